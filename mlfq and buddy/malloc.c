@@ -1,59 +1,192 @@
 #include "threads/malloc.h"
 #include <debug.h>
+#include <ksym.h>
 #include <list.h>
 #include <round.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include "threads/interrupt.h"
+#include "threads/loader.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/tunable.h"
 #include "threads/vaddr.h"
 
-/* A simple implementation of malloc().
+/* A buddy implementation of malloc().
 
    The size of each request, in bytes, is rounded up to a power
-   of 2 and assigned to the "descriptor" that manages blocks of
-   that size.  The descriptor keeps a list of free blocks.  If
-   the free list is nonempty, one of its blocks is used to
-   satisfy the request.
-
-   Otherwise, a new page of memory, called an "arena", is
-   obtained from the page allocator (if none is available,
-   malloc() returns a null pointer).  The new arena is divided
-   into blocks, all of which are added to the descriptor's free
-   list.  Then we return one of the new blocks.
-
-   When we free a block, we add it to its descriptor's free list.
-   But if the arena that the block was in now has no in-use
-   blocks, we remove all of the arena's blocks from the free list
-   and give the arena back to the page allocator.
-
-   We can't handle blocks bigger than 2 kB using this scheme,
-   because they're too big to fit in a single page with a
-   descriptor.  We handle those by allocating contiguous pages
-   with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   of 2 of at least 16 bytes and assigned to the "descriptor"
+   that manages blocks of that size, its "order".  The
+   descriptor keeps a list of the arenas (see below) that have
+   free blocks of its size.  If no descriptor of
+   a large enough order has a free block, more memory is
+   obtained from the page allocator and carved into free
+   blocks.  A block larger than the request is split in halves
+   until it fits, and the unused upper halves go onto the free
+   lists of the smaller orders.
+
+   Memory comes in "arenas", each a binary tree of blocks
+   rooted at one contiguous run of memory:
+
+   - Blocks of up to PGSIZE / 2 bytes come from one-page arenas.
+     The arena header sits at the start of the page and is
+     permanently reserved; the rest of the page is usable.
+
+   - Blocks of PGSIZE bytes and up come from "spans", runs of
+     at least SPAN_MIN_PAGES pages obtained with
+     palloc_get_multiple().  A span's pages are all usable, so
+     its header is a small block allocated separately.  Blocks
+     coalesce across page boundaries up to the whole span.
+
+   An index with an entry per page frame of RAM maps every page
+   of every arena to its header, so that free() finds a block's
+   arena in O(1) whatever kind it is.
+
+   Each header keeps two bitmaps indexed like a heap, so that
+   the node of descriptor IDX at offset OFS in arena A has
+   index (A's units >> (IDX - A->min_idx)) + OFS / block size:
+
+   - SPLIT has a bit per node bigger than the smallest block
+     that is set while the node is split into two halves.
+     Walking the set bits down from the root finds the order of
+     any block in O(orders), so allocated blocks need no size
+     tag.
+
+   - FREE has a bit per node that is set while the node is a
+     free block.  When a block is freed, its buddy's bit tells
+     whether the two coalesce, an O(1) test per order.  FREE is
+     also the arena's free list for each size: allocation takes
+     the lowest free block of the first arena on the
+     descriptor's list, so blocks are reused in address order,
+     and the arena with the most free blocks of a size is kept
+     at the front of that size's list.
+
+   When the last in-use block of an arena is freed, all of its
+   blocks have coalesced back into the blocks it started with.
+   The arena stays as it is, ready for reuse, as part of a
+   reserve of empty arenas.  Only when the reserve grows past
+   RESERVE_HIGH pages does free() itself remove an empty arena's
+   blocks from the free lists and give it back to the page
+   allocator.  Otherwise that is left to a low-priority
+   "reclaim" thread, which the timer wakes on idle ticks to
+   shrink the reserve to RESERVE_LOW pages.  When the kernel pool
+   runs low, palloc's pressure notifier wakes it to give back the
+   whole reserve.
+
+   In front of all this, the smallest orders have a "magazine"
+   of recently freed blocks.  free() parks a small block there
+   without locking or coalescing, and malloc() hands it out
+   again the same way.  The buddy system still counts parked
+   blocks as in use.  A full magazine flushes MAG_BATCH blocks
+   back to the free lists.  Pintos has a single CPU, so there is
+   one set of magazines, protected by turning interrupts off,
+   which costs less than acquiring a lock.
+
+   Optionally, the buddy system itself coalesces lazily (see
+   malloc_set_lazy()).  Then free() keeps up to a watermark of
+   blocks per order on the descriptor's lazy list, where they
+   can be reused without a split but are not marked in FREE, so
+   they do not coalesce.  Past the watermark, blocks are freed normally;
+   when no usable order has a block left, all lazy blocks are
+   coalesced before more memory is requested.
+
+   Allocations can also be tracked, for finding leaks (see
+   malloc_track_rate).  Each thread then counts the blocks of each
+   order that it has allocated less those it has freed, and one
+   allocation in every malloc_track_rate is sampled into a side
+   table, keyed by block address, with the caller's return
+   address as its site and the allocating thread.  Only sampled
+   blocks cost more than a counter update: a table insertion when
+   allocated and a probe when freed.  The table's live entries,
+   scaled up by the rate, estimate which sites hold the most
+   memory. */
 
 /* Descriptor. */
 struct desc
 {
   size_t block_size;          /* Size of each element in bytes. */
-  struct list free_list;      /* List of free blocks. */
+  struct list arenas;         /* Arenas with free blocks of this size. */
+  struct list lazy_list;      /* Freed but uncoalesced blocks. */
+  size_t lazy_cnt;            /* Number of blocks in lazy_list. */
   struct lock lock;           /* Lock. */
 };
 
 /* Magic number for detecting arena corruption. */
 #define ARENA_MAGIC 0x9a548eed
 
+/* Smallest block is 1 << MIN_SHIFT bytes. */
+#define MIN_SHIFT 4
+
+/* Most smallest blocks in any arena. */
+#define ARENA_UNITS (PGSIZE >> MIN_SHIFT)
+
+/* Number of orders served by one-page arenas: 16 B through
+   PGSIZE / 2.  This is also the descriptor index of PGSIZE. */
+#define PAGE_IDX (PGBITS - MIN_SHIFT)
+
+/* Spans hold between SPAN_MIN_PAGES and SPAN_MAX_PAGES pages;
+   the latter is the largest block malloc() can return. */
+#define SPAN_MIN_LOG 4
+#define SPAN_MAX_LOG 8
+#define SPAN_MIN_PAGES (1 << SPAN_MIN_LOG)
+#define SPAN_MAX_PAGES (1 << SPAN_MAX_LOG)
+
+/* An empty arena's pages stay reserved for reuse while the
+   reserve is at most RESERVE_HIGH pages.  Idle time trims it to
+   RESERVE_LOW pages. */
+#define RESERVE_LOW 4
+#define RESERVE_HIGH 32
+
+/* Most orders of free block in any arena. */
+#define ARENA_ORDERS (SPAN_MAX_LOG + 1)
+
+/* Orders below MAG_ORDERS (16 through 128 bytes) have a
+   magazine of up to MAG_ROUNDS blocks. */
+#define MAG_ORDERS 4
+#define MAG_ROUNDS 16
+#define MAG_BATCH (MAG_ROUNDS / 2)
+
+/* Magazine of free blocks of one order. */
+struct magazine
+{
+  unsigned cnt;                       /* Number of parked blocks. */
+  struct block *rounds[MAG_ROUNDS];   /* Parked blocks, newest last. */
+};
+
 /* Arena. */
 struct arena
 {
   unsigned magic;             /* Always set to ARENA_MAGIC. */
-  struct list_elem elem;
-  int arr[1 << (PGBITS - 1 - 4)];
+  struct list_elem elem;      /* Element in page_list or span_list. */
+  uint8_t *base;              /* Start of the root block. */
+  uint8_t min_idx;            /* Descriptor of the smallest block. */
+  uint8_t root_idx;           /* Descriptor of the root block. */
+  bool release_pending;       /* A free() is giving the arena back. */
+  unsigned used_cnt;          /* Number of in-use blocks. */
+  struct list_elem order_elems[ARENA_ORDERS];  /* In descs[].arenas. */
+  uint16_t free_cnt[ARENA_ORDERS];  /* Free blocks of each order. */
+  uint8_t split[ARENA_UNITS / 8];   /* Split bit per node above a unit. */
+  uint8_t free[ARENA_UNITS / 4];    /* Free bit per node. */
 };
 
+/* Bytes at the start of each one-page arena reserved for its
+   header. */
+#define ARENA_HDR ROUND_UP (sizeof (struct arena), 1 << MIN_SHIFT)
+
+/* One-page arenas and spans, protected by page_lock. */
 struct list page_list;
+static struct list span_list;
+static size_t page_arena_cnt;
+static struct lock page_lock;
+
+/* Arena of each page frame, or a null pointer.  An arena's
+   entries are written only when it is created and released, and
+   read only for blocks in it, so they need no lock. */
+static struct arena **arena_index;
+
 /* Free block. */
 struct block
 {
@@ -61,26 +194,168 @@ struct block
 };
 
 /* Our set of descriptors. */
-static struct desc descs[10];   /* Descriptors. */
+static struct desc descs[PAGE_IDX + SPAN_MAX_LOG + 1];   /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
+/* Summary of non-empty descriptors: bit IDX is set iff
+   descs[IDX] has at least one free or lazy block.  Lets malloc()
+   find the smallest usable order with one find-first-set and
+   take only that descriptor's lock.  Bits are changed only by
+   the holder of the matching descriptor's lock, but different
+   descriptors share the word, so updates run with interrupts
+   off. */
+static unsigned nonempty_orders;
+
+/* Magazines for the smallest orders, protected by turning
+   interrupts off. */
+static struct magazine magazines[MAG_ORDERS];
+
+/* Most blocks per order left uncoalesced, 0 to coalesce
+   eagerly. */
+static size_t lazy_watermark;
+
+/* Allocator statistics.  Per-order split and merge counts are
+   protected by the matching descriptor's lock, page counts by
+   page_lock, and everything else by turning interrupts off. */
+static struct malloc_stats stats;
+
+/* Pages in empty arenas, protected by turning interrupts off
+   like used_cnt. */
+static size_t reserve_pages;
+
+/* Reclaim thread, started the first time the reserve grows past
+   RESERVE_LOW and woken by malloc_idle_tick(). */
+static bool reclaim_started;
+static bool reclaim_wanted;
+static size_t reclaim_target;           /* Reserve to shrink to. */
+static struct palloc_notifier pressure_notifier;
+static struct semaphore reclaim_sema;
+
+/* Allocation tracking: sample one allocation in every
+   malloc_track_rate, or none if it is 0. */
+static unsigned malloc_track_rate;
+TUNABLE_UINT ("malloc.track_rate", malloc_track_rate, 0, 1 << 16,
+              "Track the caller of 1 in N allocations, 0 for none");
+
+/* A sampled block in the tracking table, which is open-addressed
+   with linear probing, kept under 3/4 full, and protected by
+   turning interrupts off. */
+#define TRACK_SLOTS 1024
+struct track
+  {
+    void *block;                /* Sampled block, or null if free. */
+    void *site;                 /* Return address of its allocation. */
+    tid_t tid;                  /* Thread that allocated it. */
+    uint8_t idx;                /* Its order. */
+  };
+static struct track tracks[TRACK_SLOTS];
+static size_t track_cnt;        /* Slots in use. */
+static size_t track_dropped;    /* Samples lost to a full table. */
+static unsigned track_countdown; /* Allocations until next sample. */
+static struct lock sites_lock;  /* Serializes print_sites(). */
+
 static struct arena *block_to_arena (struct block *);
-// static struct block *arena_to_block (struct arena *, size_t idx);
+static void desc_push (struct desc *, struct block *);
+static struct block *desc_pop (struct desc *, bool *lazy);
+static void desc_remove (struct desc *, struct block *);
+static void desc_take (struct desc *, struct arena *, struct block *);
+static void desc_update_summary (struct desc *);
+static bool arena_create (void);
+static bool span_create (size_t idx);
+static void arena_release (struct arena *);
+static void *buddy_alloc (size_t idx);
+static void buddy_free (struct arena *, size_t ofs, size_t idx,
+                        bool may_defer);
+static bool lazy_flush (void);
+static size_t arena_pages (struct arena *);
+static void arena_index_set (struct arena *, struct arena *value);
+static void reclaim_thread (void *aux);
+static palloc_notify_func malloc_pressure;
+static void stats_add_pages (size_t page_cnt);
+static size_t block_order (struct arena *, size_t ofs);
+static bool map_test (struct arena *, const uint8_t *, size_t idx,
+                      size_t ofs);
+static void map_flip (struct arena *, uint8_t *, size_t idx, size_t ofs);
+static size_t map_find (struct arena *, const uint8_t *, size_t idx,
+                        size_t ofs);
+static void *malloc_at (size_t, void *site);
+static void track_alloc (void *, size_t idx, void *site);
+static void track_free (void *, size_t idx);
+static void track_resize (void *, size_t old_idx, size_t new_idx);
 
 /* Initializes the malloc() descriptors. */
 void
 malloc_init (void)
 {
   size_t block_size;
-  for (block_size = 16; block_size <= PGSIZE / 2; block_size *= 2)
+  ASSERT (ARENA_HDR < PGSIZE / 2);
+  ASSERT (PAGE_IDX <= ARENA_ORDERS);
+  ASSERT (sizeof descs / sizeof *descs == MALLOC_ORDERS);
+  for (block_size = 1 << MIN_SHIFT;
+       block_size <= (size_t) PGSIZE * SPAN_MAX_PAGES; block_size *= 2)
   {
     struct desc *d = &descs[desc_cnt++];
     ASSERT (desc_cnt <= sizeof descs / sizeof * descs);
     d->block_size = block_size;
-    list_init (&d->free_list);
-    lock_init (&d->lock);
+    list_init (&d->arenas);
+    list_init (&d->lazy_list);
+    d->lazy_cnt = 0;
+    lock_init_named (&d->lock, "malloc desc");
   }
   list_init(&page_list);
+  list_init (&span_list);
+  lock_init (&page_lock);
+  lock_init (&sites_lock);
+  arena_index = palloc_get_multiple (PAL_ASSERT | PAL_ZERO,
+                                     DIV_ROUND_UP (init_ram_pages
+                                                   * sizeof *arena_index,
+                                                   PGSIZE));
+  sema_init (&reclaim_sema, 0);
+  reclaim_target = RESERVE_LOW;
+  palloc_register_notifier (&pressure_notifier, malloc_pressure, NULL);
+}
+
+/* Called by the timer interrupt handler on each tick spent in
+   the idle thread.  Wakes the reclaim thread if the reserve of
+   empty arenas is above RESERVE_LOW. */
+void
+malloc_idle_tick (void)
+{
+  if (reclaim_started && !reclaim_wanted && reserve_pages > RESERVE_LOW) {
+    reclaim_wanted = true;
+    sema_up (&reclaim_sema);
+  }
+}
+
+/* Called by palloc when POOL runs low on free pages.  Wakes the
+   reclaim thread to give back every empty arena, if it is
+   running. */
+static void
+malloc_pressure (enum palloc_flags pool, size_t free_cnt UNUSED,
+                 void *aux UNUSED)
+{
+  enum intr_level old_level;
+
+  if (pool & PAL_USER)
+    return;
+  old_level = intr_disable ();
+  reclaim_target = 0;
+  if (reclaim_started && !reclaim_wanted && reserve_pages > 0) {
+    reclaim_wanted = true;
+    sema_up (&reclaim_sema);
+  }
+  intr_set_level (old_level);
+}
+
+/* Sets the number of freed blocks of each order that the buddy
+   system may keep without coalescing to WATERMARK.  Zero, the
+   default, coalesces every block as soon as it is freed. */
+void
+malloc_set_lazy (size_t watermark)
+{
+  lazy_watermark = watermark;
+  if (watermark == 0)
+    lazy_flush ();
 }
 
 /* Obtains and returns a new block of at least SIZE bytes.
@@ -88,52 +363,141 @@ malloc_init (void)
 void *
 malloc (size_t size)
 {
-  ASSERT(size <= PGSIZE / 2);
-  if (size == 0 || size > PGSIZE / 2) return NULL; // not to be handled
+  return malloc_at (size, __builtin_return_address (0));
+}
+
+/* Does the work of malloc() and the functions built on it, which
+   pass the address their caller will return to as SITE, for
+   tracking. */
+static void *
+malloc_at (size_t size, void *site)
+{
+  if (size == 0 || size > descs[desc_cnt - 1].block_size) return NULL;
+
+  size_t idx = 0;
+
+  /* Find the smallest descriptor that satisfies a SIZE-byte
+     request. */
+  while (descs[idx].block_size < size) ++idx;
+
+  /* Reuse a parked block if there is one. */
+  struct block *b = NULL;
+  enum intr_level old_level;
+  if (idx < MAG_ORDERS) {
+    struct magazine *m = &magazines[idx];
+    old_level = intr_disable ();
+    if (m->cnt > 0)
+      b = m->rounds[--m->cnt];
+    intr_set_level (old_level);
+  }
+  if (b == NULL)
+    b = buddy_alloc (idx);
+  if (b == NULL)
+    return NULL;
+
+  old_level = intr_disable ();
+  stats.alloc_cnt[idx]++;
+  stats.requested_bytes += size;
+  stats.rounded_bytes += descs[idx].block_size;
+  stats.used_bytes += descs[idx].block_size;
+  if (stats.used_bytes > stats.peak_used_bytes)
+    stats.peak_used_bytes = stats.used_bytes;
+  if (malloc_track_rate != 0)
+    track_alloc (b, idx, site);
+  intr_set_level (old_level);
+  return b;
+}
+
+/* Obtains and returns a new block of at least SIZE bytes whose
+   address is a multiple of ALIGN, which must be a power of 2 no
+   bigger than PGSIZE.  The block is freed with free() as usual.
+   Returns a null pointer if memory is not available.
+
+   Every buddy block is aligned to its own size, up to a page,
+   because arenas start on page boundaries and blocks sit at
+   multiples of their size within them.  So it is enough to ask
+   for at least ALIGN bytes. */
+void *
+malloc_aligned (size_t align, size_t size)
+{
+  ASSERT (align != 0 && (align & (align - 1)) == 0);
+  ASSERT (align <= PGSIZE);
+
+  return malloc_at (size < align ? align : size,
+                    __builtin_return_address (0));
+}
 
+/* Takes a block of descriptor IDX from the buddy system, getting
+   more memory from the page allocator if necessary.  Returns a
+   null pointer if memory is not available. */
+static void *
+buddy_alloc (size_t idx)
+{
   struct desc *d;
   struct block *b;
   struct arena *a;
+  size_t ofs;
+  unsigned usable;
 
-  /* Find the smallest descriptor that satisfies a SIZE-byte
-     request. */
+  /* Find the smallest descriptor of at least order IDX that has
+     a free or lazy block.  One-page arenas cannot be split into
+     pages, nor spans below a page, so only orders of the right
+     kind of arena qualify.  If none does, coalesce the lazy
+     blocks of all orders before getting more memory.  The
+     summary bitmap can be stale by the time we hold the lock, so
+     recheck and retry. */
+  if (idx < PAGE_IDX)
+    usable = ((1u << PAGE_IDX) - 1) & ~((1u << idx) - 1);
+  else
+    usable = ((1u << desc_cnt) - 1) & ~((1u << idx) - 1);
+  for (;;) {
+    unsigned orders = nonempty_orders & usable;
+    bool lazy;
 
-  for (d = descs; d < descs + desc_cnt; d++) {
-    lock_acquire(&d->lock);
-    if (d->block_size >= size && !list_empty(&d->free_list)) {
-      b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
-      lock_release(&d->lock);
-      a = block_to_arena(b);
-      break;
-    }
-    lock_release(&d->lock);
-    if (d == descs + desc_cnt - 1) {
-      /* Allocate a page. */
-      a = palloc_get_page (0);
-      if (a == NULL)
+    if (orders == 0) {
+      if (lazy_flush ())
+        continue;
+      if (!(idx < PAGE_IDX ? arena_create () : span_create (idx)))
         return NULL;
-      list_push_back(&page_list, &(a->elem));
-      /* Initialize arena and add its blocks to the free list. */
-      a->magic = ARENA_MAGIC;
-      memset(a->arr, 0, sizeof a->arr);
-      lock_acquire(&d->lock);
-      list_push_back(&descs[7].free_list, (struct list_elem *) ((void *) a + sizeof(*a)));
-      b = list_entry (list_pop_front (&descs[7].free_list), struct block, free_elem);
+      continue;
+    }
+    d = descs + __builtin_ctz (orders);
+    lock_acquire_adaptive(&d->lock);
+    b = desc_pop (d, &lazy);
+    if (b != NULL) {
+      a = block_to_arena(b);
+      ofs = (uint8_t *) b - a->base;
+
+      /* Count the block as in use before dropping the lock, so
+         that a concurrent free() cannot give the arena away.  A
+         lazy block never stopped counting. */
+      if (!lazy) {
+        enum intr_level old_level = intr_disable ();
+        if (a->used_cnt++ == 0)
+          reserve_pages -= arena_pages (a);
+        intr_set_level (old_level);
+      }
+      if (d > descs + idx) {
+        map_flip (a, a->split, d - descs, ofs);
+        stats.split_cnt[d - descs]++;
+      }
       lock_release(&d->lock);
       break;
     }
+    lock_release(&d->lock);
   }
-  while (1) {
-    if (d->block_size == 16)  break;
-    if (d->block_size >= 2 * size) {
-      d = d - 1;
-      lock_acquire(&d->lock);
-      list_push_back(&(d->free_list), (struct list_elem *)(((void *)b) + d->block_size));
-      lock_release(&d->lock);
+
+  /* Split off upper halves until the block fits. */
+  while (d > descs + idx) {
+    d = d - 1;
+    lock_acquire_adaptive(&d->lock);
+    desc_push (d, (struct block *)(((void *)b) + d->block_size));
+    if (d > descs + idx) {
+      map_flip (a, a->split, d - descs, ofs);
+      stats.split_cnt[d - descs]++;
     }
-    else break;
+    lock_release(&d->lock);
   }
-  a->arr[((void *)b - (void *)a - sizeof(*a)) >> 4] = d->block_size;
   return b;
 }
 
@@ -151,7 +515,7 @@ calloc (size_t a, size_t b)
     return NULL;
 
   /* Allocate and zero memory. */
-  p = malloc (size);
+  p = malloc_at (size, __builtin_return_address (0));
   if (p != NULL)
     memset (p, 0, size);
 
@@ -165,7 +529,78 @@ block_size (void *block)
   struct block *b = block;
   struct arena *a = block_to_arena (b);
 
-  return a->arr[((void *)b - (void *)a - sizeof(*a)) >> 4];
+  return descs[block_order (a, (uint8_t *) b - a->base)].block_size;
+}
+
+/* Resizes BLOCK in place to fit at least NEW_SIZE bytes, if
+   possible.  Shrinking splits off upper halves onto the free
+   lists.  Growing absorbs the free upper buddies of each order
+   up to the new one, so it only works if BLOCK is the lower half
+   at each step and all of those buddies are free.  Returns true
+   if successful, false if BLOCK must be moved instead. */
+static bool
+block_resize (void *block, size_t new_size)
+{
+  struct block *b = block;
+  struct arena *a = block_to_arena (b);
+  size_t ofs = (uint8_t *) b - a->base;
+  size_t idx = block_order (a, ofs);
+  size_t new_idx = a->min_idx, i;
+  enum intr_level old_level;
+  bool ok = true;
+
+  if (new_size > descs[desc_cnt - 1].block_size)
+    return false;
+  while (descs[new_idx].block_size < new_size) ++new_idx;
+
+  if (new_idx < idx) {
+    /* Split off upper halves, as in buddy_alloc(). */
+    for (i = idx; i > new_idx; i--) {
+      struct block *upper = (struct block *) (a->base + ofs
+                                              + descs[i - 1].block_size);
+      lock_acquire(&descs[i].lock);
+      map_flip (a, a->split, i, ofs);
+      stats.split_cnt[i]++;
+      lock_release(&descs[i].lock);
+#ifndef NDEBUG
+      memset (upper, 0xcc, descs[i - 1].block_size);
+#endif
+      lock_acquire(&descs[i - 1].lock);
+      desc_push (&descs[i - 1], upper);
+      lock_release(&descs[i - 1].lock);
+    }
+  }
+  else if (new_idx > idx) {
+    /* Check every buddy in turn with all their descriptors
+       locked, ascending like arena_release(), then take them. */
+    if (new_idx > a->root_idx || (ofs & (descs[new_idx].block_size - 1)) != 0)
+      return false;
+    for (i = idx; i < new_idx; i++)
+      lock_acquire(&descs[i].lock);
+    for (i = idx; i < new_idx && ok; i++)
+      ok = map_test (a, a->free, i, ofs + descs[i].block_size);
+    if (ok)
+      for (i = idx; i < new_idx; i++) {
+        desc_take (&descs[i], a,
+                   (struct block *) (a->base + ofs + descs[i].block_size));
+        map_flip (a, a->split, i + 1, ofs);
+        stats.merge_cnt[i]++;
+      }
+    for (i = new_idx; i-- > idx; )
+      lock_release(&descs[i].lock);
+    if (!ok)
+      return false;
+  }
+
+  old_level = intr_disable ();
+  stats.used_bytes += descs[new_idx].block_size;
+  stats.used_bytes -= descs[idx].block_size;
+  if (stats.used_bytes > stats.peak_used_bytes)
+    stats.peak_used_bytes = stats.used_bytes;
+  if (malloc_track_rate != 0)
+    track_resize (block, idx, new_idx);
+  intr_set_level (old_level);
+  return true;
 }
 
 /* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
@@ -173,7 +608,9 @@ block_size (void *block)
    If successful, returns the new block; on failure, returns a
    null pointer.
    A call with null OLD_BLOCK is equivalent to malloc(NEW_SIZE).
-   A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK). */
+   A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK).
+   The block is resized in place where the buddy system allows
+   it, and moved only otherwise. */
 void *
 realloc (void *old_block, size_t new_size)
 {
@@ -182,9 +619,11 @@ realloc (void *old_block, size_t new_size)
     free (old_block);
     return NULL;
   }
+  else if (old_block != NULL && block_resize (old_block, new_size))
+    return old_block;
   else
   {
-    void *new_block = malloc (new_size);
+    void *new_block = malloc_at (new_size, __builtin_return_address (0));
     if (old_block != NULL && new_block != NULL)
     {
       size_t old_size = block_size (old_block);
@@ -205,102 +644,1039 @@ free (void *p)
 
   struct block *b = p;
   struct arena *a = block_to_arena (b);
-  size_t b_sz = block_size(b);
+  size_t ofs = (uint8_t *) b - a->base;
+  size_t idx = block_order (a, ofs);
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  stats.free_cnt[idx]++;
+  stats.used_bytes -= descs[idx].block_size;
+  if (malloc_track_rate != 0)
+    track_free (b, idx);
+  intr_set_level (old_level);
 
 #ifndef NDEBUG
   /* Clear the block to help detect use-after-free bugs. */
-  memset (b, 0xcc, b_sz);
+  memset (b, 0xcc, descs[idx].block_size);
 #endif
 
-  a->arr[((void *)b - (void *)a - sizeof(*a)) >> 4] = 0;  // reset to 0
-  int idx = 0;
-  while (b_sz > (1ul << (idx + 4))) ++idx;
+  /* Park small blocks in their magazine.  If it is full, flush
+     its oldest blocks to make room. */
+  if (idx < MAG_ORDERS) {
+    struct magazine *m = &magazines[idx];
+    struct block *flush[MAG_BATCH];
+    size_t flush_cnt = 0, i;
+    old_level = intr_disable ();
+    if (m->cnt == MAG_ROUNDS) {
+      flush_cnt = MAG_BATCH;
+      memcpy (flush, m->rounds, sizeof flush);
+      m->cnt -= MAG_BATCH;
+      memmove (m->rounds, m->rounds + MAG_BATCH,
+               m->cnt * sizeof *m->rounds);
+    }
+    m->rounds[m->cnt++] = b;
+    intr_set_level (old_level);
 
-  while (1) {
-    if (b_sz == PGSIZE / 2) {
-      list_remove(&(a->elem));
-      palloc_free_page (a);
-      break;
+    for (i = 0; i < flush_cnt; i++) {
+      a = block_to_arena (flush[i]);
+      buddy_free (a, (uint8_t *) flush[i] - a->base, idx, true);
     }
-    struct block *buddy = (struct block *)((((size_t)b - (size_t)a - sizeof *a) ^ b_sz) + (size_t)a + sizeof *a);
-    size_t i = 0;
-    for (; i < b_sz; i += 16) {
-      if (a->arr[((void *)buddy - (void *)a - sizeof(*a) + i) >> 4]) {
-        i = 1;
-        break;
-      }
+    return;
+  }
+  buddy_free (a, ofs, idx, true);
+}
+
+/* Returns the block at offset OFS in arena A, of descriptor
+   IDX, to the buddy system.  If MAY_DEFER and lazy coalescing
+   has room at this order, the block goes on the lazy list
+   instead of coalescing and stays counted as in use. */
+static void
+buddy_free (struct arena *a, size_t ofs, size_t idx, bool may_defer)
+{
+  bool merged = false, release = false, reclaim = false;
+  enum intr_level old_level;
+
+  /* Coalesce with free buddies as far as possible.  The header
+     keeps the root of a one-page arena from ever becoming free;
+     a span's root becomes free once the span is empty. */
+  for (;;) {
+    struct desc *d = &descs[idx];
+    lock_acquire_adaptive(&d->lock);
+    if (may_defer && d->lazy_cnt < lazy_watermark) {
+      struct block *b = (struct block *) (a->base + ofs);
+      list_push_back (&d->lazy_list, &b->free_elem);
+      if (d->lazy_cnt++ == 0)
+        desc_update_summary (d);
+      lock_release(&d->lock);
+      return;
     }
-    if (i == 1) {
-      lock_acquire(&descs[idx].lock);
-      list_push_back(&descs[idx].free_list, (struct list_elem *)b);
-      lock_release(&descs[idx].lock);
-      break;
+    may_defer = false;
+    if (merged)
+      map_flip (a, a->split, idx, ofs);
+    if (idx < a->root_idx
+        && map_test (a, a->free, idx, ofs ^ d->block_size)) {
+      desc_remove (d, (struct block *) (a->base + (ofs ^ d->block_size)));
+      stats.merge_cnt[idx]++;
+      lock_release(&d->lock);
+      ofs &= ~d->block_size;
+      idx++;
+      merged = true;
+      continue;
+    }
+    desc_push (d, (struct block *) (a->base + ofs));
+    lock_release(&d->lock);
+    break;
+  }
+
+  /* An emptied arena joins the reserve.  If that makes the
+     reserve too big, the first free() to empty the arena gives it
+     back. */
+  old_level = intr_disable ();
+  if (--a->used_cnt == 0) {
+    reserve_pages += arena_pages (a);
+    release = reserve_pages > RESERVE_HIGH && !a->release_pending;
+    if (release)
+      a->release_pending = true;
+    reclaim = reserve_pages > RESERVE_LOW && !reclaim_started;
+    if (reclaim)
+      reclaim_started = true;
+  }
+  intr_set_level (old_level);
+  if (release)
+    arena_release (a);
+  if (reclaim)
+    thread_create ("reclaim", PRI_MIN, reclaim_thread, NULL);
+}
+
+/* Sets the index entries of the pages of arena A to VALUE. */
+static void
+arena_index_set (struct arena *a, struct arena *value)
+{
+  size_t frame = vtop (a->base) >> PGBITS;
+  size_t i;
+
+  for (i = 0; i < arena_pages (a); i++)
+    arena_index[frame + i] = value;
+}
+
+/* Returns the number of free bytes in arena A, in O(orders).
+   The counts are not locked, so the result is only a snapshot. */
+static size_t
+arena_free_bytes (struct arena *a)
+{
+  size_t bytes = 0;
+  size_t i;
+
+  for (i = a->min_idx; i <= a->root_idx; i++)
+    bytes += (size_t) a->free_cnt[i - a->min_idx] * descs[i].block_size;
+  return bytes;
+}
+
+/* Returns the number of pages in arena A. */
+static size_t
+arena_pages (struct arena *a)
+{
+  return a->base == (uint8_t *) a ? 1 : 1 << (a->root_idx - PAGE_IDX);
+}
+
+/* Finds an empty arena on LIST that no free() is giving back,
+   and marks it so that we are the one to do it.  Returns a null
+   pointer if there is none.  page_lock must be held. */
+static struct arena *
+reclaim_find (struct list *list)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (list); e != list_end (list); e = list_next (e)) {
+    struct arena *a = list_entry (e, struct arena, elem);
+    enum intr_level old_level = intr_disable ();
+    bool found = a->used_cnt == 0 && !a->release_pending;
+    if (found)
+      a->release_pending = true;
+    intr_set_level (old_level);
+    if (found)
+      return a;
+  }
+  return NULL;
+}
+
+/* Gives empty arenas back to the page allocator whenever
+   malloc_idle_tick() finds the reserve above RESERVE_LOW. */
+static void
+reclaim_thread (void *aux UNUSED)
+{
+  for (;;) {
+    sema_down (&reclaim_sema);
+    while (reserve_pages > reclaim_target) {
+      struct arena *a;
+
+      lock_acquire (&page_lock);
+      a = reclaim_find (&span_list);
+      if (a == NULL)
+        a = reclaim_find (&page_list);
+      lock_release (&page_lock);
+      if (a == NULL)
+        break;
+      arena_release (a);
     }
-    struct block *nb = b < buddy ? b : buddy;
-    lock_acquire(&descs[idx].lock);
-    list_remove((struct list_elem *)buddy);
-    lock_release(&descs[idx].lock);
-    idx++;
-    b_sz <<= 1;
-    b = nb;
+    reclaim_target = RESERVE_LOW;
+    reclaim_wanted = false;
   }
 }
-
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b)
 {
-  struct arena *a = pg_round_down (b);
+  struct arena *a = arena_index[vtop (b) >> PGBITS];
 
   /* Check that the arena is valid. */
   ASSERT (a != NULL);
   ASSERT (a->magic == ARENA_MAGIC);
 
   /* Check that the block is properly aligned for the arena. */
-  // ASSERT (a->desc == NULL
-  //         || (pg_ofs (b) - sizeof * a) % a->desc->block_size == 0);
-  // ASSERT (a->desc != NULL || pg_ofs (b) == sizeof * a);
+  ASSERT (a->base != (uint8_t *) a || pg_ofs (b) >= ARENA_HDR);
+  ASSERT (((uint8_t *) b - a->base) % descs[a->min_idx].block_size == 0);
 
   return a;
 }
 
-/* Returns the (IDX - 1)'th block within arena A. */
-// static struct block *
-// arena_to_block (struct arena *a, size_t idx)
-// {
-//   ASSERT (a != NULL);
-//   ASSERT (a->magic == ARENA_MAGIC);
-// ASSERT (idx < a->desc->blocks_per_arena);
-//   return (struct block *) ((uint8_t *) a
-//                            + sizeof * a
-//                            + idx * a->desc->block_size);
-// }
-bool cmp_addr(const struct list_elem *a, const struct list_elem *b, void *aux) {
-  return a < b;
+/* Returns the bit index in A's bitmaps of the node of
+   descriptor IDX that contains offset OFS.  Only FREE has bits
+   for nodes of A's smallest block size. */
+static inline size_t
+map_index (struct arena *a, size_t idx, size_t ofs)
+{
+  size_t units = 1 << (a->root_idx - a->min_idx);
+  return (units >> (idx - a->min_idx)) + (ofs >> (idx + MIN_SHIFT));
+}
+
+/* Tests the bit for the node of descriptor IDX that contains
+   OFS in MAP, one of A's bitmaps. */
+static bool
+map_test (struct arena *a, const uint8_t *map, size_t idx, size_t ofs)
+{
+  size_t i = map_index (a, idx, ofs);
+  return (map[i / 8] >> (i % 8)) & 1;
+}
+
+/* Flips the bit for the node of descriptor IDX that contains
+   OFS in MAP, one of A's bitmaps.  The caller holds the lock
+   for the order that owns the bit, but bits of different
+   orders can share a byte, so the flip runs with interrupts
+   off. */
+static void
+map_flip (struct arena *a, uint8_t *map, size_t idx, size_t ofs)
+{
+  size_t i = map_index (a, idx, ofs);
+  enum intr_level old_level = intr_disable ();
+  map[i / 8] ^= 1 << (i % 8);
+  intr_set_level (old_level);
+}
+
+/* Returns the offset of the first node of descriptor IDX at or
+   after offset OFS whose bit is set in MAP, one of A's bitmaps,
+   or the size of A if there is none. */
+static size_t
+map_find (struct arena *a, const uint8_t *map, size_t idx, size_t ofs)
+{
+  size_t size = descs[a->root_idx].block_size;
+  size_t first = map_index (a, idx, 0);
+  size_t i;
+
+  if (ofs >= size)
+    return size;
+  for (i = map_index (a, idx, ofs); i < 2 * first; i = ROUND_UP (i + 1, 8)) {
+    unsigned bits = map[i / 8] >> (i % 8);
+    if (bits != 0) {
+      i += __builtin_ctz (bits);
+      if (i < 2 * first)
+        return (i - first) * descs[idx].block_size;
+      break;
+    }
+  }
+  return size;
+}
+
+/* Returns the descriptor index of the in-use block at offset
+   OFS in arena A by walking split nodes down from the root. */
+static size_t
+block_order (struct arena *a, size_t ofs)
+{
+  size_t idx = a->root_idx;
+
+  while (idx > a->min_idx && map_test (a, a->split, idx, ofs))
+    idx--;
+  return idx;
+}
+
+/* Calls FUNC on each block an empty arena A is made of: the
+   largest aligned blocks that fill it after the header, if
+   any. */
+static void
+arena_for_each_block (struct arena *a, void (*func) (struct desc *,
+                                                     struct block *))
+{
+  size_t size = descs[a->root_idx].block_size;
+  size_t ofs = a->base == (uint8_t *) a ? ARENA_HDR : 0;
+
+  if (ofs == 0)
+    func (&descs[a->root_idx], (struct block *) a->base);
+  else
+    while (ofs < size) {
+      size_t idx = __builtin_ctz (ofs) - MIN_SHIFT;
+      func (&descs[idx], (struct block *) (a->base + ofs));
+      ofs += descs[idx].block_size;
+    }
+}
+
+/* Adds B to D's free list, taking D's lock. */
+static void
+desc_push_locked (struct desc *d, struct block *b)
+{
+  lock_acquire_adaptive (&d->lock);
+  desc_push (d, b);
+  lock_release (&d->lock);
+}
+
+/* Obtains a page from the page allocator and adds its blocks to
+   the free lists.  Returns false if no page is available.  The
+   page may be borrowed from palloc's contiguous region, since
+   the reclaim thread gives pages back under memory pressure. */
+static bool
+arena_create (void)
+{
+  struct arena *a = palloc_get_page (PAL_MOVABLE);
+  enum intr_level old_level;
+  size_t idx;
+
+  if (a == NULL)
+    return false;
+
+  /* The nodes that straddle the end of the header are split;
+     no block is free yet. */
+  memset (a, 0, sizeof *a);
+  a->magic = ARENA_MAGIC;
+  a->base = (uint8_t *) a;
+  a->min_idx = 0;
+  a->root_idx = PAGE_IDX;
+  for (idx = 1; idx <= PAGE_IDX; idx++)
+    if (ARENA_HDR % descs[idx].block_size != 0)
+      map_flip (a, a->split, idx, ARENA_HDR);
+
+  old_level = intr_disable ();
+  reserve_pages += arena_pages (a);
+  intr_set_level (old_level);
+
+  arena_index_set (a, a);
+  lock_acquire (&page_lock);
+  list_push_back (&page_list, &a->elem);
+  page_arena_cnt++;
+  stats_add_pages (1);
+  lock_release (&page_lock);
+
+  arena_for_each_block (a, desc_push_locked);
+  return true;
+}
+
+/* Obtains a span from the page allocator big enough for a block
+   of descriptor IDX and adds it to the free lists.  Prefers
+   spans of at least SPAN_MIN_PAGES pages, but settles for a
+   smaller one if contiguous pages are scarce.  Returns false if
+   no span is available. */
+static bool
+span_create (size_t idx)
+{
+  size_t root_idx = idx < PAGE_IDX + SPAN_MIN_LOG ? PAGE_IDX + SPAN_MIN_LOG : idx;
+  enum intr_level old_level;
+  struct arena *a;
+  void *pages;
+
+  a = malloc (sizeof *a);
+  if (a == NULL)
+    return false;
+  for (;; root_idx--) {
+    pages = palloc_get_multiple (PAL_CONTIG, 1 << (root_idx - PAGE_IDX));
+    if (pages != NULL || root_idx == idx)
+      break;
+  }
+  if (pages == NULL) {
+    free (a);
+    return false;
+  }
+
+  memset (a, 0, sizeof *a);
+  a->magic = ARENA_MAGIC;
+  a->base = pages;
+  a->min_idx = PAGE_IDX;
+  a->root_idx = root_idx;
+
+  old_level = intr_disable ();
+  reserve_pages += arena_pages (a);
+  intr_set_level (old_level);
+
+  arena_index_set (a, a);
+  lock_acquire (&page_lock);
+  list_push_back (&span_list, &a->elem);
+  stats_add_pages (arena_pages (a));
+  lock_release (&page_lock);
+
+  arena_for_each_block (a, desc_push_locked);
+  return true;
+}
+
+/* Gives arena A back to the page allocator if it is still
+   empty.  Called by whoever set A's release_pending.
+   All descriptor locks are taken, in order, so that no block of
+   A can be allocated meanwhile. */
+static void
+arena_release (struct arena *a)
+{
+  enum intr_level old_level;
+  bool empty;
+  size_t i;
+
+  for (i = 0; i < desc_cnt; i++)
+    lock_acquire (&descs[i].lock);
+
+  old_level = intr_disable ();
+  empty = a->used_cnt == 0;
+  a->release_pending = empty;
+  if (empty)
+    reserve_pages -= arena_pages (a);
+  intr_set_level (old_level);
+  if (empty)
+    arena_for_each_block (a, desc_remove);
+
+  for (i = desc_cnt; i-- > 0; )
+    lock_release (&descs[i].lock);
+
+  if (empty) {
+    lock_acquire (&page_lock);
+    list_remove (&a->elem);
+    if (a->base == (uint8_t *) a)
+      page_arena_cnt--;
+    stats.pages -= arena_pages (a);
+    lock_release (&page_lock);
+    arena_index_set (a, NULL);
+    a->magic = 0;
+    if (a->base == (uint8_t *) a)
+      palloc_free_page (a);
+    else {
+      palloc_free_multiple (a->base, 1 << (a->root_idx - PAGE_IDX));
+      free (a);
+    }
+  }
+}
+
+/* Coalesces every block on the lazy lists.  Returns true if
+   there were any. */
+static bool
+lazy_flush (void)
+{
+  bool flushed = false;
+  size_t idx;
+
+  for (idx = 0; idx < desc_cnt; idx++) {
+    struct desc *d = &descs[idx];
+    for (;;) {
+      struct block *b = NULL;
+      struct arena *a;
+
+      lock_acquire_adaptive (&d->lock);
+      if (!list_empty (&d->lazy_list)) {
+        b = list_entry (list_pop_front (&d->lazy_list), struct block,
+                        free_elem);
+        if (--d->lazy_cnt == 0)
+          desc_update_summary (d);
+      }
+      lock_release (&d->lock);
+      if (b == NULL)
+        break;
+
+      a = block_to_arena (b);
+      buddy_free (a, (uint8_t *) b - a->base, idx, false);
+      flushed = true;
+    }
+  }
+  return flushed;
+}
+
+/* Records in nonempty_orders whether D has free or lazy blocks.
+   D's lock must be held. */
+static void
+desc_update_summary (struct desc *d)
+{
+  unsigned bit = 1u << (d - descs);
+  enum intr_level old_level = intr_disable ();
+  if (list_empty (&d->arenas) && list_empty (&d->lazy_list))
+    nonempty_orders &= ~bit;
+  else
+    nonempty_orders |= bit;
+  intr_set_level (old_level);
+}
+
+/* Returns the arena whose element for D's order is E. */
+static struct arena *
+desc_arena (struct desc *d, struct list_elem *e)
+{
+  size_t idx = d - descs;
+  size_t k = idx < PAGE_IDX ? idx : idx - PAGE_IDX;
+
+  return list_entry (e, struct arena, order_elems[k]);
+}
+
+/* Marks B free in its arena and, if needed, adds the arena to
+   D's list.  An arena that now has more free blocks of this size
+   than the first one moves to the front.  D's lock must be
+   held. */
+static void
+desc_push (struct desc *d, struct block *b)
+{
+  struct arena *a = block_to_arena (b);
+  size_t idx = d - descs, k = idx - a->min_idx;
+  struct list_elem *e = &a->order_elems[k];
+
+  ASSERT (lock_held_by_current_thread (&d->lock));
+  map_flip (a, a->free, idx, (uint8_t *) b - a->base);
+  if (a->free_cnt[k]++ == 0) {
+    list_push_back (&d->arenas, e);
+    if (list_begin (&d->arenas) == e)
+      desc_update_summary (d);
+  }
+  else if (list_begin (&d->arenas) != e
+           && (a->free_cnt[k]
+               > desc_arena (d, list_begin (&d->arenas))->free_cnt[k])) {
+    list_remove (e);
+    list_push_front (&d->arenas, e);
+  }
+}
+
+/* Marks free block B in arena A as in use and, if it was A's
+   last free block of this size, takes A off D's list.  D's lock
+   must be held. */
+static void
+desc_take (struct desc *d, struct arena *a, struct block *b)
+{
+  size_t idx = d - descs, k = idx - a->min_idx;
+
+  ASSERT (lock_held_by_current_thread (&d->lock));
+  map_flip (a, a->free, idx, (uint8_t *) b - a->base);
+  if (--a->free_cnt[k] == 0) {
+    list_remove (&a->order_elems[k]);
+    if (list_empty (&d->arenas) && list_empty (&d->lazy_list))
+      desc_update_summary (d);
+  }
+}
+
+/* Takes and returns a block from D's lazy list or, if that is
+   empty, the lowest free block of D's first arena, setting *LAZY
+   to tell which.  Returns a null pointer if there is neither.
+   D's lock must be held. */
+static struct block *
+desc_pop (struct desc *d, bool *lazy)
+{
+  struct block *b;
+
+  ASSERT (lock_held_by_current_thread (&d->lock));
+  *lazy = !list_empty (&d->lazy_list);
+  if (*lazy) {
+    b = list_entry (list_pop_front (&d->lazy_list), struct block, free_elem);
+    if (--d->lazy_cnt == 0 && list_empty (&d->arenas))
+      desc_update_summary (d);
+  }
+  else if (!list_empty (&d->arenas)) {
+    struct arena *a = desc_arena (d, list_front (&d->arenas));
+    b = (struct block *) (a->base + map_find (a, a->free, d - descs, 0));
+    desc_take (d, a, b);
+  }
+  else
+    return NULL;
+  return b;
+}
+
+/* Marks free block B as in use.  D's lock must be held. */
+static void
+desc_remove (struct desc *d, struct block *b)
+{
+  desc_take (d, block_to_arena (b), b);
+}
+
+/* Counts PAGE_CNT more pages as obtained from the page
+   allocator.  page_lock must be held. */
+static void
+stats_add_pages (size_t page_cnt)
+{
+  stats.pages += page_cnt;
+  if (stats.pages > stats.peak_pages)
+    stats.peak_pages = stats.pages;
+}
+
+/* Copies the allocator's statistics into *S. */
+void
+malloc_stats (struct malloc_stats *s)
+{
+  enum intr_level old_level = intr_disable ();
+  *s = stats;
+  intr_set_level (old_level);
+}
+
+/* Prints the allocator's statistics, one line per order that
+   has seen any use. */
+void
+malloc_print_stats (void)
+{
+  struct malloc_stats s;
+  size_t i;
+
+  malloc_stats (&s);
+  printf ("malloc: %zu pages (peak %zu), %zu bytes in use (peak %zu)\n",
+          s.pages, s.peak_pages, s.used_bytes, s.peak_used_bytes);
+  printf ("malloc: %zu bytes requested, %zu lost to rounding\n",
+          s.requested_bytes, s.rounded_bytes - s.requested_bytes);
+  for (i = 0; i < desc_cnt; i++)
+    if (s.alloc_cnt[i] || s.split_cnt[i] || s.merge_cnt[i])
+      printf ("malloc: %7zu bytes: %zu allocs, %zu frees, "
+              "%zu splits, %zu merges\n", descs[i].block_size,
+              s.alloc_cnt[i], s.free_cnt[i], s.split_cnt[i],
+              s.merge_cnt[i]);
+}
+
+/* Returns the slot of the tracking table where BLOCK's probe
+   sequence starts. */
+static size_t
+track_hash (const void *block)
+{
+  return ((uintptr_t) block >> MIN_SHIFT) * 2654435761u % TRACK_SLOTS;
+}
+
+/* Returns BLOCK's slot in the tracking table, or the free slot
+   that ends its probe sequence if it is not there. */
+static struct track *
+track_find (const void *block)
+{
+  size_t i = track_hash (block);
+
+  while (tracks[i].block != NULL && tracks[i].block != block)
+    i = (i + 1) % TRACK_SLOTS;
+  return &tracks[i];
+}
+
+/* Charges BLOCK, of order IDX, just allocated from SITE, to the
+   running thread, and samples it if it is its turn.  Interrupts
+   must be off. */
+static void
+track_alloc (void *block, size_t idx, void *site)
+{
+  struct thread *cur = thread_current ();
+  struct track *t;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  cur->malloc_blocks[idx]++;
+  if (track_countdown-- > 0)
+    return;
+  track_countdown = malloc_track_rate - 1;
+  if (track_cnt >= TRACK_SLOTS / 4 * 3)
+    {
+      track_dropped++;
+      return;
+    }
+  t = track_find (block);
+  t->block = block;
+  t->site = site;
+  t->tid = cur->tid;
+  t->idx = idx;
+  track_cnt++;
+}
+
+/* Credits BLOCK, of order IDX, being freed, to the running
+   thread, and drops it from the tracking table if it was
+   sampled.  Interrupts must be off. */
+static void
+track_free (void *block, size_t idx)
+{
+  struct track *t;
+  size_t hole, i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  thread_current ()->malloc_blocks[idx]--;
+  t = track_find (block);
+  if (t->block == NULL)
+    return;
+
+  /* Close the hole, moving back each later entry of the run whose
+     probe sequence starts at or before it, so that lookups need
+     no tombstones. */
+  t->block = NULL;
+  track_cnt--;
+  hole = t - tracks;
+  for (i = (hole + 1) % TRACK_SLOTS; tracks[i].block != NULL;
+       i = (i + 1) % TRACK_SLOTS)
+    {
+      size_t home = track_hash (tracks[i].block);
+      if ((i - home + TRACK_SLOTS) % TRACK_SLOTS
+          >= (i - hole + TRACK_SLOTS) % TRACK_SLOTS)
+        {
+          tracks[hole] = tracks[i];
+          tracks[i].block = NULL;
+          hole = i;
+        }
+    }
+}
+
+/* Notes that BLOCK was resized in place from order OLD_IDX to
+   NEW_IDX.  Interrupts must be off. */
+static void
+track_resize (void *block, size_t old_idx, size_t new_idx)
+{
+  struct thread *cur = thread_current ();
+  struct track *t = track_find (block);
+
+  cur->malloc_blocks[old_idx]--;
+  cur->malloc_blocks[new_idx]++;
+  if (t->block != NULL)
+    t->idx = new_idx;
+}
+
+/* Allocation site totals, for print_sites(). */
+#define SITE_CNT 64
+struct site
+  {
+    void *site;                 /* Return address of the allocations. */
+    size_t blocks;              /* Sampled blocks still allocated. */
+    size_t bytes;               /* Their size. */
+  };
+
+/* Orders sites by bytes, most first, for qsort(). */
+static int
+site_compare (const void *a_, const void *b_)
+{
+  const struct site *a = a_;
+  const struct site *b = b_;
+
+  return a->bytes < b->bytes ? 1 : a->bytes > b->bytes ? -1 : 0;
+}
+
+/* Prints the MAX_LINES sites whose sampled blocks, allocated by
+   thread TID or by any thread if TID is TID_ERROR, hold the most
+   memory, scaled up by the sampling rate.  Only the first
+   SITE_CNT sites found are counted. */
+static void
+print_sites (tid_t tid, size_t max_lines)
+{
+  static struct site sites[SITE_CNT];
+  enum intr_level old_level;
+  size_t site_cnt = 0, i, j;
+
+  lock_acquire (&sites_lock);
+  old_level = intr_disable ();
+  for (i = 0; i < TRACK_SLOTS; i++)
+    {
+      struct track *t = &tracks[i];
+      if (t->block == NULL || (tid != TID_ERROR && t->tid != tid))
+        continue;
+      for (j = 0; j < site_cnt && sites[j].site != t->site; j++)
+        continue;
+      if (j == SITE_CNT)
+        continue;
+      if (j == site_cnt)
+        {
+          site_cnt++;
+          sites[j].site = t->site;
+          sites[j].blocks = sites[j].bytes = 0;
+        }
+      sites[j].blocks++;
+      sites[j].bytes += descs[t->idx].block_size;
+    }
+  intr_set_level (old_level);
+
+  qsort (sites, site_cnt, sizeof *sites, site_compare);
+  for (i = 0; i < site_cnt && i < max_lines; i++)
+    {
+      printf ("malloc:   site %p ", sites[i].site);
+      ksym_print ((uintptr_t) sites[i].site, true);
+      printf (": ~%zu blocks, ~%zu bytes\n",
+              sites[i].blocks * malloc_track_rate,
+              sites[i].bytes * malloc_track_rate);
+    }
+  lock_release (&sites_lock);
+}
+
+/* Reports the blocks that thread T, which is exiting, allocated
+   and did not free itself, if allocations are tracked, with the
+   sites that allocated the most of them. */
+void
+malloc_thread_exit (struct thread *t)
+{
+  size_t blocks = 0, bytes = 0, i;
+
+  if (malloc_track_rate == 0)
+    return;
+  for (i = 0; i < desc_cnt; i++)
+    if (t->malloc_blocks[i] > 0)
+      {
+        blocks += t->malloc_blocks[i];
+        bytes += t->malloc_blocks[i] * descs[i].block_size;
+      }
+  if (blocks == 0)
+    return;
+  printf ("malloc: %s (tid %d) exits with %zu blocks, %zu bytes "
+          "outstanding\n", t->name, t->tid, blocks, bytes);
+  print_sites (t->tid, 5);
+}
+
+/* Prints the allocation sites holding the most memory, if
+   allocations are tracked. */
+void
+malloc_print_sites (void)
+{
+  if (malloc_track_rate == 0)
+    return;
+  printf ("malloc: %zu sampled blocks live, 1 in %u tracked, "
+          "%zu samples dropped\n",
+          track_cnt, malloc_track_rate, track_dropped);
+  print_sites (TID_ERROR, 10);
+}
+
+/* Prints the offsets of the free blocks of descriptors FIRST
+   through LAST in arena A, in address order. */
+static void
+print_arena (struct arena *a, size_t first, size_t last)
+{
+  size_t size = descs[a->root_idx].block_size;
+  size_t i, ofs;
+
+  for (i = first; i <= last; ++i) {
+    printf("Size %d:",descs[i].block_size);
+    for (ofs = map_find (a, a->free, i, 0); ofs < size;
+         ofs = map_find (a, a->free, i, ofs + descs[i].block_size))
+      printf(" %zu", ofs);
+    printf("\n");
+  }
 }
 
 void printMemory(void) {
-  struct list_elem *it, *itt;
-  int n = 0;
-  size_t i = 0;
-  for (; i < desc_cnt; ++i) {
-    list_sort(&descs[i].free_list, cmp_addr, 0);
-  }
-  for (it = list_begin(&page_list); it != list_end(&page_list); it = list_next(it))++n;
-  printf("No. of pages allocated : %d\n", n);
+  struct list_elem *it;
+  int n;
+  printf("No. of pages allocated : %zu\n", page_arena_cnt);
   n = 1;
   for (it = list_begin(&page_list); it != list_end(&page_list); it = list_next(it), ++n) {
-    printf("Page %d:\n", n);
     struct arena* a = list_entry(it, struct arena, elem);
-    for (i = 0; i < desc_cnt; ++i) {
-      printf("Size %d:",descs[i].block_size);
-      for (itt = list_begin(&descs[i].free_list); itt != list_end(&descs[i].free_list); itt = list_next(itt)) {
-        struct block* b = list_entry(itt, struct block, free_elem);
-        if (a != block_to_arena(b)) continue;
-        printf(" %u", (void *)b - (void *)a - sizeof(*a));
-      }
-      printf("\n");
-    }
+    printf("Page %d (%zu bytes free):\n", n, arena_free_bytes (a));
+    print_arena (a, 0, PAGE_IDX - 1);
+    printf("\n");
+  }
+  n = 1;
+  for (it = list_begin(&span_list); it != list_end(&span_list); it = list_next(it), ++n) {
+    struct arena* a = list_entry(it, struct arena, elem);
+    printf("Span %d (%d pages, %zu bytes free):\n", n,
+           1 << (a->root_idx - PAGE_IDX), arena_free_bytes (a));
+    print_arena (a, PAGE_IDX, a->root_idx);
     printf("\n");
   }
 }
+
+/* Object caches.
+
+   A kmem_cache hands out objects of one fixed size, packed into
+   "slabs".  Each slab is a page-sized block from the buddy
+   system with a struct slab header at its start followed by as
+   many objects as fit, so an object costs its size rounded to a
+   word instead of to a power of 2, and finding an object's slab
+   is a pg_round_down().
+
+   A cache may have a constructor, which is run on each object
+   once, when its slab is created.  Freed objects must be handed
+   back in their constructed state, so that they can be reused
+   without initializing them again.  Then the free list link
+   cannot overlap the object, so it gets a word of its own after
+   each object.
+
+   Slabs with free objects are on the cache's "partial" list, the
+   rest on its "full" list.  The cache keeps one empty slab for
+   reuse and gives further ones back to the buddy system. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* Object cache. */
+struct kmem_cache
+  {
+    char name[16];              /* Name, for debugging. */
+    size_t obj_size;            /* Size of each object in bytes. */
+    size_t stride;              /* Bytes from one object to the next. */
+    size_t link_ofs;            /* Offset of the free list link. */
+    size_t obj_cnt;             /* Objects per slab. */
+    void (*ctor) (void *);      /* Constructor, or a null pointer. */
+    struct list partial;        /* Slabs with free objects. */
+    struct list full;           /* Slabs with no free objects. */
+    size_t empty_cnt;           /* Slabs with no objects in use. */
+    struct lock lock;           /* Lock. */
+  };
+
+/* Slab. */
+struct slab
+  {
+    unsigned magic;             /* Always set to SLAB_MAGIC. */
+    struct kmem_cache *cache;   /* Owning cache. */
+    struct list_elem elem;      /* `partial' or `full' list element. */
+    void *free;                 /* First free object. */
+    size_t used_cnt;            /* Objects in use. */
+  };
+
+/* Bytes at the start of each slab reserved for its header. */
+#define SLAB_HDR ROUND_UP (sizeof (struct slab), sizeof (void *))
+
+/* Returns the free list link of object OBJ in cache C. */
+static void **
+slab_link (struct kmem_cache *c, void *obj)
+{
+  return (void **) ((uint8_t *) obj + c->link_ofs);
+}
+
+/* Creates and returns a cache of OBJ_SIZE-byte objects named
+   NAME.  If CTOR is nonnull, it is run on every object before
+   the object is first handed out.  Returns a null pointer if
+   memory is not available. */
+struct kmem_cache *
+kmem_cache_create (const char *name, size_t obj_size, void (*ctor) (void *))
+{
+  struct kmem_cache *c;
+
+  ASSERT (name != NULL);
+  ASSERT (obj_size > 0);
+
+  c = malloc (sizeof *c);
+  if (c == NULL)
+    return NULL;
+  strlcpy (c->name, name, sizeof c->name);
+  c->obj_size = obj_size;
+  c->link_ofs = ctor != NULL ? ROUND_UP (obj_size, sizeof (void *)) : 0;
+  c->stride = ROUND_UP (obj_size, sizeof (void *))
+              + (ctor != NULL ? sizeof (void *) : 0);
+  c->obj_cnt = (PGSIZE - SLAB_HDR) / c->stride;
+  c->ctor = ctor;
+  list_init (&c->partial);
+  list_init (&c->full);
+  c->empty_cnt = 0;
+  lock_init (&c->lock);
+  ASSERT (c->obj_cnt > 0);
+  return c;
+}
+
+/* Destroys cache C, which must have no objects in use. */
+void
+kmem_cache_destroy (struct kmem_cache *c)
+{
+  if (c == NULL)
+    return;
+
+  ASSERT (list_empty (&c->full));
+  while (!list_empty (&c->partial)) {
+    struct slab *s = list_entry (list_pop_front (&c->partial),
+                                 struct slab, elem);
+    ASSERT (s->used_cnt == 0);
+    s->magic = 0;
+    free (s);
+  }
+  free (c);
+}
+
+/* Adds a new slab to cache C, which must be locked.  Returns
+   true if successful, false if memory is not available. */
+static bool
+slab_create (struct kmem_cache *c)
+{
+  struct slab *s = malloc_aligned (PGSIZE, PGSIZE);
+  uint8_t *obj;
+  size_t i;
+
+  if (s == NULL)
+    return false;
+  s->magic = SLAB_MAGIC;
+  s->cache = c;
+  s->used_cnt = 0;
+  s->free = NULL;
+
+  /* Thread the objects onto the free list last to first, so that
+     they are handed out in address order. */
+  for (i = c->obj_cnt; i-- > 0; ) {
+    obj = (uint8_t *) s + SLAB_HDR + i * c->stride;
+    if (c->ctor != NULL)
+      c->ctor (obj);
+    *slab_link (c, obj) = s->free;
+    s->free = obj;
+  }
+  list_push_front (&c->partial, &s->elem);
+  c->empty_cnt++;
+  return true;
+}
+
+/* Obtains and returns an object from cache C.  Returns a null
+   pointer if memory is not available. */
+void *
+kmem_cache_alloc (struct kmem_cache *c)
+{
+  struct slab *s;
+  void *obj;
+
+  lock_acquire (&c->lock);
+  if (list_empty (&c->partial) && !slab_create (c)) {
+    lock_release (&c->lock);
+    return NULL;
+  }
+
+  s = list_entry (list_front (&c->partial), struct slab, elem);
+  obj = s->free;
+  s->free = *slab_link (c, obj);
+  if (s->used_cnt++ == 0)
+    c->empty_cnt--;
+  if (s->free == NULL) {
+    list_remove (&s->elem);
+    list_push_back (&c->full, &s->elem);
+  }
+  lock_release (&c->lock);
+
+  return obj;
+}
+
+/* Returns object OBJ, which must have come from cache C, to the
+   cache. */
+void
+kmem_cache_free (struct kmem_cache *c, void *obj)
+{
+  struct slab *s;
+  bool release = false;
+
+  if (obj == NULL)
+    return;
+
+  s = pg_round_down (obj);
+  ASSERT (s->magic == SLAB_MAGIC);
+  ASSERT (s->cache == c);
+  ASSERT (((uint8_t *) obj - (uint8_t *) s - SLAB_HDR) % c->stride == 0);
+
+  lock_acquire (&c->lock);
+  if (s->free == NULL) {
+    list_remove (&s->elem);
+    list_push_front (&c->partial, &s->elem);
+  }
+  *slab_link (c, obj) = s->free;
+  s->free = obj;
+  if (--s->used_cnt == 0) {
+    /* Keep one empty slab; give back any others. */
+    if (c->empty_cnt > 0) {
+      list_remove (&s->elem);
+      s->magic = 0;
+      release = true;
+    }
+    else
+      c->empty_cnt++;
+  }
+  lock_release (&c->lock);
+
+  if (release)
+    free (s);
+}
@@ -4,11 +4,44 @@
 #include <debug.h>
 #include <stddef.h>
 
+/* Number of block sizes, 16 bytes through 1 MB. */
+#define MALLOC_ORDERS 17
+
+/* Allocator statistics, see malloc_stats(). */
+struct malloc_stats
+  {
+    size_t alloc_cnt[MALLOC_ORDERS];  /* Blocks handed out, by order. */
+    size_t free_cnt[MALLOC_ORDERS];   /* Blocks freed, by order. */
+    size_t split_cnt[MALLOC_ORDERS];  /* Blocks split in halves, by order. */
+    size_t merge_cnt[MALLOC_ORDERS];  /* Buddy pairs merged, by order. */
+    size_t pages;                     /* Pages held from palloc. */
+    size_t peak_pages;                /* Most pages ever held. */
+    size_t used_bytes;                /* Bytes in allocated blocks. */
+    size_t peak_used_bytes;           /* Most bytes ever in use. */
+    size_t requested_bytes;           /* Total bytes ever requested. */
+    size_t rounded_bytes;             /* Same, rounded to block sizes. */
+  };
+
 void malloc_init (void);
 void *malloc (size_t);// __attribute__ ((malloc));
 void *calloc (size_t, size_t);// __attribute__ ((malloc));
+void *malloc_aligned (size_t align, size_t size);
 void *realloc (void *, size_t);
 void free (void *);
+void malloc_set_lazy (size_t watermark);
+void malloc_idle_tick (void);
+void malloc_stats (struct malloc_stats *);
+void malloc_print_stats (void);
+struct thread;
+void malloc_thread_exit (struct thread *);
+void malloc_print_sites (void);
 void printMemory(void);
 
+/* Object caches. */
+struct kmem_cache *kmem_cache_create (const char *name, size_t obj_size,
+                                      void (*ctor) (void *));
+void kmem_cache_destroy (struct kmem_cache *);
+void *kmem_cache_alloc (struct kmem_cache *);
+void kmem_cache_free (struct kmem_cache *, void *);
+
 #endif /* threads/malloc.h */
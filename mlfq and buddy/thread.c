@@ -1,31 +1,48 @@
 #include "threads/thread.h"
 #include <debug.h>
+#include <inttypes.h>
 #include <stddef.h>
 #include <string.h>
 #include <random.h>
+#include <round.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include "devices/clock.h"
+#include "devices/timer.h"
+#include "threads/fixed-point.h"
 #include "threads/flags.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
+#include "threads/kstack.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/percpu.h"
+#include "threads/rcu.h"
+#include "threads/sched-trace.h"
+#include "threads/seqlock.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
-#define TESTING
 /* Random value for struct thread's `magic' member.
    Used to detect stack overflow.  See the big comment at the top
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
-static struct list ready_list_2;
-#define which_ready_list(t) (((t)->qno) ? (&ready_list_2) : (&ready_list))
+/* Most MLFQ levels.  Level 0 is the highest. */
+#define MLFQ_MAX_LEVELS (PRI_MAX - PRI_MIN + 1)
+
+/* Lists of processes in THREAD_READY state, that is, processes
+   that are ready to run but not actually running, one per MLFQ
+   level.  Bit L of ready_levels is set iff ready_queues[L] is
+   not empty, so that the highest non-empty level is found with a
+   find-first-set. */
+static struct list ready_queues[MLFQ_MAX_LEVELS];
+static uint64_t ready_levels;
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
@@ -40,6 +57,16 @@ static struct thread *initial_thread;
 /* Lock used by allocate_tid(). */
 static struct lock tid_lock;
 
+/* Pages of dead threads, kept for thread_create() to reuse, so
+   that short-lived threads need not go back to palloc or have
+   their pages zeroed each time.  Linked through their `elem'
+   members, most recently freed first.  Emptied when the kernel
+   pool runs short.  Protected by turning interrupts off. */
+#define THREAD_CACHE_MAX 16
+static struct list thread_cache;
+static size_t thread_cache_cnt;
+static struct palloc_notifier thread_cache_notifier;
+
 /* Stack frame for kernel_thread(). */
 struct kernel_thread_frame 
   {
@@ -48,21 +75,89 @@ struct kernel_thread_frame
     void *aux;                  /* Auxiliary data for function. */
   };
 
-/* Statistics. */
-static long long idle_ticks;    /* # of timer ticks spent idle. */
-static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
-static long long user_ticks;    /* # of timer ticks in user programs. */
+/* Statistics.  Written only by the timer interrupt handler,
+   under stats_seq, so readers need not turn interrupts off.  The
+   tick counts are per CPU, summed by thread_print_stats(). */
+static struct seqlock stats_seq;
+static struct pcpu_counter idle_ticks;   /* # of ticks spent idle. */
+static struct pcpu_counter kernel_ticks; /* # of ticks in kernel threads. */
+static struct pcpu_counter user_ticks;   /* # of ticks in user programs. */
 static long long clock;         /* global clock */
 
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
 static unsigned thread_ticks;   /* # of timer ticks since last yield. */
 
+/* MLFQ configuration, set by kernel command-line options in
+   init.c before thread_init().  A thread at level L runs for
+   mlfq_quanta[L] ticks at a time.  Above the lowest level, after
+   thread_mlfq_demote quanta at a level it moves down one level.
+   After waiting thread_mlfq_age ticks in a queue it moves up
+   one.  Levels without a quantum get twice the quantum of the
+   level above.  If thread_mlfq_boost, a thread woken by an
+   interrupt handler for completed I/O goes straight back to the
+   top level. */
+int thread_mlfq_levels = 2;
+int thread_mlfq_demote = 2;
+int thread_mlfq_age = 6 * TIME_SLICE;
+bool thread_mlfq_boost = true;
+static long long boost_cnt;     /* Wakeups boosted to the top level. */
+static int mlfq_quanta[MLFQ_MAX_LEVELS] = { TIME_SLICE };
+
+/* 4.4BSD scheduler state, used if thread_mlfqs.  Threads are
+   queued at level PRI_MAX - priority.  Only threads with nonzero
+   recent_cpu or nice can change priority, so only those are on
+   cpu_list, and only those whose recent_cpu or nice changed
+   since priorities were last recomputed are on dirty_list. */
+static fixed_t load_avg;        /* System load average. */
+static int ready_cnt;           /* # of threads in ready queues. */
+static struct list cpu_list;    /* Threads with changing priority. */
+static struct list dirty_list;  /* Threads to recompute. */
+
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* Stride scheduler state, used if thread_stride.  See
+   [Waldspurger], "Stride Scheduling: Deterministic
+   Proportional-Share Resource Management".  A thread with T
+   tickets has a stride of STRIDE1 / T and advances its pass by
+   its stride for each tick that it runs.  The ready thread with
+   the least pass runs next, so over time each thread runs in
+   proportion to its tickets.  The ready threads are kept in
+   ready_heap, ordered by pass, instead of ready_queues, and bit
+   0 of ready_levels says whether it is empty, for idle().
+   stride_vtime is the pass of the thread that last started to
+   run; a thread joining the heap starts no earlier, so a thread
+   earns no credit for the time it spends blocked. */
+#define STRIDE1 (1 << 20)
+bool thread_stride;
+static struct heap ready_heap;
+static uint64_t stride_vtime;
+
+/* Deadline (EDF) class.  A thread admitted by
+   thread_set_deadline() is released every rt_period ticks and
+   must have run rt_runtime ticks within rt_deadline ticks of each
+   release.  Until it has used rt_runtime ticks since its latest
+   release, it is queued in edf_heap, by absolute deadline, and
+   runs ahead of every MLFQ level, preempting any thread with a
+   later deadline; after that, it drops to its MLFQ level until
+   the next release, so that a thread that overruns its budget
+   cannot starve the rest.  Admission keeps the sum of
+   rt_runtime / rt_deadline over the class at or below
+   EDF_MAX_LOAD per mille, under which EDF meets every deadline
+   and some CPU is still left to the MLFQ. */
+#define EDF_MAX_LOAD 900
+static struct heap edf_heap;
+static int edf_load;            /* Admitted share, per mille. */
+static long long edf_miss_cnt;  /* Jobs that missed their deadline. */
+static bool edf_used;           /* Any thread ever admitted? */
+
+/* If true, print CPU accounting for each thread.
+   Controlled by kernel command-line option "-acct". */
+bool thread_acct_print;
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
@@ -70,10 +165,31 @@ static struct thread *running_thread (void);
 static struct thread *next_thread_to_run (void);
 static void init_thread (struct thread *, const char *name, int priority);
 static bool is_thread (struct thread *) UNUSED;
+static struct thread *alloc_thread_page (void);
+static void free_thread_page (struct thread *);
+static palloc_notify_func drain_thread_cache;
 static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
+static void acct_switch (struct thread *cur, struct thread *next);
+static void print_acct (struct thread *, void *aux);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
+static void ready_push (struct thread *);
+static void ready_remove (struct thread *);
+static int ready_first_level (void);
+static int ready_first_level_of (uint64_t levels);
+static void thread_set_level (struct thread *, int qno);
+static void mlfqs_tick (struct thread *);
+static void mlfqs_mark (struct thread *);
+static void mlfqs_update_priority (struct thread *);
+static bool mlfqs_preempted (struct thread *);
+static void stride_update (struct thread *);
+static heap_less_func pass_less;
+static bool edf_active (const struct thread *);
+static bool edf_preempts (const struct thread *);
+static bool edf_tick (struct thread *);
+static heap_less_func deadline_less;
+static timeout_func edf_release;
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
@@ -91,17 +207,44 @@ static tid_t allocate_tid (void);
 void
 thread_init (void) 
 {
-  ASSERT (intr_get_level () == INTR_OFF);
+  int level;
 
-  lock_init (&tid_lock);
-  list_init (&ready_list);
-  list_init (&ready_list_2);
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (offsetof (struct thread, acct) == THREAD_LINE_SIZE);
+  ASSERT (sizeof (struct thread_acct) <= THREAD_LINE_SIZE);
+
+  if (thread_mlfq_levels < 1 || thread_mlfq_levels > MLFQ_MAX_LEVELS)
+    PANIC ("-mlfq-levels must be between 1 and %d", MLFQ_MAX_LEVELS);
+  if (thread_mlfq_demote < 1 || thread_mlfq_age < 1)
+    PANIC ("-mlfq-demote and -mlfq-age must be positive");
+  if (thread_mlfqs && thread_stride)
+    PANIC ("-mlfqs and -stride are mutually exclusive");
+  if (thread_mlfqs)
+    thread_mlfq_levels = MLFQ_MAX_LEVELS;
+  for (level = 1; level < thread_mlfq_levels; level++)
+    if (mlfq_quanta[level] == 0)
+      mlfq_quanta[level] = 2 * mlfq_quanta[level - 1];
+  list_init (&cpu_list);
+  list_init (&dirty_list);
+  load_avg = 0;
+  ready_cnt = 0;
+
+  lock_init_named (&tid_lock, "tid_lock");
+  seqlock_init (&stats_seq);
+  for (level = 0; level < MLFQ_MAX_LEVELS; level++)
+    list_init (&ready_queues[level]);
+  ready_levels = 0;
+  heap_init (&ready_heap, pass_less, NULL);
+  stride_vtime = 0;
+  heap_init (&edf_heap, deadline_less, NULL);
   list_init (&all_list);
+  list_init (&thread_cache);
   clock = 0;
 
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
   init_thread (initial_thread, "main", PRI_DEFAULT);
+  prng_init (&initial_thread->prng, random_ulong ());
   initial_thread->status = THREAD_RUNNING;
   initial_thread->tid = allocate_tid ();
 }
@@ -121,84 +264,253 @@ thread_start (void)
 
   /* Wait for the idle thread to initialize idle_thread. */
   sema_down (&idle_started);
+
+  /* palloc_init() has run by now, so the notifier can be
+     registered. */
+  palloc_register_notifier (&thread_cache_notifier, drain_thread_cache,
+                            NULL);
 }
 
-/* Called by the timer interrupt handler at each timer tick.
-   Thus, this function runs in an external interrupt context. */
+/* Called by the timer interrupt handler at each timer tick,
+   with USER true if the tick interrupted user code.  Thus, this
+   function runs in an external interrupt context. */
 void
-thread_tick (void) 
+thread_tick (bool user)
 {
   ++clock;
   struct thread *t = thread_current ();
 
   /* Update statistics. */
+  seqlock_write_begin (&stats_seq);
   if (t == idle_thread)
-    idle_ticks++;
+    pcpu_inc (&idle_ticks);
 #ifdef USERPROG
   else if (t->pagedir != NULL)
-    user_ticks++;
+    pcpu_inc (&user_ticks);
 #endif
   else
-    kernel_ticks++;
-
-  /* Enforce preemption. */
-
-  if (list_empty(&ready_list)) {
-    struct list_elem* it, *itt;
-    for (it = list_begin(&ready_list_2); it != list_end(&ready_list_2); it = itt) {
-      itt = list_next(it);
-     struct thread * IT = list_entry(it, struct thread, elem);
-     ++IT->total_time;
-     if (IT->total_time >= 6*TIME_SLICE) {
-       IT->qno = IT->total_time = 0;
-       #ifdef TESTING
-       if(IT->tid != 2)printf("%lld: thread %d goes to L1 queue from L2 queue\n", clock, IT->tid);
-       #endif
-       list_remove(it);
-       list_push_back(&ready_list, it);
-     }
+    pcpu_inc (&kernel_ticks);
+  seqlock_write_end (&stats_seq);
+  if (t != idle_thread)
+    {
+      if (user)
+        t->acct.user_ticks++;
+      else
+        t->acct.kernel_ticks++;
+    }
+  if (t == idle_thread)
+    malloc_idle_tick ();
+
+  /* Enforce preemption.  A running EDF thread is charged against
+     its budget instead of being timesliced or demoted, but the
+     rest of the scheduler's bookkeeping goes on as usual. */
+  bool edf = edf_tick (t);
+  if (thread_stride) {
+    if (t != idle_thread)
+      t->pass += t->stride;
+    if (++thread_ticks >= TIME_SLICE && !edf)
+      intr_yield_on_return ();
+    return;
+  }
+  if (thread_mlfqs) {
+    mlfqs_tick (t);
+    if ((++thread_ticks >= TIME_SLICE || mlfqs_preempted (t)) && !edf)
+      intr_yield_on_return ();
+    return;
+  }
+
+  /* Promote threads that have waited thread_mlfq_age ticks since
+     they were queued.  Each queue is in order of ready_since, so
+     only its head needs checking, which keeps this O(levels)
+     plus one step per thread promoted. */
+  uint64_t levels = ready_levels & ~(uint64_t) 1;
+  while (levels != 0) {
+    int level = ready_first_level_of (levels);
+    struct list *q = &ready_queues[level];
+    levels &= levels - 1;
+    while (!list_empty (q)) {
+     struct thread *IT = list_entry (list_front (q), struct thread, elem);
+     if (clock - IT->ready_since < thread_mlfq_age)
+       break;
+     IT->total_time = 0;
+     thread_set_level (IT, level - 1);
+     sched_trace (SCHED_PROMOTE, IT, level, level - 1);
     }
   }
 
   ++thread_ticks;
-  if (thread_ticks == 1) 
-    #ifdef TESTING
-    if(t->tid!=2)printf("%lld: thread %d goes to running state from L%d queue\n", clock-1, t->tid,t->qno+1);
-    #endif
-  if (t->qno == 0) {
-    ++t->total_time;
-    if (t->total_time >= 2*TIME_SLICE) {
+  if (edf)
+    return;
+  int quantum = mlfq_quanta[t->qno];
+  if (t->qno < thread_mlfq_levels - 1
+      && ++t->total_time >= thread_mlfq_demote * quantum) {
      t->total_time = 0;
-     t->qno = 1;
-     #ifdef TESTING
-     if(t->tid != 2)printf("%lld: thread %d goes to L%d queue from running state\n", clock, t->tid, t->qno + 1);
-     #endif
+     thread_set_level (t, t->qno + 1);
+     sched_trace (SCHED_DEMOTE, t, t->qno - 1, t->qno);
      intr_yield_on_return ();
-    }
-    else if (thread_ticks >= TIME_SLICE) {
-      #ifdef TESTING
-      if(t->tid != 2)printf("%lld: thread %d goes to L%d queue from running state\n", clock, t->tid, t->qno + 1);
-      #endif
-        intr_yield_on_return ();
-      }
   }
-  else {
-    if (thread_ticks >= 2*TIME_SLICE) {
-        t->total_time = 0;
-        #ifdef TESTING
-        if(t->tid != 2)printf("%lld: thread %d goes to L%d queue from running state\n", clock, t->tid, t->qno + 1);
-        #endif
-        intr_yield_on_return ();
+  else if (thread_ticks >= (unsigned) quantum) {
+      intr_yield_on_return ();
+  }
+}
+
+/* Called by the timer interrupt handler for each tick that
+   passed while the idle thread waited with the timer stopped
+   (see timer_idle_enter()), other than the one being handled. */
+void
+thread_idle_tick (void)
+{
+  ++clock;
+  seqlock_write_begin (&stats_seq);
+  pcpu_inc (&idle_ticks);
+  seqlock_write_end (&stats_seq);
+  malloc_idle_tick ();
+  if (thread_mlfqs)
+    mlfqs_tick (idle_thread);
+}
+
+/* Updates the 4.4BSD scheduler's statistics for a tick spent
+   running T. */
+static void
+mlfqs_tick (struct thread *t)
+{
+  if (t != idle_thread) {
+    t->recent_cpu = fix_add_int (t->recent_cpu, 1);
+    mlfqs_mark (t);
+  }
+
+  /* Once a second, update load_avg and decay the recent_cpu of
+     every thread that has any. */
+  if (clock % TIMER_FREQ == 0) {
+    struct list_elem *e, *next;
+    int ready = ready_cnt + (t != idle_thread);
+    fixed_t coeff;
+
+    seqlock_write_begin (&stats_seq);
+    load_avg = fix_add (fix_div_int (fix_mul_int (load_avg, 59), 60),
+                        fix_div_int (fix_int (ready), 60));
+    seqlock_write_end (&stats_seq);
+    coeff = fix_div (fix_mul_int (load_avg, 2),
+                     fix_add_int (fix_mul_int (load_avg, 2), 1));
+    for (e = list_begin (&cpu_list); e != list_end (&cpu_list); e = next) {
+      struct thread *c = list_entry (e, struct thread, cpu_elem);
+      next = list_next (e);
+      c->recent_cpu = fix_add_int (fix_mul (coeff, c->recent_cpu), c->nice);
+      mlfqs_mark (c);
+      if (c->recent_cpu == 0 && c->nice == 0) {
+        list_remove (&c->cpu_elem);
+        c->on_cpu_list = false;
       }
+    }
   }
+
+  /* Every fourth tick, recompute the priorities that changed. */
+  if (clock % 4 == 0)
+    while (!list_empty (&dirty_list)) {
+      struct thread *c = list_entry (list_pop_front (&dirty_list),
+                                     struct thread, dirty_elem);
+      c->dirty = false;
+      mlfqs_update_priority (c);
+    }
+}
+
+/* Notes that T's recent_cpu or nice has changed, so that its
+   priority is recomputed and it is decayed every second.
+   Interrupts must be off. */
+static void
+mlfqs_mark (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!t->on_cpu_list) {
+    list_push_back (&cpu_list, &t->cpu_elem);
+    t->on_cpu_list = true;
+  }
+  if (!t->dirty) {
+    list_push_back (&dirty_list, &t->dirty_elem);
+    t->dirty = true;
+  }
+}
+
+/* Recomputes T's priority from its recent_cpu and nice, moving
+   it to the matching level. */
+static void
+mlfqs_update_priority (struct thread *t)
+{
+  int priority = PRI_MAX - fix_round (fix_div_int (t->recent_cpu, 4))
+                 - t->nice * 2;
+
+  if (priority < PRI_MIN)
+    priority = PRI_MIN;
+  else if (priority > PRI_MAX)
+    priority = PRI_MAX;
+  if (priority != t->priority) {
+    t->priority = priority;
+    thread_set_level (t, PRI_MAX - priority);
+    waitqueue_requeue (t);
+  }
+}
+
+/* Returns true if a ready thread has higher priority than running
+   thread T. */
+static bool
+mlfqs_preempted (struct thread *t)
+{
+  int level = ready_first_level ();
+
+  return level >= 0 && level < t->qno;
+}
+
+/* Sets the MLFQ quanta of the highest levels from LIST, a comma-
+   separated list of tick counts, for the "-mlfq-quanta" kernel
+   command-line option. */
+void
+thread_mlfq_set_quanta (char *list)
+{
+  char *q, *save_ptr;
+  int level = 0;
+
+  for (q = strtok_r (list, ",", &save_ptr); q != NULL;
+       q = strtok_r (NULL, ",", &save_ptr))
+    {
+      if (level >= MLFQ_MAX_LEVELS)
+        PANIC ("-mlfq-quanta lists more than %d levels", MLFQ_MAX_LEVELS);
+      mlfq_quanta[level] = atoi (q);
+      if (mlfq_quanta[level] < 1)
+        PANIC ("-mlfq-quanta must be positive");
+      level++;
+    }
 }
 
 /* Prints thread statistics. */
 void
 thread_print_stats (void) 
 {
+  long long idle, kernel, user;
+  unsigned seq;
+
+  do
+    {
+      seq = seqlock_read_begin (&stats_seq);
+      idle = pcpu_read (&idle_ticks);
+      kernel = pcpu_read (&kernel_ticks);
+      user = pcpu_read (&user_ticks);
+    }
+  while (seqlock_read_retry (&stats_seq, seq));
   printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
-          idle_ticks, kernel_ticks, user_ticks);
+          idle, kernel, user);
+  if (thread_mlfq_boost && !thread_mlfqs && !thread_stride
+      && thread_mlfq_levels > 1)
+    printf ("Thread: %lld wakeups boosted to the top level\n", boost_cnt);
+  if (edf_used)
+    printf ("Thread: %lld deadline misses\n", edf_miss_cnt);
+  malloc_print_sites ();
+  if (thread_acct_print)
+    {
+      enum intr_level old_level = intr_disable ();
+      thread_foreach (print_acct, NULL);
+      intr_set_level (old_level);
+    }
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -230,16 +542,27 @@ thread_create (const char *name, int priority,
   ASSERT (function != NULL);
 
   /* Allocate thread. */
-  t = palloc_get_page (PAL_ZERO);
+  t = alloc_thread_page ();
   if (t == NULL)
     return TID_ERROR;
 
-  /* Initialize thread. */
+  /* Initialize thread.  Under the 4.4BSD scheduler it starts
+     with its parent's nice and recent_cpu. */
   init_thread (t, name, priority);
+  prng_init (&t->prng, prng_next (&thread_current ()->prng));
   tid = t->tid = allocate_tid ();
-  #ifdef TESTING
-  if(t->tid != 2)printf("%lld: thread %d created and is in blocked state\n", clock, t->tid);
-  #endif
+  if (thread_mlfqs)
+    {
+      struct thread *cur = thread_current ();
+      old_level = intr_disable ();
+      t->nice = cur->nice;
+      t->recent_cpu = cur->recent_cpu;
+      if (t->nice != 0 || t->recent_cpu != 0)
+        mlfqs_mark (t);
+      mlfqs_update_priority (t);
+      intr_set_level (old_level);
+    }
+  sched_trace (SCHED_CREATE, t, -1, -1);
 
   /* Prepare thread for first run by initializing its stack.
      Do this atomically so intermediate values for the 'stack' 
@@ -302,13 +625,35 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  list_push_back (which_ready_list(t), &t->elem);
+
+  /* A thread woken from an interrupt handler by
+     waitqueue_wake_io(), as when its disk request completes or a
+     key arrives, was waiting for I/O, not using the CPU, so it
+     rejoins the top level with a fresh budget instead of aging
+     its way back up, and it preempts a thread running below the
+     top level when the handler returns.  Timer and EDF releases
+     come from interrupt handlers too, but are not I/O. */
+  if (thread_mlfq_boost && !thread_mlfqs && !thread_stride
+      && intr_context () && waitqueue_io_wakeup ())
+    {
+      if (t->qno > 0)
+        {
+          sched_trace (SCHED_BOOST, t, t->qno, 0);
+          t->qno = 0;
+          boost_cnt++;
+        }
+      t->total_time = 0;
+      if (running_thread ()->qno > 0)
+        intr_yield_on_return ();
+    }
+  if (intr_context () && edf_active (t) && edf_preempts (t))
+    intr_yield_on_return ();
+  ready_push (t);
+  t->acct.blocked_cycles += clock_cycles () - t->acct.since;
+  t->acct.since = clock_cycles ();
   t->status = THREAD_READY;
-  
+  sched_trace (SCHED_WAKE, t, -1, t->qno);
   intr_set_level (old_level);
-  #ifdef TESTING
-    if(t->tid != 2)printf("%lld: thread %d goes to L%d queue from blocked state\n", clock, t->tid, t->qno + 1);
-  #endif
 }
 
 /* Returns the name of the running thread. */
@@ -318,6 +663,20 @@ thread_name (void)
   return thread_current ()->name;
 }
 
+/* Returns the running thread's own pseudo-random number
+   generator, for uses that need speed rather than RC4's
+   reproducible stream.  Each thread's generator is seeded from
+   its creator's, and the initial thread's from random_ulong(),
+   so a run with a fixed "-rs" seed is repeatable.  Must not be
+   called from an interrupt handler, which would share the
+   generator with the thread it interrupted. */
+struct prng *
+thread_prng (void) 
+{
+  ASSERT (!intr_context ());
+  return &thread_current ()->prng;
+}
+
 /* Returns the running thread.
    This is running_thread() plus a couple of sanity checks.
    See the big comment at the top of thread.h for details. */
@@ -354,16 +713,21 @@ thread_exit (void)
 #ifdef USERPROG
   process_exit ();
 #endif
+  fpu_exit ();
+  malloc_thread_exit (thread_current ());
+  if (thread_acct_print)
+    print_acct (thread_current (), NULL);
 
   /* Remove thread from all threads list, set our status to dying,
      and schedule another process.  That process will destroy us
      when it calls thread_schedule_tail(). */
-  int tid = thread_current()->tid;
-  #ifndef TESTING
-  if(tid != 2)printf("%lld: thread %d finished\n", clock, tid);
-  #endif
   intr_disable ();
+  edf_load -= thread_current ()->rt_load;
   list_remove (&thread_current()->allelem);
+  if (thread_current ()->on_cpu_list)
+    list_remove (&thread_current ()->cpu_elem);
+  if (thread_current ()->dirty)
+    list_remove (&thread_current ()->dirty_elem);
   thread_current ()->status = THREAD_DYING;
   schedule ();
   NOT_REACHED ();
@@ -381,20 +745,24 @@ thread_yield (void)
 
   old_level = intr_disable ();
   if (cur != idle_thread) 
-    list_push_back (which_ready_list(cur), &cur->elem);
+    ready_push (cur);
   cur->status = THREAD_READY;
   schedule ();
   intr_set_level (old_level);
 }
 
 /* Invoke function 'func' on all threads, passing along 'aux'.
-   This function must be called with interrupts off. */
+   This function must be called with interrupts off or in an RCU
+   read-side section, and 'func' must not sleep.  Threads are
+   added to all_list and removed from it with interrupts off,
+   and a dying thread's page is freed only after the switch away
+   from it, which ends any read-side section that found it. */
 void
 thread_foreach (thread_action_func *func, void *aux)
 {
   struct list_elem *e;
 
-  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (intr_get_level () == INTR_OFF || rcu_read_locked ());
 
   for (e = list_begin (&all_list); e != list_end (&all_list);
        e = list_next (e))
@@ -404,11 +772,114 @@ thread_foreach (thread_action_func *func, void *aux)
     }
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Sets the current thread's priority to NEW_PRIORITY.  If it
+   has been donated a higher priority, that stays in effect until
+   the donation ends.  Under the stride scheduler, the priority
+   sets the thread's tickets.  Ignored under the 4.4BSD scheduler,
+   which sets priorities itself. */
 void
 thread_set_priority (int new_priority) 
 {
-  thread_current ()->priority = new_priority;
+  struct thread *cur = thread_current ();
+
+  if (thread_mlfqs)
+    return;
+  cur->base_priority = new_priority;
+  thread_update_priority (cur);
+}
+
+/* Raises thread T's priority to PRIORITY, if that is higher, on
+   behalf of a thread waiting for a lock that T holds.  The MLFQ
+   picks levels by CPU use rather than priority, so this only
+   decides the order in which waiters are woken.  Under the
+   stride scheduler, T also gets the tickets of its new
+   priority, for as long as the donation lasts. */
+void
+thread_donate_priority (struct thread *t, int priority)
+{
+  if (priority > t->priority)
+    {
+      t->priority = priority;
+      stride_update (t);
+      waitqueue_requeue (t);
+    }
+}
+
+/* Recomputes thread T's priority as the highest of its own and
+   those of the threads waiting for locks that T holds. */
+void
+thread_update_priority (struct thread *t)
+{
+  enum intr_level old_level = intr_disable ();
+  int priority = t->base_priority;
+  struct list_elem *e;
+
+  for (e = list_begin (&t->held_locks); e != list_end (&t->held_locks);
+       e = list_next (e))
+    {
+      struct lock *lock = list_entry (e, struct lock, elem);
+      int waiter_priority = waitqueue_max_priority (&lock->semaphore.waiters);
+      if (waiter_priority > priority)
+        priority = waiter_priority;
+    }
+  t->priority = priority;
+  stride_update (t);
+  waitqueue_requeue (t);
+  intr_set_level (old_level);
+}
+
+/* Gives thread T the stride scheduler's tickets for its
+   priority: one more than its priority, so that a thread at
+   PRI_MAX gets twice the share of one at PRI_DEFAULT.  Tickets
+   are kept up to date under every scheduler, since they cost
+   nothing to keep. */
+static void
+stride_update (struct thread *t)
+{
+  t->tickets = t->priority - PRI_MIN + 1;
+  t->stride = STRIDE1 / t->tickets;
+}
+
+/* Under the 4.4BSD scheduler, yields the CPU if a ready thread
+   has a higher priority than the running thread.  In an
+   interrupt handler, yields on return from the interrupt
+   instead.  Does not yield if the caller has turned interrupts
+   off.  The MLFQ switches only at the end of a slice, or for a
+   wakeup that thread_unblock() boosts.  Under every scheduler,
+   also yields to a ready EDF thread with an earlier deadline. */
+void
+thread_check_preempt (void)
+{
+  enum intr_level old_level;
+  bool preempt = false;
+
+  old_level = intr_disable ();
+  if (!heap_empty (&edf_heap))
+    preempt = edf_preempts (heap_entry (heap_min (&edf_heap),
+                                        struct thread, ready_elem));
+  if (thread_mlfqs)
+    preempt = preempt || mlfqs_preempted (thread_current ());
+  intr_set_level (old_level);
+
+  if (preempt)
+    {
+      if (intr_context ())
+        intr_yield_on_return ();
+      else if (old_level == INTR_ON)
+        thread_yield ();
+    }
+}
+
+/* Returns true if thread A, given by its `elem', has lower
+   priority than thread B. */
+bool
+thread_priority_less (const struct list_elem *a_,
+                      const struct list_elem *b_, void *aux UNUSED)
+{
+  const struct thread *a = list_entry (a_, struct thread, elem);
+  const struct thread *b = list_entry (b_, struct thread, elem);
+
+  return a->priority < b->priority;
 }
 
 /* Returns the current thread's priority. */
@@ -418,35 +889,63 @@ thread_get_priority (void)
   return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE and recomputes
+   its priority, yielding if it no longer has the highest. */
 void
-thread_set_nice (int nice UNUSED) 
+thread_set_nice (int nice) 
 {
-  /* Not yet implemented. */
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  bool yield;
+
+  ASSERT (NICE_MIN <= nice && nice <= NICE_MAX);
+
+  if (!thread_mlfqs)
+    {
+      cur->nice = nice;
+      return;
+    }
+  old_level = intr_disable ();
+  cur->nice = nice;
+  mlfqs_mark (cur);
+  mlfqs_update_priority (cur);
+  yield = mlfqs_preempted (cur);
+  intr_set_level (old_level);
+  if (yield)
+    thread_yield ();
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  fixed_t load;
+  unsigned seq;
+
+  do
+    {
+      seq = seqlock_read_begin (&stats_seq);
+      load = load_avg;
+    }
+  while (seqlock_read_retry (&stats_seq, seq));
+  return fix_round (fix_mul_int (load, 100));
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int recent = fix_round (fix_mul_int (thread_current ()->recent_cpu, 100));
+  intr_set_level (old_level);
+  return recent;
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
@@ -471,6 +970,16 @@ idle (void *idle_started_ UNUSED)
       intr_disable ();
       thread_block ();
 
+      /* Zero free pages while nothing else wants the CPU.  If a
+         thread became ready meanwhile, go back and run it. */
+      intr_enable ();
+      while (ready_levels == 0 && heap_empty (&edf_heap)
+             && palloc_zero_idle ())
+        continue;
+      intr_disable ();
+      if (ready_levels != 0 || !heap_empty (&edf_heap))
+        continue;
+
       /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -483,6 +992,7 @@ idle (void *idle_started_ UNUSED)
 
          See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
          7.11.1 "HLT Instruction". */
+      timer_idle_enter ();
       asm volatile ("sti; hlt" : : : "memory");
     }
 }
@@ -505,11 +1015,12 @@ running_thread (void)
   uint32_t *esp;
 
   /* Copy the CPU's stack pointer into `esp', and then round that
-     down to the start of a page.  Because `struct thread' is
-     always at the beginning of a page and the stack pointer is
+     down to the start of its stack.  Because `struct thread' is
+     always at the beginning of the page or, for a large stack,
+     the slot that holds the stack, and the stack pointer is
      somewhere in the middle, this locates the curent thread. */
   asm ("mov %%esp, %0" : "=g" (esp));
-  return pg_round_down (esp);
+  return kstack_thread (esp);
 }
 
 /* Returns true if T appears to point to a valid thread. */
@@ -524,19 +1035,36 @@ is_thread (struct thread *t)
 static void
 init_thread (struct thread *t, const char *name, int priority)
 {
+  enum intr_level old_level;
+
   ASSERT (t != NULL);
   ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
   ASSERT (name != NULL);
 
   memset (t, 0, sizeof *t);
+  t->acct.since = clock_cycles ();
   t->status = THREAD_BLOCKED;
   strlcpy (t->name, name, sizeof t->name);
-  t->stack = (uint8_t *) t + PGSIZE;
-  t->priority = priority;
+  t->stack = kstack_top (t);
+  t->priority = t->base_priority = priority;
+  list_init (&t->held_locks);
+  t->wait_lock = NULL;
+#ifdef USERPROG
+  t->exit_status = -1;
+  list_init (&t->running_children);
+  list_init (&t->exited_children);
+#endif
   t->magic = THREAD_MAGIC;
   t->qno = 0;
   t->total_time = 0;
+  if (thread_mlfqs)
+    t->priority = PRI_MAX;
+  stride_update (t);
+  timeout_init (&t->rt_timeout, edf_release, t);
+
+  old_level = intr_disable ();
   list_push_back (&all_list, &t->allelem);
+  intr_set_level (old_level);
 }
 
 /* Allocates a SIZE-byte frame at the top of thread T's stack and
@@ -556,18 +1084,152 @@ alloc_frame (struct thread *t, size_t size)
    return a thread from the run queue, unless the run queue is
    empty.  (If the running thread can continue running, then it
    will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
+   idle_thread.  EDF threads within their budget come first,
+   earliest deadline first. */
 static struct thread *
 next_thread_to_run (void) 
 {
-  if (list_empty (&ready_list) && list_empty(&ready_list_2))
+  int level = ready_first_level ();
+  struct thread *t;
+
+  if (!heap_empty (&edf_heap))
+    {
+      t = heap_entry (heap_min (&edf_heap), struct thread, ready_elem);
+      ready_remove (t);
+      return t;
+    }
+  if (level < 0)
     return idle_thread;
-  else if (list_empty (&ready_list)){
-    return list_entry (list_pop_front (&ready_list_2), struct thread, elem);
-  }
-  else {
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);  
-  }
+  if (thread_stride)
+    {
+      t = heap_entry (heap_min (&ready_heap), struct thread, ready_elem);
+      ready_remove (t);
+      stride_vtime = t->pass;
+      return t;
+    }
+  t = list_entry (list_front (&ready_queues[level]), struct thread, elem);
+  ready_remove (t);
+  return t;
+}
+
+/* Adds ready thread T to the back of its level's queue, to
+   ready_heap under the stride scheduler, or to edf_heap if it is
+   an EDF thread within its budget, and starts counting how long
+   it has waited there. */
+static void
+ready_push (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  t->ready_since = clock;
+  ready_cnt++;
+  if (edf_active (t))
+    {
+      heap_insert (&edf_heap, &t->ready_elem);
+      return;
+    }
+  if (thread_stride)
+    {
+      if (t->pass < stride_vtime)
+        t->pass = stride_vtime;
+      heap_insert (&ready_heap, &t->ready_elem);
+      ready_levels = 1;
+      return;
+    }
+  list_push_back (&ready_queues[t->qno], &t->elem);
+  ready_levels |= (uint64_t) 1 << t->qno;
+}
+
+/* Removes ready thread T from its level's queue, from
+   ready_heap, or from edf_heap.  Whether T is an EDF thread
+   within its budget changes only while it runs or is blocked, so
+   it still tells where ready_push() put T. */
+static void
+ready_remove (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  ready_cnt--;
+  if (edf_active (t))
+    {
+      heap_remove (&edf_heap, &t->ready_elem);
+      return;
+    }
+  if (thread_stride)
+    {
+      heap_remove (&ready_heap, &t->ready_elem);
+      if (heap_empty (&ready_heap))
+        ready_levels = 0;
+      return;
+    }
+  list_remove (&t->elem);
+  if (list_empty (&ready_queues[t->qno]))
+    ready_levels &= ~((uint64_t) 1 << t->qno);
+}
+
+/* Orders threads in ready_heap by pass. */
+static bool
+pass_less (const struct heap_elem *a_, const struct heap_elem *b_,
+           void *aux UNUSED)
+{
+  const struct thread *a = heap_entry (a_, struct thread, ready_elem);
+  const struct thread *b = heap_entry (b_, struct thread, ready_elem);
+
+  return a->pass < b->pass;
+}
+
+/* Orders threads in edf_heap by absolute deadline. */
+static bool
+deadline_less (const struct heap_elem *a_, const struct heap_elem *b_,
+               void *aux UNUSED)
+{
+  const struct thread *a = heap_entry (a_, struct thread, ready_elem);
+  const struct thread *b = heap_entry (b_, struct thread, ready_elem);
+
+  return a->rt_abs_deadline < b->rt_abs_deadline;
+}
+
+/* Returns the highest level with a ready thread, or -1 if there
+   is none. */
+static int
+ready_first_level (void)
+{
+  return ready_first_level_of (ready_levels);
+}
+
+/* Returns the lowest level whose bit is set in LEVELS, or -1 if
+   there is none. */
+static int
+ready_first_level_of (uint64_t levels)
+{
+  uint32_t low = levels, high = levels >> 32;
+
+  if (low != 0)
+    return __builtin_ctz (low);
+  else if (high != 0)
+    return 32 + __builtin_ctz (high);
+  else
+    return -1;
+}
+
+/* Moves thread T to level QNO, requeueing it if it is ready. */
+static void
+thread_set_level (struct thread *t, int qno)
+{
+  enum intr_level old_level;
+
+  ASSERT (0 <= qno && qno < thread_mlfq_levels);
+
+  old_level = intr_disable ();
+  if (t->status == THREAD_READY)
+    {
+      ready_remove (t);
+      t->qno = qno;
+      ready_push (t);
+    }
+  else
+    t->qno = qno;
+  intr_set_level (old_level);
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -603,6 +1265,7 @@ thread_schedule_tail (struct thread *prev)
   /* Activate the new address space. */
   process_activate ();
 #endif
+  fpu_switch (cur);
 
   /* If the thread 
   we switched from is dying, destroy its struct
@@ -613,8 +1276,84 @@ thread_schedule_tail (struct thread *prev)
   if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread) 
     {
       ASSERT (prev != cur);
-      palloc_free_page (prev);
+      free_thread_page (prev);
+    }
+}
+
+/* Returns a page for a new thread, from thread_cache if it has
+   one and otherwise from palloc, or a null pointer if memory is
+   short.  With large kernel stacks, returns a stack slot from
+   kstack_alloc() instead.  The page is not zeroed: init_thread()
+   clears struct thread, and the stack needs no clearing. */
+static struct thread *
+alloc_thread_page (void)
+{
+  struct thread *t = NULL;
+  enum intr_level old_level;
+
+  if (kstack_size > PGSIZE)
+    return kstack_alloc ();
+
+  old_level = intr_disable ();
+  if (!list_empty (&thread_cache))
+    {
+      t = list_entry (list_pop_front (&thread_cache), struct thread, elem);
+      thread_cache_cnt--;
+    }
+  intr_set_level (old_level);
+
+  return t != NULL ? t : palloc_get_page (0);
+}
+
+/* Frees T's page, keeping it in thread_cache if there is room,
+   or T's stack slot.  Clears T's magic number, so that is_thread() rejects stale
+   pointers to it. */
+static void
+free_thread_page (struct thread *t)
+{
+  enum intr_level old_level;
+
+  if (kstack_owns (t))
+    {
+      t->magic = 0;
+      kstack_free (t);
+      return;
+    }
+
+  old_level = intr_disable ();
+  t->magic = 0;
+  if (thread_cache_cnt < THREAD_CACHE_MAX)
+    {
+      list_push_front (&thread_cache, &t->elem);
+      thread_cache_cnt++;
+      t = NULL;
+    }
+  intr_set_level (old_level);
+
+  if (t != NULL)
+    palloc_free_page (t);
+}
+
+/* Gives thread_cache's pages back when the kernel pool comes
+   under pressure. */
+static void
+drain_thread_cache (enum palloc_flags pool, size_t free_cnt UNUSED,
+                    void *aux UNUSED)
+{
+  enum intr_level old_level;
+
+  if (pool & PAL_USER)
+    return;
+
+  old_level = intr_disable ();
+  while (!list_empty (&thread_cache))
+    {
+      struct thread *t = list_entry (list_pop_front (&thread_cache),
+                                     struct thread, elem);
+      thread_cache_cnt--;
+      palloc_free_page (t);
     }
+  intr_set_level (old_level);
 }
 
 /* Schedules a new process.  At entry, interrupts must be off and
@@ -628,23 +1367,61 @@ static void
 schedule (void) 
 {
   struct thread *cur = running_thread ();
-  enum thread_status stat = cur->status;
-  int id = cur->tid;
   struct thread *next = next_thread_to_run ();
-  int tid = next->tid, qno = next->qno;
   struct thread *prev = NULL;
 
   ASSERT (intr_get_level () == INTR_OFF);
   ASSERT (cur->status != THREAD_RUNNING);
+  ASSERT (cur->rcu_nesting == 0);
   ASSERT (is_thread (next));
+
+  rcu_quiescent ();
+  if (cur == idle_thread && next != cur)
+    timer_idle_exit ();
   if (cur != next)
-    prev = switch_threads (cur, next);
+    {
+      sched_trace_switch (cur, cur->qno, next, next->qno);
+      acct_switch (cur, next);
+      prev = switch_threads (cur, next);
+    }
   thread_schedule_tail (prev);
+}
+
+/* Charges the time since CUR and NEXT last changed state when the
+   scheduler switches from CUR to NEXT: NEXT was ready that long,
+   and CUR, which is now ready, blocked, or dying, starts its next
+   interval. */
+static void
+acct_switch (struct thread *cur, struct thread *next)
+{
+  uint64_t now = clock_cycles ();
 
-  #ifdef TESTING
-  if (stat == THREAD_BLOCKED)
-    if(id != 2)printf("%lld: thread %d goes to blocked state from running state\n", clock, id);
-  #endif
+  if (cur->status == THREAD_READY)
+    cur->acct.involuntary++;
+  else if (cur->status == THREAD_BLOCKED)
+    cur->acct.voluntary++;
+  cur->acct.since = now;
+
+  next->acct.ready_cycles += now - next->acct.since;
+  next->acct.since = now;
+}
+
+/* Prints thread T's CPU accounting.  Suitable for
+   thread_foreach(). */
+static void
+print_acct (struct thread *t, void *aux UNUSED)
+{
+  struct thread_acct a = t->acct;
+
+  if (t == idle_thread)
+    return;
+  printf ("Thread %s (tid %d): %lld user ticks, %lld kernel ticks, "
+          "%"PRIu64" ns in interrupts; %u voluntary, %u involuntary "
+          "switches; %"PRIu64" ns ready, %"PRIu64" ns blocked\n",
+          t->name, t->tid, a.user_ticks, a.kernel_ticks,
+          clock_cycles_to_ns (a.intr_cycles), a.voluntary, a.involuntary,
+          clock_cycles_to_ns (a.ready_cycles),
+          clock_cycles_to_ns (a.blocked_cycles));
 }
 
 /* Returns a tid to use for a new thread. */
@@ -654,7 +1431,7 @@ allocate_tid (void)
   static tid_t next_tid = 1;
   tid_t tid;
 
-  lock_acquire (&tid_lock);
+  lock_acquire_adaptive (&tid_lock);
   tid = next_tid++;
   lock_release (&tid_lock);
 
@@ -665,3 +1442,132 @@ allocate_tid (void)
    Used by switch.S, which can't figure it out on its own. */
 uint32_t thread_stack_ofs = offsetof (struct thread, stack);
 
+/* Puts the running thread in the deadline class, to be given
+   RUNTIME ticks of CPU within DEADLINE ticks of each release,
+   one release every PERIOD ticks starting now, or takes it out of
+   the class if RUNTIME is 0.  Returns false, leaving the thread's
+   parameters alone, if the parameters are not 0 < RUNTIME <=
+   DEADLINE <= PERIOD or if admitting the thread would load the
+   class beyond EDF_MAX_LOAD. */
+bool
+thread_set_deadline (int64_t runtime, int64_t period, int64_t deadline)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  int load = 0;
+
+  if (runtime != 0)
+    {
+      if (runtime < 0 || runtime > deadline || deadline > period)
+        return false;
+      load = DIV_ROUND_UP (runtime * 1000, deadline);
+    }
+
+  old_level = intr_disable ();
+  if (edf_load - cur->rt_load + load > EDF_MAX_LOAD)
+    {
+      intr_set_level (old_level);
+      return false;
+    }
+  edf_load += load - cur->rt_load;
+  cur->rt_load = load;
+  cur->rt_runtime = runtime;
+  cur->rt_period = runtime != 0 ? period : 0;
+  cur->rt_deadline = deadline;
+  cur->rt_release = timer_ticks ();
+  cur->rt_abs_deadline = cur->rt_release + deadline;
+  cur->rt_used = 0;
+  if (runtime != 0)
+    edf_used = true;
+  intr_set_level (old_level);
+  return true;
+}
+
+/* Ends the running EDF thread's current job and sleeps until its
+   next release.  A job that ends after its deadline, and each
+   release that passed while it ran, counts as a deadline miss,
+   recorded in the scheduler trace.  The thread then resumes at
+   the latest release, so that a late thread resynchronizes with
+   its period instead of running a burst of stale jobs. */
+void
+thread_wait_period (void)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  int64_t now;
+
+  ASSERT (cur->rt_period != 0);
+
+  old_level = intr_disable ();
+  now = timer_ticks ();
+  if (now > cur->rt_abs_deadline)
+    {
+      edf_miss_cnt++;
+      int64_t late = now - cur->rt_abs_deadline;
+      sched_trace (SCHED_MISS, cur, late < INT8_MAX ? late : INT8_MAX, -1);
+    }
+  cur->rt_release += cur->rt_period;
+  while (cur->rt_release + cur->rt_deadline <= now)
+    {
+      edf_miss_cnt++;
+      cur->rt_release += cur->rt_period;
+    }
+  if (cur->rt_release > now)
+    {
+      timeout_add (&cur->rt_timeout, cur->rt_release - now);
+      thread_block ();
+    }
+  else
+    {
+      cur->rt_used = 0;
+      cur->rt_abs_deadline = cur->rt_release + cur->rt_deadline;
+    }
+  intr_set_level (old_level);
+}
+
+/* Release timeout function: AUX is an EDF thread blocked in
+   thread_wait_period(), whose next job starts now. */
+static void
+edf_release (struct timeout *timeout UNUSED, void *aux)
+{
+  struct thread *t = aux;
+
+  t->rt_used = 0;
+  t->rt_abs_deadline = t->rt_release + t->rt_deadline;
+  thread_unblock (t);
+}
+
+/* Returns true if T is in the deadline class and has budget left
+   in its current job. */
+static bool
+edf_active (const struct thread *t)
+{
+  return t->rt_period != 0 && t->rt_used < t->rt_runtime;
+}
+
+/* Returns true if ready EDF thread T should preempt the running
+   thread: it has no budgeted deadline of its own or a later
+   one. */
+static bool
+edf_preempts (const struct thread *t)
+{
+  struct thread *cur = running_thread ();
+
+  return (cur == idle_thread || !edf_active (cur)
+          || t->rt_abs_deadline < cur->rt_abs_deadline);
+}
+
+/* Charges a tick to running thread T if it is an EDF thread
+   within its budget, and returns true if so, because such a
+   thread is not timesliced: it runs until it blocks, an earlier
+   deadline arrives, or its budget runs out, at which point it
+   yields to be requeued at its MLFQ level. */
+static bool
+edf_tick (struct thread *t)
+{
+  if (t == idle_thread || !edf_active (t))
+    return false;
+  if (++t->rt_used >= t->rt_runtime)
+    intr_yield_on_return ();
+  return true;
+}
@@ -2,8 +2,12 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <heap.h>
 #include <list.h>
+#include <random.h>
 #include <stdint.h>
+#include "devices/timer.h"
+#include "threads/malloc.h"
 
 /* States in a thread's life cycle. */
 enum thread_status
@@ -24,6 +28,38 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Thread niceness. */
+#define NICE_MIN -20                    /* Nicest. */
+#define NICE_DEFAULT 0                  /* Default niceness. */
+#define NICE_MAX 20                     /* Least nice. */
+
+/* Per-thread CPU accounting.  Updated with interrupts off by the
+   scheduler and by the timer and interrupt handlers, so read it
+   with interrupts off too. */
+struct thread_acct
+  {
+    /* Updated on every switch. */
+    uint64_t since;             /* Cycle count when it last became
+                                   ready, blocked, or running. */
+    uint64_t ready_cycles;      /* Waiting on the ready queue. */
+    unsigned voluntary;         /* Switches away because it blocked. */
+    unsigned involuntary;       /* Switches away while still ready. */
+
+    /* Updated on every tick, wakeup, or interrupt. */
+    int64_t user_ticks;         /* Ticks that interrupted user code. */
+    int64_t kernel_ticks;       /* Ticks that interrupted the kernel. */
+    uint64_t blocked_cycles;    /* Blocked. */
+    uint64_t intr_cycles;       /* In external interrupt handlers. */
+  };
+
+/* Size of a CPU cache line.  The members of struct thread that
+   the scheduler and the timer interrupt use on every switch and
+   tick come first, within one line, and the accounting that the
+   same paths update fills the next, so that a switch touches two
+   lines of each thread instead of fields scattered across the
+   structure.  thread_init() checks that they still fit. */
+#define THREAD_LINE_SIZE 64
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -50,8 +86,9 @@ typedef int tid_t;
              |              magic              |
              |                :                |
              |                :                |
-             |               name              |
+             |               acct              |
              |              status             |
+             |              stack              |
         0 kB +---------------------------------+
 
    The upshot of this is twofold:
@@ -82,26 +119,116 @@ typedef int tid_t;
    blocked state is on a semaphore wait list. */
 struct thread
   {
-    /* Owned by thread.c. */
-    tid_t tid;                          /* Thread identifier. */
-    enum thread_status status;          /* Thread state. */
-    char name[16];                      /* Name (for debugging purposes). */
+    /* Used on every switch or tick.  Owned by thread.c.  Must fit
+       in THREAD_LINE_SIZE bytes. */
     uint8_t *stack;                     /* Saved stack pointer. */
-    int priority;                       /* Priority. */
-    struct list_elem allelem;           /* List element for all threads list. */
+    enum thread_status status;          /* Thread state. */
+    int priority;                       /* Priority, with donations. */
+    tid_t tid;                          /* Thread identifier. */
+    int qno;                            /* MLFQ level. */
+    int total_time;                     /* Ticks run at this level. */
+    long long ready_since;              /* Clock when last queued. */
+    int nice;                           /* Niceness (4.4BSD). */
+    int recent_cpu;                     /* Recent CPU use, fixed-point. */
+    uint64_t pass;                      /* Stride scheduler: virtual
+                                           time charged so far. */
+    unsigned stride;                    /* Pass charged per tick. */
+    bool on_cpu_list;                   /* In cpu_list? */
+    bool dirty;                         /* In dirty_list? */
 
     /* Shared between thread.c and synch.c. */
     struct list_elem elem;              /* List element. */
 
+    /* CPU accounting, owned by thread.c, in a line of its own. */
+    struct thread_acct acct __attribute__ ((aligned (THREAD_LINE_SIZE)));
+
+    /* The rest is used less often. */
+    char name[16];                      /* Name (for debugging purposes). */
+    int base_priority;                  /* Priority without donations. */
+    struct list held_locks;             /* Locks held. */
+    struct lock *wait_lock;             /* Lock being waited for. */
+    struct waiter *waiter;              /* Wait in a waitqueue, or null.
+                                           Owned by synch.c. */
+    int rcu_nesting;                    /* Read-side section depth. */
+    bool rcu_yield;                     /* Yield when it reaches 0?
+                                           Owned by rcu.c. */
+    struct list_elem allelem;           /* List element for all threads list. */
+    struct prng prng;                   /* Random numbers, for thread_prng(). */
+    struct list_elem cpu_elem;          /* cpu_list element. */
+    struct list_elem dirty_elem;        /* dirty_list element. */
+    int tickets;                        /* Stride scheduler's share. */
+    struct heap_elem ready_elem;        /* Stride scheduler's ready_heap
+                                           or EDF's edf_heap element. */
+
+    /* Deadline (EDF) class, owned by thread.c.  rt_period is 0
+       for a thread outside the class. */
+    int64_t rt_runtime;                 /* Ticks of CPU per period. */
+    int64_t rt_period;                  /* Ticks between releases. */
+    int64_t rt_deadline;                /* Ticks after release to finish. */
+    int64_t rt_release;                 /* Tick of the latest release. */
+    int64_t rt_abs_deadline;            /* Tick the current job is due. */
+    int64_t rt_used;                    /* Ticks run since the release. */
+    int rt_load;                        /* Admitted share, per mille. */
+    struct timeout rt_timeout;          /* Releases the next job. */
+
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */
+    struct vdso *vdso;                  /* Time page, or null. */
+    int exit_status;                    /* Status passed to exit(). */
+    struct exit_record *exit_record;    /* Shared with the parent, or
+                                           null if none. */
+    struct list running_children;       /* Exit records of live children. */
+    struct list exited_children;        /* Exit records not yet reaped. */
+    struct semaphore *reaper;           /* Upped when a child exits, in
+                                           process_wait_any(). */
+    uint8_t *heap_start;                /* Start of the heap. */
+    uint8_t *heap_break;                /* End of the heap, moved by
+                                           process_sbrk(). */
+
+    /* Owned by userprog/syscall.c. */
+    struct fd *fds;                     /* Open files and pipes, by
+                                           handle. */
+    struct bitmap *fd_map;              /* File handles in use. */
+    struct pipe *stdio[2];              /* Pipes standing in for the
+                                           console's input and output,
+                                           or nulls. */
+#endif
+#ifdef VM
+    /* Owned by vm/page.c. */
+    struct hash *pages;                 /* Supplemental page table. */
+    struct file *exec_file;             /* Executable, read on demand. */
+    void *user_esp;                     /* User stack pointer at the
+                                           last system call. */
+    struct list mappings;               /* Memory-mapped files. */
+    int next_mapid;                     /* Next mapping identifier. */
+    unsigned minor_faults;              /* Pages mapped without I/O. */
+    unsigned major_faults;              /* Pages read from file or swap. */
+    unsigned cow_faults;                /* Copy-on-write pages made private. */
+
+    /* Owned by vm/frame.c. */
+    unsigned age_pass;                  /* Aging pass that counted these. */
+    size_t resident_cnt;                /* Pages in frames. */
+    size_t ws_cnt;                      /* Of those, pages in the working
+                                           set. */
+#endif
+#ifdef FILESYS
+    /* Owned by filesys/journal.c. */
+    int journal_depth;                  /* Nesting of journal_begin(). */
 #endif
 
-    /* Owned by thread.c. */
+    /* Owned by threads/malloc.c. */
+    int malloc_blocks[MALLOC_ORDERS];   /* Blocks allocated less blocks
+                                           freed, by order, if tracked. */
+
+    /* Owned by threads/fpu.c. */
+    void *fpu;                          /* Saved FPU state, or null if
+                                           the thread has not used the
+                                           FPU. */
+
+    /* Owned by thread.c.  Last, nearest the stack, to catch it
+       overflowing. */
     unsigned magic;                     /* Detects stack overflow. */
-    int qno;
-    int total_time;
   };
 
 /* If false (default), use round-robin scheduler.
@@ -109,10 +236,32 @@ struct thread
    Controlled by kernel command-line option "-o mlfqs". */
 extern bool thread_mlfqs;
 
+/* If true, use the stride scheduler, which gives each thread a
+   share of the CPU in proportion to tickets set by its priority.
+   Controlled by kernel command-line option "-stride". */
+extern bool thread_stride;
+
+/* If true, print each thread's CPU accounting when it exits and,
+   for the threads still alive, at shutdown.  Controlled by kernel
+   command-line option "-acct". */
+extern bool thread_acct_print;
+
+/* MLFQ levels, quanta per level before demotion, ticks waited
+   before promotion, and whether threads woken by interrupts go
+   back to the top level.  Controlled by kernel command-line
+   options "-mlfq-levels", "-mlfq-demote", "-mlfq-age", and
+   "-mlfq-noboost". */
+extern int thread_mlfq_levels;
+extern int thread_mlfq_demote;
+extern int thread_mlfq_age;
+extern bool thread_mlfq_boost;
+void thread_mlfq_set_quanta (char *list);
+
 void thread_init (void);
 void thread_start (void);
 
-void thread_tick (void);
+void thread_tick (bool user);
+void thread_idle_tick (void);
 void thread_print_stats (void);
 
 typedef void thread_func (void *aux);
@@ -124,6 +273,7 @@ void thread_unblock (struct thread *);
 struct thread *thread_current (void);
 tid_t thread_tid (void);
 const char *thread_name (void);
+struct prng *thread_prng (void);
 
 void thread_exit (void) NO_RETURN;
 void thread_yield (void);
@@ -134,10 +284,19 @@ void thread_foreach (thread_action_func *, void *);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
+void thread_donate_priority (struct thread *, int priority);
+void thread_update_priority (struct thread *);
+void thread_check_preempt (void);
+bool thread_priority_less (const struct list_elem *,
+                           const struct list_elem *, void *aux);
 
 int thread_get_nice (void);
 void thread_set_nice (int);
 int thread_get_recent_cpu (void);
 int thread_get_load_avg (void);
 
+bool thread_set_deadline (int64_t runtime, int64_t period,
+                          int64_t deadline);
+void thread_wait_period (void);
+
 #endif /* threads/thread.h */
@@ -1,9 +1,15 @@
 #include "devices/block.h"
+#include <hash.h>
 #include <list.h>
 #include <string.h>
 #include <stdio.h>
+#include "devices/clock.h"
 #include "devices/ide.h"
+#include "devices/partition.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/percpu.h"
 
 /* A block device. */
 struct block
@@ -16,18 +22,78 @@ struct block
 
     const struct block_operations *ops;  /* Driver operations. */
     void *aux;                          /* Extra data owned by driver. */
+    bool scan_pending;                  /* Partitions not yet scanned? */
 
-    unsigned long long read_cnt;        /* Number of sectors read. */
-    unsigned long long write_cnt;       /* Number of sectors written. */
+    /* Statistics, protected by disabling interrupts.  The sector
+       counts, updated on every request, are kept per CPU and
+       copied into STATS only by block_get_stats(). */
+    struct block_stats stats;
+    struct pcpu_counter read_cnt;       /* Sectors read. */
+    struct pcpu_counter write_cnt;      /* Sectors written. */
+    block_sector_t next_sector;         /* Just past the last request. */
   };
 
-/* List of all block devices. */
+/* Sectors that block_read_multi() and block_write_multi() pass
+   to the driver at once. */
+#define BLOCK_VEC_CNT 32
+
+/* List of all block devices, in probe order: each disk is
+   followed by its partitions. */
 static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 
+/* While a disk's partitions are being scanned, where in
+   all_blocks to register them, so that they follow the disk;
+   otherwise, a null pointer. */
+static struct list_elem *register_before;
+
+/* Recently looked up block devices, by hash of name. */
+#define NAME_CACHE_CNT 16
+static struct block *name_cache[NAME_CACHE_CNT];
+
+/* Requests completed in interrupt handlers, to be finished by
+   completion_work once the handler returns.  Protected by
+   disabling interrupts. */
+static struct list completed_requests
+  = LIST_INITIALIZER (completed_requests);
+static intr_deferred_func finish_completed;
+static struct intr_deferred completion_work = { .func = finish_completed };
+static void finish_request (struct block_request *);
+
+/* An I/O scheduler, which picks the request that a block_queue
+   hands to its driver next. */
+struct block_scheduler
+  {
+    const char *name;
+    struct block_request *(*pick) (struct block_queue *);
+  };
+
+static struct block_request *pick_fifo (struct block_queue *);
+static struct block_request *pick_cscan (struct block_queue *);
+static struct block_request *pick_deadline (struct block_queue *);
+static rb_less_func request_less;
+
+static const struct block_scheduler schedulers[] =
+  {
+    {"fifo", pick_fifo},
+    {"cscan", pick_cscan},
+    {"deadline", pick_deadline},
+  };
+#define SCHEDULER_CNT (sizeof schedulers / sizeof *schedulers)
+
+/* The I/O scheduler in use.  Defaults to "deadline". */
+static const struct block_scheduler *scheduler = &schedulers[2];
+
+/* Ticks that the deadline scheduler lets a queued read or write,
+   respectively, wait before serving it out of order. */
+static const int64_t read_expire = TIMER_FREQ / 20 + 1;
+static const int64_t write_expire = TIMER_FREQ / 2 + 1;
+
 /* The block block assigned to each Pintos role. */
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
 static struct block *list_elem_to_block (struct list_elem *);
+static struct block *find_by_name (const char *);
+static void scan_partitions (struct block *);
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -74,29 +140,58 @@ block_first (void)
 }
 
 /* Returns the block device following BLOCK in kernel probe
-   order, or a null pointer if BLOCK is the last block device. */
+   order, or a null pointer if BLOCK is the last block device.
+   If BLOCK is a disk whose partitions have not been scanned,
+   scans them first, so that they come next. */
 struct block *
 block_next (struct block *block)
 {
+  scan_partitions (block);
   return list_elem_to_block (list_next (&block->list_elem));
 }
 
 /* Returns the block device with the given NAME, or a null
-   pointer if no block device has that name. */
+   pointer if no block device has that name.  A partition on a
+   disk that has not been scanned yet is found by scanning, first,
+   any such disk whose name NAME starts with, and then, if NAME
+   is still missing, all of them. */
 struct block *
 block_get_by_name (const char *name)
 {
+  struct block **cached = &name_cache[hash_string (name) % NAME_CACHE_CNT];
+  struct block *block;
   struct list_elem *e;
 
-  for (e = list_begin (&all_blocks); e != list_end (&all_blocks);
-       e = list_next (e))
+  if (*cached != NULL && !strcmp (name, (*cached)->name))
+    return *cached;
+
+  block = find_by_name (name);
+  for (e = list_begin (&all_blocks);
+       block == NULL && e != list_end (&all_blocks); e = list_next (e))
     {
-      struct block *block = list_entry (e, struct block, list_elem);
-      if (!strcmp (name, block->name))
-        return block;
+      struct block *disk = list_entry (e, struct block, list_elem);
+      size_t length = strlen (disk->name);
+      if (disk->scan_pending && strlen (name) > length
+          && !memcmp (name, disk->name, length))
+        {
+          scan_partitions (disk);
+          block = find_by_name (name);
+        }
+    }
+  for (e = list_begin (&all_blocks);
+       block == NULL && e != list_end (&all_blocks); e = list_next (e))
+    {
+      struct block *disk = list_entry (e, struct block, list_elem);
+      if (disk->scan_pending)
+        {
+          scan_partitions (disk);
+          block = find_by_name (name);
+        }
     }
 
-  return NULL;
+  if (block != NULL)
+    *cached = block;
+  return block;
 }
 
 /* Verifies that SECTOR is a valid offset within BLOCK.
@@ -113,6 +208,207 @@ check_sector (struct block *block, block_sector_t sector)
     }
 }
 
+/* Initializes R as a request to transfer the CNT sectors
+   starting at SECTOR, the Ith of them to or from BUFFERS[I], and
+   to call DONE, passing it R, when that is finished.  If WRITE
+   is false, the sectors are read into the buffers; otherwise,
+   they are written from them.  If DONE is null, the submitter
+   must instead wait for the request with block_wait().  AUX is
+   stored in R for DONE's use.  BUFFERS must stay valid until the
+   request completes. */
+void
+block_request_init (struct block_request *r, bool write,
+                    block_sector_t sector, void *const buffers[],
+                    size_t cnt, block_done_func *done, void *aux)
+{
+  ASSERT (cnt > 0);
+
+  r->write = write;
+  r->sector = sector;
+  r->cnt = cnt;
+  r->buffers = buffers;
+  r->done = done;
+  r->aux = aux;
+  r->block = NULL;
+  sema_init (&r->finished, 0);
+}
+
+/* Returns the bucket in a latency histogram for latency X. */
+static size_t
+hist_bucket (uint64_t x)
+{
+  size_t i;
+
+  for (i = 0; x != 0 && i < BLOCK_HIST_CNT - 1; i++)
+    x >>= 1;
+  return i;
+}
+
+/* Records in BLOCK's statistics that request R has been
+   submitted to it. */
+static void
+account_submit (struct block *block, struct block_request *r)
+{
+  struct block_stats *s = &block->stats;
+  enum intr_level old_level = intr_disable ();
+
+  if (r->write)
+    {
+      pcpu_add (&block->write_cnt, r->cnt);
+      s->write_reqs++;
+    }
+  else
+    {
+      pcpu_add (&block->read_cnt, r->cnt);
+      s->read_reqs++;
+    }
+  if (r->sector == block->next_sector)
+    s->sequential++;
+  else
+    s->random++;
+  block->next_sector = r->sector + r->cnt;
+
+  if (r->block == NULL)
+    {
+      r->block = block;
+      r->submit_ticks = timer_ticks ();
+      r->submit_tsc = clock_cycles ();
+      s->depth_sum += s->depth;
+      if (++s->depth > s->max_depth)
+        s->max_depth = s->depth;
+    }
+  intr_set_level (old_level);
+}
+
+/* Records in the statistics of the device that request R was
+   submitted to that R has completed. */
+static void
+account_complete (struct block_request *r)
+{
+  struct block_stats *s = &r->block->stats;
+  enum intr_level old_level = intr_disable ();
+  int64_t ticks = timer_ticks () - r->submit_ticks;
+  uint64_t cycles = clock_cycles () - r->submit_tsc;
+
+  s->completed++;
+  s->ticks += ticks;
+  s->cycles += cycles;
+  s->ticks_hist[hist_bucket (ticks)]++;
+  s->cycles_hist[hist_bucket (cycles)]++;
+  s->depth--;
+  intr_set_level (old_level);
+}
+
+/* Submits request R to BLOCK.  If BLOCK's driver can queue
+   requests, returns at once and completes R later; otherwise,
+   carries R out before returning.  Internally synchronizes
+   accesses to block devices, so external per-block device
+   locking is unneeded. */
+void
+block_submit (struct block *block, struct block_request *r)
+{
+  size_t i;
+
+  check_sector (block, r->sector);
+  check_sector (block, r->sector + r->cnt - 1);
+  ASSERT (!r->write || block->type != BLOCK_FOREIGN);
+  account_submit (block, r);
+
+  if (block->ops->submit != NULL)
+    {
+      block->ops->submit (block->aux, r);
+      return;
+    }
+
+  if (!r->write && block->ops->readv != NULL)
+    block->ops->readv (block->aux, r->sector, r->buffers, r->cnt);
+  else if (r->write && block->ops->writev != NULL)
+    block->ops->writev (block->aux, r->sector,
+                        (const void *const *) r->buffers, r->cnt);
+  else
+    for (i = 0; i < r->cnt; i++)
+      if (r->write)
+        block->ops->write (block->aux, r->sector + i, r->buffers[i]);
+      else
+        block->ops->read (block->aux, r->sector + i, r->buffers[i]);
+  block_complete (r);
+}
+
+/* Waits for request R, which must have been submitted without a
+   completion function, to complete. */
+void
+block_wait (struct block_request *r)
+{
+  ASSERT (r->done == NULL);
+  sema_down (&r->finished);
+}
+
+/* Called by a block driver when it has finished carrying out
+   request R.  May be called from an interrupt handler, in which
+   case R's completion is deferred until the handler returns, so
+   that completion functions run with interrupts on. */
+void
+block_complete (struct block_request *r)
+{
+  if (intr_context ())
+    {
+      enum intr_level old_level = intr_disable ();
+      list_push_back (&completed_requests, &r->elem);
+      intr_set_level (old_level);
+      intr_defer (&completion_work);
+    }
+  else
+    finish_request (r);
+}
+
+/* Accounts for request R's completion and notifies its
+   submitter. */
+static void
+finish_request (struct block_request *r)
+{
+  if (r->block != NULL)
+    account_complete (r);
+  if (r->done != NULL)
+    r->done (r);
+  else
+    sema_up_io (&r->finished);
+}
+
+/* Finishes the requests in completed_requests.  Runs as work
+   deferred by the interrupt handlers that completed them. */
+static void
+finish_completed (void *aux UNUSED)
+{
+  for (;;)
+    {
+      enum intr_level old_level = intr_disable ();
+      struct block_request *r = (list_empty (&completed_requests) ? NULL
+                                 : list_entry (list_pop_front
+                                               (&completed_requests),
+                                               struct block_request, elem));
+      intr_set_level (old_level);
+
+      if (r == NULL)
+        break;
+      finish_request (r);
+    }
+}
+
+/* Submits a request to transfer the CNT sectors starting at
+   SECTOR to or from BUFFERS on BLOCK and waits for it. */
+static void
+transfer (struct block *block, bool write, block_sector_t sector,
+          void *const buffers[], size_t cnt)
+{
+  struct block_request r;
+
+  if (cnt == 0)
+    return;
+  block_request_init (&r, write, sector, buffers, cnt, NULL, NULL);
+  block_submit (block, &r);
+  block_wait (&r);
+}
+
 /* Reads sector SECTOR from BLOCK into BUFFER, which must
    have room for BLOCK_SECTOR_SIZE bytes.
    Internally synchronizes accesses to block devices, so external
@@ -120,9 +416,7 @@ check_sector (struct block *block, block_sector_t sector)
 void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
-  check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  transfer (block, false, sector, &buffer, 1);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -133,10 +427,83 @@ block_read (struct block *block, block_sector_t sector, void *buffer)
 void
 block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
-  check_sector (block, sector);
-  ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
-  block->write_cnt++;
+  void *buffers[1];
+
+  buffers[0] = (void *) buffer;
+  transfer (block, true, sector, buffers, 1);
+}
+
+/* Reads the CNT sectors starting at SECTOR from BLOCK into
+   BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes.  Internally synchronizes accesses to block devices. */
+void
+block_read_multi (struct block *block, block_sector_t sector, size_t cnt,
+                  void *buffer)
+{
+  void *buffers[BLOCK_VEC_CNT];
+
+  while (cnt > 0)
+    {
+      size_t n = cnt < BLOCK_VEC_CNT ? cnt : BLOCK_VEC_CNT;
+      size_t i;
+
+      for (i = 0; i < n; i++)
+        buffers[i] = (uint8_t *) buffer + i * BLOCK_SECTOR_SIZE;
+      block_readv (block, sector, buffers, n);
+
+      sector += n;
+      buffer = (uint8_t *) buffer + n * BLOCK_SECTOR_SIZE;
+      cnt -= n;
+    }
+}
+
+/* Writes the CNT sectors starting at SECTOR to BLOCK from
+   BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Returns after the block device has acknowledged receiving the
+   data.  Internally synchronizes accesses to block devices. */
+void
+block_write_multi (struct block *block, block_sector_t sector, size_t cnt,
+                   const void *buffer)
+{
+  const void *buffers[BLOCK_VEC_CNT];
+
+  while (cnt > 0)
+    {
+      size_t n = cnt < BLOCK_VEC_CNT ? cnt : BLOCK_VEC_CNT;
+      size_t i;
+
+      for (i = 0; i < n; i++)
+        buffers[i] = (const uint8_t *) buffer + i * BLOCK_SECTOR_SIZE;
+      block_writev (block, sector, buffers, n);
+
+      sector += n;
+      buffer = (const uint8_t *) buffer + n * BLOCK_SECTOR_SIZE;
+      cnt -= n;
+    }
+}
+
+/* Reads the CNT sectors starting at SECTOR from BLOCK, the Ith
+   of them into BUFFERS[I], which must have room for
+   BLOCK_SECTOR_SIZE bytes.  The driver transfers them all at
+   once if it can.  Internally synchronizes accesses to block
+   devices. */
+void
+block_readv (struct block *block, block_sector_t sector,
+             void *const buffers[], size_t cnt)
+{
+  transfer (block, false, sector, buffers, cnt);
+}
+
+/* Writes the CNT sectors starting at SECTOR to BLOCK, the Ith
+   of them from BUFFERS[I], which must contain BLOCK_SECTOR_SIZE
+   bytes.  The driver transfers them all at once if it can.
+   Returns after the block device has acknowledged receiving the
+   data.  Internally synchronizes accesses to block devices. */
+void
+block_writev (struct block *block, block_sector_t sector,
+              const void *const buffers[], size_t cnt)
+{
+  transfer (block, true, sector, (void *const *) buffers, cnt);
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -160,6 +527,51 @@ block_type (struct block *block)
   return block->type;
 }
 
+/* Copies BLOCK's statistics into *STATS.  If RESET is true,
+   also starts them over from zero, as of now, so that a later
+   call reports only what happens in between. */
+void
+block_get_stats (struct block *block, struct block_stats *stats, bool reset)
+{
+  enum intr_level old_level = intr_disable ();
+
+  *stats = block->stats;
+  stats->read_cnt = pcpu_read (&block->read_cnt);
+  stats->write_cnt = pcpu_read (&block->write_cnt);
+  if (reset)
+    {
+      struct block_stats *s = &block->stats;
+      unsigned depth = s->depth;
+
+      memset (s, 0, sizeof *s);
+      s->depth = s->max_depth = depth;
+      pcpu_init (&block->read_cnt);
+      pcpu_init (&block->write_cnt);
+    }
+  intr_set_level (old_level);
+}
+
+/* Prints the nonempty buckets of latency histogram HIST, giving
+   each as the latency range it covers in UNITs. */
+static void
+print_hist (const char *unit, const unsigned long long hist[BLOCK_HIST_CNT])
+{
+  size_t i;
+
+  printf ("  latency in %s:", unit);
+  for (i = 0; i < BLOCK_HIST_CNT; i++)
+    if (hist[i] != 0)
+      {
+        if (i == 0)
+          printf (" 0:%llu", hist[i]);
+        else if (i < BLOCK_HIST_CNT - 1)
+          printf (" <%llu:%llu", 1ULL << i, hist[i]);
+        else
+          printf (" >=%llu:%llu", 1ULL << (i - 1), hist[i]);
+      }
+  printf ("\n");
+}
+
 /* Prints statistics for each block device used for a Pintos role. */
 void
 block_print_stats (void)
@@ -169,12 +581,30 @@ block_print_stats (void)
   for (i = 0; i < BLOCK_ROLE_CNT; i++)
     {
       struct block *block = block_by_role[i];
-      if (block != NULL)
-        {
-          printf ("%s (%s): %llu reads, %llu writes\n",
-                  block->name, block_type_name (block->type),
-                  block->read_cnt, block->write_cnt);
-        }
+      struct block_stats s;
+
+      if (block == NULL)
+        continue;
+      block_get_stats (block, &s, false);
+      printf ("%s (%s): %llu reads, %llu writes\n",
+              block->name, block_type_name (block->type),
+              s.read_cnt, s.write_cnt);
+      if (s.completed == 0)
+        continue;
+
+      printf ("  %llu requests (%llu sequential, %llu random), "
+              "%llu bytes read, %llu bytes written\n",
+              s.read_reqs + s.write_reqs, s.sequential, s.random,
+              s.read_cnt * BLOCK_SECTOR_SIZE,
+              s.write_cnt * BLOCK_SECTOR_SIZE);
+      printf ("  average latency %llu ticks, %llu cycles (%llu ns); "
+              "queue depth average %llu, max %u\n",
+              s.ticks / s.completed, s.cycles / s.completed,
+              (unsigned long long) clock_cycles_to_ns (s.cycles
+                                                       / s.completed),
+              s.depth_sum / s.completed, s.max_depth);
+      print_hist ("ticks", s.ticks_hist);
+      print_hist ("cycles", s.cycles_hist);
     }
 }
 
@@ -192,14 +622,20 @@ block_register (const char *name, enum block_type type,
   if (block == NULL)
     PANIC ("Failed to allocate memory for block device descriptor");
 
-  list_push_back (&all_blocks, &block->list_elem);
+  if (register_before != NULL)
+    list_insert (register_before, &block->list_elem);
+  else
+    list_push_back (&all_blocks, &block->list_elem);
   strlcpy (block->name, name, sizeof block->name);
   block->type = type;
   block->size = size;
   block->ops = ops;
   block->aux = aux;
-  block->read_cnt = 0;
-  block->write_cnt = 0;
+  block->scan_pending = false;
+  memset (&block->stats, 0, sizeof block->stats);
+  pcpu_init (&block->read_cnt);
+  pcpu_init (&block->write_cnt);
+  block->next_sector = 0;
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
@@ -210,7 +646,173 @@ block_register (const char *name, enum block_type type,
 
   return block;
 }
+
+/* Marks disk BLOCK as having partitions that are to be scanned
+   only once something looks for them, by name or by walking the
+   list of block devices past BLOCK.  A disk that no role or
+   command names is then never read at boot. */
+void
+block_defer_partitions (struct block *block)
+{
+  block->scan_pending = true;
+}
 
+/* Selects the I/O scheduler named NAME, one of "fifo", "cscan",
+   or "deadline".  Returns false if there is no such scheduler.
+   Should be called before any requests are queued. */
+bool
+block_set_scheduler (const char *name)
+{
+  size_t i;
+
+  for (i = 0; i < SCHEDULER_CNT; i++)
+    if (!strcmp (name, schedulers[i].name))
+      {
+        scheduler = &schedulers[i];
+        return true;
+      }
+  return false;
+}
+
+/* Initializes Q as an empty request queue. */
+void
+block_queue_init (struct block_queue *q)
+{
+  rb_init (&q->sorted, request_less, NULL);
+  list_init (&q->fifo[0]);
+  list_init (&q->fifo[1]);
+  q->head = 0;
+}
+
+/* Returns true if Q holds no requests. */
+bool
+block_queue_empty (struct block_queue *q)
+{
+  return rb_empty (&q->sorted);
+}
+
+/* Orders requests by starting sector. */
+static bool
+request_less (const struct rb_elem *a_, const struct rb_elem *b_,
+              void *aux UNUSED)
+{
+  const struct block_request *a = rb_entry (a_, struct block_request,
+                                            sorted_elem);
+  const struct block_request *b = rb_entry (b_, struct block_request,
+                                            sorted_elem);
+
+  return a->sector < b->sector;
+}
+
+/* Adds request R to Q. */
+void
+block_queue_push (struct block_queue *q, struct block_request *r)
+{
+  r->queued = timer_ticks ();
+  rb_insert (&q->sorted, &r->sorted_elem);
+  list_push_back (&q->fifo[r->write], &r->fifo_elem);
+}
+
+/* Removes request R from Q and returns it. */
+static struct block_request *
+remove_request (struct block_queue *q, struct block_request *r)
+{
+  rb_remove (&q->sorted, &r->sorted_elem);
+  list_remove (&r->fifo_elem);
+  q->head = r->sector + r->cnt;
+  return r;
+}
+
+/* Removes the request that the I/O scheduler picks from Q, which
+   must not be empty, and returns it. */
+struct block_request *
+block_queue_pop (struct block_queue *q)
+{
+  ASSERT (!block_queue_empty (q));
+  return remove_request (q, scheduler->pick (q));
+}
+
+/* Looks in Q for a request that could be merged onto the end of
+   one just popped: a read (if WRITE is false) or write (if WRITE
+   is true) of at most MAX_CNT sectors starting at SECTOR.  If
+   there is one, removes it from Q and returns it; otherwise,
+   returns a null pointer. */
+struct block_request *
+block_queue_pop_adjacent (struct block_queue *q, block_sector_t sector,
+                          bool write, size_t max_cnt)
+{
+  struct block_request key;
+  struct rb_elem *e;
+
+  key.sector = sector;
+  for (e = rb_lower_bound (&q->sorted, &key.sorted_elem); e != NULL;
+       e = rb_next (e))
+    {
+      struct block_request *r = rb_entry (e, struct block_request,
+                                          sorted_elem);
+      if (r->sector > sector)
+        break;
+      else if (r->write == write && r->cnt <= max_cnt)
+        return remove_request (q, r);
+    }
+  return NULL;
+}
+
+/* Returns the oldest request in Q, preferring reads on a tie. */
+static struct block_request *
+pick_fifo (struct block_queue *q)
+{
+  struct block_request *read = NULL, *write = NULL;
+
+  if (!list_empty (&q->fifo[0]))
+    read = list_entry (list_front (&q->fifo[0]),
+                       struct block_request, fifo_elem);
+  if (!list_empty (&q->fifo[1]))
+    write = list_entry (list_front (&q->fifo[1]),
+                        struct block_request, fifo_elem);
+  return (read != NULL && (write == NULL || read->queued <= write->queued)
+          ? read : write);
+}
+
+/* Returns the request in Q that starts at the lowest sector at
+   or past the end of the last one popped, wrapping around to the
+   lowest sector overall if there is none, so that the disk head
+   sweeps across the disk in a single direction. */
+static struct block_request *
+pick_cscan (struct block_queue *q)
+{
+  struct block_request key;
+  struct rb_elem *e;
+
+  key.sector = q->head;
+  e = rb_lower_bound (&q->sorted, &key.sorted_elem);
+  if (e == NULL)
+    e = rb_first (&q->sorted);
+  return rb_entry (e, struct block_request, sorted_elem);
+}
+
+/* Returns the oldest read in Q if it has waited longer than
+   read_expire, otherwise the oldest write if it has waited longer
+   than write_expire, otherwise the request that C-SCAN picks.
+   The sweep then carries on from the expired request. */
+static struct block_request *
+pick_deadline (struct block_queue *q)
+{
+  int64_t now = timer_ticks ();
+  int i;
+
+  for (i = 0; i < 2; i++)
+    if (!list_empty (&q->fifo[i]))
+      {
+        struct block_request *r = list_entry (list_front (&q->fifo[i]),
+                                              struct block_request,
+                                              fifo_elem);
+        if (now - r->queued >= (r->write ? write_expire : read_expire))
+          return r;
+      }
+  return pick_cscan (q);
+}
+
 /* Returns the block device corresponding to LIST_ELEM, or a null
    pointer if LIST_ELEM is the list end of all_blocks. */
 static struct block *
@@ -221,3 +823,34 @@ list_elem_to_block (struct list_elem *list_elem)
           : NULL);
 }
 
+
+/* Returns the registered block device named NAME, or a null
+   pointer if there is none, without scanning for more. */
+static struct block *
+find_by_name (const char *name)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&all_blocks); e != list_end (&all_blocks);
+       e = list_next (e))
+    {
+      struct block *block = list_entry (e, struct block, list_elem);
+      if (!strcmp (name, block->name))
+        return block;
+    }
+  return NULL;
+}
+
+/* Scans disk BLOCK's partitions, if that was deferred, and
+   registers them just after BLOCK. */
+static void
+scan_partitions (struct block *block)
+{
+  if (block->scan_pending)
+    {
+      block->scan_pending = false;
+      register_before = list_next (&block->list_elem);
+      partition_scan (block);
+      register_before = NULL;
+    }
+}
@@ -1,8 +1,12 @@
 #ifndef DEVICES_BLOCK_H
 #define DEVICES_BLOCK_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <inttypes.h>
+#include <list.h>
+#include <rbtree.h>
+#include "threads/synch.h"
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -53,10 +57,84 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multi (struct block *, block_sector_t, size_t cnt, void *);
+void block_write_multi (struct block *, block_sector_t, size_t cnt,
+                        const void *);
+void block_readv (struct block *, block_sector_t,
+                  void *const buffers[], size_t cnt);
+void block_writev (struct block *, block_sector_t,
+                   const void *const buffers[], size_t cnt);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
+/* Asynchronous requests. */
+struct block_request;
+typedef void block_done_func (struct block_request *);
+
+/* A request to read or write a run of consecutive sectors.  The
+   block layer and the driver own it from block_submit() until it
+   completes. */
+struct block_request
+  {
+    struct list_elem elem;              /* For the driver's use, then
+                                           the block layer's. */
+    struct rb_elem sorted_elem;         /* For struct block_queue. */
+    struct list_elem fifo_elem;         /* For struct block_queue. */
+    int64_t queued;                     /* Tick it was queued. */
+    struct block *block;                /* Device it was submitted to. */
+    int64_t submit_ticks;               /* Tick it was submitted. */
+    uint64_t submit_tsc;                /* TSC when it was submitted. */
+    bool write;                         /* Write, rather than read? */
+    block_sector_t sector;              /* First sector. */
+    size_t cnt;                         /* Number of sectors. */
+    void *const *buffers;               /* One buffer per sector. */
+    block_done_func *done;              /* Called on completion, or
+                                           null to use block_wait(). */
+    void *aux;                          /* For DONE's use. */
+    struct semaphore finished;          /* Up'd on completion. */
+  };
+
+void block_request_init (struct block_request *, bool write,
+                         block_sector_t, void *const buffers[], size_t cnt,
+                         block_done_func *, void *aux);
+void block_submit (struct block *, struct block_request *);
+void block_wait (struct block_request *);
+
+/* I/O scheduling. */
+bool block_set_scheduler (const char *name);
+
 /* Statistics. */
+
+/* Number of buckets in each latency histogram.  Bucket 0 counts
+   latencies of 0; bucket I > 0, latencies at least 2**(I - 1)
+   and less than 2**I; the last bucket, everything larger. */
+#define BLOCK_HIST_CNT 32
+
+/* Statistics for one block device.  Transfer counts cover every
+   request submitted to the device; latency and queue depth,
+   only requests submitted to it directly, not those passed on
+   to it by another block device such as a partition. */
+struct block_stats
+  {
+    unsigned long long read_cnt;        /* Sectors read. */
+    unsigned long long write_cnt;       /* Sectors written. */
+    unsigned long long read_reqs;       /* Read requests. */
+    unsigned long long write_reqs;      /* Write requests. */
+    unsigned long long sequential;      /* Requests starting just past
+                                           the previous one. */
+    unsigned long long random;          /* Other requests. */
+    unsigned long long completed;       /* Requests completed. */
+    unsigned long long ticks;           /* Total latency, in ticks. */
+    unsigned long long cycles;          /* Total latency, in TSC cycles. */
+    unsigned long long ticks_hist[BLOCK_HIST_CNT];  /* By ticks. */
+    unsigned long long cycles_hist[BLOCK_HIST_CNT]; /* By cycles. */
+    unsigned long long depth_sum;       /* Sum over requests of the
+                                           depth they found. */
+    unsigned depth;                     /* Requests in flight now. */
+    unsigned max_depth;                 /* Most requests in flight. */
+  };
+
+void block_get_stats (struct block *, struct block_stats *, bool reset);
 void block_print_stats (void);
 
 /* Lower-level interface to block device drivers. */
@@ -65,10 +143,47 @@ struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+
+    /* Transfer CNT consecutive sectors, the Ith one to or from
+       BUFFERS[I], as one operation if the hardware can.  Either
+       may be null, in which case the block layer calls read or
+       write once per sector instead. */
+    void (*readv) (void *aux, block_sector_t,
+                   void *const buffers[], size_t cnt);
+    void (*writev) (void *aux, block_sector_t,
+                    const void *const buffers[], size_t cnt);
+
+    /* Starts carrying out a request and returns, calling
+       block_complete() once it is done, perhaps from an interrupt
+       handler.  May be null, in which case the block layer makes
+       the transfers with the operations above, in the submitting
+       thread.  A driver that has it needs none of the others. */
+    void (*submit) (void *aux, struct block_request *);
   };
 
 struct block *block_register (const char *name, enum block_type,
                               const char *extra_info, block_sector_t size,
                               const struct block_operations *, void *aux);
+void block_defer_partitions (struct block *);
+void block_complete (struct block_request *);
+
+/* Requests that a driver with a submit operation has not yet
+   started, in the order the I/O scheduler chooses.  The driver
+   must serialize access, e.g. by disabling interrupts. */
+struct block_queue
+  {
+    struct rbtree sorted;               /* All requests, by sector. */
+    struct list fifo[2];                /* Reads, writes, by age. */
+    block_sector_t head;                /* Sector after the last one
+                                           popped. */
+  };
+
+void block_queue_init (struct block_queue *);
+bool block_queue_empty (struct block_queue *);
+void block_queue_push (struct block_queue *, struct block_request *);
+struct block_request *block_queue_pop (struct block_queue *);
+struct block_request *block_queue_pop_adjacent (struct block_queue *,
+                                                block_sector_t, bool write,
+                                                size_t max_cnt);
 
 #endif /* devices/block.h */
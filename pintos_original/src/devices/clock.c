@@ -0,0 +1,78 @@
+#include "devices/clock.h"
+#include <debug.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/tunable.h"
+
+/* Ticks to time the TSC against.  Both ends are at tick
+   boundaries, so the error is only the interrupt latency. */
+#define CALIBRATE_TICKS 4
+
+/* TSC cycles per second, or 0 before clock_calibrate(). */
+static uint64_t cycles_per_sec;
+
+/* TSC rate in kHz to use instead of measuring it, or 0. */
+static unsigned preset_khz;
+TUNABLE_UINT ("clock.khz", preset_khz, 0, UINT32_MAX,
+              "TSC rate in kHz, or 0 to measure it at boot.");
+
+/* Measures the rate of the TSC against the PIT, unless
+   "-o clock.khz" gave it.  Called by timer_calibrate().
+   Interrupts must be on. */
+void
+clock_calibrate (void)
+{
+  uint64_t start_cycles;
+  int64_t start;
+
+  ASSERT (intr_get_level () == INTR_ON);
+  if (preset_khz != 0)
+    {
+      cycles_per_sec = preset_khz * 1000ULL;
+      return;
+    }
+
+  /* Start at a tick boundary. */
+  start = timer_ticks ();
+  while (timer_ticks () == start)
+    barrier ();
+
+  start = timer_ticks ();
+  start_cycles = clock_cycles ();
+  while (timer_ticks () - start < CALIBRATE_TICKS)
+    barrier ();
+  cycles_per_sec = ((clock_cycles () - start_cycles) * TIMER_FREQ
+                    / CALIBRATE_TICKS);
+}
+
+/* Returns the number of TSC cycles per second, or 0 if the
+   clock has not been calibrated yet. */
+uint64_t
+clock_hz (void)
+{
+  return cycles_per_sec;
+}
+
+/* Converts CYCLES, a difference between clock_cycles() values,
+   to nanoseconds.  Returns 0 if the clock has not been
+   calibrated yet. */
+uint64_t
+clock_cycles_to_ns (uint64_t cycles)
+{
+  if (cycles_per_sec == 0)
+    return 0;
+
+  /* Split CYCLES into whole seconds and the rest, so that the
+     multiplication cannot overflow. */
+  return (cycles / cycles_per_sec * 1000000000
+          + cycles % cycles_per_sec * 1000000000 / cycles_per_sec);
+}
+
+/* Returns the current time in nanoseconds, measured from when
+   the TSC was reset, which is usually when the machine was. */
+uint64_t
+clock_ns (void)
+{
+  return clock_cycles_to_ns (clock_cycles ());
+}
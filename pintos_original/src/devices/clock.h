@@ -0,0 +1,26 @@
+#ifndef DEVICES_CLOCK_H
+#define DEVICES_CLOCK_H
+
+#include <stdint.h>
+
+/* Cycle-accurate clock, read from the CPU's time-stamp counter.
+   Unlike timer_ticks(), it can time a single system call, lock
+   hold, or disk request.  It counts from when the TSC was last
+   reset, usually at power-on, so mostly differences between
+   readings are useful. */
+
+/* Returns the current value of the time-stamp counter. */
+static inline uint64_t
+clock_cycles (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+void clock_calibrate (void);
+uint64_t clock_hz (void);
+uint64_t clock_cycles_to_ns (uint64_t cycles);
+uint64_t clock_ns (void);
+
+#endif /* devices/clock.h */
@@ -4,11 +4,13 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include "devices/block.h"
-#include "devices/partition.h"
 #include "devices/timer.h"
+#include "threads/init.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
    controller.  It attempts to comply to [ATA-3]. */
@@ -30,10 +32,24 @@
 #define reg_ctl(CHANNEL) ((CHANNEL)->reg_base + 0x206)  /* Control (w/o). */
 #define reg_alt_status(CHANNEL) reg_ctl (CHANNEL)       /* Alt Status (r/o). */
 
+/* Bus master IDE port addresses [PCI-IDE]. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRD table. */
+
 /* Alternate Status Register bits. */
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
+
+/* Bus Master Command Register bits. */
+#define BM_READ 0x08            /* Transfer from disk to memory. */
+#define BM_START 0x01           /* Start transfer. */
+
+/* Bus Master Status Register bits. */
+#define BM_INTR 0x04            /* Interrupt (write 1 to clear). */
+#define BM_ERR 0x02             /* Error (write 1 to clear). */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +65,33 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* PCI configuration space ports and the registers we use. */
+#define PCI_CONFIG_ADDR 0xcf8
+#define PCI_CONFIG_DATA 0xcfc
+#define PCI_REG_ID 0x00                 /* Vendor and device. */
+#define PCI_REG_COMMAND 0x04            /* Command and status. */
+#define PCI_REG_CLASS 0x08              /* Class, subclass, prog-if. */
+#define PCI_REG_BAR4 0x20               /* Bus master base address. */
+#define PCI_COMMAND_IO 0x0001           /* Respond to I/O space. */
+#define PCI_COMMAND_MASTER 0x0004       /* Enable bus mastering. */
+
+/* A physical region descriptor.  The bus master transfers data
+   to or from a table of these, each describing a physically
+   contiguous region that does not cross a 64 kB boundary. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address. */
+    uint16_t size;              /* Size in bytes, 0 meaning 64 kB. */
+    uint16_t flags;             /* PRD_EOT on the last descriptor. */
+  };
+#define PRD_EOT 0x8000          /* End of table. */
+#define PRD_CNT (PGSIZE / sizeof (struct prd))
+
+/* Most sectors READ SECTOR and WRITE SECTOR can transfer. */
+#define XFER_MAX 256
 
 /* An ATA device. */
 struct ata_disk
@@ -57,6 +100,8 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    bool dma;                   /* Does it support DMA? */
+    struct block_queue queue;   /* Requests not yet started. */
   };
 
 /* An ATA channel (aka controller).
@@ -66,12 +111,26 @@ struct channel
     char name[8];               /* Name, e.g. "ide0". */
     uint16_t reg_base;          /* Base I/O port. */
     uint8_t irq;                /* Interrupt in use. */
+    uint16_t bm_base;           /* Bus master base I/O port, or 0 if
+                                   only PIO is available. */
+    struct prd *prdt;           /* PRD table, one page, if bm_base. */
 
-    struct lock lock;           /* Must acquire to access the controller. */
     bool expecting_interrupt;   /* True if an interrupt is expected, false if
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+    /* Requests in progress, protected by disabling interrupts.
+       They are for consecutive sectors on one disk, in the same
+       direction, so that one command can carry them all out. */
+    struct list batch;                  /* Requests, empty if idle. */
+    struct ata_disk *batch_disk;        /* Disk they are for. */
+    size_t request_done;                /* Sectors of the first request
+                                           transferred. */
+    size_t command_left;                /* Sectors left in the command
+                                           in progress. */
+    bool dma;                           /* Command uses DMA, not PIO? */
+    int next_dev;                       /* Device to serve next. */
+
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
 
@@ -80,18 +139,27 @@ struct channel
 static struct channel channels[CHANNEL_CNT];
 
 static struct block_operations ide_operations;
+static void start_request (struct channel *);
+static void start_command (struct channel *);
+static void continue_request (struct channel *);
+static struct block_request *first_request (struct channel *);
+static bool finish_sectors (struct channel *, size_t cnt);
+static bool build_prdt (struct channel *);
+
+static uint16_t find_bus_master (void);
 
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void select_sectors (struct ata_disk *, block_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
 
 static void wait_until_idle (const struct ata_disk *);
 static bool wait_while_busy (const struct ata_disk *);
+static bool poll_drq (const struct ata_disk *);
 static void select_device (const struct ata_disk *);
 static void select_device_wait (const struct ata_disk *);
 
@@ -101,6 +169,7 @@ static void interrupt_handler (struct intr_frame *);
 void
 ide_init (void) 
 {
+  uint16_t bm_base = find_bus_master ();
   size_t chan_no;
 
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
@@ -123,9 +192,18 @@ ide_init (void)
         default:
           NOT_REACHED ();
         }
-      lock_init (&c->lock);
+      c->bm_base = 0;
+      c->prdt = NULL;
+      if (bm_base != 0)
+        {
+          c->prdt = palloc_get_page (0);
+          if (c->prdt != NULL)
+            c->bm_base = bm_base + chan_no * 8;
+        }
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+      list_init (&c->batch);
+      c->next_dev = 0;
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -136,6 +214,8 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->dma = false;
+          block_queue_init (&d->queue);
         }
 
       /* Register interrupt handler. */
@@ -288,6 +368,7 @@ identify_ata_device (struct ata_disk *d)
   serial = descramble_ata_string (&id[27 * 2], 40);
   snprintf (extra_info, sizeof extra_info,
             "model \"%s\", serial \"%s\"", model, serial);
+  d->dma = c->bm_base != 0 && (id[49 * 2 + 1] & 0x01) != 0;
 
   /* Disable access to IDE disks over 1 GB, which are likely
      physical IDE disks rather than virtual ones.  If we don't
@@ -306,7 +387,7 @@ identify_ata_device (struct ata_disk *d)
   /* Register. */
   block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
                           &ide_operations, d);
-  partition_scan (block);
+  block_defer_partitions (block);
 }
 
 /* Translates STRING, which consists of SIZE bytes in a funky
@@ -337,63 +418,287 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
-   room for BLOCK_SECTOR_SIZE bytes.
-   Internally synchronizes accesses to disks, so external
-   per-disk locking is unneeded. */
+/* Queues request R for disk D, starting it if D's channel is
+   idle, and returns.  The interrupt handler carries out the
+   transfers and completes R. */
 static void
-ide_read (void *d_, block_sector_t sec_no, void *buffer)
+ide_submit (void *d_, struct block_request *r)
 {
   struct ata_disk *d = d_;
-  struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
-  lock_release (&c->lock);
-}
+  enum intr_level old_level;
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
-   Internally synchronizes accesses to disks, so external
-   per-disk locking is unneeded. */
-static void
-ide_write (void *d_, block_sector_t sec_no, const void *buffer)
-{
-  struct ata_disk *d = d_;
-  struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
-  lock_release (&c->lock);
+  old_level = intr_disable ();
+  block_queue_push (&d->queue, r);
+  if (list_empty (&d->channel->batch))
+    start_request (d->channel);
+  intr_set_level (old_level);
 }
 
 static struct block_operations ide_operations =
   {
-    ide_read,
-    ide_write
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    ide_submit
   };
-
+
+/* Starts the request that the I/O scheduler picks next for
+   either disk on channel C, which must be idle, if there is one,
+   along with any queued after it that continue where it leaves
+   off, up to XFER_MAX sectors in all.  The disks take turns, so
+   that neither starves the other.  Must be called with
+   interrupts off. */
+static void
+start_request (struct channel *c)
+{
+  int i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (list_empty (&c->batch));
+
+  for (i = 0; i < 2; i++)
+    {
+      struct ata_disk *d = &c->devices[(c->next_dev + i) % 2];
+      if (!block_queue_empty (&d->queue))
+        {
+          struct block_request *r = block_queue_pop (&d->queue);
+          size_t cnt = r->cnt;
+
+          list_push_back (&c->batch, &r->elem);
+          while (cnt < XFER_MAX
+                 && (r = block_queue_pop_adjacent (&d->queue,
+                                                   r->sector + r->cnt,
+                                                   r->write,
+                                                   XFER_MAX - cnt)) != NULL)
+            {
+              list_push_back (&c->batch, &r->elem);
+              cnt += r->cnt;
+            }
+
+          c->batch_disk = d;
+          c->request_done = 0;
+          c->next_dev = (d->dev_no + 1) % 2;
+          start_command (c);
+          return;
+        }
+    }
+}
+
+/* Returns the first request in channel C's batch. */
+static struct block_request *
+first_request (struct channel *c)
+{
+  return list_entry (list_front (&c->batch), struct block_request, elem);
+}
+
+/* Issues the command for the next sectors of channel C's batch,
+   up to XFER_MAX of them.  If the disk and the buffers allow it,
+   the bus master then carries out the whole transfer and the
+   disk interrupts once at the end.  Otherwise, the command is
+   READ SECTOR or WRITE SECTOR, for a write this function sends
+   the first sector, and the disk interrupts as it finishes with
+   each sector. */
+static void
+start_command (struct channel *c)
+{
+  struct block_request *r = first_request (c);
+  size_t cnt = 0;
+  struct list_elem *e;
+
+  for (e = list_begin (&c->batch); e != list_end (&c->batch);
+       e = list_next (e))
+    cnt += list_entry (e, struct block_request, elem)->cnt;
+  cnt -= c->request_done;
+  c->command_left = cnt < XFER_MAX ? cnt : XFER_MAX;
+  c->dma = c->batch_disk->dma && build_prdt (c);
+
+  if (c->dma)
+    {
+      uint8_t direction = r->write ? 0 : BM_READ;
+
+      outl (reg_bm_prdt (c), vtop (c->prdt));
+      outb (reg_bm_command (c), direction);
+      outb (reg_bm_status (c), inb (reg_bm_status (c)) | BM_INTR | BM_ERR);
+      select_sectors (c->batch_disk, r->sector + c->request_done,
+                      c->command_left);
+      c->expecting_interrupt = true;
+      outb (reg_command (c), r->write ? CMD_WRITE_DMA : CMD_READ_DMA);
+      outb (reg_bm_command (c), direction | BM_START);
+      return;
+    }
+
+  select_sectors (c->batch_disk, r->sector + c->request_done,
+                  c->command_left);
+  c->expecting_interrupt = true;
+  outb (reg_command (c),
+        r->write ? CMD_WRITE_SECTOR_RETRY : CMD_READ_SECTOR_RETRY);
+  if (r->write)
+    {
+      if (!poll_drq (c->batch_disk))
+        PANIC ("%s: disk write failed, sector=%"PRDSNu,
+               c->batch_disk->name, r->sector + c->request_done);
+      output_sector (c, r->buffers[c->request_done]);
+    }
+}
+
+/* Fills in channel C's PRD table to describe the buffers for the
+   command about to be issued.  Returns false, so that the
+   command must use PIO, if a buffer is not in the kernel's
+   mapping of RAM (and so not necessarily physically contiguous),
+   as for a user buffer or one on a large kernel stack, or is
+   misaligned. */
+static bool
+build_prdt (struct channel *c)
+{
+  struct list_elem *e = list_begin (&c->batch);
+  size_t i = c->request_done;
+  size_t left = c->command_left;
+  size_t n = 0;
+
+  for (; left > 0; e = list_next (e), i = 0)
+    {
+      struct block_request *r = list_entry (e, struct block_request, elem);
+      for (; i < r->cnt && left > 0; i++, left--)
+        {
+          const void *buffer = r->buffers[i];
+          uintptr_t phys;
+          size_t size;
+
+          if (!is_kernel_vaddr (buffer) || ((uintptr_t) buffer & 1) != 0
+              || vtop (buffer) + BLOCK_SECTOR_SIZE > init_ram_pages * PGSIZE)
+            return false;
+
+          for (phys = vtop (buffer), size = BLOCK_SECTOR_SIZE; size > 0; )
+            {
+              size_t chunk = 0x10000 - (phys & 0xffff);
+              if (chunk > size)
+                chunk = size;
+
+              /* Extend the last region if that does not make it
+                 cross a 64 kB boundary, else start a new one. */
+              if (n > 0 && (phys & 0xffff) != 0
+                  && c->prdt[n - 1].addr + c->prdt[n - 1].size == phys)
+                c->prdt[n - 1].size += chunk;
+              else if (n < PRD_CNT)
+                {
+                  c->prdt[n].addr = phys;
+                  c->prdt[n].size = chunk;
+                  c->prdt[n].flags = 0;
+                  n++;
+                }
+              else
+                return false;
+
+              phys += chunk;
+              size -= chunk;
+            }
+        }
+    }
+  c->prdt[n - 1].flags = PRD_EOT;
+  return true;
+}
+
+/* Called by the interrupt handler when the disk has finished
+   with the command in progress on channel C (for DMA) or with
+   one of its sectors (for PIO).  Moves on, completing each
+   request after its last sector, and after the last request
+   starts the next batch. */
+static void
+continue_request (struct channel *c)
+{
+  struct ata_disk *d = c->batch_disk;
+  struct block_request *r = first_request (c);
+  bool drq;
+
+  if (c->dma)
+    {
+      uint8_t bm_status = inb (reg_bm_status (c));
+      uint8_t status;
+
+      outb (reg_bm_command (c), 0);
+      status = inb (reg_status (c));            /* Acknowledge interrupt. */
+      outb (reg_bm_status (c), bm_status | BM_INTR | BM_ERR);
+      if ((bm_status & BM_ERR) != 0 || (status & STA_ERR) != 0)
+        PANIC ("%s: disk %s failed, sector=%"PRDSNu, d->name,
+               r->write ? "write" : "read", r->sector + c->request_done);
+      if (finish_sectors (c, c->command_left))
+        start_command (c);
+      return;
+    }
+
+  drq = poll_drq (d);
+  if (!r->write)
+    {
+      if (!drq)
+        PANIC ("%s: disk read failed, sector=%"PRDSNu,
+               d->name, r->sector + c->request_done);
+      input_sector (c, r->buffers[c->request_done]);
+    }
+  if (!finish_sectors (c, 1))
+    return;
+
+  r = first_request (c);
+  if (c->command_left == 0)
+    start_command (c);
+  else if (r->write)
+    {
+      if (!drq)
+        PANIC ("%s: disk write failed, sector=%"PRDSNu,
+               d->name, r->sector + c->request_done);
+      output_sector (c, r->buffers[c->request_done]);
+    }
+}
+
+/* Records that CNT more sectors of the command in progress on
+   channel C have been transferred, completing each request that
+   that finishes.  If that finishes the batch, starts the next
+   one and returns false; otherwise, returns true. */
+static bool
+finish_sectors (struct channel *c, size_t cnt)
+{
+  c->command_left -= cnt;
+  while (cnt > 0)
+    {
+      struct block_request *r = first_request (c);
+      size_t n = r->cnt - c->request_done;
+      if (n > cnt)
+        n = cnt;
+      c->request_done += n;
+      cnt -= n;
+
+      if (c->request_done == r->cnt)
+        {
+          /* Start the next batch before completing R, in case R's
+             completion function submits another request. */
+          list_pop_front (&c->batch);
+          c->request_done = 0;
+          if (list_empty (&c->batch))
+            {
+              start_request (c);
+              block_complete (r);
+              return false;
+            }
+          block_complete (r);
+        }
+    }
+  return true;
+}
+
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and CNT, which must be between 1 and XFER_MAX,
+   to the disk's sector selection registers.  (We use LBA
+   mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sectors (struct ata_disk *d, block_sector_t sec_no, size_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt >= 1 && cnt <= XFER_MAX);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt % XFER_MAX);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -436,7 +741,8 @@ output_sector (struct channel *c, const void *sector)
    is, for the BSY and DRQ bits to clear in the status register.
 
    As a side effect, reading the status register clears any
-   pending interrupt. */
+   pending interrupt.  Busy-waits, so that it may be called with
+   interrupts off. */
 static void
 wait_until_idle (const struct ata_disk *d) 
 {
@@ -446,7 +752,7 @@ wait_until_idle (const struct ata_disk *d)
     {
       if ((inb (reg_status (d->channel)) & (STA_BSY | STA_DRQ)) == 0)
         return;
-      timer_usleep (10);
+      timer_udelay (10);
     }
 
   printf ("%s: idle timeout\n", d->name);
@@ -479,7 +785,23 @@ wait_while_busy (const struct ata_disk *d)
   return false;
 }
 
-/* Program D's channel so that D is now the selected disk. */
+/* Wait up to 1 second for disk D to clear BSY, then read its
+   status, which acknowledges any pending interrupt, and return
+   the status of the DRQ bit.  Busy-waits, so that it may be
+   called from an interrupt handler. */
+static bool
+poll_drq (const struct ata_disk *d)
+{
+  struct channel *c = d->channel;
+  int i;
+
+  for (i = 0; i < 100000 && (inb (reg_alt_status (c)) & STA_BSY); i++)
+    timer_udelay (10);
+  return (inb (reg_status (c)) & STA_DRQ) != 0;
+}
+
+/* Program D's channel so that D is now the selected disk.
+   Busy-waits, so that it may be called with interrupts off. */
 static void
 select_device (const struct ata_disk *d)
 {
@@ -489,7 +811,7 @@ select_device (const struct ata_disk *d)
     dev |= DEV_DEV;
   outb (reg_device (c), dev);
   inb (reg_alt_status (c));
-  timer_nsleep (400);
+  timer_ndelay (400);
 }
 
 /* Select disk D in its channel, as select_device(), but wait for
@@ -502,6 +824,63 @@ select_device_wait (const struct ata_disk *d)
   wait_until_idle (d);
 }
 
+/* PCI bus master detection. */
+
+/* Returns the value of 32-bit register REG in the PCI
+   configuration space of function FUNC of device DEV on bus 0. */
+static uint32_t
+pci_read (int dev, int func, int reg)
+{
+  outl (PCI_CONFIG_ADDR, 0x80000000 | (dev << 11) | (func << 8) | reg);
+  return inl (PCI_CONFIG_DATA);
+}
+
+/* Sets 32-bit register REG in the PCI configuration space of
+   function FUNC of device DEV on bus 0 to VALUE. */
+static void
+pci_write (int dev, int func, int reg, uint32_t value)
+{
+  outl (PCI_CONFIG_ADDR, 0x80000000 | (dev << 11) | (func << 8) | reg);
+  outl (PCI_CONFIG_DATA, value);
+}
+
+/* Looks on PCI bus 0 for an IDE controller that can act as a bus
+   master, such as the PIIX found in emulators, and enables its
+   bus mastering.  Returns the base I/O port of its bus master
+   registers, the first channel's followed by the second's, or 0
+   if there is no such controller. */
+static uint16_t
+find_bus_master (void)
+{
+  int dev, func;
+
+  for (dev = 0; dev < 32; dev++)
+    for (func = 0; func < 8; func++)
+      {
+        uint32_t class, bar, command;
+
+        if ((pci_read (dev, func, PCI_REG_ID) & 0xffff) == 0xffff)
+          continue;
+
+        /* Class 1 (mass storage), subclass 1 (IDE), with the
+           prog-if bit that says it can be a bus master. */
+        class = pci_read (dev, func, PCI_REG_CLASS);
+        if ((class >> 16) != 0x0101 || (class & 0x8000) == 0)
+          continue;
+
+        /* The bus master registers must be in I/O space. */
+        bar = pci_read (dev, func, PCI_REG_BAR4);
+        if ((bar & 1) == 0 || (bar & 0xfffc) == 0)
+          continue;
+
+        command = pci_read (dev, func, PCI_REG_COMMAND) & 0xffff;
+        pci_write (dev, func, PCI_REG_COMMAND,
+                   command | PCI_COMMAND_IO | PCI_COMMAND_MASTER);
+        return bar & 0xfffc;
+      }
+  return 0;
+}
+
 /* ATA interrupt handler. */
 static void
 interrupt_handler (struct intr_frame *f) 
@@ -511,10 +890,12 @@ interrupt_handler (struct intr_frame *f)
   for (c = channels; c < channels + CHANNEL_CNT; c++)
     if (f->vec_no == c->irq)
       {
-        if (c->expecting_interrupt) 
+        if (!list_empty (&c->batch))
+          continue_request (c);
+        else if (c->expecting_interrupt) 
           {
             inb (reg_status (c));               /* Acknowledge interrupt. */
-            sema_up (&c->completion_wait);      /* Wake up waiter. */
+            sema_up_io (&c->completion_wait);   /* Wake up waiter. */
           }
         else
           printf ("%s: unexpected interrupt\n", c->name);
@@ -2,15 +2,43 @@
 #include <debug.h>
 #include "devices/intq.h"
 #include "devices/serial.h"
+#include "threads/synch.h"
 
 /* Stores keys from the keyboard and serial port. */
 static struct intq buffer;
 
+/* If true, input_read() waits for a whole line, ended by a
+   new-line or carriage return, or for the buffer to fill up, and
+   returns at most one line.  Set by kernel command-line option
+   "-linein". */
+bool input_line_mode;
+
+/* Number of line ends in the buffer. */
+static size_t line_cnt;
+
+/* input_read() waits here, in line mode, for a line to end. */
+static struct waitqueue line_ready;
+
+/* Serializes input_read(), so that each caller gets whole
+   lines. */
+static struct lock read_lock;
+
+static uint8_t take (void);
+
+/* Returns true if KEY ends a line. */
+static inline bool
+is_line_end (uint8_t key)
+{
+  return key == '\n' || key == '\r';
+}
+
 /* Initializes the input buffer. */
 void
 input_init (void) 
 {
   intq_init (&buffer);
+  waitqueue_init (&line_ready);
+  lock_init (&read_lock);
 }
 
 /* Adds a key to the input buffer.
@@ -22,6 +50,10 @@ input_putc (uint8_t key)
   ASSERT (!intq_full (&buffer));
 
   intq_putc (&buffer, key);
+  if (is_line_end (key))
+    line_cnt++;
+  if (input_line_mode && (is_line_end (key) || intq_full (&buffer)))
+    waitqueue_wake_io (&line_ready, 1);
   serial_notify ();
 }
 
@@ -34,13 +66,47 @@ input_getc (void)
   uint8_t key;
 
   old_level = intr_disable ();
-  key = intq_getc (&buffer);
+  key = take ();
   serial_notify ();
   intr_set_level (old_level);
   
   return key;
 }
 
+/* Reads up to N keys from the input buffer into BUFFER and
+   returns the number read.  If the buffer is empty, waits for a
+   key to be pressed, then takes everything available at once,
+   instead of waking up for each key.  In line mode, waits until
+   a line has been typed and takes no more than that line. */
+size_t
+input_read (uint8_t *buf, size_t n) 
+{
+  enum intr_level old_level;
+  size_t i = 0;
+
+  if (n == 0)
+    return 0;
+
+  lock_acquire (&read_lock);
+  old_level = intr_disable ();
+  if (input_line_mode)
+    while (line_cnt == 0 && !intq_full (&buffer))
+      waitqueue_wait (&line_ready, true, WAIT_FOREVER);
+  do
+    {
+      uint8_t key = take ();
+      buf[i++] = key;
+      if (input_line_mode && is_line_end (key))
+        break;
+    }
+  while (i < n && !intq_empty (&buffer));
+  serial_notify ();
+  intr_set_level (old_level);
+  lock_release (&read_lock);
+
+  return i;
+}
+
 /* Returns true if the input buffer is full,
    false otherwise.
    Interrupts must be off. */
@@ -50,3 +116,15 @@ input_full (void)
   ASSERT (intr_get_level () == INTR_OFF);
   return intq_full (&buffer);
 }
+
+/* Removes a key from the input buffer and returns it, waiting
+   for one if the buffer is empty.  Interrupts must be off. */
+static uint8_t
+take (void) 
+{
+  uint8_t key = intq_getc (&buffer);
+
+  if (is_line_end (key))
+    line_cnt--;
+  return key;
+}
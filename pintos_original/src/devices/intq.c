@@ -2,33 +2,31 @@
 #include <debug.h>
 #include "threads/thread.h"
 
-static int next (int pos);
-static void wait (struct intq *q, struct thread **waiter);
-static void signal (struct intq *q, struct thread **waiter);
+static void wait (struct intq *q, struct waitqueue *waiter);
+static void signal (struct intq *q, struct waitqueue *waiter);
 
 /* Initializes interrupt queue Q. */
 void
 intq_init (struct intq *q) 
 {
   lock_init (&q->lock);
-  q->not_full = q->not_empty = NULL;
-  q->head = q->tail = 0;
+  waitqueue_init (&q->not_full);
+  waitqueue_init (&q->not_empty);
+  ring_init (&q->ring, q->buf, INTQ_BUFSIZE, 1);
 }
 
 /* Returns true if Q is empty, false otherwise. */
 bool
 intq_empty (const struct intq *q) 
 {
-  ASSERT (intr_get_level () == INTR_OFF);
-  return q->head == q->tail;
+  return ring_empty (&q->ring);
 }
 
 /* Returns true if Q is full, false otherwise. */
 bool
 intq_full (const struct intq *q) 
 {
-  ASSERT (intr_get_level () == INTR_OFF);
-  return next (q->head) == q->tail;
+  return ring_full (&q->ring);
 }
 
 /* Removes a byte from Q and returns it.
@@ -39,17 +37,19 @@ intq_getc (struct intq *q)
 {
   uint8_t byte;
   
-  ASSERT (intr_get_level () == INTR_OFF);
-  while (intq_empty (q)) 
+  while (ring_pop (&q->ring, &byte, 1) == 0)
     {
+      enum intr_level old_level;
+
       ASSERT (!intr_context ());
       lock_acquire (&q->lock);
-      wait (q, &q->not_empty);
+      old_level = intr_disable ();
+      if (intq_empty (q))
+        wait (q, &q->not_empty);
+      intr_set_level (old_level);
       lock_release (&q->lock);
     }
-  
-  byte = q->buf[q->tail];
-  q->tail = next (q->tail);
+
   signal (q, &q->not_full);
   return byte;
 }
@@ -60,55 +60,49 @@ intq_getc (struct intq *q)
 void
 intq_putc (struct intq *q, uint8_t byte) 
 {
-  ASSERT (intr_get_level () == INTR_OFF);
-  while (intq_full (q))
+  while (ring_push (&q->ring, &byte, 1) == 0)
     {
+      enum intr_level old_level;
+
       ASSERT (!intr_context ());
       lock_acquire (&q->lock);
-      wait (q, &q->not_full);
+      old_level = intr_disable ();
+      if (intq_full (q))
+        wait (q, &q->not_full);
+      intr_set_level (old_level);
       lock_release (&q->lock);
     }
 
-  q->buf[q->head] = byte;
-  q->head = next (q->head);
   signal (q, &q->not_empty);
 }
-
-/* Returns the position after POS within an intq. */
-static int
-next (int pos) 
-{
-  return (pos + 1) % INTQ_BUFSIZE;
-}
 
 /* WAITER must be the address of Q's not_empty or not_full
-   member.  Waits until the given condition is true. */
+   member.  Waits until the given condition is true.  Interrupts
+   must be off, so that the other side cannot change the
+   condition between our check and the wait. */
 static void
-wait (struct intq *q UNUSED, struct thread **waiter) 
+wait (struct intq *q UNUSED, struct waitqueue *waiter) 
 {
   ASSERT (!intr_context ());
   ASSERT (intr_get_level () == INTR_OFF);
   ASSERT ((waiter == &q->not_empty && intq_empty (q))
           || (waiter == &q->not_full && intq_full (q)));
 
-  *waiter = thread_current ();
-  thread_block ();
+  waitqueue_wait (waiter, true, WAIT_FOREVER);
 }
 
 /* WAITER must be the address of Q's not_empty or not_full
-   member, and the associated condition must be true.  If a
-   thread is waiting for the condition, wakes it up and resets
-   the waiting thread. */
+   member, whose condition the caller has just made true.  If a
+   thread is waiting for the condition, wakes it up, as a waiter
+   for I/O, since a device is on the other side of every queue.
+   A waiter checks the condition with interrupts off before it
+   waits, so it is either already on WAITER or will see the
+   change. */
 static void
-signal (struct intq *q UNUSED, struct thread **waiter) 
+signal (struct intq *q UNUSED, struct waitqueue *waiter) 
 {
-  ASSERT (intr_get_level () == INTR_OFF);
-  ASSERT ((waiter == &q->not_empty && !intq_empty (q))
-          || (waiter == &q->not_full && !intq_full (q)));
+  ASSERT (waiter == &q->not_empty || waiter == &q->not_full);
 
-  if (*waiter != NULL) 
-    {
-      thread_unblock (*waiter);
-      *waiter = NULL;
-    }
+  if (!waitqueue_empty (waiter))
+    waitqueue_wake_io (waiter, 1);
 }
@@ -1,6 +1,7 @@
 #ifndef DEVICES_INTQ_H
 #define DEVICES_INTQ_H
 
+#include <ring.h>
 #include "threads/interrupt.h"
 #include "threads/synch.h"
 
@@ -8,16 +9,20 @@
    kernel threads and external interrupt handlers.
 
    Interrupt queue functions can be called from kernel threads or
-   from external interrupt handlers.  Except for intq_init(),
-   interrupts must be off in either case.
-
-   The interrupt queue has the structure of a "monitor".  Locks
-   and condition variables from threads/synch.h cannot be used in
-   this case, as they normally would, because they can only
-   protect kernel threads from one another, not from interrupt
-   handlers. */
-
-/* Queue buffer size, in bytes. */
+   from external interrupt handlers.  The bytes themselves live in
+   a ring from lib/kernel/ring.h, so one producer and one consumer
+   may use a queue at the same time without turning interrupts
+   off.  Callers with more than one producer or more than one
+   consumer must keep them from running at once, as the serial
+   and input drivers do by turning interrupts off.
+
+   Waiting for a byte or for room has the structure of a
+   "monitor".  Locks and condition variables from threads/synch.h
+   cannot be used in this case, as they normally would, because
+   they can only protect kernel threads from one another, not
+   from interrupt handlers. */
+
+/* Queue buffer size, in bytes.  Must be a power of 2. */
 #define INTQ_BUFSIZE 64
 
 /* A circular queue of bytes. */
@@ -25,13 +30,12 @@ struct intq
   {
     /* Waiting threads. */
     struct lock lock;           /* Only one thread may wait at once. */
-    struct thread *not_full;    /* Thread waiting for not-full condition. */
-    struct thread *not_empty;   /* Thread waiting for not-empty condition. */
+    struct waitqueue not_full;  /* Thread waiting for not-full condition. */
+    struct waitqueue not_empty; /* Thread waiting for not-empty condition. */
 
     /* Queue. */
+    struct ring ring;           /* Ring over BUF. */
     uint8_t buf[INTQ_BUFSIZE];  /* Buffer. */
-    int head;                   /* New data is written here. */
-    int tail;                   /* Old data is read here. */
   };
 
 void intq_init (struct intq *);
@@ -0,0 +1,198 @@
+#include "devices/klog.h"
+#include <debug.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/serial.h"
+#include "devices/vga.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Asynchronous kernel log.
+
+   printf() writes to the serial port through its transmit queue,
+   which holds only INTQ_BUFSIZE bytes, so a burst of output makes
+   the caller wait for the UART, or, with interrupts off, poll it
+   a byte at a time.  klog_printf() instead formats its message
+   into a buffer and appends it to a ring, which takes only a
+   moment with interrupts off and never waits.  If the message
+   does not fit, it is dropped, and counted.
+
+   The ring is drained to the serial port by the serial
+   interrupt handler, which sends bytes from the ring whenever its
+   own transmit queue is empty, and to the VGA display by the
+   "klogd" thread, which runs at PRI_MIN so that it never delays
+   any other thread.  The VGA display is only a mirror: if klogd
+   falls more than a ring's worth behind, it skips ahead rather
+   than holding up the serial port.  Because the serial port
+   takes bytes from printf() first, a message logged this way may
+   come out after printf() output that followed it. */
+
+/* If true, log asynchronously.  Set by kernel command-line option
+   "-klog". */
+bool klog_enabled;
+
+/* Ring size, in bytes.  Must be a power of 2. */
+#define KLOG_SIZE 8192
+
+/* Longest message; longer ones are truncated. */
+#define KLOG_MSG_MAX 128
+
+/* The ring.  HEAD, SERIAL_TAIL, and VGA_TAIL count bytes since
+   boot, so that their differences are the amounts in between,
+   and each one's position in BUF is modulo KLOG_SIZE.  The bytes
+   from HEAD - KLOG_SIZE to HEAD are intact, those from
+   SERIAL_TAIL on are yet to be sent, and HEAD never runs more
+   than KLOG_SIZE past SERIAL_TAIL.  Protected by turning
+   interrupts off. */
+static char buf[KLOG_SIZE];
+static uint32_t head;           /* Bytes appended. */
+static uint32_t serial_tail;    /* Bytes sent to the serial port. */
+static uint32_t vga_tail;       /* Bytes written to the display. */
+
+/* klogd, if it is waiting for output, is blocked on this. */
+static struct semaphore klogd_sema;
+static bool klogd_started;
+static bool klogd_waiting;
+
+/* Statistics. */
+static unsigned long long msg_cnt;      /* Messages logged. */
+static unsigned long long byte_cnt;     /* Bytes logged. */
+static unsigned long long drop_cnt;     /* Messages dropped. */
+static unsigned long long skip_cnt;     /* Bytes klogd skipped. */
+
+static thread_func klogd;
+
+/* Starts klogd, the thread that mirrors the log to the VGA
+   display.  Does nothing unless the log is enabled. */
+void
+klog_start (void)
+{
+  if (!klog_enabled)
+    return;
+  sema_init (&klogd_sema, 0);
+  thread_create ("klogd", PRI_MIN, klogd, NULL);
+  klogd_started = true;
+}
+
+/* Logs a message formatted as by printf().  Returns the number
+   of characters in the formatted message, whether or not there
+   was room for it. */
+int
+klog_printf (const char *format, ...)
+{
+  va_list args;
+  int retval;
+
+  va_start (args, format);
+  retval = klog_vprintf (format, args);
+  va_end (args);
+
+  return retval;
+}
+
+/* Logs a message formatted as by vprintf(). */
+int
+klog_vprintf (const char *format, va_list args)
+{
+  char msg[KLOG_MSG_MAX];
+  enum intr_level old_level;
+  size_t len, ofs, chunk;
+  int retval;
+
+  if (!klog_enabled)
+    return vprintf (format, args);
+
+  retval = vsnprintf (msg, sizeof msg, format, args);
+  len = (size_t) retval < sizeof msg ? (size_t) retval : sizeof msg - 1;
+
+  old_level = intr_disable ();
+  if (len > KLOG_SIZE - (head - serial_tail))
+    drop_cnt++;
+  else
+    {
+      bool was_empty = head == serial_tail;
+
+      ofs = head % KLOG_SIZE;
+      chunk = len < KLOG_SIZE - ofs ? len : KLOG_SIZE - ofs;
+      memcpy (buf + ofs, msg, chunk);
+      memcpy (buf, msg + chunk, len - chunk);
+      head += len;
+      msg_cnt++;
+      byte_cnt += len;
+
+      /* Have the serial port start sending, and klogd start
+         writing, if they went idle. */
+      if (was_empty)
+        serial_notify ();
+      if (klogd_waiting)
+        {
+          klogd_waiting = false;
+          sema_up (&klogd_sema);
+        }
+    }
+  intr_set_level (old_level);
+
+  return retval;
+}
+
+/* Returns true if the log has bytes for the serial port. */
+bool
+klog_pending (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  return head != serial_tail;
+}
+
+/* Takes the next byte for the serial port from the log and
+   stores it in *C.  Returns true if successful, false if there
+   is none. */
+bool
+klog_getc (uint8_t *c)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  if (head == serial_tail)
+    return false;
+  *c = buf[serial_tail++ % KLOG_SIZE];
+  return true;
+}
+
+/* Prints log statistics. */
+void
+klog_print_stats (void)
+{
+  if (klog_enabled)
+    printf ("Klog: %llu messages, %llu bytes, %llu dropped, "
+            "%llu bytes not displayed\n",
+            msg_cnt, byte_cnt, drop_cnt, skip_cnt);
+}
+
+/* Thread that writes the log to the VGA display. */
+static void
+klogd (void *aux UNUSED)
+{
+  for (;;)
+    {
+      char chunk[64];
+      size_t len;
+      enum intr_level old_level = intr_disable ();
+
+      while (vga_tail == head)
+        {
+          klogd_waiting = true;
+          sema_down (&klogd_sema);
+        }
+      if (head - vga_tail > KLOG_SIZE)
+        {
+          skip_cnt += head - vga_tail - KLOG_SIZE;
+          vga_tail = head - KLOG_SIZE;
+        }
+      for (len = 0; len < sizeof chunk && vga_tail != head; len++)
+        chunk[len] = buf[vga_tail++ % KLOG_SIZE];
+      intr_set_level (old_level);
+
+      vga_write (chunk, len);
+    }
+}
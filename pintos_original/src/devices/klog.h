@@ -0,0 +1,23 @@
+#ifndef DEVICES_KLOG_H
+#define DEVICES_KLOG_H
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Asynchronous kernel log.  Enabled by kernel command-line
+   option "-klog"; otherwise klog_printf() is just printf(). */
+extern bool klog_enabled;
+
+void klog_start (void);
+int klog_printf (const char *, ...) PRINTF_FORMAT (1, 2);
+int klog_vprintf (const char *, va_list) PRINTF_FORMAT (1, 0);
+
+/* For the serial driver.  Interrupts must be off. */
+bool klog_pending (void);
+bool klog_getc (uint8_t *);
+
+void klog_print_stats (void);
+
+#endif /* devices/klog.h */
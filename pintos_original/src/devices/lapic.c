@@ -0,0 +1,309 @@
+#include "devices/lapic.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <heap.h>
+#include <stdio.h>
+#include "devices/clock.h"
+#include "devices/timer.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Local APIC timer.  See [IA32-v3a] 10.5.4 "APIC Timer".
+
+   The 8254 PIT keeps ticking at TIMER_FREQ, but an interrupt at
+   the tick is too coarse for waits shorter than a tick, which
+   otherwise have to busy-wait.  The local APIC has its own timer
+   that can interrupt at an arbitrary moment, so lapic_sleep()
+   blocks the caller until its deadline instead.
+
+   Deadlines are kept as TSC values.  If the CPU supports
+   TSC-deadline mode, the timer interrupts when the TSC reaches the
+   deadline written to IA32_TSC_DEADLINE.  Otherwise, it is a
+   one-shot countdown, in units of the bus clock divided by 16,
+   and the deadline is converted to a count at the rate that
+   lapic_calibrate() measures against the PIT. */
+
+/* Local APIC registers, as byte offsets. */
+#define LAPIC_ID        0x020   /* Local APIC ID. */
+#define LAPIC_EOI       0x0b0   /* End of interrupt. */
+#define LAPIC_SVR       0x0f0   /* Spurious interrupt vector. */
+#define LAPIC_LVT_TIMER 0x320   /* Timer local vector table entry. */
+#define LAPIC_LVT_LINT0 0x350   /* LINT0 local vector table entry. */
+#define LAPIC_LVT_LINT1 0x360   /* LINT1 local vector table entry. */
+#define LAPIC_TIMER_INIT 0x380  /* Timer initial count. */
+#define LAPIC_TIMER_CUR 0x390   /* Timer current count. */
+#define LAPIC_TIMER_DIV 0x3e0   /* Timer divide configuration. */
+
+/* SVR bits. */
+#define SVR_ENABLE 0x100        /* Software enable. */
+
+/* Local vector table entry bits. */
+#define LVT_MASKED 0x10000      /* Interrupt masked. */
+#define LVT_EXTINT 0x700        /* Deliver as ExtINT (from the PIC). */
+#define LVT_NMI 0x400           /* Deliver as NMI. */
+#define LVT_ONESHOT 0x00000     /* Timer: count down once. */
+#define LVT_TSC_DEADLINE 0x40000 /* Timer: TSC-deadline mode. */
+
+/* Timer divide configuration for dividing by 16. */
+#define TIMER_DIV_16 0x3
+
+/* Model-specific registers. */
+#define MSR_APIC_BASE 0x1b      /* IA32_APIC_BASE. */
+#define APIC_BASE_ENABLE 0x800  /* Global enable. */
+#define MSR_TSC_DEADLINE 0x6e0  /* IA32_TSC_DEADLINE. */
+
+/* CPUID(1) feature bits. */
+#define CPUID_EDX_TSC 0x010     /* EDX: time stamp counter. */
+#define CPUID_EDX_MSR 0x020     /* EDX: RDMSR and WRMSR. */
+#define CPUID_EDX_APIC 0x200    /* EDX: local APIC. */
+#define CPUID_ECX_TSC_DEADLINE 0x01000000 /* ECX: TSC-deadline mode. */
+
+/* Kernel virtual address at which the local APIC's registers are
+   mapped.  It is above any RAM that Pintos maps, and is the same
+   in every page directory because they all copy the kernel part
+   of init_page_dir. */
+#define LAPIC_VADDR ((void *) 0xfffff000)
+
+/* Ticks to time the local APIC timer against. */
+#define CALIBRATE_TICKS (TIMER_FREQ / 10 + 1)
+
+static volatile uint32_t *lapic;        /* Registers, or null. */
+static bool tsc_deadline;               /* TSC-deadline mode? */
+static uint64_t lapic_hz;               /* Timer counts per second. */
+
+/* A thread in lapic_sleep().  Lives on the sleeper's stack. */
+struct hrsleeper
+  {
+    struct heap_elem elem;      /* Element in sleepers. */
+    uint64_t deadline;          /* TSC value to wake at. */
+    struct semaphore sema;      /* Upped by the timer interrupt. */
+  };
+
+/* Sleeping threads, the one with the earliest deadline first.
+   Protected by turning interrupts off. */
+static struct heap sleepers;
+
+static intr_handler_func lapic_timer_interrupt, lapic_spurious_interrupt;
+static void map_registers (uintptr_t phys);
+static void arm (uint64_t deadline);
+static bool deadline_less (const struct heap_elem *,
+                           const struct heap_elem *, void *aux);
+
+static inline uint32_t
+lapic_read (unsigned reg)
+{
+  return lapic[reg / 4];
+}
+
+static inline void
+lapic_write (unsigned reg, uint32_t value)
+{
+  lapic[reg / 4] = value;
+}
+
+static inline uint64_t
+rdmsr (uint32_t msr)
+{
+  uint64_t value;
+  asm volatile ("rdmsr" : "=A" (value) : "c" (msr));
+  return value;
+}
+
+static inline void
+wrmsr (uint32_t msr, uint64_t value)
+{
+  asm volatile ("wrmsr" : : "c" (msr), "A" (value));
+}
+
+/* Enables the local APIC, if there is one, with its timer
+   masked until lapic_calibrate().  Must be called after paging
+   is set up and before any processes are created.  Returns true
+   if successful, false if the CPU lacks a local APIC. */
+bool
+lapic_init (void)
+{
+  uint32_t eax, ebx, ecx, edx;
+  uint32_t required = CPUID_EDX_TSC | CPUID_EDX_MSR | CPUID_EDX_APIC;
+  uintptr_t phys;
+
+  asm ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (0));
+  if (eax < 1)
+    return false;
+  asm ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (1));
+  if ((edx & required) != required)
+    return false;
+  tsc_deadline = (ecx & CPUID_ECX_TSC_DEADLINE) != 0;
+
+  phys = rdmsr (MSR_APIC_BASE) & PTE_ADDR;
+  wrmsr (MSR_APIC_BASE, phys | APIC_BASE_ENABLE);
+  map_registers (phys);
+
+  /* Keep the PIC's interrupts arriving through LINT0, as in
+     "virtual wire" mode, and NMIs through LINT1. */
+  lapic_write (LAPIC_LVT_LINT0, LVT_EXTINT);
+  lapic_write (LAPIC_LVT_LINT1, LVT_NMI);
+  lapic_write (LAPIC_LVT_TIMER, LVT_MASKED | LAPIC_TIMER_VEC);
+  lapic_write (LAPIC_TIMER_DIV, TIMER_DIV_16);
+  lapic_write (LAPIC_SVR, SVR_ENABLE | LAPIC_SPURIOUS_VEC);
+
+  heap_init (&sleepers, deadline_less, NULL);
+  intr_register_ext (LAPIC_TIMER_VEC, lapic_timer_interrupt,
+                     "Local APIC Timer");
+  intr_register_ext (LAPIC_SPURIOUS_VEC, lapic_spurious_interrupt,
+                     "Local APIC Spurious");
+  return true;
+}
+
+/* Maps the local APIC's registers, at physical address PHYS, at
+   LAPIC_VADDR in init_page_dir, uncached. */
+static void
+map_registers (uintptr_t phys)
+{
+  uint32_t *pde = init_page_dir + pd_no (LAPIC_VADDR);
+  uint32_t *pt;
+
+  if (*pde == 0)
+    *pde = pde_create (palloc_get_page (PAL_ASSERT | PAL_ZERO));
+  pt = ptov (*pde & PTE_ADDR);
+  pt[pt_no (LAPIC_VADDR)] = phys | PTE_PCD | PTE_PWT | PTE_W | PTE_P;
+  asm volatile ("invlpg (%0)" : : "r" (LAPIC_VADDR) : "memory");
+  lapic = LAPIC_VADDR;
+}
+
+/* Measures the rate of the local APIC timer against the PIT,
+   then unmasks the timer.  Must be called after
+   clock_calibrate().  Interrupts must be on. */
+void
+lapic_calibrate (void)
+{
+  uint32_t left;
+  int64_t start;
+
+  ASSERT (intr_get_level () == INTR_ON);
+  ASSERT (lapic != NULL);
+
+  /* Start at a tick boundary. */
+  start = timer_ticks ();
+  while (timer_ticks () == start)
+    barrier ();
+
+  start = timer_ticks ();
+  lapic_write (LAPIC_TIMER_INIT, UINT32_MAX);
+  while (timer_ticks () - start < CALIBRATE_TICKS)
+    barrier ();
+  left = lapic_read (LAPIC_TIMER_CUR);
+  lapic_write (LAPIC_TIMER_INIT, 0);
+  lapic_hz = (uint64_t) (UINT32_MAX - left) * TIMER_FREQ / CALIBRATE_TICKS;
+
+  lapic_write (LAPIC_LVT_TIMER, LAPIC_TIMER_VEC
+               | (tsc_deadline ? LVT_TSC_DEADLINE : LVT_ONESHOT));
+  printf ("Local APIC timer: %'"PRIu64" Hz, TSC %'"PRIu64" Hz%s.\n",
+          lapic_hz, clock_hz (), tsc_deadline ? ", TSC-deadline mode" : "");
+}
+
+/* Sleeps for approximately NUM/DENOM seconds, blocking until the
+   local APIC timer interrupts instead of busy-waiting.  Returns
+   false without sleeping if the timer is not available, in which
+   case the caller should busy-wait instead.  Interrupts must be
+   on. */
+bool
+lapic_sleep (int64_t num, int32_t denom)
+{
+  struct hrsleeper s;
+  enum intr_level old_level;
+
+  ASSERT (intr_get_level () == INTR_ON);
+  ASSERT (!intr_context ());
+
+  if (lapic == NULL || clock_hz () == 0 || lapic_hz == 0)
+    return false;
+
+  s.deadline = clock_cycles () + num * clock_hz () / denom;
+  sema_init (&s.sema, 0);
+
+  old_level = intr_disable ();
+  heap_insert (&sleepers, &s.elem);
+  if (heap_min (&sleepers) == &s.elem)
+    arm (s.deadline);
+  intr_set_level (old_level);
+
+  sema_down (&s.sema);
+  return true;
+}
+
+/* Acknowledges the interrupt being handled on the local
+   APIC. */
+void
+lapic_eoi (void)
+{
+  lapic_write (LAPIC_EOI, 0);
+}
+
+/* Programs the timer to interrupt at TSC value DEADLINE, or
+   stops it if DEADLINE is 0.  Interrupts must be off. */
+static void
+arm (uint64_t deadline)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (tsc_deadline)
+    wrmsr (MSR_TSC_DEADLINE, deadline);
+  else if (deadline == 0)
+    lapic_write (LAPIC_TIMER_INIT, 0);
+  else
+    {
+      uint64_t now = clock_cycles ();
+      uint64_t count = (deadline > now
+                        ? (deadline - now) * lapic_hz / clock_hz () : 0);
+      if (count == 0)
+        count = 1;
+      else if (count > UINT32_MAX)
+        count = UINT32_MAX;
+      lapic_write (LAPIC_TIMER_INIT, count);
+    }
+}
+
+/* Local APIC timer interrupt handler.  Wakes the sleepers whose
+   deadlines have passed and arms the timer for the next one.  A
+   one-shot count can run out a little early, in which case this
+   just arms the timer again. */
+static void
+lapic_timer_interrupt (struct intr_frame *args UNUSED)
+{
+  uint64_t now = clock_cycles ();
+
+  while (!heap_empty (&sleepers))
+    {
+      struct hrsleeper *s = heap_entry (heap_min (&sleepers),
+                                        struct hrsleeper, elem);
+      if (s->deadline > now)
+        break;
+      heap_pop_min (&sleepers);
+      sema_up (&s->sema);
+    }
+  arm (heap_empty (&sleepers) ? 0
+       : heap_entry (heap_min (&sleepers), struct hrsleeper,
+                     elem)->deadline);
+}
+
+/* Spurious interrupt handler.  Spurious interrupts need no
+   end-of-interrupt. */
+static void
+lapic_spurious_interrupt (struct intr_frame *args UNUSED)
+{
+}
+
+/* Orders hrsleepers by deadline. */
+static bool
+deadline_less (const struct heap_elem *a_, const struct heap_elem *b_,
+               void *aux UNUSED)
+{
+  const struct hrsleeper *a = heap_entry (a_, struct hrsleeper, elem);
+  const struct hrsleeper *b = heap_entry (b_, struct hrsleeper, elem);
+
+  return a->deadline < b->deadline;
+}
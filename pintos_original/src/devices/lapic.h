@@ -0,0 +1,18 @@
+#ifndef DEVICES_LAPIC_H
+#define DEVICES_LAPIC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Interrupt vectors raised by the local APIC.  The interrupt
+   core treats 0xf0...0xff like the PIC's 0x20...0x2f, as
+   external interrupts. */
+#define LAPIC_TIMER_VEC 0xf0
+#define LAPIC_SPURIOUS_VEC 0xff
+
+bool lapic_init (void);
+void lapic_calibrate (void);
+bool lapic_sleep (int64_t num, int32_t denom);
+void lapic_eoi (void);
+
+#endif /* devices/lapic.h */
@@ -0,0 +1,122 @@
+#include "devices/overlay.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* A copy-on-write overlay block device.  Reads of sectors that
+   have never been written come from a base device, which is
+   never modified.  Writes go to a scratch device instead, which
+   is filled in the order sectors are first written, so that it
+   may be much smaller than the base.  Many Pintos instances can
+   thus share one base disk image, each with its own scratch.
+
+   Which sectors have been written, and where they went, is kept
+   only in memory, so the overlay's changes last until shutdown. */
+struct overlay
+  {
+    struct block *base;                 /* Read-only base device. */
+    struct block *scratch;              /* Holds written sectors. */
+    struct lock lock;                   /* Protects the members below. */
+    struct bitmap *written;             /* Base sectors written. */
+    block_sector_t *map;                /* Scratch sector of each
+                                           written base sector. */
+    block_sector_t scratch_used;        /* Scratch sectors in use. */
+  };
+
+static struct block_operations overlay_operations;
+
+/* Looks up the block device named NAME and returns it, panicking
+   if there is none. */
+static struct block *
+get_device (const char *name)
+{
+  struct block *block = name != NULL ? block_get_by_name (name) : NULL;
+  if (block == NULL)
+    PANIC ("No such block device \"%s\"", name != NULL ? name : "");
+  return block;
+}
+
+/* Creates an overlay block device named "cow0" from NAMES, which
+   must have the form "BASE,SCRATCH", giving the names of the
+   base and scratch devices. */
+void
+overlay_init (char *names)
+{
+  struct overlay *o;
+  char *save_ptr;
+  block_sector_t size;
+
+  o = malloc (sizeof *o);
+  if (o == NULL)
+    PANIC ("Failed to allocate memory for overlay device");
+  o->base = get_device (strtok_r (names, ",", &save_ptr));
+  o->scratch = get_device (strtok_r (NULL, ",", &save_ptr));
+  if (o->base == o->scratch)
+    PANIC ("Overlay base and scratch must differ");
+
+  size = block_size (o->base);
+  lock_init (&o->lock);
+  o->written = bitmap_create (size);
+  o->map = malloc (size * sizeof *o->map);
+  if (o->written == NULL || o->map == NULL)
+    PANIC ("Failed to allocate memory for overlay device");
+  o->scratch_used = 0;
+
+  block_register ("cow0", BLOCK_RAW, NULL, size, &overlay_operations, o);
+}
+
+/* Reads SECTOR from overlay O_ into BUFFER. */
+static void
+overlay_read (void *o_, block_sector_t sector, void *buffer)
+{
+  struct overlay *o = o_;
+  bool written;
+  block_sector_t scratch_sector = 0;
+
+  lock_acquire (&o->lock);
+  written = bitmap_test (o->written, sector);
+  if (written)
+    scratch_sector = o->map[sector];
+  lock_release (&o->lock);
+
+  if (written)
+    block_read (o->scratch, scratch_sector, buffer);
+  else
+    block_read (o->base, sector, buffer);
+}
+
+/* Writes SECTOR to overlay O_ from BUFFER, giving it a scratch
+   sector if this is its first write. */
+static void
+overlay_write (void *o_, block_sector_t sector, const void *buffer)
+{
+  struct overlay *o = o_;
+  block_sector_t scratch_sector;
+
+  lock_acquire (&o->lock);
+  if (!bitmap_test (o->written, sector))
+    {
+      if (o->scratch_used >= block_size (o->scratch))
+        PANIC ("%s: overlay scratch device is full",
+               block_name (o->scratch));
+      o->map[sector] = o->scratch_used++;
+      bitmap_mark (o->written, sector);
+    }
+  scratch_sector = o->map[sector];
+  lock_release (&o->lock);
+
+  block_write (o->scratch, scratch_sector, buffer);
+}
+
+static struct block_operations overlay_operations =
+  {
+    overlay_read,
+    overlay_write,
+    NULL,
+    NULL,
+    NULL
+  };
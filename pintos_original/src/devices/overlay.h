@@ -0,0 +1,6 @@
+#ifndef DEVICES_OVERLAY_H
+#define DEVICES_OVERLAY_H
+
+void overlay_init (char *names);
+
+#endif /* devices/overlay.h */
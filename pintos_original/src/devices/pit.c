@@ -11,9 +11,6 @@
 #define PIT_PORT_CONTROL          0x43                /* Control port. */
 #define PIT_PORT_COUNTER(CHANNEL) (0x40 + (CHANNEL))  /* Counter port. */
 
-/* PIT cycles per second. */
-#define PIT_HZ 1193180
-
 /* Configure the given CHANNEL in the PIT.  In a PC, the PIT's
    three output channels are hooked up like this:
 
@@ -46,7 +43,6 @@ void
 pit_configure_channel (int channel, int mode, int frequency)
 {
   uint16_t count;
-  enum intr_level old_level;
 
   ASSERT (channel == 0 || channel == 2);
   ASSERT (mode == 2 || mode == 3);
@@ -74,6 +70,25 @@ pit_configure_channel (int channel, int mode, int frequency)
   else
     count = (PIT_HZ + frequency / 2) / frequency;
 
+  pit_configure_count (channel, mode, count);
+}
+
+/* Configures the given CHANNEL in the PIT to run in MODE, with a
+   period of COUNT PIT cycles, where a COUNT of 0 means 65536.
+   The channel restarts counting at once.  MODE may be 2 or 3, as
+   for pit_configure_channel(), or 0:
+
+     - Mode 0 interrupts once, on terminal count: the channel's
+       output goes to 1 after COUNT cycles and stays there until
+       the channel is configured again. */
+void
+pit_configure_count (int channel, int mode, uint16_t count)
+{
+  enum intr_level old_level;
+
+  ASSERT (channel == 0 || channel == 2);
+  ASSERT (mode == 0 || mode == 2 || mode == 3);
+
   /* Configure the PIT mode and load its counters. */
   old_level = intr_disable ();
   outb (PIT_PORT_CONTROL, (channel << 6) | 0x30 | (mode << 1));
@@ -81,3 +96,28 @@ pit_configure_channel (int channel, int mode, int frequency)
   outb (PIT_PORT_COUNTER (channel), count >> 8);
   intr_set_level (old_level);
 }
+
+/* Returns the number of PIT cycles left in the given CHANNEL's
+   current period, and stores the state of its output in *OUT.
+   Uses the 8254 read-back command, which latches the status and
+   the count together. */
+unsigned
+pit_read_count (int channel, bool *out)
+{
+  enum intr_level old_level;
+  uint8_t status, low, high;
+  unsigned count;
+
+  ASSERT (channel == 0 || channel == 2);
+
+  old_level = intr_disable ();
+  outb (PIT_PORT_CONTROL, 0xc0 | (2 << channel));
+  status = inb (PIT_PORT_COUNTER (channel));
+  low = inb (PIT_PORT_COUNTER (channel));
+  high = inb (PIT_PORT_COUNTER (channel));
+  intr_set_level (old_level);
+
+  *out = (status & 0x80) != 0;
+  count = low | (high << 8);
+  return count != 0 ? count : 65536;
+}
@@ -0,0 +1,201 @@
+#include "devices/profile.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <ksym.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "threads/interrupt.h"
+#include "threads/loader.h"
+#include "threads/tunable.h"
+
+/* Statistical kernel profiler.
+
+   Every profile_interval timer ticks, the timer interrupt
+   handler passes the frame of the code it interrupted to
+   profile_sample(), which counts the interrupted kernel EIP in a
+   hash table.  At shutdown, profile_print_stats() prints the
+   most frequent addresses with their counts and the functions
+   they are in, from the kernel's symbol table, then the same
+   functions' totals, which is a flat profile.  It also prints
+   the addresses, in the same order, on a "Profile addresses:"
+   line, which utils/backtrace can turn into source lines.
+
+   While the CPU is idle with dynamic ticks ("-tickless"), the
+   timer does not interrupt, so idle time is undersampled. */
+
+/* If true, sample.  Set by kernel command-line option
+   "-profile". */
+bool profile_enabled;
+TUNABLE_BOOL ("profile.enabled", profile_enabled,
+              "Sample the kernel and print the hottest addresses.");
+
+/* Ticks between samples, at least 1.  Set by "-profile=TICKS". */
+unsigned profile_interval = 1;
+TUNABLE_UINT ("profile.interval", profile_interval, 1, 1000,
+              "Timer ticks between profile samples.");
+
+/* Hash table of sampled addresses, with linear probing.
+   Accessed only by the timer interrupt handler and, at shutdown,
+   with interrupts off. */
+#define PROFILE_BITS 10
+#define PROFILE_SLOTS (1 << PROFILE_BITS)
+struct profile_slot
+  {
+    uintptr_t eip;              /* Address, or 0 if slot is free. */
+    unsigned cnt;               /* Times sampled. */
+  };
+static struct profile_slot slots[PROFILE_SLOTS];
+
+/* Addresses, and functions, printed at shutdown. */
+#define PROFILE_PRINT_CNT 40
+
+/* Samples in one function, for profile_print_stats(). */
+struct profile_func
+  {
+    const char *name;           /* Name, or null if unknown. */
+    unsigned cnt;               /* Samples. */
+  };
+
+static unsigned countdown;      /* Ticks until the next sample. */
+static unsigned long long samples;     /* All samples. */
+static unsigned long long user_samples; /* Samples in user mode. */
+static unsigned long long dropped;     /* Samples for a full table. */
+
+/* Records a sample of the code interrupted by timer interrupt
+   frame F, if it is time for one. */
+void
+profile_sample (const struct intr_frame *f)
+{
+  uintptr_t eip = (uintptr_t) f->eip;
+  size_t i, n;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!profile_enabled || countdown-- > 0)
+    return;
+  countdown = profile_interval - 1;
+
+  samples++;
+  if (f->cs != SEL_KCSEG)
+    {
+      user_samples++;
+      return;
+    }
+
+  i = ((uint32_t) eip * 2654435761u) >> (32 - PROFILE_BITS);
+  for (n = 0; n < PROFILE_SLOTS; n++, i = (i + 1) % PROFILE_SLOTS)
+    if (slots[i].eip == eip || slots[i].eip == 0)
+      {
+        slots[i].eip = eip;
+        slots[i].cnt++;
+        return;
+      }
+  dropped++;
+}
+
+/* Orders pointers to profile slots from most to least
+   sampled. */
+static int
+slot_compare (const void *a_, const void *b_)
+{
+  const struct profile_slot *a = *(const struct profile_slot *const *) a_;
+  const struct profile_slot *b = *(const struct profile_slot *const *) b_;
+
+  if (a->cnt != b->cnt)
+    return a->cnt < b->cnt ? 1 : -1;
+  return 0;
+}
+
+/* Orders pointers to profile slots by address. */
+static int
+slot_compare_eip (const void *a_, const void *b_)
+{
+  const struct profile_slot *a = *(const struct profile_slot *const *) a_;
+  const struct profile_slot *b = *(const struct profile_slot *const *) b_;
+
+  return a->eip < b->eip ? -1 : a->eip > b->eip;
+}
+
+/* Orders functions from most to least sampled. */
+static int
+func_compare (const void *a_, const void *b_)
+{
+  const struct profile_func *a = a_;
+  const struct profile_func *b = b_;
+
+  return a->cnt < b->cnt ? 1 : a->cnt > b->cnt ? -1 : 0;
+}
+
+/* Adds up the samples of the CNT slots in SORTED, which are
+   sorted by address, by function, into FUNCS, and returns the
+   number of functions. */
+static size_t
+sum_functions (struct profile_slot **sorted, size_t cnt,
+               struct profile_func *funcs)
+{
+  size_t func_cnt = 0;
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      const char *name = ksym_lookup (sorted[i]->eip, NULL);
+      if (func_cnt == 0 || funcs[func_cnt - 1].name != name)
+        {
+          funcs[func_cnt].name = name;
+          funcs[func_cnt++].cnt = 0;
+        }
+      funcs[func_cnt - 1].cnt += sorted[i]->cnt;
+    }
+  return func_cnt;
+}
+
+/* Prints the most sampled kernel addresses and functions. */
+void
+profile_print_stats (void)
+{
+  static struct profile_slot *sorted[PROFILE_SLOTS];
+  static struct profile_func funcs[PROFILE_SLOTS];
+  enum intr_level old_level;
+  size_t i, cnt, func_cnt;
+
+  if (!profile_enabled)
+    return;
+
+  old_level = intr_disable ();
+  for (i = cnt = 0; i < PROFILE_SLOTS; i++)
+    if (slots[i].eip != 0)
+      sorted[cnt++] = &slots[i];
+
+  /* Slots of the same function are adjacent in address order,
+     since functions don't overlap. */
+  qsort (sorted, cnt, sizeof *sorted, slot_compare_eip);
+  func_cnt = sum_functions (sorted, cnt, funcs);
+  qsort (funcs, func_cnt, sizeof *funcs, func_compare);
+  qsort (sorted, cnt, sizeof *sorted, slot_compare);
+  intr_set_level (old_level);
+
+  printf ("Profile: %llu samples, %llu in user mode, %llu dropped\n",
+          samples, user_samples, dropped);
+  if (cnt > PROFILE_PRINT_CNT)
+    cnt = PROFILE_PRINT_CNT;
+  for (i = 0; i < cnt; i++)
+    {
+      printf ("Profile: %8u %3llu%% %#010"PRIxPTR" ", sorted[i]->cnt,
+              sorted[i]->cnt * 100ULL / samples, sorted[i]->eip);
+      ksym_print (sorted[i]->eip, false);
+      printf ("\n");
+    }
+
+  printf ("Profile: by function:\n");
+  if (func_cnt > PROFILE_PRINT_CNT)
+    func_cnt = PROFILE_PRINT_CNT;
+  for (i = 0; i < func_cnt; i++)
+    printf ("Profile: %8u %3llu%% %s\n", funcs[i].cnt,
+            funcs[i].cnt * 100ULL / samples,
+            funcs[i].name != NULL ? funcs[i].name : "(unknown)");
+  printf ("Profile addresses:");
+  for (i = 0; i < cnt; i++)
+    printf (" %#"PRIxPTR, sorted[i]->eip);
+  printf (".\n");
+}
@@ -0,0 +1,16 @@
+#ifndef DEVICES_PROFILE_H
+#define DEVICES_PROFILE_H
+
+#include <stdbool.h>
+
+struct intr_frame;
+
+/* Sampling profiler.  Controlled by kernel command-line option
+   "-profile". */
+extern bool profile_enabled;
+extern unsigned profile_interval;
+
+void profile_sample (const struct intr_frame *);
+void profile_print_stats (void);
+
+#endif /* devices/profile.h */
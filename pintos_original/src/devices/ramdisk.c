@@ -0,0 +1,90 @@
+#include "devices/ramdisk.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* A block device whose sectors are kept in memory, so that file
+   system tests need not go through the emulated disk.  Its
+   contents are lost at shutdown. */
+
+/* Sectors per page. */
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* A RAM disk.  The pages need not be contiguous, so that a large
+   disk can be made even when memory is fragmented. */
+struct ramdisk
+  {
+    uint8_t **pages;                    /* Pages holding the sectors. */
+    size_t page_cnt;                    /* Number of pages. */
+  };
+
+static struct block_operations ramdisk_operations;
+
+/* Creates a zero-filled RAM disk of KB kilobytes, rounded up to a
+   whole number of pages, and registers it as block device
+   "ram0", which can be chosen for a role such as the file system
+   with e.g. "-filesys=ram0".  Takes pages from the kernel pool
+   and, when that runs out, from the user pool. */
+void
+ramdisk_init (size_t kb)
+{
+  struct ramdisk *rd;
+  size_t i;
+
+  rd = malloc (sizeof *rd);
+  if (rd == NULL)
+    PANIC ("Failed to allocate memory for RAM disk");
+  rd->page_cnt = DIV_ROUND_UP (kb * 1024, PGSIZE);
+  rd->pages = malloc (rd->page_cnt * sizeof *rd->pages);
+  if (rd->pages == NULL)
+    PANIC ("Failed to allocate memory for RAM disk");
+
+  for (i = 0; i < rd->page_cnt; i++)
+    {
+      rd->pages[i] = palloc_get_page (PAL_ZERO);
+      if (rd->pages[i] == NULL)
+        rd->pages[i] = palloc_get_page (PAL_ZERO | PAL_USER);
+      if (rd->pages[i] == NULL)
+        PANIC ("Out of memory for %zu kB RAM disk", kb);
+    }
+
+  block_register ("ram0", BLOCK_RAW, "RAM disk",
+                  rd->page_cnt * SECTORS_PER_PAGE,
+                  &ramdisk_operations, rd);
+}
+
+/* Returns the address of SECTOR within RAM disk RD. */
+static uint8_t *
+sector_address (struct ramdisk *rd, block_sector_t sector)
+{
+  return (rd->pages[sector / SECTORS_PER_PAGE]
+          + sector % SECTORS_PER_PAGE * BLOCK_SECTOR_SIZE);
+}
+
+/* Reads SECTOR from RAM disk RD_ into BUFFER. */
+static void
+ramdisk_read (void *rd_, block_sector_t sector, void *buffer)
+{
+  memcpy (buffer, sector_address (rd_, sector), BLOCK_SECTOR_SIZE);
+}
+
+/* Writes SECTOR to RAM disk RD_ from BUFFER. */
+static void
+ramdisk_write (void *rd_, block_sector_t sector, const void *buffer)
+{
+  memcpy (sector_address (rd_, sector), buffer, BLOCK_SECTOR_SIZE);
+}
+
+static struct block_operations ramdisk_operations =
+  {
+    ramdisk_read,
+    ramdisk_write,
+    NULL,
+    NULL,
+    NULL
+  };
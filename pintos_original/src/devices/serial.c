@@ -2,6 +2,7 @@
 #include <debug.h>
 #include "devices/input.h"
 #include "devices/intq.h"
+#include "devices/klog.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
@@ -37,6 +38,15 @@
 #define IER_RECV 0x01           /* Interrupt when data received. */
 #define IER_XMIT 0x02           /* Interrupt when transmit finishes. */
 
+/* FIFO Control Register bits. */
+#define FCR_ENABLE 0x01         /* Enable transmit and receive FIFOs. */
+#define FCR_CLEAR_RX 0x02       /* Clear receive FIFO. */
+#define FCR_CLEAR_TX 0x04       /* Clear transmit FIFO. */
+#define FCR_TRIGGER_8 0x80      /* Receive interrupt at 8 bytes. */
+
+/* Interrupt Identification Register bits. */
+#define IIR_FIFO 0xc0           /* FIFOs enabled; both set on a 16550A. */
+
 /* Line Control Register bits. */
 #define LCR_N81 0x03            /* No parity, 8 data bits, 1 stop bit. */
 #define LCR_DLAB 0x80           /* Divisor Latch Access Bit (DLAB). */
@@ -51,6 +61,18 @@
 /* Transmission mode. */
 static enum { UNINIT, POLL, QUEUE } mode;
 
+/* Bytes the UART accepts at once when THRE is set: the 16550A's
+   transmit FIFO holds 16, a UART without a working FIFO just
+   1. */
+#define FIFO_SIZE 16
+static int tx_fifo_size = 1;
+
+/* Bytes putc_poll() may write before checking THRE again. */
+static int tx_room;
+
+/* Data rate, in bits per second. */
+static int serial_bps = 9600;
+
 /* Data to be transmitted. */
 static struct intq txq;
 
@@ -68,8 +90,12 @@ init_poll (void)
 {
   ASSERT (mode == UNINIT);
   outb (IER_REG, 0);                    /* Turn off all interrupts. */
-  outb (FCR_REG, 0);                    /* Disable FIFO. */
-  set_serial (9600);                    /* 9.6 kbps, N-8-1. */
+  outb (FCR_REG, FCR_ENABLE | FCR_CLEAR_RX | FCR_CLEAR_TX | FCR_TRIGGER_8);
+  if ((inb (IIR_REG) & IIR_FIFO) == IIR_FIFO)
+    tx_fifo_size = FIFO_SIZE;
+  else
+    outb (FCR_REG, 0);                  /* 16450 or buggy 16550: no FIFO. */
+  set_serial (serial_bps);              /* N-8-1. */
   outb (MCR_REG, MCR_OUT2);             /* Required to enable interrupts. */
   intq_init (&txq);
   mode = POLL;
@@ -94,6 +120,19 @@ serial_init_queue (void)
   intr_set_level (old_level);
 }
 
+/* Sets the serial port's data rate to BPS bits per second, which
+   must divide 115,200 evenly.  Returns false if BPS is not a
+   valid rate.  Takes effect when the port is initialized, so it
+   should be called before any output. */
+bool
+serial_set_speed (int bps)
+{
+  if (bps < 300 || bps > 115200 || 115200 % bps != 0)
+    return false;
+  serial_bps = bps;
+  return true;
+}
+
 /* Sends BYTE to the serial port. */
 void
 serial_putc (uint8_t byte) 
@@ -129,14 +168,57 @@ serial_putc (uint8_t byte)
   intr_set_level (old_level);
 }
 
+/* Sends the N bytes in BUFFER to the serial port, like N calls
+   to serial_putc() but with interrupts disabled, and the
+   interrupt enable register updated, only once for all of them
+   unless the transmit queue fills up. */
+void
+serial_write (const uint8_t *buffer, size_t n)
+{
+  enum intr_level old_level = intr_disable ();
+
+  if (mode != QUEUE)
+    {
+      if (mode == UNINIT)
+        init_poll ();
+      while (n-- > 0)
+        putc_poll (*buffer++);
+    }
+  else
+    {
+      while (n-- > 0)
+        {
+          if (intq_full (&txq))
+            {
+              /* As in serial_putc(), poll a byte out if
+                 interrupts were off.  Otherwise intq_putc() will
+                 wait, so make sure the transmit interrupt is
+                 enabled to drain the queue. */
+              if (old_level == INTR_OFF)
+                putc_poll (intq_getc (&txq));
+              else
+                write_ier ();
+            }
+          intq_putc (&txq, *buffer++);
+        }
+      write_ier ();
+    }
+
+  intr_set_level (old_level);
+}
+
 /* Flushes anything in the serial buffer out the port in polling
    mode. */
 void
 serial_flush (void) 
 {
   enum intr_level old_level = intr_disable ();
+  uint8_t byte;
+
   while (!intq_empty (&txq))
     putc_poll (intq_getc (&txq));
+  while (klog_getc (&byte))
+    putc_poll (byte);
   intr_set_level (old_level);
 }
 
@@ -181,8 +263,8 @@ write_ier (void)
   ASSERT (intr_get_level () == INTR_OFF);
 
   /* Enable transmit interrupt if we have any characters to
-     transmit. */
-  if (!intq_empty (&txq))
+     transmit, from the transmit queue or the kernel log. */
+  if (!intq_empty (&txq) || klog_pending ())
     ier |= IER_XMIT;
 
   /* Enable receive interrupt if we have room to store any
@@ -194,15 +276,21 @@ write_ier (void)
 }
 
 /* Polls the serial port until it's ready,
-   and then transmits BYTE. */
+   and then transmits BYTE.  Once THRE shows the transmit FIFO
+   empty, fills the whole FIFO before checking again. */
 static void
 putc_poll (uint8_t byte) 
 {
   ASSERT (intr_get_level () == INTR_OFF);
 
-  while ((inb (LSR_REG) & LSR_THRE) == 0)
-    continue;
+  if (tx_room == 0)
+    {
+      while ((inb (LSR_REG) & LSR_THRE) == 0)
+        continue;
+      tx_room = tx_fifo_size;
+    }
   outb (THR_REG, byte);
+  tx_room--;
 }
 
 /* Serial interrupt handler. */
@@ -218,10 +306,21 @@ serial_interrupt (struct intr_frame *f UNUSED)
   while (!input_full () && (inb (LSR_REG) & LSR_DR) != 0)
     input_putc (inb (RBR_REG));
 
-  /* As long as we have a byte to transmit, and the hardware is
-     ready to accept a byte for transmission, transmit a byte. */
-  while (!intq_empty (&txq) && (inb (LSR_REG) & LSR_THRE) != 0) 
-    outb (THR_REG, intq_getc (&txq));
+  /* If the transmit FIFO is empty, refill it, first from the
+     transmit queue and then from the kernel log.  Bytes that
+     putc_poll() wrote are gone by the time THRE is set, so the
+     whole FIFO is free. */
+  if ((inb (LSR_REG) & LSR_THRE) != 0)
+    {
+      uint8_t byte;
+      int room;
+
+      for (room = tx_fifo_size; room > 0 && !intq_empty (&txq); room--)
+        outb (THR_REG, intq_getc (&txq));
+      for (; room > 0 && klog_getc (&byte); room--)
+        outb (THR_REG, byte);
+      tx_room = room;
+    }
 
   /* Update interrupt enable register based on queue status. */
   write_ier ();
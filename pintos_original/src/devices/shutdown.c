@@ -2,16 +2,31 @@
 #include <console.h>
 #include <stdio.h>
 #include "devices/kbd.h"
+#include "devices/klog.h"
+#include "devices/profile.h"
 #include "devices/serial.h"
 #include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/io.h"
+#include "threads/kstack.h"
+#include "threads/palloc.h"
+#include "threads/sched-trace.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #ifdef USERPROG
 #include "userprog/exception.h"
+#include "userprog/exec-cache.h"
+#include "userprog/syscall.h"
 #endif
 #ifdef FILESYS
 #include "devices/block.h"
+#include "filesys/cache.h"
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
+#include "filesys/journal.h"
+#endif
+#ifdef VM
+#include "vm/page.h"
 #endif
 
 /* Keyboard control register port. */
@@ -120,12 +135,28 @@ print_stats (void)
 {
   timer_print_stats ();
   thread_print_stats ();
+  intr_print_stats ();
+  lockstat_print_stats ();
+  profile_print_stats ();
+  sched_trace_dump ();
+  palloc_print_stats ();
+  kstack_print_stats ();
 #ifdef FILESYS
   block_print_stats ();
+  filesys_print_stats ();
+  cache_print_stats ();
+  dcache_print_stats ();
+  journal_print_stats ();
 #endif
   console_print_stats ();
+  klog_print_stats ();
   kbd_print_stats ();
 #ifdef USERPROG
   exception_print_stats ();
+  syscall_print_stats ();
+  exec_cache_print_stats ();
+#endif
+#ifdef VM
+  page_print_stats ();
 #endif
 }
@@ -0,0 +1,176 @@
+#include "devices/stripe.h"
+#include <debug.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/workqueue.h"
+
+/* A striped ("RAID-0") block device, which interleaves runs of
+   STRIPE_CHUNK sectors across its member devices so that
+   requests spanning several chunks are carried out by all of the
+   members at once.  Chunk I lives on member I % member_cnt, at
+   chunk I / member_cnt within it. */
+#define STRIPE_CHUNK 8                  /* Sectors per chunk. */
+#define STRIPE_MAX 4                    /* Maximum number of members. */
+
+struct stripe
+  {
+    struct block *members[STRIPE_MAX];  /* Member devices. */
+    size_t member_cnt;                  /* Number of members. */
+  };
+
+/* A request on a striped device, split into one request per
+   chunk that it touches. */
+struct stripe_io
+  {
+    struct list_elem elem;              /* Element in finished_ios. */
+    struct block_request *parent;       /* Request on the stripe. */
+    size_t pending;                     /* Parts not yet completed. */
+    struct block_request parts[];       /* One per chunk. */
+  };
+
+/* Completed stripe_ios, left for reap_work to free because
+   free() cannot be called from the interrupt context that
+   completes them.  Protected by disabling interrupts. */
+static struct list finished_ios = LIST_INITIALIZER (finished_ios);
+static work_func free_finished_ios;
+static struct work reap_work;
+
+static struct block_operations stripe_operations;
+
+/* Creates a striped block device named "md0" from the devices
+   named in NAMES, a comma-separated list such as "hda,hdc".  For
+   the members to work in parallel, they should be on different
+   IDE channels.  The new device's size is the size of the
+   smallest member, rounded down to a whole number of chunks,
+   times the number of members. */
+void
+stripe_init (char *names)
+{
+  struct stripe *s;
+  block_sector_t member_size = 0;
+  char *name, *save_ptr;
+  size_t i;
+
+  s = malloc (sizeof *s);
+  if (s == NULL)
+    PANIC ("Failed to allocate memory for striped device");
+  s->member_cnt = 0;
+
+  for (name = strtok_r (names, ",", &save_ptr); name != NULL;
+       name = strtok_r (NULL, ",", &save_ptr))
+    {
+      struct block *block = block_get_by_name (name);
+      if (block == NULL)
+        PANIC ("No such block device \"%s\"", name);
+      if (s->member_cnt >= STRIPE_MAX)
+        PANIC ("Too many devices in stripe (maximum %d)", STRIPE_MAX);
+      for (i = 0; i < s->member_cnt; i++)
+        if (s->members[i] == block)
+          PANIC ("Block device \"%s\" is in stripe twice", name);
+
+      if (s->member_cnt == 0 || block_size (block) < member_size)
+        member_size = block_size (block);
+      s->members[s->member_cnt++] = block;
+    }
+  member_size -= member_size % STRIPE_CHUNK;
+  if (s->member_cnt == 0 || member_size == 0)
+    PANIC ("Stripe needs at least one nonempty device");
+
+  work_init (&reap_work, free_finished_ios, NULL);
+  block_register ("md0", BLOCK_RAW, NULL, member_size * s->member_cnt,
+                  &stripe_operations, s);
+}
+
+/* Frees the stripe_ios in finished_ios.  Runs in a worker
+   thread. */
+static void
+free_finished_ios (void *aux UNUSED)
+{
+  for (;;)
+    {
+      enum intr_level old_level = intr_disable ();
+      struct stripe_io *io = (list_empty (&finished_ios) ? NULL
+                              : list_entry (list_pop_front (&finished_ios),
+                                            struct stripe_io, elem));
+      intr_set_level (old_level);
+
+      if (io == NULL)
+        break;
+      free (io);
+    }
+}
+
+/* Completion function for part of a request on a striped
+   device.  After the last part, completes the whole request. */
+static void
+part_done (struct block_request *part)
+{
+  struct stripe_io *io = part->aux;
+  enum intr_level old_level = intr_disable ();
+
+  if (--io->pending == 0)
+    {
+      block_complete (io->parent);
+      list_push_back (&finished_ios, &io->elem);
+      work_schedule (&reap_work);
+    }
+  intr_set_level (old_level);
+}
+
+/* Splits request R for striped device S at chunk boundaries and
+   submits each part to the member that holds it.  Must not be
+   called from an interrupt handler, because it allocates
+   memory. */
+static void
+stripe_submit (void *s_, struct block_request *r)
+{
+  struct stripe *s = s_;
+  block_sector_t first = r->sector / STRIPE_CHUNK;
+  block_sector_t last = (r->sector + r->cnt - 1) / STRIPE_CHUNK;
+  size_t part_cnt = last - first + 1;
+  struct stripe_io *io;
+  size_t done, i;
+
+  ASSERT (!intr_context ());
+
+  io = malloc (sizeof *io + part_cnt * sizeof *io->parts);
+  if (io == NULL)
+    PANIC ("Failed to allocate memory for striped request");
+  io->parent = r;
+  io->pending = part_cnt;
+
+  /* Set up every part before submitting any, since the first may
+     complete before the last is submitted. */
+  for (i = done = 0; i < part_cnt; i++)
+    {
+      block_sector_t sector = r->sector + done;
+      block_sector_t chunk = sector / STRIPE_CHUNK;
+      size_t cnt = STRIPE_CHUNK - sector % STRIPE_CHUNK;
+      if (cnt > r->cnt - done)
+        cnt = r->cnt - done;
+
+      block_request_init (&io->parts[i], r->write,
+                          ((chunk / s->member_cnt) * STRIPE_CHUNK
+                           + sector % STRIPE_CHUNK),
+                          r->buffers + done, cnt, part_done, io);
+      done += cnt;
+    }
+  for (i = 0; i < part_cnt; i++)
+    {
+      block_sector_t chunk = first + i;
+      block_submit (s->members[chunk % s->member_cnt], &io->parts[i]);
+    }
+}
+
+static struct block_operations stripe_operations =
+  {
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    stripe_submit
+  };
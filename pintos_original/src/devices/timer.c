@@ -1,12 +1,23 @@
 #include "devices/timer.h"
 #include <debug.h>
 #include <inttypes.h>
+#include <limits.h>
+#include <list.h>
 #include <round.h>
 #include <stdio.h>
+#include "devices/clock.h"
+#include "devices/lapic.h"
 #include "devices/pit.h"
+#include "devices/profile.h"
 #include "threads/interrupt.h"
+#include "threads/loader.h"
+#include "threads/seqlock.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/tunable.h"
+#ifdef USERPROG
+#include "userprog/vdso.h"
+#endif
   
 /* See [8254] for hardware details of the 8254 timer chip. */
 
@@ -17,15 +28,78 @@
 #error TIMER_FREQ <= 1000 recommended
 #endif
 
-/* Number of timer ticks since OS booted. */
+/* Number of timer ticks since OS booted.  Written only with
+   interrupts off, under ticks_seq, so that timer_ticks() can
+   read it without turning interrupts off. */
 static int64_t ticks;
+static struct seqlock ticks_seq;
 
 /* Number of loops per timer tick.
-   Initialized by timer_calibrate(). */
+   Initialized by timer_calibrate(), unless preset with "-o
+   timer.loops_per_tick", as printed by an earlier boot on the
+   same machine, to skip calibration. */
 static unsigned loops_per_tick;
+TUNABLE_UINT ("timer.loops_per_tick", loops_per_tick, 0, UINT_MAX,
+              "Busy-wait loops per tick, or 0 to calibrate at boot.");
+
+/* Pending timeouts are kept in a hierarchical timer wheel.  The
+   root level has a slot for each of the next WHEEL_ROOT_SIZE
+   ticks.  Each slot of the next level covers a whole turn of the
+   root, and so on.  When the root wraps around, the next level's
+   current slot is "cascaded": its timeouts are put back into
+   the wheel, now landing in the root or in a lower level.  So
+   adding and canceling are O(1), and each tick fires one root
+   slot.  Timeouts further away than the wheel reaches go in its
+   last slot and are put back until they are due.  Protected by
+   turning interrupts off. */
+#define WHEEL_ROOT_BITS 8
+#define WHEEL_BITS 6
+#define WHEEL_ROOT_SIZE (1 << WHEEL_ROOT_BITS)
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 3
+#define WHEEL_SPAN_BITS (WHEEL_ROOT_BITS + WHEEL_LEVELS * WHEEL_BITS)
+static struct list wheel_root[WHEEL_ROOT_SIZE];
+static struct list wheel[WHEEL_LEVELS][WHEEL_SIZE];
+static int64_t wheel_tick;      /* Next tick to fire. */
+
+/* If true, use dynamic ticks: while the CPU is idle, the timer
+   interrupt is put off until the next tick that has something
+   to do, and the ticks in between are accounted for when it
+   arrives or when the CPU wakes up for another reason.
+   Controlled by kernel command-line option "-tickless". */
+bool timer_tickless;
+
+/* If true, use the local APIC timer, if there is one, to block
+   in sleeps shorter than a tick instead of busy-waiting.
+   Controlled by kernel command-line option "-hrtimer". */
+bool timer_hires;
+
+static unsigned tick_count;     /* PIT cycles per tick. */
+static bool cpu_idle;           /* Idle thread waiting in `hlt'? */
+static int oneshot_ticks;       /* Ticks the pending one-shot timer
+                                   interrupt stands for, or 0 if
+                                   the timer is periodic. */
+static int idle_owed;           /* Idle ticks counted in `ticks' but
+                                   not yet passed to
+                                   thread_idle_tick(). */
+
+/* A thread sleeping in timer_sleep().  Lives on the sleeper's
+   stack. */
+struct sleeper
+  {
+    struct timeout timeout;     /* Wakes the sleeper. */
+    struct semaphore sema;      /* Upped by TIMEOUT. */
+  };
 
 static intr_handler_func timer_interrupt;
 static bool too_many_loops (unsigned loops);
+static void wheel_insert (struct timeout *);
+static void wheel_cascade (int level);
+static void wheel_run (void);
+static void tick_program (void);
+static void tick_sync (void);
+static int idle_window (void);
+static timeout_func sleeper_wakeup;
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
 static void real_time_delay (int64_t num, int32_t denom);
@@ -35,44 +109,92 @@ static void real_time_delay (int64_t num, int32_t denom);
 void
 timer_init (void) 
 {
+  size_t i, level;
+
+  seqlock_init (&ticks_seq);
   pit_configure_channel (0, 2, TIMER_FREQ);
+  tick_count = (PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ;
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
+
+  for (i = 0; i < WHEEL_ROOT_SIZE; i++)
+    list_init (&wheel_root[i]);
+  for (level = 0; level < WHEEL_LEVELS; level++)
+    for (i = 0; i < WHEEL_SIZE; i++)
+      list_init (&wheel[level][i]);
+  wheel_tick = ticks;
+
+  if (timer_hires)
+    timer_hires = lapic_init ();
 }
 
-/* Calibrates loops_per_tick, used to implement brief delays. */
+/* Calibrates loops_per_tick, used to implement brief delays,
+   unless it was preset on the command line.  Calibration takes
+   a few dozen ticks, which adds up over many short test runs. */
 void
 timer_calibrate (void) 
 {
-  unsigned high_bit, test_bit;
-
   ASSERT (intr_get_level () == INTR_ON);
-  printf ("Calibrating timer...  ");
-
-  /* Approximate loops_per_tick as the largest power-of-two
-     still less than one timer tick. */
-  loops_per_tick = 1u << 10;
-  while (!too_many_loops (loops_per_tick << 1)) 
+  if (loops_per_tick != 0)
+    printf ("Timer preset to %'"PRIu64" loops/s.\n",
+            (uint64_t) loops_per_tick * TIMER_FREQ);
+  else
     {
-      loops_per_tick <<= 1;
-      ASSERT (loops_per_tick != 0);
+      unsigned high_bit, test_bit;
+
+      printf ("Calibrating timer...  ");
+
+      /* Approximate loops_per_tick as the largest power-of-two
+         still less than one timer tick. */
+      loops_per_tick = 1u << 10;
+      while (!too_many_loops (loops_per_tick << 1)) 
+        {
+          loops_per_tick <<= 1;
+          ASSERT (loops_per_tick != 0);
+        }
+
+      /* Refine the next 8 bits of loops_per_tick. */
+      high_bit = loops_per_tick;
+      for (test_bit = high_bit >> 1; test_bit != high_bit >> 10;
+           test_bit >>= 1)
+        if (!too_many_loops (high_bit | test_bit))
+          loops_per_tick |= test_bit;
+
+      printf ("%'"PRIu64" loops/s (-o timer.loops_per_tick=%u).\n",
+              (uint64_t) loops_per_tick * TIMER_FREQ, loops_per_tick);
     }
 
-  /* Refine the next 8 bits of loops_per_tick. */
-  high_bit = loops_per_tick;
-  for (test_bit = high_bit >> 1; test_bit != high_bit >> 10; test_bit >>= 1)
-    if (!too_many_loops (high_bit | test_bit))
-      loops_per_tick |= test_bit;
-
-  printf ("%'"PRIu64" loops/s.\n", (uint64_t) loops_per_tick * TIMER_FREQ);
+  clock_calibrate ();
+  if (timer_hires)
+    lapic_calibrate ();
 }
 
-/* Returns the number of timer ticks since the OS booted. */
+/* Returns the number of timer ticks since the OS booted.
+
+   `ticks' is behind only while a one-shot timer interrupt covering
+   several ticks is pending, which happens only while the idle
+   thread has the CPU, so ordinary threads just read it under
+   ticks_seq. */
 int64_t
 timer_ticks (void) 
 {
-  enum intr_level old_level = intr_disable ();
-  int64_t t = ticks;
-  intr_set_level (old_level);
+  int64_t t;
+  unsigned seq;
+
+  if (oneshot_ticks > 1)
+    {
+      enum intr_level old_level = intr_disable ();
+      tick_sync ();
+      t = ticks;
+      intr_set_level (old_level);
+      return t;
+    }
+
+  do
+    {
+      seq = seqlock_read_begin (&ticks_seq);
+      t = ticks;
+    }
+  while (seqlock_read_retry (&ticks_seq, seq));
   return t;
 }
 
@@ -85,15 +207,30 @@ timer_elapsed (int64_t then)
 }
 
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
-   be turned on. */
+   be turned on.  The thread blocks until the timer interrupt
+   wakes it. */
 void
 timer_sleep (int64_t ticks) 
 {
-  int64_t start = timer_ticks ();
+  struct sleeper s;
 
   ASSERT (intr_get_level () == INTR_ON);
-  while (timer_elapsed (start) < ticks) 
-    thread_yield ();
+  if (ticks <= 0)
+    return;
+
+  sema_init (&s.sema, 0);
+  timeout_init (&s.timeout, sleeper_wakeup, &s);
+  timeout_add (&s.timeout, ticks);
+  sema_down (&s.sema);
+}
+
+/* Wakes up the sleeper AUX. */
+static void
+sleeper_wakeup (struct timeout *t UNUSED, void *aux)
+{
+  struct sleeper *s = aux;
+
+  sema_up (&s->sema);
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -166,12 +303,261 @@ timer_print_stats (void)
   printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
 }
 
+/* Called by the idle thread, with interrupts off, just before it
+   waits for an interrupt.  With dynamic ticks, lets the timer
+   interrupt handler stop the periodic timer until the idle
+   thread is switched out. */
+void
+timer_idle_enter (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (timer_tickless)
+    cpu_idle = true;
+}
+
+/* Called by the scheduler, with interrupts off, when it switches
+   away from the idle thread.  Catches up on the ticks that
+   passed while the timer was stopped and restarts it at the next
+   tick. */
+void
+timer_idle_exit (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  cpu_idle = false;
+  tick_sync ();
+}
+
 /* Timer interrupt handler. */
 static void
-timer_interrupt (struct intr_frame *args UNUSED)
+timer_interrupt (struct intr_frame *args)
+{
+  int n = oneshot_ticks > 0 ? oneshot_ticks : 1;
+
+  profile_sample (args);
+  for (; idle_owed > 0; idle_owed--)
+    thread_idle_tick ();
+  while (n-- > 0)
+    {
+      seqlock_write_begin (&ticks_seq);
+      ticks++;
+      seqlock_write_end (&ticks_seq);
+      wheel_run ();
+      if (n > 0)
+        thread_idle_tick ();
+      else
+        thread_tick (args->cs != SEL_KCSEG);
+    }
+#ifdef USERPROG
+  vdso_update ();
+#endif
+  tick_program ();
+}
+
+/* Programs the timer for the next interrupt: a one-shot
+   interrupt at the next tick with something to do, if the CPU is
+   idle and that is more than a tick away, otherwise a tick from
+   now. */
+static void
+tick_program (void)
+{
+  int n = cpu_idle ? idle_window () : 1;
+
+  if (n > 1)
+    {
+      pit_configure_count (0, 0, n * tick_count);
+      oneshot_ticks = n;
+    }
+  else if (oneshot_ticks > 0)
+    {
+      pit_configure_count (0, 2, tick_count);
+      oneshot_ticks = 0;
+    }
+}
+
+/* Returns the number of ticks until the next one that has a
+   timeout to fire or a wheel level to cascade, which is at least
+   1 and at most the longest one-shot the PIT can time.  A
+   nonempty root slot counts even if its timeouts belong to a
+   later turn of the root. */
+static int
+idle_window (void)
+{
+  int max = 65535 / tick_count;
+  int n;
+
+  for (n = 1; n < max; n++)
+    {
+      size_t idx = (ticks + n) & (WHEEL_ROOT_SIZE - 1);
+      if (idx == 0 || !list_empty (&wheel_root[idx]))
+        break;
+    }
+  return n;
+}
+
+/* If a one-shot timer interrupt covering several ticks is
+   pending, adds the ticks that have passed so far to `ticks' and
+   reprograms the timer for the next tick boundary, so that
+   `ticks' is exact.  Nothing was due in those ticks, so the
+   wheel can catch up at the next interrupt.  If the one-shot has
+   already expired, its interrupt is awaiting delivery and does
+   all the accounting. */
+static void
+tick_sync (void)
+{
+  unsigned rem;
+  int left;
+  bool expired;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (oneshot_ticks <= 1)
+    return;
+  rem = pit_read_count (0, &expired);
+  if (expired)
+    return;
+
+  left = (rem + tick_count - 1) / tick_count;
+  if (left > oneshot_ticks)
+    left = oneshot_ticks;
+  seqlock_write_begin (&ticks_seq);
+  ticks += oneshot_ticks - left;
+  seqlock_write_end (&ticks_seq);
+  idle_owed += oneshot_ticks - left;
+  pit_configure_count (0, 0, rem - (left - 1) * tick_count);
+  oneshot_ticks = 1;
+}
+
+/* Initializes timeout T to call FUNC (T, AUX) when it fires. */
+void
+timeout_init (struct timeout *t, timeout_func *func, void *aux)
+{
+  ASSERT (t != NULL);
+  ASSERT (func != NULL);
+
+  t->func = func;
+  t->aux = aux;
+  t->pending = false;
+}
+
+/* Makes timeout T, which must not be pending, fire TICKS timer
+   ticks from now, or at the next tick if TICKS is not positive.
+   May be called from an interrupt handler, including from a
+   timeout's function. */
+void
+timeout_add (struct timeout *t, int64_t ticks_)
+{
+  enum intr_level old_level = intr_disable ();
+
+  ASSERT (!t->pending);
+  tick_sync ();
+  t->expires = ticks + (ticks_ > 0 ? ticks_ : 1);
+  t->pending = true;
+  wheel_insert (t);
+  intr_set_level (old_level);
+}
+
+/* Cancels timeout T.  Returns true if it was pending, false if
+   it had already fired or was never added. */
+bool
+timeout_cancel (struct timeout *t)
+{
+  enum intr_level old_level = intr_disable ();
+  bool pending = t->pending;
+
+  if (pending)
+    {
+      list_remove (&t->elem);
+      t->pending = false;
+    }
+  intr_set_level (old_level);
+  return pending;
+}
+
+/* Puts timeout T in the wheel slot for its expiry. */
+static void
+wheel_insert (struct timeout *t)
 {
-  ticks++;
-  thread_tick ();
+  int64_t delta = t->expires - wheel_tick;
+  int64_t expires = t->expires;
+  struct list *slot;
+  int level;
+
+  if (delta < WHEEL_ROOT_SIZE)
+    slot = &wheel_root[(delta < 0 ? wheel_tick : expires)
+                       & (WHEEL_ROOT_SIZE - 1)];
+  else
+    {
+      if (delta >= (int64_t) 1 << WHEEL_SPAN_BITS)
+        expires = wheel_tick + ((int64_t) 1 << WHEEL_SPAN_BITS) - 1;
+      for (level = 0; ; level++)
+        {
+          int shift = WHEEL_ROOT_BITS + level * WHEEL_BITS;
+          if (expires - wheel_tick < (int64_t) 1 << (shift + WHEEL_BITS))
+            {
+              slot = &wheel[level][(expires >> shift) & (WHEEL_SIZE - 1)];
+              break;
+            }
+        }
+    }
+  list_push_back (slot, &t->elem);
+}
+
+/* Puts the timeouts of the current slot of wheel LEVEL back into
+   the wheel.  If that slot is the first, does the same for the
+   next level up first. */
+static void
+wheel_cascade (int level)
+{
+  int shift = WHEEL_ROOT_BITS + level * WHEEL_BITS;
+  size_t idx = (wheel_tick >> shift) & (WHEEL_SIZE - 1);
+  struct list cascade;
+
+  if (idx == 0 && level + 1 < WHEEL_LEVELS)
+    wheel_cascade (level + 1);
+
+  list_init (&cascade);
+  if (!list_empty (&wheel[level][idx]))
+    list_splice (list_end (&cascade), list_begin (&wheel[level][idx]),
+                 list_end (&wheel[level][idx]));
+  while (!list_empty (&cascade))
+    wheel_insert (list_entry (list_pop_front (&cascade),
+                              struct timeout, elem));
+}
+
+/* Fires the timeouts that are due, catching up to the current
+   tick. */
+static void
+wheel_run (void)
+{
+  while (wheel_tick <= ticks)
+    {
+      size_t idx = wheel_tick & (WHEEL_ROOT_SIZE - 1);
+      struct list due;
+
+      if (idx == 0)
+        wheel_cascade (0);
+
+      list_init (&due);
+      if (!list_empty (&wheel_root[idx]))
+        list_splice (list_end (&due), list_begin (&wheel_root[idx]),
+                     list_end (&wheel_root[idx]));
+      wheel_tick++;
+
+      while (!list_empty (&due))
+        {
+          struct timeout *t = list_entry (list_pop_front (&due),
+                                          struct timeout, elem);
+          if (t->expires >= wheel_tick)
+            wheel_insert (t);
+          else
+            {
+              t->pending = false;
+              t->func (t, t->aux);
+            }
+        }
+    }
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
@@ -216,8 +602,15 @@ real_time_sleep (int64_t num, int32_t denom)
         (NUM / DENOM) s          
      ---------------------- = NUM * TIMER_FREQ / DENOM ticks. 
      1 s / TIMER_FREQ ticks
-  */
-  int64_t ticks = num * TIMER_FREQ / denom;
+
+     When TIMER_FREQ divides DENOM, as the default of 100 divides
+     every DENOM used here, dividing NUM by DENOM / TIMER_FREQ
+     gives the same result with one division by a 32-bit divisor,
+     which lib/arithmetic.c does in one or two DIVLs, and cannot
+     overflow. */
+  int64_t ticks = (denom % TIMER_FREQ == 0
+                   ? num / (denom / TIMER_FREQ)
+                   : num * TIMER_FREQ / denom);
 
   ASSERT (intr_get_level () == INTR_ON);
   if (ticks > 0)
@@ -227,10 +620,11 @@ real_time_sleep (int64_t num, int32_t denom)
          processes. */                
       timer_sleep (ticks); 
     }
-  else 
+  else if (!timer_hires || intr_context () || !lapic_sleep (num, denom))
     {
       /* Otherwise, use a busy-wait loop for more accurate
-         sub-tick timing. */
+         sub-tick timing, unless the local APIC timer can wake us
+         just as accurately. */
       real_time_delay (num, denom); 
     }
 }
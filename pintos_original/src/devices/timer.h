@@ -1,7 +1,9 @@
 #ifndef DEVICES_TIMER_H
 #define DEVICES_TIMER_H
 
+#include <list.h>
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 /* Number of timer interrupts per second. */
@@ -26,4 +28,29 @@ void timer_ndelay (int64_t nanoseconds);
 
 void timer_print_stats (void);
 
+/* Dynamic ticks. */
+extern bool timer_tickless;
+extern bool timer_hires;
+void timer_idle_enter (void);
+void timer_idle_exit (void);
+
+/* Timeouts. */
+struct timeout;
+typedef void timeout_func (struct timeout *, void *aux);
+
+/* A timeout calls FUNC (T, AUX) from the timer interrupt handler,
+   with interrupts off, at tick EXPIRES.  FUNC must not sleep. */
+struct timeout
+  {
+    int64_t expires;            /* Tick to fire at. */
+    timeout_func *func;         /* Function to call. */
+    void *aux;                  /* Auxiliary data for FUNC. */
+    bool pending;               /* Added and not yet fired? */
+    struct list_elem elem;      /* Timer wheel element. */
+  };
+
+void timeout_init (struct timeout *, timeout_func *, void *aux);
+void timeout_add (struct timeout *, int64_t ticks);
+bool timeout_cancel (struct timeout *);
+
 #endif /* devices/timer.h */
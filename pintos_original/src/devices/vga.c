@@ -14,16 +14,30 @@
 #define COL_CNT 80
 #define ROW_CNT 25
 
+/* Rows of text that fit in the 32 kB of video memory at
+   0xb8000. */
+#define MEM_ROW_CNT (0x8000 / (COL_CNT * 2))
+
 /* Current cursor position.  (0,0) is in the upper left corner of
    the display. */
 static size_t cx, cy;
 
+/* Row of video memory shown at the top of the display.
+
+   Scrolling by copying the screen up a row on every newline is
+   slow, because video memory is slow, so instead newline()
+   advances the CRTC's start address by a row.  Only when the
+   display reaches the end of video memory does it copy the
+   screen back to the start, once every MEM_ROW_CNT - ROW_CNT
+   lines. */
+static size_t top;
+
 /* Attribute value for gray text on a black background. */
 #define GRAY_ON_BLACK 0x07
 
 /* Framebuffer.  See [FREEVGA] under "VGA Text Mode Operation".
-   The character at (x,y) is fb[y][x][0].
-   The attribute at (x,y) is fb[y][x][1]. */
+   The character at (x,y) on the display is fb[top + y][x][0].
+   The attribute at (x,y) is fb[top + y][x][1]. */
 static uint8_t (*fb)[COL_CNT][2];
 
 static void clear_row (size_t y);
@@ -31,6 +45,9 @@ static void cls (void);
 static void newline (void);
 static void move_cursor (void);
 static void find_cursor (size_t *x, size_t *y);
+static void set_start (void);
+static uint8_t read_crtc (uint8_t reg);
+static void putc_have_lock (int c, enum intr_level);
 
 /* Initializes the VGA text display. */
 static void
@@ -40,7 +57,13 @@ init (void)
   static bool inited;
   if (!inited)
     {
+      uint16_t start = (read_crtc (0x0c) << 8) | read_crtc (0x0d);
+
       fb = ptov (0xb8000);
+      top = start / COL_CNT;
+      if (top + ROW_CNT > MEM_ROW_CNT)
+        top = 0;
+      set_start ();
       find_cursor (&cx, &cy);
       inited = true; 
     }
@@ -56,7 +79,34 @@ vga_putc (int c)
   enum intr_level old_level = intr_disable ();
 
   init ();
-  
+  putc_have_lock (c, old_level);
+  move_cursor ();
+
+  intr_set_level (old_level);
+}
+
+/* Writes the N characters in BUFFER to the VGA text display, like
+   N calls to vga_putc() but disabling interrupts and moving the
+   hardware cursor only once. */
+void
+vga_write (const char *buffer, size_t n)
+{
+  enum intr_level old_level = intr_disable ();
+
+  init ();
+  while (n-- > 0)
+    putc_have_lock (*buffer++, old_level);
+  move_cursor ();
+
+  intr_set_level (old_level);
+}
+
+/* Writes C to the framebuffer, interpreting control characters,
+   without moving the hardware cursor.  Interrupts must be off;
+   OLD_LEVEL is the level to sound the bell at. */
+static void
+putc_have_lock (int c, enum intr_level old_level)
+{
   switch (c) 
     {
     case '\n':
@@ -89,17 +139,12 @@ vga_putc (int c)
       break;
       
     default:
-      fb[cy][cx][0] = c;
-      fb[cy][cx][1] = GRAY_ON_BLACK;
+      fb[top + cy][cx][0] = c;
+      fb[top + cy][cx][1] = GRAY_ON_BLACK;
       if (++cx >= COL_CNT)
         newline ();
       break;
     }
-
-  /* Update cursor position. */
-  move_cursor ();
-
-  intr_set_level (old_level);
 }
 
 /* Clears the screen and moves the cursor to the upper left. */
@@ -108,6 +153,8 @@ cls (void)
 {
   size_t y;
 
+  top = 0;
+  set_start ();
   for (y = 0; y < ROW_CNT; y++)
     clear_row (y);
 
@@ -115,7 +162,7 @@ cls (void)
   move_cursor ();
 }
 
-/* Clears row Y to spaces. */
+/* Clears row Y of video memory to spaces. */
 static void
 clear_row (size_t y) 
 {
@@ -139,17 +186,34 @@ newline (void)
   if (cy >= ROW_CNT)
     {
       cy = ROW_CNT - 1;
-      memmove (&fb[0], &fb[1], sizeof fb[0] * (ROW_CNT - 1));
-      clear_row (ROW_CNT - 1);
+      if (top + ROW_CNT < MEM_ROW_CNT)
+        top++;
+      else
+        {
+          memmove (&fb[0], &fb[top + 1], sizeof fb[0] * (ROW_CNT - 1));
+          top = 0;
+        }
+      clear_row (top + ROW_CNT - 1);
+      set_start ();
     }
 }
 
+/* Makes the display start at row TOP of video memory. */
+static void
+set_start (void)
+{
+  /* See [FREEVGA] under "CRTC Registers". */
+  uint16_t start = top * COL_CNT;
+  outw (0x3d4, 0x0c | (start & 0xff00));
+  outw (0x3d4, 0x0d | (start << 8));
+}
+
 /* Moves the hardware cursor to (cx,cy). */
 static void
 move_cursor (void) 
 {
   /* See [FREEVGA] under "Manipulating the Text-mode Cursor". */
-  uint16_t cp = cx + COL_CNT * cy;
+  uint16_t cp = cx + COL_CNT * (top + cy);
   outw (0x3d4, 0x0e | (cp & 0xff00));
   outw (0x3d4, 0x0f | (cp << 8));
 }
@@ -159,14 +223,18 @@ static void
 find_cursor (size_t *x, size_t *y) 
 {
   /* See [FREEVGA] under "Manipulating the Text-mode Cursor". */
-  uint16_t cp;
-
-  outb (0x3d4, 0x0e);
-  cp = inb (0x3d5) << 8;
-
-  outb (0x3d4, 0x0f);
-  cp |= inb (0x3d5);
+  uint16_t cp = (read_crtc (0x0e) << 8) | read_crtc (0x0f);
 
   *x = cp % COL_CNT;
-  *y = cp / COL_CNT;
+  *y = cp / COL_CNT >= top ? cp / COL_CNT - top : 0;
+  if (*y >= ROW_CNT)
+    *y = ROW_CNT - 1;
+}
+
+/* Returns the value of CRTC register REG. */
+static uint8_t
+read_crtc (uint8_t reg)
+{
+  outb (0x3d4, reg);
+  return inb (0x3d5);
 }
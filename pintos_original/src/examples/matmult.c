@@ -8,6 +8,7 @@
    and store the result back to the file system!
  */
 
+#include <malloc.h>
 #include <stdio.h>
 #include <syscall.h>
 
@@ -28,15 +29,17 @@
  16,384 3,145,728 kB */
 #define DIM 128
 
-int A[DIM][DIM];
-int B[DIM][DIM];
-int C[DIM][DIM];
-
 int
 main (void)
 {
+  int (*A)[DIM] = malloc (sizeof (int[DIM][DIM]));
+  int (*B)[DIM] = malloc (sizeof (int[DIM][DIM]));
+  int (*C)[DIM] = malloc (sizeof (int[DIM][DIM]));
   int i, j, k;
 
+  if (A == NULL || B == NULL || C == NULL)
+    exit (-1);
+
   /* Initialize the matrices. */
   for (i = 0; i < DIM; i++)
     for (j = 0; j < DIM; j++)
@@ -3,8 +3,12 @@
 #include <string.h>
 #include <syscall.h>
 
+/* Most commands in a pipeline. */
+#define PIPELINE_MAX 8
+
 static void read_line (char line[], size_t);
 static bool backspace (char **pos, char line[]);
+static void run_pipeline (char *command);
 
 int
 main (void)
@@ -30,6 +34,8 @@ main (void)
         {
           /* Empty command. */
         }
+      else if (strchr (command, '|') != NULL)
+        run_pipeline (command);
       else
         {
           pid_t pid = exec (command);
@@ -44,6 +50,63 @@ main (void)
   return EXIT_SUCCESS;
 }
 
+/* Runs COMMAND, a list of commands separated by `|', each one
+   reading the output of the one before through a pipe, and waits
+   for all of them.  Modifies COMMAND. */
+static void
+run_pipeline (char *command)
+{
+  char *stages[PIPELINE_MAX];
+  pid_t pids[PIPELINE_MAX];
+  int stage_cnt = 0, started;
+  int in = STDIN_FILENO;
+  char *stage, *save_ptr;
+  int i;
+
+  for (stage = strtok_r (command, "|", &save_ptr); stage != NULL;
+       stage = strtok_r (NULL, "|", &save_ptr))
+    {
+      if (stage_cnt >= PIPELINE_MAX)
+        {
+          printf ("too many commands in pipeline\n");
+          return;
+        }
+      while (*stage == ' ')
+        stage++;
+      stages[stage_cnt++] = stage;
+    }
+
+  /* Start each command reading the previous one's pipe and, but
+     for the last, writing a new one.  The shell closes its own
+     ends as it goes, so that each reader sees end of file once
+     the writer before it exits. */
+  for (i = 0; i < stage_cnt; i++)
+    {
+      int fds[2] = {STDIN_FILENO, STDOUT_FILENO};
+
+      if (i < stage_cnt - 1 && !pipe (fds))
+        {
+          printf ("pipe failed\n");
+          break;
+        }
+      pids[i] = exec_redirect (stages[i], in, fds[1]);
+      if (pids[i] == PID_ERROR)
+        printf ("\"%s\": exec failed\n", stages[i]);
+      if (in != STDIN_FILENO)
+        close (in);
+      if (fds[1] != STDOUT_FILENO)
+        close (fds[1]);
+      in = fds[0];
+    }
+  started = i;
+  if (in != STDIN_FILENO)
+    close (in);
+
+  for (i = 0; i < started; i++)
+    if (pids[i] != PID_ERROR)
+      printf ("\"%s\": exit code %d\n", stages[i], wait (pids[i]));
+}
+
 /* Reads a line of input from the user into LINE, which has room
    for SIZE bytes.  Handles backspace and Ctrl+U in the ways
    expected by Unix users.  On return, LINE will always be
@@ -0,0 +1,448 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "filesys/journal.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/tunable.h"
+
+/* Buffer cache.
+
+   The file system reads and writes fs_device only through a
+   cache of CACHE_SIZE sectors.  A sector that is not cached is
+   read into a free slot, or into one picked by a clock hand that
+   gives recently used slots a second chance.  Writes only mark
+   the slot dirty; a dirty slot is written back when it is
+   evicted, every FLUSH_INTERVAL milliseconds by a background
+   thread, and at shutdown by filesys_done().
+
+   A write of part of a data sector that is not cached does not
+   read it first.  The slot instead records the range of bytes
+   that has been written, and further writes that overlap or
+   adjoin that range extend it.  The rest of the sector is read
+   from disk and merged in only when something needs it: a read
+   outside the range, a write that doesn't touch it, or the
+   write-back.  So a run of small writes that together cover a
+   sector, such as a program writing a line at a time, costs no
+   reads and a single write.  Metadata sectors are always read
+   in whole, because the journal keeps whole sectors.
+
+   cache_read_ahead() asks for a sector to be brought in ahead of
+   need.  Requests go on a small queue served by a background
+   thread, so that the disk transfer overlaps with whatever the
+   requester does next; if the queue already holds
+   read_ahead_depth requests, set by "-o cache.read_ahead", a
+   request is dropped.
+
+   Metadata is written with cache_write_meta() and
+   cache_write_meta_at(), which hand each changed sector to the
+   journal.  The cache never writes back a sector the journal
+   holds, and reads such a sector from the journal's copy.
+
+   cache_read_direct() is for callers that keep what they read,
+   such as page loads.  It copies a cached sector as usual, but
+   reads an uncached one straight into the caller's buffer
+   without caching it, so the data is copied once and other
+   sectors aren't displaced.
+
+   cache_lock protects which sector each slot holds, the clock,
+   and the read-ahead queue, and is never held across a disk
+   transfer.  Each slot has its own lock, which protects its
+   contents and is held while they are read or written back, so
+   transfers for different sectors overlap.  While a dirty slot is
+   being reassigned, it also answers lookups for the sector it is
+   writing back, so that no one can read that sector's stale disk
+   copy in the meantime. */
+
+/* Number of cached sectors. */
+#define CACHE_SIZE 64
+
+/* Milliseconds between background flushes. */
+#define FLUSH_INTERVAL 5000
+
+/* Capacity of the read-ahead queue. */
+#define READ_AHEAD_MAX 16
+
+/* A cached sector. */
+struct cache_block
+  {
+    struct lock lock;                   /* Protects data, dirty, and
+                                           the filled range. */
+    block_sector_t sector;              /* Sector held. */
+    block_sector_t old_sector;          /* Sector being written back. */
+    bool valid;                         /* Holds SECTOR? */
+    bool evicting;                      /* Writing back OLD_SECTOR? */
+    bool dirty;                         /* Changed since read? */
+    bool accessed;                      /* Used since the hand passed? */
+    uint16_t fill_ofs, fill_end;        /* Bytes of DATA that hold the
+                                           sector, if not all. */
+    uint8_t data[BLOCK_SECTOR_SIZE];    /* Sector contents. */
+  };
+
+static struct cache_block cache[CACHE_SIZE];
+static struct lock cache_lock;
+static size_t hand;                     /* Next slot for the clock. */
+
+/* Read-ahead queue, a ring of sectors. */
+static block_sector_t read_ahead_queue[READ_AHEAD_MAX];
+static size_t read_ahead_head, read_ahead_cnt;
+static unsigned read_ahead_depth = READ_AHEAD_MAX;
+TUNABLE_UINT ("cache.read_ahead", read_ahead_depth, 0, READ_AHEAD_MAX,
+              "Most sectors queued for read-ahead.");
+static struct condition read_ahead_cond;
+
+/* Statistics. */
+static unsigned long long hit_cnt, miss_cnt, write_back_cnt;
+static unsigned long long prefetch_cnt, direct_cnt, fill_cnt;
+
+static struct cache_block *lookup_block (block_sector_t);
+static struct cache_block *get_block (block_sector_t, bool read,
+                                      unsigned long long *miss_cnt);
+static void write_at (block_sector_t, const void *buffer, int ofs,
+                      int size, bool meta);
+static void fill_block (struct cache_block *, block_sector_t);
+static void flush_block (struct cache_block *);
+static thread_func flush_thread NO_RETURN;
+static thread_func read_ahead_thread NO_RETURN;
+
+/* Initializes the buffer cache and starts its flush and
+   read-ahead threads. */
+void
+cache_init (void)
+{
+  size_t i;
+
+  lock_init (&cache_lock);
+  for (i = 0; i < CACHE_SIZE; i++)
+    lock_init (&cache[i].lock);
+  cond_init (&read_ahead_cond);
+  thread_create ("cache_flush", PRI_MIN, flush_thread, NULL);
+  thread_create ("read_ahead", PRI_DEFAULT, read_ahead_thread, NULL);
+}
+
+/* Writes every dirty cached sector back to disk. */
+void
+cache_flush (void)
+{
+  size_t i;
+
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      struct cache_block *b = &cache[i];
+
+      lock_acquire (&b->lock);
+      flush_block (b);
+      lock_release (&b->lock);
+    }
+}
+
+/* Reads SECTOR into BUFFER, which must be BLOCK_SECTOR_SIZE
+   bytes. */
+void
+cache_read (block_sector_t sector, void *buffer)
+{
+  cache_read_at (sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* Reads SIZE bytes starting at offset OFS within SECTOR into
+   BUFFER. */
+void
+cache_read_at (block_sector_t sector, void *buffer, int ofs, int size)
+{
+  struct cache_block *b;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  b = get_block (sector, true, &miss_cnt);
+  if (ofs < b->fill_ofs || ofs + size > b->fill_end)
+    fill_block (b, sector);
+  memcpy (buffer, b->data + ofs, size);
+  lock_release (&b->lock);
+}
+
+/* Reads SECTOR into BUFFER, which must be BLOCK_SECTOR_SIZE
+   bytes, without caching it if it is not already cached. */
+void
+cache_read_direct (block_sector_t sector, void *buffer)
+{
+  struct cache_block *b;
+
+  for (;;)
+    {
+      lock_acquire (&cache_lock);
+      b = lookup_block (sector);
+      lock_release (&cache_lock);
+      if (b == NULL)
+        {
+          direct_cnt++;
+          if (!journal_read (sector, buffer))
+            block_read (fs_device, sector, buffer);
+          return;
+        }
+
+      /* Same as the hit case in get_block(). */
+      lock_acquire (&b->lock);
+      if (b->valid && b->sector == sector)
+        break;
+      lock_release (&b->lock);
+    }
+  hit_cnt++;
+  fill_block (b, sector);
+  memcpy (buffer, b->data, BLOCK_SECTOR_SIZE);
+  lock_release (&b->lock);
+}
+
+/* Writes BUFFER, which must be BLOCK_SECTOR_SIZE bytes, to
+   SECTOR. */
+void
+cache_write (block_sector_t sector, const void *buffer)
+{
+  cache_write_at (sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* Writes SIZE bytes from BUFFER into SECTOR, starting at offset
+   OFS within it. */
+void
+cache_write_at (block_sector_t sector, const void *buffer, int ofs,
+                int size)
+{
+  write_at (sector, buffer, ofs, size, false);
+}
+
+/* Writes BUFFER, which must be BLOCK_SECTOR_SIZE bytes, to
+   metadata SECTOR. */
+void
+cache_write_meta (block_sector_t sector, const void *buffer)
+{
+  write_at (sector, buffer, 0, BLOCK_SECTOR_SIZE, true);
+}
+
+/* Writes SIZE bytes from BUFFER into metadata SECTOR, starting at
+   offset OFS within it. */
+void
+cache_write_meta_at (block_sector_t sector, const void *buffer, int ofs,
+                     int size)
+{
+  write_at (sector, buffer, ofs, size, true);
+}
+
+/* Asks for SECTOR to be read into the cache in the background,
+   unless it is already cached or too many requests are queued. */
+void
+cache_read_ahead (block_sector_t sector)
+{
+  lock_acquire (&cache_lock);
+  if (read_ahead_cnt < read_ahead_depth && lookup_block (sector) == NULL)
+    {
+      read_ahead_queue[(read_ahead_head + read_ahead_cnt++)
+                       % READ_AHEAD_MAX] = sector;
+      cond_signal (&read_ahead_cond, &cache_lock);
+    }
+  lock_release (&cache_lock);
+}
+
+/* Prints buffer cache statistics. */
+void
+cache_print_stats (void)
+{
+  printf ("Cache: %llu hits, %llu misses, %llu write-backs, "
+          "%llu read ahead, %llu direct, %llu late fills\n",
+          hit_cnt, miss_cnt, write_back_cnt, prefetch_cnt, direct_cnt,
+          fill_cnt);
+}
+
+/* Returns the cache block holding SECTOR, or a null pointer if it
+   is not cached.  Must be called with cache_lock held. */
+static struct cache_block *
+lookup_block (block_sector_t sector)
+{
+  size_t i;
+
+  for (i = 0; i < CACHE_SIZE; i++)
+    if ((cache[i].valid && cache[i].sector == sector)
+        || (cache[i].evicting && cache[i].old_sector == sector))
+      return &cache[i];
+  return NULL;
+}
+
+/* Returns the cache block holding SECTOR, with its lock held,
+   bringing it in if it is not cached and counting that in
+   *MISS_CNT.  The sector's contents are read from disk if READ is
+   true; otherwise none of them are, and the caller must set the
+   filled range to what it writes. */
+static struct cache_block *
+get_block (block_sector_t sector, bool read, unsigned long long *miss_cnt)
+{
+  struct cache_block *b;
+  size_t tries;
+
+  for (;;)
+    {
+      lock_acquire (&cache_lock);
+      b = lookup_block (sector);
+      if (b != NULL)
+        {
+          /* Wait for the slot's owner, then make sure it wasn't
+             reassigned to another sector in the meantime. */
+          b->accessed = true;
+          hit_cnt++;
+          lock_release (&cache_lock);
+          lock_acquire (&b->lock);
+          if (b->valid && b->sector == sector)
+            return b;
+          lock_release (&b->lock);
+          continue;
+        }
+
+      /* Run the clock to pick a slot: an empty one, or one not
+         used since the hand last passed it, that no one is using
+         right now.  If every slot is busy, let their users
+         finish and try again. */
+      for (tries = 0; tries < 2 * CACHE_SIZE; tries++)
+        {
+          b = &cache[hand];
+          hand = (hand + 1) % CACHE_SIZE;
+          if ((!b->valid || !b->accessed) && lock_try_acquire (&b->lock))
+            break;
+          b->accessed = false;
+        }
+      if (tries < 2 * CACHE_SIZE)
+        break;
+      lock_release (&cache_lock);
+      thread_yield ();
+    }
+  (*miss_cnt)++;
+
+  /* Claim the slot for SECTOR, then do the transfers without
+     cache_lock. */
+  b->evicting = b->valid && b->dirty;
+  b->old_sector = b->sector;
+  b->sector = sector;
+  b->valid = true;
+  b->accessed = true;
+  lock_release (&cache_lock);
+
+  if (b->evicting)
+    {
+      fill_block (b, b->old_sector);
+      block_write (fs_device, b->old_sector, b->data);
+      write_back_cnt++;
+      b->evicting = false;
+    }
+  b->dirty = false;
+  b->fill_ofs = 0;
+  b->fill_end = read ? BLOCK_SECTOR_SIZE : 0;
+  if (read && !journal_read (sector, b->data))
+    block_read (fs_device, sector, b->data);
+  return b;
+}
+
+/* Writes SIZE bytes from BUFFER into SECTOR, starting at offset
+   OFS within it.  If META is true, the sector is metadata, which
+   goes to the journal instead of being written back, unless
+   there is no journal. */
+static void
+write_at (block_sector_t sector, const void *buffer, int ofs, int size,
+          bool meta)
+{
+  struct cache_block *b;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  b = get_block (sector, meta && size < BLOCK_SECTOR_SIZE, &miss_cnt);
+  if (b->fill_ofs == b->fill_end && (!meta || size == BLOCK_SECTOR_SIZE))
+    {
+      /* Nothing is known yet but what we write. */
+      b->fill_ofs = ofs;
+      b->fill_end = ofs + size;
+    }
+  else if (!meta && ofs <= b->fill_end && ofs + size >= b->fill_ofs)
+    {
+      /* Grow the filled range to take in ours. */
+      if (ofs < b->fill_ofs)
+        b->fill_ofs = ofs;
+      if (ofs + size > b->fill_end)
+        b->fill_end = ofs + size;
+    }
+  else
+    fill_block (b, sector);
+  memcpy (b->data + ofs, buffer, size);
+  b->dirty = !meta || !journal_write (sector, b->data);
+  lock_release (&b->lock);
+}
+
+/* Makes all of B's data valid by reading the bytes outside its
+   filled range from SECTOR, the one B holds or is writing back.
+   Must be called with B's lock held. */
+static void
+fill_block (struct cache_block *b, block_sector_t sector)
+{
+  uint8_t disk[BLOCK_SECTOR_SIZE];
+
+  if (b->fill_ofs == 0 && b->fill_end == BLOCK_SECTOR_SIZE)
+    return;
+  if (!journal_read (sector, disk))
+    block_read (fs_device, sector, disk);
+  memcpy (b->data, disk, b->fill_ofs);
+  memcpy (b->data + b->fill_end, disk + b->fill_end,
+          BLOCK_SECTOR_SIZE - b->fill_end);
+  b->fill_ofs = 0;
+  b->fill_end = BLOCK_SECTOR_SIZE;
+  fill_cnt++;
+}
+
+/* Writes B back to disk if it is dirty, first reading the rest
+   of its sector if only part of it was written.  Must be called
+   with B's lock held. */
+static void
+flush_block (struct cache_block *b)
+{
+  if (b->valid && b->dirty)
+    {
+      fill_block (b, b->sector);
+      block_write (fs_device, b->sector, b->data);
+      b->dirty = false;
+      write_back_cnt++;
+    }
+}
+
+/* Commits the journal and writes dirty sectors back every
+   FLUSH_INTERVAL milliseconds, so that a crash loses little. */
+static void
+flush_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_msleep (FLUSH_INTERVAL);
+      journal_commit ();
+      cache_flush ();
+    }
+}
+
+/* Serves cache_read_ahead() requests. */
+static void
+read_ahead_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      block_sector_t sector;
+      bool cached;
+
+      lock_acquire (&cache_lock);
+      while (read_ahead_cnt == 0)
+        cond_wait (&read_ahead_cond, &cache_lock);
+      sector = read_ahead_queue[read_ahead_head];
+      read_ahead_head = (read_ahead_head + 1) % READ_AHEAD_MAX;
+      read_ahead_cnt--;
+      cached = lookup_block (sector) != NULL;
+      lock_release (&cache_lock);
+
+      /* Bring it in, unless a reader has beaten us to it.  This
+         is not a miss, which only readers have. */
+      if (!cached)
+        lock_release (&get_block (sector, true, &prefetch_cnt)->lock);
+    }
+}
@@ -0,0 +1,19 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include "devices/block.h"
+
+void cache_init (void);
+void cache_flush (void);
+void cache_read (block_sector_t, void *buffer);
+void cache_read_at (block_sector_t, void *buffer, int ofs, int size);
+void cache_read_direct (block_sector_t, void *buffer);
+void cache_write (block_sector_t, const void *buffer);
+void cache_write_at (block_sector_t, const void *buffer, int ofs, int size);
+void cache_write_meta (block_sector_t, const void *buffer);
+void cache_write_meta_at (block_sector_t, const void *buffer,
+                          int ofs, int size);
+void cache_read_ahead (block_sector_t);
+void cache_print_stats (void);
+
+#endif /* filesys/cache.h */
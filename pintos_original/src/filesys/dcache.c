@@ -0,0 +1,162 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "filesys/inode.h"
+#include "threads/synch.h"
+
+/* Directory entry cache.
+
+   Remembers the results of recent directory lookups, keyed by
+   the directory's inode sector and the name looked up, so that
+   resolving a path whose components were resolved recently reads
+   no directory sectors.  A lookup that failed is remembered too,
+   as a negative entry, since programs often probe for files that
+   don't exist.
+
+   The cache is direct-mapped: each (directory, name) pair has
+   one slot, picked by hashing, and a new entry simply replaces
+   whatever was in its slot.
+
+   The directory code keeps the cache exact.  It inserts entries
+   and invalidates them only with the directory's inode lock
+   held, and dir_add() and dir_remove() invalidate the entry for
+   the name they change. */
+
+/* Number of slots. */
+#define DCACHE_SIZE 128
+
+/* Marks a negative entry. */
+#define NO_INODE ((block_sector_t) -1)
+
+/* A cached lookup result. */
+struct dentry
+  {
+    bool valid;                         /* In use? */
+    unsigned hash;                      /* Hash of DIR and NAME. */
+    block_sector_t dir;                 /* Directory's inode sector. */
+    char name[NAME_MAX + 1];            /* Name looked up. */
+    block_sector_t inode_sector;        /* Result, or NO_INODE. */
+  };
+
+static struct dentry dcache[DCACHE_SIZE];
+
+/* Protects dcache.  Held across inode_open() on a hit, so that
+   dir_remove() can't free the inode in between. */
+static struct lock dcache_lock;
+
+/* Statistics. */
+static unsigned long long hit_cnt, negative_hit_cnt, miss_cnt;
+
+static unsigned dentry_hash (block_sector_t dir, const char *name);
+static struct dentry *find (unsigned hash, block_sector_t dir,
+                            const char *name);
+
+/* Initializes the directory entry cache. */
+void
+dcache_init (void)
+{
+  lock_init (&dcache_lock);
+}
+
+/* Looks up NAME in the directory whose inode is in sector DIR.
+   If the answer is cached, returns true and sets *INODE to the
+   named file's inode, opened, or to a null pointer if there is
+   no such file.  The caller must close *INODE.
+   Returns false if the answer is not cached. */
+bool
+dcache_lookup (block_sector_t dir, const char *name, struct inode **inode)
+{
+  unsigned hash = dentry_hash (dir, name);
+  struct dentry *d;
+
+  lock_acquire (&dcache_lock);
+  d = find (hash, dir, name);
+  if (d == NULL)
+    {
+      miss_cnt++;
+      lock_release (&dcache_lock);
+      return false;
+    }
+  if (d->inode_sector != NO_INODE)
+    {
+      hit_cnt++;
+      *inode = inode_open (d->inode_sector);
+    }
+  else
+    {
+      negative_hit_cnt++;
+      *inode = NULL;
+    }
+  lock_release (&dcache_lock);
+  return true;
+}
+
+/* Records that NAME in the directory whose inode is in sector
+   DIR refers to the inode in INODE_SECTOR, or, if INODE_SECTOR
+   is -1, that there is no such file. */
+void
+dcache_insert (block_sector_t dir, const char *name,
+               block_sector_t inode_sector)
+{
+  unsigned hash = dentry_hash (dir, name);
+  struct dentry *d = &dcache[hash % DCACHE_SIZE];
+
+  ASSERT (strlen (name) <= NAME_MAX);
+
+  lock_acquire (&dcache_lock);
+  d->valid = true;
+  d->hash = hash;
+  d->dir = dir;
+  strlcpy (d->name, name, sizeof d->name);
+  d->inode_sector = inode_sector;
+  lock_release (&dcache_lock);
+}
+
+/* Forgets anything cached about NAME in the directory whose
+   inode is in sector DIR. */
+void
+dcache_invalidate (block_sector_t dir, const char *name)
+{
+  unsigned hash = dentry_hash (dir, name);
+  struct dentry *d;
+
+  lock_acquire (&dcache_lock);
+  d = find (hash, dir, name);
+  if (d != NULL)
+    d->valid = false;
+  lock_release (&dcache_lock);
+}
+
+/* Prints directory entry cache statistics. */
+void
+dcache_print_stats (void)
+{
+  printf ("Dcache: %llu hits, %llu negative hits, %llu misses\n",
+          hit_cnt, negative_hit_cnt, miss_cnt);
+}
+
+/* Returns a hash of DIR and NAME. */
+static unsigned
+dentry_hash (block_sector_t dir, const char *name)
+{
+  return hash_string (name) ^ hash_int (dir);
+}
+
+/* Returns the slot holding NAME in DIR, whose hash is HASH, or a
+   null pointer if it is not cached.  Must be called with
+   dcache_lock held. */
+static struct dentry *
+find (unsigned hash, block_sector_t dir, const char *name)
+{
+  struct dentry *d = &dcache[hash % DCACHE_SIZE];
+
+  ASSERT (lock_held_by_current_thread (&dcache_lock));
+
+  if (d->valid && d->hash == hash && d->dir == dir
+      && !strcmp (d->name, name))
+    return d;
+  return NULL;
+}
@@ -1,16 +1,41 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
 
+/* A directory is a hash table of entries, keyed by name.
+
+   The first sector of the directory's inode holds a struct
+   dir_header.  Each sector after it is a bucket of up to
+   BUCKET_ENTRIES entries.  An entry goes in the bucket that its
+   name hashes to, or, if that bucket is full, in the next bucket
+   with room, wrapping around; each full bucket passed over is
+   marked as having overflowed, so that a lookup knows to keep
+   going past it.  A lookup therefore reads one bucket, unless
+   buckets near it have filled up.
+
+   When the table becomes more than 3/4 full, its buckets are
+   doubled in place and every entry is reinserted. */
+
+/* Identifies a directory. */
+#define DIR_MAGIC 0x44495248
+
+/* Entries per bucket. */
+#define BUCKET_ENTRIES 25
+
 /* A directory. */
 struct dir 
   {
     struct inode *inode;                /* Backing store. */
-    off_t pos;                          /* Current position. */
+    off_t pos;                          /* Current position, as an
+                                           index into the entries
+                                           of all the buckets. */
   };
 
 /* A single directory entry. */
@@ -21,12 +46,100 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
+/* First sector of a directory. */
+struct dir_header
+  {
+    unsigned magic;                     /* DIR_MAGIC. */
+    uint32_t bucket_cnt;                /* Number of buckets, a power
+                                           of 2. */
+    uint32_t entry_cnt;                 /* Number of entries in use. */
+  };
+
+/* A bucket of directory entries, one sector long. */
+struct dir_bucket
+  {
+    struct dir_entry entries[BUCKET_ENTRIES];
+    uint16_t used_cnt;                  /* Entries in use, so that
+                                           insertion can pass over a
+                                           full bucket cheaply. */
+    bool overflowed;                    /* Holds or held entries
+                                           that didn't fit here? */
+  };
+
+/* Returns the offset of BUCKET within a directory. */
+static inline off_t
+bucket_ofs (uint32_t bucket)
+{
+  return (off_t) (bucket + 1) * BLOCK_SECTOR_SIZE;
+}
+
+/* Returns the bucket that NAME hashes to in a directory with
+   BUCKET_CNT buckets. */
+static inline uint32_t
+home_bucket (const char *name, uint32_t bucket_cnt)
+{
+  return hash_string (name) & (bucket_cnt - 1);
+}
+
+/* Reads DIR's header into *H.
+   Returns true if successful, false if DIR is not a valid
+   directory. */
+static bool
+read_header (const struct dir *dir, struct dir_header *h)
+{
+  return (inode_read_at (dir->inode, h, sizeof *h, 0) == sizeof *h
+          && h->magic == DIR_MAGIC && h->bucket_cnt > 0);
+}
+
+/* Writes *H as DIR's header.
+   Returns true if successful, false on failure. */
+static bool
+write_header (struct dir *dir, const struct dir_header *h)
+{
+  return inode_write_at (dir->inode, h, sizeof *h, 0) == sizeof *h;
+}
+
+/* Reads BUCKET of DIR into *B.
+   Returns true if successful, false on failure. */
+static bool
+read_bucket (const struct dir *dir, uint32_t bucket, struct dir_bucket *b)
+{
+  return (inode_read_at (dir->inode, b, sizeof *b, bucket_ofs (bucket))
+          == sizeof *b);
+}
+
+/* Writes *B as BUCKET of DIR.
+   Returns true if successful, false on failure. */
+static bool
+write_bucket (struct dir *dir, uint32_t bucket, const struct dir_bucket *b)
+{
+  return (inode_write_at (dir->inode, b, sizeof *b, bucket_ofs (bucket))
+          == sizeof *b);
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
    given SECTOR.  Returns true if successful, false on failure. */
 bool
 dir_create (block_sector_t sector, size_t entry_cnt)
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+  struct dir_header h;
+  struct dir *dir;
+  bool success;
+
+  ASSERT (sizeof (struct dir_bucket) <= BLOCK_SECTOR_SIZE);
+
+  h.magic = DIR_MAGIC;
+  h.bucket_cnt = 1;
+  h.entry_cnt = 0;
+  while (h.bucket_cnt * BUCKET_ENTRIES * 3 / 4 < entry_cnt)
+    h.bucket_cnt *= 2;
+
+  if (!inode_create (sector, bucket_ofs (h.bucket_cnt)))
+    return false;
+  dir = dir_open (inode_open (sector));
+  success = dir != NULL && write_header (dir, &h);
+  dir_close (dir);
+  return success;
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -39,6 +152,7 @@ dir_open (struct inode *inode)
     {
       dir->inode = inode;
       dir->pos = 0;
+      inode_mark_metadata (inode);
       return dir;
     }
   else
@@ -83,34 +197,145 @@ dir_get_inode (struct dir *dir)
   return dir->inode;
 }
 
-/* Searches DIR for a file with the given NAME.
-   If successful, returns true, sets *EP to the directory entry
-   if EP is non-null, and sets *OFSP to the byte offset of the
-   directory entry if OFSP is non-null.
-   otherwise, returns false and ignores EP and OFSP. */
+/* Searches DIR, whose header is *H, for a file with the given
+   NAME, using *B as scratch space.
+   If successful, returns true, and leaves the bucket holding the
+   entry in *B and sets *BUCKETP and *SLOTP to its bucket and
+   index within it; otherwise, returns false. */
 static bool
-lookup (const struct dir *dir, const char *name,
-        struct dir_entry *ep, off_t *ofsp) 
+lookup (const struct dir *dir, const struct dir_header *h,
+        const char *name, struct dir_bucket *b,
+        uint32_t *bucketp, int *slotp)
 {
-  struct dir_entry e;
-  size_t ofs;
-  
+  uint32_t bucket = home_bucket (name, h->bucket_cnt);
+  uint32_t i;
+
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (e.in_use && !strcmp (name, e.name)) 
-      {
-        if (ep != NULL)
-          *ep = e;
-        if (ofsp != NULL)
-          *ofsp = ofs;
-        return true;
-      }
+  for (i = 0; i < h->bucket_cnt; i++)
+    {
+      int slot;
+
+      if (!read_bucket (dir, bucket, b))
+        return false;
+      for (slot = 0; slot < BUCKET_ENTRIES; slot++)
+        if (b->entries[slot].in_use && !strcmp (name, b->entries[slot].name))
+          {
+            *bucketp = bucket;
+            *slotp = slot;
+            return true;
+          }
+      if (!b->overflowed)
+        break;
+      bucket = (bucket + 1) & (h->bucket_cnt - 1);
+    }
   return false;
 }
 
+/* Puts E in DIR, whose header is *H, using *B as scratch space.
+   Does not update H->entry_cnt.
+   Returns true if successful, false on failure. */
+static bool
+insert (struct dir *dir, const struct dir_header *h,
+        const struct dir_entry *e, struct dir_bucket *b)
+{
+  uint32_t bucket = home_bucket (e->name, h->bucket_cnt);
+  uint32_t i;
+
+  for (i = 0; i < h->bucket_cnt; i++)
+    {
+      off_t ofs = bucket_ofs (bucket);
+      uint16_t used_cnt;
+
+      /* Pass over a full bucket without reading its entries. */
+      if (inode_read_at (dir->inode, &used_cnt, sizeof used_cnt,
+                         ofs + offsetof (struct dir_bucket, used_cnt))
+          != sizeof used_cnt)
+        return false;
+      if (used_cnt < BUCKET_ENTRIES)
+        {
+          int slot;
+
+          if (!read_bucket (dir, bucket, b))
+            return false;
+          for (slot = 0; b->entries[slot].in_use; slot++)
+            continue;
+          b->entries[slot] = *e;
+          b->used_cnt++;
+          return write_bucket (dir, bucket, b);
+        }
+      else
+        {
+          bool overflowed = true;
+
+          if (inode_write_at (dir->inode, &overflowed, sizeof overflowed,
+                              ofs + offsetof (struct dir_bucket, overflowed))
+              != sizeof overflowed)
+            return false;
+        }
+      bucket = (bucket + 1) & (h->bucket_cnt - 1);
+    }
+  return false;
+}
+
+/* Doubles the number of buckets in DIR, whose header is *H, and
+   rehashes all of its entries, using *B as scratch space.
+   Returns true if successful, false on failure.  A failure while
+   adding the new buckets leaves DIR unchanged; a later one, which
+   takes a disk error, may lose entries. */
+static bool
+grow (struct dir *dir, struct dir_header *h, struct dir_bucket *b)
+{
+  uint32_t old_cnt = h->bucket_cnt;
+  uint32_t bucket;
+
+  /* Add empty buckets, last one first, so that the directory
+     grows only once. */
+  memset (b, 0, sizeof *b);
+  for (bucket = 2 * old_cnt; bucket-- > old_cnt; )
+    if (!write_bucket (dir, bucket, b))
+      return false;
+
+  /* Forget the old overflows: every entry is about to be
+     reinserted, which marks all the overflows that are still
+     needed. */
+  for (bucket = 0; bucket < old_cnt; bucket++)
+    {
+      if (!read_bucket (dir, bucket, b))
+        return false;
+      b->overflowed = false;
+      if (!write_bucket (dir, bucket, b))
+        return false;
+    }
+  h->bucket_cnt = 2 * old_cnt;
+
+  /* Take each entry out of its old bucket and reinsert it.  An
+     entry may land back where it was, or in a later bucket, to be
+     taken out and reinserted again; either way it ends up where
+     lookup() will find it. */
+  for (bucket = 0; bucket < old_cnt; bucket++)
+    {
+      int slot;
+
+      for (slot = 0; slot < BUCKET_ENTRIES; slot++)
+        {
+          struct dir_entry e;
+
+          if (!read_bucket (dir, bucket, b))
+            return false;
+          if (!b->entries[slot].in_use)
+            continue;
+          e = b->entries[slot];
+          b->entries[slot].in_use = false;
+          b->used_cnt--;
+          if (!write_bucket (dir, bucket, b) || !insert (dir, h, &e, b))
+            return false;
+        }
+    }
+  return write_header (dir, h);
+}
+
 /* Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
    On success, sets *INODE to an inode for the file, otherwise to
@@ -119,16 +344,38 @@ bool
 dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
-  struct dir_entry e;
+  struct dir_header h;
+  struct dir_bucket *b;
+  uint32_t bucket;
+  int slot;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
-  else
-    *inode = NULL;
+  if (dcache_lookup (inode_get_inumber (dir->inode), name, inode))
+    return *inode != NULL;
+
+  *inode = NULL;
+  b = malloc (sizeof *b);
+  if (b == NULL)
+    return false;
 
+  inode_lock (dir->inode);
+  if (read_header (dir, &h))
+    {
+      block_sector_t sector = -1;
+
+      if (lookup (dir, &h, name, b, &bucket, &slot))
+        {
+          sector = b->entries[slot].inode_sector;
+          *inode = inode_open (sector);
+        }
+      if (strlen (name) <= NAME_MAX)
+        dcache_insert (inode_get_inumber (dir->inode), name, sector);
+    }
+  inode_unlock (dir->inode);
+
+  free (b);
   return *inode != NULL;
 }
 
@@ -141,8 +388,11 @@ dir_lookup (const struct dir *dir, const char *name,
 bool
 dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 {
+  struct dir_header h;
+  struct dir_bucket *b;
   struct dir_entry e;
-  off_t ofs;
+  uint32_t bucket;
+  int slot;
   bool success = false;
 
   ASSERT (dir != NULL);
@@ -152,29 +402,35 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   if (*name == '\0' || strlen (name) > NAME_MAX)
     return false;
 
+  b = malloc (sizeof *b);
+  if (b == NULL)
+    return false;
+
   /* Check that NAME is not in use. */
-  if (lookup (dir, name, NULL, NULL))
+  journal_begin ();
+  inode_lock (dir->inode);
+  if (!read_header (dir, &h) || lookup (dir, &h, name, b, &bucket, &slot))
+    goto done;
+
+  /* Make room if the table is getting full. */
+  if ((h.entry_cnt + 1) * 4 > h.bucket_cnt * BUCKET_ENTRIES * 3
+      && !grow (dir, &h, b))
     goto done;
 
-  /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file.
-     
-     inode_read_at() will only return a short read at end of file.
-     Otherwise, we'd need to verify that we didn't get a short
-     read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
-
-  /* Write slot. */
+  /* Insert entry. */
   e.in_use = true;
   strlcpy (e.name, name, sizeof e.name);
   e.inode_sector = inode_sector;
-  success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  dcache_invalidate (inode_get_inumber (dir->inode), name);
+  if (!insert (dir, &h, &e, b))
+    goto done;
+  h.entry_cnt++;
+  success = write_header (dir, &h);
 
  done:
+  inode_unlock (dir->inode);
+  journal_end ();
+  free (b);
   return success;
 }
 
@@ -184,34 +440,50 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 bool
 dir_remove (struct dir *dir, const char *name) 
 {
-  struct dir_entry e;
+  struct dir_header h;
+  struct dir_bucket *b;
   struct inode *inode = NULL;
+  uint32_t bucket;
+  int slot;
   bool success = false;
-  off_t ofs;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  b = malloc (sizeof *b);
+  if (b == NULL)
+    return false;
+
   /* Find directory entry. */
-  if (!lookup (dir, name, &e, &ofs))
+  journal_begin ();
+  inode_lock (dir->inode);
+  if (!read_header (dir, &h) || !lookup (dir, &h, name, b, &bucket, &slot))
     goto done;
 
   /* Open inode. */
-  inode = inode_open (e.inode_sector);
+  inode = inode_open (b->entries[slot].inode_sector);
   if (inode == NULL)
     goto done;
 
-  /* Erase directory entry. */
-  e.in_use = false;
-  if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
+  /* Erase directory entry.  The bucket stays marked as overflowed
+     if it was, since entries past it may still depend on that. */
+  dcache_invalidate (inode_get_inumber (dir->inode), name);
+  b->entries[slot].in_use = false;
+  b->used_cnt--;
+  if (!write_bucket (dir, bucket, b))
     goto done;
+  h.entry_cnt--;
+  write_header (dir, &h);
 
   /* Remove inode. */
   inode_remove (inode);
   success = true;
 
  done:
+  inode_unlock (dir->inode);
   inode_close (inode);
+  journal_end ();
+  free (b);
   return success;
 }
 
@@ -221,16 +493,99 @@ dir_remove (struct dir *dir, const char *name)
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
+  struct dir_header h;
   struct dir_entry e;
+  bool success = false;
+
+  inode_lock (dir->inode);
+  if (read_header (dir, &h))
+    while ((uint32_t) dir->pos < h.bucket_cnt * BUCKET_ENTRIES)
+      {
+        off_t ofs = (bucket_ofs (dir->pos / BUCKET_ENTRIES)
+                     + dir->pos % BUCKET_ENTRIES * sizeof e);
+
+        if (inode_read_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
+          break;
+        dir->pos++;
+        if (e.in_use)
+          {
+            strlcpy (name, e.name, NAME_MAX + 1);
+            success = true;
+            break;
+          }
+      }
+  inode_unlock (dir->inode);
+  return success;
+}
 
-  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
+/* Reads up to CNT of the next directory entries in DIR into
+   INFO, reading each bucket of entries at once rather than entry
+   by entry, and leaves the LENGTH of each one -1.  Returns the
+   number of entries read, which is less than CNT only if the
+   directory contains no more entries. */
+size_t
+dir_readdir_multi (struct dir *dir, struct dir_info info[], size_t cnt)
+{
+  struct dir_header h;
+  struct dir_bucket *b;
+  size_t n = 0;
+
+  b = malloc (sizeof *b);
+  if (b == NULL)
+    return 0;
+
+  inode_lock (dir->inode);
+  if (read_header (dir, &h))
+    while (n < cnt && (uint32_t) dir->pos < h.bucket_cnt * BUCKET_ENTRIES)
+      {
+        int slot = dir->pos % BUCKET_ENTRIES;
+
+        if (!read_bucket (dir, dir->pos / BUCKET_ENTRIES, b))
+          break;
+        if (b->used_cnt == 0)
+          {
+            dir->pos += BUCKET_ENTRIES - slot;
+            continue;
+          }
+        for (; n < cnt && slot < BUCKET_ENTRIES; slot++)
+          {
+            const struct dir_entry *e = &b->entries[slot];
+
+            dir->pos++;
+            if (e->in_use)
+              {
+                strlcpy (info[n].name, e->name, sizeof info[n].name);
+                info[n].inode_sector = e->inode_sector;
+                info[n].length = -1;
+                n++;
+              }
+          }
+      }
+  inode_unlock (dir->inode);
+
+  free (b);
+  return n;
+}
+
+/* Like dir_readdir_multi(), but also sets the LENGTH of each
+   entry read to its file's size, or leaves it -1 if the file
+   can't be opened. */
+size_t
+dir_readdir_stat (struct dir *dir, struct dir_info info[], size_t cnt)
+{
+  size_t n = dir_readdir_multi (dir, info, cnt);
+  size_t i;
+
+  /* The inodes are opened without DIR locked, as in dir_remove(),
+     since closing one may have to finish removing it. */
+  for (i = 0; i < n; i++)
     {
-      dir->pos += sizeof e;
-      if (e.in_use)
+      struct inode *inode = inode_open (info[i].inode_sector);
+      if (inode != NULL)
         {
-          strlcpy (name, e.name, NAME_MAX + 1);
-          return true;
-        } 
+          info[i].length = inode_length (inode);
+          inode_close (inode);
+        }
     }
-  return false;
+  return n;
 }
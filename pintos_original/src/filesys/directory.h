@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include "devices/block.h"
+#include "filesys/off_t.h"
 
 /* Maximum length of a file name component.
    This is the traditional UNIX maximum length.
@@ -13,6 +14,16 @@
 
 struct inode;
 
+/* A directory entry, as returned by dir_readdir_multi() and
+   dir_readdir_stat(). */
+struct dir_info
+  {
+    char name[NAME_MAX + 1];            /* Null terminated file name. */
+    block_sector_t inode_sector;        /* Sector of the file's inode. */
+    off_t length;                       /* File size in bytes, or -1 if
+                                           not looked up. */
+  };
+
 /* Opening and closing directories. */
 bool dir_create (block_sector_t sector, size_t entry_cnt);
 struct dir *dir_open (struct inode *);
@@ -26,5 +37,7 @@ bool dir_lookup (const struct dir *, const char *name, struct inode **);
 bool dir_add (struct dir *, const char *name, block_sector_t);
 bool dir_remove (struct dir *, const char *name);
 bool dir_readdir (struct dir *, char name[NAME_MAX + 1]);
+size_t dir_readdir_multi (struct dir *, struct dir_info[], size_t cnt);
+size_t dir_readdir_stat (struct dir *, struct dir_info[], size_t cnt);
 
 #endif /* filesys/directory.h */
@@ -84,6 +84,17 @@ file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs)
   return inode_read_at (file->inode, buffer, size, file_ofs);
 }
 
+/* Reads SIZE bytes from FILE into BUFFER, starting at offset
+   FILE_OFS in the file, like file_read_at(), but without passing
+   whole uncached sectors through the buffer cache.  Meant for
+   callers that keep what they read, such as page loads. */
+off_t
+file_read_at_direct (struct file *file, void *buffer, off_t size,
+                     off_t file_ofs)
+{
+  return inode_read_at_direct (file->inode, buffer, size, file_ofs);
+}
+
 /* Writes SIZE bytes from BUFFER into FILE,
    starting at the file's current position.
    Returns the number of bytes actually written,
@@ -113,6 +124,17 @@ file_write_at (struct file *file, const void *buffer, off_t size,
   return inode_write_at (file->inode, buffer, size, file_ofs);
 }
 
+/* Allocates disk space for the first LENGTH bytes of FILE, so
+   that a writer that knows how much it will write can have the
+   space set aside at once instead of a little with each write.
+   FILE's length and position are unaffected.
+   Returns true if successful, false if the disk is full. */
+bool
+file_allocate (struct file *file, off_t length)
+{
+  return inode_reserve (file->inode, length);
+}
+
 /* Prevents write operations on FILE's underlying inode
    until file_allow_write() is called or FILE is closed. */
 void
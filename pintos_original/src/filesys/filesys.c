@@ -2,15 +2,51 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
+#include "filesys/dcache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "filesys/journal.h"
+#include "threads/synch.h"
+
+/* Identifies a superblock. */
+#define SUPER_MAGIC 0x53555052
+
+/* Superblock, at SUPER_SECTOR.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+
+   CLEAN is set by filesys_done(), after everything else has been
+   written, and cleared by the next mount before anything else is,
+   so it is set on disk only while the file system is unmounted
+   and consistent.  Mounting a clean file system trusts the
+   counts, and skips journal replay, since a clean unmount leaves
+   the log empty.  Otherwise, the journal is replayed and the
+   counts are recomputed, by scanning the root directory for
+   INODE_CNT.  A file system formatted before there were
+   superblocks has none, and is always recovered that way. */
+struct superblock
+  {
+    unsigned magic;                     /* SUPER_MAGIC. */
+    uint32_t clean;                     /* Unmounted cleanly? */
+    uint32_t free_cnt;                  /* Free sectors. */
+    uint32_t inode_cnt;                 /* Inodes in use. */
+    uint32_t mount_cnt;                 /* Times mounted. */
+    uint8_t unused[BLOCK_SECTOR_SIZE - 20];
+  };
 
 /* Partition that contains the file system. */
 struct block *fs_device;
 
+/* In-memory superblock, whose INODE_CNT is kept up to date. */
+static struct superblock super;
+static bool have_super;                 /* Found or written one? */
+static struct lock super_lock;          /* Protects super.inode_cnt. */
+
 static void do_format (void);
+static void write_super (bool clean);
+static uint32_t count_inodes (void);
 
 /* Initializes the file system module.
    If FORMAT is true, reformats the file system. */
@@ -21,21 +57,56 @@ filesys_init (bool format)
   if (fs_device == NULL)
     PANIC ("No file system device found, can't initialize file system.");
 
+  cache_init ();
+  dcache_init ();
   inode_init ();
   free_map_init ();
+  journal_init ();
+  lock_init (&super_lock);
+  ASSERT (sizeof super == BLOCK_SECTOR_SIZE);
 
   if (format) 
     do_format ();
 
-  free_map_open ();
+  block_read (fs_device, SUPER_SECTOR, &super);
+  have_super = super.magic == SUPER_MAGIC;
+  if (have_super && super.clean)
+    {
+      journal_open (false);
+      free_map_open ();
+      if (free_map_free_cnt () != super.free_cnt)
+        printf ("File system free map has %zu free sectors, "
+                "superblock says %"PRIu32".\n",
+                free_map_free_cnt (), super.free_cnt);
+    }
+  else
+    {
+      if (have_super)
+        printf ("File system was not unmounted cleanly, recovering.\n");
+      journal_open (true);
+      free_map_open ();
+      super.inode_cnt = count_inodes ();
+    }
+  if (have_super)
+    {
+      super.mount_cnt++;
+      write_super (false);
+    }
 }
 
 /* Shuts down the file system module, writing any unwritten data
-   to disk. */
+   to disk, and then marks it cleanly unmounted. */
 void
 filesys_done (void) 
 {
   free_map_close ();
+  journal_close ();
+  cache_flush ();
+  if (have_super)
+    {
+      super.free_cnt = free_map_free_cnt ();
+      write_super (true);
+    }
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
@@ -46,15 +117,31 @@ bool
 filesys_create (const char *name, off_t initial_size) 
 {
   block_sector_t inode_sector = 0;
-  struct dir *dir = dir_open_root ();
-  bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
-                  && inode_create (inode_sector, initial_size)
-                  && dir_add (dir, name, inode_sector));
+  block_sector_t goal = 0;
+  struct dir *dir;
+  bool success;
+
+  journal_begin ();
+  dir = dir_open_root ();
+
+  /* Put the inode near its directory's, and its data after it. */
+  if (dir != NULL)
+    goal = inode_get_inumber (dir_get_inode (dir)) + 1;
+  success = (dir != NULL
+             && free_map_allocate_near (1, goal, &inode_sector)
+             && inode_create (inode_sector, initial_size)
+             && dir_add (dir, name, inode_sector));
   if (!success && inode_sector != 0) 
     free_map_release (inode_sector, 1);
   dir_close (dir);
+  journal_end ();
 
+  if (success)
+    {
+      lock_acquire (&super_lock);
+      super.inode_cnt++;
+      lock_release (&super_lock);
+    }
   return success;
 }
 
@@ -87,8 +174,23 @@ filesys_remove (const char *name)
   bool success = dir != NULL && dir_remove (dir, name);
   dir_close (dir); 
 
+  if (success)
+    {
+      lock_acquire (&super_lock);
+      super.inode_cnt--;
+      lock_release (&super_lock);
+    }
   return success;
 }
+
+/* Prints file system statistics. */
+void
+filesys_print_stats (void)
+{
+  printf ("File system: %"PRIu32" inodes, %zu free sectors, "
+          "mounted %"PRIu32" times\n",
+          super.inode_cnt, free_map_free_cnt (), super.mount_cnt);
+}
 
 /* Formats the file system. */
 static void
@@ -98,6 +200,44 @@ do_format (void)
   free_map_create ();
   if (!dir_create (ROOT_DIR_SECTOR, 16))
     PANIC ("root directory creation failed");
+  journal_create ();
   free_map_close ();
+
+  /* Everything but the root directory's entries is the free map
+     and the root directory. */
+  memset (&super, 0, sizeof super);
+  super.magic = SUPER_MAGIC;
+  super.inode_cnt = 2;
+  super.free_cnt = free_map_free_cnt ();
+  write_super (true);
   printf ("done.\n");
 }
+
+/* Writes the superblock with its CLEAN flag set as given.  It is
+   written straight to disk, bypassing the cache, so that it
+   reaches the disk at once and in order with the rest. */
+static void
+write_super (bool clean)
+{
+  super.clean = clean;
+  block_write (fs_device, SUPER_SECTOR, &super);
+}
+
+/* Returns the number of inodes in use, counted by scanning the
+   root directory, plus the free map's and the root directory's
+   own. */
+static uint32_t
+count_inodes (void)
+{
+  struct dir *dir = dir_open_root ();
+  struct dir_info info[16];
+  uint32_t cnt = 2;
+  size_t n;
+
+  if (dir == NULL)
+    PANIC ("root dir open failed");
+  while ((n = dir_readdir_multi (dir, info, sizeof info / sizeof *info)) > 0)
+    cnt += n;
+  dir_close (dir);
+  return cnt;
+}
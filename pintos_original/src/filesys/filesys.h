@@ -7,6 +7,8 @@
 /* Sectors of system file inodes. */
 #define FREE_MAP_SECTOR 0       /* Free map file inode sector. */
 #define ROOT_DIR_SECTOR 1       /* Root directory file inode sector. */
+#define JOURNAL_SECTOR 2        /* Journal header sector. */
+#define SUPER_SECTOR 3          /* Superblock sector. */
 
 /* Block device that contains the file system. */
 struct block *fs_device;
@@ -16,5 +18,6 @@ void filesys_done (void);
 bool filesys_create (const char *name, off_t initial_size);
 struct file *filesys_open (const char *name);
 bool filesys_remove (const char *name);
+void filesys_print_stats (void);
 
 #endif /* filesys/filesys.h */
@@ -4,9 +4,14 @@
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/synch.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
+static struct lock free_map_lock;    /* Protects free_map and its file. */
+
+static size_t save_allocation (size_t sector, size_t cnt);
 
 /* Initializes the free map. */
 void
@@ -15,38 +20,100 @@ free_map_init (void)
   free_map = bitmap_create (block_size (fs_device));
   if (free_map == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
+  lock_init (&free_map_lock);
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  bitmap_mark (free_map, JOURNAL_SECTOR);
+  bitmap_mark (free_map, SUPER_SECTOR);
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
    the first into *SECTORP.
    Returns true if successful, false if not enough consecutive
    sectors were available or if the free_map file could not be
-   written. */
+   written.  Each search starts just past the previous
+   allocation.  Only the part of the free map file that holds the
+   changed bits is rewritten, through the buffer cache. */
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
+  size_t sector;
+
+  lock_acquire (&free_map_lock);
+  sector = bitmap_scan_and_flip_next (free_map, cnt, false);
+  sector = save_allocation (sector, cnt);
+  lock_release (&free_map_lock);
+  if (sector != BITMAP_ERROR)
+    *sectorp = sector;
+  return sector != BITMAP_ERROR;
+}
+
+/* Allocates CNT consecutive sectors from the free map, the first
+   free run at or after GOAL if there is one, and stores the first
+   into *SECTORP.  Callers pass the sector after the one they
+   would like the new ones to follow, so that related sectors end
+   up close together on disk.
+   Returns true if successful, false if not enough consecutive
+   sectors were available or if the free_map file could not be
+   written. */
+bool
+free_map_allocate_near (size_t cnt, block_sector_t goal,
+                        block_sector_t *sectorp)
+{
+  size_t sector;
+
+  lock_acquire (&free_map_lock);
+  if (goal >= bitmap_size (free_map))
+    goal = 0;
+  sector = bitmap_scan_and_flip (free_map, goal, cnt, false);
+  if (sector == BITMAP_ERROR && goal > 0)
+    sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
+  sector = save_allocation (sector, cnt);
+  lock_release (&free_map_lock);
+  if (sector != BITMAP_ERROR)
+    *sectorp = sector;
+  return sector != BITMAP_ERROR;
+}
+
+/* Writes the free map back after CNT sectors starting at SECTOR
+   have been marked in use, undoing that if the write fails.
+   Returns SECTOR, or BITMAP_ERROR if SECTOR is BITMAP_ERROR or
+   the write fails.  Must be called with free_map_lock held. */
+static size_t
+save_allocation (size_t sector, size_t cnt)
+{
   if (sector != BITMAP_ERROR
       && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+      && !bitmap_write_range (free_map, free_map_file, sector, cnt))
     {
       bitmap_set_multiple (free_map, sector, cnt, false); 
       sector = BITMAP_ERROR;
     }
-  if (sector != BITMAP_ERROR)
-    *sectorp = sector;
-  return sector != BITMAP_ERROR;
+  return sector;
 }
 
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
   bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  journal_revoke (sector, cnt);
+  bitmap_write_range (free_map, free_map_file, sector, cnt);
+  lock_release (&free_map_lock);
+}
+
+/* Returns the number of free sectors. */
+size_t
+free_map_free_cnt (void)
+{
+  size_t cnt;
+
+  lock_acquire (&free_map_lock);
+  cnt = bitmap_count (free_map, 0, bitmap_size (free_map), false);
+  lock_release (&free_map_lock);
+  return cnt;
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -56,6 +123,7 @@ free_map_open (void)
   free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
+  inode_mark_metadata (file_get_inode (free_map_file));
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
 }
@@ -80,6 +148,7 @@ free_map_create (void)
   free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
+  inode_mark_metadata (file_get_inode (free_map_file));
   if (!bitmap_write (free_map, free_map_file))
     PANIC ("can't write free map");
 }
@@ -1,5 +1,6 @@
 #include "filesys/fsutil.h"
 #include <debug.h>
+#include <round.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -11,19 +12,25 @@
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
 
-/* List files in the root directory. */
+/* List files in the root directory, with their sizes. */
 void
 fsutil_ls (char **argv UNUSED) 
 {
   struct dir *dir;
-  char name[NAME_MAX + 1];
+  struct dir_info info[16];
+  size_t n;
   
   printf ("Files in the root directory:\n");
   dir = dir_open_root ();
   if (dir == NULL)
     PANIC ("root dir open failed");
-  while (dir_readdir (dir, name))
-    printf ("%s\n", name);
+  while ((n = dir_readdir_stat (dir, info, sizeof info / sizeof *info)) > 0)
+    {
+      size_t i;
+
+      for (i = 0; i < n; i++)
+        printf ("%-*s %8"PROTd"\n", NAME_MAX, info[i].name, info[i].length);
+    }
   dir_close (dir);
   printf ("End of listing.\n");
 }
@@ -67,8 +74,17 @@ fsutil_rm (char **argv)
     PANIC ("%s: delete failed\n", file_name);
 }
 
+/* Pages in fsutil_extract()'s data buffer. */
+#define EXTRACT_PAGES 8
+#define EXTRACT_SECTORS (EXTRACT_PAGES * PGSIZE / BLOCK_SECTOR_SIZE)
+
 /* Extracts a ustar-format tar archive from the scratch block
-   device into the Pintos file system. */
+   device into the Pintos file system.
+
+   Each file is created at its full size from its header, so that
+   its sectors are allocated together, and then its data is copied
+   EXTRACT_SECTORS at a time, with one multi-sector read from the
+   scratch device and one file_write() per chunk. */
 void
 fsutil_extract (char **argv UNUSED) 
 {
@@ -79,8 +95,8 @@ fsutil_extract (char **argv UNUSED)
 
   /* Allocate buffers. */
   header = malloc (BLOCK_SECTOR_SIZE);
-  data = malloc (BLOCK_SECTOR_SIZE);
-  if (header == NULL || data == NULL)
+  data = palloc_get_multiple (PAL_ASSERT, EXTRACT_PAGES);
+  if (header == NULL)
     PANIC ("couldn't allocate buffers");
 
   /* Open source block device. */
@@ -127,10 +143,13 @@ fsutil_extract (char **argv UNUSED)
           /* Do copy. */
           while (size > 0)
             {
-              int chunk_size = (size > BLOCK_SECTOR_SIZE
-                                ? BLOCK_SECTOR_SIZE
+              int chunk_size = (size > EXTRACT_SECTORS * BLOCK_SECTOR_SIZE
+                                ? EXTRACT_SECTORS * BLOCK_SECTOR_SIZE
                                 : size);
-              block_read (src, sector++, data);
+              size_t sector_cnt = DIV_ROUND_UP (chunk_size,
+                                                BLOCK_SECTOR_SIZE);
+              block_read_multi (src, sector, sector_cnt, data);
+              sector += sector_cnt;
               if (file_write (dst, data, chunk_size) != chunk_size)
                 PANIC ("%s: write failed with %d bytes unwritten",
                        file_name, size);
@@ -151,7 +170,7 @@ fsutil_extract (char **argv UNUSED)
   block_write (src, 0, header);
   block_write (src, 1, header);
 
-  free (data);
+  palloc_free_multiple (data, EXTRACT_PAGES);
   free (header);
 }
 
@@ -1,67 +1,727 @@
 #include "filesys/inode.h"
-#include <list.h>
 #include <debug.h>
+#include <hash.h>
+#include <ohash.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/rcu.h"
+#include "threads/synch.h"
+#include "threads/tunable.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Sectors to read ahead of a sequential reader. */
+#define READ_AHEAD_SECTORS 4
+
+/* Sector pointers in an inode: DIRECT_CNT point to data
+   sectors, INDIRECT_CNT to sectors of data sector pointers, and
+   DBL_INDIRECT_CNT to sectors of indirect sector pointers. */
+#define DIRECT_CNT 123
+#define INDIRECT_CNT 1
+#define DBL_INDIRECT_CNT 1
+#define SECTOR_CNT (DIRECT_CNT + INDIRECT_CNT + DBL_INDIRECT_CNT)
+
+/* Most sector pointers looked at at once to find a run of
+   consecutive data sectors in an indexed inode. */
+#define MAP_RUN_MAX 16
+
+/* Sector pointers in an indirect sector. */
+#define PTRS_PER_SECTOR ((off_t) (BLOCK_SECTOR_SIZE / sizeof (block_sector_t)))
+
+/* Largest file an indexed inode can describe, in bytes. */
+#define INODE_SPAN ((DIRECT_CNT                                         \
+                     + PTRS_PER_SECTOR * INDIRECT_CNT                   \
+                     + PTRS_PER_SECTOR * PTRS_PER_SECTOR * DBL_INDIRECT_CNT) \
+                    * BLOCK_SECTOR_SIZE)
+
+/* A run of LENGTH consecutive sectors starting at START. */
+struct extent
+  {
+    block_sector_t start;               /* First sector. */
+    uint32_t length;                    /* Number of sectors, or 0 if
+                                           this extent is unused. */
+  };
+
+/* Extents in an inode, in its overflow sector, and in all. */
+#define EXTENT_CNT (SECTOR_CNT / 2)
+#define OVERFLOW_CNT ((int) (BLOCK_SECTOR_SIZE / sizeof (struct extent)))
+#define EXTENT_MAX (EXTENT_CNT + OVERFLOW_CNT)
+
+/* Largest file an extent-based inode can describe, in bytes. */
+#define EXTENT_SPAN (INT32_MAX / BLOCK_SECTOR_SIZE * BLOCK_SECTOR_SIZE)
+
+/* Bytes of data an inline inode holds. */
+#define INLINE_SIZE ((off_t) (SECTOR_CNT * sizeof (block_sector_t)))
+
+/* Inode layouts. */
+#define INODE_INDEXED 0                 /* Sector pointers. */
+#define INODE_EXTENTS 1                 /* Extents. */
+#define INODE_INLINE 2                  /* Data in the inode itself. */
+
 /* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+
+   An indexed inode maps each sector of the file through
+   sectors[].  A zero sector pointer means the sector has not
+   been allocated yet; it reads as zeros.  (Sector 0 holds the
+   free map inode, so it is never anyone's data.)
+
+   An extent-based inode maps the file as a sequence of runs of
+   sectors, the first EXTENT_CNT in extents[] and the rest in
+   the overflow sector.  Every sector up to the end of the file
+   is allocated.
+
+   Either kind may also have sectors past the end of the file
+   that inode_reserve() set aside for it to grow into.
+
+   An inline inode holds a file of up to INLINE_SIZE bytes in
+   inline_data[] and has no other sectors, so that reading a
+   small file takes just the inode.  Its data is written through
+   the journal with the rest of the inode.  It becomes indexed or
+   extent-based, like a new inode, when it grows past
+   INLINE_SIZE. */
 struct inode_disk
   {
-    block_sector_t start;               /* First data sector. */
+    union
+      {
+        block_sector_t sectors[SECTOR_CNT]; /* Sector pointers. */
+        struct
+          {
+            struct extent extents[EXTENT_CNT]; /* First extents. */
+            block_sector_t overflow;    /* Sector of more extents. */
+          };
+        uint8_t inline_data[INLINE_SIZE]; /* Data of inline inode. */
+      };
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
+    uint32_t layout;                    /* INODE_INDEXED,
+                                           INODE_EXTENTS, or
+                                           INODE_INLINE. */
   };
 
-/* Returns the number of sectors to allocate for an inode SIZE
-   bytes long. */
-static inline size_t
-bytes_to_sectors (off_t size)
-{
-  return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
-}
+/* If false (default), create indexed inodes.
+   If true, create extent-based inodes.
+   Controlled by kernel command-line option "-extents". */
+bool inode_extents;
+
+/* If true (default), create inodes of files no bigger than
+   INLINE_SIZE inline. */
+static bool inode_inline = true;
+TUNABLE_BOOL ("inode.inline", inode_inline,
+              "Keep files of up to 500 bytes in their inodes.");
+
+/* A sector of zeros. */
+static char zeros[BLOCK_SECTOR_SIZE];
+
+/* A run of CNT consecutive sectors starting at START.  Used for
+   free sectors that reserve_indexed() has taken from the free
+   map and hands out one at a time as data sectors, and for the
+   last run of a file's sectors that map_sector() found. */
+struct sector_run
+  {
+    block_sector_t start;               /* First sector. */
+    size_t cnt;                         /* Number of sectors. */
+  };
 
 /* In-memory inode. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
     block_sector_t sector;              /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    unsigned version;                   /* Incremented by each write. */
+    bool metadata;                      /* Data is metadata? */
+    off_t read_end;                     /* End of the last read. */
+    off_t ahead_end;                    /* End of data read ahead. */
+    block_sector_t alloc_goal;          /* Where to allocate next, or
+                                           0 if not yet known. */
+    off_t map_idx;                      /* File sector held in the first
+                                           sector of MAP. */
+    struct sector_run map;              /* Last run of sectors mapped. */
+    struct rwlock rwlock;               /* Held to read or write data. */
+    struct lock lock;                   /* See inode_lock(). */
     struct inode_disk data;             /* Inode content. */
   };
 
+/* Stores in PATH the indexes to follow from an inode's sectors[]
+   down to the pointer to its data sector number SECTOR_IDX, and
+   returns the number of indexes stored. */
+static int
+index_path (off_t sector_idx, off_t path[3])
+{
+  if (sector_idx < DIRECT_CNT)
+    {
+      path[0] = sector_idx;
+      return 1;
+    }
+  sector_idx -= DIRECT_CNT;
+  if (sector_idx < PTRS_PER_SECTOR * INDIRECT_CNT)
+    {
+      path[0] = DIRECT_CNT + sector_idx / PTRS_PER_SECTOR;
+      path[1] = sector_idx % PTRS_PER_SECTOR;
+      return 2;
+    }
+  sector_idx -= PTRS_PER_SECTOR * INDIRECT_CNT;
+  path[0] = (DIRECT_CNT + INDIRECT_CNT
+             + sector_idx / (PTRS_PER_SECTOR * PTRS_PER_SECTOR));
+  path[1] = sector_idx / PTRS_PER_SECTOR % PTRS_PER_SECTOR;
+  path[2] = sector_idx % PTRS_PER_SECTOR;
+  return 3;
+}
+
+/* Allocates a sector, zeroes it, and stores it in *SECTORP.  The
+   sector is the first free one at or after *GOAL, if there is
+   one, and *GOAL is advanced past it, so that sectors allocated
+   one after another end up consecutive.  If RUN is nonnull and
+   not empty, the sector is instead the first one in RUN, and
+   *GOAL is left alone.
+   Returns true if successful, false if the disk is full. */
+static bool
+allocate_sector (block_sector_t *sectorp, block_sector_t *goal,
+                 struct sector_run *run)
+{
+  if (run != NULL && run->cnt > 0)
+    {
+      *sectorp = run->start++;
+      run->cnt--;
+    }
+  else if (free_map_allocate_near (1, *goal, sectorp))
+    *goal = *sectorp + 1;
+  else
+    return false;
+  cache_write (*sectorp, zeros);
+  return true;
+}
+
+/* Returns the sector that holds byte offset POS of the file
+   described by DATA, or -1 if it has not been allocated.
+   If ALLOCATE is true, allocates the data sector and any index
+   sectors above it that are missing, returning -1 only if the
+   disk is full, and sets *DIRTY to true if DATA itself changed
+   and must be written back.  Sectors are allocated near *GOAL, as
+   described for allocate_sector(), except that a missing data
+   sector comes from RUN if RUN is nonnull and not empty. */
+static block_sector_t
+get_sector (struct inode_disk *data, off_t pos, bool allocate, bool *dirty,
+            block_sector_t *goal, struct sector_run *run)
+{
+  off_t path[3];
+  int depth = index_path (pos / BLOCK_SECTOR_SIZE, path);
+  block_sector_t sector = data->sectors[path[0]];
+  int level;
+
+  if (sector == 0)
+    {
+      if (!allocate
+          || !allocate_sector (&sector, goal, depth == 1 ? run : NULL))
+        return -1;
+      data->sectors[path[0]] = sector;
+      *dirty = true;
+    }
+  for (level = 1; level < depth; level++)
+    {
+      block_sector_t index = sector;
+      off_t ofs = path[level] * sizeof sector;
+
+      cache_read_at (index, &sector, ofs, sizeof sector);
+      if (sector == 0)
+        {
+          if (!allocate
+              || !allocate_sector (&sector, goal,
+                                   level == depth - 1 ? run : NULL))
+            return -1;
+          cache_write_meta_at (index, &sector, ofs, sizeof sector);
+        }
+    }
+  return sector;
+}
+
+/* Returns the sector that holds byte offset POS of the indexed
+   file DATA, or -1 if it has not been allocated, like
+   get_sector() without ALLOCATE, and stores in *RUN_CNT the
+   number of consecutive sectors, starting from that one, that
+   hold the file's following data.  The run ends where the
+   sector pointers stop being consecutive, at the end of the
+   block of pointers that holds POS's, or after MAP_RUN_MAX
+   sectors, whichever comes first, so that finding it costs no
+   more index reads than finding the one sector. */
+static block_sector_t
+index_to_sector (const struct inode_disk *data, off_t pos, size_t *run_cnt)
+{
+  off_t path[3];
+  int depth = index_path (pos / BLOCK_SECTOR_SIZE, path);
+  block_sector_t ptrs[MAP_RUN_MAX];
+  const block_sector_t *leaf;
+  size_t cnt, i;
+
+  *run_cnt = 1;
+  if (depth == 1)
+    {
+      leaf = &data->sectors[path[0]];
+      cnt = DIRECT_CNT - path[0];
+    }
+  else
+    {
+      block_sector_t index = data->sectors[path[0]];
+      int level;
+
+      for (level = 1; level < depth - 1 && index != 0; level++)
+        cache_read_at (index, &index, path[level] * sizeof index,
+                       sizeof index);
+      if (index == 0)
+        return -1;
+      cnt = PTRS_PER_SECTOR - path[depth - 1];
+      if (cnt > MAP_RUN_MAX)
+        cnt = MAP_RUN_MAX;
+      cache_read_at (index, ptrs, path[depth - 1] * sizeof *ptrs,
+                     cnt * sizeof *ptrs);
+      leaf = ptrs;
+    }
+  if (leaf[0] == 0)
+    return -1;
+
+  if (cnt > MAP_RUN_MAX)
+    cnt = MAP_RUN_MAX;
+  for (i = 1; i < cnt && leaf[i] == leaf[0] + i; i++)
+    continue;
+  *run_cnt = i;
+  return leaf[0];
+}
+
+/* Allocates every data sector that the indexed file DATA is
+   missing among those that hold its first LENGTH bytes, and any
+   index sectors they need, setting *DIRTY to true if DATA itself
+   changed.  The data sectors are taken from the free map in runs
+   as long as it can supply, at or after *GOAL, instead of one at
+   a time.  Index sectors and *GOAL are handled as described for
+   allocate_sector().
+   Returns true if successful, false if the disk filled up, in
+   which case some of the sectors may have been allocated. */
+static bool
+reserve_indexed (struct inode_disk *data, off_t length, bool *dirty,
+                 block_sector_t *goal)
+{
+  off_t sector_cnt = DIV_ROUND_UP (length, BLOCK_SECTOR_SIZE);
+  size_t missing = 0;
+  struct sector_run run;
+  off_t i;
+
+  for (i = 0; i < sector_cnt; i++)
+    if (get_sector (data, i * BLOCK_SECTOR_SIZE, false, NULL, NULL, NULL)
+        == (block_sector_t) -1)
+      missing++;
+
+  i = 0;
+  while (missing > 0)
+    {
+      run.cnt = missing;
+      while (!free_map_allocate_near (run.cnt, *goal, &run.start))
+        if ((run.cnt /= 2) == 0)
+          return false;
+      missing -= run.cnt;
+      *goal = run.start + run.cnt;
+
+      /* Each missing data sector in order takes the next sector
+         of the run. */
+      for (; run.cnt > 0; i++)
+        if (get_sector (data, i * BLOCK_SECTOR_SIZE, true, dirty, goal,
+                        &run) == (block_sector_t) -1)
+          {
+            free_map_release (run.start, run.cnt);
+            return false;
+          }
+    }
+  return true;
+}
+
+/* Stores extent I of DATA into *E.
+   Returns true if successful, false if extent I is unused. */
+static bool
+get_extent (const struct inode_disk *data, int i, struct extent *e)
+{
+  if (i < EXTENT_CNT)
+    *e = data->extents[i];
+  else if (i < EXTENT_MAX && data->overflow != 0)
+    cache_read_at (data->overflow, e, (i - EXTENT_CNT) * sizeof *e,
+                   sizeof *e);
+  else
+    return false;
+  return e->length != 0;
+}
+
+/* Sets extent I of DATA to E, allocating the overflow sector if
+   necessary, and sets *DIRTY to true if DATA itself changed.
+   Returns true if successful, false if I is out of range or the
+   disk is full. */
+static bool
+put_extent (struct inode_disk *data, int i, const struct extent *e,
+            bool *dirty)
+{
+  if (i < EXTENT_CNT)
+    {
+      data->extents[i] = *e;
+      *dirty = true;
+    }
+  else if (i < EXTENT_MAX)
+    {
+      if (data->overflow == 0)
+        {
+          block_sector_t goal = e->start + e->length;
+          if (!allocate_sector (&data->overflow, &goal, NULL))
+            return false;
+          *dirty = true;
+        }
+      cache_write_meta_at (data->overflow, e, (i - EXTENT_CNT) * sizeof *e,
+                           sizeof *e);
+    }
+  else
+    return false;
+  return true;
+}
+
+/* Returns the sector that holds byte offset POS of the
+   extent-based file DATA, or -1 if it is past the allocated
+   sectors, and stores in *RUN_CNT the number of consecutive
+   sectors, starting from that one, in the same extent. */
+static block_sector_t
+extent_to_sector (const struct inode_disk *data, off_t pos, size_t *run_cnt)
+{
+  uint32_t sector_idx = pos / BLOCK_SECTOR_SIZE;
+  struct extent e;
+  int i;
+
+  for (i = 0; get_extent (data, i, &e); i++)
+    {
+      if (sector_idx < e.length)
+        {
+          *run_cnt = e.length - sector_idx;
+          return e.start + sector_idx;
+        }
+      sector_idx -= e.length;
+    }
+  *run_cnt = 1;
+  return -1;
+}
+
+/* Grows the extent-based file DATA, if necessary, so that its
+   sectors hold at least LENGTH bytes.  New sectors are zeroed and
+   taken from the free map in runs as long as it can supply, each
+   run extending the last extent if it happens to follow it.  Each
+   run is looked for just past the last extent, or from GOAL if
+   there is none yet.  Sets *DIRTY to true if DATA itself changed.
+   Returns the number of bytes DATA's sectors hold, which is less
+   than LENGTH if the disk or the extent table filled up. */
+static off_t
+extend_extents (struct inode_disk *data, off_t length, bool *dirty,
+                block_sector_t goal)
+{
+  size_t want = DIV_ROUND_UP (length, BLOCK_SECTOR_SIZE);
+  size_t have = 0;
+  struct extent last, e;
+  int i;
+
+  for (i = 0; get_extent (data, i, &e); i++)
+    {
+      have += e.length;
+      last = e;
+      goal = e.start + e.length;
+    }
+  while (have < want)
+    {
+      size_t j;
+
+      e.length = want - have;
+      while (!free_map_allocate_near (e.length, goal, &e.start))
+        if ((e.length /= 2) == 0)
+          return have * BLOCK_SECTOR_SIZE;
+      for (j = 0; j < e.length; j++)
+        cache_write (e.start + j, zeros);
+      goal = e.start + e.length;
+
+      if (i > 0 && last.start + last.length == e.start)
+        {
+          last.length += e.length;
+          put_extent (data, i - 1, &last, dirty);
+        }
+      else if (put_extent (data, i, &e, dirty))
+        {
+          last = e;
+          i++;
+        }
+      else
+        {
+          free_map_release (e.start, e.length);
+          break;
+        }
+      have += e.length;
+    }
+  return have * BLOCK_SECTOR_SIZE;
+}
+
+/* Returns the layout of a new inode that holds its data in
+   sectors of its own. */
+static uint32_t
+block_layout (void)
+{
+  return inode_extents ? INODE_EXTENTS : INODE_INDEXED;
+}
+
+/* Returns the largest file DATA can describe, in bytes.  An
+   inline inode can grow as large as the layout it would become. */
+static off_t
+inode_span (const struct inode_disk *data)
+{
+  uint32_t layout = (data->layout == INODE_INLINE ? block_layout ()
+                     : data->layout);
+  return layout == INODE_EXTENTS ? EXTENT_SPAN : INODE_SPAN;
+}
+
+/* Sets the indexed INODE's allocation goal, if it has none yet,
+   so that the file is extended from just past its last sector,
+   or from its inode if it has none. */
+static void
+init_alloc_goal (struct inode *inode)
+{
+  off_t end = inode->data.length;
+  block_sector_t last = -1;
+
+  if (inode->alloc_goal != 0)
+    return;
+  if (end > 0)
+    last = get_sector (&inode->data, end - 1, false, NULL, NULL, NULL);
+  inode->alloc_goal = (last != (block_sector_t) -1 ? last
+                       : inode->sector) + 1;
+}
+
 /* Returns the block device sector that contains byte offset POS
-   within INODE.
+   within INODE, and stores in *RUN_CNT the number of consecutive
+   sectors, starting from that one, that are known to hold the
+   file's following data.  If ALLOCATE is true, allocates an
+   indexed inode's sector if it has none, setting *DIRTY to true if
+   INODE's data changed; an extent-based inode must already have
+   been extended with extend_extents().
    Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
+   POS, either because POS is past the end of the file or because
+   that part of the file has never been written.
+
+   The last run found is kept in INODE, so that a sequential
+   reader, or one that reads a sector at a time, looks at the
+   index or the extents only once per run.  A sector, once it
+   belongs to an open file, stays at the same place in it, so the
+   run never goes stale.  Readers share INODE's rwlock, so the run
+   is copied in and out with interrupts off. */
 static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
+map_sector (struct inode *inode, off_t pos, bool allocate, bool *dirty,
+            size_t *run_cnt)
 {
+  off_t sector_idx = pos / BLOCK_SECTOR_SIZE;
+  struct sector_run map;
+  enum intr_level old_level;
+  off_t map_idx;
+  block_sector_t sector;
+
   ASSERT (inode != NULL);
-  if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
-  else
+  *run_cnt = 1;
+  if ((!allocate && pos >= inode->data.length)
+      || inode->data.layout == INODE_INLINE)
     return -1;
+
+  old_level = intr_disable ();
+  map_idx = inode->map_idx;
+  map = inode->map;
+  intr_set_level (old_level);
+  if (sector_idx >= map_idx && (size_t) (sector_idx - map_idx) < map.cnt)
+    {
+      *run_cnt = map.cnt - (sector_idx - map_idx);
+      return map.start + (sector_idx - map_idx);
+    }
+
+  if (inode->data.layout == INODE_EXTENTS)
+    sector = extent_to_sector (&inode->data, pos, run_cnt);
+  else if (!allocate)
+    sector = index_to_sector (&inode->data, pos, run_cnt);
+  else
+    {
+      init_alloc_goal (inode);
+      sector = get_sector (&inode->data, pos, true, dirty,
+                           &inode->alloc_goal, NULL);
+    }
+
+  if (sector != (block_sector_t) -1)
+    {
+      old_level = intr_disable ();
+      inode->map_idx = sector_idx;
+      inode->map.start = sector;
+      inode->map.cnt = *run_cnt;
+      intr_set_level (old_level);
+    }
+  return sector;
+}
+
+/* Returns the block device sector that contains byte offset POS
+   within INODE, or -1 if INODE does not contain data for a byte
+   at offset POS. */
+static block_sector_t
+byte_to_sector (struct inode *inode, off_t pos) 
+{
+  size_t run_cnt;
+
+  return map_sector (inode, pos, false, NULL, &run_cnt);
+}
+
+/* Releases SECTOR and, if it is an index sector LEVELS above
+   the data, every sector it points to. */
+static void
+release_sector (block_sector_t sector, int levels)
+{
+  if (levels > 0)
+    {
+      off_t i;
+
+      for (i = 0; i < PTRS_PER_SECTOR; i++)
+        {
+          block_sector_t child;
+
+          cache_read_at (sector, &child, i * sizeof child, sizeof child);
+          if (child != 0)
+            release_sector (child, levels - 1);
+        }
+    }
+  free_map_release (sector, 1);
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Releases all the data, index and extent sectors of the file
+   described by DATA. */
+static void
+release_sectors (const struct inode_disk *data)
+{
+  int i;
+
+  if (data->layout == INODE_INLINE)
+    return;
+  if (data->layout == INODE_EXTENTS)
+    {
+      struct extent e;
+
+      for (i = 0; get_extent (data, i, &e); i++)
+        free_map_release (e.start, e.length);
+      if (data->overflow != 0)
+        free_map_release (data->overflow, 1);
+      return;
+    }
+
+  for (i = 0; i < SECTOR_CNT; i++)
+    if (data->sectors[i] != 0)
+      release_sector (data->sectors[i],
+                      i < DIRECT_CNT ? 0
+                      : i < DIRECT_CNT + INDIRECT_CNT ? 1 : 2);
+}
+
+/* Moves the data of inline INODE out to sectors of its own,
+   making it indexed or extent-based like a new inode, and sets
+   *DIRTY to true.  Returns true if successful, false if memory
+   or the disk is full, in which case INODE is left as it was. */
+static bool
+migrate_inline (struct inode *inode, bool *dirty)
+{
+  struct inode_disk *data = &inode->data;
+  off_t length = data->length;
+  uint8_t *copy;
+  bool success;
+
+  ASSERT (data->layout == INODE_INLINE);
+
+  copy = malloc (INLINE_SIZE);
+  if (copy == NULL)
+    return false;
+  memcpy (copy, data->inline_data, INLINE_SIZE);
+  memset (data->inline_data, 0, INLINE_SIZE);
+  data->layout = block_layout ();
+
+  if (data->layout == INODE_EXTENTS)
+    success = (extend_extents (data, length, dirty, inode->sector + 1)
+               >= length);
+  else
+    {
+      init_alloc_goal (inode);
+      success = reserve_indexed (data, length, dirty, &inode->alloc_goal);
+    }
+
+  if (success)
+    {
+      off_t pos;
+
+      for (pos = 0; pos < length; pos += BLOCK_SECTOR_SIZE)
+        {
+          off_t chunk_size = (length - pos < BLOCK_SECTOR_SIZE
+                              ? length - pos : BLOCK_SECTOR_SIZE);
+          size_t run_cnt;
+          block_sector_t sector = map_sector (inode, pos, false, NULL,
+                                              &run_cnt);
+
+          if (inode->metadata)
+            cache_write_meta_at (sector, copy + pos, 0, chunk_size);
+          else
+            cache_write_at (sector, copy + pos, 0, chunk_size);
+        }
+      *dirty = true;
+    }
+  else
+    {
+      release_sectors (data);
+      memcpy (data->inline_data, copy, INLINE_SIZE);
+      data->layout = INODE_INLINE;
+    }
+  free (copy);
+  return success;
+}
+
+static off_t read_data (struct inode *, void *, off_t size, off_t offset,
+                        bool direct);
+static void read_ahead (struct inode *, off_t offset);
+
+/* Open inodes, keyed by sector, so that opening a single inode
+   twice returns the same `struct inode'. */
+static struct ohash open_inodes;
+static ohash_match_func inode_match;
+static bool get_inode (struct inode *);
+static bool put_inode (struct inode *);
+
+/* Serializes changes to open_inodes, and closing an inode with
+   removing it from open_inodes.  inode_open() first looks for an
+   open inode without it, in an RCU read-side section, so an
+   inode is added to open_inodes only once it is ready to use,
+   and freed only after a grace period.  Open counts change only
+   in get_inode() and put_inode().
+
+   The table frees its old slots at once when it grows, which is
+   safe because on one CPU no reader runs while a writer does, as
+   synchronize_rcu() explains.
+
+   Each open inode's data is protected by its own readers-writer
+   lock, held for reading by inode_read_at() and for writing by
+   inode_write_at(), so that readers of a file run in parallel
+   with one another and operations on different files don't wait
+   for each other at all.  The read-ahead bookkeeping (read_end,
+   ahead_end) is only a hint, so concurrent readers update it
+   without further locking. */
+static struct lock open_inodes_lock;
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  if (!ohash_init (&open_inodes))
+    PANIC ("open inode table creation failed");
+  lock_init (&open_inodes_lock);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -84,22 +744,26 @@ inode_create (block_sector_t sector, off_t length)
   disk_inode = calloc (1, sizeof *disk_inode);
   if (disk_inode != NULL)
     {
-      size_t sectors = bytes_to_sectors (length);
+      /* Sectors past the initial length are allocated only when
+         written, but the initial ones are allocated now: the free
+         map's own file can't grow while it is being written. */
+      block_sector_t goal = sector + 1;
+      bool dirty;
+
       disk_inode->length = length;
       disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
-        {
-          block_write (fs_device, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
-            }
-          success = true; 
-        } 
+      disk_inode->layout = (inode_inline && length <= INLINE_SIZE
+                            ? INODE_INLINE : block_layout ());
+      success = length <= inode_span (disk_inode);
+      if (success && disk_inode->layout == INODE_EXTENTS)
+        success = (extend_extents (disk_inode, length, &dirty, goal)
+                   >= length);
+      else if (success && disk_inode->layout == INODE_INDEXED)
+        success = reserve_indexed (disk_inode, length, &dirty, &goal);
+      if (!success)
+        release_sectors (disk_inode);
+      else
+        cache_write_meta (sector, disk_inode);
       free (disk_inode);
     }
   return success;
@@ -111,33 +775,57 @@ inode_create (block_sector_t sector, off_t length)
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
   struct inode *inode;
 
   /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  rcu_read_lock ();
+  inode = ohash_find (&open_inodes, hash_int (sector), inode_match, &sector);
+  if (inode != NULL && !get_inode (inode))
+    inode = NULL;
+  rcu_read_unlock ();
+  if (inode != NULL)
+    return inode;
+
+  /* Check again with the lock held, in case it was being closed
+     or opened. */
+  lock_acquire (&open_inodes_lock);
+  inode = ohash_find (&open_inodes, hash_int (sector), inode_match, &sector);
+  if (inode != NULL && get_inode (inode))
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
-        {
-          inode_reopen (inode);
-          return inode; 
-        }
+      lock_release (&open_inodes_lock);
+      return inode;
     }
 
   /* Allocate memory. */
   inode = malloc (sizeof *inode);
   if (inode == NULL)
-    return NULL;
+    {
+      lock_release (&open_inodes_lock);
+      return NULL;
+    }
 
   /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
   inode->sector = sector;
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
+  inode->version = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  inode->metadata = false;
+  inode->read_end = inode->ahead_end = 0;
+  inode->alloc_goal = 0;
+  inode->map_idx = 0;
+  inode->map.cnt = 0;
+  rwlock_init (&inode->rwlock);
+  lock_init (&inode->lock);
+  cache_read (inode->sector, &inode->data);
+
+  /* Make it visible to inode_open(). */
+  if (!ohash_insert (&open_inodes, hash_int (sector), inode))
+    {
+      free (inode);
+      inode = NULL;
+    }
+  lock_release (&open_inodes_lock);
   return inode;
 }
 
@@ -146,7 +834,10 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      bool open UNUSED = get_inode (inode);
+      ASSERT (open);
+    }
   return inode;
 }
 
@@ -157,30 +848,56 @@ inode_get_inumber (const struct inode *inode)
   return inode->sector;
 }
 
+/* Returns INODE's version, which changes whenever its data is
+   written, for callers that cache what they derive from it.  It
+   starts over each time the inode is opened, so such callers
+   must keep INODE open to rely on it. */
+unsigned
+inode_get_version (const struct inode *inode)
+{
+  return inode->version;
+}
+
+/* Returns true if INODE has been removed, false otherwise. */
+bool
+inode_is_removed (const struct inode *inode)
+{
+  return inode->removed;
+}
+
 /* Closes INODE and writes it to disk.
    If this was the last reference to INODE, frees its memory.
    If INODE was also a removed inode, frees its blocks. */
 void
 inode_close (struct inode *inode) 
 {
+  bool last;
+
   /* Ignore null pointer. */
   if (inode == NULL)
     return;
 
+  lock_acquire (&open_inodes_lock);
+  last = put_inode (inode);
+  if (last)
+    ohash_delete (&open_inodes, hash_int (inode->sector), inode_match,
+                  &inode->sector);
+  lock_release (&open_inodes_lock);
+
   /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
+  if (last)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
- 
       /* Deallocate blocks if removed. */
       if (inode->removed) 
         {
+          journal_begin ();
           free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          release_sectors (&inode->data);
+          journal_end ();
         }
 
+      /* Wait out lookups that found it before it was removed. */
+      synchronize_rcu ();
       free (inode); 
     }
 }
@@ -198,16 +915,54 @@ inode_remove (struct inode *inode)
    Returns the number of bytes actually read, which may be less
    than SIZE if an error occurs or end of file is reached. */
 off_t
-inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) 
+inode_read_at (struct inode *inode, void *buffer, off_t size, off_t offset) 
+{
+  return read_data (inode, buffer, size, offset, false);
+}
+
+/* Reads SIZE bytes from INODE into BUFFER, starting at position
+   OFFSET, like inode_read_at(), but reads whole sectors that are
+   not in the buffer cache directly into BUFFER, bypassing the
+   cache.  For callers that keep the data they read, such as
+   page loads, so that it is copied once instead of twice and
+   doesn't displace cached sectors.  Doesn't read ahead. */
+off_t
+inode_read_at_direct (struct inode *inode, void *buffer, off_t size,
+                      off_t offset)
+{
+  return read_data (inode, buffer, size, offset, true);
+}
+
+/* Reads SIZE bytes from INODE into BUFFER, starting at position
+   OFFSET, reading whole sectors with cache_read_direct() if
+   DIRECT is true.  Implements inode_read_at() and
+   inode_read_at_direct(). */
+static off_t
+read_data (struct inode *inode, void *buffer_, off_t size, off_t offset,
+           bool direct)
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
+  block_sector_t sector_idx = -1;
+  size_t run_cnt = 0;
 
+  rwlock_acquire_read (&inode->rwlock);
+  if (inode->data.layout == INODE_INLINE)
+    {
+      /* The data is right here. */
+      if (size > inode_length (inode) - offset)
+        size = inode_length (inode) - offset;
+      if (size > 0)
+        {
+          memcpy (buffer, inode->data.inline_data + offset, size);
+          offset += size;
+          bytes_read = size;
+        }
+      size = 0;
+    }
   while (size > 0) 
     {
-      /* Disk sector to read, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      /* Starting byte offset within sector. */
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -220,110 +975,228 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
-        }
-      else 
+      /* Disk sector to read, mapping a new run of sectors only
+         when the last one is used up. */
+      if (run_cnt == 0)
+        sector_idx = map_sector (inode, offset, false, NULL, &run_cnt);
+      if (sector_idx == (block_sector_t) -1)
+        memset (buffer + bytes_read, 0, chunk_size);
+      else if (direct && chunk_size == BLOCK_SECTOR_SIZE)
+        cache_read_direct (sector_idx, buffer + bytes_read);
+      else
+        cache_read_at (sector_idx, buffer + bytes_read, sector_ofs,
+                       chunk_size);
+
+      /* Advance. */
+      if (sector_ofs + chunk_size == BLOCK_SECTOR_SIZE)
         {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
+          sector_idx++;
+          run_cnt--;
         }
-      
-      /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
+
+  /* A read that starts where the last one ended is probably part
+     of a sequential scan, so ask for the next few sectors now. */
+  if (!direct)
+    {
+      if (bytes_read > 0 && offset - bytes_read == inode->read_end)
+        read_ahead (inode, offset);
+      else
+        inode->ahead_end = 0;
+      inode->read_end = offset;
+    }
+  rwlock_release_read (&inode->rwlock);
 
   return bytes_read;
 }
 
+/* Asks the buffer cache to bring in the READ_AHEAD_SECTORS
+   sectors of INODE that follow byte offset OFFSET, skipping any
+   already asked for. */
+static void
+read_ahead (struct inode *inode, off_t offset)
+{
+  off_t start = ROUND_UP (offset, BLOCK_SECTOR_SIZE);
+  off_t end = start + READ_AHEAD_SECTORS * BLOCK_SECTOR_SIZE;
+  off_t pos;
+
+  if (end > inode_length (inode))
+    end = inode_length (inode);
+  if (start < inode->ahead_end)
+    start = inode->ahead_end;
+  for (pos = start; pos < end; pos += BLOCK_SECTOR_SIZE)
+    {
+      block_sector_t sector = byte_to_sector (inode, pos);
+      if (sector != (block_sector_t) -1)
+        cache_read_ahead (sector);
+    }
+  if (end > inode->ahead_end)
+    inode->ahead_end = end;
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if the disk fills up or the file would grow past
+   INODE_SPAN.  A write past end of file extends the inode; any
+   gap it leaves reads as zeros and takes no disk space until it
+   is written. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
+  off_t span = inode_span (&inode->data);
+  block_sector_t sector_idx = -1;
+  size_t run_cnt = 0;
+  bool dirty = false;
 
-  if (inode->deny_write_cnt)
-    return 0;
+  journal_begin ();
+  rwlock_acquire_write (&inode->rwlock);
+  if (inode->deny_write_cnt || offset >= span)
+    size = 0;
+  else if (size > span - offset)
+    size = span - offset;
+  if (size > 0)
+    inode->version++;
+
+  /* An inline inode takes the data itself if it fits, filling
+     any gap it leaves with zeros, and otherwise moves what it
+     has out to sectors first. */
+  if (inode->data.layout == INODE_INLINE && size > 0)
+    {
+      uint8_t *data = inode->data.inline_data;
+      off_t length = inode->data.length;
+
+      if (offset + size <= INLINE_SIZE)
+        {
+          if (offset > length)
+            memset (data + length, 0, offset - length);
+          memcpy (data + offset, buffer, size);
+          bytes_written = size;
+          offset += size;
+          size = 0;
+          dirty = true;
+        }
+      else if (!migrate_inline (inode, &dirty))
+        size = 0;
+    }
+
+  /* An extent-based inode is extended all at once, so that the
+     new sectors can come from as few runs as possible. */
+  if (inode->data.layout == INODE_EXTENTS && size > 0)
+    {
+      off_t room = extend_extents (&inode->data, offset + size, &dirty,
+                                   inode->sector + 1);
+      if (size > room - offset)
+        size = room - offset;
+    }
 
   while (size > 0) 
     {
-      /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      /* Starting byte offset within sector. */
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
-      /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
+      /* Bytes left in sector, and number of bytes to actually
+         write into it. */
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-      int min_left = inode_left < sector_left ? inode_left : sector_left;
+      int chunk_size = size < sector_left ? size : sector_left;
 
-      /* Number of bytes to actually write into this sector. */
-      int chunk_size = size < min_left ? size : min_left;
-      if (chunk_size <= 0)
+      /* Sector to write, allocating it if necessary and mapping a
+         new run of sectors only when the last one is used up. */
+      if (run_cnt == 0)
+        sector_idx = map_sector (inode, offset, true, &dirty, &run_cnt);
+      if (sector_idx == (block_sector_t) -1)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
-        }
-      else 
-        {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
-        }
+      if (inode->metadata)
+        cache_write_meta_at (sector_idx, buffer + bytes_written,
+                             sector_ofs, chunk_size);
+      else
+        cache_write_at (sector_idx, buffer + bytes_written, sector_ofs,
+                        chunk_size);
 
       /* Advance. */
+      if (sector_ofs + chunk_size == BLOCK_SECTOR_SIZE)
+        {
+          sector_idx++;
+          run_cnt--;
+        }
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
+
+  if (offset > inode->data.length)
+    {
+      inode->data.length = offset;
+      dirty = true;
+    }
+  if (dirty)
+    cache_write_meta (inode->sector, &inode->data);
+  rwlock_release_write (&inode->rwlock);
+  journal_end ();
 
   return bytes_written;
 }
 
+/* Allocates disk space for the first LENGTH bytes of INODE, so
+   that writing them later needs no further allocation, without
+   changing INODE's length.  An indexed inode's missing data
+   sectors are allocated in as few runs as possible and an
+   extent-based inode is extended all at once, each with a single
+   write of the inode.
+   Returns true if successful, false if LENGTH is beyond what
+   INODE can describe or the disk filled up, in which case some
+   of the space may have been allocated. */
+bool
+inode_reserve (struct inode *inode, off_t length)
+{
+  bool dirty = false;
+  bool success;
+
+  ASSERT (length >= 0);
+
+  journal_begin ();
+  rwlock_acquire_write (&inode->rwlock);
+  if (length > inode_span (&inode->data))
+    success = false;
+  else if (inode->data.layout == INODE_INLINE && length <= INLINE_SIZE)
+    success = true;
+  else
+    {
+      success = (inode->data.layout != INODE_INLINE
+                 || migrate_inline (inode, &dirty));
+      if (success && inode->data.layout == INODE_EXTENTS)
+        success = (extend_extents (&inode->data, length, &dirty,
+                                   inode->sector + 1) >= length);
+      else if (success)
+        {
+          init_alloc_goal (inode);
+          success = reserve_indexed (&inode->data, length, &dirty,
+                                     &inode->alloc_goal);
+        }
+    }
+  if (dirty)
+    cache_write_meta (inode->sector, &inode->data);
+  rwlock_release_write (&inode->rwlock);
+  journal_end ();
+
+  return success;
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
 inode_deny_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->rwlock);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  rwlock_release_write (&inode->rwlock);
 }
 
 /* Re-enables writes to INODE.
@@ -332,9 +1205,11 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->rwlock);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  rwlock_release_write (&inode->rwlock);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -343,3 +1218,88 @@ inode_length (const struct inode *inode)
 {
   return inode->data.length;
 }
+
+/* Marks INODE's data as file system metadata, which is written
+   through the journal.  Directories and the free map do this
+   whenever they open their inodes. */
+void
+inode_mark_metadata (struct inode *inode)
+{
+  inode->metadata = true;
+}
+
+/* Returns true if open inode ITEM is the one in the sector that
+   KEY points to. */
+static bool
+inode_match (const void *item, const void *key)
+{
+  const struct inode *inode = item;
+  return inode->sector == *(const block_sector_t *) key;
+}
+
+/* Atomically sets *P to NEW if it is OLD.  Returns the previous
+   value of *P. */
+static inline int
+compare_exchange (int *p, int old, int new)
+{
+  asm volatile ("lock cmpxchgl %2, %1"
+                : "+a" (old), "+m" (*p) : "r" (new) : "memory");
+  return old;
+}
+
+/* Atomically adds N to *P and returns its previous value. */
+static inline int
+fetch_add (int *p, int n)
+{
+  asm volatile ("lock xaddl %0, %1" : "+r" (n), "+m" (*p) : : "memory");
+  return n;
+}
+
+/* Adds an opener to INODE and returns true, unless its last
+   opener has closed it already, in which case returns false.
+   The test and the increment are one compare-and-exchange, so
+   that they are atomic with respect to other openers and
+   closers without any lock, as inode_open() needs for an inode
+   it finds in an RCU read-side section. */
+static bool
+get_inode (struct inode *inode)
+{
+  int cnt = inode->open_cnt;
+
+  while (cnt > 0)
+    {
+      int old = compare_exchange (&inode->open_cnt, cnt, cnt + 1);
+      if (old == cnt)
+        return true;
+      cnt = old;
+    }
+  return false;
+}
+
+/* Drops an opener from INODE and returns true if it was the
+   last.  Atomic in the same way as get_inode(). */
+static bool
+put_inode (struct inode *inode)
+{
+  int old = fetch_add (&inode->open_cnt, -1);
+
+  ASSERT (old > 0);
+  return old == 1;
+}
+
+/* Acquires INODE's lock, which serializes operations made of
+   several reads and writes of INODE that must appear atomic to
+   one another, such as adding an entry to a directory.  It does
+   not exclude plain inode_read_at() or inode_write_at() calls. */
+void
+inode_lock (struct inode *inode)
+{
+  lock_acquire (&inode->lock);
+}
+
+/* Releases INODE's lock. */
+void
+inode_unlock (struct inode *inode)
+{
+  lock_release (&inode->lock);
+}
@@ -0,0 +1,674 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <hash.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Metadata journal.
+
+   Changes to file system metadata -- inodes, index sectors, the
+   free map, and directories -- are grouped into transactions,
+   and each transaction is written to a log before any of it is
+   written in place, so that after a crash every transaction is
+   either wholly applied or not at all.  File data is not logged,
+   but the cache writes it back before each commit ("ordered"
+   mode), so committed metadata never points to sectors that
+   don't hold what was written to them.
+
+   The log is JOURNAL_SIZE consecutive sectors allocated at
+   format time and described by the header at JOURNAL_SECTOR.  In
+   the log, a transaction is one or more descriptor sectors, each
+   followed by the sectors it lists, then a commit sector, all
+   written in one sequential pass.  Replaying the log at mount
+   redoes every transaction that has its commit sector.
+
+   The journal keeps its own copy of each sector logged since the
+   log was last emptied, and the cache never writes such a sector
+   in place; it rereads it from the journal's copy instead of the
+   disk.  When a commit leaves the log more than half full, the
+   journal writes all of its copies in place ("checkpoints") and
+   empties the log.
+
+   Operations that change metadata run between journal_begin()
+   and journal_end(), which may nest.  The operations run since
+   the last commit form one transaction, which commits once none
+   of them is still running: when it grows large, when the cache
+   flushes, and at shutdown.  Grouping many operations into each
+   commit is what makes logging cheap.
+
+   A logged sector that is freed is "revoked", by logging its
+   number, so that replay won't overwrite what the sector comes
+   to hold instead.
+
+   journal_lock protects everything here, and is held while the
+   log is written, but never while calling into the cache. */
+
+/* Identify the journal header, descriptor sectors, and commit
+   sectors. */
+#define JOURNAL_MAGIC 0x4a524e4c
+#define DESC_MAGIC 0x4a445343
+#define COMMIT_MAGIC 0x4a434d54
+
+/* Sectors in the log. */
+#define JOURNAL_SIZE 256
+
+/* Sectors listed by a descriptor. */
+#define DESC_CNT 124
+
+/* Journal header, at JOURNAL_SECTOR.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct journal_header
+  {
+    unsigned magic;                     /* JOURNAL_MAGIC. */
+    block_sector_t start;               /* First sector of the log. */
+    uint32_t size;                      /* Sectors in the log. */
+    uint32_t seq;                       /* Sequence number of the
+                                           first transaction in the
+                                           log. */
+    uint8_t unused[BLOCK_SECTOR_SIZE - 16];
+  };
+
+/* Descriptor or commit sector.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct descriptor
+  {
+    unsigned magic;                     /* DESC_MAGIC or COMMIT_MAGIC. */
+    uint32_t seq;                       /* Transaction's sequence
+                                           number. */
+    uint32_t block_cnt;                 /* Logged sectors that follow. */
+    uint32_t revoke_cnt;                /* Revoked sectors. */
+    block_sector_t sectors[DESC_CNT];   /* Home sectors of the
+                                           BLOCK_CNT that follow,
+                                           then REVOKE_CNT revoked
+                                           sectors. */
+  };
+
+/* The journal's copy of a sector. */
+struct jblock
+  {
+    struct hash_elem elem;              /* Element in jblocks. */
+    block_sector_t sector;              /* Home sector. */
+    bool in_txn;                        /* Changed by the running
+                                           transaction? */
+    bool logged;                        /* In the log? */
+    bool revoked;                       /* Freed since logged? */
+    uint8_t data[BLOCK_SECTOR_SIZE];    /* Contents. */
+  };
+
+/* A sector revoked by a transaction being replayed. */
+struct revocation
+  {
+    struct hash_elem elem;              /* Element in revocations. */
+    block_sector_t sector;              /* Revoked sector. */
+    uint32_t seq;                       /* Last transaction to
+                                           revoke it. */
+  };
+
+/* Passes over the log made by replay(). */
+enum replay_pass
+  {
+    REPLAY_SCAN,                        /* Find the committed
+                                           transactions. */
+    REPLAY_REVOKE,                      /* Collect their revocations. */
+    REPLAY_APPLY                        /* Write their sectors. */
+  };
+
+/* True once journal_open() has found a journal. */
+static bool active;
+
+static struct journal_header header;
+static uint32_t seq;                    /* Running transaction. */
+static size_t log_used;                 /* Log sectors in use. */
+
+/* Sectors the journal holds, and how many of them the running
+   transaction changed and revoked. */
+static struct hash jblocks;
+static size_t txn_block_cnt, txn_revoke_cnt;
+
+/* Running operations.  While commit_wanted is true, new ones
+   wait. */
+static int handle_cnt;
+static bool commit_wanted, committing;
+
+static struct lock journal_lock;
+static struct condition journal_cond;
+
+/* Buffer for descriptor and commit sectors. */
+static struct descriptor desc;
+
+/* Statistics. */
+static unsigned long long commit_cnt, logged_cnt, checkpoint_cnt;
+static unsigned long long overflow_cnt, replay_cnt;
+
+static hash_hash_func jblock_hash, revocation_hash;
+static hash_less_func jblock_less, revocation_less;
+static hash_action_func write_jblock, free_revocation;
+static struct jblock *find_jblock (block_sector_t);
+static size_t log_need (void);
+static void commit (void);
+static void write_txn (void);
+static void checkpoint (void);
+static void replay (void);
+static bool replay_txn (size_t *pos, uint32_t txn, enum replay_pass,
+                        struct hash *revocations);
+
+/* Initializes the journal module. */
+void
+journal_init (void)
+{
+  ASSERT (sizeof (struct journal_header) == BLOCK_SECTOR_SIZE);
+  ASSERT (sizeof (struct descriptor) == BLOCK_SECTOR_SIZE);
+
+  if (!hash_init (&jblocks, jblock_hash, jblock_less, NULL))
+    PANIC ("journal table creation failed");
+  lock_init (&journal_lock);
+  cond_init (&journal_cond);
+}
+
+/* Allocates the log on a newly formatted file system and writes
+   its header.  If the disk has no room for it, the file system
+   is left without a journal. */
+void
+journal_create (void)
+{
+  memset (&header, 0, sizeof header);
+  if (free_map_allocate (JOURNAL_SIZE, &header.start))
+    {
+      header.magic = JOURNAL_MAGIC;
+      header.size = JOURNAL_SIZE;
+      header.seq = 1;
+
+      /* Make sure replay finds no transaction in the log. */
+      memset (&desc, 0, sizeof desc);
+      block_write (fs_device, header.start, &desc);
+    }
+  block_write (fs_device, JOURNAL_SECTOR, &header);
+}
+
+/* Reads the journal header, replays the log if RECOVER is true,
+   and starts journaling.  RECOVER may be false only if the log
+   is known to be empty, as it is after journal_close().  Must be
+   called before anything reads the file system's metadata. */
+void
+journal_open (bool recover)
+{
+  block_read (fs_device, JOURNAL_SECTOR, &header);
+  if (header.magic != JOURNAL_MAGIC)
+    return;
+  if (recover)
+    replay ();
+  else
+    {
+      seq = header.seq;
+      log_used = 0;
+    }
+  active = true;
+}
+
+/* Commits the running transaction, writes everything logged in
+   place, and stops journaling. */
+void
+journal_close (void)
+{
+  if (!active)
+    return;
+  journal_commit ();
+  lock_acquire (&journal_lock);
+  checkpoint ();
+  active = false;
+  lock_release (&journal_lock);
+}
+
+/* Starts an operation that changes metadata, which joins the
+   running transaction.  Must be called before taking any lock
+   that the operation's file system calls may wait for, because
+   it waits for a commit in progress to finish, and a commit
+   waits for running operations to end. */
+void
+journal_begin (void)
+{
+  if (thread_current ()->journal_depth++ > 0)
+    return;
+
+  lock_acquire (&journal_lock);
+  while (commit_wanted)
+    cond_wait (&journal_cond, &journal_lock);
+  handle_cnt++;
+  lock_release (&journal_lock);
+}
+
+/* Ends an operation started by journal_begin().  If the running
+   transaction has grown large, commits it once no operation is
+   running any more. */
+void
+journal_end (void)
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (t->journal_depth > 0);
+  if (--t->journal_depth > 0)
+    return;
+
+  lock_acquire (&journal_lock);
+  handle_cnt--;
+  if (active && log_need () > header.size / 4)
+    commit_wanted = true;
+  if (commit_wanted && handle_cnt == 0 && !committing)
+    commit ();
+  lock_release (&journal_lock);
+}
+
+/* Commits the running transaction, waiting for running
+   operations to end first.  The caller must not be inside one. */
+void
+journal_commit (void)
+{
+  if (!active)
+    return;
+  ASSERT (thread_current ()->journal_depth == 0);
+
+  lock_acquire (&journal_lock);
+  commit_wanted = true;
+  while (handle_cnt > 0 || committing)
+    cond_wait (&journal_cond, &journal_lock);
+  commit ();
+  lock_release (&journal_lock);
+}
+
+/* Records that metadata SECTOR now holds DATA, which must be
+   BLOCK_SECTOR_SIZE bytes, in the running transaction.  Returns
+   true if the journal took the sector over, in which case the
+   caller must not write it in place; returns false if it did not
+   because there is no journal or memory ran out. */
+bool
+journal_write (block_sector_t sector, const void *data)
+{
+  struct jblock *b;
+
+  if (!active)
+    return false;
+
+  lock_acquire (&journal_lock);
+  b = find_jblock (sector);
+  if (b == NULL)
+    {
+      b = malloc (sizeof *b);
+      if (b == NULL)
+        {
+          lock_release (&journal_lock);
+          return false;
+        }
+      b->sector = sector;
+      b->in_txn = b->logged = b->revoked = false;
+      hash_insert (&jblocks, &b->elem);
+    }
+  if (b->in_txn && b->revoked)
+    txn_revoke_cnt--;
+  if (!b->in_txn || b->revoked)
+    txn_block_cnt++;
+  b->in_txn = true;
+  b->revoked = false;
+  memcpy (b->data, data, BLOCK_SECTOR_SIZE);
+  lock_release (&journal_lock);
+  return true;
+}
+
+/* If the journal holds SECTOR, copies it into DATA, which must be
+   BLOCK_SECTOR_SIZE bytes, and returns true.  Otherwise, returns
+   false, and SECTOR's contents are the ones on disk. */
+bool
+journal_read (block_sector_t sector, void *data)
+{
+  struct jblock *b;
+  bool found;
+
+  if (!active)
+    return false;
+
+  lock_acquire (&journal_lock);
+  b = find_jblock (sector);
+  found = b != NULL && !b->revoked;
+  if (found)
+    memcpy (data, b->data, BLOCK_SECTOR_SIZE);
+  lock_release (&journal_lock);
+  return found;
+}
+
+/* Revokes the CNT sectors starting at SECTOR, which are being
+   freed. */
+void
+journal_revoke (block_sector_t sector, size_t cnt)
+{
+  size_t i;
+
+  if (!active)
+    return;
+
+  lock_acquire (&journal_lock);
+  for (i = 0; i < cnt; i++)
+    {
+      struct jblock *b = find_jblock (sector + i);
+      if (b == NULL || b->revoked)
+        continue;
+
+      if (b->in_txn)
+        txn_block_cnt--;
+      if (b->logged)
+        {
+          /* Log the revocation. */
+          b->in_txn = b->revoked = true;
+          txn_revoke_cnt++;
+        }
+      else
+        {
+          /* Only the running transaction knew of it. */
+          hash_delete (&jblocks, &b->elem);
+          free (b);
+        }
+    }
+  lock_release (&journal_lock);
+}
+
+/* Prints journal statistics. */
+void
+journal_print_stats (void)
+{
+  printf ("Journal: %llu commits, %llu sectors logged, "
+          "%llu checkpoints, %llu overflows, %llu replayed\n",
+          commit_cnt, logged_cnt, checkpoint_cnt, overflow_cnt,
+          replay_cnt);
+}
+
+/* Returns the journal's copy of SECTOR, or a null pointer if it
+   has none.  Must be called with journal_lock held. */
+static struct jblock *
+find_jblock (block_sector_t sector)
+{
+  /* Lookup key.  It is static because a `struct jblock' is too
+     big for the stack; journal_lock protects it too. */
+  static struct jblock key;
+  struct hash_elem *e;
+
+  key.sector = sector;
+  e = hash_find (&jblocks, &key.elem);
+  return e != NULL ? hash_entry (e, struct jblock, elem) : NULL;
+}
+
+/* Returns the number of log sectors that committing the running
+   transaction would take. */
+static size_t
+log_need (void)
+{
+  return (DIV_ROUND_UP (txn_block_cnt + txn_revoke_cnt, DESC_CNT)
+          + txn_block_cnt + 1);
+}
+
+/* Commits the running transaction.  Must be called with
+   journal_lock held and no operation running. */
+static void
+commit (void)
+{
+  ASSERT (handle_cnt == 0);
+
+  commit_wanted = committing = true;
+
+  /* Write file data back first, without journal_lock, since the
+     cache calls into the journal. */
+  lock_release (&journal_lock);
+  cache_flush ();
+  lock_acquire (&journal_lock);
+
+  write_txn ();
+  commit_wanted = committing = false;
+  cond_broadcast (&journal_cond, &journal_lock);
+}
+
+/* Writes the running transaction to the log, checkpointing
+   afterward if the log is more than half full.  Must be called
+   with journal_lock held. */
+static void
+write_txn (void)
+{
+  static struct jblock *batch[DESC_CNT];
+  static const void *buffers[DESC_CNT + 1];
+  struct hash_iterator blocks, revokes;
+  size_t block_left = txn_block_cnt;
+  size_t revoke_left = txn_revoke_cnt;
+  block_sector_t pos;
+
+  if (block_left + revoke_left == 0)
+    return;
+  if (log_used + log_need () > header.size)
+    {
+      /* Too big to log, even though the log is never left more
+         than half full: write everything in place instead, giving
+         up atomicity for this transaction. */
+      overflow_cnt++;
+      checkpoint ();
+      return;
+    }
+
+  pos = header.start + log_used;
+  hash_first (&blocks, &jblocks);
+  hash_first (&revokes, &jblocks);
+  while (block_left + revoke_left > 0)
+    {
+      size_t n = 0;
+      size_t i;
+
+      /* List logged sectors first, then revoked ones. */
+      desc.magic = DESC_MAGIC;
+      desc.seq = seq;
+      while (n < DESC_CNT && block_left > 0)
+        {
+          struct jblock *b = hash_entry (hash_next (&blocks),
+                                         struct jblock, elem);
+          if (b->in_txn && !b->revoked)
+            {
+              batch[n] = b;
+              desc.sectors[n++] = b->sector;
+              block_left--;
+            }
+        }
+      desc.block_cnt = n;
+      while (n < DESC_CNT && revoke_left > 0)
+        {
+          struct jblock *b = hash_entry (hash_next (&revokes),
+                                         struct jblock, elem);
+          if (b->in_txn && b->revoked)
+            {
+              b->in_txn = false;
+              desc.sectors[n++] = b->sector;
+              revoke_left--;
+            }
+        }
+      desc.revoke_cnt = n - desc.block_cnt;
+
+      /* Write the descriptor and its sectors in one transfer. */
+      buffers[0] = &desc;
+      for (i = 0; i < desc.block_cnt; i++)
+        {
+          buffers[i + 1] = batch[i]->data;
+          batch[i]->in_txn = false;
+          batch[i]->logged = true;
+        }
+      block_writev (fs_device, pos, buffers, desc.block_cnt + 1);
+      pos += desc.block_cnt + 1;
+      logged_cnt += desc.block_cnt;
+    }
+
+  memset (&desc, 0, sizeof desc);
+  desc.magic = COMMIT_MAGIC;
+  desc.seq = seq++;
+  block_write (fs_device, pos++, &desc);
+
+  log_used = pos - header.start;
+  txn_block_cnt = txn_revoke_cnt = 0;
+  commit_cnt++;
+  if (log_used > header.size / 2)
+    checkpoint ();
+}
+
+/* Writes every sector the journal holds in place, drops them,
+   and empties the log.  Must be called with journal_lock held. */
+static void
+checkpoint (void)
+{
+  hash_clear (&jblocks, write_jblock);
+  txn_block_cnt = txn_revoke_cnt = 0;
+  log_used = 0;
+  header.seq = seq;
+  block_write (fs_device, JOURNAL_SECTOR, &header);
+  checkpoint_cnt++;
+}
+
+/* Redoes the committed transactions in the log, then empties
+   it. */
+static void
+replay (void)
+{
+  struct hash revocations;
+  uint32_t end, s;
+  size_t pos;
+
+  if (!hash_init (&revocations, revocation_hash, revocation_less, NULL))
+    PANIC ("journal revocation table creation failed");
+
+  /* Find the end of the committed transactions, then collect
+     their revocations, so that no sector is replayed over what
+     a later transaction freed it for. */
+  for (pos = 0, end = header.seq;
+       replay_txn (&pos, end, REPLAY_SCAN, NULL); end++)
+    continue;
+  for (pos = 0, s = header.seq; s < end; s++)
+    replay_txn (&pos, s, REPLAY_REVOKE, &revocations);
+  for (pos = 0, s = header.seq; s < end; s++)
+    replay_txn (&pos, s, REPLAY_APPLY, &revocations);
+  hash_destroy (&revocations, free_revocation);
+  replay_cnt += end - header.seq;
+
+  cache_flush ();
+  seq = header.seq = end;
+  log_used = 0;
+  block_write (fs_device, JOURNAL_SECTOR, &header);
+}
+
+/* Makes PASS over the transaction with sequence number TXN, which
+   begins at log sector *POS, advancing *POS past it.  Returns
+   false if the log holds no complete transaction TXN there, which
+   only REPLAY_SCAN checks for. */
+static bool
+replay_txn (size_t *pos, uint32_t txn, enum replay_pass pass,
+            struct hash *revocations)
+{
+  static uint8_t data[BLOCK_SECTOR_SIZE];
+
+  for (;;)
+    {
+      uint32_t i;
+
+      if (*pos >= header.size)
+        return false;
+      block_read (fs_device, header.start + (*pos)++, &desc);
+      if (desc.seq != txn)
+        return false;
+      if (desc.magic == COMMIT_MAGIC)
+        return true;
+      if (desc.magic != DESC_MAGIC
+          || desc.block_cnt + desc.revoke_cnt > DESC_CNT)
+        return false;
+
+      if (pass == REPLAY_REVOKE)
+        for (i = 0; i < desc.revoke_cnt; i++)
+          {
+            struct revocation *r = malloc (sizeof *r);
+            struct hash_elem *old;
+
+            if (r == NULL)
+              PANIC ("out of memory replaying journal");
+            r->sector = desc.sectors[desc.block_cnt + i];
+            r->seq = txn;
+            old = hash_replace (revocations, &r->elem);
+            if (old != NULL)
+              free (hash_entry (old, struct revocation, elem));
+          }
+      else if (pass == REPLAY_APPLY)
+        for (i = 0; i < desc.block_cnt; i++)
+          {
+            struct revocation key;
+            struct hash_elem *e;
+
+            key.sector = desc.sectors[i];
+            e = hash_find (revocations, &key.elem);
+            if (e == NULL
+                || hash_entry (e, struct revocation, elem)->seq < txn)
+              {
+                block_read (fs_device, header.start + *pos + i, data);
+                cache_write (desc.sectors[i], data);
+              }
+          }
+      *pos += desc.block_cnt;
+    }
+}
+
+/* Writes jblock E in place, unless it was revoked, and frees
+   it. */
+static void
+write_jblock (struct hash_elem *e, void *aux UNUSED)
+{
+  struct jblock *b = hash_entry (e, struct jblock, elem);
+
+  if (!b->revoked)
+    block_write (fs_device, b->sector, b->data);
+  free (b);
+}
+
+/* Frees revocation E. */
+static void
+free_revocation (struct hash_elem *e, void *aux UNUSED)
+{
+  free (hash_entry (e, struct revocation, elem));
+}
+
+/* Returns a hash value for jblock E. */
+static unsigned
+jblock_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct jblock *b = hash_entry (e, struct jblock, elem);
+  return hash_int (b->sector);
+}
+
+/* Returns true if jblock A precedes jblock B. */
+static bool
+jblock_less (const struct hash_elem *a_, const struct hash_elem *b_,
+             void *aux UNUSED)
+{
+  const struct jblock *a = hash_entry (a_, struct jblock, elem);
+  const struct jblock *b = hash_entry (b_, struct jblock, elem);
+  return a->sector < b->sector;
+}
+
+/* Returns a hash value for revocation E. */
+static unsigned
+revocation_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct revocation *r = hash_entry (e, struct revocation, elem);
+  return hash_int (r->sector);
+}
+
+/* Returns true if revocation A precedes revocation B. */
+static bool
+revocation_less (const struct hash_elem *a_, const struct hash_elem *b_,
+                 void *aux UNUSED)
+{
+  const struct revocation *a = hash_entry (a_, struct revocation, elem);
+  const struct revocation *b = hash_entry (b_, struct revocation, elem);
+  return a->sector < b->sector;
+}
@@ -0,0 +1,23 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+
+void journal_init (void);
+void journal_create (void);
+void journal_open (bool recover);
+void journal_close (void);
+
+void journal_begin (void);
+void journal_end (void);
+void journal_commit (void);
+
+bool journal_write (block_sector_t, const void *data);
+bool journal_read (block_sector_t, void *data);
+void journal_revoke (block_sector_t, size_t cnt);
+
+void journal_print_stats (void);
+
+#endif /* filesys/journal.h */
@@ -19,66 +19,63 @@
    much less mysterious. */
 
 /* Uses x86 DIVL instruction to divide 64-bit N by 32-bit D to
-   yield a 32-bit quotient.  Returns the quotient.
+   yield a 32-bit quotient, and stores the remainder in *R.
+   Returns the quotient.
    Traps with a divide error (#DE) if the quotient does not fit
    in 32 bits. */
 static inline uint32_t
-divl (uint64_t n, uint32_t d)
+divl (uint64_t n, uint32_t d, uint32_t *r)
 {
   uint32_t n1 = n >> 32;
   uint32_t n0 = n;
-  uint32_t q, r;
+  uint32_t q;
 
   asm ("divl %4"
-       : "=d" (r), "=a" (q)
+       : "=d" (*r), "=a" (q)
        : "0" (n1), "1" (n0), "rm" (d));
 
   return q;
 }
 
-/* Returns the number of leading zero bits in X,
-   which must be nonzero. */
-static int
-nlz (uint32_t x) 
+/* Returns the number of trailing zero bits in X, which must be
+   nonzero. */
+static inline int
+ntz64 (uint64_t x)
 {
-  /* This technique is portable, but there are better ways to do
-     it on particular systems.  With sufficiently new enough GCC,
-     you can use __builtin_clz() to take advantage of GCC's
-     knowledge of how to do it.  Or you can use the x86 BSR
-     instruction directly. */
-  int n = 0;
-  if (x <= 0x0000FFFF)
-    {
-      n += 16;
-      x <<= 16; 
-    }
-  if (x <= 0x00FFFFFF)
-    {
-      n += 8;
-      x <<= 8; 
-    }
-  if (x <= 0x0FFFFFFF)
-    {
-      n += 4;
-      x <<= 4;
-    }
-  if (x <= 0x3FFFFFFF)
-    {
-      n += 2;
-      x <<= 2; 
-    }
-  if (x <= 0x7FFFFFFF)
-    n++;
-  return n;
+  uint32_t x0 = x;
+  return x0 != 0 ? __builtin_ctz (x0) : 32 + __builtin_ctz (x >> 32);
 }
 
-/* Divides unsigned 64-bit N by unsigned 64-bit D and returns the
-   quotient. */
+/* Divides unsigned 64-bit N by unsigned 64-bit D, stores the
+   remainder in *R, and returns the quotient.
+
+   Most divisors in Pintos are small constants, such as 1000 or
+   TIMER_FREQ, and most dividends are tick or cycle counts, so
+   the common cases go first: a power of 2 is a shift, and a
+   32-bit N by a 32-bit D is one 32-bit division.  A 64-bit N by
+   a 32-bit D takes one DIVL if the quotient fits in 32 bits, and
+   two otherwise. */
 static uint64_t
-udiv64 (uint64_t n, uint64_t d)
+udivmod64 (uint64_t n, uint64_t d, uint64_t *r)
 {
-  if ((d >> 32) == 0) 
+  if (d != 0 && (d & (d - 1)) == 0)
+    {
+      *r = n & (d - 1);
+      return n >> ntz64 (d);
+    }
+  else if ((d >> 32) == 0) 
     {
+      uint32_t n1 = n >> 32;
+      uint32_t n0 = n; 
+      uint32_t d0 = d;
+      uint32_t q1, q0, r0;
+
+      if (n1 == 0)
+        {
+          *r = n0 % d0;
+          return n0 / d0;
+        }
+
       /* Proof of correctness:
 
          Let n, d, b, n1, and n0 be defined as in this function.
@@ -90,7 +87,8 @@ udiv64 (uint64_t n, uint64_t d)
                    = [(b*n1 + n0)/d - dT/d] + T
                    = [(b(n1 - d[n1/d]) + n0)/d] + T
                    = [(b[n1 % d] + n0)/d] + T,             by definition of %
-         which is the expression calculated below.
+         which is the expression calculated below.  If n1 < d,
+         then T = 0 and n1 % d = n1, so one DIVL does it all.
 
          (1) Note that for any real x, integer i: [x] + i = [x + i].
 
@@ -103,35 +101,56 @@ udiv64 (uint64_t n, uint64_t d)
          which is a tautology.
 
          Therefore, this code is correct and will not trap. */
-      uint64_t b = 1ULL << 32;
-      uint32_t n1 = n >> 32;
-      uint32_t n0 = n; 
-      uint32_t d0 = d;
-
-      return divl (b * (n1 % d0) + n0, d0) + b * (n1 / d0); 
+      q1 = 0;
+      if (n1 >= d0)
+        {
+          q1 = n1 / d0;
+          n1 %= d0;
+        }
+      q0 = divl (((uint64_t) n1 << 32) | n0, d0, &r0);
+      *r = r0;
+      return ((uint64_t) q1 << 32) | q0;
     }
   else 
     {
       /* Based on the algorithm and proof available from
          http://www.hackersdelight.org/revisions.pdf. */
       if (n < d)
-        return 0;
+        {
+          *r = n;
+          return 0;
+        }
       else 
         {
           uint32_t d1 = d >> 32;
-          int s = nlz (d1);
-          uint64_t q = divl (n >> 1, (d << s) >> 32) >> (31 - s);
-          return n - (q - 1) * d < d ? q - 1 : q; 
+          int s = __builtin_clz (d1);
+          uint32_t r0;
+          uint64_t q = divl (n >> 1, (d << s) >> 32, &r0) >> (31 - s);
+          if (n - (q - 1) * d < d)
+            q--;
+          *r = n - q * d;
+          return q;
         }
     }
 }
 
+/* Divides unsigned 64-bit N by unsigned 64-bit D and returns the
+   quotient. */
+static uint64_t
+udiv64 (uint64_t n, uint64_t d)
+{
+  uint64_t r;
+  return udivmod64 (n, d, &r);
+}
+
 /* Divides unsigned 64-bit N by unsigned 64-bit D and returns the
    remainder. */
-static uint32_t
+static uint64_t
 umod64 (uint64_t n, uint64_t d)
 {
-  return n - d * udiv64 (n, d);
+  uint64_t r;
+  udivmod64 (n, d, &r);
+  return r;
 }
 
 /* Divides signed 64-bit N by signed 64-bit D and returns the
@@ -146,13 +165,16 @@ sdiv64 (int64_t n, int64_t d)
 }
 
 /* Divides signed 64-bit N by signed 64-bit D and returns the
-   remainder. */
-static int32_t
+   remainder, which has the sign of N. */
+static int64_t
 smod64 (int64_t n, int64_t d)
 {
-  return n - d * sdiv64 (n, d);
+  uint64_t n_abs = n >= 0 ? (uint64_t) n : -(uint64_t) n;
+  uint64_t d_abs = d >= 0 ? (uint64_t) d : -(uint64_t) d;
+  uint64_t r_abs = umod64 (n_abs, d_abs);
+  return n >= 0 ? (int64_t) r_abs : -(int64_t) r_abs;
 }
-
+
 /* These are the routines that GCC calls. */
 
 long long __divdi3 (long long n, long long d);
@@ -0,0 +1,9 @@
+#ifndef __LIB_FUTEX_H
+#define __LIB_FUTEX_H
+
+/* Results of the futex_wait() system call. */
+#define FUTEX_WOKEN 0           /* Woken by futex_wake(). */
+#define FUTEX_CHANGED 1         /* The word did not hold the value. */
+#define FUTEX_TIMEOUT 2         /* The timeout expired. */
+
+#endif /* lib/futex.h */
@@ -3,6 +3,7 @@
 #include <limits.h>
 #include <round.h>
 #include <stdio.h>
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
 #ifdef FILESYS
 #include "filesys/file.h"
@@ -27,6 +28,8 @@ typedef unsigned long elem_type;
 struct bitmap
   {
     size_t bit_cnt;     /* Number of bits. */
+    size_t set_cnt;     /* Number of bits set to true. */
+    size_t hint;        /* Where bitmap_scan_and_flip_next() starts. */
     elem_type *bits;    /* Elements that represent bits. */
   };
 
@@ -68,6 +71,67 @@ last_mask (const struct bitmap *b)
   int last_bits = b->bit_cnt % ELEM_BITS;
   return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
+
+/* Returns the bits of element ELEM_IDX of B that are set to
+   VALUE, restricted to bits START through END - 1 of the bitmap,
+   which must overlap that element. */
+static inline elem_type
+elem_bits (const struct bitmap *b, size_t elem_idx, size_t start, size_t end,
+           bool value)
+{
+  elem_type bits = value ? b->bits[elem_idx] : ~b->bits[elem_idx];
+  if (start > elem_idx * ELEM_BITS)
+    bits &= (elem_type) -1 << (start % ELEM_BITS);
+  if (end < (elem_idx + 1) * ELEM_BITS)
+    bits &= ((elem_type) 1 << (end % ELEM_BITS)) - 1;
+  return bits;
+}
+
+/* Returns the number of bits set in X.  GCC's __builtin_popcount
+   becomes a call into libgcc, which the kernel does not link. */
+static inline size_t
+elem_popcount (elem_type x)
+{
+  x = x - ((x >> 1) & (elem_type) -1 / 3);
+  x = (x & (elem_type) -1 / 15 * 3) + ((x >> 2) & (elem_type) -1 / 15 * 3);
+  x = (x + (x >> 4)) & (elem_type) -1 / 255 * 15;
+  return (elem_type) (x * ((elem_type) -1 / 255))
+         >> (sizeof (elem_type) - 1) * CHAR_BIT;
+}
+
+/* Returns the number of bits in B between START and END,
+   exclusive, that are set to VALUE, counting a whole element at
+   a time. */
+static size_t
+count_bits (const struct bitmap *b, size_t start, size_t end, bool value)
+{
+  size_t idx, value_cnt = 0;
+
+  if (start < end)
+    for (idx = elem_idx (start); idx <= elem_idx (end - 1); idx++)
+      value_cnt += elem_popcount (elem_bits (b, idx, start, end, value));
+  return value_cnt;
+}
+
+/* Returns the index of the first bit in B between START and END,
+   exclusive, that is set to VALUE, or END if there is none.
+   Examines a whole element at a time. */
+static size_t
+find_bit (const struct bitmap *b, size_t start, size_t end, bool value)
+{
+  size_t idx, last;
+
+  if (start >= end)
+    return end;
+  last = elem_idx (end - 1);
+  for (idx = elem_idx (start); idx <= last; idx++)
+    {
+      elem_type bits = elem_bits (b, idx, start, end, value);
+      if (bits != 0)
+        return idx * ELEM_BITS + __builtin_ctzl (bits);
+    }
+  return end;
+}
 
 /* Creation and destruction. */
 
@@ -86,6 +150,8 @@ bitmap_create (size_t bit_cnt)
       if (b->bits != NULL || bit_cnt == 0)
         {
           bitmap_set_all (b, false);
+          b->set_cnt = 0;
+          b->hint = 0;
           return b;
         }
       free (b);
@@ -106,6 +172,8 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
   b->bit_cnt = bit_cnt;
   b->bits = (elem_type *) (b + 1);
   bitmap_set_all (b, false);
+  b->set_cnt = 0;
+  b->hint = 0;
   return b;
 }
 
@@ -159,11 +227,17 @@ bitmap_mark (struct bitmap *b, size_t bit_idx)
 {
   size_t idx = elem_idx (bit_idx);
   elem_type mask = bit_mask (bit_idx);
+  enum intr_level old_level;
 
-  /* This is equivalent to `b->bits[idx] |= mask' except that it
-     is guaranteed to be atomic on a uniprocessor machine.  See
-     the description of the OR instruction in [IA32-v2b]. */
-  asm ("orl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  /* Turn interrupts off so that the bit and set_cnt change
+     together. */
+  old_level = intr_disable ();
+  if ((b->bits[idx] & mask) == 0)
+    {
+      b->bits[idx] |= mask;
+      b->set_cnt++;
+    }
+  intr_set_level (old_level);
 }
 
 /* Atomically sets the bit numbered BIT_IDX in B to false. */
@@ -172,11 +246,15 @@ bitmap_reset (struct bitmap *b, size_t bit_idx)
 {
   size_t idx = elem_idx (bit_idx);
   elem_type mask = bit_mask (bit_idx);
+  enum intr_level old_level;
 
-  /* This is equivalent to `b->bits[idx] &= ~mask' except that it
-     is guaranteed to be atomic on a uniprocessor machine.  See
-     the description of the AND instruction in [IA32-v2a]. */
-  asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+  old_level = intr_disable ();
+  if ((b->bits[idx] & mask) != 0)
+    {
+      b->bits[idx] &= ~mask;
+      b->set_cnt--;
+    }
+  intr_set_level (old_level);
 }
 
 /* Atomically toggles the bit numbered IDX in B;
@@ -187,11 +265,15 @@ bitmap_flip (struct bitmap *b, size_t bit_idx)
 {
   size_t idx = elem_idx (bit_idx);
   elem_type mask = bit_mask (bit_idx);
+  enum intr_level old_level;
 
-  /* This is equivalent to `b->bits[idx] ^= mask' except that it
-     is guaranteed to be atomic on a uniprocessor machine.  See
-     the description of the XOR instruction in [IA32-v2b]. */
-  asm ("xorl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  old_level = intr_disable ();
+  b->bits[idx] ^= mask;
+  if ((b->bits[idx] & mask) != 0)
+    b->set_cnt++;
+  else
+    b->set_cnt--;
+  intr_set_level (old_level);
 }
 
 /* Returns the value of the bit numbered IDX in B. */
@@ -214,18 +296,38 @@ bitmap_set_all (struct bitmap *b, bool value)
   bitmap_set_multiple (b, 0, bitmap_size (b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Atomically sets the CNT bits starting at START in B to
+   VALUE. */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
+  size_t idx, end = start + cnt;
+  enum intr_level old_level;
   
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set (b, start + i, value);
+  if (cnt == 0)
+    return;
+
+  old_level = intr_disable ();
+  for (idx = elem_idx (start); idx <= elem_idx (end - 1); idx++)
+    {
+      /* The bits in range that need to change. */
+      elem_type mask = elem_bits (b, idx, start, end, !value);
+      if (value)
+        {
+          b->bits[idx] |= mask;
+          b->set_cnt += elem_popcount (mask);
+        }
+      else
+        {
+          b->bits[idx] &= ~mask;
+          b->set_cnt -= elem_popcount (mask);
+        }
+    }
+  intr_set_level (old_level);
 }
 
 /* Returns the number of bits in B between START and START + CNT,
@@ -233,17 +335,22 @@ bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value)
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i, value_cnt;
-
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  value_cnt = 0;
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      value_cnt++;
-  return value_cnt;
+  if (start == 0 && cnt == b->bit_cnt)
+    return bitmap_count_all (b, value);
+  return count_bits (b, start, start + cnt, value);
+}
+
+/* Returns the number of bits in B that are set to VALUE, in
+   constant time. */
+size_t
+bitmap_count_all (const struct bitmap *b, bool value)
+{
+  ASSERT (b != NULL);
+  return value ? b->set_cnt : b->bit_cnt - b->set_cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -251,16 +358,11 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      return true;
-  return false;
+  return find_bit (b, start, start + cnt, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -299,13 +401,29 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
 
-  if (cnt <= b->bit_cnt) 
+  if (cnt <= bitmap_count_all (b, value)) 
     {
       size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      size_t i = start;
+
+      /* Skip to the next bit set to VALUE, then look for a bit
+         set to !VALUE within the following CNT bits.  If there
+         is one, the group can't start before the bit after it. */
+      while (i <= last)
+        {
+          size_t j;
+
+          if (cnt > 0)
+            {
+              i = find_bit (b, i, last + 1, value);
+              if (i > last)
+                break;
+            }
+          j = find_bit (b, i, i + cnt, !value);
+          if (j == i + cnt)
+            return i;
+          i = j + 1;
+        }
     }
   return BITMAP_ERROR;
 }
@@ -325,6 +443,38 @@ bitmap_scan_and_flip (struct bitmap *b, size_t start, size_t cnt, bool value)
     bitmap_set_multiple (b, idx, cnt, !value);
   return idx;
 }
+
+/* Like bitmap_scan_and_flip(), but starts where the previous
+   call left off and wraps around to the beginning of B, so that
+   allocations don't rescan a full prefix each time (next fit).
+   Returns BITMAP_ERROR at once if fewer than CNT bits in all of
+   B are set to VALUE. */
+size_t
+bitmap_scan_and_flip_next (struct bitmap *b, size_t cnt, bool value)
+{
+  size_t idx;
+
+  ASSERT (b != NULL);
+
+  idx = bitmap_scan (b, b->hint, cnt, value);
+  if (idx == BITMAP_ERROR && b->hint > 0)
+    idx = bitmap_scan (b, 0, cnt, value);
+  if (idx != BITMAP_ERROR)
+    {
+      bitmap_set_multiple (b, idx, cnt, !value);
+      b->hint = idx + cnt < b->bit_cnt ? idx + cnt : 0;
+    }
+  return idx;
+}
+
+/* Returns the index at which bitmap_scan_and_flip_next() will
+   start its next scan of B. */
+size_t
+bitmap_hint (const struct bitmap *b)
+{
+  ASSERT (b != NULL);
+  return b->hint;
+}
 
 /* File input and output. */
 
@@ -347,6 +497,8 @@ bitmap_read (struct bitmap *b, struct file *file)
       off_t size = byte_cnt (b->bit_cnt);
       success = file_read_at (file, b->bits, size, 0) == size;
       b->bits[elem_cnt (b->bit_cnt) - 1] &= last_mask (b);
+      b->set_cnt = count_bits (b, 0, b->bit_cnt, true);
+      b->hint = 0;
     }
   return success;
 }
@@ -359,6 +511,30 @@ bitmap_write (const struct bitmap *b, struct file *file)
   off_t size = byte_cnt (b->bit_cnt);
   return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Writes the part of B that holds bits START through START + CNT
+   - 1 to FILE, where bitmap_write() would put it, so that FILE
+   stays a copy of B after changing only those bits.  Return true
+   if successful, false otherwise. */
+bool
+bitmap_write_range (const struct bitmap *b, struct file *file,
+                    size_t start, size_t cnt)
+{
+  size_t first, last;
+  off_t ofs, size;
+
+  ASSERT (b != NULL);
+  ASSERT (start <= b->bit_cnt);
+  ASSERT (cnt <= b->bit_cnt - start);
+
+  if (cnt == 0)
+    return true;
+  first = elem_idx (start);
+  last = elem_idx (start + cnt - 1);
+  ofs = first * sizeof (elem_type);
+  size = (last - first + 1) * sizeof (elem_type);
+  return file_write_at (file, b->bits + first, size, ofs) == size;
+}
 #endif /* FILESYS */
 
 /* Debugging. */
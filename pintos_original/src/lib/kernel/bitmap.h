@@ -27,6 +27,7 @@ bool bitmap_test (const struct bitmap *, size_t idx);
 void bitmap_set_all (struct bitmap *, bool);
 void bitmap_set_multiple (struct bitmap *, size_t start, size_t cnt, bool);
 size_t bitmap_count (const struct bitmap *, size_t start, size_t cnt, bool);
+size_t bitmap_count_all (const struct bitmap *, bool);
 bool bitmap_contains (const struct bitmap *, size_t start, size_t cnt, bool);
 bool bitmap_any (const struct bitmap *, size_t start, size_t cnt);
 bool bitmap_none (const struct bitmap *, size_t start, size_t cnt);
@@ -36,6 +37,8 @@ bool bitmap_all (const struct bitmap *, size_t start, size_t cnt);
 #define BITMAP_ERROR SIZE_MAX
 size_t bitmap_scan (const struct bitmap *, size_t start, size_t cnt, bool);
 size_t bitmap_scan_and_flip (struct bitmap *, size_t start, size_t cnt, bool);
+size_t bitmap_scan_and_flip_next (struct bitmap *, size_t cnt, bool);
+size_t bitmap_hint (const struct bitmap *);
 
 /* File input and output. */
 #ifdef FILESYS
@@ -43,6 +46,8 @@ struct file;
 size_t bitmap_file_size (const struct bitmap *);
 bool bitmap_read (struct bitmap *, struct file *);
 bool bitmap_write (const struct bitmap *, struct file *);
+bool bitmap_write_range (const struct bitmap *, struct file *,
+                         size_t start, size_t cnt);
 #endif
 
 /* Debugging. */
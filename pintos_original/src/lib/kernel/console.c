@@ -1,14 +1,15 @@
 #include <console.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 #include "devices/serial.h"
 #include "devices/vga.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
 
-static void vprintf_helper (char, void *);
-static void putchar_have_lock (uint8_t c);
+static void vprintf_helper (const char *, size_t, void *);
+static void putbuf_have_lock (const char *, size_t);
 
 /* The console lock.
    Both the vga and serial layers do their own locking, so it's
@@ -119,19 +120,31 @@ console_locked_by_current_thread (void)
           || lock_held_by_current_thread (&console_lock));
 }
 
+/* Output of one vprintf() call not yet written to the console.
+   Lives on the caller's stack, so it is kept small. */
+struct vprintf_buffer
+  {
+    char buf[64];               /* Characters not yet written. */
+    size_t length;              /* Number of characters in BUF. */
+    int char_cnt;               /* Characters output in all. */
+  };
+
 /* The standard vprintf() function,
    which is like printf() but uses a va_list.
    Writes its output to both vga display and serial port. */
 int
 vprintf (const char *format, va_list args) 
 {
-  int char_cnt = 0;
+  struct vprintf_buffer b;
 
+  b.length = 0;
+  b.char_cnt = 0;
   acquire_console ();
-  __vprintf (format, args, vprintf_helper, &char_cnt);
+  __vprintf_buf (format, args, vprintf_helper, &b);
+  putbuf_have_lock (b.buf, b.length);
   release_console ();
 
-  return char_cnt;
+  return b.char_cnt;
 }
 
 /* Writes string S to the console, followed by a new-line
@@ -140,9 +153,8 @@ int
 puts (const char *s) 
 {
   acquire_console ();
-  while (*s != '\0')
-    putchar_have_lock (*s++);
-  putchar_have_lock ('\n');
+  putbuf_have_lock (s, strlen (s));
+  putbuf_have_lock ("\n", 1);
   release_console ();
 
   return 0;
@@ -153,8 +165,7 @@ void
 putbuf (const char *buffer, size_t n) 
 {
   acquire_console ();
-  while (n-- > 0)
-    putchar_have_lock (*buffer++);
+  putbuf_have_lock (buffer, n);
   release_console ();
 }
 
@@ -162,30 +173,48 @@ putbuf (const char *buffer, size_t n)
 int
 putchar (int c) 
 {
+  char c_ = c;
+
   acquire_console ();
-  putchar_have_lock (c);
+  putbuf_have_lock (&c_, 1);
   release_console ();
   
   return c;
 }
 
-/* Helper function for vprintf(). */
+/* Helper function for vprintf().  Collects output in a buffer
+   and writes it out a chunk at a time, because each write to the
+   serial port and vga display disables interrupts once per call,
+   not once per character.  A run of N characters in BUF that
+   would not fit goes out directly, after what is buffered. */
 static void
-vprintf_helper (char c, void *char_cnt_) 
+vprintf_helper (const char *buf, size_t n, void *b_) 
 {
-  int *char_cnt = char_cnt_;
-  (*char_cnt)++;
-  putchar_have_lock (c);
+  struct vprintf_buffer *b = b_;
+
+  b->char_cnt += n;
+  if (n > sizeof b->buf - b->length)
+    {
+      putbuf_have_lock (b->buf, b->length);
+      b->length = 0;
+      if (n >= sizeof b->buf)
+        {
+          putbuf_have_lock (buf, n);
+          return;
+        }
+    }
+  memcpy (b->buf + b->length, buf, n);
+  b->length += n;
 }
 
-/* Writes C to the vga display and serial port.
-   The caller has already acquired the console lock if
-   appropriate. */
+/* Writes the N characters in BUFFER to the vga display and
+   serial port.  The caller has already acquired the console lock
+   if appropriate. */
 static void
-putchar_have_lock (uint8_t c) 
+putbuf_have_lock (const char *buffer, size_t n) 
 {
   ASSERT (console_locked_by_current_thread ());
-  write_cnt++;
-  serial_putc (c);
-  vga_putc (c);
+  write_cnt += n;
+  serial_write ((const uint8_t *) buffer, n);
+  vga_write (buffer, n);
 }
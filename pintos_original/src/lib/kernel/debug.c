@@ -1,5 +1,6 @@
 #include <debug.h>
 #include <console.h>
+#include <ksym.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stddef.h>
@@ -13,6 +14,8 @@
 #include "devices/serial.h"
 #include "devices/shutdown.h"
 
+static void print_frames (void *retaddr, void **frame);
+
 /* Halts the OS, printing the source file name, line number, and
    function name, plus a user-specific message. */
 void
@@ -36,6 +39,8 @@ debug_panic (const char *file, int line, const char *function,
       va_end (args);
 
       debug_backtrace ();
+      print_frames (__builtin_return_address (0),
+                    ((void **) __builtin_frame_address (0))[0]);
     }
   else if (level == 2)
     printf ("Kernel PANIC recursion at %s:%d in %s().\n",
@@ -55,7 +60,7 @@ debug_panic (const char *file, int line, const char *function,
 static void
 print_stacktrace(struct thread *t, void *aux UNUSED)
 {
-  void *retaddr = NULL, **frame = NULL;
+  void *retaddr = NULL, **frame = NULL, **f;
   const char *status = "UNKNOWN";
 
   switch (t->status) {
@@ -107,9 +112,30 @@ print_stacktrace(struct thread *t, void *aux UNUSED)
     }
 
   printf (" %p", retaddr);
-  for (; (uintptr_t) frame >= 0x1000 && frame[0] != NULL; frame = frame[0])
-    printf (" %p", frame[1]);
+  for (f = frame; (uintptr_t) f >= 0x1000 && f[0] != NULL; f = f[0])
+    printf (" %p", f[1]);
   printf (".\n");
+  print_frames (retaddr, frame);
+}
+
+/* Prints the call stack whose innermost return address is
+   RETADDR and whose next frame is FRAME, one return address per
+   line, each with the function it returns into. */
+static void
+print_frames (void *retaddr, void **frame)
+{
+  int depth = 0;
+
+  for (;;)
+    {
+      printf ("  #%d %p ", depth++, retaddr);
+      ksym_print ((uintptr_t) retaddr, true);
+      printf ("\n");
+      if ((uintptr_t) frame < 0x1000 || frame[0] == NULL)
+        break;
+      retaddr = frame[1];
+      frame = frame[0];
+    }
 }
 
 /* Prints call stack of all threads. */
@@ -18,6 +18,9 @@ static struct hash_elem *find_elem (struct hash *, struct list *,
 static void insert_elem (struct hash *, struct list *, struct hash_elem *);
 static void remove_elem (struct hash *, struct hash_elem *);
 static void rehash (struct hash *);
+static void rehash_step (struct hash *);
+static void free_old_buckets (struct hash *);
+static struct list *next_bucket (struct hash *, struct list *);
 
 /* Initializes hash table H to compute hash values using HASH and
    compare hash elements using LESS, given auxiliary data AUX. */
@@ -28,6 +31,9 @@ hash_init (struct hash *h,
   h->elem_cnt = 0;
   h->bucket_cnt = 4;
   h->buckets = malloc (sizeof *h->buckets * h->bucket_cnt);
+  h->old_buckets = NULL;
+  h->old_bucket_cnt = 0;
+  h->rehash_idx = 0;
   h->hash = hash;
   h->less = less;
   h->aux = aux;
@@ -53,22 +59,22 @@ hash_init (struct hash *h,
 void
 hash_clear (struct hash *h, hash_action_func *destructor) 
 {
+  struct list *bucket;
   size_t i;
 
-  for (i = 0; i < h->bucket_cnt; i++) 
-    {
-      struct list *bucket = &h->buckets[i];
-
-      if (destructor != NULL) 
-        while (!list_empty (bucket)) 
-          {
-            struct list_elem *list_elem = list_pop_front (bucket);
-            struct hash_elem *hash_elem = list_elem_to_hash_elem (list_elem);
-            destructor (hash_elem, h->aux);
-          }
+  if (destructor != NULL)
+    for (bucket = next_bucket (h, NULL); bucket != NULL;
+         bucket = next_bucket (h, bucket))
+      while (!list_empty (bucket)) 
+        {
+          struct list_elem *list_elem = list_pop_front (bucket);
+          struct hash_elem *hash_elem = list_elem_to_hash_elem (list_elem);
+          destructor (hash_elem, h->aux);
+        }
 
-      list_init (bucket); 
-    }    
+  for (i = 0; i < h->bucket_cnt; i++) 
+    list_init (&h->buckets[i]);
+  free_old_buckets (h);
 
   h->elem_cnt = 0;
 }
@@ -88,6 +94,7 @@ hash_destroy (struct hash *h, hash_action_func *destructor)
 {
   if (destructor != NULL)
     hash_clear (h, destructor);
+  free_old_buckets (h);
   free (h->buckets);
 }
 
@@ -162,13 +169,13 @@ hash_delete (struct hash *h, struct hash_elem *e)
 void
 hash_apply (struct hash *h, hash_action_func *action) 
 {
-  size_t i;
+  struct list *bucket;
   
   ASSERT (action != NULL);
 
-  for (i = 0; i < h->bucket_cnt; i++) 
+  for (bucket = next_bucket (h, NULL); bucket != NULL;
+       bucket = next_bucket (h, bucket))
     {
-      struct list *bucket = &h->buckets[i];
       struct list_elem *elem, *next;
 
       for (elem = list_begin (bucket); elem != list_end (bucket); elem = next) 
@@ -203,7 +210,7 @@ hash_first (struct hash_iterator *i, struct hash *h)
   ASSERT (h != NULL);
 
   i->hash = h;
-  i->bucket = i->hash->buckets;
+  i->bucket = next_bucket (h, NULL);
   i->elem = list_elem_to_hash_elem (list_head (i->bucket));
 }
 
@@ -223,7 +230,8 @@ hash_next (struct hash_iterator *i)
   i->elem = list_elem_to_hash_elem (list_next (&i->elem->list_elem));
   while (i->elem == list_elem_to_hash_elem (list_end (i->bucket)))
     {
-      if (++i->bucket >= i->hash->buckets + i->hash->bucket_cnt)
+      i->bucket = next_bucket (i->hash, i->bucket);
+      if (i->bucket == NULL)
         {
           i->elem = NULL;
           break;
@@ -261,24 +269,80 @@ hash_empty (struct hash *h)
 #define FNV_32_PRIME 16777619u
 #define FNV_32_BASIS 2166136261u
 
+/* MurmurHash3 constants and helpers, for 32-bit words. */
+#define MURMUR_C1 0xcc9e2d51u
+#define MURMUR_C2 0x1b873593u
+
+typedef uint32_t __attribute__ ((may_alias)) word_t;
+
+static inline uint32_t
+rotl32 (uint32_t x, int r)
+{
+  return (x << r) | (x >> (32 - r));
+}
+
+/* Mixes word K into hash value HASH. */
+static inline uint32_t
+murmur_mix (uint32_t hash, uint32_t k)
+{
+  k *= MURMUR_C1;
+  k = rotl32 (k, 15);
+  k *= MURMUR_C2;
+  return hash ^ k;
+}
+
+/* Final avalanche, so that every input bit affects the low bits
+   that hash tables use as an index. */
+static inline uint32_t
+murmur_finish (uint32_t hash)
+{
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6bu;
+  hash ^= hash >> 13;
+  hash *= 0xc2b2ae35u;
+  hash ^= hash >> 16;
+  return hash;
+}
+
 /* Returns a hash of the SIZE bytes in BUF. */
 unsigned
 hash_bytes (const void *buf_, size_t size)
 {
-  /* Fowler-Noll-Vo 32-bit hash, for bytes. */
+  /* MurmurHash3 (x86, 32-bit), taking a word per step.  x86
+     tolerates unaligned loads, so BUF need not be aligned. */
   const unsigned char *buf = buf_;
-  unsigned hash;
+  uint32_t hash = 0, k = 0;
+  size_t i;
 
   ASSERT (buf != NULL);
 
-  hash = FNV_32_BASIS;
-  while (size-- > 0)
-    hash = (hash * FNV_32_PRIME) ^ *buf++;
+  for (i = 0; i + 4 <= size; i += 4)
+    {
+      hash = murmur_mix (hash, *(const word_t *) (buf + i));
+      hash = rotl32 (hash, 13) * 5 + 0xe6546b64u;
+    }
+  switch (size & 3)
+    {
+    case 3:
+      k ^= buf[i + 2] << 16;
+      /* Fall through. */
+    case 2:
+      k ^= buf[i + 1] << 8;
+      /* Fall through. */
+    case 1:
+      k ^= buf[i];
+      hash = murmur_mix (hash, k);
+    }
 
-  return hash;
-} 
+  return murmur_finish (hash ^ size);
+}
 
-/* Returns a hash of string S. */
+/* Returns a hash of string S.
+
+   This is still the byte-wise Fowler-Noll-Vo hash, because the
+   directory code stores its values on disk to place entries in
+   buckets, so changing it would make existing file systems
+   unreadable. */
 unsigned
 hash_string (const char *s_) 
 {
@@ -298,15 +362,44 @@ hash_string (const char *s_)
 unsigned
 hash_int (int i) 
 {
-  return hash_bytes (&i, sizeof i);
+  return murmur_finish (i);
 }
 
-/* Returns the bucket in H that E belongs in. */
+/* Returns the bucket in H that E belongs in: its bucket in the
+   old buckets, if a rehash has not yet emptied that one, and
+   otherwise its bucket in the new ones. */
 static struct list *
 find_bucket (struct hash *h, struct hash_elem *e) 
 {
-  size_t bucket_idx = h->hash (e, h->aux) & (h->bucket_cnt - 1);
-  return &h->buckets[bucket_idx];
+  unsigned hash = h->hash (e, h->aux);
+
+  if (h->old_buckets != NULL)
+    {
+      size_t old_idx = hash & (h->old_bucket_cnt - 1);
+      if (old_idx >= h->rehash_idx)
+        return &h->old_buckets[old_idx];
+    }
+  return &h->buckets[hash & (h->bucket_cnt - 1)];
+}
+
+/* Returns the bucket in H after BUCKET in iteration order, or
+   the first if BUCKET is null, or a null pointer after the last.
+   The order is the current buckets, then the old buckets that a
+   rehash has not yet emptied. */
+static struct list *
+next_bucket (struct hash *h, struct list *bucket)
+{
+  if (bucket == NULL)
+    return h->buckets;
+  if (bucket >= h->buckets && bucket < h->buckets + h->bucket_cnt)
+    {
+      if (++bucket < h->buckets + h->bucket_cnt)
+        return bucket;
+      if (h->old_buckets == NULL || h->rehash_idx >= h->old_bucket_cnt)
+        return NULL;
+      return h->old_buckets + h->rehash_idx;
+    }
+  return ++bucket < h->old_buckets + h->old_bucket_cnt ? bucket : NULL;
 }
 
 /* Searches BUCKET in H for a hash element equal to E.  Returns
@@ -344,22 +437,32 @@ is_power_of_2 (size_t x)
 #define BEST_ELEMS_PER_BUCKET 2 /* Ideal elems/bucket. */
 #define MAX_ELEMS_PER_BUCKET  4 /* Elems/bucket > 4: increase # of buckets. */
 
-/* Changes the number of buckets in hash table H to match the
-   ideal.  This function can fail because of an out-of-memory
-   condition, but that'll just make hash accesses less efficient;
-   we can still continue. */
+/* Old buckets emptied by each insertion or deletion during a
+   rehash.  At 2, a rehash started when the table doubles or
+   halves finishes well before the next one is due. */
+#define REHASH_STEP 2
+
+/* Moves hash table H toward the ideal number of buckets.  If a
+   rehash is in progress, empties a few more old buckets into the
+   new ones.  Otherwise, if the number of buckets should change,
+   allocates the new buckets and starts a rehash.  This function
+   can fail because of an out-of-memory condition, but that'll
+   just make hash accesses less efficient; we can still
+   continue. */
 static void
 rehash (struct hash *h) 
 {
-  size_t old_bucket_cnt, new_bucket_cnt;
-  struct list *new_buckets, *old_buckets;
+  size_t new_bucket_cnt;
+  struct list *new_buckets;
   size_t i;
 
   ASSERT (h != NULL);
 
-  /* Save old bucket info for later use. */
-  old_buckets = h->buckets;
-  old_bucket_cnt = h->bucket_cnt;
+  if (h->old_buckets != NULL)
+    {
+      rehash_step (h);
+      return;
+    }
 
   /* Calculate the number of buckets to use now.
      We want one bucket for about every BEST_ELEMS_PER_BUCKET.
@@ -372,7 +475,7 @@ rehash (struct hash *h)
     new_bucket_cnt = turn_off_least_1bit (new_bucket_cnt);
 
   /* Don't do anything if the bucket count wouldn't change. */
-  if (new_bucket_cnt == old_bucket_cnt)
+  if (new_bucket_cnt == h->bucket_cnt)
     return;
 
   /* Allocate new buckets and initialize them as empty. */
@@ -387,29 +490,48 @@ rehash (struct hash *h)
   for (i = 0; i < new_bucket_cnt; i++) 
     list_init (&new_buckets[i]);
 
-  /* Install new bucket info. */
+  /* Install new bucket info, keeping the old buckets until
+     rehash_step() has emptied them. */
+  h->old_buckets = h->buckets;
+  h->old_bucket_cnt = h->bucket_cnt;
+  h->rehash_idx = 0;
   h->buckets = new_buckets;
   h->bucket_cnt = new_bucket_cnt;
+  rehash_step (h);
+}
 
-  /* Move each old element into the appropriate new bucket. */
-  for (i = 0; i < old_bucket_cnt; i++) 
+/* Moves the elements of up to REHASH_STEP old buckets in H into
+   the new buckets, and frees the old buckets once all are
+   empty. */
+static void
+rehash_step (struct hash *h)
+{
+  size_t n;
+
+  for (n = 0; n < REHASH_STEP && h->rehash_idx < h->old_bucket_cnt; n++)
     {
-      struct list *old_bucket;
-      struct list_elem *elem, *next;
+      struct list *old_bucket = &h->old_buckets[h->rehash_idx++];
 
-      old_bucket = &old_buckets[i];
-      for (elem = list_begin (old_bucket);
-           elem != list_end (old_bucket); elem = next) 
+      while (!list_empty (old_bucket))
         {
+          struct list_elem *elem = list_pop_front (old_bucket);
           struct list *new_bucket
             = find_bucket (h, list_elem_to_hash_elem (elem));
-          next = list_next (elem);
-          list_remove (elem);
           list_push_front (new_bucket, elem);
         }
     }
+  if (h->rehash_idx >= h->old_bucket_cnt)
+    free_old_buckets (h);
+}
 
-  free (old_buckets);
+/* Frees H's old buckets, if any, which must be empty. */
+static void
+free_old_buckets (struct hash *h)
+{
+  free (h->old_buckets);
+  h->old_buckets = NULL;
+  h->old_bucket_cnt = 0;
+  h->rehash_idx = 0;
 }
 
 /* Inserts E into BUCKET (in hash table H). */
@@ -18,7 +18,17 @@
    conversion from a struct hash_elem back to a structure object
    that contains it.  This is the same technique used in the
    linked list implementation.  Refer to lib/kernel/list.h for a
-   detailed explanation. */
+   detailed explanation.
+
+   When the number of elements calls for a different number of
+   buckets, the table moves its elements to the new buckets a few
+   old buckets at a time, during later insertions and deletions,
+   rather than all at once, so that no single operation takes
+   time proportional to the size of the table.
+
+   For an index that should not embed a member in the objects it
+   indexes, or where lookups must touch little memory, see
+   ohash.h. */
 
 #include <stdbool.h>
 #include <stddef.h>
@@ -61,6 +71,9 @@ struct hash
     size_t elem_cnt;            /* Number of elements in table. */
     size_t bucket_cnt;          /* Number of buckets, a power of 2. */
     struct list *buckets;       /* Array of `bucket_cnt' lists. */
+    struct list *old_buckets;   /* Buckets being rehashed, or null. */
+    size_t old_bucket_cnt;      /* Number of old buckets. */
+    size_t rehash_idx;          /* Old buckets before it are empty. */
     hash_hash_func *hash;       /* Hash function. */
     hash_less_func *less;       /* Comparison function. */
     void *aux;                  /* Auxiliary data for `hash' and `less'. */
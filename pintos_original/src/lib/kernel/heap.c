@@ -0,0 +1,164 @@
+#include "heap.h"
+#include "../debug.h"
+
+/* Pairing heap.  See heap.h for basic information.
+
+   The heap is a tree in which no element is less than its
+   parent, and each element's children form a doubly linked
+   sibling list.  Melding two trees makes the root that is not
+   less the leftmost child of the other.  Removing the root
+   melds its children in pairs from left to right, then melds
+   the pairs from right to left. */
+
+static struct heap_elem *meld (struct heap *, struct heap_elem *,
+                               struct heap_elem *);
+static struct heap_elem *merge_pairs (struct heap *, struct heap_elem *);
+
+/* Initializes H as an empty heap that orders its elements with
+   LESS, given auxiliary data AUX. */
+void
+heap_init (struct heap *h, heap_less_func *less, void *aux)
+{
+  ASSERT (h != NULL);
+  ASSERT (less != NULL);
+
+  h->root = NULL;
+  h->size = 0;
+  h->less = less;
+  h->aux = aux;
+}
+
+/* Inserts E into H. */
+void
+heap_insert (struct heap *h, struct heap_elem *e)
+{
+  ASSERT (e != NULL);
+
+  e->child = e->next = e->prev = NULL;
+  h->root = h->root != NULL ? meld (h, h->root, e) : e;
+  h->size++;
+}
+
+/* Returns the least element in H, or a null pointer if H is
+   empty. */
+struct heap_elem *
+heap_min (const struct heap *h)
+{
+  return h->root;
+}
+
+/* Removes and returns the least element in H, which must not be
+   empty. */
+struct heap_elem *
+heap_pop_min (struct heap *h)
+{
+  struct heap_elem *min = h->root;
+
+  ASSERT (min != NULL);
+
+  h->root = merge_pairs (h, min->child);
+  h->size--;
+  return min;
+}
+
+/* Removes E, which must be in H, from H. */
+void
+heap_remove (struct heap *h, struct heap_elem *e)
+{
+  struct heap_elem *sub;
+
+  if (e == h->root)
+    {
+      heap_pop_min (h);
+      return;
+    }
+
+  /* Unlink E's subtree from its siblings and parent, then meld
+     E's children back into the heap. */
+  if (e->prev->child == e)
+    e->prev->child = e->next;
+  else
+    e->prev->next = e->next;
+  if (e->next != NULL)
+    e->next->prev = e->prev;
+
+  sub = merge_pairs (h, e->child);
+  if (sub != NULL)
+    h->root = meld (h, h->root, sub);
+  h->size--;
+}
+
+/* Returns the number of elements in H. */
+size_t
+heap_size (const struct heap *h)
+{
+  return h->size;
+}
+
+/* Returns true if H is empty, false otherwise. */
+bool
+heap_empty (const struct heap *h)
+{
+  return h->root == NULL;
+}
+
+/* Melds trees A and B, whose roots have no siblings, and returns
+   the root of the result. */
+static struct heap_elem *
+meld (struct heap *h, struct heap_elem *a, struct heap_elem *b)
+{
+  if (h->less (b, a, h->aux))
+    {
+      struct heap_elem *t = a;
+      a = b;
+      b = t;
+    }
+
+  b->prev = a;
+  b->next = a->child;
+  if (a->child != NULL)
+    a->child->prev = b;
+  a->child = b;
+  a->next = a->prev = NULL;
+  return a;
+}
+
+/* Melds the sibling list that starts at FIRST into one tree and
+   returns its root, or a null pointer if FIRST is null. */
+static struct heap_elem *
+merge_pairs (struct heap *h, struct heap_elem *first)
+{
+  struct heap_elem *pairs = NULL;       /* Melded pairs, rightmost first. */
+  struct heap_elem *root;
+
+  /* Meld pairs from left to right, pushing each result onto
+     PAIRS through its NEXT member. */
+  while (first != NULL)
+    {
+      struct heap_elem *a = first;
+      struct heap_elem *b = a->next;
+
+      if (b == NULL)
+        {
+          a->next = pairs;
+          pairs = a;
+          break;
+        }
+      first = b->next;
+      a->next = a->prev = b->next = b->prev = NULL;
+      a = meld (h, a, b);
+      a->next = pairs;
+      pairs = a;
+    }
+
+  /* Meld the pairs from right to left. */
+  root = NULL;
+  while (pairs != NULL)
+    {
+      struct heap_elem *p = pairs;
+      pairs = p->next;
+      p->next = p->prev = NULL;
+      root = root != NULL ? meld (h, p, root) : p;
+    }
+  return root;
+}
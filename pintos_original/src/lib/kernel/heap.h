@@ -0,0 +1,64 @@
+#ifndef __LIB_KERNEL_HEAP_H
+#define __LIB_KERNEL_HEAP_H
+
+/* Pairing heap.
+
+   A priority queue that, like struct list, does not allocate
+   memory: each structure that can be in a heap embeds a struct
+   heap_elem member, and heap_entry() converts a pointer to that
+   member back to the structure, as list_entry() does.
+
+   heap_insert() and heap_min() take constant time, and
+   heap_pop_min() and heap_remove() take amortized O(log n) time,
+   where struct list's list_insert_ordered() takes O(n).  See
+   Fredman, Sedgewick, Sleator, and Tarjan, "The Pairing Heap: A
+   New Form of Self-Adjusting Heap", Algorithmica 1 (1986).
+
+   Elements that compare equal come out in no particular
+   order. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Heap element. */
+struct heap_elem
+  {
+    struct heap_elem *child;    /* Leftmost child. */
+    struct heap_elem *next;     /* Next sibling to the right. */
+    struct heap_elem *prev;     /* Sibling to the left, or parent
+                                   if this is the leftmost child. */
+  };
+
+/* Converts pointer to heap element HEAP_ELEM into a pointer to
+   the structure that HEAP_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the heap element. */
+#define heap_entry(HEAP_ELEM, STRUCT, MEMBER)           \
+        ((STRUCT *) ((uint8_t *) (HEAP_ELEM)            \
+                     - offsetof (STRUCT, MEMBER)))
+
+/* Compares the value of two heap elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than or equal to B. */
+typedef bool heap_less_func (const struct heap_elem *a,
+                             const struct heap_elem *b, void *aux);
+
+/* Heap. */
+struct heap
+  {
+    struct heap_elem *root;     /* Least element, or null. */
+    size_t size;                /* Number of elements. */
+    heap_less_func *less;       /* Comparison function. */
+    void *aux;                  /* Auxiliary data for LESS. */
+  };
+
+void heap_init (struct heap *, heap_less_func *, void *aux);
+void heap_insert (struct heap *, struct heap_elem *);
+struct heap_elem *heap_min (const struct heap *);
+struct heap_elem *heap_pop_min (struct heap *);
+void heap_remove (struct heap *, struct heap_elem *);
+size_t heap_size (const struct heap *);
+bool heap_empty (const struct heap *);
+
+#endif /* lib/kernel/heap.h */
@@ -0,0 +1,62 @@
+#include "ksym.h"
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/* A kernel function. */
+struct ksym
+  {
+    uintptr_t addr;             /* Start address. */
+    const char *name;           /* Name. */
+  };
+
+/* The symbol table, sorted by address, and the end of the code,
+   from the linker script.  The table is empty in the first of
+   the kernel's two links, which is never run. */
+extern const struct ksym _start_ksyms[], _end_ksyms[];
+extern const char _end_text[];
+
+/* Returns the name of the kernel function that contains ADDR and
+   stores ADDR's offset from the start of the function in *OFS,
+   or returns a null pointer if ADDR is not in the kernel's
+   code.  OFS may be null. */
+const char *
+ksym_lookup (uintptr_t addr, uintptr_t *ofs)
+{
+  const struct ksym *lo = _start_ksyms;
+  const struct ksym *hi = _end_ksyms;
+
+  if (lo == hi || addr < lo->addr || addr >= (uintptr_t) _end_text)
+    return NULL;
+
+  /* LO is the last symbol known to start at or before ADDR, and
+     HI the first known to start after it. */
+  while (hi - lo > 1)
+    {
+      const struct ksym *mid = lo + (hi - lo) / 2;
+      if (mid->addr <= addr)
+        lo = mid;
+      else
+        hi = mid;
+    }
+
+  if (ofs != NULL)
+    *ofs = addr - lo->addr;
+  return lo->name;
+}
+
+/* Prints ADDR as FUNCTION+OFFSET, or as a plain address if it is
+   not in the kernel's code.  If RETADDR is true, ADDR is a
+   return address, which belongs to the function that made the
+   call even if the call was that function's last instruction. */
+void
+ksym_print (uintptr_t addr, bool retaddr)
+{
+  uintptr_t ofs;
+  const char *name = ksym_lookup (addr - retaddr, &ofs);
+
+  if (name != NULL)
+    printf ("%s+%#"PRIxPTR, name, ofs + retaddr);
+  else
+    printf ("%#"PRIxPTR, addr);
+}
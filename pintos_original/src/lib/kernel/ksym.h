@@ -0,0 +1,21 @@
+#ifndef __LIB_KERNEL_KSYM_H
+#define __LIB_KERNEL_KSYM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Kernel symbol table.
+
+   The build links the kernel twice: once without a symbol table,
+   to learn where each function ends up, and again with a table
+   of those functions, sorted by address and generated from the
+   first link by utils/ksyms, placed after all of the code so
+   that adding it moves nothing.  With it, the kernel can name
+   the function that contains an address by itself, by binary
+   search, so that backtraces, profiles, and allocation sites are
+   readable as printed, without running utils/backtrace. */
+
+const char *ksym_lookup (uintptr_t addr, uintptr_t *ofs);
+void ksym_print (uintptr_t addr, bool retaddr);
+
+#endif /* lib/kernel/ksym.h */
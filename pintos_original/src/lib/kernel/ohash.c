@@ -0,0 +1,194 @@
+/* Open-addressing hash table.  See ohash.h for basic
+   information. */
+
+#include "ohash.h"
+#include "../debug.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* Initial number of slots. */
+#define MIN_SLOTS 16
+
+static bool resize (struct ohash *, size_t slot_cnt);
+
+/* Returns the slot where probing for HASH in H starts. */
+static inline size_t
+home (const struct ohash *h, unsigned hash)
+{
+  return hash & (h->slot_cnt - 1);
+}
+
+/* Returns the slot after slot I in H, wrapping around. */
+static inline size_t
+next (const struct ohash *h, size_t i)
+{
+  return (i + 1) & (h->slot_cnt - 1);
+}
+
+/* Initializes H as an empty table.  Returns true if successful,
+   false if memory is short. */
+bool
+ohash_init (struct ohash *h)
+{
+  h->cnt = 0;
+  h->slot_cnt = 0;
+  h->slots = NULL;
+  return resize (h, MIN_SLOTS);
+}
+
+/* Frees H's slots.  If DESTRUCTOR is non-null, it is first
+   called for each object in H, with AUX. */
+void
+ohash_destroy (struct ohash *h, ohash_action_func *destructor, void *aux)
+{
+  if (destructor != NULL)
+    ohash_apply (h, destructor, aux);
+  free (h->slots);
+  h->slots = NULL;
+  h->cnt = h->slot_cnt = 0;
+}
+
+/* Returns the index of the slot in H that holds the object with
+   hash value HASH for which MATCH is true given KEY, or the
+   index of the empty slot that ends its probe sequence. */
+static size_t
+probe (const struct ohash *h, unsigned hash,
+       ohash_match_func *match, const void *key)
+{
+  size_t i;
+
+  for (i = home (h, hash); h->slots[i].item != NULL; i = next (h, i))
+    if (h->slots[i].hash == hash && match (h->slots[i].item, key))
+      break;
+  return i;
+}
+
+/* Returns the object in H with hash value HASH for which MATCH
+   is true given KEY, or a null pointer if there is none. */
+void *
+ohash_find (const struct ohash *h, unsigned hash,
+            ohash_match_func *match, const void *key)
+{
+  return h->slots[probe (h, hash, match, key)].item;
+}
+
+/* Inserts non-null ITEM, with hash value HASH, into H.  Returns
+   true if successful, false if H was full and memory to grow it
+   was short. */
+bool
+ohash_insert (struct ohash *h, unsigned hash, void *item)
+{
+  size_t i;
+
+  ASSERT (item != NULL);
+
+  /* Keep the load factor at most 3/4, so that probe sequences
+     stay short and at least one slot is always empty. */
+  if ((h->cnt + 1) * 4 > h->slot_cnt * 3
+      && !resize (h, h->slot_cnt * 2)
+      && h->cnt + 1 >= h->slot_cnt)
+    return false;
+
+  for (i = home (h, hash); h->slots[i].item != NULL; i = next (h, i))
+    continue;
+  h->slots[i].hash = hash;
+  barrier ();
+  h->slots[i].item = item;
+  h->cnt++;
+  return true;
+}
+
+/* Removes and returns the object in H with hash value HASH for
+   which MATCH is true given KEY, or returns a null pointer if
+   there is none.
+
+   Rather than leave a tombstone, moves back each later object in
+   the same run of full slots whose probe sequence passes over
+   the freed slot, so that lookups never have to skip deleted
+   slots.  See Knuth, TAOCP vol. 3, Algorithm 6.4R. */
+void *
+ohash_delete (struct ohash *h, unsigned hash,
+              ohash_match_func *match, const void *key)
+{
+  size_t i = probe (h, hash, match, key);
+  void *item = h->slots[i].item;
+  size_t j;
+
+  if (item == NULL)
+    return NULL;
+
+  for (j = next (h, i); h->slots[j].item != NULL; j = next (h, j))
+    {
+      size_t k = home (h, h->slots[j].hash);
+
+      /* Move slot J to I unless its home K lies cyclically in
+         (I, J], in which case it is still reachable. */
+      if (i <= j ? (k <= i || k > j) : (k <= i && k > j))
+        {
+          h->slots[i] = h->slots[j];
+          i = j;
+        }
+    }
+  h->slots[i].item = NULL;
+  h->cnt--;
+  return item;
+}
+
+/* Calls ACTION for each object in H, in arbitrary order, with
+   AUX.  ACTION must not insert into or delete from H. */
+void
+ohash_apply (struct ohash *h, ohash_action_func *action, void *aux)
+{
+  size_t i;
+
+  for (i = 0; i < h->slot_cnt; i++)
+    if (h->slots[i].item != NULL)
+      action (h->slots[i].item, aux);
+}
+
+/* Returns the number of objects in H. */
+size_t
+ohash_size (const struct ohash *h)
+{
+  return h->cnt;
+}
+
+/* Moves H's objects into a new array of SLOT_CNT slots, a power
+   of 2, at least as large as the old one.  Returns true if
+   successful, false if memory is short, in which case H is
+   unchanged.
+
+   Fills in the new array before it replaces the old one, and
+   replaces the array before its size, so that a lookup that
+   runs while a writer is preempted here sees a complete array
+   and stays within it. */
+static bool
+resize (struct ohash *h, size_t slot_cnt)
+{
+  struct ohash_slot *old_slots = h->slots;
+  struct ohash_slot *new_slots;
+  size_t old_cnt = h->slot_cnt;
+  size_t i;
+
+  ASSERT (slot_cnt > 0 && (slot_cnt & (slot_cnt - 1)) == 0);
+  ASSERT (slot_cnt >= old_cnt);
+
+  new_slots = calloc (slot_cnt, sizeof *new_slots);
+  if (new_slots == NULL)
+    return false;
+
+  for (i = 0; i < old_cnt; i++)
+    if (old_slots[i].item != NULL)
+      {
+        size_t j;
+        for (j = old_slots[i].hash & (slot_cnt - 1); new_slots[j].item != NULL;
+             j = (j + 1) & (slot_cnt - 1))
+          continue;
+        new_slots[j] = old_slots[i];
+      }
+  h->slots = new_slots;
+  barrier ();
+  h->slot_cnt = slot_cnt;
+  free (old_slots);
+  return true;
+}
@@ -0,0 +1,62 @@
+#ifndef __LIB_KERNEL_OHASH_H
+#define __LIB_KERNEL_OHASH_H
+
+/* Open-addressing hash table.
+
+   Unlike struct hash, which chains elements embedded in the
+   objects it indexes, an ohash is a single array of slots, each
+   holding an object's hash value and a pointer to it, probed
+   linearly.  A slot is 8 bytes, so a lookup usually finds its
+   object among the slots in one or two cache lines, and compares
+   hash values before it dereferences any object.  Objects need
+   no embedded member, but inserting may have to allocate memory,
+   and so may fail.
+
+   The table holds at most one object per key only if the caller
+   checks with ohash_find() before ohash_insert().
+
+   Callers serialize changes to a table.  ohash_find() may run
+   while a change is half done, as in an RCU read-side section
+   that preempts a writer: it may then miss an object, but it
+   returns only an object that MATCH accepts and that is or was
+   just in the table, so the caller can look again under its
+   lock if it must be sure. */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Returns true if object ITEM has key KEY. */
+typedef bool ohash_match_func (const void *item, const void *key);
+
+/* Performs some operation on object ITEM, given auxiliary data
+   AUX. */
+typedef void ohash_action_func (void *item, void *aux);
+
+/* One slot. */
+struct ohash_slot
+  {
+    unsigned hash;              /* Hash value of ITEM. */
+    void *item;                 /* Object, or null if slot is empty. */
+  };
+
+/* Hash table. */
+struct ohash
+  {
+    size_t cnt;                 /* Number of objects. */
+    size_t slot_cnt;            /* Number of slots, a power of 2. */
+    struct ohash_slot *slots;   /* Array of SLOT_CNT slots. */
+  };
+
+bool ohash_init (struct ohash *);
+void ohash_destroy (struct ohash *, ohash_action_func *, void *aux);
+
+void *ohash_find (const struct ohash *, unsigned hash,
+                  ohash_match_func *, const void *key);
+bool ohash_insert (struct ohash *, unsigned hash, void *item);
+void *ohash_delete (struct ohash *, unsigned hash,
+                    ohash_match_func *, const void *key);
+
+void ohash_apply (struct ohash *, ohash_action_func *, void *aux);
+size_t ohash_size (const struct ohash *);
+
+#endif /* lib/kernel/ohash.h */
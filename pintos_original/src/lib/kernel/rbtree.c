@@ -0,0 +1,387 @@
+#include "rbtree.h"
+#include "../debug.h"
+
+/* Red-black tree.  See rbtree.h for basic information.
+
+   This follows [CLRS] chapter 13, with null pointers in place of
+   the sentinel leaf, so that elements need no tree-specific
+   sentinel and a tree needs no initialization beyond
+   rb_init(). */
+
+static void rotate_left (struct rbtree *, struct rb_elem *);
+static void rotate_right (struct rbtree *, struct rb_elem *);
+static void transplant (struct rbtree *, struct rb_elem *,
+                        struct rb_elem *);
+static void insert_fixup (struct rbtree *, struct rb_elem *);
+static void remove_fixup (struct rbtree *, struct rb_elem *,
+                          struct rb_elem *);
+
+/* Returns true if E is a red element, false if it is black or
+   null. */
+static inline bool
+is_red (const struct rb_elem *e)
+{
+  return e != NULL && e->red;
+}
+
+/* Returns the least element in the subtree rooted at E. */
+static inline struct rb_elem *
+subtree_min (struct rb_elem *e)
+{
+  while (e->left != NULL)
+    e = e->left;
+  return e;
+}
+
+/* Returns the greatest element in the subtree rooted at E. */
+static inline struct rb_elem *
+subtree_max (struct rb_elem *e)
+{
+  while (e->right != NULL)
+    e = e->right;
+  return e;
+}
+
+/* Initializes T as an empty tree that orders its elements with
+   LESS, given auxiliary data AUX. */
+void
+rb_init (struct rbtree *t, rb_less_func *less, void *aux)
+{
+  ASSERT (t != NULL);
+  ASSERT (less != NULL);
+
+  t->root = NULL;
+  t->size = 0;
+  t->less = less;
+  t->aux = aux;
+}
+
+/* Inserts E into T, after any elements equal to it. */
+void
+rb_insert (struct rbtree *t, struct rb_elem *e)
+{
+  struct rb_elem **link = &t->root;
+  struct rb_elem *parent = NULL;
+
+  ASSERT (e != NULL);
+
+  while (*link != NULL)
+    {
+      parent = *link;
+      link = t->less (e, parent, t->aux) ? &parent->left : &parent->right;
+    }
+
+  e->parent = parent;
+  e->left = e->right = NULL;
+  e->red = true;
+  *link = e;
+  t->size++;
+  insert_fixup (t, e);
+}
+
+/* Removes E, which must be in T, from T. */
+void
+rb_remove (struct rbtree *t, struct rb_elem *e)
+{
+  struct rb_elem *x, *x_parent;
+  bool removed_red;
+
+  ASSERT (e != NULL);
+
+  if (e->left == NULL || e->right == NULL)
+    {
+      /* E has at most one child, which takes its place. */
+      x = e->left != NULL ? e->left : e->right;
+      x_parent = e->parent;
+      removed_red = e->red;
+      transplant (t, e, x);
+    }
+  else
+    {
+      /* E's successor Y, which has no left child, takes its
+         place. */
+      struct rb_elem *y = subtree_min (e->right);
+
+      removed_red = y->red;
+      x = y->right;
+      if (y->parent == e)
+        x_parent = y;
+      else
+        {
+          x_parent = y->parent;
+          transplant (t, y, y->right);
+          y->right = e->right;
+          y->right->parent = y;
+        }
+      transplant (t, e, y);
+      y->left = e->left;
+      y->left->parent = y;
+      y->red = e->red;
+    }
+
+  if (!removed_red)
+    remove_fixup (t, x, x_parent);
+  t->size--;
+}
+
+/* Returns the first element in T equal to KEY, or a null
+   pointer if there is none.  KEY need only have the members that
+   T's comparison function examines. */
+struct rb_elem *
+rb_find (const struct rbtree *t, const struct rb_elem *key)
+{
+  struct rb_elem *e = rb_lower_bound (t, key);
+  return e != NULL && !t->less (key, e, t->aux) ? e : NULL;
+}
+
+/* Returns the first element in T that is not less than KEY, or a
+   null pointer if there is none. */
+struct rb_elem *
+rb_lower_bound (const struct rbtree *t, const struct rb_elem *key)
+{
+  struct rb_elem *e = t->root;
+  struct rb_elem *bound = NULL;
+
+  while (e != NULL)
+    if (t->less (e, key, t->aux))
+      e = e->right;
+    else
+      {
+        bound = e;
+        e = e->left;
+      }
+  return bound;
+}
+
+/* Returns the least element in T, or a null pointer if T is
+   empty. */
+struct rb_elem *
+rb_first (const struct rbtree *t)
+{
+  return t->root != NULL ? subtree_min (t->root) : NULL;
+}
+
+/* Returns the greatest element in T, or a null pointer if T is
+   empty. */
+struct rb_elem *
+rb_last (const struct rbtree *t)
+{
+  return t->root != NULL ? subtree_max (t->root) : NULL;
+}
+
+/* Returns the element after E in its tree, or a null pointer if
+   E is the last. */
+struct rb_elem *
+rb_next (const struct rb_elem *e)
+{
+  if (e->right != NULL)
+    return subtree_min (e->right);
+  while (e->parent != NULL && e == e->parent->right)
+    e = e->parent;
+  return e->parent;
+}
+
+/* Returns the element before E in its tree, or a null pointer if
+   E is the first. */
+struct rb_elem *
+rb_prev (const struct rb_elem *e)
+{
+  if (e->left != NULL)
+    return subtree_max (e->left);
+  while (e->parent != NULL && e == e->parent->left)
+    e = e->parent;
+  return e->parent;
+}
+
+/* Returns the number of elements in T. */
+size_t
+rb_size (const struct rbtree *t)
+{
+  return t->size;
+}
+
+/* Returns true if T is empty, false otherwise. */
+bool
+rb_empty (const struct rbtree *t)
+{
+  return t->root == NULL;
+}
+
+/* Makes X's right child take X's place, with X as its left
+   child. */
+static void
+rotate_left (struct rbtree *t, struct rb_elem *x)
+{
+  struct rb_elem *y = x->right;
+
+  x->right = y->left;
+  if (y->left != NULL)
+    y->left->parent = x;
+  transplant (t, x, y);
+  y->left = x;
+  x->parent = y;
+}
+
+/* Makes X's left child take X's place, with X as its right
+   child. */
+static void
+rotate_right (struct rbtree *t, struct rb_elem *x)
+{
+  struct rb_elem *y = x->left;
+
+  x->left = y->right;
+  if (y->right != NULL)
+    y->right->parent = x;
+  transplant (t, x, y);
+  y->right = x;
+  x->parent = y;
+}
+
+/* Puts V, which may be null, where U is in T's tree, as far as
+   U's parent is concerned. */
+static void
+transplant (struct rbtree *t, struct rb_elem *u, struct rb_elem *v)
+{
+  if (u->parent == NULL)
+    t->root = v;
+  else if (u == u->parent->left)
+    u->parent->left = v;
+  else
+    u->parent->right = v;
+  if (v != NULL)
+    v->parent = u->parent;
+}
+
+/* Restores the red-black properties after red element E is
+   inserted into T. */
+static void
+insert_fixup (struct rbtree *t, struct rb_elem *e)
+{
+  struct rb_elem *p;
+
+  while ((p = e->parent) != NULL && p->red)
+    {
+      /* P is red, so it is not the root, and its parent G is
+         black. */
+      struct rb_elem *g = p->parent;
+
+      if (p == g->left)
+        {
+          struct rb_elem *u = g->right;
+          if (is_red (u))
+            {
+              p->red = u->red = false;
+              g->red = true;
+              e = g;
+              continue;
+            }
+          if (e == p->right)
+            {
+              rotate_left (t, p);
+              e = p;
+              p = e->parent;
+            }
+          p->red = false;
+          g->red = true;
+          rotate_right (t, g);
+        }
+      else
+        {
+          struct rb_elem *u = g->left;
+          if (is_red (u))
+            {
+              p->red = u->red = false;
+              g->red = true;
+              e = g;
+              continue;
+            }
+          if (e == p->left)
+            {
+              rotate_right (t, p);
+              e = p;
+              p = e->parent;
+            }
+          p->red = false;
+          g->red = true;
+          rotate_left (t, g);
+        }
+    }
+  t->root->red = false;
+}
+
+/* Restores the red-black properties after a black element is
+   removed from T.  X, which may be null, took its place, under
+   X_PARENT, and carries an extra black. */
+static void
+remove_fixup (struct rbtree *t, struct rb_elem *x, struct rb_elem *x_parent)
+{
+  while (x != t->root && !is_red (x))
+    {
+      if (x == x_parent->left)
+        {
+          struct rb_elem *w = x_parent->right;
+          if (w->red)
+            {
+              w->red = false;
+              x_parent->red = true;
+              rotate_left (t, x_parent);
+              w = x_parent->right;
+            }
+          if (!is_red (w->left) && !is_red (w->right))
+            {
+              w->red = true;
+              x = x_parent;
+              x_parent = x->parent;
+            }
+          else
+            {
+              if (!is_red (w->right))
+                {
+                  w->left->red = false;
+                  w->red = true;
+                  rotate_right (t, w);
+                  w = x_parent->right;
+                }
+              w->red = x_parent->red;
+              x_parent->red = false;
+              w->right->red = false;
+              rotate_left (t, x_parent);
+              x = t->root;
+            }
+        }
+      else
+        {
+          struct rb_elem *w = x_parent->left;
+          if (w->red)
+            {
+              w->red = false;
+              x_parent->red = true;
+              rotate_right (t, x_parent);
+              w = x_parent->left;
+            }
+          if (!is_red (w->left) && !is_red (w->right))
+            {
+              w->red = true;
+              x = x_parent;
+              x_parent = x->parent;
+            }
+          else
+            {
+              if (!is_red (w->left))
+                {
+                  w->right->red = false;
+                  w->red = true;
+                  rotate_left (t, w);
+                  w = x_parent->left;
+                }
+              w->red = x_parent->red;
+              x_parent->red = false;
+              w->left->red = false;
+              rotate_right (t, x_parent);
+              x = t->root;
+            }
+        }
+    }
+  if (x != NULL)
+    x->red = false;
+}
@@ -0,0 +1,73 @@
+#ifndef __LIB_KERNEL_RBTREE_H
+#define __LIB_KERNEL_RBTREE_H
+
+/* Red-black tree.
+
+   An ordered set that, like struct list, does not allocate
+   memory: each structure that can be in a tree embeds a struct
+   rb_elem member, and rb_entry() converts a pointer to that
+   member back to the structure, as list_entry() does.
+
+   Insertion, removal, and search take O(log n) time, where
+   keeping a struct list in order with list_insert_ordered()
+   takes O(n).  Iteration with rb_first() and rb_next() visits
+   the elements in order.  Equal elements are allowed and are
+   kept in the order they were inserted.  See [CLRS] chapter 13,
+   "Red-Black Trees". */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Tree element. */
+struct rb_elem
+  {
+    struct rb_elem *parent;     /* Parent, or null at the root. */
+    struct rb_elem *left;       /* Lesser subtree, or null. */
+    struct rb_elem *right;      /* Greater or equal subtree, or null. */
+    bool red;                   /* Red, rather than black? */
+  };
+
+/* Converts pointer to tree element RB_ELEM into a pointer to the
+   structure that RB_ELEM is embedded inside.  Supply the name of
+   the outer structure STRUCT and the member name MEMBER of the
+   tree element. */
+#define rb_entry(RB_ELEM, STRUCT, MEMBER)               \
+        ((STRUCT *) ((uint8_t *) (RB_ELEM)              \
+                     - offsetof (STRUCT, MEMBER)))
+
+/* Compares the value of two tree elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than or equal to B. */
+typedef bool rb_less_func (const struct rb_elem *a,
+                           const struct rb_elem *b, void *aux);
+
+/* Red-black tree. */
+struct rbtree
+  {
+    struct rb_elem *root;       /* Root, or null if empty. */
+    size_t size;                /* Number of elements. */
+    rb_less_func *less;         /* Comparison function. */
+    void *aux;                  /* Auxiliary data for LESS. */
+  };
+
+void rb_init (struct rbtree *, rb_less_func *, void *aux);
+void rb_insert (struct rbtree *, struct rb_elem *);
+void rb_remove (struct rbtree *, struct rb_elem *);
+
+/* Search. */
+struct rb_elem *rb_find (const struct rbtree *, const struct rb_elem *key);
+struct rb_elem *rb_lower_bound (const struct rbtree *,
+                                const struct rb_elem *key);
+
+/* Traversal. */
+struct rb_elem *rb_first (const struct rbtree *);
+struct rb_elem *rb_last (const struct rbtree *);
+struct rb_elem *rb_next (const struct rb_elem *);
+struct rb_elem *rb_prev (const struct rb_elem *);
+
+/* Information. */
+size_t rb_size (const struct rbtree *);
+bool rb_empty (const struct rbtree *);
+
+#endif /* lib/kernel/rbtree.h */
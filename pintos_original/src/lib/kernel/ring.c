@@ -0,0 +1,143 @@
+#include "ring.h"
+#include <debug.h>
+#include <string.h>
+
+/* Keeps the compiler from moving memory accesses across it.  The
+   x86 does not reorder stores with stores or loads with loads,
+   so this is all that the producer and consumer need. */
+#define ring_barrier() asm volatile ("" : : : "memory")
+
+/* Initializes RING to hold up to SLOT_CNT elements of SLOT_SIZE
+   bytes each in BUF, which must have room for SLOT_CNT *
+   SLOT_SIZE bytes.  SLOT_CNT must be a power of 2. */
+void
+ring_init (struct ring *ring, void *buf, size_t slot_cnt, size_t slot_size)
+{
+  ASSERT (ring != NULL);
+  ASSERT (buf != NULL);
+  ASSERT (slot_cnt > 0 && (slot_cnt & (slot_cnt - 1)) == 0);
+  ASSERT (slot_size > 0);
+
+  ring->buf = buf;
+  ring->slot_size = slot_size;
+  ring->mask = slot_cnt - 1;
+  ring->head = ring->tail = 0;
+}
+
+/* Returns the number of elements in RING.  The answer may be out
+   of date by the time it returns, unless the caller is the
+   consumer, for whom it can only be too low, or the producer,
+   for whom it can only be too high. */
+size_t
+ring_count (const struct ring *ring)
+{
+  return ring->head - ring->tail;
+}
+
+/* Returns the number of elements that could be pushed onto RING,
+   subject to the same caveat as ring_count(). */
+size_t
+ring_space (const struct ring *ring)
+{
+  return ring->mask + 1 - ring_count (ring);
+}
+
+/* Returns true if RING has no elements, false otherwise. */
+bool
+ring_empty (const struct ring *ring)
+{
+  return ring_count (ring) == 0;
+}
+
+/* Returns true if RING has no room for more elements, false
+   otherwise. */
+bool
+ring_full (const struct ring *ring)
+{
+  return ring_space (ring) == 0;
+}
+
+/* Copies CNT elements between ELEMS and RING's slots starting at
+   index IDX, wrapping around the end of the buffer, into the
+   slots if TO_RING is true, out of them otherwise. */
+static void
+copy_slots (const struct ring *ring, size_t idx, void *elems, size_t cnt,
+            bool to_ring)
+{
+  size_t slot_cnt = ring->mask + 1;
+  size_t ofs = idx & ring->mask;
+  size_t first = cnt < slot_cnt - ofs ? cnt : slot_cnt - ofs;
+  size_t part;
+
+  for (part = 0; part < 2; part++)
+    {
+      uint8_t *slots = ring->buf + ofs * ring->slot_size;
+      size_t size = first * ring->slot_size;
+
+      if (size > 0)
+        {
+          if (to_ring)
+            memcpy (slots, elems, size);
+          else
+            memcpy (elems, slots, size);
+        }
+      elems = (uint8_t *) elems + size;
+      ofs = 0;
+      first = cnt - first;
+    }
+}
+
+/* Pushes up to CNT elements from ELEMS onto RING, as many as
+   there is room for.  Returns the number pushed.  Only the
+   producer may call this function. */
+size_t
+ring_push (struct ring *ring, const void *elems, size_t cnt)
+{
+  size_t head = ring->head;
+  size_t space = ring_space (ring);
+
+  if (cnt > space)
+    cnt = space;
+  ring_barrier ();
+  copy_slots (ring, head, (void *) elems, cnt, true);
+  ring_barrier ();
+  ring->head = head + cnt;
+  return cnt;
+}
+
+/* Copies up to CNT of the oldest elements in RING into ELEMS,
+   without removing them, and returns the number copied.  Only
+   the consumer may call this function. */
+size_t
+ring_peek (const struct ring *ring, void *elems, size_t cnt)
+{
+  size_t count = ring_count (ring);
+
+  if (cnt > count)
+    cnt = count;
+  ring_barrier ();
+  copy_slots (ring, ring->tail, elems, cnt, false);
+  return cnt;
+}
+
+/* Removes the CNT oldest elements from RING, which must hold at
+   least that many.  Only the consumer may call this function. */
+void
+ring_discard (struct ring *ring, size_t cnt)
+{
+  ASSERT (cnt <= ring_count (ring));
+
+  ring_barrier ();
+  ring->tail += cnt;
+}
+
+/* Pops up to CNT of the oldest elements from RING into ELEMS and
+   returns the number popped.  Only the consumer may call this
+   function. */
+size_t
+ring_pop (struct ring *ring, void *elems, size_t cnt)
+{
+  cnt = ring_peek (ring, elems, cnt);
+  ring_discard (ring, cnt);
+  return cnt;
+}
@@ -0,0 +1,45 @@
+#ifndef __LIB_KERNEL_RING_H
+#define __LIB_KERNEL_RING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Single-producer, single-consumer ring buffer.
+
+   A ring holds up to a power-of-two number of fixed-size
+   elements, in a buffer supplied by its owner.  One "producer"
+   may push elements while one "consumer" pops them, with no
+   locking and without disabling interrupts, so the producer can
+   be an interrupt handler and the consumer a thread, or vice
+   versa.  With more than one producer or consumer, the producers
+   (or consumers) must serialize among themselves.
+
+   Each side writes only its own index and reads the other's, and
+   moves data before publishing the index that makes it visible,
+   so neither side ever waits for the other. */
+struct ring
+  {
+    uint8_t *buf;               /* SLOT_CNT * SLOT_SIZE bytes. */
+    size_t slot_size;           /* Bytes per element. */
+    size_t mask;                /* SLOT_CNT - 1. */
+    volatile size_t head;       /* Elements ever pushed.  Producer's. */
+    volatile size_t tail;       /* Elements ever popped.  Consumer's. */
+  };
+
+void ring_init (struct ring *, void *buf, size_t slot_cnt, size_t slot_size);
+
+size_t ring_count (const struct ring *);
+size_t ring_space (const struct ring *);
+bool ring_empty (const struct ring *);
+bool ring_full (const struct ring *);
+
+/* Producer side. */
+size_t ring_push (struct ring *, const void *elems, size_t cnt);
+
+/* Consumer side. */
+size_t ring_pop (struct ring *, void *elems, size_t cnt);
+size_t ring_peek (const struct ring *, void *elems, size_t cnt);
+void ring_discard (struct ring *, size_t cnt);
+
+#endif /* lib/kernel/ring.h */
@@ -81,3 +81,76 @@ random_ulong (void)
   random_bytes (&ul, sizeof ul);
   return ul;
 }
+
+/* Fast pseudo-random number generator.
+
+   RC4 produces its output a byte at a time, through a table that
+   every caller shares.  A caller that just wants well-mixed
+   numbers quickly, to shuffle an array for a stress test or to
+   draw a lottery ticket, can instead keep its own struct prng,
+   a xoshiro128** generator: 16 bytes of state, advanced by a few
+   shifts, rotates, and xors for each 32 bits of output.  Each
+   kernel thread has one; see thread_prng().  Only code that must
+   reproduce RC4's stream, as the file system tests do through
+   tests/arc4.c, needs random_bytes().
+
+   See https://prng.di.unimi.it/ for information on xoshiro. */
+
+/* Rotates X left by K bits. */
+static inline uint32_t
+rotl (uint32_t x, int k)
+{
+  return (x << k) | (x >> (32 - k));
+}
+
+/* Returns the next output of the SplitMix32 generator with
+   state *X, for seeding. */
+static uint32_t
+splitmix32 (uint32_t *x)
+{
+  uint32_t z = *x += 0x9e3779b9;
+  z = (z ^ (z >> 16)) * 0x85ebca6b;
+  z = (z ^ (z >> 13)) * 0xc2b2ae35;
+  return z ^ (z >> 16);
+}
+
+/* Initializes P with the given SEED.  Generators with different
+   seeds produce unrelated sequences, even if the seeds differ in
+   just one bit. */
+void
+prng_init (struct prng *p, unsigned long seed)
+{
+  uint32_t x = seed;
+  int i;
+
+  for (i = 0; i < 4; i++)
+    p->s[i] = splitmix32 (&x);
+}
+
+/* Returns the next 32-bit output of P. */
+uint32_t
+prng_next (struct prng *p)
+{
+  uint32_t *s = p->s;
+  uint32_t result = rotl (s[1] * 5, 7) * 9;
+  uint32_t t = s[1] << 9;
+
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = rotl (s[3], 11);
+
+  return result;
+}
+
+/* Returns a number from P in the range 0...N (exclusive), by
+   scaling rather than by division, which is cheaper than
+   prng_next() % N and about as uniform for N much less than
+   2**32. */
+unsigned long
+prng_range (struct prng *p, unsigned long n)
+{
+  return (uint64_t) prng_next (p) * n >> 32;
+}
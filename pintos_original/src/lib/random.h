@@ -2,9 +2,21 @@
 #define __LIB_RANDOM_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 void random_init (unsigned seed);
 void random_bytes (void *, size_t);
 unsigned long random_ulong (void);
 
+/* Fast, non-cryptographic pseudo-random number generator.
+   See random.c. */
+struct prng
+  {
+    uint32_t s[4];
+  };
+
+void prng_init (struct prng *, unsigned long seed);
+uint32_t prng_next (struct prng *);
+unsigned long prng_range (struct prng *, unsigned long n);
+
 #endif /* lib/random.h */
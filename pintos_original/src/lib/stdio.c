@@ -13,7 +13,7 @@ struct vsnprintf_aux
     int max_length;     /* Max length of output string. */
   };
 
-static void vsnprintf_helper (char, void *);
+static void vsnprintf_helper (const char *, size_t, void *);
 
 /* Like vprintf(), except that output is stored into BUFFER,
    which must have space for BUF_SIZE characters.  Writes at most
@@ -32,7 +32,7 @@ vsnprintf (char *buffer, size_t buf_size, const char *format, va_list args)
   aux.max_length = buf_size > 0 ? buf_size - 1 : 0;
 
   /* Do most of the work. */
-  __vprintf (format, args, vsnprintf_helper, &aux);
+  __vprintf_buf (format, args, vsnprintf_helper, &aux);
 
   /* Add null terminator. */
   if (buf_size > 0)
@@ -43,12 +43,18 @@ vsnprintf (char *buffer, size_t buf_size, const char *format, va_list args)
 
 /* Helper function for vsnprintf(). */
 static void
-vsnprintf_helper (char ch, void *aux_)
+vsnprintf_helper (const char *buf, size_t n, void *aux_)
 {
   struct vsnprintf_aux *aux = aux_;
 
-  if (aux->length++ < aux->max_length)
-    *aux->p++ = ch;
+  if (aux->length < aux->max_length)
+    {
+      size_t room = aux->max_length - aux->length;
+      size_t copy = n < room ? n : room;
+      memcpy (aux->p, buf, copy);
+      aux->p += copy;
+    }
+  aux->length += n;
 }
 
 /* Like printf(), except that output is stored into BUFFER,
@@ -140,31 +146,87 @@ static const struct integer_base base_o = {8, "01234567", 0, 3};
 static const struct integer_base base_x = {16, "0123456789abcdef", 'x', 4};
 static const struct integer_base base_X = {16, "0123456789ABCDEF", 'X', 4};
 
+/* The decimal digits of 0 through 99, two characters each, so
+   that decimal conversion takes one division per pair of
+   digits. */
+static const char digit_pairs[201] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+/* Output function for __vprintf_buf(). */
+typedef void output_func (const char *, size_t, void *aux);
+
 static const char *parse_conversion (const char *format,
                                      struct printf_conversion *,
                                      va_list *);
 static void format_integer (uintmax_t value, bool is_signed, bool negative, 
                             const struct integer_base *,
                             const struct printf_conversion *,
-                            void (*output) (char, void *), void *aux);
-static void output_dup (char ch, size_t cnt,
-                        void (*output) (char, void *), void *aux);
+                            output_func *, void *aux);
+static void output_dup (char ch, size_t cnt, output_func *, void *aux);
 static void format_string (const char *string, int length,
                            struct printf_conversion *,
-                           void (*output) (char, void *), void *aux);
+                           output_func *, void *aux);
+
+/* Auxiliary data for vprintf_char_helper(). */
+struct vprintf_char_aux
+  {
+    void (*output) (char, void *);      /* Per-character output. */
+    void *aux;                          /* Its auxiliary data. */
+  };
+
+/* Passes each of the N characters in BUF to the per-character
+   output function in AUX_. */
+static void
+vprintf_char_helper (const char *buf, size_t n, void *aux_)
+{
+  struct vprintf_char_aux *aux = aux_;
+
+  while (n-- > 0)
+    aux->output (*buf++, aux->aux);
+}
 
+/* Formats FORMAT with ARGS, passing each character of output to
+   OUTPUT with auxiliary data AUX.  __vprintf_buf() is faster, for
+   callers that can take a run of characters at a time. */
 void
 __vprintf (const char *format, va_list args,
            void (*output) (char, void *), void *aux)
 {
-  for (; *format != '\0'; format++)
+  struct vprintf_char_aux char_aux;
+
+  char_aux.output = output;
+  char_aux.aux = aux;
+  __vprintf_buf (format, args, vprintf_char_helper, &char_aux);
+}
+
+/* Formats FORMAT with ARGS, passing output to OUTPUT with
+   auxiliary data AUX, a run of characters at a time: each run
+   of literal text, each string, each converted number, and each
+   run of padding in one call. */
+void
+__vprintf_buf (const char *format, va_list args,
+               void (*output) (const char *, size_t, void *), void *aux)
+{
+  while (*format != '\0')
     {
       struct printf_conversion c;
+      const char *literal = format;
 
       /* Literally copy non-conversions to output. */
-      if (*format != '%') 
+      while (*format != '\0' && *format != '%')
+        format++;
+      if (format > literal)
         {
-          output (*format, aux);
+          output (literal, format - literal, aux);
           continue;
         }
       format++;
@@ -172,7 +234,8 @@ __vprintf (const char *format, va_list args,
       /* %% => %. */
       if (*format == '%') 
         {
-          output ('%', aux);
+          output ("%", 1, aux);
+          format++;
           continue;
         }
 
@@ -322,13 +385,19 @@ __vprintf (const char *format, va_list args,
         case 'n':
           /* We don't support floating-point arithmetic,
              and %n can be part of a security hole. */
-          __printf ("<<no %%%c in kernel>>", output, aux, *format);
+          output ("<<no %", 6, aux);
+          output (format, 1, aux);
+          output (" in kernel>>", 12, aux);
           break;
 
         default:
-          __printf ("<<no %%%c conversion>>", output, aux, *format);
+          output ("<<no %", 6, aux);
+          output (format, *format != '\0', aux);
+          output (" conversion>>", 13, aux);
           break;
         }
+      if (*format != '\0')
+        format++;
     }
 }
 
@@ -470,14 +539,16 @@ static void
 format_integer (uintmax_t value, bool is_signed, bool negative, 
                 const struct integer_base *b,
                 const struct printf_conversion *c,
-                void (*output) (char, void *), void *aux)
+                output_func *output, void *aux)
 {
   char buf[64], *cp;            /* Buffer and current position. */
+  char *end = buf + sizeof buf; /* End of buffer. */
+  char prefix[3];               /* Sign and `0x', if any. */
+  int prefix_len;               /* Length of PREFIX. */
   int x;                        /* `x' character to use or 0 if none. */
   int sign;                     /* Sign character or 0 if none. */
   int precision;                /* Rendered precision. */
   int pad_cnt;                  /* # of pad characters to fill field width. */
-  int digit_cnt;                /* # of digits output so far. */
 
   /* Determine sign character, if any.
      An unsigned conversion will never have a sign character,
@@ -498,60 +569,115 @@ format_integer (uintmax_t value, bool is_signed, bool negative,
      nonzero value with the # flag. */
   x = (c->flags & POUND) && value ? b->x : 0;
 
-  /* Accumulate digits into buffer.
-     This algorithm produces digits in reverse order, so later we
-     will output the buffer's content in reverse. */
-  cp = buf;
-  digit_cnt = 0;
-  while (value > 0) 
+  /* Accumulate digits into buffer, from its end backward, so
+     that they come out in order. */
+  cp = end;
+  if (c->flags & GROUP)
+    {
+      int digit_cnt = 0;
+      while (value > 0) 
+        {
+          if (digit_cnt > 0 && digit_cnt % b->group == 0)
+            *--cp = ',';
+          *--cp = b->digits[value % b->base];
+          value /= b->base;
+          digit_cnt++;
+        }
+    }
+  else if (b->base == 10)
+    {
+      uint32_t v;
+
+      /* 64-bit division is a library call on a 32-bit CPU, so
+         use it only until the value fits in 32 bits. */
+      while (value > UINT32_MAX)
+        {
+          unsigned pair = value % 100;
+          value /= 100;
+          cp -= 2;
+          memcpy (cp, digit_pairs + 2 * pair, 2);
+        }
+      for (v = value; v >= 100; v /= 100)
+        {
+          cp -= 2;
+          memcpy (cp, digit_pairs + 2 * (v % 100), 2);
+        }
+      if (v >= 10)
+        {
+          cp -= 2;
+          memcpy (cp, digit_pairs + 2 * v, 2);
+        }
+      else if (v > 0)
+        *--cp = '0' + v;
+    }
+  else
     {
-      if ((c->flags & GROUP) && digit_cnt > 0 && digit_cnt % b->group == 0)
-        *cp++ = ',';
-      *cp++ = b->digits[value % b->base];
-      value /= b->base;
-      digit_cnt++;
+      /* Bases 8 and 16 are powers of 2, so shift instead of
+         dividing. */
+      int shift = b->base == 16 ? 4 : 3;
+      unsigned mask = b->base - 1;
+      for (; value > 0; value >>= shift)
+        *--cp = b->digits[value & mask];
     }
 
-  /* Append enough zeros to match precision.
+  /* Prepend enough zeros to match precision.
      If requested precision is 0, then a value of zero is
      rendered as a null string, otherwise as "0".
      If the # flag is used with base 8, the result must always
      begin with a zero. */
   precision = c->precision < 0 ? 1 : c->precision;
-  while (cp - buf < precision && cp < buf + sizeof buf - 1)
-    *cp++ = '0';
-  if ((c->flags & POUND) && b->base == 8 && (cp == buf || cp[-1] != '0'))
-    *cp++ = '0';
+  while (end - cp < precision && cp > buf + 1)
+    *--cp = '0';
+  if ((c->flags & POUND) && b->base == 8 && (cp == end || *cp != '0'))
+    *--cp = '0';
+
+  /* Gather the sign and `0x'. */
+  prefix_len = 0;
+  if (sign)
+    prefix[prefix_len++] = sign;
+  if (x) 
+    {
+      prefix[prefix_len++] = '0';
+      prefix[prefix_len++] = x;
+    }
 
   /* Calculate number of pad characters to fill field width. */
-  pad_cnt = c->width - (cp - buf) - (x ? 2 : 0) - (sign != 0);
+  pad_cnt = c->width - (end - cp) - prefix_len;
   if (pad_cnt < 0)
     pad_cnt = 0;
 
   /* Do output. */
   if ((c->flags & (MINUS | ZERO)) == 0)
     output_dup (' ', pad_cnt, output, aux);
-  if (sign)
-    output (sign, aux);
-  if (x) 
-    {
-      output ('0', aux);
-      output (x, aux); 
-    }
+  if (prefix_len > 0)
+    output (prefix, prefix_len, aux);
   if (c->flags & ZERO)
     output_dup ('0', pad_cnt, output, aux);
-  while (cp > buf)
-    output (*--cp, aux);
+  output (cp, end - cp, aux);
   if (c->flags & MINUS)
     output_dup (' ', pad_cnt, output, aux);
 }
 
 /* Writes CH to OUTPUT with auxiliary data AUX, CNT times. */
 static void
-output_dup (char ch, size_t cnt, void (*output) (char, void *), void *aux) 
+output_dup (char ch, size_t cnt, output_func *output, void *aux) 
 {
-  while (cnt-- > 0)
-    output (ch, aux);
+  static const char spaces[] = "                ";
+  static const char zeros[] = "0000000000000000";
+  const char *run = ch == ' ' ? spaces : ch == '0' ? zeros : NULL;
+
+  if (run == NULL)
+    {
+      while (cnt-- > 0)
+        output (&ch, 1, aux);
+      return;
+    }
+  while (cnt > 0)
+    {
+      size_t n = cnt < sizeof spaces - 1 ? cnt : sizeof spaces - 1;
+      output (run, n, aux);
+      cnt -= n;
+    }
 }
 
 /* Formats the LENGTH characters starting at STRING according to
@@ -560,13 +686,12 @@ output_dup (char ch, size_t cnt, void (*output) (char, void *), void *aux)
 static void
 format_string (const char *string, int length,
                struct printf_conversion *c,
-               void (*output) (char, void *), void *aux) 
+               output_func *output, void *aux) 
 {
-  int i;
   if (c->width > length && (c->flags & MINUS) == 0)
     output_dup (' ', c->width - length, output, aux);
-  for (i = 0; i < length; i++)
-    output (string[i], aux);
+  if (length > 0)
+    output (string, length, aux);
   if (c->width > length && (c->flags & MINUS) != 0)
     output_dup (' ', c->width - length, output, aux);
 }
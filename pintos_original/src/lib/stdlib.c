@@ -3,6 +3,7 @@
 #include <random.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 /* Converts a string representation of a signed decimal integer
    in S into an `int', which is returned. */
@@ -40,64 +41,66 @@ atoi (const char *s)
   return value;
 }
 
-/* Compares A and B by calling the AUX function. */
-static int
-compare_thunk (const void *a, const void *b, void *aux) 
-{
-  int (**compare) (const void *, const void *) = aux;
-  return (*compare) (a, b);
-}
+/* How to compare and swap elements while sorting or searching.
+   qsort() and bsearch() set COMPARE2, sort() and
+   binary_search() set COMPARE3, so that neither pays for an
+   extra call through a thunk to reach the other's kind of
+   comparison function. */
+struct sorter
+  {
+    int (*compare2) (const void *, const void *);
+    int (*compare3) (const void *, const void *, void *aux);
+    void *aux;                  /* Auxiliary data for COMPARE3. */
+    size_t size;                /* Element size in bytes. */
+    bool words;                 /* Swap a word at a time? */
+  };
 
-/* Sorts ARRAY, which contains CNT elements of SIZE bytes each,
-   using COMPARE.  When COMPARE is passed a pair of elements A
-   and B, respectively, it must return a strcmp()-type result,
-   i.e. less than zero if A < B, zero if A == B, greater than
-   zero if A > B.  Runs in O(n lg n) time and O(1) space in
-   CNT. */
-void
-qsort (void *array, size_t cnt, size_t size,
-       int (*compare) (const void *, const void *)) 
+/* Sorts with insertion sort below this many elements. */
+#define INSERTION_CNT 12
+
+/* Compares A and B, returning a strcmp()-type result. */
+static inline int
+do_compare (const struct sorter *s, const void *a, const void *b)
 {
-  sort (array, cnt, size, compare_thunk, &compare);
+  return (s->compare2 != NULL
+          ? s->compare2 (a, b)
+          : s->compare3 (a, b, s->aux));
 }
 
-/* Swaps elements with 1-based indexes A_IDX and B_IDX in ARRAY
-   with elements of SIZE bytes each. */
-static void
-do_swap (unsigned char *array, size_t a_idx, size_t b_idx, size_t size)
+/* Swaps the elements at A and B. */
+static inline void
+do_swap (const struct sorter *s, unsigned char *a, unsigned char *b)
 {
-  unsigned char *a = array + (a_idx - 1) * size;
-  unsigned char *b = array + (b_idx - 1) * size;
   size_t i;
 
-  for (i = 0; i < size; i++)
+  if (s->words)
     {
-      unsigned char t = a[i];
-      a[i] = b[i];
-      b[i] = t;
+      unsigned long *wa = (unsigned long *) a;
+      unsigned long *wb = (unsigned long *) b;
+      for (i = 0; i < s->size / sizeof (unsigned long); i++)
+        {
+          unsigned long t = wa[i];
+          wa[i] = wb[i];
+          wb[i] = t;
+        }
     }
+  else
+    for (i = 0; i < s->size; i++)
+      {
+        unsigned char t = a[i];
+        a[i] = b[i];
+        b[i] = t;
+      }
 }
 
-/* Compares elements with 1-based indexes A_IDX and B_IDX in
-   ARRAY with elements of SIZE bytes each, using COMPARE to
-   compare elements, passing AUX as auxiliary data, and returns a
-   strcmp()-type result. */
-static int
-do_compare (unsigned char *array, size_t a_idx, size_t b_idx, size_t size,
-            int (*compare) (const void *, const void *, void *aux),
-            void *aux) 
-{
-  return compare (array + (a_idx - 1) * size, array + (b_idx - 1) * size, aux);
-}
-
-/* "Float down" the element with 1-based index I in ARRAY of CNT
-   elements of SIZE bytes each, using COMPARE to compare
-   elements, passing AUX as auxiliary data. */
+/* "Float down" the element with 1-based index I in the heap of
+   CNT elements at ARRAY. */
 static void
-heapify (unsigned char *array, size_t i, size_t cnt, size_t size,
-         int (*compare) (const void *, const void *, void *aux),
-         void *aux) 
+heapify (const struct sorter *s, unsigned char *array, size_t i, size_t cnt)
 {
+  /* With 1-based indexes, element I is at ARRAY + (I - 1) * SIZE. */
+  unsigned char *base = array - s->size;
+
   for (;;) 
     {
       /* Set `max' to the index of the largest element among I
@@ -105,10 +108,11 @@ heapify (unsigned char *array, size_t i, size_t cnt, size_t size,
       size_t left = 2 * i;
       size_t right = 2 * i + 1;
       size_t max = i;
-      if (left <= cnt && do_compare (array, left, max, size, compare, aux) > 0)
+      if (left <= cnt
+          && do_compare (s, base + left * s->size, base + max * s->size) > 0)
         max = left;
       if (right <= cnt
-          && do_compare (array, right, max, size, compare, aux) > 0) 
+          && do_compare (s, base + right * s->size, base + max * s->size) > 0)
         max = right;
 
       /* If the maximum value is already in element I, we're
@@ -117,38 +121,199 @@ heapify (unsigned char *array, size_t i, size_t cnt, size_t size,
         break;
 
       /* Swap and continue down the heap. */
-      do_swap (array, i, max, size);
+      do_swap (s, base + i * s->size, base + max * s->size);
       i = max;
     }
 }
 
+/* Sorts the CNT elements at ARRAY with heapsort, in O(n lg n)
+   time whatever their order. */
+static void
+heap_sort (const struct sorter *s, unsigned char *array, size_t cnt)
+{
+  size_t i;
+
+  /* Build a heap. */
+  for (i = cnt / 2; i > 0; i--)
+    heapify (s, array, i, cnt);
+
+  /* Sort the heap. */
+  for (i = cnt; i > 1; i--) 
+    {
+      do_swap (s, array, array + (i - 1) * s->size);
+      heapify (s, array, 1, i - 1);
+    }
+}
+
+/* Sorts the CNT elements at ARRAY with insertion sort, which is
+   fastest for a few elements. */
+static void
+insertion_sort (const struct sorter *s, unsigned char *array, size_t cnt)
+{
+  unsigned char *end = array + cnt * s->size;
+  unsigned char *p, *q;
+
+  for (p = array + s->size; p < end; p += s->size)
+    for (q = p; q > array && do_compare (s, q - s->size, q) > 0; q -= s->size)
+      do_swap (s, q - s->size, q);
+}
+
+/* Partitions the CNT elements at ARRAY, at least 3 of them,
+   around the median of the first, middle, and last, and returns
+   the pivot's final position.  Elements before it are no greater
+   than it, and elements after it no less. */
+static unsigned char *
+partition (const struct sorter *s, unsigned char *array, size_t cnt)
+{
+  size_t size = s->size;
+  unsigned char *lo = array;
+  unsigned char *mid = array + cnt / 2 * size;
+  unsigned char *hi = array + (cnt - 1) * size;
+  unsigned char *i, *j;
+
+  /* Sort the three, so that *HI stops the scan up below, then
+     move the median to the front as the pivot. */
+  if (do_compare (s, mid, lo) < 0)
+    do_swap (s, mid, lo);
+  if (do_compare (s, hi, mid) < 0)
+    {
+      do_swap (s, hi, mid);
+      if (do_compare (s, mid, lo) < 0)
+        do_swap (s, mid, lo);
+    }
+  do_swap (s, lo, mid);
+
+  /* Both scans stop at elements equal to the pivot, so that runs
+     of equal elements split evenly. */
+  i = lo;
+  j = hi + size;
+  for (;;)
+    {
+      do
+        i += size;
+      while (do_compare (s, i, lo) < 0);
+      do
+        j -= size;
+      while (do_compare (s, j, lo) > 0);
+      if (i >= j)
+        break;
+      do_swap (s, i, j);
+    }
+  do_swap (s, lo, j);
+  return j;
+}
+
+/* Sorts the CNT elements at ARRAY with introsort: quicksort
+   while it makes progress, heapsort for any part that takes it
+   past DEPTH levels of partitioning, and insertion sort for
+   small parts.  Sorts the smaller side of each partition
+   recursively and the larger side in a loop, so that the stack
+   grows by O(lg n) frames at most. */
+static void
+intro_sort (const struct sorter *s, unsigned char *array, size_t cnt,
+            int depth)
+{
+  while (cnt > INSERTION_CNT)
+    {
+      unsigned char *pivot;
+      size_t left_cnt, right_cnt;
+
+      if (depth-- == 0)
+        {
+          heap_sort (s, array, cnt);
+          return;
+        }
+
+      pivot = partition (s, array, cnt);
+      left_cnt = (pivot - array) / s->size;
+      right_cnt = cnt - left_cnt - 1;
+      if (left_cnt < right_cnt)
+        {
+          intro_sort (s, array, left_cnt, depth);
+          array = pivot + s->size;
+          cnt = right_cnt;
+        }
+      else
+        {
+          intro_sort (s, pivot + s->size, right_cnt, depth);
+          cnt = left_cnt;
+        }
+    }
+  insertion_sort (s, array, cnt);
+}
+
+/* Sorts ARRAY, which contains CNT elements of SIZE bytes each,
+   as S says. */
+static void
+do_sort (struct sorter *s, void *array, size_t cnt, size_t size)
+{
+  int depth = 0;
+  size_t n;
+
+  ASSERT (array != NULL || cnt == 0);
+  ASSERT (size > 0);
+
+  s->size = size;
+  s->words = ((uintptr_t) array | size) % sizeof (unsigned long) == 0;
+  for (n = cnt; n > 1; n /= 2)
+    depth += 2;
+  intro_sort (s, array, cnt, depth);
+}
+
+/* Sorts ARRAY, which contains CNT elements of SIZE bytes each,
+   using COMPARE.  When COMPARE is passed a pair of elements A
+   and B, respectively, it must return a strcmp()-type result,
+   i.e. less than zero if A < B, zero if A == B, greater than
+   zero if A > B.  Runs in O(n lg n) time and O(lg n) space in
+   CNT. */
+void
+qsort (void *array, size_t cnt, size_t size,
+       int (*compare) (const void *, const void *)) 
+{
+  struct sorter s = {compare, NULL, NULL, 0, false};
+
+  ASSERT (compare != NULL);
+  do_sort (&s, array, cnt, size);
+}
+
 /* Sorts ARRAY, which contains CNT elements of SIZE bytes each,
    using COMPARE to compare elements, passing AUX as auxiliary
    data.  When COMPARE is passed a pair of elements A and B,
    respectively, it must return a strcmp()-type result, i.e. less
    than zero if A < B, zero if A == B, greater than zero if A >
-   B.  Runs in O(n lg n) time and O(1) space in CNT. */
+   B.  Runs in O(n lg n) time and O(lg n) space in CNT. */
 void
 sort (void *array, size_t cnt, size_t size,
       int (*compare) (const void *, const void *, void *aux),
       void *aux) 
 {
-  size_t i;
+  struct sorter s = {NULL, compare, aux, 0, false};
 
-  ASSERT (array != NULL || cnt == 0);
   ASSERT (compare != NULL);
-  ASSERT (size > 0);
+  do_sort (&s, array, cnt, size);
+}
 
-  /* Build a heap. */
-  for (i = cnt / 2; i > 0; i--)
-    heapify (array, i, cnt, size, compare, aux);
+/* Searches the CNT elements of SIZE bytes at ARRAY for KEY, as S
+   says.  Halves the range with a comparison and a conditional
+   move, which GCC emits without a branch, so that the loop runs
+   the same lg CNT times whatever the comparisons return. */
+static void *
+do_search (const struct sorter *s, const void *key, const void *array,
+           size_t cnt, size_t size)
+{
+  const unsigned char *base = array;
 
-  /* Sort the heap. */
-  for (i = cnt; i > 1; i--) 
+  if (cnt == 0)
+    return NULL;
+  while (cnt > 1)
     {
-      do_swap (array, 1, i, size);
-      heapify (array, 1, i - 1, size, compare, aux); 
+      size_t half = cnt / 2;
+      const unsigned char *middle = base + half * size;
+
+      base = do_compare (s, key, middle) < 0 ? base : middle;
+      cnt -= half;
     }
+  return do_compare (s, key, base) == 0 ? (void *) base : NULL;
 }
 
 /* Searches ARRAY, which contains CNT elements of SIZE bytes
@@ -166,7 +331,9 @@ void *
 bsearch (const void *key, const void *array, size_t cnt,
          size_t size, int (*compare) (const void *, const void *)) 
 {
-  return binary_search (key, array, cnt, size, compare_thunk, &compare);
+  struct sorter s = {compare, NULL, NULL, size, false};
+
+  return do_search (&s, key, array, cnt, size);
 }
 
 /* Searches ARRAY, which contains CNT elements of SIZE bytes
@@ -186,23 +353,8 @@ binary_search (const void *key, const void *array, size_t cnt, size_t size,
                int (*compare) (const void *, const void *, void *aux),
                void *aux) 
 {
-  const unsigned char *first = array;
-  const unsigned char *last = array + size * cnt;
+  struct sorter s = {NULL, compare, aux, size, false};
 
-  while (first < last) 
-    {
-      size_t range = (last - first) / size;
-      const unsigned char *middle = first + (range / 2) * size;
-      int cmp = compare (key, middle, aux);
-
-      if (cmp < 0) 
-        last = middle;
-      else if (cmp > 0) 
-        first = middle + size;
-      else
-        return (void *) middle;
-    }
-  
-  return NULL;
+  return do_search (&s, key, array, cnt, size);
 }
 
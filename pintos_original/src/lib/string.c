@@ -1,5 +1,55 @@
 #include <string.h>
 #include <debug.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* memcpy(), memmove(), and memset() move 32-bit words with REP
+   MOVSL and REP STOSL when the block is at least WORD_MIN bytes,
+   after a byte loop brings DST to a word boundary.  Blocks of at
+   least NT_MIN bytes, such as whole pages, are written with the
+   SSE2 non-temporal store MOVNTI instead, if the CPU has it, so
+   that clearing or copying them does not evict the rest of the
+   cache.  MOVNTI and SFENCE use only general-purpose registers,
+   so they neither touch the FPU state nor fault while CR0.EM or
+   CR0.TS is set. */
+#define WORD_MIN 16
+#define NT_MIN 4096
+
+/* Whether the CPU has MOVNTI: 1 if so, 0 if not, -1 if not yet
+   known.  Initialized so that it is in .data, not .bss, because
+   the kernel clears its BSS with memset(). */
+static int movnti_state = -1;
+
+/* Returns true if the CPU supports MOVNTI. */
+static bool
+has_movnti (void)
+{
+  if (movnti_state < 0)
+    {
+      uint32_t eax, ebx, ecx, edx;
+      asm ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (1));
+      movnti_state = (edx & (1u << 26)) != 0;   /* SSE2. */
+    }
+  return movnti_state;
+}
+
+/* Copies WORDS 32-bit words from SRC to DST, in ascending
+   order.  DST must be word-aligned. */
+static void
+copy_words (void *dst, const void *src, size_t words)
+{
+  if (words * 4 >= NT_MIN && has_movnti ())
+    {
+      uint32_t *d = dst;
+      const uint32_t *s = src;
+      for (; words > 0; words--)
+        asm volatile ("movnti %1, %0" : "=m" (*d++) : "r" (*s++));
+      asm volatile ("sfence" : : : "memory");
+    }
+  else
+    asm volatile ("rep movsl"
+                  : "+D" (dst), "+S" (src), "+c" (words) : : "memory");
+}
 
 /* Copies SIZE bytes from SRC to DST, which must not overlap.
    Returns DST. */
@@ -12,6 +62,15 @@ memcpy (void *dst_, const void *src_, size_t size)
   ASSERT (dst != NULL || size == 0);
   ASSERT (src != NULL || size == 0);
 
+  if (size >= WORD_MIN)
+    {
+      for (; (uintptr_t) dst % 4 != 0; size--)
+        *dst++ = *src++;
+      copy_words (dst, src, size / 4);
+      dst += size & ~3u;
+      src += size & ~3u;
+      size %= 4;
+    }
   while (size-- > 0)
     *dst++ = *src++;
 
@@ -29,8 +88,19 @@ memmove (void *dst_, const void *src_, size_t size)
   ASSERT (dst != NULL || size == 0);
   ASSERT (src != NULL || size == 0);
 
-  if (dst < src) 
+  if (dst < src || dst >= src + size)
     {
+      /* Copying in ascending order is safe even if the blocks
+         overlap. */
+      if (size >= WORD_MIN)
+        {
+          for (; (uintptr_t) dst % 4 != 0; size--)
+            *dst++ = *src++;
+          copy_words (dst, src, size / 4);
+          dst += size & ~3u;
+          src += size & ~3u;
+          size %= 4;
+        }
       while (size-- > 0)
         *dst++ = *src++;
     }
@@ -38,11 +108,54 @@ memmove (void *dst_, const void *src_, size_t size)
     {
       dst += size;
       src += size;
+      if (size >= WORD_MIN)
+        {
+          size_t words;
+          void *d;
+          const void *s;
+
+          for (; (uintptr_t) dst % 4 != 0; size--)
+            *--dst = *--src;
+          words = size / 4;
+          dst -= words * 4;
+          src -= words * 4;
+          size %= 4;
+
+          /* Copy words in descending order, from the last. */
+          d = dst + words * 4 - 4;
+          s = src + words * 4 - 4;
+          asm volatile ("std; rep movsl; cld"
+                        : "+D" (d), "+S" (s), "+c" (words) : : "memory");
+        }
       while (size-- > 0)
         *--dst = *--src;
     }
 
-  return dst;
+  return dst_;
+}
+
+/* The scanning functions below read 32-bit words at a time once
+   their pointers are word-aligned.  has_zero(W) is true if and
+   only if some byte of W is zero, and has_zero(W ^ REP) if some
+   byte equals the byte repeated in REP.  An aligned word never
+   crosses a page boundary, so reading all of the word that holds
+   a string's terminator, or a block's last byte, cannot fault
+   even if the bytes after it are unmapped.  word_t's may_alias
+   attribute makes such reads of char arrays well-defined. */
+typedef uint32_t __attribute__ ((may_alias)) word_t;
+#define ONES 0x01010101u
+
+static inline bool
+has_zero (uint32_t w)
+{
+  return ((w - ONES) & ~w & (ONES << 7)) != 0;
+}
+
+/* Returns true if P is word-aligned. */
+static inline bool
+aligned (const void *p)
+{
+  return (uintptr_t) p % sizeof (word_t) == 0;
 }
 
 /* Find the first differing byte in the two blocks of SIZE bytes
@@ -58,6 +171,15 @@ memcmp (const void *a_, const void *b_, size_t size)
   ASSERT (a != NULL || size == 0);
   ASSERT (b != NULL || size == 0);
 
+  if (size >= WORD_MIN && ((uintptr_t) a ^ (uintptr_t) b) % 4 == 0)
+    {
+      for (; !aligned (a); a++, b++, size--)
+        if (*a != *b)
+          return *a > *b ? +1 : -1;
+      for (; size >= 4 && *(const word_t *) a == *(const word_t *) b;
+           a += 4, b += 4, size -= 4)
+        continue;
+    }
   for (; size-- > 0; a++, b++)
     if (*a != *b)
       return *a > *b ? +1 : -1;
@@ -78,6 +200,15 @@ strcmp (const char *a_, const char *b_)
   ASSERT (a != NULL);
   ASSERT (b != NULL);
 
+  if (((uintptr_t) a ^ (uintptr_t) b) % 4 == 0)
+    {
+      for (; !aligned (a); a++, b++)
+        if (*a == '\0' || *a != *b)
+          return *a < *b ? -1 : *a > *b;
+      for (; *(const word_t *) a == *(const word_t *) b
+             && !has_zero (*(const word_t *) a); a += 4, b += 4)
+        continue;
+    }
   while (*a != '\0' && *a == *b) 
     {
       a++;
@@ -98,6 +229,17 @@ memchr (const void *block_, int ch_, size_t size)
 
   ASSERT (block != NULL || size == 0);
 
+  if (size >= WORD_MIN)
+    {
+      uint32_t rep = ch * ONES;
+
+      for (; !aligned (block); block++, size--)
+        if (*block == ch)
+          return (void *) block;
+      for (; size >= 4 && !has_zero (*(const word_t *) block ^ rep);
+           block += 4, size -= 4)
+        continue;
+    }
   for (; size-- > 0; block++)
     if (*block == ch)
       return (void *) block;
@@ -113,9 +255,22 @@ char *
 strchr (const char *string, int c_) 
 {
   char c = c_;
+  uint32_t rep = (unsigned char) c * ONES;
 
   ASSERT (string != NULL);
 
+  for (; !aligned (string); string++)
+    if (*string == c)
+      return (char *) string;
+    else if (*string == '\0')
+      return NULL;
+  for (;; string += 4)
+    {
+      uint32_t w = *(const word_t *) string;
+      if (has_zero (w) || has_zero (w ^ rep))
+        break;
+    }
+
   for (;;) 
     if (*string == c)
       return (char *) string;
@@ -281,7 +436,31 @@ memset (void *dst_, int value, size_t size)
   unsigned char *dst = dst_;
 
   ASSERT (dst != NULL || size == 0);
-  
+
+  if (size >= WORD_MIN)
+    {
+      uint32_t word = (unsigned char) value * 0x01010101u;
+      size_t words;
+
+      for (; (uintptr_t) dst % 4 != 0; size--)
+        *dst++ = value;
+      words = size / 4;
+      if (size >= NT_MIN && has_movnti ())
+        {
+          uint32_t *d = (uint32_t *) dst;
+          for (; words > 0; words--)
+            asm volatile ("movnti %1, %0" : "=m" (*d++) : "r" (word));
+          asm volatile ("sfence" : : : "memory");
+        }
+      else
+        {
+          void *d = dst;
+          asm volatile ("rep stosl"
+                        : "+D" (d), "+c" (words) : "a" (word) : "memory");
+        }
+      dst += size & ~3u;
+      size %= 4;
+    }
   while (size-- > 0)
     *dst++ = value;
 
@@ -296,7 +475,12 @@ strlen (const char *string)
 
   ASSERT (string != NULL);
 
-  for (p = string; *p != '\0'; p++)
+  for (p = string; !aligned (p); p++)
+    if (*p == '\0')
+      return p - string;
+  for (; !has_zero (*(const word_t *) p); p += 4)
+    continue;
+  for (; *p != '\0'; p++)
     continue;
   return p - string;
 }
@@ -308,7 +492,13 @@ strnlen (const char *string, size_t maxlen)
 {
   size_t length;
 
-  for (length = 0; string[length] != '\0' && length < maxlen; length++)
+  for (length = 0; length < maxlen && !aligned (string + length); length++)
+    if (string[length] == '\0')
+      return length;
+  for (; maxlen - length >= 4
+         && !has_zero (*(const word_t *) (string + length)); length += 4)
+    continue;
+  for (; length < maxlen && string[length] != '\0'; length++)
     continue;
   return length;
 }
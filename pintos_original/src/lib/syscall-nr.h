@@ -28,7 +28,22 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_READV,                  /* Read into several buffers. */
+    SYS_WRITEV,                 /* Write from several buffers. */
+    SYS_BATCH,                  /* Run several system calls at once. */
+    SYS_BLOCKSTATS,             /* Get block device statistics. */
+    SYS_UPTIME,                 /* Get the time since boot. */
+    SYS_WAIT_ANY,               /* Wait for any child process to die. */
+    SYS_SBRK,                   /* Move the end of the heap. */
+    SYS_PIPE,                   /* Create a pipe. */
+    SYS_EXEC_REDIRECT,          /* Start a process reading and writing
+                                   pipes. */
+    SYS_FUTEX_WAIT,             /* Wait for a user memory word to change. */
+    SYS_FUTEX_WAKE,             /* Wake threads waiting on a word. */
+    SYS_FORK                    /* Copy this process. */
   };
 
 #endif /* lib/syscall-nr.h */
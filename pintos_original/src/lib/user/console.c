@@ -1,19 +1,227 @@
 #include <stdio.h>
+#include <malloc.h>
 #include <string.h>
 #include <syscall.h>
 #include <syscall-nr.h>
 
+/* Buffered output streams.
+
+   Each write() is a system call, so output goes through a
+   stream that collects it in a buffer and writes the buffer out
+   in one call.  A stream's buffering mode says when:
+
+   - _IOFBF: when the buffer fills, or at fflush().  This is the
+     default for a stream opened with hopen().
+
+   - _IOLBF: also whenever a new-line is written, so that each
+     line of output appears as soon as it is complete.  This is
+     stdout's mode, which keeps console output in step with
+     messages from the kernel, such as "foo: exit(0)".
+
+   - _IONBF: never buffered; each write goes straight out.
+
+   exit() flushes every open stream, and reading the console
+   flushes stdout first, so that a prompt without a new-line
+   appears before the program waits for input.  Output still in a
+   buffer when the kernel kills a process is lost. */
+
+/* An output stream. */
+struct FILE
+  {
+    int handle;                 /* File handle written to. */
+    int mode;                   /* _IOFBF, _IOLBF, or _IONBF. */
+    char *buf;                  /* Buffer. */
+    size_t size;                /* Size of BUF. */
+    size_t used;                /* Bytes in BUF not yet written. */
+    bool error;                 /* Has a write failed? */
+    struct FILE *next;          /* Next open stream. */
+    char buffer[BUFSIZ];        /* Default buffer. */
+  };
+
+static FILE stdout_stream =
+  {
+    .handle = STDOUT_FILENO,
+    .mode = _IOLBF,
+    .buf = stdout_stream.buffer,
+    .size = BUFSIZ,
+  };
+
+FILE *stdout = &stdout_stream;
+
+/* Open streams, for fflush(NULL). */
+static FILE *streams = &stdout_stream;
+
+static void init_stream (FILE *, int handle, int mode);
+static void put_bytes (FILE *, const char *, size_t);
+static void put_char (FILE *, char);
+
+/* Returns a stream that writes to HANDLE, fully buffered, or a
+   null pointer if memory is not available. */
+FILE *
+hopen (int handle)
+{
+  FILE *s = malloc (sizeof *s);
+
+  if (s != NULL)
+    {
+      init_stream (s, handle, _IOFBF);
+      s->next = streams;
+      streams = s;
+    }
+  return s;
+}
+
+/* Flushes stream S, closes its file handle, and frees it.
+   Returns 0 if successful, EOF if a write failed. */
+int
+fclose (FILE *s)
+{
+  FILE **p;
+  int retval = fflush (s);
+
+  for (p = &streams; *p != NULL; p = &(*p)->next)
+    if (*p == s)
+      {
+        *p = s->next;
+        break;
+      }
+  close (s->handle);
+  if (s != &stdout_stream)
+    free (s);
+  return retval;
+}
+
+/* Sets stream S's buffering MODE, and its buffer to the SIZE
+   bytes at BUF, or to its own buffer if BUF is null.  Any output
+   already buffered is flushed first.  Returns 0 if successful,
+   -1 if MODE is invalid. */
+int
+setvbuf (FILE *s, char *buf, int mode, size_t size)
+{
+  if (mode != _IOFBF && mode != _IOLBF && mode != _IONBF)
+    return -1;
+
+  fflush (s);
+  s->mode = mode;
+  if (buf != NULL && size > 0)
+    {
+      s->buf = buf;
+      s->size = size;
+    }
+  else
+    {
+      s->buf = s->buffer;
+      s->size = sizeof s->buffer;
+    }
+  return 0;
+}
+
+/* Writes out whatever is buffered in stream S, or in every open
+   stream if S is null.  Returns 0 if successful, EOF if a write
+   failed. */
+int
+fflush (FILE *s)
+{
+  if (s == NULL)
+    {
+      int retval = 0;
+      for (s = streams; s != NULL; s = s->next)
+        if (fflush (s) != 0)
+          retval = EOF;
+      return retval;
+    }
+
+  if (s->used > 0)
+    {
+      if (write (s->handle, s->buf, s->used) != (int) s->used)
+        s->error = true;
+      s->used = 0;
+    }
+  return s->error ? EOF : 0;
+}
+
+/* Writes C to stream S.  Returns C. */
+int
+fputc (int c, FILE *s)
+{
+  put_char (s, c);
+  return c;
+}
+
+/* Writes string STRING, without a new-line, to stream S.
+   Returns 0. */
+int
+fputs (const char *string, FILE *s)
+{
+  put_bytes (s, string, strlen (string));
+  return 0;
+}
+
+/* Writes CNT elements of SIZE bytes each from BUFFER to stream
+   S.  Returns CNT. */
+size_t
+fwrite (const void *buffer, size_t size, size_t cnt, FILE *s)
+{
+  put_bytes (s, buffer, size * cnt);
+  return cnt;
+}
+
+/* Like printf(), but writes output to stream S. */
+int
+fprintf (FILE *s, const char *format, ...)
+{
+  va_list args;
+  int retval;
+
+  va_start (args, format);
+  retval = vfprintf (s, format, args);
+  va_end (args);
+
+  return retval;
+}
+
+/* Auxiliary data for vfprintf_helper(). */
+struct vfprintf_aux
+  {
+    FILE *stream;               /* Output stream. */
+    int char_cnt;               /* Total characters written so far. */
+  };
+
+static void vfprintf_helper (const char *, size_t, void *);
+
+/* Formats the printf() format specification FORMAT with
+   arguments given in ARGS and writes the output to stream S. */
+int
+vfprintf (FILE *s, const char *format, va_list args)
+{
+  struct vfprintf_aux aux;
+  aux.stream = s;
+  aux.char_cnt = 0;
+  __vprintf_buf (format, args, vfprintf_helper, &aux);
+  return aux.char_cnt;
+}
+
+/* Writes the N characters in BUF to AUX's stream and counts
+   them. */
+static void
+vfprintf_helper (const char *buf, size_t n, void *aux_)
+{
+  struct vfprintf_aux *aux = aux_;
+  put_bytes (aux->stream, buf, n);
+  aux->char_cnt += n;
+}
+
 /* The standard vprintf() function,
    which is like printf() but uses a va_list. */
 int
-vprintf (const char *format, va_list args) 
+vprintf (const char *format, va_list args)
 {
-  return vhprintf (STDOUT_FILENO, format, args);
+  return vfprintf (stdout, format, args);
 }
 
 /* Like printf(), but writes output to the given HANDLE. */
 int
-hprintf (int handle, const char *format, ...) 
+hprintf (int handle, const char *format, ...)
 {
   va_list args;
   int retval;
@@ -25,12 +233,32 @@ hprintf (int handle, const char *format, ...)
   return retval;
 }
 
+/* Formats the printf() format specification FORMAT with
+   arguments given in ARGS and writes the output to the given
+   HANDLE.  Output to STDOUT_FILENO goes through stdout, to keep
+   it in order with the rest; output to any other handle is
+   written out before returning. */
+int
+vhprintf (int handle, const char *format, va_list args)
+{
+  FILE s;
+  int retval;
+
+  if (handle == STDOUT_FILENO)
+    return vfprintf (stdout, format, args);
+
+  init_stream (&s, handle, _IOFBF);
+  retval = vfprintf (&s, format, args);
+  fflush (&s);
+  return retval;
+}
+
 /* Writes string S to the console, followed by a new-line
    character. */
 int
-puts (const char *s) 
+puts (const char *s)
 {
-  write (STDOUT_FILENO, s, strlen (s));
+  fputs (s, stdout);
   putchar ('\n');
 
   return 0;
@@ -38,57 +266,58 @@ puts (const char *s)
 
 /* Writes C to the console. */
 int
-putchar (int c) 
+putchar (int c)
 {
-  char c2 = c;
-  write (STDOUT_FILENO, &c2, 1);
-  return c;
+  return fputc (c, stdout);
 }
-
-/* Auxiliary data for vhprintf_helper(). */
-struct vhprintf_aux 
-  {
-    char buf[64];       /* Character buffer. */
-    char *p;            /* Current position in buffer. */
-    int char_cnt;       /* Total characters written so far. */
-    int handle;         /* Output file handle. */
-  };
 
-static void add_char (char, void *);
-static void flush (struct vhprintf_aux *);
-
-/* Formats the printf() format specification FORMAT with
-   arguments given in ARGS and writes the output to the given
-   HANDLE. */
-int
-vhprintf (int handle, const char *format, va_list args) 
+/* Initializes S as a stream that writes to HANDLE, with
+   buffering MODE and its own buffer. */
+static void
+init_stream (FILE *s, int handle, int mode)
 {
-  struct vhprintf_aux aux;
-  aux.p = aux.buf;
-  aux.char_cnt = 0;
-  aux.handle = handle;
-  __vprintf (format, args, add_char, &aux);
-  flush (&aux);
-  return aux.char_cnt;
+  s->handle = handle;
+  s->mode = mode;
+  s->buf = s->buffer;
+  s->size = sizeof s->buffer;
+  s->used = 0;
+  s->error = false;
+  s->next = NULL;
 }
 
-/* Adds C to the buffer in AUX, flushing it if the buffer fills
-   up. */
+/* Writes the SIZE bytes in DATA to stream S. */
 static void
-add_char (char c, void *aux_) 
+put_bytes (FILE *s, const char *data, size_t size)
 {
-  struct vhprintf_aux *aux = aux_;
-  *aux->p++ = c;
-  if (aux->p >= aux->buf + sizeof aux->buf)
-    flush (aux);
-  aux->char_cnt++;
+  bool newline = s->mode == _IOLBF && memchr (data, '\n', size) != NULL;
+
+  if (s->mode == _IONBF || size >= s->size)
+    {
+      /* Don't bother copying what would fill the buffer anyway. */
+      fflush (s);
+      if (size > 0 && write (s->handle, data, size) != (int) size)
+        s->error = true;
+      return;
+    }
+
+  if (size > s->size - s->used)
+    fflush (s);
+  memcpy (s->buf + s->used, data, size);
+  s->used += size;
+  if (newline)
+    fflush (s);
 }
 
-/* Flushes the buffer in AUX. */
+/* Writes C to stream S. */
 static void
-flush (struct vhprintf_aux *aux)
+put_char (FILE *s, char c)
 {
-  if (aux->p > aux->buf)
-    write (aux->handle, aux->buf, aux->p - aux->buf);
-  aux->p = aux->buf;
+  if (s->mode == _IONBF)
+    {
+      put_bytes (s, &c, 1);
+      return;
+    }
+  s->buf[s->used++] = c;
+  if (s->used >= s->size || (c == '\n' && s->mode == _IOLBF))
+    fflush (s);
 }
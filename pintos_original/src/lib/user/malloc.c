@@ -0,0 +1,385 @@
+#include <malloc.h>
+#include <debug.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+
+/* A buddy implementation of malloc() for user programs, after
+   the kernel's in threads/malloc.c.
+
+   Memory comes from the heap, which starts empty and grows with
+   sbrk().  Every block is a power of 2 of at least 16 bytes,
+   its "order", and is aligned to its own size relative to the
+   start of the heap, so that the "buddy" it was split from and
+   may coalesce with is at the offset with the order's bit
+   flipped.  A request is rounded up, with the block's header,
+   to the smallest order that fits.  There is a free list for
+   each order.  If no order large enough has a free block, the
+   heap grows by a block of the order needed, but at least
+   GROW_ORDER, after first filling up to the block's alignment
+   with free blocks of smaller orders.  A block larger than the
+   request is split in halves until it fits, and the unused upper
+   halves go onto the free lists of the smaller orders.
+
+   The kernel's allocator keeps bitmaps outside its blocks,
+   because it must not tag the pages it hands out whole.  Here,
+   instead, each block starts with a small header that gives its
+   order and whether it is free, so free() needs no lookup.  A
+   free block's header also holds its free list links.  When a
+   block is freed, it coalesces with its buddy for as long as the
+   buddy is free and of the same order.  A coalesced block of at
+   least GROW_ORDER that ends at the break is given back with
+   sbrk().
+
+   In front of all this, the smallest orders have a "magazine"
+   of recently freed blocks, as in the kernel.  free() parks a
+   small block there without coalescing, and malloc() hands it
+   out again just as cheaply.  The buddy system still counts
+   parked blocks as in use.  A full magazine flushes MAG_BATCH
+   blocks back to the free lists.  The kernel's single set of
+   magazines is shared by all of its threads, behind disabled
+   interrupts; a Pintos process has just one thread, so these are
+   in effect that thread's own and need no locking.
+
+   A program that uses malloc() must not move the break itself
+   with sbrk(). */
+
+/* Smallest and largest block orders. */
+#define MIN_ORDER 4
+#define MAX_ORDER 30
+
+/* The heap grows by at least 1 << GROW_ORDER bytes at a time. */
+#define GROW_ORDER 14
+
+/* Orders below MIN_ORDER + MAG_ORDERS (16 through 128 bytes)
+   have a magazine of up to MAG_ROUNDS blocks. */
+#define MAG_ORDERS 4
+#define MAG_ROUNDS 16
+#define MAG_BATCH (MAG_ROUNDS / 2)
+
+/* Magic number for detecting corrupted headers. */
+#define BLOCK_MAGIC 0x9a548eed
+
+/* Header at the start of every block. */
+struct block
+  {
+    unsigned magic;             /* Always BLOCK_MAGIC. */
+    uint8_t order;              /* Block is 1 << ORDER bytes. */
+    bool free;                  /* On a free list? */
+    struct block *prev, *next;  /* Free list or magazine links,
+                                   overlapping the data if in use. */
+  };
+
+/* Bytes of a block's header that are kept while the block is in
+   use. */
+#define HDR_SIZE offsetof (struct block, prev)
+
+/* Magazine of free blocks of one order. */
+struct magazine
+  {
+    struct block *top;          /* Most recently freed block. */
+    size_t cnt;                 /* Number of blocks. */
+  };
+
+static uint8_t *heap_base;      /* Start of the heap, or null. */
+static uint8_t *heap_end;       /* The break. */
+static struct block *free_lists[MAX_ORDER + 1];
+static struct magazine mags[MAG_ORDERS];
+
+static int size_to_order (size_t);
+static struct block *get_block (int order);
+static bool grow (int order);
+static struct block *release (struct block *, int order);
+static void trim (struct block *);
+static void push_free (struct block *, int order);
+static void remove_free (struct block *);
+
+/* Obtains and returns a new block of at least SIZE bytes.
+   Returns a null pointer if memory is not available. */
+void *
+malloc (size_t size)
+{
+  struct block *b;
+  int order;
+
+  /* A null pointer satisfies a request for 0 bytes. */
+  if (size == 0)
+    return NULL;
+
+  order = size_to_order (size);
+  if (order < 0)
+    return NULL;
+
+  if (order < MIN_ORDER + MAG_ORDERS && mags[order - MIN_ORDER].cnt > 0)
+    {
+      struct magazine *m = &mags[order - MIN_ORDER];
+      b = m->top;
+      m->top = b->next;
+      m->cnt--;
+    }
+  else
+    {
+      b = get_block (order);
+      if (b == NULL)
+        return NULL;
+    }
+  return (uint8_t *) b + HDR_SIZE;
+}
+
+/* Allocates and return A times B bytes initialized to zeroes.
+   Returns a null pointer if memory is not available. */
+void *
+calloc (size_t a, size_t b)
+{
+  void *p;
+  size_t size;
+
+  /* Calculate block size and make sure it fits in size_t. */
+  size = a * b;
+  if (size < a || size < b)
+    return NULL;
+
+  /* Allocate and zero memory. */
+  p = malloc (size);
+  if (p != NULL)
+    memset (p, 0, size);
+
+  return p;
+}
+
+/* Returns the block whose data starts at P. */
+static struct block *
+data_to_block (void *p)
+{
+  struct block *b = (struct block *) ((uint8_t *) p - HDR_SIZE);
+
+  ASSERT (b->magic == BLOCK_MAGIC);
+  ASSERT (!b->free);
+  return b;
+}
+
+/* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
+   moving it in the process.
+   If successful, returns the new block; on failure, returns a
+   null pointer.
+   A call with null OLD_BLOCK is equivalent to malloc(NEW_SIZE).
+   A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK). */
+void *
+realloc (void *old_block, size_t new_size)
+{
+  if (new_size == 0)
+    {
+      free (old_block);
+      return NULL;
+    }
+  else if (old_block == NULL)
+    return malloc (new_size);
+  else
+    {
+      struct block *b = data_to_block (old_block);
+      size_t old_size = ((size_t) 1 << b->order) - HDR_SIZE;
+      void *new_block;
+
+      /* A block that is already big enough stays put. */
+      if (new_size <= old_size)
+        return old_block;
+
+      new_block = malloc (new_size);
+      if (new_block != NULL)
+        {
+          memcpy (new_block, old_block, old_size);
+          free (old_block);
+        }
+      return new_block;
+    }
+}
+
+/* Frees block P, which must have been previously allocated with
+   malloc(), calloc(), or realloc(). */
+void
+free (void *p)
+{
+  struct block *b;
+  int order;
+
+  if (p == NULL)
+    return;
+
+  b = data_to_block (p);
+  order = b->order;
+  if (order < MIN_ORDER + MAG_ORDERS)
+    {
+      struct magazine *m = &mags[order - MIN_ORDER];
+      if (m->cnt >= MAG_ROUNDS)
+        while (m->cnt > MAG_ROUNDS - MAG_BATCH)
+          {
+            struct block *old = m->top;
+            m->top = old->next;
+            m->cnt--;
+            trim (release (old, order));
+          }
+      b->next = m->top;
+      m->top = b;
+      m->cnt++;
+    }
+  else
+    trim (release (b, order));
+}
+
+/* Returns the order of the smallest block that holds SIZE bytes
+   of data, or -1 if SIZE is too big for any block. */
+static int
+size_to_order (size_t size)
+{
+  int order = MIN_ORDER;
+
+  if (size > ((size_t) 1 << MAX_ORDER) - HDR_SIZE)
+    return -1;
+  while (((size_t) 1 << order) - HDR_SIZE < size)
+    order++;
+  return order;
+}
+
+/* Removes a block of ORDER from the free lists, splitting a
+   larger one or growing the heap if necessary, and returns it
+   marked in use.  Returns a null pointer if memory is not
+   available. */
+static struct block *
+get_block (int order)
+{
+  struct block *b;
+  int k;
+
+  for (;;)
+    {
+      for (k = order; k <= MAX_ORDER; k++)
+        if (free_lists[k] != NULL)
+          break;
+      if (k <= MAX_ORDER)
+        break;
+      if (!grow (order > GROW_ORDER ? order : GROW_ORDER))
+        return NULL;
+    }
+
+  b = free_lists[k];
+  remove_free (b);
+  while (k > order)
+    {
+      k--;
+      push_free ((struct block *) ((uint8_t *) b + ((size_t) 1 << k)), k);
+    }
+  b->order = order;
+  b->free = false;
+  return b;
+}
+
+/* Grows the heap by a free block of ORDER, aligned to its size,
+   first filling the gap up to that alignment with free blocks,
+   each the largest aligned at its start.  Returns true if
+   successful, false if sbrk() fails. */
+static bool
+grow (int order)
+{
+  size_t size = (size_t) 1 << order;
+
+  if (heap_base == NULL)
+    {
+      heap_base = heap_end = sbrk (0);
+      if (heap_base == SBRK_FAILED)
+        {
+          heap_base = NULL;
+          return false;
+        }
+    }
+
+  for (;;)
+    {
+      size_t ofs = heap_end - heap_base;
+      int k = ofs & (size - 1) ? __builtin_ctz (ofs) : order;
+      struct block *b = (struct block *) heap_end;
+
+      if (sbrk ((size_t) 1 << k) == SBRK_FAILED)
+        return false;
+      heap_end += (size_t) 1 << k;
+      b->magic = BLOCK_MAGIC;
+      release (b, k);
+      if (k == order)
+        return true;
+    }
+}
+
+/* Frees block B, of ORDER, coalescing it with its buddy for as
+   long as the buddy is free.  Returns the coalesced block. */
+static struct block *
+release (struct block *b, int order)
+{
+  size_t ofs = (uint8_t *) b - heap_base;
+
+  /* A buddy that lies within the heap always starts with a
+     header: it cannot be inside a larger block, since any larger
+     block around it would contain B too. */
+  while (order < MAX_ORDER)
+    {
+      size_t size = (size_t) 1 << order;
+      size_t buddy_ofs = ofs ^ size;
+      struct block *buddy = (struct block *) (heap_base + buddy_ofs);
+
+      if (buddy_ofs + size > (size_t) (heap_end - heap_base)
+          || !buddy->free || buddy->order != order)
+        break;
+      remove_free (buddy);
+      ofs &= ~size;
+      order++;
+    }
+
+  b = (struct block *) (heap_base + ofs);
+  push_free (b, order);
+  return b;
+}
+
+/* Gives free block B back with sbrk() if it is at least
+   GROW_ORDER and ends at the break. */
+static void
+trim (struct block *b)
+{
+  size_t size = (size_t) 1 << b->order;
+
+  if (b->order >= GROW_ORDER && (uint8_t *) b + size == heap_end
+      && sbrk (-(intptr_t) size) != SBRK_FAILED)
+    {
+      remove_free (b);
+      heap_end = (uint8_t *) b;
+    }
+}
+
+/* Marks B as a free block of ORDER and adds it to that order's
+   free list. */
+static void
+push_free (struct block *b, int order)
+{
+  b->magic = BLOCK_MAGIC;
+  b->order = order;
+  b->free = true;
+  b->prev = NULL;
+  b->next = free_lists[order];
+  if (b->next != NULL)
+    b->next->prev = b;
+  free_lists[order] = b;
+}
+
+/* Removes free block B from its free list and marks it in
+   use. */
+static void
+remove_free (struct block *b)
+{
+  ASSERT (b->free);
+
+  if (b->prev != NULL)
+    b->prev->next = b->next;
+  else
+    free_lists[b->order] = b->next;
+  if (b->next != NULL)
+    b->next->prev = b->prev;
+  b->free = false;
+}
@@ -0,0 +1,81 @@
+#include <mutex.h>
+#include <syscall.h>
+
+/* User-space mutexes.
+
+   A mutex is one int that goes from MUTEX_FREE to MUTEX_LOCKED
+   with an atomic compare-and-exchange when it is taken, and back
+   with an atomic exchange when it is released.  Neither needs
+   the kernel.  Only a thread that finds the mutex held makes a
+   system call: it marks the mutex MUTEX_CONTENDED and sleeps in
+   futex_wait() until it sees the mutex free, and a release that
+   finds the mark calls futex_wake() to let one sleeper try
+   again.  A woken thread takes the mutex as contended, since it
+   can't know whether others still sleep, so the last release may
+   make one system call that wakes no one.
+
+   This is the three-state mutex from Ulrich Drepper's paper
+   "Futexes Are Tricky". */
+
+#define MUTEX_FREE 0            /* Not held. */
+#define MUTEX_LOCKED 1          /* Held, with no thread waiting. */
+#define MUTEX_CONTENDED 2       /* Held, and threads may be waiting. */
+
+/* Atomically sets *P to NEW if it is OLD.  Returns the previous
+   value of *P. */
+static inline int
+compare_exchange (int *p, int old, int new)
+{
+  asm volatile ("lock cmpxchgl %2, %1"
+                : "+a" (old), "+m" (*p) : "r" (new) : "memory");
+  return old;
+}
+
+/* Atomically sets *P to NEW and returns its previous value. */
+static inline int
+exchange (int *p, int new)
+{
+  asm volatile ("xchgl %0, %1" : "+r" (new), "+m" (*p) : : "memory");
+  return new;
+}
+
+/* Initializes M as an unheld mutex. */
+void
+mutex_init (struct mutex *m)
+{
+  m->state = MUTEX_FREE;
+}
+
+/* Takes M, waiting in the kernel if another thread holds it. */
+void
+mutex_lock (struct mutex *m)
+{
+  int state = compare_exchange (&m->state, MUTEX_FREE, MUTEX_LOCKED);
+
+  if (state == MUTEX_FREE)
+    return;
+  if (state != MUTEX_CONTENDED)
+    state = exchange (&m->state, MUTEX_CONTENDED);
+  while (state != MUTEX_FREE)
+    {
+      futex_wait (&m->state, MUTEX_CONTENDED, -1);
+      state = exchange (&m->state, MUTEX_CONTENDED);
+    }
+}
+
+/* Takes M if no thread holds it.  Returns true if successful,
+   false if M is held. */
+bool
+mutex_trylock (struct mutex *m)
+{
+  return compare_exchange (&m->state, MUTEX_FREE, MUTEX_LOCKED) == MUTEX_FREE;
+}
+
+/* Releases M, which the calling thread must hold, waking a
+   waiting thread if there may be one. */
+void
+mutex_unlock (struct mutex *m)
+{
+  if (exchange (&m->state, MUTEX_FREE) == MUTEX_CONTENDED)
+    futex_wake (&m->state, 1);
+}
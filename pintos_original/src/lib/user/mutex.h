@@ -0,0 +1,21 @@
+#ifndef __LIB_USER_MUTEX_H
+#define __LIB_USER_MUTEX_H
+
+#include <stdbool.h>
+
+/* A mutual exclusion lock for user programs, built on the
+   futex_wait() and futex_wake() system calls.  See mutex.c. */
+struct mutex
+  {
+    int state;                  /* MUTEX_* in mutex.c. */
+  };
+
+/* Initializer for a mutex in static storage. */
+#define MUTEX_INITIALIZER {0}
+
+void mutex_init (struct mutex *);
+void mutex_lock (struct mutex *);
+bool mutex_trylock (struct mutex *);
+void mutex_unlock (struct mutex *);
+
+#endif /* lib/user/mutex.h */
@@ -1,6 +1,33 @@
 #ifndef __LIB_USER_STDIO_H
 #define __LIB_USER_STDIO_H
 
+/* A buffered output stream.  See lib/user/console.c. */
+typedef struct FILE FILE;
+
+/* Buffering modes, for setvbuf(). */
+#define _IOFBF 0                /* Fully buffered. */
+#define _IOLBF 1                /* Line buffered. */
+#define _IONBF 2                /* Unbuffered. */
+
+/* Size of a stream's own buffer. */
+#define BUFSIZ 512
+
+/* Returned by stream functions on failure. */
+#define EOF (-1)
+
+/* The console, line buffered. */
+extern FILE *stdout;
+
+FILE *hopen (int handle);
+int fclose (FILE *);
+int setvbuf (FILE *, char *buf, int mode, size_t size);
+int fflush (FILE *);
+int fputc (int, FILE *);
+int fputs (const char *, FILE *);
+size_t fwrite (const void *, size_t size, size_t cnt, FILE *);
+int fprintf (FILE *, const char *, ...) PRINTF_FORMAT (2, 3);
+int vfprintf (FILE *, const char *, va_list) PRINTF_FORMAT (2, 0);
+
 int hprintf (int, const char *, ...) PRINTF_FORMAT (2, 3);
 int vhprintf (int, const char *, va_list) PRINTF_FORMAT (2, 0);
 
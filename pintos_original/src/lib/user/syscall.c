@@ -1,4 +1,5 @@
 #include <syscall.h>
+#include <stdio.h>
 #include "../syscall-nr.h"
 
 /* Invokes syscall NUMBER, passing no arguments, and returns the
@@ -64,6 +65,7 @@
 void
 halt (void) 
 {
+  fflush (NULL);
   syscall0 (SYS_HALT);
   NOT_REACHED ();
 }
@@ -71,6 +73,7 @@ halt (void)
 void
 exit (int status)
 {
+  fflush (NULL);
   syscall1 (SYS_EXIT, status);
   NOT_REACHED ();
 }
@@ -114,6 +117,9 @@ filesize (int fd)
 int
 read (int fd, void *buffer, unsigned size)
 {
+  /* Let a prompt appear before waiting for its answer. */
+  if (fd == STDIN_FILENO)
+    fflush (stdout);
   return syscall3 (SYS_READ, fd, buffer, size);
 }
 
@@ -182,3 +188,77 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+int
+readv (int fd, const struct iovec *iov, int iovcnt)
+{
+  return syscall3 (SYS_READV, fd, iov, iovcnt);
+}
+
+int
+writev (int fd, const struct iovec *iov, int iovcnt)
+{
+  return syscall3 (SYS_WRITEV, fd, iov, iovcnt);
+}
+
+int
+syscall_batch (struct syscall_req *reqs, int cnt)
+{
+  return syscall2 (SYS_BATCH, reqs, cnt);
+}
+
+bool
+blockstats (const char *device, struct block_stats *stats, bool reset)
+{
+  return syscall3 (SYS_BLOCKSTATS, device, stats, reset);
+}
+
+uint64_t
+uptime (void)
+{
+  uint64_t ns;
+  syscall1 (SYS_UPTIME, &ns);
+  return ns;
+}
+
+pid_t
+wait_any (int *status)
+{
+  return syscall1 (SYS_WAIT_ANY, status);
+}
+
+void *
+sbrk (intptr_t increment)
+{
+  return (void *) syscall1 (SYS_SBRK, increment);
+}
+
+bool
+pipe (int fds[2])
+{
+  return syscall1 (SYS_PIPE, fds);
+}
+
+pid_t
+exec_redirect (const char *file, int in, int out)
+{
+  return (pid_t) syscall3 (SYS_EXEC_REDIRECT, file, in, out);
+}
+
+int
+futex_wait (int *addr, int val, int timeout_ms)
+{
+  return syscall3 (SYS_FUTEX_WAIT, addr, val, timeout_ms);
+}
+
+int
+futex_wake (int *addr, int cnt)
+{
+  return syscall2 (SYS_FUTEX_WAKE, addr, cnt);
+}
+
+pid_t
+fork (void)
+{
+  return (pid_t) syscall0 (SYS_FORK);
+}
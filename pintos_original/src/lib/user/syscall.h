@@ -2,6 +2,7 @@
 #define __LIB_USER_SYSCALL_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <debug.h>
 
 /* Process identifier. */
@@ -12,9 +13,50 @@ typedef int pid_t;
 typedef int mapid_t;
 #define MAP_FAILED ((mapid_t) -1)
 
+/* Returned by sbrk() on failure. */
+#define SBRK_FAILED ((void *) -1)
+
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
+/* A buffer for readv() and writev(). */
+struct iovec
+  {
+    void *iov_base;             /* Start of the buffer. */
+    unsigned iov_len;           /* Length in bytes. */
+  };
+
+/* A system call for syscall_batch(). */
+struct syscall_req
+  {
+    int number;                 /* SYS_* number, from <syscall-nr.h>. */
+    int args[3];                /* Arguments, as ints. */
+    int result;                 /* Set to the call's return value. */
+  };
+
+/* Statistics for a block device, from blockstats(). */
+#define BLOCK_HIST_CNT 32
+struct block_stats
+  {
+    unsigned long long read_cnt;        /* Sectors read. */
+    unsigned long long write_cnt;       /* Sectors written. */
+    unsigned long long read_reqs;       /* Read requests. */
+    unsigned long long write_reqs;      /* Write requests. */
+    unsigned long long sequential;      /* Requests starting just past
+                                           the previous one. */
+    unsigned long long random;          /* Other requests. */
+    unsigned long long completed;       /* Requests completed. */
+    unsigned long long ticks;           /* Total latency, in ticks. */
+    unsigned long long cycles;          /* Total latency, in TSC cycles. */
+    unsigned long long ticks_hist[BLOCK_HIST_CNT];  /* By ticks, in
+                                                       powers of 2. */
+    unsigned long long cycles_hist[BLOCK_HIST_CNT]; /* By cycles. */
+    unsigned long long depth_sum;       /* Sum over requests of the
+                                           depth they found. */
+    unsigned depth;                     /* Requests in flight now. */
+    unsigned max_depth;                 /* Most requests in flight. */
+  };
+
 /* Typical return values from main() and arguments to exit(). */
 #define EXIT_SUCCESS 0          /* Successful execution. */
 #define EXIT_FAILURE 1          /* Unsuccessful execution. */
@@ -45,4 +87,18 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Extensions. */
+int readv (int fd, const struct iovec *, int iovcnt);
+int writev (int fd, const struct iovec *, int iovcnt);
+int syscall_batch (struct syscall_req *, int cnt);
+bool blockstats (const char *device, struct block_stats *, bool reset);
+uint64_t uptime (void);
+pid_t wait_any (int *status);
+void *sbrk (intptr_t increment);
+bool pipe (int fds[2]);
+pid_t exec_redirect (const char *file, int in, int out);
+int futex_wait (int *addr, int val, int timeout_ms);
+int futex_wake (int *addr, int cnt);
+pid_t fork (void);
+
 #endif /* lib/user/syscall.h */
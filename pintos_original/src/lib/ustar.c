@@ -1,6 +1,7 @@
 #include <ustar.h>
 #include <limits.h>
 #include <packed.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -32,24 +33,34 @@ struct ustar_header
   }
 PACKED;
 
-/* Returns the checksum for the given ustar format HEADER. */
+/* Returns the checksum for the given ustar format HEADER.
+
+   The octets are summed a word at a time, as two 16-bit lanes
+   that each take the sum of every other octet.  A lane gains at
+   most 2 * 255 per word, so over the 128 words of a header it
+   can't overflow. */
 static unsigned int
 calculate_chksum (const struct ustar_header *h)
 {
   const uint8_t *header = (const uint8_t *) h;
+  uint32_t lanes = 0;
   unsigned int chksum;
   size_t i;
 
-  chksum = 0;
-  for (i = 0; i < USTAR_HEADER_SIZE; i++)
+  for (i = 0; i < USTAR_HEADER_SIZE; i += sizeof (uint32_t))
     {
-      /* The ustar checksum is calculated as if the chksum field
-         were all spaces. */
-      const size_t chksum_start = offsetof (struct ustar_header, chksum);
-      const size_t chksum_end = chksum_start + sizeof h->chksum;
-      bool in_chksum_field = i >= chksum_start && i < chksum_end;
-      chksum += in_chksum_field ? ' ' : header[i];
+      uint32_t word;
+
+      /* HEADER need not be aligned. */
+      memcpy (&word, header + i, sizeof word);
+      lanes += (word & 0x00ff00ff) + ((word >> 8) & 0x00ff00ff);
     }
+  chksum = (lanes & 0xffff) + (lanes >> 16);
+
+  /* The ustar checksum is calculated as if the chksum field
+     were all spaces. */
+  for (i = 0; i < sizeof h->chksum; i++)
+    chksum += ' ' - (uint8_t) h->chksum[i];
   return chksum;
 }
 
@@ -129,32 +140,39 @@ ustar_make_header (const char *file_name, enum ustar_type type,
 static bool
 parse_octal_field (const char *s, size_t size, unsigned long int *value)
 {
+  /* Classes of characters in an octal field: 1 more than an
+     octal digit's value, OCTAL_END for a space or null byte, or
+     OCTAL_BAD for anything else. */
+  enum { OCTAL_BAD = 0, OCTAL_END = 9 };
+  static const uint8_t octal_class[UCHAR_MAX + 1] =
+    {
+      ['\0'] = OCTAL_END, [' '] = OCTAL_END,
+      ['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4,
+      ['4'] = 5, ['5'] = 6, ['6'] = 7, ['7'] = 8,
+    };
   size_t ofs;
 
   *value = 0;
   for (ofs = 0; ofs < size; ofs++)
     {
-      char c = s[ofs];
-      if (c >= '0' && c <= '7')
-        {
-          if (*value > ULONG_MAX / 8)
-            {
-              /* Overflow. */
-              return false;
-            }
-          *value = c - '0' + *value * 8;
-        }
-      else if (c == ' ' || c == '\0')
+      unsigned int class = octal_class[(unsigned char) s[ofs]];
+      if (class == OCTAL_END)
         {
           /* End of field, but disallow completely empty
              fields. */
           return ofs > 0;
         }
-      else
+      else if (class == OCTAL_BAD)
         {
           /* Bad character. */
           return false;
         }
+      else if (*value > ULONG_MAX / 8)
+        {
+          /* Overflow. */
+          return false;
+        }
+      *value = (class - 1) + *value * 8;
     }
 
   /* Field did not end in space or null byte. */
@@ -162,13 +180,20 @@ parse_octal_field (const char *s, size_t size, unsigned long int *value)
 }
 
 /* Returns true if the CNT bytes starting at BLOCK are all zero,
-   false otherwise. */
+   false otherwise.  CNT must be a multiple of the word size, but
+   BLOCK need not be aligned. */
 static bool
 is_all_zeros (const char *block, size_t cnt)
 {
-  while (cnt-- > 0)
-    if (*block++ != 0)
-      return false;
+  ASSERT (cnt % sizeof (uint32_t) == 0);
+  for (; cnt > 0; block += sizeof (uint32_t), cnt -= sizeof (uint32_t))
+    {
+      uint32_t word;
+
+      memcpy (&word, block, sizeof word);
+      if (word != 0)
+        return false;
+    }
   return true;
 }
 
@@ -0,0 +1,79 @@
+#ifndef __LIB_VDSO_H
+#define __LIB_VDSO_H
+
+#include <stdint.h>
+
+/* Time page.
+
+   The kernel maps a read-only page of its own into each user
+   process at VDSO_ADDR, from which the process can read the time
+   and its own CPU usage without a system call.  The kernel
+   updates the page on every timer tick while the process runs
+   and whenever it switches to the process, so the page is
+   current whenever the process looks at it.
+
+   The kernel makes SEQ odd while it updates the page.  A reader
+   that was interrupted by an update sees SEQ odd or changed and
+   reads again, as vdso_read() does. */
+#define VDSO_ADDR 0x08000000
+
+struct vdso
+  {
+    unsigned seq;               /* Odd while being updated. */
+    uint32_t tick_freq;         /* Timer ticks per second. */
+    uint64_t cycles_per_sec;    /* TSC rate, or 0 if unknown. */
+    int64_t ticks;              /* Timer ticks since boot. */
+    int64_t user_ticks;         /* Ticks this process ran user code. */
+    int64_t kernel_ticks;       /* Ticks it ran in the kernel. */
+  };
+
+/* The rest is for user programs. */
+
+/* Copies the current process's time page into *V. */
+static inline void
+vdso_read (struct vdso *v)
+{
+  const volatile struct vdso *page = (const volatile struct vdso *) VDSO_ADDR;
+  unsigned seq;
+
+  do
+    {
+      seq = page->seq;
+      asm volatile ("" : : : "memory");
+      v->tick_freq = page->tick_freq;
+      v->cycles_per_sec = page->cycles_per_sec;
+      v->ticks = page->ticks;
+      v->user_ticks = page->user_ticks;
+      v->kernel_ticks = page->kernel_ticks;
+      asm volatile ("" : : : "memory");
+    }
+  while ((seq & 1) || seq != page->seq);
+  v->seq = seq;
+}
+
+/* Returns the number of timer ticks since the OS booted. */
+static inline int64_t
+vdso_ticks (void)
+{
+  struct vdso v;
+
+  vdso_read (&v);
+  return v.ticks;
+}
+
+/* Returns the time in nanoseconds, measured like the uptime()
+   system call, or 0 if the TSC rate is unknown. */
+static inline uint64_t
+vdso_ns (void)
+{
+  const volatile struct vdso *page = (const volatile struct vdso *) VDSO_ADDR;
+  uint64_t hz = page->cycles_per_sec;
+  uint64_t tsc;
+
+  if (hz == 0)
+    return 0;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc / hz * 1000000000 + tsc % hz * 1000000000 / hz;
+}
+
+#endif /* lib/vdso.h */
@@ -0,0 +1,255 @@
+/* Replays allocation traces against malloc() and reports its
+   speed and how much memory it holds onto.
+
+   Each trace is a sequence of mallocs and frees into a table of
+   live blocks, generated before timing starts from a fixed seed,
+   so that every run, and every allocator, sees exactly the same
+   sequence.  Block sizes follow a power law: a size class of 2**K
+   bytes, for K from 4 to 12, is picked with probability
+   proportional to R**K, then a size within the class uniformly.
+   The traces are:
+
+     steep: R = 1/2, mostly small blocks.
+     heavy: R = 3/4, a heavier tail of large blocks.
+     phased: alternating phases of growth and shrinkage, as when
+     a burst of processes start and then exit, with heavy sizes.
+
+   The benchmark reports the replay's speed, then, at 10 points
+   during a second replay, the pages the allocator holds, counted
+   as kernel pool pages taken since the start, the bytes the
+   trace has live, and their ratio, the fragmentation: bytes held
+   per byte in use.  Pages that the allocator kept from earlier
+   traces do not count, so a count can even be negative.  Finally
+   it frees everything and reports the pages still held.  Build with the buddy allocator in place of
+   threads/malloc.c to compare the two.
+
+   Arguments, all optional, name the traces to run, by default
+   all of them.  A trace recorded elsewhere can be replayed by
+   adding it to the table below in the same form. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "tests/bench/bench.h"
+#include "devices/clock.h"
+#include "devices/timer.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+#define OP_CNT 20000            /* Operations per trace. */
+#define SLOT_CNT 256            /* Most live blocks. */
+#define SAMPLE_CNT 10           /* Fragmentation samples per trace. */
+
+/* One operation: malloc SIZE bytes into SLOT, or, if SIZE is 0,
+   free the block in SLOT. */
+struct alloc_op
+  {
+    uint16_t slot;
+    uint16_t size;
+  };
+
+/* How to generate a trace. */
+struct trace
+  {
+    const char *name;
+    const unsigned *weights;    /* Weight of each size class. */
+    bool phased;                /* Alternate growth and shrinkage? */
+  };
+
+/* Size classes 2**4 through 2**12, weighted by R**K. */
+#define CLASS_MIN 4
+#define CLASS_CNT 9
+static const unsigned steep_weights[CLASS_CNT] =
+  {256, 128, 64, 32, 16, 8, 4, 2, 1};
+static const unsigned heavy_weights[CLASS_CNT] =
+  {1000, 750, 563, 422, 316, 237, 178, 133, 100};
+
+static const struct trace traces[] =
+  {
+    {"steep", steep_weights, false},
+    {"heavy", heavy_weights, false},
+    {"phased", heavy_weights, true},
+  };
+#define TRACE_CNT (sizeof traces / sizeof *traces)
+
+static struct alloc_op ops[OP_CNT];
+static void *blocks[SLOT_CNT];
+static uint32_t rng_state;
+
+static void run_trace (const struct trace *);
+static void generate (const struct trace *);
+static void replay (const char *name, bool sample);
+static uint32_t rng (void);
+
+void
+test_bench_alloc (void)
+{
+  char args[64], *save_ptr, *arg;
+  size_t i;
+
+  strlcpy (args, test_args, sizeof args);
+  arg = strtok_r (args, " ", &save_ptr);
+  if (arg == NULL)
+    {
+      for (i = 0; i < TRACE_CNT; i++)
+        run_trace (&traces[i]);
+      return;
+    }
+
+  for (; arg != NULL; arg = strtok_r (NULL, " ", &save_ptr))
+    {
+      for (i = 0; i < TRACE_CNT; i++)
+        if (!strcmp (arg, traces[i].name))
+          break;
+      if (i >= TRACE_CNT)
+        fail ("unknown trace \"%s\"", arg);
+      run_trace (&traces[i]);
+    }
+}
+
+/* Generates trace T, then replays it twice, once for speed and
+   once for fragmentation. */
+static void
+run_trace (const struct trace *t)
+{
+  generate (t);
+  replay (t->name, false);
+  replay (t->name, true);
+}
+
+/* Returns a size drawn from the power law given by WEIGHTS. */
+static uint16_t
+pick_size (const unsigned *weights)
+{
+  unsigned total = 0, r;
+  int k;
+
+  for (k = 0; k < CLASS_CNT; k++)
+    total += weights[k];
+  r = rng () % total;
+  for (k = 0; r >= weights[k]; k++)
+    r -= weights[k];
+  return (1u << (CLASS_MIN + k)) + rng () % (1u << (CLASS_MIN + k));
+}
+
+/* Fills ops[] with trace T. */
+static void
+generate (const struct trace *t)
+{
+  static uint16_t live[SLOT_CNT], free_slots[SLOT_CNT];
+  size_t live_cnt = 0, free_cnt = SLOT_CNT;
+  size_t i;
+
+  rng_state = 0x12345678;
+  for (i = 0; i < SLOT_CNT; i++)
+    free_slots[i] = SLOT_CNT - 1 - i;
+
+  for (i = 0; i < OP_CNT; i++)
+    {
+      /* Percent chance of a malloc rather than a free: steady
+         around half full, or, if phased, growing during even
+         phases and shrinking during odd ones. */
+      unsigned grow = 55;
+      if (t->phased)
+        grow = (i / (OP_CNT / 8)) % 2 == 0 ? 80 : 20;
+
+      if (free_cnt > 0 && (live_cnt == 0 || rng () % 100 < grow))
+        {
+          uint16_t slot = free_slots[--free_cnt];
+          live[live_cnt++] = slot;
+          ops[i].slot = slot;
+          ops[i].size = pick_size (t->weights);
+        }
+      else
+        {
+          size_t j = rng () % live_cnt;
+          ops[i].slot = live[j];
+          ops[i].size = 0;
+          free_slots[free_cnt++] = live[j];
+          live[j] = live[--live_cnt];
+        }
+    }
+}
+
+/* Replays ops[], then frees whatever it left allocated.  If
+   SAMPLE, reports fragmentation as it goes; otherwise, reports
+   the replay's speed. */
+static void
+replay (const char *name, bool sample)
+{
+  static uint16_t sizes[SLOT_CNT];
+  size_t base = palloc_free_count (0);
+  size_t live_bytes = 0;
+  struct bench b;
+  char what[64];
+  size_t i;
+
+  bench_start (&b);
+  for (i = 0; i < OP_CNT; i++)
+    {
+      const struct alloc_op *op = &ops[i];
+
+      if (op->size != 0)
+        {
+          blocks[op->slot] = malloc (op->size);
+          if (blocks[op->slot] == NULL)
+            fail ("%s: malloc(%"PRIu16") failed at op %zu",
+                  name, op->size, i);
+          sizes[op->slot] = op->size;
+          live_bytes += op->size;
+        }
+      else
+        {
+          free (blocks[op->slot]);
+          blocks[op->slot] = NULL;
+          live_bytes -= sizes[op->slot];
+        }
+
+      if (sample && (i + 1) % (OP_CNT / SAMPLE_CNT) == 0)
+        {
+          long held = (long) base - (long) palloc_free_count (0);
+          unsigned long long ratio = (held > 0 && live_bytes > 0
+                                      ? held * PGSIZE * 100ULL / live_bytes
+                                      : 0);
+          msg ("%s: op %zu: %ld pages held, %zu bytes live, "
+               "fragmentation %llu.%02llu",
+               name, i + 1, held, live_bytes, ratio / 100, ratio % 100);
+        }
+    }
+  if (!sample)
+    {
+      uint64_t cycles = clock_cycles () - b.cycles;
+      snprintf (what, sizeof what, "%s replay", name);
+      bench_report (what, OP_CNT, cycles, timer_elapsed (b.ticks));
+      if (cycles > 0)
+        msg ("%s: %llu ops/s", name,
+             (unsigned long long) (OP_CNT * clock_hz () / cycles));
+    }
+
+  for (i = 0; i < SLOT_CNT; i++)
+    if (blocks[i] != NULL)
+      {
+        free (blocks[i]);
+        blocks[i] = NULL;
+      }
+  if (sample)
+    {
+      long held = (long) base - (long) palloc_free_count (0);
+
+      msg ("%s: all freed: %ld pages held", name, held);
+      snprintf (what, sizeof what, "%s pages held after free", name);
+      bench_metric (what, held > 0 ? held : 0, "pages", BENCH_LOWER);
+    }
+}
+
+/* Returns a pseudo-random number from a xorshift generator, so
+   that traces do not depend on the kernel's random seed. */
+static uint32_t
+rng (void)
+{
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 17;
+  rng_state ^= rng_state << 5;
+  return rng_state;
+}
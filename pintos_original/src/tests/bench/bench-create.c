@@ -0,0 +1,35 @@
+/* Measures the rate at which threads can be created and exit:
+   each thread runs at once, because it has a higher priority
+   than the creator, and exits right away. */
+
+#include "tests/bench/bench.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define CREATE_CNT 2000
+
+static thread_func exiter;
+
+void
+test_bench_create (void) 
+{
+  struct semaphore done;
+  struct bench b;
+  int i;
+
+  sema_init (&done, 0);
+  thread_set_priority (PRI_DEFAULT);
+  bench_start (&b);
+  for (i = 0; i < CREATE_CNT; i++)
+    {
+      thread_create ("exiter", PRI_DEFAULT + 1, exiter, &done);
+      sema_down (&done);
+    }
+  bench_stop (&b, "thread_create() and exit", CREATE_CNT);
+}
+
+static void
+exiter (void *done) 
+{
+  sema_up (done);
+}
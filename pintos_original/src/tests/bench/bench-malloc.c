@@ -0,0 +1,54 @@
+/* Measures malloc() and free() for each power-of-2 size from 16
+   bytes to 4 kB, allocating a batch of blocks and then freeing
+   them.  Build with the buddy allocator in place of
+   threads/malloc.c to compare the two. */
+
+#include <stdio.h>
+#include "tests/bench/bench.h"
+#include "devices/clock.h"
+#include "devices/timer.h"
+#include "threads/malloc.h"
+
+#define BATCH_CNT 256
+#define ROUND_CNT 16
+
+void
+test_bench_malloc (void) 
+{
+  static void *blocks[BATCH_CNT];
+  size_t size;
+
+  for (size = 16; size <= 4096; size *= 2)
+    {
+      struct bench alloc, release;
+      uint64_t alloc_cycles = 0, release_cycles = 0;
+      int64_t alloc_ticks = 0, release_ticks = 0;
+      char what[32];
+      int round, i;
+
+      for (round = 0; round < ROUND_CNT; round++)
+        {
+          bench_start (&alloc);
+          for (i = 0; i < BATCH_CNT; i++)
+            {
+              blocks[i] = malloc (size);
+              if (blocks[i] == NULL)
+                fail ("malloc(%zu) failed", size);
+            }
+          alloc_cycles += clock_cycles () - alloc.cycles;
+          alloc_ticks += timer_elapsed (alloc.ticks);
+
+          bench_start (&release);
+          for (i = 0; i < BATCH_CNT; i++)
+            free (blocks[i]);
+          release_cycles += clock_cycles () - release.cycles;
+          release_ticks += timer_elapsed (release.ticks);
+        }
+
+      snprintf (what, sizeof what, "malloc(%zu)", size);
+      bench_report (what, BATCH_CNT * ROUND_CNT, alloc_cycles, alloc_ticks);
+      snprintf (what, sizeof what, "free(%zu)", size);
+      bench_report (what, BATCH_CNT * ROUND_CNT, release_cycles,
+                    release_ticks);
+    }
+}
@@ -0,0 +1,59 @@
+/* Measures palloc_get_page() and palloc_free_page(), and the
+   same for runs of several pages, allocating a batch and then
+   freeing it. */
+
+#include <stdio.h>
+#include "tests/bench/bench.h"
+#include "devices/clock.h"
+#include "devices/timer.h"
+#include "threads/palloc.h"
+
+#define BATCH_CNT 64
+#define ROUND_CNT 16
+
+static void bench_pages (size_t page_cnt);
+
+void
+test_bench_palloc (void) 
+{
+  bench_pages (1);
+  bench_pages (4);
+  bench_pages (16);
+}
+
+/* Allocates and frees batches of PAGE_CNT pages. */
+static void
+bench_pages (size_t page_cnt) 
+{
+  static void *pages[BATCH_CNT];
+  uint64_t alloc_cycles = 0, release_cycles = 0;
+  int64_t alloc_ticks = 0, release_ticks = 0;
+  char what[48];
+  int round, i;
+
+  for (round = 0; round < ROUND_CNT; round++)
+    {
+      struct bench b;
+
+      bench_start (&b);
+      for (i = 0; i < BATCH_CNT; i++)
+        {
+          pages[i] = palloc_get_multiple (0, page_cnt);
+          if (pages[i] == NULL)
+            fail ("palloc_get_multiple(0, %zu) failed", page_cnt);
+        }
+      alloc_cycles += clock_cycles () - b.cycles;
+      alloc_ticks += timer_elapsed (b.ticks);
+
+      bench_start (&b);
+      for (i = 0; i < BATCH_CNT; i++)
+        palloc_free_multiple (pages[i], page_cnt);
+      release_cycles += clock_cycles () - b.cycles;
+      release_ticks += timer_elapsed (b.ticks);
+    }
+
+  snprintf (what, sizeof what, "palloc_get_multiple(%zu)", page_cnt);
+  bench_report (what, BATCH_CNT * ROUND_CNT, alloc_cycles, alloc_ticks);
+  snprintf (what, sizeof what, "palloc_free_multiple(%zu)", page_cnt);
+  bench_report (what, BATCH_CNT * ROUND_CNT, release_cycles, release_ticks);
+}
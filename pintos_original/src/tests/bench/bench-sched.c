@@ -0,0 +1,251 @@
+/* Measures the scheduler under a mix of interactive and
+   CPU-bound threads.
+
+   Each interactive thread waits for an event, which a timeout
+   posts from the timer interrupt every 1 to 3 ticks, then does a
+   short burst of work.  Its response time is the time from the
+   post until it runs.  Each CPU-bound thread spins, counting
+   units of work.  The benchmark reports response-time
+   percentiles, the throughput of both kinds of thread, and Jain's
+   fairness index over the CPU-bound threads' work.
+
+   Arguments, all optional, are the number of interactive
+   threads, the number of CPU-bound threads, and the seconds to
+   run, by default "4 4 5".  The same function runs as
+   bench-sched-rr and bench-sched-mlfq, which "make bench" runs
+   without and with -mlfqs, to compare the schedulers. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tests/bench/bench.h"
+#include "devices/clock.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define THREAD_MAX 32           /* Most threads of each kind. */
+#define SAMPLE_MAX 8192         /* Most response times recorded. */
+#define WORK_UNIT 1000          /* Loop iterations per unit of work. */
+
+/* An interactive thread. */
+struct io_thread
+  {
+    struct timeout timeout;     /* Posts the next event. */
+    struct semaphore event;     /* Upped by the timeout. */
+    uint64_t posted;            /* TSC when the event was posted. */
+    unsigned long long events;  /* Events handled. */
+  };
+
+/* A CPU-bound thread. */
+struct cpu_thread
+  {
+    unsigned long long work;    /* Units of work done. */
+  };
+
+static volatile bool done;              /* Time to stop? */
+static struct semaphore exited;         /* Upped by each thread. */
+static uint64_t burst_cycles;           /* Interactive burst length. */
+static uint64_t samples[SAMPLE_MAX];    /* Response times, in cycles. */
+static size_t sample_cnt;
+static unsigned long long dropped;      /* Samples that did not fit. */
+
+static thread_func io_func, cpu_func;
+static timeout_func post_event;
+static void spin (unsigned long long iterations);
+static int compare_samples (const void *, const void *);
+static uint64_t percentile (int pct);
+
+void
+test_bench_sched (void) 
+{
+  static struct io_thread io[THREAD_MAX];
+  static struct cpu_thread cpu[THREAD_MAX];
+  char args[64], *save_ptr, *arg;
+  int io_cnt = 4, cpu_cnt = 4, seconds = 5;
+  unsigned long long events = 0, work = 0, work_sq = 0;
+  int i;
+
+  strlcpy (args, test_args, sizeof args);
+  if ((arg = strtok_r (args, " ", &save_ptr)) != NULL)
+    io_cnt = atoi (arg);
+  if ((arg = strtok_r (NULL, " ", &save_ptr)) != NULL)
+    cpu_cnt = atoi (arg);
+  if ((arg = strtok_r (NULL, " ", &save_ptr)) != NULL)
+    seconds = atoi (arg);
+  if (io_cnt < 0 || io_cnt > THREAD_MAX || cpu_cnt < 0
+      || cpu_cnt > THREAD_MAX || seconds <= 0)
+    fail ("bad arguments \"%s\"", test_args);
+  ASSERT (clock_hz () != 0);
+
+  msg ("%d interactive and %d CPU-bound threads for %d s, %s scheduler",
+       io_cnt, cpu_cnt, seconds, thread_mlfqs ? "MLFQ" : "round-robin");
+
+  done = false;
+  sema_init (&exited, 0);
+  burst_cycles = clock_hz () / 5000;
+  sample_cnt = 0;
+  dropped = 0;
+  thread_set_priority (PRI_MAX);
+  for (i = 0; i < io_cnt; i++)
+    {
+      char name[16];
+
+      snprintf (name, sizeof name, "io %d", i);
+      io[i].events = 0;
+      thread_create (name, PRI_DEFAULT, io_func, &io[i]);
+    }
+  for (i = 0; i < cpu_cnt; i++)
+    {
+      char name[16];
+
+      snprintf (name, sizeof name, "cpu %d", i);
+      cpu[i].work = 0;
+      thread_create (name, PRI_DEFAULT, cpu_func, &cpu[i]);
+    }
+
+  timer_sleep (seconds * TIMER_FREQ);
+  done = true;
+  for (i = 0; i < io_cnt + cpu_cnt; i++)
+    sema_down (&exited);
+
+  /* Response times. */
+  qsort (samples, sample_cnt, sizeof *samples, compare_samples);
+  for (i = 0; i < io_cnt; i++)
+    events += io[i].events;
+  msg ("response: %zu samples (%llu dropped), "
+       "p50 %"PRIu64" us, p90 %"PRIu64" us, p99 %"PRIu64" us, "
+       "max %"PRIu64" us",
+       sample_cnt, dropped,
+       clock_cycles_to_ns (percentile (50)) / 1000,
+       clock_cycles_to_ns (percentile (90)) / 1000,
+       clock_cycles_to_ns (percentile (99)) / 1000,
+       clock_cycles_to_ns (percentile (100)) / 1000);
+  msg ("interactive throughput: %llu events/s", events / seconds);
+  bench_metric ("response p50", clock_cycles_to_ns (percentile (50)) / 1000,
+                "us", BENCH_LOWER);
+  bench_metric ("response p90", clock_cycles_to_ns (percentile (90)) / 1000,
+                "us", BENCH_LOWER);
+  bench_metric ("response p99", clock_cycles_to_ns (percentile (99)) / 1000,
+                "us", BENCH_LOWER);
+  bench_metric ("interactive throughput", events / seconds, "events/s",
+                BENCH_HIGHER);
+
+  /* Jain's fairness index, (sum x)^2 / (n * sum x^2), from 1/n
+     when one thread gets everything to 1 when all get the same. */
+  for (i = 0; i < cpu_cnt; i++)
+    {
+      work += cpu[i].work;
+      work_sq += cpu[i].work * cpu[i].work;
+    }
+  msg ("CPU-bound throughput: %llu units/s", work / seconds);
+  bench_metric ("CPU-bound throughput", work / seconds, "units/s",
+                BENCH_HIGHER);
+  if (cpu_cnt > 0 && work_sq > 0)
+    {
+      /* Scale down so that the squares do not overflow. */
+      unsigned long long scale = work / cpu_cnt / 1000 + 1;
+      unsigned long long sum = 0, sum_sq = 0, jain;
+
+      for (i = 0; i < cpu_cnt; i++)
+        {
+          unsigned long long x = cpu[i].work / scale;
+          sum += x;
+          sum_sq += x * x;
+        }
+      jain = sum_sq > 0 ? sum * sum * 1000 / (cpu_cnt * sum_sq) : 0;
+      msg ("Jain fairness index: %llu.%03llu", jain / 1000, jain % 1000);
+      bench_metric ("Jain fairness index", jain, "1/1000", BENCH_HIGHER);
+    }
+}
+
+/* Interactive thread. */
+static void
+io_func (void *io_) 
+{
+  struct io_thread *io = io_;
+
+  sema_init (&io->event, 0);
+  timeout_init (&io->timeout, post_event, io);
+  while (!done)
+    {
+      enum intr_level old_level;
+      uint64_t latency;
+
+      timeout_add (&io->timeout, 1 + prng_range (thread_prng (), 3));
+      sema_down (&io->event);
+      latency = clock_cycles () - io->posted;
+
+      old_level = intr_disable ();
+      if (sample_cnt < SAMPLE_MAX)
+        samples[sample_cnt++] = latency;
+      else
+        dropped++;
+      intr_set_level (old_level);
+      io->events++;
+
+      spin (burst_cycles);
+    }
+  sema_up (&exited);
+}
+
+/* Posts an event to interactive thread IO_.  Called from the
+   timer interrupt. */
+static void
+post_event (struct timeout *t UNUSED, void *io_) 
+{
+  struct io_thread *io = io_;
+
+  io->posted = clock_cycles ();
+  sema_up (&io->event);
+}
+
+/* CPU-bound thread. */
+static void
+cpu_func (void *cpu_) 
+{
+  struct cpu_thread *cpu = cpu_;
+
+  while (!done)
+    {
+      volatile int i;
+
+      for (i = 0; i < WORK_UNIT; i++)
+        continue;
+      cpu->work++;
+    }
+  sema_up (&exited);
+}
+
+/* Busy-waits for CYCLES TSC cycles. */
+static void
+spin (unsigned long long cycles) 
+{
+  uint64_t start = clock_cycles ();
+
+  while (clock_cycles () - start < cycles)
+    barrier ();
+}
+
+static int
+compare_samples (const void *a_, const void *b_) 
+{
+  const uint64_t *a = a_, *b = b_;
+
+  return *a < *b ? -1 : *a > *b;
+}
+
+/* Returns the PCTth percentile of the sorted samples. */
+static uint64_t
+percentile (int pct) 
+{
+  size_t idx;
+
+  if (sample_cnt == 0)
+    return 0;
+  idx = (sample_cnt * pct + 99) / 100;
+  return samples[idx > 0 ? idx - 1 : 0];
+}
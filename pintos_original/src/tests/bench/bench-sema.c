@@ -0,0 +1,50 @@
+/* Measures a semaphore round trip: two threads hand control back
+   and forth through a pair of semaphores. */
+
+#include "tests/bench/bench.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define PING_CNT 10000
+
+struct ping_pong
+  {
+    struct semaphore ping;
+    struct semaphore pong;
+  };
+
+static thread_func ponger;
+
+void
+test_bench_sema (void) 
+{
+  struct ping_pong pp;
+  struct bench b;
+  int i;
+
+  sema_init (&pp.ping, 0);
+  sema_init (&pp.pong, 0);
+  thread_set_priority (PRI_DEFAULT);
+  thread_create ("ponger", PRI_DEFAULT, ponger, &pp);
+
+  bench_start (&b);
+  for (i = 0; i < PING_CNT; i++)
+    {
+      sema_up (&pp.ping);
+      sema_down (&pp.pong);
+    }
+  bench_stop (&b, "semaphore round trip", PING_CNT);
+}
+
+static void
+ponger (void *pp_) 
+{
+  struct ping_pong *pp = pp_;
+  int i;
+
+  for (i = 0; i < PING_CNT; i++)
+    {
+      sema_down (&pp->ping);
+      sema_up (&pp->pong);
+    }
+}
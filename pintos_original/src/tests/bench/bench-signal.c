@@ -0,0 +1,72 @@
+/* Measures signal delivery latency, from sigqueue() in one
+   thread to sigtimedwait() returning in another, higher-priority
+   one.  Only kernels with signals support it. */
+
+#include "tests/bench/bench.h"
+#include "devices/clock.h"
+#include "devices/timer.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#ifdef THREADS_SIGNAL_H
+#define SIGNAL_CNT 2000
+
+/* Shared with the receiver. */
+struct signal_bench
+  {
+    uint64_t sent;              /* TSC just before sigqueue(). */
+    uint64_t cycles;            /* Total latency. */
+    struct semaphore done;      /* Upped when the receiver is done. */
+  };
+
+static thread_func receiver;
+
+void
+test_bench_signal (void) 
+{
+  struct signal_bench sb;
+  int64_t start;
+  tid_t tid;
+  int i;
+
+  sb.cycles = 0;
+  sema_init (&sb.done, 0);
+  thread_set_priority (PRI_DEFAULT);
+  tid = thread_create ("receiver", PRI_DEFAULT + 1, receiver, &sb);
+
+  start = timer_ticks ();
+  for (i = 0; i < SIGNAL_CNT; i++)
+    {
+      sb.sent = clock_cycles ();
+      if (sigqueue (tid, SIG_RT, i) < 0)
+        fail ("sigqueue() failed");
+    }
+  sema_down (&sb.done);
+  bench_report ("sigqueue() to sigtimedwait()", SIGNAL_CNT, sb.cycles,
+                timer_elapsed (start));
+}
+
+static void
+receiver (void *sb_) 
+{
+  struct signal_bench *sb = sb_;
+  sigset_t set;
+  int i;
+
+  sigemptyset (&set);
+  sigaddset (&set, SIG_RT);
+  for (i = 0; i < SIGNAL_CNT; i++)
+    {
+      if (sigtimedwait (&set, NULL, -1) != SIG_RT)
+        fail ("sigtimedwait() failed");
+      sb->cycles += clock_cycles () - sb->sent;
+    }
+  sema_up (&sb->done);
+}
+#else /* !THREADS_SIGNAL_H */
+void
+test_bench_signal (void) 
+{
+  msg ("signals not supported by this kernel");
+}
+#endif /* !THREADS_SIGNAL_H */
@@ -0,0 +1,78 @@
+/* Measures how late timer_sleep() and timer_usleep() wake up,
+   beyond the time asked for. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "tests/bench/bench.h"
+#include "devices/clock.h"
+#include "devices/timer.h"
+#include "threads/synch.h"
+
+#define SLEEP_CNT 20
+
+void
+test_bench_sleep (void) 
+{
+  static const int64_t ticks[] = {1, 2, 5};
+  static const int64_t usecs[] = {10, 100, 1000};
+  char what[48];
+  size_t i;
+  int j;
+
+  /* Ticks: start at a tick boundary, so that the wait should be
+     exactly TICKS[I] ticks. */
+  for (i = 0; i < sizeof ticks / sizeof *ticks; i++)
+    {
+      uint64_t late_cycles = 0;
+      int64_t late_ticks = 0;
+
+      for (j = 0; j < SLEEP_CNT; j++)
+        {
+          int64_t start = timer_ticks ();
+          uint64_t cycles;
+
+          while (timer_ticks () == start)
+            barrier ();
+          start = timer_ticks ();
+          cycles = clock_cycles ();
+          timer_sleep (ticks[i]);
+          late_ticks += timer_elapsed (start) - ticks[i];
+          cycles = clock_cycles () - cycles;
+          if (clock_hz () != 0)
+            {
+              uint64_t expected = clock_hz () * ticks[i] / TIMER_FREQ;
+              if (cycles > expected)
+                late_cycles += cycles - expected;
+            }
+        }
+      snprintf (what, sizeof what, "timer_sleep(%"PRId64") lateness",
+                ticks[i]);
+      bench_report (what, SLEEP_CNT, late_cycles, late_ticks);
+    }
+
+  /* Microseconds. */
+  for (i = 0; i < sizeof usecs / sizeof *usecs; i++)
+    {
+      uint64_t late_cycles = 0;
+      int64_t late_ticks = 0;
+
+      for (j = 0; j < SLEEP_CNT; j++)
+        {
+          int64_t start = timer_ticks ();
+          uint64_t cycles = clock_cycles ();
+
+          timer_usleep (usecs[i]);
+          cycles = clock_cycles () - cycles;
+          late_ticks += timer_elapsed (start);
+          if (clock_hz () != 0)
+            {
+              uint64_t expected = clock_hz () * usecs[i] / 1000000;
+              if (cycles > expected)
+                late_cycles += cycles - expected;
+            }
+        }
+      snprintf (what, sizeof what, "timer_usleep(%"PRId64") lateness",
+                usecs[i]);
+      bench_report (what, SLEEP_CNT, late_cycles, late_ticks);
+    }
+}
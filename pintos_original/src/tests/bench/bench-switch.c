@@ -0,0 +1,38 @@
+/* Measures context-switch latency: two threads of equal priority
+   take turns calling thread_yield(), so that each yield switches
+   to the other one. */
+
+#include "tests/bench/bench.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define SWITCH_CNT 10000
+
+static thread_func yielder;
+
+void
+test_bench_switch (void) 
+{
+  struct semaphore done;
+  struct bench b;
+  int i;
+
+  sema_init (&done, 0);
+  thread_set_priority (PRI_DEFAULT);
+  bench_start (&b);
+  thread_create ("yielder", PRI_DEFAULT, yielder, &done);
+  for (i = 0; i < SWITCH_CNT; i++)
+    thread_yield ();
+  sema_down (&done);
+  bench_stop (&b, "thread_yield() switch", 2 * SWITCH_CNT);
+}
+
+static void
+yielder (void *done) 
+{
+  int i;
+
+  for (i = 0; i < SWITCH_CNT; i++)
+    thread_yield ();
+  sema_up (done);
+}
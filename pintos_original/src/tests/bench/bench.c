@@ -0,0 +1,51 @@
+#include "tests/bench/bench.h"
+#include <inttypes.h>
+#include "devices/clock.h"
+#include "devices/timer.h"
+
+/* Starts timing interval B. */
+void
+bench_start (struct bench *b)
+{
+  b->ticks = timer_ticks ();
+  b->cycles = clock_cycles ();
+}
+
+/* Ends interval B, which covered OPS repetitions of WHAT, and
+   reports it. */
+void
+bench_stop (struct bench *b, const char *what, unsigned long long ops)
+{
+  uint64_t cycles = clock_cycles () - b->cycles;
+
+  bench_report (what, ops, cycles, timer_elapsed (b->ticks));
+}
+
+/* Prints the time that OPS repetitions of WHAT took, CYCLES TSC
+   cycles and TICKS timer ticks in all: per repetition in cycles
+   and nanoseconds, and in all in ticks.  The time per
+   repetition in nanoseconds is also reported as metric WHAT. */
+void
+bench_report (const char *what, unsigned long long ops, uint64_t cycles,
+              int64_t ticks)
+{
+  unsigned long long ns;
+
+  if (ops == 0)
+    ops = 1;
+  ns = clock_cycles_to_ns (cycles) / ops;
+  msg ("%s: %llu cycles, %llu ns each; %llu in %"PRId64" ticks",
+       what, (unsigned long long) (cycles / ops), ns, ops, ticks);
+  bench_metric (what, ns, "ns", BENCH_LOWER);
+}
+
+/* Reports VALUE, in UNIT, as the result NAME, in the form that
+   utils/bench-json collects.  NAME must not contain " = ", and
+   UNIT must be one word. */
+void
+bench_metric (const char *name, unsigned long long value, const char *unit,
+              enum bench_better better)
+{
+  msg ("metric: %s = %llu %s (%s is better)", name, value, unit,
+       better == BENCH_LOWER ? "lower" : "higher");
+}
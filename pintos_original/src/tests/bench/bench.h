@@ -0,0 +1,41 @@
+#ifndef TESTS_BENCH_BENCH_H
+#define TESTS_BENCH_BENCH_H
+
+#include <stdint.h>
+#include "tests/threads/tests.h"
+
+/* Microbenchmarks.  Run like the tests in tests/threads, but
+   print measurements instead of passing or failing. */
+
+extern test_func test_bench_switch;
+extern test_func test_bench_create;
+extern test_func test_bench_sema;
+extern test_func test_bench_malloc;
+extern test_func test_bench_alloc;
+extern test_func test_bench_palloc;
+extern test_func test_bench_sleep;
+extern test_func test_bench_signal;
+extern test_func test_bench_sched;
+
+/* Measured interval. */
+struct bench
+  {
+    uint64_t cycles;            /* TSC at start. */
+    int64_t ticks;              /* Timer ticks at start. */
+  };
+
+/* Which way a metric improves. */
+enum bench_better
+  {
+    BENCH_LOWER,                /* Smaller is better, as for times. */
+    BENCH_HIGHER                /* Larger is better, as for rates. */
+  };
+
+void bench_start (struct bench *);
+void bench_stop (struct bench *, const char *what, unsigned long long ops);
+void bench_report (const char *what, unsigned long long ops,
+                   uint64_t cycles, int64_t ticks);
+void bench_metric (const char *name, unsigned long long value,
+                   const char *unit, enum bench_better);
+
+#endif /* tests/bench/bench.h */
@@ -0,0 +1,36 @@
+/* Creates many small files, then deletes them, and reports the
+   rates. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/filesys/bench/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 200
+
+void
+test_main (void) 
+{
+  char file_name[16];
+  uint64_t start;
+  int i;
+
+  start = bench_start ();
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (file_name, sizeof file_name, "file%d", i);
+      if (!create (file_name, 512))
+        fail ("create \"%s\" failed", file_name);
+    }
+  bench_ops (start, "create", FILE_CNT);
+
+  start = bench_start ();
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (file_name, sizeof file_name, "file%d", i);
+      if (!remove (file_name))
+        fail ("remove \"%s\" failed", file_name);
+    }
+  bench_ops (start, "remove", FILE_CNT);
+}
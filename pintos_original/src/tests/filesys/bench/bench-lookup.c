@@ -0,0 +1,56 @@
+/* Fills directories of several sizes with files, then opens
+   files in each, in random order, and reports the rate of
+   lookups. */
+
+#include <random.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/filesys/bench/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define LOOKUP_CNT 1000
+
+static void bench_dir (int file_cnt);
+
+void
+test_main (void) 
+{
+  bench_dir (10);
+  bench_dir (50);
+  bench_dir (200);
+}
+
+/* Creates a directory with FILE_CNT files and looks files up in
+   it. */
+static void
+bench_dir (int file_cnt) 
+{
+  char dir_name[16], file_name[32], what[32];
+  uint64_t start;
+  int i;
+
+  snprintf (dir_name, sizeof dir_name, "dir%d", file_cnt);
+  CHECK (mkdir (dir_name), "mkdir \"%s\"", dir_name);
+  for (i = 0; i < file_cnt; i++)
+    {
+      snprintf (file_name, sizeof file_name, "%s/file%d", dir_name, i);
+      if (!create (file_name, 0))
+        fail ("create \"%s\" failed", file_name);
+    }
+
+  start = bench_start ();
+  for (i = 0; i < LOOKUP_CNT; i++)
+    {
+      int fd;
+
+      snprintf (file_name, sizeof file_name, "%s/file%lu",
+                dir_name, random_ulong () % file_cnt);
+      fd = open (file_name);
+      if (fd < 2)
+        fail ("open \"%s\" failed", file_name);
+      close (fd);
+    }
+  snprintf (what, sizeof what, "open in %d-entry directory", file_cnt);
+  bench_ops (start, what, LOOKUP_CNT);
+}
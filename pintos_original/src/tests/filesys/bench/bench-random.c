@@ -0,0 +1,48 @@
+/* Reads 512-byte blocks of a large file in random order and
+   reports the rate. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/filesys/bench/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE (1024 * 1024)
+#define BLOCK_SIZE 512
+#define BLOCK_CNT (FILE_SIZE / BLOCK_SIZE)
+
+static char buf[BLOCK_SIZE];
+static int order[BLOCK_CNT];
+
+void
+test_main (void) 
+{
+  const char *file_name = "random";
+  uint64_t start;
+  size_t i;
+  int fd;
+
+  random_bytes (buf, sizeof buf);
+  for (i = 0; i < BLOCK_CNT; i++)
+    order[i] = i;
+  shuffle (order, BLOCK_CNT, sizeof *order);
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  for (i = 0; i < BLOCK_CNT; i++)
+    if (write (fd, buf, BLOCK_SIZE) != BLOCK_SIZE)
+      fail ("write \"%s\" failed", file_name);
+
+  start = bench_start ();
+  for (i = 0; i < BLOCK_CNT; i++) 
+    {
+      size_t ofs = BLOCK_SIZE * order[i];
+      seek (fd, ofs);
+      if (read (fd, buf, BLOCK_SIZE) != BLOCK_SIZE)
+        fail ("read %d bytes at offset %zu failed", BLOCK_SIZE, ofs);
+    }
+  bench_ops (start, "random 512-byte reads", BLOCK_CNT);
+
+  close (fd);
+  CHECK (remove (file_name), "remove \"%s\"", file_name);
+}
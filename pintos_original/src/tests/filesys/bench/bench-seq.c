@@ -0,0 +1,54 @@
+/* Writes a large file sequentially, then reads it back, one
+   block at a time, for several block sizes, and reports the
+   rates. */
+
+#include <random.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/filesys/bench/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE (1024 * 1024)
+#define BLOCK_MAX 65536
+
+static char buf[BLOCK_MAX];
+
+void
+test_main (void) 
+{
+  static const size_t block_sizes[] = {512, 4096, BLOCK_MAX};
+  size_t i;
+
+  random_bytes (buf, sizeof buf);
+  for (i = 0; i < sizeof block_sizes / sizeof *block_sizes; i++)
+    {
+      size_t block_size = block_sizes[i];
+      char file_name[16], what[32];
+      uint64_t start;
+      size_t ofs;
+      int fd;
+
+      snprintf (file_name, sizeof file_name, "seq%zu", block_size);
+      CHECK (create (file_name, 0), "create \"%s\"", file_name);
+      CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+
+      start = bench_start ();
+      for (ofs = 0; ofs < FILE_SIZE; ofs += block_size)
+        if (write (fd, buf, block_size) != (int) block_size)
+          fail ("write %zu bytes at offset %zu failed", block_size, ofs);
+      snprintf (what, sizeof what, "write %zu-byte blocks", block_size);
+      bench_bytes (start, what, FILE_SIZE);
+
+      seek (fd, 0);
+      start = bench_start ();
+      for (ofs = 0; ofs < FILE_SIZE; ofs += block_size)
+        if (read (fd, buf, block_size) != (int) block_size)
+          fail ("read %zu bytes at offset %zu failed", block_size, ofs);
+      snprintf (what, sizeof what, "read %zu-byte blocks", block_size);
+      bench_bytes (start, what, FILE_SIZE);
+
+      close (fd);
+      CHECK (remove (file_name), "remove \"%s\"", file_name);
+    }
+}
@@ -0,0 +1,56 @@
+#include "tests/filesys/bench/bench.h"
+#include <vdso.h>
+#include "tests/lib.h"
+
+/* Returns the time at which a measured interval starts. */
+uint64_t
+bench_start (void) 
+{
+  return vdso_ns ();
+}
+
+/* Returns the nanoseconds since START, at least 1. */
+static uint64_t
+elapsed (uint64_t start) 
+{
+  uint64_t ns = vdso_ns () - start;
+  return ns > 0 ? ns : 1;
+}
+
+/* Reports that OPS repetitions of WHAT took from START until
+   now, in operations per second, which are also reported as
+   metric WHAT. */
+void
+bench_ops (uint64_t start, const char *what, unsigned long long ops) 
+{
+  uint64_t ns = elapsed (start);
+  unsigned long long ops_per_s = ops * 1000000000ULL / ns;
+
+  msg ("%s: %llu in %llu us, %llu ops/s",
+       what, ops, (unsigned long long) (ns / 1000), ops_per_s);
+  bench_metric (what, ops_per_s, "ops/s", BENCH_HIGHER);
+}
+
+/* Reports that WHAT transferred BYTES from START until now, in
+   MB/s, and in kB/s as metric WHAT. */
+void
+bench_bytes (uint64_t start, const char *what, unsigned long long bytes) 
+{
+  uint64_t ns = elapsed (start);
+  unsigned long long kb_per_s = bytes * 1000000000ULL / 1024 / ns;
+
+  msg ("%s: %llu bytes in %llu us, %llu.%02llu MB/s",
+       what, bytes, (unsigned long long) (ns / 1000),
+       kb_per_s / 1024, kb_per_s % 1024 * 100 / 1024);
+  bench_metric (what, kb_per_s, "kB/s", BENCH_HIGHER);
+}
+
+/* Reports VALUE, in UNIT, as the result NAME, in the form that
+   utils/bench-json collects, as in tests/bench/bench.c. */
+void
+bench_metric (const char *name, unsigned long long value, const char *unit,
+              enum bench_better better)
+{
+  msg ("metric: %s = %llu %s (%s is better)", name, value, unit,
+       better == BENCH_LOWER ? "lower" : "higher");
+}
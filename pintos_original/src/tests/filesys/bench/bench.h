@@ -0,0 +1,19 @@
+#ifndef TESTS_FILESYS_BENCH_BENCH_H
+#define TESTS_FILESYS_BENCH_BENCH_H
+
+#include <stdint.h>
+
+/* Which way a metric improves. */
+enum bench_better
+  {
+    BENCH_LOWER,                /* Smaller is better, as for times. */
+    BENCH_HIGHER                /* Larger is better, as for rates. */
+  };
+
+uint64_t bench_start (void);
+void bench_ops (uint64_t start, const char *what, unsigned long long ops);
+void bench_bytes (uint64_t start, const char *what, unsigned long long bytes);
+void bench_metric (const char *name, unsigned long long value,
+                   const char *unit, enum bench_better);
+
+#endif /* tests/filesys/bench/bench.h */
@@ -13,6 +13,7 @@
 #include <random.h>
 #include <stdio.h>
 #include "threads/test.h"
+#include "threads/thread.h"
 
 /* Maximum number of elements in a linked list that we will
    test. */
@@ -91,7 +92,7 @@ test (void)
                e = list_next (e))
             {
               struct value *v = list_entry (e, struct value, elem);
-              int copies = random_ulong () % 4;
+              int copies = prng_range (thread_prng (), 4);
               while (copies-- > 0) 
                 {
                   values[ofs].value = v->value;
@@ -116,7 +117,7 @@ shuffle (struct value *array, size_t cnt)
 
   for (i = 0; i < cnt; i++)
     {
-      size_t j = i + random_ulong () % (cnt - i);
+      size_t j = i + prng_range (thread_prng (), cnt - i);
       struct value t = array[j];
       array[j] = array[i];
       array[i] = t;
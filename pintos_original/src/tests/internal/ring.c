@@ -0,0 +1,115 @@
+/* Test program for lib/kernel/ring.c.
+
+   Pushes and pops across the end of a ring's buffer many times,
+   in batches of every size, and checks the full and empty edges
+   along the way.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <ring.h>
+#include <stdio.h>
+#include "threads/test.h"
+
+/* Number of slots in the ring that we test. */
+#define SLOT_CNT 8
+
+/* An element, bigger than a byte so that slot offsets matter. */
+struct value
+  {
+    int value;                  /* Item value. */
+    char pad[3];                /* Makes the size odd. */
+  };
+
+static void check_edges (struct ring *, size_t cnt);
+
+/* Test the ring buffer implementation. */
+void
+test (void)
+{
+  struct value slots[SLOT_CNT];
+  struct value in[SLOT_CNT + 1], out[SLOT_CNT + 1];
+  struct ring ring;
+  int next_in, next_out;
+  size_t batch;
+  int round;
+  size_t i;
+
+  printf ("testing ring buffer:");
+  ring_init (&ring, slots, SLOT_CNT, sizeof *slots);
+  check_edges (&ring, 0);
+
+  /* Popping, peeking, or discarding from an empty ring does
+     nothing. */
+  ASSERT (ring_pop (&ring, out, 1) == 0);
+  ASSERT (ring_peek (&ring, out, 1) == 0);
+  ring_discard (&ring, 0);
+  check_edges (&ring, 0);
+
+  /* Fill the ring, then check that it takes no more. */
+  for (i = 0; i < SLOT_CNT + 1; i++)
+    in[i].value = i;
+  ASSERT (ring_push (&ring, in, SLOT_CNT + 1) == SLOT_CNT);
+  check_edges (&ring, SLOT_CNT);
+  ASSERT (ring_push (&ring, in, 1) == 0);
+  check_edges (&ring, SLOT_CNT);
+
+  /* Drain it, then check that nothing more comes out. */
+  ASSERT (ring_pop (&ring, out, SLOT_CNT + 1) == SLOT_CNT);
+  for (i = 0; i < SLOT_CNT; i++)
+    ASSERT (out[i].value == (int) i);
+  check_edges (&ring, 0);
+  ASSERT (ring_pop (&ring, out, 1) == 0);
+
+  /* Push and pop in batches of every size, so that the ring's
+     contents wrap around the end of the buffer at every offset.
+     Values must come out in the order they went in. */
+  next_in = next_out = 0;
+  for (round = 0; round < 4 * SLOT_CNT; round++)
+    for (batch = 1; batch <= SLOT_CNT; batch++)
+      {
+        size_t cnt = ring_count (&ring);
+        size_t pushed, popped;
+
+        for (i = 0; i < batch; i++)
+          in[i].value = next_in + i;
+        pushed = ring_push (&ring, in, batch);
+        ASSERT (pushed == (batch < SLOT_CNT - cnt ? batch : SLOT_CNT - cnt));
+        next_in += pushed;
+        check_edges (&ring, cnt + pushed);
+
+        /* Peek at the oldest, then pop it along with all but
+           the newest. */
+        cnt = ring_count (&ring);
+        ASSERT (ring_peek (&ring, out, 1) == 1);
+        ASSERT (out[0].value == next_out);
+        popped = ring_pop (&ring, out, cnt - 1);
+        ASSERT (popped == cnt - 1);
+        for (i = 0; i < popped; i++)
+          ASSERT (out[i].value == next_out + (int) i);
+        next_out += popped;
+        check_edges (&ring, 1);
+      }
+
+  /* Discard the last element, leaving the ring empty out of
+     phase with its buffer. */
+  ring_discard (&ring, 1);
+  next_out++;
+  ASSERT (next_out == next_in);
+  check_edges (&ring, 0);
+
+  printf (" done\n");
+}
+
+/* Checks that RING reports holding CNT elements. */
+static void
+check_edges (struct ring *ring, size_t cnt)
+{
+  ASSERT (ring_count (ring) == cnt);
+  ASSERT (ring_space (ring) == SLOT_CNT - cnt);
+  ASSERT (ring_empty (ring) == (cnt == 0));
+  ASSERT (ring_full (ring) == (cnt == SLOT_CNT));
+}
@@ -14,6 +14,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include "threads/test.h"
+#include "threads/thread.h"
 
 /* Maximum number of elements in an array that we will test. */
 #define MAX_CNT 4096
@@ -40,10 +41,14 @@ test (void)
           static int values[MAX_CNT];
           int i;
 
-          /* Put values 0...CNT in random order in VALUES. */
+          /* Put values 0...CNT in VALUES in ascending order the
+             first time, descending order the second, and random
+             order after that, since quicksort's worst cases are
+             orderly. */
           for (i = 0; i < cnt; i++)
-            values[i] = i;
-          shuffle (values, cnt);
+            values[i] = repeat == 1 ? cnt - 1 - i : i;
+          if (repeat > 1)
+            shuffle (values, cnt);
   
           /* Sort VALUES, then verify ordering. */
           qsort (values, cnt, sizeof *values, compare_ints);
@@ -64,7 +69,7 @@ shuffle (int *array, size_t cnt)
 
   for (i = 0; i < cnt; i++)
     {
-      size_t j = i + random_ulong () % (cnt - i);
+      size_t j = i + prng_range (thread_prng (), cnt - i);
       int t = array[j];
       array[j] = array[i];
       array[i] = t;
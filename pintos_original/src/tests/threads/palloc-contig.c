@@ -0,0 +1,92 @@
+/* Fragments the kernel pool so that it has no two free pages in
+   a row, then checks that a PAL_CONTIG request for a long run
+   still succeeds, from the contiguous region, and that once the
+   kernel pool is exhausted a PAL_MOVABLE page may be borrowed
+   from the region but an ordinary page may not.  Run with "-o
+   palloc.contig_pages=64". */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+#define RUN_PAGES 16
+
+static void *take_all (void **odd);
+static void free_list (void *list);
+
+void
+test_palloc_contig (void)
+{
+  size_t region_free = palloc_free_count (PAL_CONTIG);
+  void *even, *odd, *rest, *run, *bad, *page;
+
+  msg ("Contiguous region %s.",
+       region_free >= RUN_PAGES ? "present" : "missing");
+
+  /* Leave only every other page of the kernel pool free. */
+  even = take_all (&odd);
+  free_list (odd);
+
+  bad = palloc_get_multiple (0, RUN_PAGES);
+  msg ("Ordinary %d-page run %s.", RUN_PAGES,
+       bad == NULL ? "refused" : "granted");
+  palloc_free_multiple (bad, RUN_PAGES);
+
+  run = palloc_get_multiple (PAL_CONTIG, RUN_PAGES);
+  msg ("PAL_CONTIG %d-page run %s, %s the region.", RUN_PAGES,
+       run != NULL ? "granted" : "refused",
+       palloc_free_count (PAL_CONTIG) == region_free - RUN_PAGES
+       ? "from" : "not from");
+
+  /* Exhaust the kernel pool, then borrow. */
+  rest = take_all (&odd);
+  page = palloc_get_page (0);
+  msg ("Ordinary page %s.", page == NULL ? "refused" : "granted");
+  palloc_free_page (page);
+  page = palloc_get_page (PAL_MOVABLE);
+  msg ("PAL_MOVABLE page %s, %s the region.",
+       page != NULL ? "granted" : "refused",
+       palloc_free_count (PAL_CONTIG) == region_free - RUN_PAGES - 1
+       ? "from" : "not from");
+
+  palloc_free_page (page);
+  palloc_free_multiple (run, RUN_PAGES);
+  free_list (even);
+  free_list (rest);
+  free_list (odd);
+  msg ("Region %s.", palloc_free_count (PAL_CONTIG) == region_free
+       ? "fully free again" : "still in use");
+}
+
+/* Takes every free page of the kernel pool, one at a time.
+   Returns a list, linked through the pages' first words, of the
+   ones at even page numbers, and stores a list of the rest in
+   *ODD. */
+static void *
+take_all (void **odd)
+{
+  void *even = NULL;
+  void *page;
+
+  *odd = NULL;
+  while ((page = palloc_get_page (0)) != NULL)
+    {
+      void **list = pg_no (page) % 2 ? odd : &even;
+      *(void **) page = *list;
+      *list = page;
+    }
+  return even;
+}
+
+/* Frees the pages in LIST, as returned by take_all(). */
+static void
+free_list (void *list)
+{
+  while (list != NULL)
+    {
+      void *next = *(void **) list;
+      palloc_free_page (list);
+      list = next;
+    }
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(palloc-contig) begin
+(palloc-contig) Contiguous region present.
+(palloc-contig) Ordinary 16-page run refused.
+(palloc-contig) PAL_CONTIG 16-page run granted, from the region.
+(palloc-contig) Ordinary page refused.
+(palloc-contig) PAL_MOVABLE page granted, from the region.
+(palloc-contig) Region fully free again.
+(palloc-contig) end
+EOF
+pass;
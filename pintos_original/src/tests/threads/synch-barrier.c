@@ -0,0 +1,69 @@
+/* Runs worker threads through several phases separated by a
+   barrier, then waits for them all to finish on a latch.  Checks
+   that no worker starts a phase before every worker has finished
+   the one before, and that exactly one worker per phase is told
+   it arrived last. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define WORKER_CNT 8
+#define PHASE_CNT 4
+
+static thread_func barrier_worker;
+static struct barrier barrier;
+static struct latch done;
+static int arrived[PHASE_CNT];
+static int last_cnt[PHASE_CNT];
+static int early_cnt;
+
+void
+test_synch_barrier (void) 
+{
+  int i;
+
+  barrier_init (&barrier, WORKER_CNT);
+  latch_init (&done, WORKER_CNT);
+  for (i = 0; i < WORKER_CNT; i++) 
+    {
+      char name[16];
+      snprintf (name, sizeof name, "worker %d", i);
+      thread_create (name, PRI_DEFAULT, barrier_worker, NULL);
+    }
+
+  latch_wait (&done);
+  msg ("All %d workers finished.", WORKER_CNT);
+  for (i = 0; i < PHASE_CNT; i++)
+    msg ("Phase %d: %d arrived, %d last.", i, arrived[i], last_cnt[i]);
+  msg ("%d workers ran ahead of the barrier.", early_cnt);
+}
+
+static void
+barrier_worker (void *aux UNUSED) 
+{
+  int phase;
+
+  for (phase = 0; phase < PHASE_CNT; phase++)
+    {
+      enum intr_level old_level = intr_disable ();
+      if (phase > 0 && arrived[phase - 1] != WORKER_CNT)
+        early_cnt++;
+      arrived[phase]++;
+      intr_set_level (old_level);
+
+      /* Give the others a chance to run ahead, if they could. */
+      thread_yield ();
+
+      if (barrier_wait (&barrier))
+        {
+          old_level = intr_disable ();
+          last_cnt[phase]++;
+          intr_set_level (old_level);
+        }
+    }
+  latch_count_down (&done);
+}
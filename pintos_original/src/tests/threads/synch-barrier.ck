@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(synch-barrier) begin
+(synch-barrier) All 8 workers finished.
+(synch-barrier) Phase 0: 8 arrived, 1 last.
+(synch-barrier) Phase 1: 8 arrived, 1 last.
+(synch-barrier) Phase 2: 8 arrived, 1 last.
+(synch-barrier) Phase 3: 8 arrived, 1 last.
+(synch-barrier) 0 workers ran ahead of the barrier.
+(synch-barrier) end
+EOF
+pass;
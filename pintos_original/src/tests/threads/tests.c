@@ -2,6 +2,7 @@
 #include <debug.h>
 #include <string.h>
 #include <stdio.h>
+#include "tests/bench/bench.h"
 
 struct test 
   {
@@ -29,6 +30,8 @@ static const struct test tests[] =
     {"priority-preempt", test_priority_preempt},
     {"priority-sema", test_priority_sema},
     {"priority-condvar", test_priority_condvar},
+    {"synch-barrier", test_synch_barrier},
+    {"palloc-contig", test_palloc_contig},
     {"mlfqs-load-1", test_mlfqs_load_1},
     {"mlfqs-load-60", test_mlfqs_load_60},
     {"mlfqs-load-avg", test_mlfqs_load_avg},
@@ -38,20 +41,37 @@ static const struct test tests[] =
     {"mlfqs-nice-2", test_mlfqs_nice_2},
     {"mlfqs-nice-10", test_mlfqs_nice_10},
     {"mlfqs-block", test_mlfqs_block},
+    {"bench-switch", test_bench_switch},
+    {"bench-create", test_bench_create},
+    {"bench-sema", test_bench_sema},
+    {"bench-malloc", test_bench_malloc},
+    {"bench-alloc", test_bench_alloc},
+    {"bench-palloc", test_bench_palloc},
+    {"bench-sleep", test_bench_sleep},
+    {"bench-signal", test_bench_signal},
+    {"bench-sched-rr", test_bench_sched},
+    {"bench-sched-mlfq", test_bench_sched},
   };
 
 static const char *test_name;
 
-/* Runs the test named NAME. */
+/* Arguments that followed the test name, separated from it by
+   spaces, or an empty string. */
+const char *test_args;
+
+/* Runs the test named by the first word of NAME, passing it the
+   rest of NAME in test_args. */
 void
 run_test (const char *name) 
 {
   const struct test *t;
+  size_t len = strcspn (name, " ");
 
+  test_args = name + len + strspn (name + len, " ");
   for (t = tests; t < tests + sizeof tests / sizeof *tests; t++)
-    if (!strcmp (name, t->name))
+    if (strlen (t->name) == len && !memcmp (name, t->name, len))
       {
-        test_name = name;
+        test_name = t->name;
         msg ("begin");
         t->function ();
         msg ("end");
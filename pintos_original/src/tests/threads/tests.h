@@ -2,6 +2,7 @@
 #define TESTS_THREADS_TESTS_H
 
 void run_test (const char *);
+extern const char *test_args;
 
 typedef void test_func (void);
 
@@ -23,6 +24,8 @@ extern test_func test_priority_fifo;
 extern test_func test_priority_preempt;
 extern test_func test_priority_sema;
 extern test_func test_priority_condvar;
+extern test_func test_synch_barrier;
+extern test_func test_palloc_contig;
 extern test_func test_mlfqs_load_1;
 extern test_func test_mlfqs_load_60;
 extern test_func test_mlfqs_load_avg;
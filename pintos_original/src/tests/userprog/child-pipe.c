@@ -0,0 +1,23 @@
+/* Child process run by the pipe-exec test.
+   Copies its console input to its console output until end of
+   file, reading into page-aligned memory.  Its exit code is 0,
+   or 1 if a write falls short. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+
+const char *test_name = "child-pipe";
+
+static char buf[4 * 4096] __attribute__ ((aligned (4096)));
+
+int
+main (void) 
+{
+  int n;
+
+  while ((n = read (STDIN_FILENO, buf, sizeof buf)) > 0)
+    if (write (STDOUT_FILENO, buf, n) != n)
+      return 1;
+  return 0;
+}
@@ -0,0 +1,38 @@
+/* Exercises futex_wait() and futex_wake() within one process,
+   where there is no one to wake it: a wait on a word that has
+   changed returns at once, a wait on one that hasn't times out,
+   and a wake finds no one.  Then takes and releases a mutex,
+   which uncontended never marks itself for the kernel. */
+
+#include <futex.h>
+#include <mutex.h>
+#include <syscall.h>
+#include <vdso.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  static struct mutex m = MUTEX_INITIALIZER;
+  int word = 5;
+  int64_t start;
+
+  CHECK (futex_wait (&word, 4, -1) == FUTEX_CHANGED,
+         "wait on a changed word");
+  start = vdso_ticks ();
+  CHECK (futex_wait (&word, 5, 50) == FUTEX_TIMEOUT, "wait times out");
+  if (vdso_ticks () == start)
+    fail ("timed out without waiting");
+  CHECK (futex_wake (&word, 1) == 0, "wake with no waiters");
+  CHECK (futex_wait ((int *) ((char *) &word + 1), 0, 0) == -1,
+         "misaligned word rejected");
+
+  mutex_lock (&m);
+  CHECK (m.state == 1, "lock free mutex without contention");
+  CHECK (!mutex_trylock (&m), "trylock held mutex fails");
+  mutex_unlock (&m);
+  CHECK (mutex_trylock (&m), "trylock free mutex");
+  mutex_unlock (&m);
+  CHECK (m.state == 0, "unlock");
+}
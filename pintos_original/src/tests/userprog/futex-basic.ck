@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(futex-basic) begin
+(futex-basic) wait on a changed word
+(futex-basic) wait times out
+(futex-basic) wake with no waiters
+(futex-basic) misaligned word rejected
+(futex-basic) lock free mutex without contention
+(futex-basic) trylock held mutex fails
+(futex-basic) trylock free mutex
+(futex-basic) unlock
+(futex-basic) end
+futex-basic: exit(0)
+EOF
+pass;
@@ -0,0 +1,59 @@
+/* Passes data through a pipe within one process: a short
+   message, then several whole pages read back into page-aligned
+   memory, which the kernel may hand over by remapping.  Then
+   checks that closing the write end gives end of file and that
+   writing with no reader left fails. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 4
+
+static char out[PAGE_CNT * PAGE_SIZE] __attribute__ ((aligned (PAGE_SIZE)));
+static char in[PAGE_CNT * PAGE_SIZE] __attribute__ ((aligned (PAGE_SIZE)));
+
+void
+test_main (void) 
+{
+  static const char hello[] = "hello, pipe";
+  char buf[sizeof hello];
+  int fds[2];
+  size_t i;
+
+  CHECK (pipe (fds), "pipe");
+  if (fds[0] < 2 || fds[1] < 2 || fds[0] == fds[1])
+    fail ("pipe returned handles %d and %d", fds[0], fds[1]);
+  CHECK (filesize (fds[0]) == -1, "filesize on a pipe fails");
+
+  CHECK (write (fds[1], hello, sizeof hello) == sizeof hello,
+         "write short message");
+  CHECK (read (fds[0], buf, sizeof buf) == sizeof buf,
+         "read short message");
+  if (memcmp (buf, hello, sizeof hello))
+    fail ("short message garbled");
+
+  for (i = 0; i < sizeof out; i++)
+    out[i] = i * 7 + i / PAGE_SIZE;
+  CHECK (write (fds[1], out, sizeof out) == sizeof out, "write %d pages",
+         PAGE_CNT);
+  CHECK (read (fds[0], in, sizeof in) == sizeof in, "read %d pages",
+         PAGE_CNT);
+  for (i = 0; i < sizeof in; i++)
+    if (in[i] != out[i])
+      fail ("byte %zu is %d, expected %d", i, in[i], out[i]);
+  in[0] = out[0] + 1;
+  CHECK (in[0] != out[0], "buffers still separate");
+
+  close (fds[1]);
+  CHECK (read (fds[0], buf, sizeof buf) == 0, "end of file");
+  close (fds[0]);
+
+  CHECK (pipe (fds), "pipe");
+  close (fds[0]);
+  CHECK (write (fds[1], hello, sizeof hello) == -1,
+         "write with no reader fails");
+  close (fds[1]);
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(pipe-basic) begin
+(pipe-basic) pipe
+(pipe-basic) filesize on a pipe fails
+(pipe-basic) write short message
+(pipe-basic) read short message
+(pipe-basic) write 4 pages
+(pipe-basic) read 4 pages
+(pipe-basic) buffers still separate
+(pipe-basic) end of file
+(pipe-basic) pipe
+(pipe-basic) write with no reader fails
+(pipe-basic) end
+pipe-basic: exit(0)
+EOF
+pass;
@@ -0,0 +1,47 @@
+/* Starts child-pipe with its console input and output
+   redirected to two pipes, feeds it several pages through one,
+   and reads them back through the other until end of file,
+   which comes when the child exits. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define DATA_SIZE (8 * 4096 + 100)
+
+static char out[DATA_SIZE];
+static char in[DATA_SIZE + 1];
+
+void
+test_main (void) 
+{
+  int to_child[2], from_child[2];
+  size_t ofs;
+  pid_t pid;
+  int n;
+
+  CHECK (pipe (to_child) && pipe (from_child), "create pipes");
+  CHECK ((pid = exec_redirect ("child-pipe", to_child[0], from_child[1]))
+         != PID_ERROR, "exec_redirect \"child-pipe\"");
+  close (to_child[0]);
+  close (from_child[1]);
+
+  for (ofs = 0; ofs < sizeof out; ofs++)
+    out[ofs] = ofs % 251;
+  CHECK (write (to_child[1], out, sizeof out) == sizeof out,
+         "write %zu bytes", sizeof out);
+  close (to_child[1]);
+
+  for (ofs = 0; (n = read (from_child[0], in + ofs, sizeof in - ofs)) > 0;
+       ofs += n)
+    continue;
+  if (ofs != sizeof out)
+    fail ("read back %zu bytes, expected %zu", ofs, sizeof out);
+  if (memcmp (in, out, sizeof out))
+    fail ("data garbled");
+  msg ("read back %zu bytes", ofs);
+  close (from_child[0]);
+
+  CHECK (wait (pid) == 0, "wait for child");
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(pipe-exec) begin
+(pipe-exec) create pipes
+(pipe-exec) exec_redirect "child-pipe"
+(pipe-exec) write 32868 bytes
+child-pipe: exit(0)
+(pipe-exec) read back 32868 bytes
+(pipe-exec) wait for child
+(pipe-exec) end
+pipe-exec: exit(0)
+EOF
+pass;
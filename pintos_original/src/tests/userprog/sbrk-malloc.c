@@ -0,0 +1,97 @@
+/* Moves the break with sbrk() and checks that the pages it adds
+   are usable and zeroed, then allocates, resizes, and frees
+   blocks of many sizes with malloc() and checks that none of
+   them overlap. */
+
+#include <malloc.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define BLOCK_CNT 64
+
+static char *blocks[BLOCK_CNT];
+static size_t sizes[BLOCK_CNT];
+
+static void
+fill (int i)
+{
+  memset (blocks[i], i + 1, sizes[i]);
+}
+
+static void
+check (int i)
+{
+  size_t j;
+
+  for (j = 0; j < sizes[i]; j++)
+    if (blocks[i][j] != (char) (i + 1))
+      fail ("block %d of %zu bytes corrupted at byte %zu",
+            i, sizes[i], j);
+}
+
+void
+test_main (void) 
+{
+  char *old, *page;
+  int i;
+
+  /* The break moves by exactly what is asked. */
+  old = sbrk (0);
+  CHECK (old != SBRK_FAILED, "sbrk(0)");
+  page = sbrk (2 * PAGE_SIZE);
+  CHECK (page == old, "sbrk(2 pages)");
+  for (i = 0; i < 2 * PAGE_SIZE; i++)
+    if (page[i] != 0)
+      fail ("heap byte %d is not zero", i);
+  memset (page, 0x5a, 2 * PAGE_SIZE);
+  CHECK (sbrk (-2 * PAGE_SIZE) == old + 2 * PAGE_SIZE, "sbrk(-2 pages)");
+  CHECK (sbrk (0) == old, "break back where it started");
+  CHECK (sbrk (-1) == SBRK_FAILED, "sbrk below the heap must fail");
+  CHECK (sbrk (0x7fffffff) == SBRK_FAILED, "sbrk into the stack must fail");
+
+  /* Blocks of all sizes keep their contents. */
+  for (i = 0; i < BLOCK_CNT; i++)
+    {
+      sizes[i] = (i * 997) % (3 * PAGE_SIZE) + 1;
+      blocks[i] = malloc (sizes[i]);
+      if (blocks[i] == NULL)
+        fail ("malloc(%zu) failed", sizes[i]);
+      fill (i);
+    }
+  for (i = 0; i < BLOCK_CNT; i++)
+    check (i);
+  msg ("malloc");
+
+  /* Freeing every other block and growing the rest moves them
+     without losing their contents. */
+  for (i = 0; i < BLOCK_CNT; i += 2)
+    {
+      free (blocks[i]);
+      blocks[i] = NULL;
+    }
+  for (i = 1; i < BLOCK_CNT; i += 2)
+    {
+      size_t old_size = sizes[i];
+      blocks[i] = realloc (blocks[i], old_size * 2);
+      if (blocks[i] == NULL)
+        fail ("realloc(%zu) failed", old_size * 2);
+      check (i);
+      sizes[i] = old_size * 2;
+      fill (i);
+    }
+  for (i = 1; i < BLOCK_CNT; i += 2)
+    check (i);
+  msg ("realloc");
+
+  for (i = 1; i < BLOCK_CNT; i += 2)
+    free (blocks[i]);
+  page = calloc (PAGE_SIZE, 16);
+  CHECK (page != NULL, "calloc");
+  for (i = 0; i < 16 * PAGE_SIZE; i++)
+    if (page[i] != 0)
+      fail ("calloc'd byte %d is not zero", i);
+  free (page);
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(sbrk-malloc) begin
+(sbrk-malloc) sbrk(0)
+(sbrk-malloc) sbrk(2 pages)
+(sbrk-malloc) sbrk(-2 pages)
+(sbrk-malloc) break back where it started
+(sbrk-malloc) sbrk below the heap must fail
+(sbrk-malloc) sbrk into the stack must fail
+(sbrk-malloc) malloc
+(sbrk-malloc) realloc
+(sbrk-malloc) calloc
+(sbrk-malloc) end
+sbrk-malloc: exit(0)
+EOF
+pass;
@@ -0,0 +1,43 @@
+/* Reads the time page that the kernel maps into every process:
+   the tick count must advance while the process spins, the
+   spinning must be counted as user time, and the TSC-based time
+   must never go backward. */
+
+#include <vdso.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  struct vdso v;
+  int64_t start;
+  uint64_t ns, last_ns;
+  int i;
+
+  vdso_read (&v);
+  if (v.tick_freq == 0)
+    fail ("tick_freq is 0");
+  msg ("tick rate is set");
+
+  start = vdso_ticks ();
+  while (vdso_ticks () < start + 5)
+    continue;
+  msg ("ticks advance");
+
+  vdso_read (&v);
+  if (v.user_ticks <= 0)
+    fail ("user_ticks = %lld after spinning", (long long) v.user_ticks);
+  msg ("user ticks counted");
+
+  last_ns = vdso_ns ();
+  for (i = 0; i < 1000; i++)
+    {
+      ns = vdso_ns ();
+      if (ns < last_ns)
+        fail ("time went from %llu to %llu ns",
+              (unsigned long long) last_ns, (unsigned long long) ns);
+      last_ns = ns;
+    }
+  msg ("time never goes backward");
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(vdso-time) begin
+(vdso-time) tick rate is set
+(vdso-time) ticks advance
+(vdso-time) user ticks counted
+(vdso-time) time never goes backward
+(vdso-time) end
+vdso-time: exit(0)
+EOF
+pass;
@@ -0,0 +1,27 @@
+/* Reaps subprocesses with wait_any(), which must return each one
+   with its exit code.  Once a subprocess has been reaped, wait()
+   for it must return -1, and so must wait_any() once there are no
+   subprocesses left. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int i;
+
+  for (i = 0; i < 2; i++)
+    {
+      pid_t child = exec ("child-simple");
+      int status = -1;
+      pid_t reaped = wait_any (&status);
+
+      if (reaped != child)
+        fail ("wait_any() returned %d, not %d", reaped, child);
+      msg ("wait_any() status = %d", status);
+      msg ("wait(reaped child) = %d", wait (child));
+    }
+  msg ("wait_any() = %d", wait_any (NULL));
+}
@@ -0,0 +1,58 @@
+/* Forks a child that shares the parent's memory copy-on-write,
+   then checks that pages written by either process afterward
+   change only for that process, and that the child inherits the
+   parent's open file and pipe. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[2 * 4096];
+
+static bool all_same (char);
+
+void
+test_main (void)
+{
+  int handle, fds[2];
+  pid_t pid;
+  char c;
+
+  memset (buf, 'p', sizeof buf);
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (pipe (fds), "pipe");
+
+  pid = fork ();
+  if (pid == 0)
+    {
+      /* Wait for the parent to write BUF, then write it here. */
+      if (read (fds[0], &c, 1) != 1 || !all_same ('p'))
+        exit (1);
+      memset (buf, 'c', sizeof buf);
+      if (read (handle, &c, 1) != 1 || c != sample[0])
+        exit (2);
+      exit (81);
+    }
+  CHECK (pid != PID_ERROR, "fork");
+
+  msg ("write in parent");
+  memset (buf, 'q', sizeof buf);
+  write (fds[1], "x", 1);
+  CHECK (wait (pid) == 81, "wait for child");
+  if (!all_same ('q'))
+    fail ("child's write changed the parent's memory");
+}
+
+/* Returns true if every byte of BUF is C. */
+static bool
+all_same (char c)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof buf; i++)
+    if (buf[i] != c)
+      return false;
+  return true;
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(fork-cow) begin
+(fork-cow) open "sample.txt"
+(fork-cow) pipe
+(fork-cow) fork
+(fork-cow) write in parent
+fork-cow: exit(81)
+(fork-cow) wait for child
+(fork-cow) end
+fork-cow: exit(0)
+EOF
+pass;
@@ -0,0 +1,258 @@
+#include "threads/fpu.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+
+/* Lazy FPU context switching.  See [IA32-v3a] 13.4 "Designing
+   OS Facilities for Saving x87 FPU, SSE and Extended States on
+   Task or Context Switches".
+
+   The kernel is compiled with -msoft-float, so only user
+   programs use the x87 FPU and SSE registers, and most threads
+   never touch them.  Instead of saving and restoring those
+   registers on every switch, the registers keep the state of
+   whichever thread used them last, fpu_owner.  Switching to any
+   other thread sets CR0.TS, so that its first FPU instruction
+   raises #NM.  The #NM handler then saves fpu_owner's state,
+   loads the current thread's, and makes it the owner.  A thread
+   that does not use the FPU costs nothing beyond, at most, a
+   write to CR0 per switch.
+
+   State is saved with FXSAVE, which covers the SSE registers as
+   well, if the CPU has it, and otherwise with FNSAVE.  Each
+   thread's state is allocated the first time it uses the FPU. */
+
+/* CR0 and CR4 bits. */
+#define CR0_MP 0x00000002       /* Monitor coprocessor: WAIT honors TS. */
+#define CR0_EM 0x00000004       /* Emulation: FPU instructions trap. */
+#define CR0_TS 0x00000008       /* Task switched: FPU instructions trap. */
+#define CR4_OSFXSR 0x00000200   /* OS supports FXSAVE and SSE. */
+#define CR4_OSXMMEXCPT 0x00000400 /* OS supports #XF. */
+
+/* CPUID(1).EDX feature bits. */
+#define CPUID_FXSR 0x01000000   /* FXSAVE and FXRSTOR. */
+#define CPUID_SSE 0x02000000    /* SSE. */
+
+/* Size and alignment of a saved state.  FNSAVE needs only 108
+   bytes, with no alignment. */
+#define FPU_SIZE 512
+#define FPU_ALIGN 16
+
+static bool has_fxsr;           /* Use FXSAVE rather than FNSAVE? */
+static bool ts_set;             /* Is CR0.TS set? */
+static struct thread *fpu_owner; /* Thread whose state is loaded. */
+
+/* State of a freshly initialized FPU, given to each thread the
+   first time it uses the FPU. */
+static uint8_t initial_state[FPU_SIZE] __attribute__ ((aligned (FPU_ALIGN)));
+
+static intr_handler_func fpu_trap;
+static void *state_of (struct thread *);
+
+static inline uint32_t
+read_cr0 (void)
+{
+  uint32_t cr0;
+  asm volatile ("movl %%cr0, %0" : "=r" (cr0));
+  return cr0;
+}
+
+static inline void
+write_cr0 (uint32_t cr0)
+{
+  asm volatile ("movl %0, %%cr0" : : "r" (cr0) : "memory");
+}
+
+/* Clears CR0.TS, so that FPU instructions run. */
+static inline void
+clear_ts (void)
+{
+  if (ts_set)
+    {
+      asm volatile ("clts");
+      ts_set = false;
+    }
+}
+
+/* Sets CR0.TS, so that FPU instructions raise #NM. */
+static inline void
+set_ts (void)
+{
+  if (!ts_set)
+    {
+      write_cr0 (read_cr0 () | CR0_TS);
+      ts_set = true;
+    }
+}
+
+/* Saves the FPU's state into STATE.  FNSAVE also reinitializes
+   the FPU, which does not matter because its state is about to
+   be replaced. */
+static inline void
+save (void *state)
+{
+  if (has_fxsr)
+    asm volatile ("fxsave %0" : "=m" (*(uint8_t (*)[FPU_SIZE]) state));
+  else
+    asm volatile ("fnsave %0" : "=m" (*(uint8_t (*)[FPU_SIZE]) state));
+}
+
+/* Loads the FPU's state from STATE. */
+static inline void
+restore (const void *state)
+{
+  if (has_fxsr)
+    asm volatile ("fxrstor %0" : : "m" (*(const uint8_t (*)[FPU_SIZE]) state));
+  else
+    asm volatile ("frstor %0" : : "m" (*(const uint8_t (*)[FPU_SIZE]) state));
+}
+
+/* Turns on the FPU, records its initial state, and registers
+   the #NM handler.  Until this is called, FPU instructions fault
+   because start.S sets CR0.EM. */
+void
+fpu_init (void)
+{
+  uint32_t eax, ebx, ecx, edx;
+  uint32_t cr4;
+
+  asm ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (1));
+  has_fxsr = (edx & CPUID_FXSR) != 0;
+  if (has_fxsr)
+    {
+      asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+      cr4 |= CR4_OSFXSR;
+      if (edx & CPUID_SSE)
+        cr4 |= CR4_OSXMMEXCPT;
+      asm volatile ("movl %0, %%cr4" : : "r" (cr4));
+    }
+
+  write_cr0 ((read_cr0 () & ~(CR0_EM | CR0_TS)) | CR0_MP);
+  ts_set = false;
+  asm volatile ("fninit");
+  if (edx & CPUID_SSE)
+    {
+      uint32_t mxcsr = 0x1f80;  /* All exceptions masked. */
+      asm volatile ("ldmxcsr %0" : : "m" (mxcsr));
+    }
+  save (initial_state);
+  set_ts ();
+
+  intr_register_int (7, 0, INTR_ON, fpu_trap,
+                     "#NM Device Not Available Exception");
+}
+
+/* Called by the scheduler, with interrupts off, just after
+   switching to thread T.  Lets T use the FPU directly if its
+   state is loaded, and otherwise arranges for its first FPU
+   instruction to trap. */
+void
+fpu_switch (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (t == fpu_owner)
+    clear_ts ();
+  else
+    set_ts ();
+}
+
+/* Gives the current thread a copy of thread FROM's FPU state, as
+   for fork().  Returns true if successful, false if memory is
+   short. */
+bool
+fpu_copy (struct thread *from)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (cur->fpu == NULL);
+
+  if (from->fpu == NULL)
+    return true;
+  cur->fpu = malloc (FPU_SIZE + FPU_ALIGN - 1);
+  if (cur->fpu == NULL)
+    return false;
+
+  old_level = intr_disable ();
+  if (fpu_owner == from)
+    {
+      /* FROM's latest state is in the FPU, not in memory. */
+      clear_ts ();
+      save (state_of (from));
+      if (!has_fxsr)
+        restore (state_of (from));
+      set_ts ();
+    }
+  memcpy (state_of (cur), state_of (from), FPU_SIZE);
+  intr_set_level (old_level);
+  return true;
+}
+
+/* Frees the current thread's FPU state.  Called by
+   thread_exit(). */
+void
+fpu_exit (void)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  if (cur->fpu == NULL)
+    return;
+
+  old_level = intr_disable ();
+  if (fpu_owner == cur)
+    {
+      fpu_owner = NULL;
+      set_ts ();
+    }
+  intr_set_level (old_level);
+
+  free (cur->fpu);
+  cur->fpu = NULL;
+}
+
+/* #NM handler.  Makes the current thread the owner of the FPU,
+   saving the previous owner's state and loading the current
+   thread's. */
+static void
+fpu_trap (struct intr_frame *f UNUSED)
+{
+  struct thread *cur = thread_current ();
+  bool fresh = cur->fpu == NULL;
+  enum intr_level old_level;
+
+  /* Allocate first, because malloc() may sleep. */
+  if (fresh)
+    {
+      cur->fpu = malloc (FPU_SIZE + FPU_ALIGN - 1);
+      if (cur->fpu == NULL)
+        {
+          printf ("%s: out of memory for FPU state\n", thread_name ());
+          thread_exit ();
+        }
+    }
+
+  old_level = intr_disable ();
+  clear_ts ();
+  if (fpu_owner != cur)
+    {
+      if (fpu_owner != NULL)
+        save (state_of (fpu_owner));
+      restore (fresh ? initial_state : state_of (cur));
+      fpu_owner = cur;
+    }
+  intr_set_level (old_level);
+}
+
+/* Returns the aligned state buffer within T's allocation. */
+static void *
+state_of (struct thread *t)
+{
+  return (void *) ROUND_UP ((uintptr_t) t->fpu, FPU_ALIGN);
+}
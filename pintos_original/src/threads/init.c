@@ -9,22 +9,34 @@
 #include <stdlib.h>
 #include <string.h>
 #include "devices/kbd.h"
+#include "devices/klog.h"
+#include "devices/profile.h"
 #include "devices/input.h"
 #include "devices/serial.h"
 #include "devices/shutdown.h"
 #include "devices/timer.h"
 #include "devices/vga.h"
 #include "devices/rtc.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
+#include "threads/kstack.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
+#include "threads/mp.h"
 #include "threads/palloc.h"
+#include "threads/sched-trace.h"
 #include "threads/pte.h"
+#include "threads/rcu.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/tunable.h"
+#include "threads/workqueue.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
+#include "userprog/exec-cache.h"
+#include "userprog/futex.h"
 #include "userprog/gdt.h"
 #include "userprog/syscall.h"
 #include "userprog/tss.h"
@@ -34,8 +46,17 @@
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "devices/overlay.h"
+#include "devices/ramdisk.h"
+#include "devices/stripe.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#include "filesys/inode.h"
+#endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/swap.h"
 #endif
 
 /* Page directory with kernel mappings only. */
@@ -52,15 +73,30 @@ static const char *scratch_bdev_name;
 #ifdef VM
 static const char *swap_bdev_name;
 #endif
+
+/* -stripe: Names of block devices to stripe together, or null. */
+static char *stripe_bdev_names;
+
+/* -ramdisk: Size of RAM disk to create, in kB, or 0 for none. */
+static size_t ramdisk_kb;
+
+/* -overlay: Names of overlay base and scratch devices, or null. */
+static char *overlay_bdev_names;
 #endif /* FILESYS */
 
 /* -ul: Maximum number of pages to put into palloc's user pool. */
 static size_t user_page_limit = SIZE_MAX;
 
+/* -snapshot: Wait after initialization for the actions to run,
+   sent over the serial port by "pintos --snapshot"? */
+static bool snapshot_wait;
+
 static void bss_init (void);
 static void paging_init (void);
 
 static char **read_command_line (void);
+static char **read_snapshot_actions (void);
+static void print_arguments (const char *title, char **argv);
 static char **parse_options (char **argv);
 static void run_actions (char **argv);
 static void usage (void);
@@ -97,7 +133,10 @@ main (void)
   /* Initialize memory system. */
   palloc_init (user_page_limit);
   malloc_init ();
+  sched_trace_init ();
   paging_init ();
+  kstack_init ();
+  mp_init ();
 
   /* Segmentation. */
 #ifdef USERPROG
@@ -107,27 +146,49 @@ main (void)
 
   /* Initialize interrupt handlers. */
   intr_init ();
+  fpu_init ();
   timer_init ();
   kbd_init ();
   input_init ();
 #ifdef USERPROG
   exception_init ();
   syscall_init ();
+  exec_cache_init ();
+  futex_init ();
+  process_init ();
 #endif
 
   /* Start thread scheduler and enable interrupts. */
   thread_start ();
+  workqueue_init ();
+  rcu_init ();
   serial_init_queue ();
+  klog_start ();
   timer_calibrate ();
 
 #ifdef FILESYS
   /* Initialize file system. */
   ide_init ();
+  if (ramdisk_kb != 0)
+    ramdisk_init (ramdisk_kb);
+  if (stripe_bdev_names != NULL)
+    stripe_init (stripe_bdev_names);
+  if (overlay_bdev_names != NULL)
+    overlay_init (overlay_bdev_names);
   locate_block_devices ();
   filesys_init (format_filesys);
 #endif
 
+#ifdef VM
+  /* Initialize virtual memory. */
+  page_init ();
+  frame_init ();
+  swap_init ();
+#endif
+
   printf ("Boot complete.\n");
+  if (snapshot_wait)
+    argv = read_snapshot_actions ();
   
   /* Run actions specified on kernel command line. */
   run_actions (argv);
@@ -150,16 +211,44 @@ bss_init (void)
   memset (&_start_bss, 0, &_end_bss - &_start_bss);
 }
 
+/* Returns the feature flags that CPUID returns in EDX, such as
+   CPUID_PSE and CPUID_PGE, or 0 if the CPU's CPUID has no
+   feature leaf.  See [IA32-v2a] "CPUID". */
+static uint32_t
+cpu_features (void)
+{
+  uint32_t eax, ebx, ecx, edx;
+
+  asm ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (0));
+  if (eax < 1)
+    return 0;
+  asm ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (1));
+  return edx;
+}
+
 /* Populates the base page directory and page table with the
    kernel virtual mapping, and then sets up the CPU to use the
    new page directory.  Points init_page_dir to the page
-   directory it creates. */
+   directory it creates.
+
+   If the CPU supports them, each 4 MB of RAM that lies wholly
+   in memory and holds no kernel text is mapped with a single
+   4 MB page directory entry, saving a page table and extending
+   the TLB's reach.  The rest is mapped with 4 kB pages, so that
+   the kernel text can stay read-only.
+
+   The kernel mapping is the same in every page directory, so if
+   the CPU supports global pages it is marked global.  Its TLB
+   entries then survive the CR3 reloads of process switches. */
 static void
 paging_init (void)
 {
   uint32_t *pd, *pt;
   size_t page;
   extern char _start, _end_kernel_text;
+  uint32_t features = cpu_features ();
+  bool pse = (features & CPUID_PSE) != 0;
+  uint32_t global = features & CPUID_PGE ? PTE_G : 0;
 
   pd = init_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
   pt = NULL;
@@ -173,11 +262,28 @@ paging_init (void)
 
       if (pd[pde_idx] == 0)
         {
+          if (pse && pte_idx == 0
+              && page + PTSPAN / PGSIZE <= init_ram_pages
+              && (vaddr + PTSPAN <= &_start || vaddr >= &_end_kernel_text))
+            {
+              pd[pde_idx] = pde_create_large_kernel (vaddr, true) | global;
+              page += PTSPAN / PGSIZE - 1;
+              continue;
+            }
           pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
           pd[pde_idx] = pde_create (pt);
         }
 
-      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text);
+      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text) | global;
+    }
+
+  /* Large pages need CR4.PSE set before they are used.  See
+     [IA32-v3a] 3.6.1 "Paging Options". */
+  if (pse)
+    {
+      uint32_t cr4;
+      asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+      asm volatile ("movl %0, %%cr4" : : "r" (cr4 | CR4_PSE));
     }
 
   /* Store the physical address of the page directory into CR3
@@ -186,6 +292,16 @@ paging_init (void)
      to/from Control Registers" and [IA32-v3a] 3.7.5 "Base Address
      of the Page Directory". */
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)));
+
+  /* Global pages are enabled only once the kernel mapping is
+     final, so that no stale global entry lingers.  See
+     [IA32-v3a] 3.11 "Translation Lookaside Buffers (TLBs)". */
+  if (global)
+    {
+      uint32_t cr4;
+      asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+      asm volatile ("movl %0, %%cr4" : : "r" (cr4 | CR4_PGE) : "memory");
+    }
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -211,23 +327,66 @@ read_command_line (void)
     }
   argv[argc] = NULL;
 
-  /* Print kernel command line. */
-  printf ("Kernel command line:");
-  for (i = 0; i < argc; i++)
-    if (strchr (argv[i], ' ') == NULL)
-      printf (" %s", argv[i]);
-    else
-      printf (" '%s'", argv[i]);
-  printf ("\n");
+  print_arguments ("Kernel command line", argv);
+  return argv;
+}
 
+/* Announces that initialization is complete, then reads the
+   actions to run from the console and returns them as an
+   argv-like array.  "pintos --snapshot" saves the machine when it
+   sees the announcement, and each later run restores it and
+   sends its actions, each null-terminated, then a new-line.  So
+   every run after the first skips booting. */
+static char **
+read_snapshot_actions (void)
+{
+  static char line[512];
+  static char *argv[sizeof line / 2 + 1];
+  size_t length = 0;
+  int argc = 0;
+  char *p;
+
+  printf ("Snapshot point.\n");
+  for (;;)
+    {
+      uint8_t c = input_getc ();
+      if (c == '\n')
+        break;
+      if (length >= sizeof line - 1)
+        PANIC ("snapshot actions overflow");
+      line[length++] = c;
+    }
+  line[length] = '\0';
+
+  for (p = line; p < line + length; p += strlen (p) + 1)
+    argv[argc++] = p;
+  argv[argc] = NULL;
+
+  print_arguments ("Actions", argv);
   return argv;
 }
 
+/* Prints TITLE and the arguments in ARGV, quoting any that
+   contain spaces. */
+static void
+print_arguments (const char *title, char **argv)
+{
+  printf ("%s:", title);
+  for (; *argv != NULL; argv++)
+    if (strchr (*argv, ' ') == NULL)
+      printf (" %s", *argv);
+    else
+      printf (" '%s'", *argv);
+  printf ("\n");
+}
+
 /* Parses options in ARGV[]
    and returns the first non-option argument. */
 static char **
 parse_options (char **argv) 
 {
+  bool list_tunables = false;
+
   for (; *argv != NULL && **argv == '-'; argv++)
     {
       char *save_ptr;
@@ -247,22 +406,84 @@ parse_options (char **argv)
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-stripe"))
+        stripe_bdev_names = value;
+      else if (!strcmp (name, "-ramdisk"))
+        ramdisk_kb = atoi (value);
+      else if (!strcmp (name, "-overlay"))
+        overlay_bdev_names = value;
+      else if (!strcmp (name, "-extents"))
+        inode_extents = true;
+      else if (!strcmp (name, "-iosched"))
+        {
+          if (value == NULL || !block_set_scheduler (value))
+            PANIC ("unknown I/O scheduler `%s' (use -h for help)", value);
+        }
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
 #endif
 #endif
+      else if (!strcmp (name, "-o"))
+        {
+          if (argv[1] != NULL && !strcmp (argv[1], "list"))
+            list_tunables = true;
+          else
+            tunable_set (argv[1]);
+          if (argv[1] != NULL)
+            argv++;
+        }
+      else if (!strcmp (name, "-snapshot"))
+        snapshot_wait = true;
       else if (!strcmp (name, "-rs"))
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-tickless"))
+        timer_tickless = true;
+      else if (!strcmp (name, "-hrtimer"))
+        timer_hires = true;
+      else if (!strcmp (name, "-acct"))
+        thread_acct_print = true;
+      else if (!strcmp (name, "-schedtrace"))
+        sched_trace_enabled = true;
+      else if (!strcmp (name, "-intrstat"))
+        intr_stat_enabled = true;
+      else if (!strcmp (name, "-baud"))
+        {
+          if (value == NULL || !serial_set_speed (atoi (value)))
+            PANIC ("invalid serial data rate `%s' (use -h for help)", value);
+        }
+      else if (!strcmp (name, "-linein"))
+        input_line_mode = true;
+      else if (!strcmp (name, "-klog"))
+        klog_enabled = true;
+      else if (!strcmp (name, "-lockstat"))
+        lockstat_enabled = true;
+      else if (!strcmp (name, "-kstack"))
+        {
+          if (value == NULL || !kstack_set_size (atoi (value) * 1024))
+            PANIC ("invalid kernel stack size `%s' (use -h for help)", value);
+        }
+      else if (!strcmp (name, "-profile"))
+        {
+          profile_enabled = true;
+          if (value != NULL && atoi (value) > 0)
+            profile_interval = atoi (value);
+        }
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-sl"))
+        page_stack_limit = atoi (value);
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
     }
+  if (list_tunables)
+    tunable_print ();
 
   /* Initialize the random number generator based on the system
      time.  This has no effect if an "-rs" option was specified.
@@ -373,14 +594,43 @@ usage (void)
           "  -f                 Format file system device during startup.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -stripe=BDEV,...   Stripe BDEVs together as block device md0.\n"
+          "  -ramdisk=KB        Create a KB-kilobyte RAM disk, ram0.\n"
+          "  -overlay=BASE,SCR  Create cow0, which reads BASE but writes SCR.\n"
+          "  -extents           Create files as extents, not sector lists.\n"
+          "  -iosched=NAME      Schedule disk I/O by NAME: fifo, cscan,\n"
+          "                     or deadline (the default).\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
 #endif
+          "  -o NAME=VALUE      Set tunable NAME to VALUE.\n"
+          "  -o list            List tunables and their values.\n"
+          "  -snapshot          Wait after booting for actions from the\n"
+          "                     console (see pintos --snapshot).\n"
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -tickless          Stop the timer tick while the CPU is idle.\n"
+          "  -hrtimer           Block in sub-tick sleeps on the local APIC timer.\n"
+          "  -acct              Print per-thread CPU accounting at exit.\n"
+          "  -schedtrace        Record scheduler events and print them at exit.\n"
+          "  -intrstat          Time interrupt handlers and interrupts-off\n"
+          "                     sections and print the results at exit.\n"
+          "  -baud=BPS          Run the serial port at BPS bits per second,\n"
+          "                     a divisor of 115200 (default 9600).\n"
+          "  -linein            Read console input a line at a time.\n"
+          "  -klog              Log traces to memory and drain them in the\n"
+          "                     background instead of printing them.\n"
+          "  -lockstat          Profile locks and print the results at exit.\n"
+          "  -kstack=KB         Give each thread a KB-kilobyte kernel stack,\n"
+          "                     4, 8, or 16, with guard pages (default 4).\n"
+          "  -profile[=TICKS]   Sample the kernel every TICKS ticks (default 1)\n"
+          "                     and print the hottest addresses at exit.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+          "  -sl=COUNT          Limit user stacks to COUNT pages.\n"
 #endif
           );
   shutdown_power_off ();
@@ -3,11 +3,15 @@
 #include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include "threads/flags.h"
 #include "threads/intr-stubs.h"
 #include "threads/io.h"
+#include "threads/rcu.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "devices/clock.h"
+#include "devices/lapic.h"
 #include "devices/timer.h"
 
 /* Programmable Interrupt Controller (PIC) registers.
@@ -47,6 +51,61 @@ static unsigned int unexpected_cnt[INTR_CNT];
 static bool in_external_intr;   /* Are we processing an external interrupt? */
 static bool yield_on_return;    /* Should we yield on interrupt return? */
 
+/* Work that external interrupt handlers have put off with
+   intr_defer(), in the order it was deferred.  When the
+   outermost external interrupt handler returns, it runs this
+   work with interrupts turned back on, so that the heavy part of
+   handling a device does not hold off other interrupts.  Deferred
+   work still counts as interrupt context: it may not sleep, but
+   it may call intr_yield_on_return(). */
+static struct list deferred_list;
+static bool in_deferred;        /* Running deferred work? */
+static void run_deferred (void);
+
+/* Interrupt statistics, kept if intr_stat_enabled.
+
+   For each vector, the number of interrupts and the cycles spent
+   in its handler.  The handlers of internal interrupts, such as
+   system calls and page faults, may sleep, so their cycles
+   include time blocked.
+
+   For each place that turns interrupts off, the length of the
+   sections that start there and end at the next intr_enable() or
+   intr_set_level(INTR_ON).  intr_set_level() is charged to its
+   caller.  A section that ends because an interrupt handler
+   returns with IRET is not measured, but does not count toward
+   the next one either: intr_handler() forgets the open section
+   whenever the interrupted code had interrupts on. */
+bool intr_stat_enabled;
+
+struct intr_stat
+  {
+    unsigned long long cnt;     /* Interrupts. */
+    uint64_t cycles;            /* Total cycles in handler. */
+    uint64_t max_cycles;        /* Longest time in handler. */
+  };
+static struct intr_stat intr_stats[INTR_CNT];
+
+/* Interrupts-off sites, in a hash table with linear probing. */
+#define OFF_BITS 8
+#define OFF_SLOTS (1 << OFF_BITS)
+struct intr_off_site
+  {
+    uintptr_t caller;           /* Return address, or 0 if free. */
+    unsigned long long cnt;     /* Sections started here. */
+    uint64_t cycles;            /* Total cycles off. */
+    uint64_t max_cycles;        /* Longest section. */
+  };
+static struct intr_off_site off_sites[OFF_SLOTS];
+static uintptr_t off_caller;    /* Where interrupts went off, or 0. */
+static uint64_t off_start;      /* When interrupts went off. */
+
+/* Interrupts-off sites printed at shutdown. */
+#define OFF_PRINT_CNT 20
+
+static void off_begin (uintptr_t caller);
+static void off_end (void);
+
 /* Programmable Interrupt Controller helpers. */
 static void pic_init (void);
 static void pic_end_of_interrupt (int irq);
@@ -54,10 +113,12 @@ static void pic_end_of_interrupt (int irq);
 /* Interrupt Descriptor Table helpers. */
 static uint64_t make_intr_gate (void (*) (void), int dpl);
 static uint64_t make_trap_gate (void (*) (void), int dpl);
+static uint64_t make_task_gate (uint16_t tss_sel);
 static inline uint64_t make_idtr_operand (uint16_t limit, void *base);
 
 /* Interrupt handlers. */
 void intr_handler (struct intr_frame *args);
+static bool is_external (uint8_t vec_no);
 static void unexpected_interrupt (const struct intr_frame *);
 
 /* Returns the current interrupt status. */
@@ -80,7 +141,15 @@ intr_get_level (void)
 enum intr_level
 intr_set_level (enum intr_level level) 
 {
-  return level == INTR_ON ? intr_enable () : intr_disable ();
+  enum intr_level old_level;
+
+  if (level == INTR_ON)
+    return intr_enable ();
+
+  old_level = intr_disable ();
+  if (intr_stat_enabled && old_level == INTR_ON)
+    off_caller = (uintptr_t) __builtin_return_address (0);
+  return old_level;
 }
 
 /* Enables interrupts and returns the previous interrupt status. */
@@ -88,7 +157,10 @@ enum intr_level
 intr_enable (void) 
 {
   enum intr_level old_level = intr_get_level ();
-  ASSERT (!intr_context ());
+  ASSERT (!in_external_intr);
+
+  if (intr_stat_enabled && old_level == INTR_OFF)
+    off_end ();
 
   /* Enable interrupts by setting the interrupt flag.
 
@@ -110,8 +182,48 @@ intr_disable (void)
      Hardware Interrupts". */
   asm volatile ("cli" : : : "memory");
 
+  if (intr_stat_enabled && old_level == INTR_ON)
+    off_begin ((uintptr_t) __builtin_return_address (0));
+
   return old_level;
 }
+
+/* Starts an interrupts-off section at CALLER.  Interrupts must
+   have just been turned off. */
+static void
+off_begin (uintptr_t caller)
+{
+  off_caller = caller;
+  off_start = clock_cycles ();
+}
+
+/* Ends the interrupts-off section in progress, if any, and
+   charges it to the place that started it.  Interrupts must
+   still be off. */
+static void
+off_end (void)
+{
+  uint64_t cycles;
+  size_t i, n;
+
+  if (off_caller == 0)
+    return;
+  cycles = clock_cycles () - off_start;
+
+  i = ((uint32_t) off_caller * 2654435761u) >> (32 - OFF_BITS);
+  for (n = 0; n < OFF_SLOTS; n++, i = (i + 1) % OFF_SLOTS)
+    if (off_sites[i].caller == off_caller || off_sites[i].caller == 0)
+      {
+        struct intr_off_site *s = &off_sites[i];
+        s->caller = off_caller;
+        s->cnt++;
+        s->cycles += cycles;
+        if (cycles > s->max_cycles)
+          s->max_cycles = cycles;
+        break;
+      }
+  off_caller = 0;
+}
 
 /* Initializes the interrupt system. */
 void
@@ -122,6 +234,7 @@ intr_init (void)
 
   /* Initialize interrupt controller. */
   pic_init ();
+  list_init (&deferred_list);
 
   /* Initialize IDT. */
   for (i = 0; i < INTR_CNT; i++)
@@ -181,7 +294,7 @@ void
 intr_register_ext (uint8_t vec_no, intr_handler_func *handler,
                    const char *name) 
 {
-  ASSERT (vec_no >= 0x20 && vec_no <= 0x2f);
+  ASSERT (is_external (vec_no));
   register_handler (vec_no, 0, INTR_OFF, handler, name);
 }
 
@@ -202,16 +315,34 @@ void
 intr_register_int (uint8_t vec_no, int dpl, enum intr_level level,
                    intr_handler_func *handler, const char *name)
 {
-  ASSERT (vec_no < 0x20 || vec_no > 0x2f);
+  ASSERT (!is_external (vec_no));
   register_handler (vec_no, dpl, level, handler, name);
 }
 
-/* Returns true during processing of an external interrupt
-   and false at all other times. */
+/* Registers internal interrupt VEC_NO to switch to the task
+   whose TSS has selector TSS_SEL, named NAME for debugging
+   purposes.  Unlike an interrupt or trap gate, a task gate loads
+   a whole new processor state, including the stack pointer, so
+   it works even when the interrupted stack is unusable.  The
+   task runs with the interrupts off that its TSS specifies, and
+   intr_handler() is not involved.  See [IA32-v3a] 6.3 "Task
+   Switching". */
+void
+intr_register_task (uint8_t vec_no, uint16_t tss_sel, const char *name)
+{
+  ASSERT (!is_external (vec_no));
+  ASSERT (intr_handlers[vec_no] == NULL);
+  idt[vec_no] = make_task_gate (tss_sel);
+  intr_names[vec_no] = name;
+}
+
+/* Returns true during processing of an external interrupt,
+   including work it deferred with intr_defer(), and false at all
+   other times. */
 bool
 intr_context (void) 
 {
-  return in_external_intr;
+  return in_external_intr || in_deferred;
 }
 
 /* During processing of an external interrupt, directs the
@@ -225,6 +356,62 @@ intr_yield_on_return (void)
   yield_on_return = true;
 }
 
+/* Initializes D to call FUNC (AUX) when it runs. */
+void
+intr_deferred_init (struct intr_deferred *d, intr_deferred_func *func,
+                    void *aux)
+{
+  ASSERT (d != NULL);
+  ASSERT (func != NULL);
+
+  d->func = func;
+  d->aux = aux;
+  d->pending = false;
+}
+
+/* Arranges for D to run once the external interrupt being
+   handled, or the next one if none is, returns.  Does nothing
+   if D is already waiting to run.  Returns true if D was queued,
+   false if it was already pending.  May be called from any
+   context, including from deferred work, which then runs before
+   the interrupt returns. */
+bool
+intr_defer (struct intr_deferred *d)
+{
+  enum intr_level old_level = intr_disable ();
+  bool queued = !d->pending;
+
+  if (queued)
+    {
+      d->pending = true;
+      list_push_back (&deferred_list, &d->elem);
+    }
+  intr_set_level (old_level);
+  return queued;
+}
+
+/* Runs deferred work until none is left, with interrupts on
+   while each piece runs.  An external interrupt that arrives
+   meanwhile leaves the work it defers to this loop. */
+static void
+run_deferred (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (!in_external_intr && !in_deferred);
+
+  in_deferred = true;
+  while (!list_empty (&deferred_list))
+    {
+      struct intr_deferred *d = list_entry (list_pop_front (&deferred_list),
+                                            struct intr_deferred, elem);
+      d->pending = false;
+      intr_enable ();
+      d->func (d->aux);
+      intr_disable ();
+    }
+  in_deferred = false;
+}
+
 /* 8259A Programmable Interrupt Controller. */
 
 /* Initializes the PICs.  Refer to [8259A] for details.
@@ -327,6 +514,18 @@ make_trap_gate (void (*function) (void), int dpl)
   return make_gate (function, dpl, 15);
 }
 
+/* Creates a task gate, with DPL 0, for the TSS with selector
+   TSS_SEL.  See [IA32-v3a] 6.2.5 "Task-Gate Descriptor". */
+static uint64_t
+make_task_gate (uint16_t tss_sel)
+{
+  uint32_t e0 = (uint32_t) tss_sel << 16;   /* TSS segment selector. */
+  uint32_t e1 = ((1 << 15)                  /* Present. */
+                 | (5 << 8));               /* Task gate. */
+
+  return e0 | ((uint64_t) e1 << 32);
+}
+
 /* Returns a descriptor that yields the given LIMIT and BASE when
    used as an operand for the LIDT instruction. */
 static inline uint64_t
@@ -337,6 +536,14 @@ make_idtr_operand (uint16_t limit, void *base)
 
 /* Interrupt handlers. */
 
+/* Returns true if VEC_NO is an external interrupt: one from the
+   PIC, 0x20...0x2f, or from the local APIC, 0xf0...0xff. */
+static bool
+is_external (uint8_t vec_no)
+{
+  return (vec_no >= 0x20 && vec_no <= 0x2f) || vec_no >= 0xf0;
+}
+
 /* Handler for all interrupts, faults, and exceptions.  This
    function is called by the assembly language interrupt stubs in
    intr-stubs.S.  FRAME describes the interrupt and the
@@ -346,19 +553,26 @@ intr_handler (struct intr_frame *frame)
 {
   bool external;
   intr_handler_func *handler;
+  uint64_t start = clock_cycles ();
+
+  /* The interrupted code had interrupts on, so any
+     interrupts-off section we knew about is over. */
+  if (frame->eflags & FLAG_IF)
+    off_caller = 0;
 
   /* External interrupts are special.
      We only handle one at a time (so interrupts must be off)
      and they need to be acknowledged on the PIC (see below).
      An external interrupt handler cannot sleep. */
-  external = frame->vec_no >= 0x20 && frame->vec_no < 0x30;
+  external = is_external (frame->vec_no);
   if (external) 
     {
       ASSERT (intr_get_level () == INTR_OFF);
-      ASSERT (!intr_context ());
+      ASSERT (!in_external_intr);
 
       in_external_intr = true;
-      yield_on_return = false;
+      if (!in_deferred)
+        yield_on_return = false;
     }
 
   /* Invoke the interrupt's handler. */
@@ -374,17 +588,38 @@ intr_handler (struct intr_frame *frame)
   else
     unexpected_interrupt (frame);
 
+  if (intr_stat_enabled)
+    {
+      struct intr_stat *s = &intr_stats[frame->vec_no];
+      uint64_t cycles = clock_cycles () - start;
+      s->cnt++;
+      s->cycles += cycles;
+      if (cycles > s->max_cycles)
+        s->max_cycles = cycles;
+    }
+
   /* Complete the processing of an external interrupt. */
   if (external) 
     {
       ASSERT (intr_get_level () == INTR_OFF);
-      ASSERT (intr_context ());
+      ASSERT (in_external_intr);
 
       in_external_intr = false;
-      pic_end_of_interrupt (frame->vec_no); 
-
-      if (yield_on_return) 
-        thread_yield (); 
+      if (frame->vec_no < 0x30)
+        pic_end_of_interrupt (frame->vec_no); 
+      else if (frame->vec_no != LAPIC_SPURIOUS_VEC)
+        lapic_eoi ();
+
+      /* If we interrupted deferred work, it will yield when it is
+         done. */
+      if (!in_deferred)
+        {
+          if (!list_empty (&deferred_list))
+            run_deferred ();
+          thread_current ()->acct.intr_cycles += clock_cycles () - start;
+          if (yield_on_return && !rcu_defer_yield ())
+            thread_yield ();
+        }
     }
 }
 
@@ -406,6 +641,58 @@ unexpected_interrupt (const struct intr_frame *f)
     f->vec_no, intr_names[f->vec_no]);
 }
 
+/* Orders pointers to interrupts-off sites by longest
+   section. */
+static int
+off_site_compare (const void *a_, const void *b_)
+{
+  const struct intr_off_site *a = *(const struct intr_off_site *const *) a_;
+  const struct intr_off_site *b = *(const struct intr_off_site *const *) b_;
+
+  if (a->max_cycles != b->max_cycles)
+    return a->max_cycles < b->max_cycles ? 1 : -1;
+  return 0;
+}
+
+/* Prints interrupt statistics: each vector that was taken, then
+   the places that kept interrupts off longest.  Pass the
+   addresses to utils/backtrace to name them. */
+void
+intr_print_stats (void)
+{
+  static struct intr_off_site *sorted[OFF_SLOTS];
+  enum intr_level old_level;
+  size_t i, cnt;
+
+  if (!intr_stat_enabled)
+    return;
+
+  old_level = intr_disable ();
+  for (i = 0; i < INTR_CNT; i++)
+    {
+      const struct intr_stat *s = &intr_stats[i];
+      if (s->cnt != 0)
+        printf ("Interrupt %#04zx (%s): %llu times, %"PRIu64" ns total, "
+                "%"PRIu64" ns max\n", i, intr_names[i], s->cnt,
+                clock_cycles_to_ns (s->cycles),
+                clock_cycles_to_ns (s->max_cycles));
+    }
+
+  for (i = cnt = 0; i < OFF_SLOTS; i++)
+    if (off_sites[i].caller != 0)
+      sorted[cnt++] = &off_sites[i];
+  qsort (sorted, cnt, sizeof *sorted, off_site_compare);
+  if (cnt > OFF_PRINT_CNT)
+    cnt = OFF_PRINT_CNT;
+  for (i = 0; i < cnt; i++)
+    printf ("Interrupts off at %#010"PRIxPTR": %llu times, "
+            "%"PRIu64" ns total, %"PRIu64" ns max\n",
+            sorted[i]->caller, sorted[i]->cnt,
+            clock_cycles_to_ns (sorted[i]->cycles),
+            clock_cycles_to_ns (sorted[i]->max_cycles));
+  intr_set_level (old_level);
+}
+
 /* Dumps interrupt frame F to the console, for debugging. */
 void
 intr_dump_frame (const struct intr_frame *f) 
@@ -1,6 +1,7 @@
 #ifndef THREADS_INTERRUPT_H
 #define THREADS_INTERRUPT_H
 
+#include <list.h>
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -61,9 +62,31 @@ void intr_init (void);
 void intr_register_ext (uint8_t vec, intr_handler_func *, const char *name);
 void intr_register_int (uint8_t vec, int dpl, enum intr_level,
                         intr_handler_func *, const char *name);
+void intr_register_task (uint8_t vec, uint16_t tss_sel, const char *name);
 bool intr_context (void);
 void intr_yield_on_return (void);
 
+/* Work deferred by an interrupt handler until the handler
+   returns, when it runs with interrupts on. */
+typedef void intr_deferred_func (void *aux);
+struct intr_deferred
+  {
+    struct list_elem elem;      /* Element in the deferred list. */
+    intr_deferred_func *func;   /* Function to call. */
+    void *aux;                  /* Auxiliary data for FUNC. */
+    bool pending;               /* In the deferred list? */
+  };
+
+void intr_deferred_init (struct intr_deferred *, intr_deferred_func *,
+                         void *aux);
+bool intr_defer (struct intr_deferred *);
+
+/* If true, keep per-vector handler times and interrupts-off
+   section lengths.  Set by kernel command-line option
+   "-intrstat". */
+extern bool intr_stat_enabled;
+void intr_print_stats (void);
+
 void intr_dump_frame (const struct intr_frame *);
 const char *intr_name (uint8_t vec);
 
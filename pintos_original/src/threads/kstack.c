@@ -0,0 +1,231 @@
+#include "threads/kstack.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <stdio.h>
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/thread.h"
+
+/* Large kernel stacks.
+
+   By default, a thread's kernel stack shares a 4 kB page with
+   its struct thread, and an overflow is caught only afterward,
+   if at all, when thread_current() finds the thread's magic
+   number clobbered.  With "-kstack=KB", for KB of 8 or 16, each
+   thread instead gets a slot of 2 * KB kB in a region of kernel
+   virtual memory above the kernel's mapping of RAM.  The slot is
+   aligned to its size, so that running_thread() still finds
+   struct thread by rounding down the stack pointer:
+
+        2*KB +---------------------------------+
+             |          kernel stack           |
+             |       (committed lazily)        |
+          KB +---------------------------------+
+             |           guard pages           |
+             |           (unmapped)            |
+        4 kB +---------------------------------+
+             |          struct thread          |
+           0 +---------------------------------+
+
+   Only struct thread's page and the stack's top page are mapped
+   when the thread is created.  A thread commits the rest with
+   kstack_reserve() before it enters a path that may run deep:
+   system calls and page faults do, since they lead into the file
+   system and virtual memory, but most kernel threads never need
+   more than their first page.  Pages cannot be committed when
+   the stack first touches them instead, because a page fault on
+   the stack cannot push its own frame and so becomes a double
+   fault, which the x86 cannot restart.  An overflow past the
+   stack runs into the guard pages instead of struct thread; with
+   user programs, userprog/tss.c reports the double fault from a
+   task with its own stack.
+
+   The region's page tables are allocated by kstack_init(), before
+   any process exists, and every page directory copies the
+   kernel's page directory entries, so all of them see every
+   stack.  vtop() does not apply to stack addresses, so a stack
+   buffer cannot be the target of DMA; devices/ide.c falls back
+   to PIO for one. */
+
+size_t kstack_size = PGSIZE;
+
+/* Page table entries for the region, in order.  Its page tables
+   are allocated together, so they form one array. */
+static uint32_t *ptes;
+
+/* Slots in use, and statistics.  Protected by turning interrupts
+   off. */
+static struct bitmap *slots;
+static size_t live_cnt;                 /* Slots in use. */
+static size_t peak_cnt;                 /* Most slots in use. */
+static long long commit_cnt;            /* Pages kstack_reserve() mapped. */
+
+static bool commit (uint8_t *page);
+
+/* Sets the kernel stack size to SIZE bytes, which must be a
+   power of two between PGSIZE and KSTACK_MAX.  Returns true if
+   successful, false if SIZE is invalid.  Must be called before
+   kstack_init(). */
+bool
+kstack_set_size (size_t size)
+{
+  if (size < PGSIZE || size > KSTACK_MAX || (size & (size - 1)) != 0)
+    return false;
+  kstack_size = size;
+  return true;
+}
+
+/* Sets up the region for large kernel stacks, if they are in
+   use.  Must be called after paging_init() and malloc_init() and
+   before any thread or process is created. */
+void
+kstack_init (void)
+{
+  size_t pt_cnt = KSTACK_SPAN / PTSPAN;
+  size_t i;
+
+  if (kstack_size == PGSIZE)
+    return;
+  if (init_ram_pages > (KSTACK_VADDR - (uintptr_t) PHYS_BASE) / PGSIZE)
+    PANIC ("too much RAM for -kstack");
+
+  ptes = palloc_get_multiple (PAL_ASSERT | PAL_ZERO, pt_cnt);
+  for (i = 0; i < pt_cnt; i++)
+    init_page_dir[pd_no ((void *) (KSTACK_VADDR + i * PTSPAN))]
+      = pde_create (ptes + i * (PGSIZE / sizeof *ptes));
+
+  slots = bitmap_create (KSTACK_SPAN / (2 * kstack_size));
+  if (slots == NULL)
+    PANIC ("out of memory for kernel stack slots");
+}
+
+/* Allocates a slot for a new thread and maps its struct thread's
+   page and the top page of its stack.  Returns the address for
+   its struct thread, or a null pointer if the slots or memory
+   run out.  Like a page for a thread, the memory is not
+   zeroed. */
+struct thread *
+kstack_alloc (void)
+{
+  enum intr_level old_level;
+  uint8_t *t;
+  size_t slot;
+
+  ASSERT (kstack_size > PGSIZE);
+
+  old_level = intr_disable ();
+  slot = bitmap_scan_and_flip (slots, 0, 1, false);
+  if (slot != BITMAP_ERROR && ++live_cnt > peak_cnt)
+    peak_cnt = live_cnt;
+  intr_set_level (old_level);
+  if (slot == BITMAP_ERROR)
+    return NULL;
+
+  t = (uint8_t *) KSTACK_VADDR + slot * 2 * kstack_size;
+  if (!commit (t) || !commit ((uint8_t *) kstack_top (t) - PGSIZE))
+    {
+      kstack_free ((struct thread *) t);
+      return NULL;
+    }
+  return (struct thread *) t;
+}
+
+/* Unmaps and frees the pages of the slot of thread T, which must
+   not be running, and frees the slot. */
+void
+kstack_free (struct thread *t)
+{
+  uint8_t *top = kstack_top (t);
+  enum intr_level old_level;
+  uint8_t *page;
+
+  ASSERT (kstack_owns (t));
+
+  for (page = (uint8_t *) t; page < top; page += PGSIZE)
+    {
+      uint32_t *pte = &ptes[((uintptr_t) page - KSTACK_VADDR) / PGSIZE];
+      if (*pte & PTE_P)
+        {
+          void *kpage = ptov (*pte & PTE_ADDR);
+          *pte = 0;
+          asm volatile ("invlpg (%0)" : : "r" (page) : "memory");
+          palloc_free_page (kpage);
+        }
+    }
+
+  old_level = intr_disable ();
+  bitmap_reset (slots, ((uintptr_t) t - KSTACK_VADDR) / (2 * kstack_size));
+  live_cnt--;
+  intr_set_level (old_level);
+}
+
+/* Commits the running thread's kernel stack to SIZE bytes below
+   the stack pointer, or to the bottom of the stack if that is
+   nearer, so that code that runs that deep finds its pages.
+   Does nothing for a stack that shares its page with struct
+   thread.  Returns true if successful, false if memory is
+   short.  Must not be called in an interrupt handler, since it
+   may sleep. */
+bool
+kstack_reserve (size_t size)
+{
+  uint8_t *sp, *bottom, *low, *page;
+
+  asm ("mov %%esp, %0" : "=g" (sp));
+  if (!kstack_owns (sp))
+    return true;
+  ASSERT (!intr_context ());
+
+  bottom = (uint8_t *) kstack_top (kstack_thread (sp)) - kstack_size;
+  low = (size_t) (sp - bottom) > size ? pg_round_down (sp - size) : bottom;
+  for (page = pg_round_down (sp); page >= low; page -= PGSIZE)
+    {
+      if (ptes[((uintptr_t) page - KSTACK_VADDR) / PGSIZE] & PTE_P)
+        continue;
+      if (!commit (page))
+        return false;
+      commit_cnt++;
+    }
+  return true;
+}
+
+/* Returns true if ADDR is in a large kernel stack's slot but not
+   mapped: in its guard pages, or in a page of the stack that has
+   not been committed. */
+bool
+kstack_is_guard (const void *addr)
+{
+  return (kstack_owns (addr) && ptes != NULL
+          && !(ptes[((uintptr_t) addr - KSTACK_VADDR) / PGSIZE] & PTE_P));
+}
+
+/* Prints kernel stack statistics. */
+void
+kstack_print_stats (void)
+{
+  if (kstack_size == PGSIZE)
+    return;
+  printf ("Kernel stacks: %zu kB each, at most %zu at once, "
+          "%lld pages committed lazily\n",
+          kstack_size / 1024, peak_cnt, commit_cnt);
+}
+
+/* Maps a newly allocated page at PAGE, within the region, if
+   nothing is mapped there.  Returns true if successful, false if
+   memory is short. */
+static bool
+commit (uint8_t *page)
+{
+  uint32_t *pte = &ptes[((uintptr_t) page - KSTACK_VADDR) / PGSIZE];
+  void *kpage;
+
+  if (*pte & PTE_P)
+    return true;
+  kpage = palloc_get_page (0);
+  if (kpage == NULL)
+    return false;
+  *pte = pte_create_kernel (kpage, true);
+  return true;
+}
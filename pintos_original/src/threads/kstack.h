@@ -0,0 +1,59 @@
+#ifndef THREADS_KSTACK_H
+#define THREADS_KSTACK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "threads/vaddr.h"
+
+/* Large kernel stacks.  See kstack.c. */
+
+/* Kernel virtual addresses of the slots that hold large kernel
+   stacks, above the kernel's mapping of RAM. */
+#define KSTACK_VADDR 0xff000000
+#define KSTACK_SPAN (8 * 1024 * 1024)
+
+/* Largest kernel stack size, in bytes. */
+#define KSTACK_MAX (16 * 1024)
+
+/* Size of each thread's kernel stack, in bytes: PGSIZE, for a
+   stack that shares its page with struct thread, or a larger
+   power of two up to KSTACK_MAX.  Set by "-kstack=KB". */
+extern size_t kstack_size;
+
+bool kstack_set_size (size_t);
+void kstack_init (void);
+struct thread *kstack_alloc (void);
+void kstack_free (struct thread *);
+bool kstack_reserve (size_t);
+bool kstack_is_guard (const void *);
+void kstack_print_stats (void);
+
+/* Returns true if ADDR is within a large kernel stack's slot. */
+static inline bool
+kstack_owns (const void *addr)
+{
+  return (uintptr_t) addr - KSTACK_VADDR < KSTACK_SPAN;
+}
+
+/* Returns the struct thread whose stack contains ADDR.  A large
+   stack's slot is aligned to its own size, 2 * kstack_size, with
+   struct thread in its first page; any other thread's stack
+   shares the page of its struct thread. */
+static inline void *
+kstack_thread (const void *addr)
+{
+  if (kstack_owns (addr))
+    return (void *) ((uintptr_t) addr & ~(2 * kstack_size - 1));
+  return pg_round_down (addr);
+}
+
+/* Returns the top of the stack of the thread whose struct thread
+   is at T. */
+static inline void *
+kstack_top (const void *t)
+{
+  return (uint8_t *) t + (kstack_owns (t) ? 2 * kstack_size : PGSIZE);
+}
+
+#endif /* threads/kstack.h */
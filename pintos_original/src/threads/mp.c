@@ -0,0 +1,249 @@
+#include "threads/mp.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/loader.h"
+#include "threads/vaddr.h"
+
+/* MultiProcessor table detection.  See [MP] for details.
+
+   The BIOS describes the machine's processors and interrupt
+   controllers in a table found through an "MP floating pointer
+   structure", which it leaves in one of a few places in the
+   first megabyte of physical memory.  We read the table to learn
+   how many CPUs there are and where their local APICs live.
+
+   Only the bootstrap processor runs Pintos.  Bringing up the
+   others takes an INIT-SIPI-SIPI sequence through the local APIC,
+   a real-mode trampoline below 1 MB, and a kernel in which
+   disabling interrupts is no longer enough to exclude other
+   threads; the other processors are recorded here for that. */
+
+/* MP floating pointer structure. */
+struct mp_fp
+  {
+    char signature[4];          /* "_MP_". */
+    uint32_t config;            /* Physical address of config table. */
+    uint8_t length;             /* Length in 16-byte units. */
+    uint8_t spec_rev;           /* MP specification revision. */
+    uint8_t checksum;           /* Makes the structure sum to 0. */
+    uint8_t type;               /* Default configuration, or 0. */
+    uint8_t features[4];        /* Bit 7 of first byte: IMCR present. */
+  };
+
+/* MP configuration table header. */
+struct mp_config
+  {
+    char signature[4];          /* "PCMP". */
+    uint16_t length;            /* Length of base table. */
+    uint8_t spec_rev;           /* MP specification revision. */
+    uint8_t checksum;           /* Makes the base table sum to 0. */
+    char oem[8];                /* OEM ID. */
+    char product[12];           /* Product ID. */
+    uint32_t oem_table;         /* Physical address of OEM table. */
+    uint16_t oem_length;        /* Length of OEM table. */
+    uint16_t entry_cnt;         /* Number of entries. */
+    uint32_t lapic;             /* Physical address of local APICs. */
+    uint16_t ext_length;        /* Length of extended table. */
+    uint8_t ext_checksum;       /* Checksum of extended table. */
+    uint8_t reserved;
+  };
+
+/* MP configuration table entry types. */
+#define MP_PROCESSOR 0          /* 20 bytes. */
+#define MP_BUS 1                /* 8 bytes. */
+#define MP_IOAPIC 2             /* 8 bytes. */
+#define MP_IOINTR 3             /* 8 bytes. */
+#define MP_LINTR 4              /* 8 bytes. */
+
+/* Processor entry. */
+struct mp_processor
+  {
+    uint8_t type;               /* MP_PROCESSOR. */
+    uint8_t apic_id;            /* Local APIC ID. */
+    uint8_t apic_version;       /* Local APIC version. */
+    uint8_t flags;              /* MPP_* flags. */
+    uint8_t signature[4];       /* CPU signature. */
+    uint32_t features;          /* CPUID feature flags. */
+    uint8_t reserved[8];
+  };
+#define MPP_ENABLED 0x01        /* Usable. */
+#define MPP_BSP 0x02            /* Bootstrap processor. */
+
+/* I/O APIC entry. */
+struct mp_ioapic
+  {
+    uint8_t type;               /* MP_IOAPIC. */
+    uint8_t apic_id;            /* I/O APIC ID. */
+    uint8_t version;            /* I/O APIC version. */
+    uint8_t flags;              /* Bit 0: usable. */
+    uint32_t addr;              /* Physical address. */
+  };
+
+/* CPUs found, in table order.  There is always at least the one
+   we are running on. */
+struct cpu cpus[CPU_MAX];
+int cpu_cnt;
+
+/* Physical address of the local APICs, or 0 if there is no MP
+   table. */
+uintptr_t lapic_base;
+
+/* Physical address of the first usable I/O APIC, or 0. */
+static uintptr_t ioapic_base;
+
+static struct mp_fp *search_fp (uintptr_t phys, size_t size);
+static struct mp_config *find_config (void);
+static uint8_t sum (const void *, size_t size);
+static void add_cpu (uint8_t apic_id, bool bsp);
+
+/* Looks for the MP table and records the CPUs it lists. */
+void
+mp_init (void)
+{
+  struct mp_config *config = find_config ();
+  const uint8_t *p, *end;
+  int i;
+
+  if (config == NULL)
+    {
+      add_cpu (0, true);
+      cpus[0].started = true;
+      printf ("MP: no MP table, assuming 1 CPU.\n");
+      return;
+    }
+
+  lapic_base = config->lapic;
+  p = (const uint8_t *) (config + 1);
+  end = (const uint8_t *) config + config->length;
+  while (p < end)
+    switch (*p)
+      {
+      case MP_PROCESSOR:
+        {
+          const struct mp_processor *proc = (const void *) p;
+          if (proc->flags & MPP_ENABLED)
+            add_cpu (proc->apic_id, (proc->flags & MPP_BSP) != 0);
+          p += sizeof *proc;
+        }
+        break;
+
+      case MP_IOAPIC:
+        {
+          const struct mp_ioapic *io = (const void *) p;
+          if ((io->flags & 1) && ioapic_base == 0)
+            ioapic_base = io->addr;
+          p += sizeof *io;
+        }
+        break;
+
+      case MP_BUS:
+      case MP_IOINTR:
+      case MP_LINTR:
+        p += 8;
+        break;
+
+      default:
+        printf ("MP: unknown config table entry type %d\n", *p);
+        p = end;
+        break;
+      }
+
+  /* The BSP is cpus[0], because that is the CPU we are on. */
+  if (cpu_cnt == 0)
+    add_cpu (0, true);
+  for (i = 1; i < cpu_cnt; i++)
+    if (cpus[i].bsp)
+      {
+        struct cpu tmp = cpus[0];
+        cpus[0] = cpus[i];
+        cpus[i] = tmp;
+        break;
+      }
+  for (i = 0; i < cpu_cnt; i++)
+    cpus[i].id = i;
+  cpus[0].started = true;
+
+  printf ("MP: %d CPU%s, local APIC at %#"PRIxPTR", I/O APIC at %#"PRIxPTR
+          "; using 1.\n",
+          cpu_cnt, cpu_cnt != 1 ? "s" : "", lapic_base, ioapic_base);
+}
+
+/* Adds a CPU with the given APIC_ID, unless there are already
+   CPU_MAX. */
+static void
+add_cpu (uint8_t apic_id, bool bsp)
+{
+  struct cpu *c;
+
+  if (cpu_cnt >= CPU_MAX)
+    return;
+  c = &cpus[cpu_cnt++];
+  c->id = cpu_cnt - 1;
+  c->apic_id = apic_id;
+  c->bsp = bsp;
+  c->started = false;
+}
+
+/* Returns the MP configuration table, or a null pointer if there
+   is none or it is a default configuration, which we do not
+   support. */
+static struct mp_config *
+find_config (void)
+{
+  const uint8_t *bda = ptov (0x400);
+  uintptr_t ebda = *(const uint16_t *) (bda + 0x0e) << 4;
+  uintptr_t base_kb = *(const uint16_t *) (bda + 0x13);
+  struct mp_fp *fp;
+  struct mp_config *config;
+
+  /* [MP] 4: the first kB of the extended BIOS data area, the
+     last kB of base memory, or the BIOS ROM. */
+  fp = NULL;
+  if (ebda != 0)
+    fp = search_fp (ebda, 1024);
+  if (fp == NULL && base_kb != 0)
+    fp = search_fp (base_kb * 1024 - 1024, 1024);
+  if (fp == NULL)
+    fp = search_fp (0xf0000, 0x10000);
+  if (fp == NULL || fp->config == 0 || fp->type != 0
+      || fp->config + sizeof *config > init_ram_pages * PGSIZE)
+    return NULL;
+
+  config = ptov (fp->config);
+  if (memcmp (config->signature, "PCMP", 4)
+      || (config->spec_rev != 1 && config->spec_rev != 4)
+      || fp->config + config->length > init_ram_pages * PGSIZE
+      || sum (config, config->length) != 0)
+    return NULL;
+  return config;
+}
+
+/* Searches the SIZE bytes of physical memory at PHYS for an MP
+   floating pointer structure and returns it, or a null pointer
+   if there is none. */
+static struct mp_fp *
+search_fp (uintptr_t phys, size_t size)
+{
+  uint8_t *p = ptov (phys);
+  uint8_t *end = p + size;
+
+  for (; p + sizeof (struct mp_fp) <= end; p += sizeof (struct mp_fp))
+    if (!memcmp (p, "_MP_", 4) && sum (p, sizeof (struct mp_fp)) == 0)
+      return (struct mp_fp *) p;
+  return NULL;
+}
+
+/* Returns the sum of the SIZE bytes at P. */
+static uint8_t
+sum (const void *p_, size_t size)
+{
+  const uint8_t *p = p_;
+  uint8_t s = 0;
+
+  while (size-- > 0)
+    s += *p++;
+  return s;
+}
@@ -0,0 +1,33 @@
+#ifndef THREADS_MP_H
+#define THREADS_MP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Maximum number of CPUs that we keep track of. */
+#define CPU_MAX 8
+
+/* A processor, as described by the MultiProcessor table. */
+struct cpu
+  {
+    int id;                     /* Index in cpus[]. */
+    uint8_t apic_id;            /* Local APIC ID. */
+    bool bsp;                   /* Bootstrap processor? */
+    bool started;               /* Running kernel code? */
+  };
+
+extern struct cpu cpus[CPU_MAX];
+extern int cpu_cnt;
+extern uintptr_t lapic_base;
+
+void mp_init (void);
+
+/* Returns the index in cpus[] of the CPU running the caller.
+   Only the bootstrap processor, cpus[0], runs Pintos so far. */
+static inline int
+cpu_id (void)
+{
+  return 0;
+}
+
+#endif /* threads/mp.h */
@@ -2,13 +2,15 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/loader.h"
-#include "threads/synch.h"
+#include "threads/tunable.h"
 #include "threads/vaddr.h"
 
 /* Page allocator.  Hands out memory in page-size (or
@@ -23,22 +25,121 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Within a pool, free pages are kept as a binary buddy system:
+   a block of order K is 2**K pages whose index within the pool
+   is a multiple of 2**K, and there is one free list per order.
+   A request for N pages takes a block of the smallest order that
+   fits, splitting a larger one if need be, and gives back the
+   pages past N.  Freed blocks are merged with their buddies.
+   Both take O(log N) time, instead of a scan of the whole
+   bitmap.
+
+   The pools are protected by turning interrupts off, not by a
+   lock, because thread_schedule_tail() frees the page of a dying
+   thread with interrupts already off.
+
+   Single pages, by far the most common request, go through a
+   small per-pool cache.  It is refilled PAGE_CACHE_BATCH pages at
+   a time from one buddy block, and freed pages go back to it
+   until it is full.  Cached pages stay marked used in the
+   bitmap.  The cache is flushed back to the buddy lists whenever
+   a multi-page request would otherwise fail.
+
+   Each pool also keeps a stash of up to ZERO_CACHE_SIZE free
+   pages that are known to be zero.  The idle thread fills it
+   through palloc_zero_idle(), so single-page PAL_ZERO requests
+   usually need no memset.
+
+   Each pool counts its free pages, cached ones included.  When
+   an allocation leaves fewer than the pool's low watermark free,
+   or fails outright, the functions registered with
+   palloc_register_notifier() are asked to give memory back.  They
+   are not asked again until the pool has climbed back above its
+   high watermark, except on a failed allocation, which is retried
+   once after they have run.
+
+   After long uptimes the pools fragment, and a request for a
+   long run of pages, such as a DMA buffer or a large allocator
+   slab, can fail although plenty of memory is free.  So a
+   "contiguous region" of palloc.contig_pages pages may be carved
+   out of the kernel's share of memory at boot, as a third pool.
+   PAL_CONTIG requests for more than one page are served from it
+   first, then from their usual pool.  Other allocations may only
+   borrow single pages from it, and only with PAL_MOVABLE, which
+   promises that the page goes back when the notifiers ask for
+   memory, and only once their usual pool is exhausted.  When a
+   PAL_CONTIG request does not fit in the region, the notifiers
+   are run for it, with PAL_CONTIG as the pool, so that the
+   borrowers give their pages back, before the request falls back
+   to the usual pool.  Long runs thus keep succeeding under load,
+   while the region still holds data when they are not wanted. */
+
+/* Number of block orders.  A pool may be at most 2**(PALLOC_ORDERS
+   - 1) pages, or 4 GB, in one block. */
+#define PALLOC_ORDERS 21
+
+/* Order of a page that does not start a free block. */
+#define ORDER_NONE 0xff
+
+/* Single-page cache capacity, and number of pages per refill. */
+#define PAGE_CACHE_SIZE 16
+#define PAGE_CACHE_BATCH 8
+
+/* Pre-zeroed page stash capacity. */
+#define ZERO_CACHE_SIZE 16
 
 /* A memory pool. */
 struct pool
   {
-    struct lock lock;                   /* Mutual exclusion. */
-    struct bitmap *used_map;            /* Bitmap of free pages. */
+    struct bitmap *used_map;            /* Bitmap of used pages. */
+    uint8_t *order;                     /* Order of the free block
+                                           starting at each page,
+                                           or ORDER_NONE. */
+    struct list free[PALLOC_ORDERS];    /* Free blocks of each order. */
+    size_t cache[PAGE_CACHE_SIZE];      /* Cached free single pages. */
+    size_t cache_cnt;                   /* Number of cached pages. */
+    size_t zeroed[ZERO_CACHE_SIZE];     /* Cached pages of zeros. */
+    size_t zeroed_cnt;                  /* Number of zeroed pages. */
+    size_t free_cnt;                    /* Pages not handed out. */
+    size_t low_wm, high_wm;             /* Watermarks, in pages. */
+    bool pressure;                      /* Below low_wm, not yet back
+                                           above high_wm? */
+    unsigned pressure_cnt;              /* Times notifiers were run. */
+    enum palloc_flags flags;            /* PAL_USER for the user pool. */
     uint8_t *base;                      /* Base of pool. */
   };
 
-/* Two pools: one for kernel data, one for user pages. */
-static struct pool kernel_pool, user_pool;
+/* Two pools: one for kernel data, one for user pages, and the
+   contiguous region, whose used_map is null if there is none. */
+static struct pool kernel_pool, user_pool, contig_pool;
+
+/* Pages carved out of the kernel's share for the contiguous
+   region.  Set by "-o palloc.contig_pages=N". */
+static unsigned contig_pages;
+TUNABLE_UINT ("palloc.contig_pages", contig_pages, 0, 1 << 20,
+              "Pages reserved for long contiguous runs.");
+
+/* Registered struct palloc_notifiers. */
+static struct list notifiers;
 
 static void init_pool (struct pool *, void *base, size_t page_cnt,
-                       const char *name);
+                       const char *name, enum palloc_flags);
 static bool page_from_pool (const struct pool *, void *page);
+static struct pool *pool_of (void *page);
+static void return_pages (struct pool *, size_t page_idx, size_t page_cnt);
+static size_t take_pages (struct pool *, size_t page_cnt);
+static void free_pages (struct pool *, size_t page_idx, size_t page_cnt);
+static size_t take_cached_page (struct pool *);
+static size_t take_zeroed_page (struct pool *);
+static bool put_cached_page (struct pool *, size_t page_idx);
+static bool flush_cache (struct pool *);
+static size_t alloc_pages (struct pool *, enum palloc_flags, size_t page_cnt,
+                           bool *zeroed);
+static void *get_pages (struct pool *, enum palloc_flags, size_t page_cnt);
+static struct pool *flags_pool (enum palloc_flags);
+static void notify_pressure (struct pool *);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -51,53 +152,225 @@ palloc_init (size_t user_page_limit)
   size_t free_pages = (free_end - free_start) / PGSIZE;
   size_t user_pages = free_pages / 2;
   size_t kernel_pages;
+  size_t region_pages;
   if (user_pages > user_page_limit)
     user_pages = user_page_limit;
   kernel_pages = free_pages - user_pages;
 
+  /* The contiguous region comes out of the kernel's half, at its
+     end, and may have at most half of it. */
+  region_pages = contig_pages;
+  if (region_pages > kernel_pages / 2)
+    region_pages = kernel_pages / 2;
+  kernel_pages -= region_pages;
+
   /* Give half of memory to kernel, half to user. */
-  init_pool (&kernel_pool, free_start, kernel_pages, "kernel pool");
-  init_pool (&user_pool, free_start + kernel_pages * PGSIZE,
-             user_pages, "user pool");
+  list_init (&notifiers);
+  init_pool (&kernel_pool, free_start, kernel_pages, "kernel pool", 0);
+  if (region_pages > 0)
+    init_pool (&contig_pool, free_start + kernel_pages * PGSIZE,
+               region_pages, "contiguous region", PAL_CONTIG);
+  init_pool (&user_pool,
+             free_start + (kernel_pages + region_pages) * PGSIZE,
+             user_pages, "user pool", PAL_USER);
 }
 
 /* Obtains and returns a group of PAGE_CNT contiguous free pages.
    If PAL_USER is set, the pages are obtained from the user pool,
    otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
-   then the pages are filled with zeros.  If too few pages are
-   available, returns a null pointer, unless PAL_ASSERT is set in
-   FLAGS, in which case the kernel panics. */
+   then the pages are filled with zeros.  If PAL_CONTIG is set,
+   the pages come from the contiguous region if they fit there.
+   A single page that its owner gives back under memory pressure
+   should be asked for with PAL_MOVABLE, so that it may be
+   borrowed from the contiguous region once its pool runs out.
+   If too few pages are available, returns a null pointer, unless
+   PAL_ASSERT is set in FLAGS, in which case the kernel panics. */
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 {
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  bool region = contig_pool.used_map != NULL;
+  void *pages = NULL;
+
+  if (page_cnt == 0)
+    return NULL;
+
+  if (region && (flags & PAL_CONTIG) && page_cnt > 1)
+    pages = get_pages (&contig_pool, flags, page_cnt);
+  if (pages == NULL)
+    pages = get_pages (pool, flags, page_cnt);
+  if (pages == NULL && region && (flags & PAL_MOVABLE) && page_cnt == 1)
+    pages = get_pages (&contig_pool, flags, page_cnt);
+
+  if (pages == NULL && (flags & PAL_ASSERT))
+    PANIC ("palloc_get: out of pages");
+  return pages;
+}
+
+/* Obtains PAGE_CNT contiguous pages from POOL, as
+   palloc_get_multiple() does, running the notifiers and trying
+   again if they are not available at first.  Returns the first
+   page, or a null pointer if there is no run of PAGE_CNT free
+   pages even then. */
+static void *
+get_pages (struct pool *pool, enum palloc_flags flags, size_t page_cnt)
+{
   void *pages;
   size_t page_idx;
+  bool zeroed;
 
-  if (page_cnt == 0)
+  page_idx = alloc_pages (pool, flags, page_cnt, &zeroed);
+  if (page_idx == BITMAP_ERROR)
+    {
+      notify_pressure (pool);
+      page_idx = alloc_pages (pool, flags, page_cnt, &zeroed);
+    }
+  if (page_idx == BITMAP_ERROR)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
+  pages = pool->base + PGSIZE * page_idx;
+  if ((flags & PAL_ZERO) && !zeroed)
+    memset (pages, 0, PGSIZE * page_cnt);
+  return pages;
+}
 
-  if (page_idx != BITMAP_ERROR)
-    pages = pool->base + PGSIZE * page_idx;
-  else
-    pages = NULL;
+/* Takes PAGE_CNT pages from POOL, from its caches if PAGE_CNT is
+   1, and returns the index of the first, or BITMAP_ERROR if there
+   are not enough.  Sets *ZEROED to true if the page came from the
+   pre-zeroed stash and FLAGS asked for PAL_ZERO.  Runs the
+   notifiers if the pool drops below its low watermark. */
+static size_t
+alloc_pages (struct pool *pool, enum palloc_flags flags, size_t page_cnt,
+             bool *zeroed)
+{
+  size_t page_idx = BITMAP_ERROR;
+  enum intr_level old_level;
+  bool notify;
 
-  if (pages != NULL) 
+  *zeroed = false;
+  if (page_cnt == 1)
     {
       if (flags & PAL_ZERO)
-        memset (pages, 0, PGSIZE * page_cnt);
+        {
+          page_idx = take_zeroed_page (pool);
+          *zeroed = page_idx != BITMAP_ERROR;
+        }
+      if (page_idx == BITMAP_ERROR)
+        page_idx = take_cached_page (pool);
+      if (page_idx == BITMAP_ERROR)
+        page_idx = take_zeroed_page (pool);
     }
-  else 
+  else
     {
-      if (flags & PAL_ASSERT)
-        PANIC ("palloc_get: out of pages");
+      page_idx = take_pages (pool, page_cnt);
+      if (page_idx == BITMAP_ERROR && flush_cache (pool))
+        page_idx = take_pages (pool, page_cnt);
     }
+  if (page_idx == BITMAP_ERROR)
+    return BITMAP_ERROR;
 
-  return pages;
+  old_level = intr_disable ();
+  pool->free_cnt -= page_cnt;
+  notify = !pool->pressure && pool->free_cnt < pool->low_wm;
+  intr_set_level (old_level);
+  if (notify)
+    notify_pressure (pool);
+  return page_idx;
+}
+
+/* Marks POOL as under pressure and runs each notifier for it. */
+static void
+notify_pressure (struct pool *pool)
+{
+  enum intr_level old_level;
+  struct list_elem *e;
+
+  old_level = intr_disable ();
+  pool->pressure = true;
+  pool->pressure_cnt++;
+  intr_set_level (old_level);
+  for (e = list_begin (&notifiers); e != list_end (&notifiers);
+       e = list_next (e))
+    {
+      struct palloc_notifier *n = list_entry (e, struct palloc_notifier,
+                                              elem);
+      n->func (pool->flags, pool->free_cnt, n->aux);
+    }
+}
+
+/* Registers N to have FUNC (POOL, FREE_CNT, AUX) called whenever
+   a pool comes under memory pressure.  POOL is PAL_USER for the
+   user pool, PAL_CONTIG for the contiguous region, and 0 for the
+   kernel pool.  FUNC may be called with
+   interrupts off, from whatever thread is allocating, so it must
+   not sleep; it should free pages or wake a thread that will. */
+void
+palloc_register_notifier (struct palloc_notifier *n,
+                          palloc_notify_func *func, void *aux)
+{
+  enum intr_level old_level;
+
+  n->func = func;
+  n->aux = aux;
+  old_level = intr_disable ();
+  list_push_back (&notifiers, &n->elem);
+  intr_set_level (old_level);
+}
+
+/* Returns the pool that FLAGS names: the user pool if it has
+   PAL_USER set, otherwise the contiguous region if it has
+   PAL_CONTIG set, otherwise the kernel pool. */
+static struct pool *
+flags_pool (enum palloc_flags flags)
+{
+  if (flags & PAL_USER)
+    return &user_pool;
+  else if (flags & PAL_CONTIG)
+    return &contig_pool;
+  else
+    return &kernel_pool;
+}
+
+/* Returns the number of free pages in the pool that FLAGS names,
+   as described for flags_pool(), or 0 for a contiguous region
+   that does not exist. */
+size_t
+palloc_free_count (enum palloc_flags flags)
+{
+  return flags_pool (flags)->free_cnt;
+}
+
+/* Sets the low and high watermarks, in free pages, of the pool
+   that FLAGS names, as described for flags_pool(). */
+void
+palloc_set_watermarks (enum palloc_flags flags, size_t low, size_t high)
+{
+  struct pool *pool = flags_pool (flags);
+  enum intr_level old_level;
+
+  ASSERT (low <= high);
+
+  old_level = intr_disable ();
+  pool->low_wm = low;
+  pool->high_wm = high;
+  intr_set_level (old_level);
+}
+
+/* Prints page allocator statistics. */
+void
+palloc_print_stats (void)
+{
+  printf ("Kernel pool: %zu of %zu pages free, %u low-memory events\n",
+          kernel_pool.free_cnt, bitmap_size (kernel_pool.used_map),
+          kernel_pool.pressure_cnt);
+  if (contig_pool.used_map != NULL)
+    printf ("Contiguous region: %zu of %zu pages free, "
+            "%u low-memory events\n",
+            contig_pool.free_cnt, bitmap_size (contig_pool.used_map),
+            contig_pool.pressure_cnt);
+  printf ("User pool: %zu of %zu pages free, %u low-memory events\n",
+          user_pool.free_cnt, bitmap_size (user_pool.used_map),
+          user_pool.pressure_cnt);
 }
 
 /* Obtains a single free page and returns its kernel virtual
@@ -118,27 +391,54 @@ void
 palloc_free_multiple (void *pages, size_t page_cnt) 
 {
   struct pool *pool;
-  size_t page_idx;
+  enum intr_level old_level;
 
   ASSERT (pg_ofs (pages) == 0);
   if (pages == NULL || page_cnt == 0)
     return;
 
-  if (page_from_pool (&kernel_pool, pages))
-    pool = &kernel_pool;
-  else if (page_from_pool (&user_pool, pages))
-    pool = &user_pool;
-  else
-    NOT_REACHED ();
+  pool = pool_of (pages);
+#ifndef NDEBUG
+  memset (pages, 0xcc, PGSIZE * page_cnt);
+#endif
+
+  old_level = intr_disable ();
+  return_pages (pool, pg_no (pages) - pg_no (pool->base), page_cnt);
+  intr_set_level (old_level);
+}
 
-  page_idx = pg_no (pages) - pg_no (pool->base);
+/* Frees the PAGE_CNT single pages whose addresses are in PAGES,
+   which may come from either pool, turning interrupts off only
+   once for all of them.  Runs of consecutive pages, which are
+   common since the buddy system hands out neighbours, go back to
+   the free lists together. */
+void
+palloc_free_batch (void **pages, size_t page_cnt)
+{
+  enum intr_level old_level;
+  size_t i;
 
 #ifndef NDEBUG
-  memset (pages, 0xcc, PGSIZE * page_cnt);
+  for (i = 0; i < page_cnt; i++)
+    memset (pages[i], 0xcc, PGSIZE);
 #endif
 
-  ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
-  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  old_level = intr_disable ();
+  for (i = 0; i < page_cnt; )
+    {
+      uint8_t *first = pages[i];
+      struct pool *pool = pool_of (first);
+      size_t run = 1;
+
+      ASSERT (pg_ofs (first) == 0);
+      while (i + run < page_cnt
+             && pages[i + run] == first + run * PGSIZE
+             && page_from_pool (pool, pages[i + run]))
+        run++;
+      return_pages (pool, pg_no (first) - pg_no (pool->base), run);
+      i += run;
+    }
+  intr_set_level (old_level);
 }
 
 /* Frees the page at PAGE. */
@@ -149,24 +449,300 @@ palloc_free_page (void *page)
 }
 
 /* Initializes pool P as starting at START and ending at END,
-   naming it NAME for debugging purposes. */
+   naming it NAME for debugging purposes.  FLAGS is what to pass
+   to notifiers for P. */
 static void
-init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
+init_pool (struct pool *p, void *base, size_t page_cnt, const char *name,
+           enum palloc_flags flags)
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
-     and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
+  /* We'll put the pool's used_map at its base, followed by its
+     order array.  Calculate the space needed for both and
+     subtract it from the pool's size. */
+  size_t bm_size = bitmap_buf_size (page_cnt);
+  size_t bm_pages = DIV_ROUND_UP (bm_size + page_cnt, PGSIZE);
+  enum intr_level old_level;
+  int i;
+
   if (bm_pages > page_cnt)
     PANIC ("Not enough memory in %s for bitmap.", name);
   page_cnt -= bm_pages;
 
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
-  /* Initialize the pool. */
-  lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
+  /* Initialize the pool, with every page free. */
+  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_size);
+  p->order = (uint8_t *) base + bm_size;
+  memset (p->order, ORDER_NONE, page_cnt);
+  for (i = 0; i < PALLOC_ORDERS; i++)
+    list_init (&p->free[i]);
+  p->cache_cnt = 0;
+  p->zeroed_cnt = 0;
+  p->free_cnt = page_cnt;
+  p->low_wm = page_cnt / 32;
+  p->high_wm = page_cnt / 16;
+  p->pressure = false;
+  p->pressure_cnt = 0;
+  p->flags = flags;
   p->base = base + bm_pages * PGSIZE;
+
+  old_level = intr_disable ();
+  free_pages (p, 0, page_cnt);
+  intr_set_level (old_level);
+}
+
+/* Returns the list element kept in page PAGE_IDX of POOL while
+   the page starts a free block. */
+static struct list_elem *
+page_elem (const struct pool *pool, size_t page_idx)
+{
+  return (struct list_elem *) (pool->base + PGSIZE * page_idx);
+}
+
+/* Returns the index within POOL of the page holding E. */
+static size_t
+elem_page (const struct pool *pool, struct list_elem *e)
+{
+  return ((uint8_t *) e - pool->base) / PGSIZE;
+}
+
+/* Adds the block of order ORDER at PAGE_IDX to POOL's free lists,
+   first merging it with its buddy for as long as the buddy is
+   free and whole.  Interrupts must be off. */
+static void
+free_block (struct pool *pool, size_t page_idx, int order)
+{
+  size_t page_cnt = bitmap_size (pool->used_map);
+
+  while (order + 1 < PALLOC_ORDERS)
+    {
+      size_t buddy = page_idx ^ ((size_t) 1 << order);
+      if (buddy + ((size_t) 1 << order) > page_cnt
+          || pool->order[buddy] != order)
+        break;
+      list_remove (page_elem (pool, buddy));
+      pool->order[buddy] = ORDER_NONE;
+      if (buddy < page_idx)
+        page_idx = buddy;
+      order++;
+    }
+  pool->order[page_idx] = order;
+  list_push_front (&pool->free[order], page_elem (pool, page_idx));
+}
+
+/* Adds the PAGE_CNT pages at PAGE_IDX to POOL's free lists, as
+   the fewest aligned blocks that cover them.  Interrupts must be
+   off. */
+static void
+free_pages (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (page_cnt > 0)
+    {
+      int order = 0;
+      while (order + 1 < PALLOC_ORDERS
+             && (page_idx & ((size_t) 1 << order)) == 0
+             && ((size_t) 2 << order) <= page_cnt)
+        order++;
+      free_block (pool, page_idx, order);
+      page_idx += (size_t) 1 << order;
+      page_cnt -= (size_t) 1 << order;
+    }
+}
+
+/* Takes PAGE_CNT contiguous pages from POOL, marks them used,
+   and returns the index of the first, or BITMAP_ERROR if there is
+   no free block large enough. */
+static size_t
+take_pages (struct pool *pool, size_t page_cnt)
+{
+  enum intr_level old_level;
+  size_t page_idx;
+  int order, i;
+
+  for (order = 0; ((size_t) 1 << order) < page_cnt; order++)
+    if (order + 1 >= PALLOC_ORDERS)
+      return BITMAP_ERROR;
+
+  old_level = intr_disable ();
+  for (i = order; i < PALLOC_ORDERS && list_empty (&pool->free[i]); i++)
+    continue;
+  if (i >= PALLOC_ORDERS)
+    {
+      intr_set_level (old_level);
+      return BITMAP_ERROR;
+    }
+  page_idx = elem_page (pool, list_pop_front (&pool->free[i]));
+  pool->order[page_idx] = ORDER_NONE;
+
+  /* Split the block down to ORDER, freeing the upper halves. */
+  while (i > order)
+    {
+      size_t half;
+
+      i--;
+      half = page_idx + ((size_t) 1 << i);
+      pool->order[half] = i;
+      list_push_front (&pool->free[i], page_elem (pool, half));
+    }
+
+  /* Give back the pages past PAGE_CNT. */
+  free_pages (pool, page_idx + page_cnt, ((size_t) 1 << order) - page_cnt);
+
+  ASSERT (bitmap_none (pool->used_map, page_idx, page_cnt));
+  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+  intr_set_level (old_level);
+  return page_idx;
+}
+
+/* Takes a single page from POOL's cache, refilling the cache
+   first if it is empty, and returns its index, or BITMAP_ERROR if
+   POOL has no free pages. */
+static size_t
+take_cached_page (struct pool *pool)
+{
+  enum intr_level old_level = intr_disable ();
+  size_t page_idx;
+
+  if (pool->cache_cnt == 0)
+    {
+      /* Refill from one block, falling back to a single page
+         when no block of the batch size is left. */
+      size_t batch = PAGE_CACHE_BATCH;
+      page_idx = take_pages (pool, batch);
+      if (page_idx == BITMAP_ERROR)
+        {
+          batch = 1;
+          page_idx = take_pages (pool, batch);
+        }
+      if (page_idx != BITMAP_ERROR)
+        while (batch-- > 0)
+          pool->cache[pool->cache_cnt++] = page_idx + batch;
+    }
+
+  page_idx = pool->cache_cnt > 0 ? pool->cache[--pool->cache_cnt]
+                                 : BITMAP_ERROR;
+  intr_set_level (old_level);
+  return page_idx;
+}
+
+/* Takes a page of zeros from POOL's stash and returns its index,
+   or BITMAP_ERROR if the stash is empty. */
+static size_t
+take_zeroed_page (struct pool *pool)
+{
+  enum intr_level old_level = intr_disable ();
+  size_t page_idx = pool->zeroed_cnt > 0 ? pool->zeroed[--pool->zeroed_cnt]
+                                         : BITMAP_ERROR;
+  intr_set_level (old_level);
+  return page_idx;
+}
+
+/* Zeroes one free page for the pre-zeroed stash of POOL.
+   Returns false if the stash is full or POOL has no free
+   pages. */
+static bool
+zero_one_page (struct pool *pool)
+{
+  enum intr_level old_level;
+  size_t page_idx;
+
+  if (pool->zeroed_cnt >= ZERO_CACHE_SIZE)
+    return false;
+  page_idx = take_cached_page (pool);
+  if (page_idx == BITMAP_ERROR)
+    return false;
+
+  /* The page is ours now, so it can be cleared with interrupts
+     on. */
+  memset (pool->base + PGSIZE * page_idx, 0, PGSIZE);
+
+  old_level = intr_disable ();
+  if (pool->zeroed_cnt < ZERO_CACHE_SIZE)
+    pool->zeroed[pool->zeroed_cnt++] = page_idx;
+  else if (!put_cached_page (pool, page_idx))
+    {
+      bitmap_reset (pool->used_map, page_idx);
+      free_pages (pool, page_idx, 1);
+    }
+  intr_set_level (old_level);
+  return true;
+}
+
+/* Zeroes one free page for a pre-zeroed stash.  Called by the
+   idle thread, with interrupts on, for as long as it returns
+   true and nothing else is ready to run. */
+bool
+palloc_zero_idle (void)
+{
+  return zero_one_page (&kernel_pool) || zero_one_page (&user_pool);
+}
+
+/* Adds the page at PAGE_IDX, which must be marked used, to POOL's
+   cache.  Returns false if the cache is full.  Interrupts must be
+   off. */
+static bool
+put_cached_page (struct pool *pool, size_t page_idx)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (pool->cache_cnt >= PAGE_CACHE_SIZE)
+    return false;
+  pool->cache[pool->cache_cnt++] = page_idx;
+  return true;
+}
+
+/* Returns all of POOL's cached and zeroed pages to its buddy
+   lists.  Returns true if there were any. */
+static bool
+flush_cache (struct pool *pool)
+{
+  enum intr_level old_level = intr_disable ();
+  bool flushed = pool->cache_cnt > 0 || pool->zeroed_cnt > 0;
+
+  while (pool->cache_cnt > 0 || pool->zeroed_cnt > 0)
+    {
+      size_t page_idx = (pool->cache_cnt > 0
+                         ? pool->cache[--pool->cache_cnt]
+                         : pool->zeroed[--pool->zeroed_cnt]);
+      bitmap_reset (pool->used_map, page_idx);
+      free_pages (pool, page_idx, 1);
+    }
+  intr_set_level (old_level);
+  return flushed;
+}
+
+/* Returns the pool that PAGE was allocated from. */
+static struct pool *
+pool_of (void *page)
+{
+  if (page_from_pool (&kernel_pool, page))
+    return &kernel_pool;
+  else if (page_from_pool (&user_pool, page))
+    return &user_pool;
+  else if (page_from_pool (&contig_pool, page))
+    return &contig_pool;
+  else
+    NOT_REACHED ();
+}
+
+/* Gives the PAGE_CNT used pages at PAGE_IDX back to POOL, to its
+   single-page cache if there is room, otherwise to its buddy
+   lists.  Interrupts must be off. */
+static void
+return_pages (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
+
+  pool->free_cnt += page_cnt;
+  if (pool->free_cnt > pool->high_wm)
+    pool->pressure = false;
+  if (page_cnt > 1 || !put_cached_page (pool, page_idx))
+    {
+      bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+      free_pages (pool, page_idx, page_cnt);
+    }
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -176,7 +752,11 @@ page_from_pool (const struct pool *pool, void *page)
 {
   size_t page_no = pg_no (page);
   size_t start_page = pg_no (pool->base);
-  size_t end_page = start_page + bitmap_size (pool->used_map);
+  size_t end_page;
+
+  if (pool->used_map == NULL)
+    return false;
+  end_page = start_page + bitmap_size (pool->used_map);
 
   return page_no >= start_page && page_no < end_page;
 }
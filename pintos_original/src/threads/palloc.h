@@ -1,6 +1,8 @@
 #ifndef THREADS_PALLOC_H
 #define THREADS_PALLOC_H
 
+#include <list.h>
+#include <stdbool.h>
 #include <stddef.h>
 
 /* How to allocate pages. */
@@ -8,7 +10,12 @@ enum palloc_flags
   {
     PAL_ASSERT = 001,           /* Panic on failure. */
     PAL_ZERO = 002,             /* Zero page contents. */
-    PAL_USER = 004              /* User page. */
+    PAL_USER = 004,             /* User page. */
+    PAL_CONTIG = 010,           /* Large run, from the contiguous
+                                   region if possible. */
+    PAL_MOVABLE = 020           /* Page given back under pressure,
+                                   which may borrow from the
+                                   contiguous region. */
   };
 
 void palloc_init (size_t user_page_limit);
@@ -16,5 +23,23 @@ void *palloc_get_page (enum palloc_flags);
 void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
 void palloc_free_page (void *);
 void palloc_free_multiple (void *, size_t page_cnt);
+void palloc_free_batch (void **, size_t page_cnt);
+bool palloc_zero_idle (void);
+
+/* Memory pressure.  See palloc_register_notifier(). */
+typedef void palloc_notify_func (enum palloc_flags pool, size_t free_cnt,
+                                 void *aux);
+struct palloc_notifier
+  {
+    palloc_notify_func *func;   /* Function to call. */
+    void *aux;                  /* Auxiliary data for FUNC. */
+    struct list_elem elem;      /* List element. */
+  };
+
+void palloc_register_notifier (struct palloc_notifier *,
+                               palloc_notify_func *, void *aux);
+size_t palloc_free_count (enum palloc_flags);
+void palloc_set_watermarks (enum palloc_flags, size_t low, size_t high);
+void palloc_print_stats (void);
 
 #endif /* threads/palloc.h */
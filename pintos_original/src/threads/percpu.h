@@ -0,0 +1,75 @@
+#ifndef THREADS_PERCPU_H
+#define THREADS_PERCPU_H
+
+#include <stdint.h>
+#include <string.h>
+#include "threads/mp.h"
+
+/* Size of a cache line, in bytes. */
+#define CACHE_LINE_SIZE 64
+
+/* Per-CPU statistics counter.
+
+   A statistic that is bumped on every tick or request and kept
+   in one shared variable would, with more than one CPU, move
+   that variable's cache line from CPU to CPU on every increment,
+   along with anything else that happened to share the line.  A
+   per-CPU counter instead gives each CPU a slot of its own,
+   padded out to a cache line, and adds up the slots only when it
+   is read, which for statistics is rare.  Padding rather than
+   alignment keeps any two slots' values on different lines even
+   in memory from malloc(), as long as it is 8-byte aligned.
+
+   Each CPU updates only its own slot, with interrupts off, so an
+   update needs no atomic instruction.  A reader that must not
+   see a half-updated 64-bit value, which takes two loads, still
+   needs interrupts off or, like thread_print_stats(), a seqlock.
+
+   A counter in static storage starts at 0; otherwise, call
+   pcpu_init(). */
+struct pcpu_slot
+  {
+    unsigned long long val;
+    uint8_t pad[CACHE_LINE_SIZE - sizeof (unsigned long long)];
+  };
+
+struct pcpu_counter
+  {
+    struct pcpu_slot cpu[CPU_MAX];
+  };
+
+/* Sets C to 0. */
+static inline void
+pcpu_init (struct pcpu_counter *c)
+{
+  memset (c, 0, sizeof *c);
+}
+
+/* Adds N to C.  Interrupts must be off, or else C must not be
+   updated by interrupt handlers. */
+static inline void
+pcpu_add (struct pcpu_counter *c, unsigned long long n)
+{
+  c->cpu[cpu_id ()].val += n;
+}
+
+/* Adds 1 to C, like pcpu_add(). */
+static inline void
+pcpu_inc (struct pcpu_counter *c)
+{
+  pcpu_add (c, 1);
+}
+
+/* Returns the sum of C over all CPUs. */
+static inline unsigned long long
+pcpu_read (const struct pcpu_counter *c)
+{
+  unsigned long long sum = 0;
+  int i;
+
+  for (i = 0; i < CPU_MAX; i++)
+    sum += c->cpu[i].val;
+  return sum;
+}
+
+#endif /* threads/percpu.h */
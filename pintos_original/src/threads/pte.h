@@ -64,8 +64,28 @@ static inline uintptr_t pd_no (const void *va) {
 #define PTE_P 0x1               /* 1=present, 0=not present. */
 #define PTE_W 0x2               /* 1=read/write, 0=read-only. */
 #define PTE_U 0x4               /* 1=user/kernel, 0=kernel only. */
+#define PTE_PWT 0x8             /* 1=write-through, 0=write-back. */
+#define PTE_PCD 0x10            /* 1=cache disabled, 0=cache enabled. */
 #define PTE_A 0x20              /* 1=accessed, 0=not acccessed. */
-#define PTE_D 0x40              /* 1=dirty, 0=not dirty (PTEs only). */
+#define PTE_D 0x40              /* 1=dirty, 0=not dirty (PTEs and
+                                   4 MB PDEs only). */
+#define PTE_PS 0x80             /* 1=4 MB page, 0=page table (PDEs only). */
+#define PTE_G 0x100             /* 1=global, kept in the TLB across CR3
+                                   loads (PTEs and 4 MB PDEs only). */
+
+/* A PDE with PTE_PS set maps a 4 MB page directly, with no page
+   table.  Its physical address must be 4 MB aligned, and the
+   flags above keep their meanings.  Only the kernel's mapping of
+   physical memory uses such PDEs, and only if the CPU supports
+   them; CR4_PSE must then be set in CR4. */
+#define PDE_LARGE_ADDR 0xffc00000 /* Address bits of a 4 MB PDE. */
+#define CR4_PSE 0x00000010      /* Page size extensions enable. */
+#define CPUID_PSE 0x00000008    /* CPUID(1).EDX bit for PSE support. */
+
+/* PTE_G takes effect only with CR4_PGE set in CR4.  Only kernel
+   mappings, which every page directory shares, may be global. */
+#define CR4_PGE 0x00000080      /* Global pages enable. */
+#define CPUID_PGE 0x00002000    /* CPUID(1).EDX bit for PGE support. */
 
 /* Returns a PDE that points to page table PT. */
 static inline uint32_t pde_create (uint32_t *pt) {
@@ -73,10 +93,26 @@ static inline uint32_t pde_create (uint32_t *pt) {
   return vtop (pt) | PTE_U | PTE_P | PTE_W;
 }
 
+/* Returns a PDE that maps the 4 MB of memory starting at PAGE.
+   The memory is readable.
+   If WRITABLE is true then it will be writable as well.
+   The memory will be usable only by ring 0 code (the kernel). */
+static inline uint32_t pde_create_large_kernel (void *page, bool writable) {
+  ASSERT (((uintptr_t) page & (PTSPAN - 1)) == 0);
+  return vtop (page) | PTE_PS | PTE_P | (writable ? PTE_W : 0);
+}
+
+/* Returns true if PDE is present and maps a 4 MB page. */
+static inline bool pde_is_large (uint32_t pde) {
+  return (pde & (PTE_P | PTE_PS)) == (PTE_P | PTE_PS);
+}
+
 /* Returns a pointer to the page table that page directory entry
-   PDE, which must "present", points to. */
+   PDE, which must "present" and not map a 4 MB page, points
+   to. */
 static inline uint32_t *pde_get_pt (uint32_t pde) {
   ASSERT (pde & PTE_P);
+  ASSERT (!(pde & PTE_PS));
   return ptov (pde & PTE_ADDR);
 }
 
@@ -103,5 +139,13 @@ static inline void *pte_get_page (uint32_t pte) {
   return ptov (pte & PTE_ADDR);
 }
 
+/* Returns the kernel virtual address that VADDR maps to through
+   4 MB page directory entry PDE. */
+static inline void *pde_get_large_page (uint32_t pde, const void *vaddr) {
+  ASSERT (pde_is_large (pde));
+  return (uint8_t *) ptov (pde & PDE_LARGE_ADDR)
+         + ((uintptr_t) vaddr & (PTSPAN - 1));
+}
+
 #endif /* threads/pte.h */
 
@@ -0,0 +1,174 @@
+#include "threads/rcu.h"
+#include <debug.h>
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/workqueue.h"
+#include "devices/timer.h"
+
+/* Context switches so far.  A call_rcu() callback stamped with
+   an earlier count has waited out its grace period. */
+static unsigned gp_cnt;
+
+/* Callbacks waiting for their grace periods, oldest first, so
+   those that are ready are always a prefix.  Protected by
+   disabling interrupts, so that interrupt handlers can call
+   call_rcu(). */
+static struct list pending_list;
+
+/* Runs ready callbacks in a worker thread, where they may
+   sleep.  If the first pending callback is not ready yet,
+   RETRY schedules the work again a tick later, by which time
+   the worker will have been switched out at least once. */
+static struct work rcu_work;
+static struct timeout retry;
+
+static work_func run_callbacks;
+static timeout_func retry_callbacks;
+
+/* Initializes RCU.  Must be called after workqueue_init(). */
+void
+rcu_init (void)
+{
+  list_init (&pending_list);
+  work_init (&rcu_work, run_callbacks, NULL);
+  timeout_init (&retry, retry_callbacks, NULL);
+}
+
+/* Begins a read-side section.  Until the matching
+   rcu_read_unlock(), objects found in RCU-protected structures
+   stay valid, and the running thread is not preempted.  May be
+   called from an interrupt handler. */
+void
+rcu_read_lock (void)
+{
+  thread_current ()->rcu_nesting++;
+  barrier ();
+}
+
+/* Ends a read-side section.  If a timer interrupt wanted the
+   running thread to yield during the outermost section, yields
+   now, unless interrupts are off, in which case the next tick
+   will ask again. */
+void
+rcu_read_unlock (void)
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (t->rcu_nesting > 0);
+
+  barrier ();
+  if (--t->rcu_nesting == 0 && t->rcu_yield && !intr_context ())
+    {
+      t->rcu_yield = false;
+      if (intr_get_level () == INTR_ON)
+        thread_yield ();
+    }
+}
+
+/* Returns true if the running thread is in a read-side
+   section. */
+bool
+rcu_read_locked (void)
+{
+  return thread_current ()->rcu_nesting > 0;
+}
+
+/* Waits until every read-side section that began before the
+   call has ended.  Must not be called in a read-side section or
+   from an interrupt handler.
+
+   On one CPU this returns at once.  Readers can't be switched
+   out of a read-side section, so no other thread is in one, and
+   no interrupt handler is running, so the running thread is
+   already in a quiescent state. */
+void
+synchronize_rcu (void)
+{
+  ASSERT (!intr_context ());
+  ASSERT (!rcu_read_locked ());
+
+  barrier ();
+}
+
+/* Arranges for FUNC (HEAD) to be called in a worker thread once
+   every read-side section that began before the call has ended.
+   May be called in a read-side section or from an interrupt
+   handler. */
+void
+call_rcu (struct rcu_head *head, rcu_func *func)
+{
+  enum intr_level old_level;
+
+  ASSERT (head != NULL);
+  ASSERT (func != NULL);
+
+  head->func = func;
+  old_level = intr_disable ();
+  head->gp = gp_cnt;
+  list_push_back (&pending_list, &head->elem);
+  intr_set_level (old_level);
+  work_schedule (&rcu_work);
+}
+
+/* Notes a context switch, which ends a grace period.  Called by
+   schedule() with interrupts off. */
+void
+rcu_quiescent (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  gp_cnt++;
+}
+
+/* Called at the end of an external interrupt that wants the
+   running thread to yield.  If the thread is in a read-side
+   section, notes that it should yield when the section ends and
+   returns true; otherwise returns false. */
+bool
+rcu_defer_yield (void)
+{
+  struct thread *t = thread_current ();
+
+  if (t->rcu_nesting == 0)
+    return false;
+  t->rcu_yield = true;
+  return true;
+}
+
+/* Calls the pending callbacks whose grace periods are over. */
+static void
+run_callbacks (void *aux UNUSED)
+{
+  for (;;)
+    {
+      enum intr_level old_level = intr_disable ();
+      struct rcu_head *head;
+
+      if (list_empty (&pending_list))
+        {
+          intr_set_level (old_level);
+          return;
+        }
+      head = list_entry (list_front (&pending_list), struct rcu_head, elem);
+      if (head->gp == gp_cnt)
+        {
+          if (!retry.pending)
+            timeout_add (&retry, 1);
+          intr_set_level (old_level);
+          return;
+        }
+      list_pop_front (&pending_list);
+      intr_set_level (old_level);
+
+      head->func (head);
+    }
+}
+
+/* Schedules the callbacks to run again, from the timer
+   interrupt. */
+static void
+retry_callbacks (struct timeout *t UNUSED, void *aux UNUSED)
+{
+  work_schedule (&rcu_work);
+}
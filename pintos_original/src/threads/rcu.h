@@ -0,0 +1,52 @@
+#ifndef THREADS_RCU_H
+#define THREADS_RCU_H
+
+#include <list.h>
+#include <stdbool.h>
+
+/* Read-copy update.
+
+   Lets readers of a shared structure look things up without
+   locks or turning interrupts off.  A reader brackets its
+   lookup with rcu_read_lock() and rcu_read_unlock().  A writer,
+   still serialized against other writers the usual way, unlinks
+   an object so that new readers can't find it, then waits for a
+   grace period, with synchronize_rcu() or call_rcu(), before it
+   frees the object, so that readers who found it before it was
+   unlinked are done with it.
+
+   A read-side section is not preemptible: a timer interrupt that
+   wants the running thread to yield in one is put off until the
+   section ends.  It must not sleep or yield either.  On one CPU,
+   then, no other thread runs while a reader is inside one, and
+   any context switch, counted by rcu_quiescent() in schedule(),
+   ends the grace period of everything unlinked before it.  That
+   also makes a read-side section atomic with respect to other
+   threads, though not interrupt handlers, which can also be
+   readers.
+
+   Sections nest, and cost an increment and a decrement. */
+
+/* Deferred call, usually embedded in the object to be freed. */
+struct rcu_head;
+typedef void rcu_func (struct rcu_head *);
+struct rcu_head
+  {
+    struct list_elem elem;      /* Element in the pending list. */
+    rcu_func *func;             /* Function to call. */
+    unsigned gp;                /* Grace period it waits out. */
+  };
+
+void rcu_init (void);
+
+void rcu_read_lock (void);
+void rcu_read_unlock (void);
+bool rcu_read_locked (void);
+
+void synchronize_rcu (void);
+void call_rcu (struct rcu_head *, rcu_func *);
+
+void rcu_quiescent (void);
+bool rcu_defer_yield (void);
+
+#endif /* threads/rcu.h */
@@ -0,0 +1,160 @@
+#include "threads/sched-trace.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "devices/clock.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Scheduler trace.
+
+   Printing each scheduler event as it happens serializes on the
+   console lock and changes the timing being observed.  Instead,
+   with "-schedtrace", each event is written into a ring buffer,
+   which costs a timestamp and a few stores, and the ring is
+   printed at shutdown.  When the ring fills, the oldest events
+   are overwritten. */
+
+/* One recorded event. */
+struct sched_record
+  {
+    uint64_t tsc;               /* clock_cycles() at the event. */
+    int64_t tick;               /* timer_ticks() at the event. */
+    tid_t tid;                  /* Thread. */
+    uint8_t type;               /* enum sched_event. */
+    int8_t from, to;            /* Queue levels, or -1. */
+  };
+
+/* Size of the ring. */
+#define TRACE_PAGES 16
+#define TRACE_CNT (TRACE_PAGES * PGSIZE / sizeof (struct sched_record))
+
+/* If true, record scheduler events. */
+bool sched_trace_enabled;
+
+static struct sched_record *ring;       /* Ring, or null. */
+static unsigned long long recorded;     /* Events ever recorded. */
+
+/* Allocates the ring, if tracing is enabled.  Must be called
+   after palloc_init(). */
+void
+sched_trace_init (void)
+{
+  if (sched_trace_enabled)
+    ring = palloc_get_multiple (PAL_ASSERT, TRACE_PAGES);
+}
+
+/* Records that event TYPE happened to thread T, between queue
+   levels FROM and TO. */
+void
+sched_trace (enum sched_event type, const struct thread *t, int from, int to)
+{
+  struct sched_record *r;
+  enum intr_level old_level;
+
+  if (ring == NULL)
+    return;
+
+  old_level = intr_disable ();
+  r = &ring[recorded++ % TRACE_CNT];
+  r->tsc = clock_cycles ();
+  r->tick = timer_ticks ();
+  r->tid = t->tid;
+  r->type = type;
+  r->from = from;
+  r->to = to;
+  intr_set_level (old_level);
+}
+
+/* Records the scheduler's switch from thread CUR, whose state is
+   no longer running, to thread NEXT.  CUR_LEVEL is the queue CUR
+   joins, if it is ready, and NEXT_LEVEL the one NEXT left. */
+void
+sched_trace_switch (const struct thread *cur, int cur_level,
+                    const struct thread *next, int next_level)
+{
+  if (ring == NULL)
+    return;
+
+  if (cur->status == THREAD_READY)
+    sched_trace (SCHED_PREEMPT, cur, -1, cur_level);
+  else if (cur->status == THREAD_BLOCKED)
+    sched_trace (SCHED_BLOCK, cur, -1, -1);
+  else
+    sched_trace (SCHED_EXIT, cur, -1, -1);
+  sched_trace (SCHED_RUN, next, next_level, -1);
+}
+
+/* Formats queue LEVEL into BUF, which must be at least 12
+   bytes, and returns BUF. */
+static const char *
+queue_name (char *buf, int level)
+{
+  if (level < 0)
+    return "ready";
+  snprintf (buf, 12, "L%d", level + 1);
+  return buf;
+}
+
+/* Prints the recorded events, oldest first. */
+void
+sched_trace_dump (void)
+{
+  unsigned long long i, first;
+  uint64_t start;
+
+  if (ring == NULL || recorded == 0)
+    return;
+
+  first = recorded > TRACE_CNT ? recorded - TRACE_CNT : 0;
+  start = ring[first % TRACE_CNT].tsc;
+  printf ("Sched: %llu events, %llu overwritten\n",
+          recorded, first);
+  for (i = first; i < recorded; i++)
+    {
+      const struct sched_record *r = &ring[i % TRACE_CNT];
+      char from[12], to[12];
+
+      printf ("Sched: %lld %"PRIu64" ns: thread %d ", r->tick,
+              clock_cycles_to_ns (r->tsc - start), r->tid);
+      switch (r->type)
+        {
+        case SCHED_CREATE:
+          printf ("created and is in blocked state\n");
+          break;
+        case SCHED_WAKE:
+          printf ("goes to %s queue from blocked state\n",
+                  queue_name (to, r->to));
+          break;
+        case SCHED_RUN:
+          printf ("goes to running state from %s queue\n",
+                  queue_name (from, r->from));
+          break;
+        case SCHED_PREEMPT:
+          printf ("goes to %s queue from running state\n",
+                  queue_name (to, r->to));
+          break;
+        case SCHED_BLOCK:
+          printf ("goes to blocked state from running state\n");
+          break;
+        case SCHED_EXIT:
+          printf ("finished\n");
+          break;
+        case SCHED_DEMOTE:
+        case SCHED_PROMOTE:
+        case SCHED_BOOST:
+          printf ("goes to %s queue from %s queue\n",
+                  queue_name (to, r->to), queue_name (from, r->from));
+          break;
+        case SCHED_MISS:
+          printf ("missed its deadline by %d ticks\n", r->from);
+          break;
+        default:
+          NOT_REACHED ();
+        }
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef THREADS_SCHED_TRACE_H
+#define THREADS_SCHED_TRACE_H
+
+#include <stdbool.h>
+
+struct thread;
+
+/* Scheduler events.  FROM and TO are run queue levels, or -1 if
+   the scheduler has only one queue or the event has no level. */
+enum sched_event
+  {
+    SCHED_CREATE,               /* Created, blocked. */
+    SCHED_WAKE,                 /* Blocked, now in queue TO. */
+    SCHED_RUN,                  /* Taken from queue FROM to run. */
+    SCHED_PREEMPT,              /* Stopped running, now in queue TO. */
+    SCHED_BLOCK,                /* Stopped running, blocked. */
+    SCHED_EXIT,                 /* Stopped running for good. */
+    SCHED_DEMOTE,               /* Moved down from level FROM to TO. */
+    SCHED_PROMOTE,              /* Aged up from queue FROM to TO. */
+    SCHED_BOOST,                /* Woken by an interrupt, moved up
+                                   from level FROM to TO. */
+    SCHED_MISS                  /* Finished a job FROM ticks past
+                                   its deadline (at most 127). */
+  };
+
+/* If true, record scheduler events.  Set by kernel command-line
+   option "-schedtrace". */
+extern bool sched_trace_enabled;
+
+void sched_trace_init (void);
+void sched_trace (enum sched_event, const struct thread *, int from, int to);
+void sched_trace_switch (const struct thread *cur, int cur_level,
+                         const struct thread *next, int next_level);
+void sched_trace_dump (void);
+
+#endif /* threads/sched-trace.h */
@@ -0,0 +1,84 @@
+#ifndef THREADS_SEQLOCK_H
+#define THREADS_SEQLOCK_H
+
+#include <debug.h>
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+
+/* Sequence lock.
+
+   Protects data that is read often and written rarely, and only
+   with interrupts off, such as the tick counters updated by the
+   timer interrupt handler.  A writer makes the sequence number
+   odd for the duration of its update.  A reader notes the
+   sequence number, copies the data, and tries again if the
+   number was odd or has changed since, which can only happen if
+   it was interrupted by a writer.  Readers therefore never block
+   and never turn off interrupts.
+
+   Typical use by a reader:
+
+     unsigned seq;
+     do
+       {
+         seq = seqlock_read_begin (&sl);
+         ...copy the protected data...
+       }
+     while (seqlock_read_retry (&sl, seq));
+
+   Because Pintos runs on a single CPU, a compiler barrier is all
+   the ordering that is needed. */
+struct seqlock
+  {
+    unsigned seq;               /* Odd while a write is under way. */
+  };
+
+/* Initializes SL. */
+static inline void
+seqlock_init (struct seqlock *sl)
+{
+  sl->seq = 0;
+}
+
+/* Starts a write to the data protected by SL.  Interrupts must be
+   off until the matching seqlock_write_end(). */
+static inline void
+seqlock_write_begin (struct seqlock *sl)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (!(sl->seq & 1));
+
+  sl->seq++;
+  barrier ();
+}
+
+/* Finishes a write started by seqlock_write_begin(). */
+static inline void
+seqlock_write_end (struct seqlock *sl)
+{
+  ASSERT (sl->seq & 1);
+
+  barrier ();
+  sl->seq++;
+}
+
+/* Starts a read of the data protected by SL and returns the
+   sequence number to pass to seqlock_read_retry(). */
+static inline unsigned
+seqlock_read_begin (const struct seqlock *sl)
+{
+  unsigned seq = *(volatile const unsigned *) &sl->seq;
+  barrier ();
+  return seq;
+}
+
+/* Returns true if the data read since seqlock_read_begin()
+   returned SEQ may be inconsistent and should be read again. */
+static inline bool
+seqlock_read_retry (const struct seqlock *sl, unsigned seq)
+{
+  barrier ();
+  return (seq & 1) || *(volatile const unsigned *) &sl->seq != seq;
+}
+
+#endif /* threads/seqlock.h */
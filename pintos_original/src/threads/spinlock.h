@@ -0,0 +1,233 @@
+#ifndef THREADS_SPINLOCK_H
+#define THREADS_SPINLOCK_H
+
+#include <debug.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "threads/interrupt.h"
+
+/* Spin lock.
+
+   Guards a short critical section against other CPUs as well as
+   against interrupt handlers on this one.  Acquiring a spin lock
+   turns interrupts off, then spins until the lock word is
+   clear, so a spin lock also does everything that turning
+   interrupts off does.  While only one CPU runs Pintos the lock
+   word is never found set, so the cost over intr_disable() is one
+   atomic exchange.
+
+   Typical use:
+
+     enum intr_level old_level = spin_lock (&sl);
+     ...critical section...
+     spin_unlock (&sl, old_level);
+
+   Must not be held across anything that sleeps.
+
+   A plain spin lock is neither fair nor cheap under contention:
+   every waiter spins on the one lock word, and whichever CPU
+   sees it clear first wins.  Two other kinds follow, with the
+   same interrupt-saving interface:
+
+   - A ticket lock hands out numbered tickets and serves them in
+     order, so waiters get the lock first come, first served.
+     Waiters still all read the one `serving' word, which is
+     fine for a few CPUs.
+
+   - An MCS lock (see Mellor-Crummey and Scott, "Algorithms for
+     Scalable Synchronization on Shared-Memory Multiprocessors",
+     ACM TOCS 9(1), 1991) queues each waiter on a node of its
+     own, usually on its stack, and each spins only on its own
+     node, which its predecessor writes once when it hands over
+     the lock.  It is also first come, first served, and lets a
+     hot lock scale past a few CPUs. */
+struct spinlock
+  {
+    volatile unsigned locked;   /* Nonzero while held. */
+  };
+
+#define SPINLOCK_INITIALIZER { 0 }
+
+/* Initializes SL. */
+static inline void
+spin_lock_init (struct spinlock *sl)
+{
+  sl->locked = 0;
+}
+
+/* Turns interrupts off and acquires SL.  Returns the previous
+   interrupt level, to be passed to spin_unlock(). */
+static inline enum intr_level
+spin_lock (struct spinlock *sl)
+{
+  enum intr_level old_level = intr_disable ();
+  unsigned old;
+
+  for (;;)
+    {
+      old = 1;
+      asm volatile ("xchgl %0, %1" : "+r" (old), "+m" (sl->locked)
+                    : : "memory");
+      if (old == 0)
+        break;
+      while (sl->locked)
+        asm volatile ("pause");
+    }
+  return old_level;
+}
+
+/* Releases SL and restores the interrupt level to OLD_LEVEL,
+   which spin_lock() returned. */
+static inline void
+spin_unlock (struct spinlock *sl, enum intr_level old_level)
+{
+  ASSERT (sl->locked);
+
+  asm volatile ("" : : : "memory");
+  sl->locked = 0;
+  intr_set_level (old_level);
+}
+
+/* Returns true if SL is held. */
+static inline bool
+spin_locked (const struct spinlock *sl)
+{
+  return sl->locked != 0;
+}
+
+/* Ticket lock. */
+struct ticketlock
+  {
+    volatile unsigned next;     /* Next ticket to hand out. */
+    volatile unsigned serving;  /* Ticket that holds the lock. */
+  };
+
+#define TICKETLOCK_INITIALIZER { 0, 0 }
+
+/* Initializes TL. */
+static inline void
+ticket_lock_init (struct ticketlock *tl)
+{
+  tl->next = tl->serving = 0;
+}
+
+/* Turns interrupts off, takes a ticket for TL, and spins until
+   it is served.  Returns the previous interrupt level, to be
+   passed to ticket_unlock(). */
+static inline enum intr_level
+ticket_lock (struct ticketlock *tl)
+{
+  enum intr_level old_level = intr_disable ();
+  unsigned ticket = 1;
+
+  asm volatile ("lock xaddl %0, %1" : "+r" (ticket), "+m" (tl->next)
+                : : "memory");
+  while (tl->serving != ticket)
+    asm volatile ("pause" : : : "memory");
+  return old_level;
+}
+
+/* Releases TL to the next ticket and restores the interrupt
+   level to OLD_LEVEL, which ticket_lock() returned. */
+static inline void
+ticket_unlock (struct ticketlock *tl, enum intr_level old_level)
+{
+  ASSERT (tl->next != tl->serving);
+
+  /* Only the holder writes `serving', so no atomic is needed. */
+  asm volatile ("" : : : "memory");
+  tl->serving = tl->serving + 1;
+  intr_set_level (old_level);
+}
+
+/* Returns true if TL is held. */
+static inline bool
+ticket_locked (const struct ticketlock *tl)
+{
+  return tl->next != tl->serving;
+}
+
+/* MCS lock, and a waiter's place in its queue.  Each acquisition
+   supplies a node, which must stay valid until the matching
+   release. */
+struct mcs_node
+  {
+    struct mcs_node *volatile next;     /* Next waiter, or null. */
+    volatile bool waiting;              /* Cleared by predecessor. */
+  };
+
+struct mcs_lock
+  {
+    struct mcs_node *volatile tail;     /* Last in queue, or null. */
+  };
+
+#define MCS_LOCK_INITIALIZER { NULL }
+
+/* Initializes ML. */
+static inline void
+mcs_lock_init (struct mcs_lock *ml)
+{
+  ml->tail = NULL;
+}
+
+/* Turns interrupts off and acquires ML, queuing on NODE.  Returns
+   the previous interrupt level, to be passed to mcs_unlock(). */
+static inline enum intr_level
+mcs_lock (struct mcs_lock *ml, struct mcs_node *node)
+{
+  enum intr_level old_level = intr_disable ();
+  struct mcs_node *pred = node;
+
+  node->next = NULL;
+  node->waiting = true;
+  asm volatile ("xchgl %0, %1" : "+r" (pred), "+m" (ml->tail)
+                : : "memory");
+  if (pred != NULL)
+    {
+      pred->next = node;
+      while (node->waiting)
+        asm volatile ("pause" : : : "memory");
+    }
+  return old_level;
+}
+
+/* Releases ML, which was acquired on NODE, to the next waiter,
+   and restores the interrupt level to OLD_LEVEL, which
+   mcs_lock() returned. */
+static inline void
+mcs_unlock (struct mcs_lock *ml, struct mcs_node *node,
+            enum intr_level old_level)
+{
+  ASSERT (ml->tail != NULL);
+
+  if (node->next == NULL)
+    {
+      /* No known successor: if we are still the tail, the queue
+         is empty.  Otherwise a successor has swapped itself in
+         but not linked to us yet, so wait for it. */
+      struct mcs_node *tail = node;
+      asm volatile ("lock cmpxchgl %2, %1"
+                    : "+a" (tail), "+m" (ml->tail)
+                    : "r" ((struct mcs_node *) NULL)
+                    : "memory");
+      if (tail == node)
+        {
+          intr_set_level (old_level);
+          return;
+        }
+      while (node->next == NULL)
+        asm volatile ("pause" : : : "memory");
+    }
+  asm volatile ("" : : : "memory");
+  node->next->waiting = false;
+  intr_set_level (old_level);
+}
+
+/* Returns true if ML is held. */
+static inline bool
+mcs_locked (const struct mcs_lock *ml)
+{
+  return ml->tail != NULL;
+}
+
+#endif /* threads/spinlock.h */
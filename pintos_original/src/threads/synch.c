@@ -29,9 +29,327 @@
 #include "threads/synch.h"
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
+#include "devices/clock.h"
+#include "devices/timer.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 
+/* Most locks a priority donation is passed through, to bound
+   the time spent in nested donation. */
+#define DONATION_DEPTH 8
+
+static void donate_priority (struct thread *);
+
+/* Profile of the locks with one name. */
+struct lockstat
+  {
+    const char *name;                   /* Name, from lock_init_named(). */
+    unsigned long long acquires;        /* Times acquired. */
+    unsigned long long contended;       /* Times a thread had to wait. */
+    uint64_t wait_cycles;               /* Total TSC cycles spent waiting. */
+    uint64_t max_hold;                  /* Longest hold, in TSC cycles. */
+  };
+
+/* Lock profiles, protected by disabling interrupts.  Locks with
+   names past the end of the table go unprofiled. */
+#define LOCKSTAT_CNT 128
+static struct lockstat lockstats[LOCKSTAT_CNT];
+static size_t lockstat_cnt;
+
+/* Profile locks?  Set by kernel command-line option "-lockstat"
+   before any locks are initialized. */
+bool lockstat_enabled;
+
+static struct lockstat *lockstat_lookup (const char *name);
+static void lockstat_acquired (struct lock *);
+static bool wait (struct waitqueue *, bool exclusive, int64_t timeout,
+                  struct lock *, bool *interrupted);
+
+/* A thread waiting in a waitqueue.  Lives on the waiting
+   thread's stack. */
+struct waiter
+  {
+    struct list_elem elem;              /* Element in `shared'. */
+    struct heap_elem heap_elem;         /* Element in `exclusive'. */
+    struct waitqueue *wq;               /* Queue waited in. */
+    struct thread *thread;              /* The waiting thread. */
+    int priority;                       /* Priority as of the last
+                                           waitqueue_requeue(). */
+    unsigned seq;                       /* Order of arrival. */
+    bool exclusive;                     /* Woken one at a time? */
+    bool woken;                         /* Woken, or timed out? */
+    bool interruptible;                 /* May waitqueue_interrupt()
+                                           end the wait? */
+    bool interrupted;                   /* Did it? */
+    struct timeout timeout;             /* Ends the wait, if timed. */
+  };
+
+static heap_less_func waiter_less;
+
+/* Initializes WQ as an empty wait queue. */
+void
+waitqueue_init (struct waitqueue *wq)
+{
+  ASSERT (wq != NULL);
+
+  heap_init (&wq->exclusive, waiter_less, NULL);
+  list_init (&wq->shared);
+  wq->next_seq = 0;
+}
+
+/* Returns true if no threads are waiting in WQ. */
+bool
+waitqueue_empty (struct waitqueue *wq)
+{
+  return heap_empty (&wq->exclusive) && list_empty (&wq->shared);
+}
+
+/* Removes waiter W from its queue.  Interrupts must be off. */
+static void
+remove_waiter (struct waiter *w)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (w->exclusive)
+    heap_remove (&w->wq->exclusive, &w->heap_elem);
+  else
+    list_remove (&w->elem);
+  w->thread->waiter = NULL;
+}
+
+/* Removes waiter W from its queue and wakes its thread, unless it
+   has already been woken.  Interrupts must be off. */
+static void
+wake_waiter (struct waiter *w)
+{
+  remove_waiter (w);
+  w->woken = true;
+  if (w->thread->status == THREAD_BLOCKED)
+    thread_unblock (w->thread);
+}
+
+/* Ends the wait of the waiter W_ whose timeout has expired. */
+static void
+wait_timed_out (struct timeout *t UNUSED, void *w_)
+{
+  struct waiter *w = w_;
+
+  if (!w->woken)
+    wake_waiter (w);
+}
+
+/* Waits in WQ until another thread wakes us or, unless TIMEOUT
+   is WAIT_FOREVER, until TIMEOUT ticks have passed.  If
+   EXCLUSIVE is true, wakeups wake us one at a time relative to
+   other exclusive waiters; otherwise, we wake on any wakeup.
+   Returns true if we were woken, false if we timed out.
+
+   Interrupts must be off, so that the caller can check the
+   condition it is waiting for and then wait without a wakeup
+   slipping in between.  Interrupts are still off on return.
+   Must not be called within an interrupt handler. */
+bool
+waitqueue_wait (struct waitqueue *wq, bool exclusive, int64_t timeout)
+{
+  return wait (wq, exclusive, timeout, NULL, NULL);
+}
+
+/* Ends thread T's wait as though it had been woken, if T is
+   waiting interruptibly, as in sema_down_interruptible(), and
+   holds no locks.  Returns true if it ended the wait.  Used to
+   make a signal take effect on a thread that might otherwise
+   wait for a long time.  Interrupts must be off. */
+bool
+waitqueue_interrupt (struct thread *t)
+{
+  struct waiter *w = t->waiter;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (w == NULL || !w->interruptible || w->woken
+      || !list_empty (&t->held_locks))
+    return false;
+  w->interrupted = true;
+  wake_waiter (w);
+  return true;
+}
+
+/* Waits in WQ as waitqueue_wait(), but if LOCK is non-null,
+   releases it once we are in the queue.  Releasing it may yield
+   to a thread that wakes us, or our timeout may fire, before we
+   block, in which case we do not block at all.  If INTERRUPTED
+   is non-null, the wait, which must be untimed, may be ended by
+   waitqueue_interrupt(), and *INTERRUPTED says whether it was. */
+static bool
+wait (struct waitqueue *wq, bool exclusive, int64_t timeout,
+      struct lock *lock, bool *interrupted)
+{
+  struct waiter w;
+  bool timed;
+
+  ASSERT (!intr_context ());
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  w.wq = wq;
+  w.thread = thread_current ();
+  w.priority = w.thread->priority;
+  w.seq = wq->next_seq++;
+  w.exclusive = exclusive;
+  w.woken = false;
+  w.interruptible = interrupted != NULL;
+  w.interrupted = false;
+  ASSERT (!w.interruptible || timeout == WAIT_FOREVER);
+  if (exclusive)
+    heap_insert (&wq->exclusive, &w.heap_elem);
+  else
+    list_push_back (&wq->shared, &w.elem);
+  w.thread->waiter = &w;
+  timed = timeout != WAIT_FOREVER;
+  if (timed)
+    {
+      timeout_init (&w.timeout, wait_timed_out, &w);
+      timeout_add (&w.timeout, timeout);
+    }
+
+  if (lock != NULL)
+    {
+      lock_release (lock);
+      intr_disable ();
+    }
+  if (!w.woken)
+    thread_block ();
+
+  /* A thread can be unblocked without a wakeup, as by SIG_UBLOCK
+     in the signals kernel.  Leave the queue, since W is about to
+     go out of scope, and report a wakeup: callers recheck their
+     conditions anyway. */
+  if (!w.woken)
+    remove_waiter (&w);
+
+  if (interrupted != NULL)
+    *interrupted = w.interrupted;
+
+  /* Our timeout fired if and only if it is no longer pending. */
+  return !timed || timeout_cancel (&w.timeout);
+}
+
+/* Orders exclusive waiters so that the least comes first: the
+   highest priority, and the earliest arrival within one.  SEQ
+   wraps, so arrivals are compared by their difference. */
+static bool
+waiter_less (const struct heap_elem *a_, const struct heap_elem *b_,
+             void *aux UNUSED)
+{
+  const struct waiter *a = heap_entry (a_, struct waiter, heap_elem);
+  const struct waiter *b = heap_entry (b_, struct waiter, heap_elem);
+
+  if (a->priority != b->priority)
+    return a->priority > b->priority;
+  return (int) (a->seq - b->seq) < 0;
+}
+
+/* Wakes every shared waiter in WQ and up to CNT exclusive ones,
+   those of highest priority first.  Returns the number of
+   exclusive waiters woken.  May be called from an interrupt
+   handler. */
+size_t
+waitqueue_wake (struct waitqueue *wq, size_t cnt)
+{
+  enum intr_level old_level = intr_disable ();
+  size_t woken = 0;
+
+  while (!list_empty (&wq->shared))
+    wake_waiter (list_entry (list_front (&wq->shared), struct waiter, elem));
+
+  /* waitqueue_requeue() keeps the heap up to date as waiters'
+     priorities change through donation, so the least element is
+     always the one to wake. */
+  for (; woken < cnt && !heap_empty (&wq->exclusive); woken++)
+    wake_waiter (heap_entry (heap_min (&wq->exclusive),
+                             struct waiter, heap_elem));
+  intr_set_level (old_level);
+  return woken;
+}
+
+/* Wakes every waiter in WQ.  Returns the number of exclusive
+   waiters woken.  May be called from an interrupt handler. */
+size_t
+waitqueue_wake_all (struct waitqueue *wq)
+{
+  return waitqueue_wake (wq, SIZE_MAX);
+}
+
+/* True while waitqueue_wake_io() is waking threads. */
+static bool io_wakeup;
+
+/* Like waitqueue_wake(), for waiters blocked on I/O that has now
+   completed, as when a disk request finishes or a key arrives.
+   The scheduler may favor threads woken this way over those
+   woken by a timer or another thread. */
+size_t
+waitqueue_wake_io (struct waitqueue *wq, size_t cnt)
+{
+  enum intr_level old_level = intr_disable ();
+  size_t woken;
+
+  io_wakeup = true;
+  woken = waitqueue_wake (wq, cnt);
+  io_wakeup = false;
+  intr_set_level (old_level);
+  return woken;
+}
+
+/* Returns true if the thread being unblocked is being woken by
+   waitqueue_wake_io(), for thread_unblock(). */
+bool
+waitqueue_io_wakeup (void)
+{
+  return io_wakeup;
+}
+
+/* Returns the highest priority of the threads waiting in WQ, or
+   PRI_MIN - 1 if there are none.  Interrupts must be off. */
+int
+waitqueue_max_priority (struct waitqueue *wq)
+{
+  int priority = PRI_MIN - 1;
+  struct list_elem *e;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!heap_empty (&wq->exclusive))
+    priority = heap_entry (heap_min (&wq->exclusive),
+                           struct waiter, heap_elem)->priority;
+  for (e = list_begin (&wq->shared); e != list_end (&wq->shared);
+       e = list_next (e))
+    {
+      struct waiter *w = list_entry (e, struct waiter, elem);
+      if (w->thread->priority > priority)
+        priority = w->thread->priority;
+    }
+  return priority;
+}
+
+/* Moves thread T, if it is waiting exclusively in a waitqueue, to
+   the place there for its current priority.  Must be called
+   whenever a waiting thread's priority changes, as through
+   donation, to keep the queue's heap in order. */
+void
+waitqueue_requeue (struct thread *t)
+{
+  enum intr_level old_level = intr_disable ();
+  struct waiter *w = t->waiter;
+
+  if (w != NULL && w->exclusive && w->priority != t->priority)
+    {
+      heap_remove (&w->wq->exclusive, &w->heap_elem);
+      w->priority = t->priority;
+      heap_insert (&w->wq->exclusive, &w->heap_elem);
+    }
+  intr_set_level (old_level);
+}
+
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
    manipulating it:
@@ -47,7 +365,7 @@ sema_init (struct semaphore *sema, unsigned value)
   ASSERT (sema != NULL);
 
   sema->value = value;
-  list_init (&sema->waiters);
+  waitqueue_init (&sema->waiters);
 }
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
@@ -67,12 +385,67 @@ sema_down (struct semaphore *sema)
 
   old_level = intr_disable ();
   while (sema->value == 0) 
+    waitqueue_wait (&sema->waiters, true, WAIT_FOREVER);
+  sema->value--;
+  intr_set_level (old_level);
+}
+
+/* Down or "P" operation on a semaphore, as sema_down(), except
+   that waitqueue_interrupt() may end the wait.  Returns true if
+   SEMA was decremented, false if the wait was interrupted.
+
+   In the signals kernel, an interrupted thread takes its pending
+   signals on the way back from the wait, and SIG_KILL makes it
+   exit before this function returns, so the caller must not be keeping anything
+   that another thread or a timeout still refers to, such as a
+   struct timeout of its own on its stack. */
+bool
+sema_down_interruptible (struct semaphore *sema)
+{
+  enum intr_level old_level;
+  bool interrupted = false;
+
+  ASSERT (sema != NULL);
+  ASSERT (!intr_context ());
+
+  old_level = intr_disable ();
+  while (sema->value == 0 && !interrupted)
+    wait (&sema->waiters, true, WAIT_FOREVER, NULL, &interrupted);
+  if (!interrupted)
+    sema->value--;
+  intr_set_level (old_level);
+  return !interrupted;
+}
+
+/* Down or "P" operation on a semaphore, giving up if SEMA's
+   value has not become positive within TIMEOUT ticks.  Returns
+   true if the semaphore is decremented, false on timeout.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+bool
+sema_down_timeout (struct semaphore *sema, int64_t timeout)
+{
+  enum intr_level old_level;
+  int64_t deadline = timer_ticks () + timeout;
+  bool success = true;
+
+  ASSERT (sema != NULL);
+  ASSERT (!intr_context ());
+
+  old_level = intr_disable ();
+  while (sema->value == 0 && success)
     {
-      list_push_back (&sema->waiters, &thread_current ()->elem);
-      thread_block ();
+      int64_t left = deadline - timer_ticks ();
+      success = left > 0 && waitqueue_wait (&sema->waiters, true, left);
+    }
+  if (sema->value > 0)
+    {
+      sema->value--;
+      success = true;
     }
-  sema->value--;
   intr_set_level (old_level);
+  return success;
 }
 
 /* Down or "P" operation on a semaphore, but only if the
@@ -102,7 +475,9 @@ sema_try_down (struct semaphore *sema)
 }
 
 /* Up or "V" operation on a semaphore.  Increments SEMA's value
-   and wakes up one thread of those waiting for SEMA, if any.
+   and wakes up the highest-priority thread of those waiting for
+   SEMA, if any, yielding to it if it has a higher priority than
+   the running thread.
 
    This function may be called from an interrupt handler. */
 void
@@ -113,11 +488,27 @@ sema_up (struct semaphore *sema)
   ASSERT (sema != NULL);
 
   old_level = intr_disable ();
-  if (!list_empty (&sema->waiters)) 
-    thread_unblock (list_entry (list_pop_front (&sema->waiters),
-                                struct thread, elem));
+  waitqueue_wake (&sema->waiters, 1);
+  sema->value++;
+  intr_set_level (old_level);
+  thread_check_preempt ();
+}
+
+/* Like sema_up(), for a semaphore that signals the completion of
+   I/O, such as a disk request.  Wakes the waiter with
+   waitqueue_wake_io(). */
+void
+sema_up_io (struct semaphore *sema) 
+{
+  enum intr_level old_level;
+
+  ASSERT (sema != NULL);
+
+  old_level = intr_disable ();
+  waitqueue_wake_io (&sema->waiters, 1);
   sema->value++;
   intr_set_level (old_level);
+  thread_check_preempt ();
 }
 
 static void sema_test_helper (void *sema_);
@@ -171,20 +562,32 @@ sema_test_helper (void *sema_)
    another one "up" it, but with a lock the same thread must both
    acquire and release it.  When these restrictions prove
    onerous, it's a good sign that a semaphore should be used,
-   instead of a lock. */
+   instead of a lock.
+
+   NAME, which must stay valid forever (a string literal, say),
+   identifies the lock in lock profiling.  Locks with the same
+   name are profiled together.  lock_init() names each lock after
+   the line that initializes it. */
 void
-lock_init (struct lock *lock)
+lock_init_named (struct lock *lock, const char *name)
 {
   ASSERT (lock != NULL);
+  ASSERT (name != NULL);
 
   lock->holder = NULL;
   sema_init (&lock->semaphore, 1);
+  lock->stat = lockstat_enabled ? lockstat_lookup (name) : NULL;
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
    necessary.  The lock must not already be held by the current
    thread.
 
+   While waiting, the current thread donates its priority to the
+   holder of LOCK and, if that thread is waiting for another
+   lock, on through the chain of holders, up to DONATION_DEPTH
+   locks deep.  The 4.4BSD scheduler does not use donation.
+
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
    interrupts disabled, but interrupts will be turned back on if
@@ -192,12 +595,114 @@ lock_init (struct lock *lock)
 void
 lock_acquire (struct lock *lock)
 {
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  bool contended;
+  uint64_t start = 0;
+
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
+  contended = lock->holder != NULL;
+  if (contended && !thread_mlfqs)
+    {
+      cur->wait_lock = lock;
+      donate_priority (cur);
+    }
+  if (contended && lock->stat != NULL)
+    start = clock_cycles ();
   sema_down (&lock->semaphore);
-  lock->holder = thread_current ();
+  if (contended && lock->stat != NULL)
+    {
+      lock->stat->contended++;
+      lock->stat->wait_cycles += clock_cycles () - start;
+    }
+  cur->wait_lock = NULL;
+  lock->holder = cur;
+  list_push_back (&cur->held_locks, &lock->elem);
+  lockstat_acquired (lock);
+  intr_set_level (old_level);
+}
+
+/* Passes thread T's priority on to the holder of the lock T is
+   waiting for, and so on along the chain of holders.  Interrupts
+   must be off. */
+static void
+donate_priority (struct thread *t)
+{
+  struct lock *lock = t->wait_lock;
+  int depth;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (depth = 0; lock != NULL && lock->holder != NULL
+                  && depth < DONATION_DEPTH; depth++)
+    {
+      struct thread *holder = lock->holder;
+      if (holder->priority >= t->priority)
+        break;
+      thread_donate_priority (holder, t->priority);
+      t = holder;
+      lock = holder->wait_lock;
+    }
+}
+
+/* Times lock_acquire_adaptive() tries for a lock before it
+   sleeps. */
+#define LOCK_SPIN_CNT 4
+
+/* Acquires LOCK, as lock_acquire(), but for a lock that is only
+   held briefly: while the holder is running (on another CPU) or
+   is ready to run and no less important than us, keeps trying to
+   get the lock without sleeping, by spinning or yielding to the
+   holder, up to LOCK_SPIN_CNT times.  Only then does it sleep,
+   donating its priority to the holder.  On one CPU the holder is
+   never running while we are, so the spinning is for SMP.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+lock_acquire_adaptive (struct lock *lock)
+{
+  int i;
+
+  ASSERT (lock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!lock_held_by_current_thread (lock));
+
+  for (i = 0; i < LOCK_SPIN_CNT; i++)
+    {
+      enum intr_level old_level;
+      struct thread *holder;
+      bool yield;
+
+      if (lock_try_acquire (lock))
+        return;
+
+      old_level = intr_disable ();
+      holder = lock->holder;
+      if (holder == NULL || holder->status == THREAD_RUNNING)
+        yield = false;
+      else if (holder->status == THREAD_READY
+               && holder->priority >= thread_current ()->priority)
+        yield = true;
+      else
+        {
+          /* The holder is blocked, or would not run if we
+             yielded.  Sleeping is the only way to progress. */
+          intr_set_level (old_level);
+          break;
+        }
+      intr_set_level (old_level);
+
+      if (yield)
+        thread_yield ();
+      else
+        asm volatile ("pause" : : : "memory");
+    }
+  lock_acquire (lock);
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -209,14 +714,21 @@ lock_acquire (struct lock *lock)
 bool
 lock_try_acquire (struct lock *lock)
 {
+  enum intr_level old_level;
   bool success;
 
   ASSERT (lock != NULL);
   ASSERT (!lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
   success = sema_try_down (&lock->semaphore);
   if (success)
-    lock->holder = thread_current ();
+    {
+      lock->holder = thread_current ();
+      list_push_back (&lock->holder->held_locks, &lock->elem);
+      lockstat_acquired (lock);
+    }
+  intr_set_level (old_level);
   return success;
 }
 
@@ -228,10 +740,24 @@ lock_try_acquire (struct lock *lock)
 void
 lock_release (struct lock *lock) 
 {
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
+  /* Give up the priority donated through LOCK. */
+  old_level = intr_disable ();
+  if (lock->stat != NULL)
+    {
+      uint64_t hold = clock_cycles () - lock->acquired_tsc;
+      if (hold > lock->stat->max_hold)
+        lock->stat->max_hold = hold;
+    }
+  list_remove (&lock->elem);
   lock->holder = NULL;
+  if (!thread_mlfqs)
+    thread_update_priority (thread_current ());
+  intr_set_level (old_level);
   sema_up (&lock->semaphore);
 }
 
@@ -246,13 +772,6 @@ lock_held_by_current_thread (const struct lock *lock)
   return lock->holder == thread_current ();
 }
 
-/* One semaphore in a list. */
-struct semaphore_elem 
-  {
-    struct list_elem elem;              /* List element. */
-    struct semaphore semaphore;         /* This semaphore. */
-  };
-
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
    code to receive the signal and act upon it. */
@@ -261,7 +780,7 @@ cond_init (struct condition *cond)
 {
   ASSERT (cond != NULL);
 
-  list_init (&cond->waiters);
+  waitqueue_init (&cond->waiters);
 }
 
 /* Atomically releases LOCK and waits for COND to be signaled by
@@ -287,22 +806,37 @@ cond_init (struct condition *cond)
 void
 cond_wait (struct condition *cond, struct lock *lock) 
 {
-  struct semaphore_elem waiter;
+  cond_wait_timeout (cond, lock, WAIT_FOREVER);
+}
+
+/* Like cond_wait(), but gives up waiting for COND to be signaled
+   after TIMEOUT ticks, unless TIMEOUT is WAIT_FOREVER.  Either
+   way, reacquires LOCK before returning.  Returns true if COND
+   was signaled, false on timeout. */
+bool
+cond_wait_timeout (struct condition *cond, struct lock *lock,
+                   int64_t timeout)
+{
+  enum intr_level old_level;
+  bool signaled;
 
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (lock_held_by_current_thread (lock));
-  
-  sema_init (&waiter.semaphore, 0);
-  list_push_back (&cond->waiters, &waiter.elem);
-  lock_release (lock);
-  sema_down (&waiter.semaphore);
+
+  /* Queue up before releasing LOCK, so that a signal sent as soon
+     as it is released still finds us. */
+  old_level = intr_disable ();
+  signaled = wait (&cond->waiters, true, timeout, lock, NULL);
+  intr_set_level (old_level);
   lock_acquire (lock);
+  return signaled;
 }
 
 /* If any threads are waiting on COND (protected by LOCK), then
-   this function signals one of them to wake up from its wait.
+   this function signals the one with the highest priority to
+   wake up from its wait.
    LOCK must be held before calling this function.
 
    An interrupt handler cannot acquire a lock, so it does not
@@ -316,9 +850,7 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
   ASSERT (!intr_context ());
   ASSERT (lock_held_by_current_thread (lock));
 
-  if (!list_empty (&cond->waiters)) 
-    sema_up (&list_entry (list_pop_front (&cond->waiters),
-                          struct semaphore_elem, elem)->semaphore);
+  waitqueue_wake (&cond->waiters, 1);
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -332,7 +864,343 @@ cond_broadcast (struct condition *cond, struct lock *lock)
 {
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
+  ASSERT (lock_held_by_current_thread (lock));
+
+  waitqueue_wake_all (&cond->waiters);
+}
+
+/* Initializes RWLOCK.  Any number of readers may hold a
+   readers-writer lock at once, or a single writer.
+
+   A writer takes WRITE_LOCK, an ordinary lock, and keeps it
+   until it releases the readers-writer lock.  Readers pass
+   through WRITE_LOCK on the way in.  So a writer that is waiting
+   for readers to leave holds off readers that arrive after it,
+   and a steady stream of readers cannot starve writers; threads
+   blocked by a writer, whether readers or writers, donate their
+   priority to it; and when the writer leaves, the
+   highest-priority of them goes first.  Readers have no owner,
+   so a writer waiting for readers to leave does not donate
+   priority to them. */
+void
+rwlock_init (struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+
+  lock_init_named (&rwlock->write_lock, "rwlock write_lock");
+  lock_init_named (&rwlock->lock, "rwlock lock");
+  cond_init (&rwlock->no_readers);
+  rwlock->reader_cnt = 0;
+}
+
+/* Adds a reader to RWLOCK, whose write_lock the caller holds. */
+static void
+add_reader (struct rwlock *rwlock)
+{
+  lock_acquire (&rwlock->lock);
+  rwlock->reader_cnt++;
+  lock_release (&rwlock->lock);
+}
+
+/* Acquires RWLOCK for reading, sleeping until no writer holds
+   or is waiting for it. */
+void
+rwlock_acquire_read (struct rwlock *rwlock)
+{
+  lock_acquire (&rwlock->write_lock);
+  add_reader (rwlock);
+  lock_release (&rwlock->write_lock);
+}
+
+/* Tries to acquire RWLOCK for reading and returns true if
+   successful or false on failure, which happens when a writer
+   holds or is waiting for it.  Does not sleep on RWLOCK, so it
+   may be called where sleeping until a writer leaves would
+   deadlock. */
+bool
+rwlock_try_acquire_read (struct rwlock *rwlock)
+{
+  if (!lock_try_acquire (&rwlock->write_lock))
+    return false;
+  add_reader (rwlock);
+  lock_release (&rwlock->write_lock);
+  return true;
+}
+
+/* Releases RWLOCK, which the current thread holds for reading. */
+void
+rwlock_release_read (struct rwlock *rwlock)
+{
+  lock_acquire (&rwlock->lock);
+  ASSERT (rwlock->reader_cnt > 0);
+  if (--rwlock->reader_cnt == 0)
+    cond_signal (&rwlock->no_readers, &rwlock->lock);
+  lock_release (&rwlock->lock);
+}
+
+/* Acquires RWLOCK for writing, sleeping until no one else holds
+   it. */
+void
+rwlock_acquire_write (struct rwlock *rwlock)
+{
+  lock_acquire (&rwlock->write_lock);
+  lock_acquire (&rwlock->lock);
+  while (rwlock->reader_cnt > 0)
+    cond_wait (&rwlock->no_readers, &rwlock->lock);
+  lock_release (&rwlock->lock);
+}
+
+/* Tries to acquire RWLOCK for writing and returns true if
+   successful or false on failure, which happens when anyone
+   else holds or is waiting for it. */
+bool
+rwlock_try_acquire_write (struct rwlock *rwlock)
+{
+  bool success;
+
+  if (!lock_try_acquire (&rwlock->write_lock))
+    return false;
+  lock_acquire (&rwlock->lock);
+  success = rwlock->reader_cnt == 0;
+  lock_release (&rwlock->lock);
+  if (!success)
+    lock_release (&rwlock->write_lock);
+  return success;
+}
+
+/* Releases RWLOCK, which the current thread holds for writing.
+   The highest-priority thread waiting for it goes next, along
+   with any readers behind it. */
+void
+rwlock_release_write (struct rwlock *rwlock)
+{
+  ASSERT (rwlock_held_for_write (rwlock));
+
+  lock_release (&rwlock->write_lock);
+}
+
+/* Turns the current thread's hold on RWLOCK for writing into a
+   hold for reading, without letting any writer in between. */
+void
+rwlock_downgrade (struct rwlock *rwlock)
+{
+  ASSERT (rwlock_held_for_write (rwlock));
+
+  add_reader (rwlock);
+  lock_release (&rwlock->write_lock);
+}
+
+/* Returns true if the current thread holds RWLOCK for writing.
+   (There is no way to tell whether it holds it for reading.) */
+bool
+rwlock_held_for_write (const struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+
+  return lock_held_by_current_thread (&rwlock->write_lock);
+}
+
+
+/* Initializes BARRIER for rounds of CNT threads, which must be
+   positive. */
+void
+barrier_init (struct barrier *barrier, unsigned cnt)
+{
+  ASSERT (barrier != NULL);
+  ASSERT (cnt > 0);
+
+  barrier->cnt = cnt;
+  barrier->arrived = 0;
+  barrier->round = 0;
+  waitqueue_init (&barrier->waiters);
+}
+
+/* Waits at BARRIER until its round's CNT threads have all
+   arrived.  Returns true in exactly one of them, the last to
+   arrive, which can then do any work that must be done once
+   between rounds, and false in the others.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+bool
+barrier_wait (struct barrier *barrier)
+{
+  enum intr_level old_level;
+  unsigned round;
+  bool last;
+
+  ASSERT (barrier != NULL);
+  ASSERT (!intr_context ());
+
+  old_level = intr_disable ();
+  round = barrier->round;
+  last = ++barrier->arrived == barrier->cnt;
+  if (last)
+    {
+      barrier->arrived = 0;
+      barrier->round++;
+      waitqueue_wake_all (&barrier->waiters);
+    }
+  else
+    while (barrier->round == round)
+      waitqueue_wait (&barrier->waiters, false, WAIT_FOREVER);
+  intr_set_level (old_level);
+  if (last)
+    thread_check_preempt ();
+  return last;
+}
+
+/* Initializes LATCH to open after COUNT calls to
+   latch_count_down(), or at once if COUNT is 0. */
+void
+latch_init (struct latch *latch, unsigned count)
+{
+  ASSERT (latch != NULL);
+
+  latch->count = count;
+  waitqueue_init (&latch->waiters);
+}
+
+/* Counts LATCH down by one, waking its waiters if that opens it.
+   Counting down an open latch does nothing.
+
+   This function may be called from an interrupt handler. */
+void
+latch_count_down (struct latch *latch)
+{
+  enum intr_level old_level;
+
+  ASSERT (latch != NULL);
+
+  old_level = intr_disable ();
+  if (latch->count > 0 && --latch->count == 0)
+    waitqueue_wake_all (&latch->waiters);
+  intr_set_level (old_level);
+  thread_check_preempt ();
+}
+
+/* Waits until LATCH is open.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+latch_wait (struct latch *latch)
+{
+  enum intr_level old_level;
+
+  ASSERT (latch != NULL);
+  ASSERT (!intr_context ());
+
+  old_level = intr_disable ();
+  while (latch->count > 0)
+    waitqueue_wait (&latch->waiters, false, WAIT_FOREVER);
+  intr_set_level (old_level);
+}
+
+/* Waits until LATCH is open, giving up after TIMEOUT ticks.
+   Returns true if it opened, false on timeout.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+bool
+latch_wait_timeout (struct latch *latch, int64_t timeout)
+{
+  enum intr_level old_level;
+  int64_t deadline = timer_ticks () + timeout;
+  bool open;
+
+  ASSERT (latch != NULL);
+  ASSERT (!intr_context ());
+
+  old_level = intr_disable ();
+  while (latch->count > 0)
+    {
+      int64_t left = deadline - timer_ticks ();
+      if (left <= 0)
+        break;
+      waitqueue_wait (&latch->waiters, false, left);
+    }
+  open = latch->count == 0;
+  intr_set_level (old_level);
+  return open;
+}
+
+/* Returns the profile for locks named NAME, creating it if
+   necessary, or a null pointer if the table is full. */
+static struct lockstat *
+lockstat_lookup (const char *name)
+{
+  struct lockstat *ls = NULL;
+  enum intr_level old_level = intr_disable ();
+  size_t i;
+
+  for (i = 0; i < lockstat_cnt; i++)
+    if (lockstats[i].name == name || !strcmp (lockstats[i].name, name))
+      {
+        ls = &lockstats[i];
+        break;
+      }
+  if (ls == NULL && lockstat_cnt < LOCKSTAT_CNT)
+    {
+      ls = &lockstats[lockstat_cnt++];
+      ls->name = name;
+    }
+  intr_set_level (old_level);
+  return ls;
+}
+
+/* Records that the current thread has just acquired LOCK.
+   Interrupts must be off. */
+static void
+lockstat_acquired (struct lock *lock)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (lock->stat != NULL)
+    {
+      lock->stat->acquires++;
+      lock->acquired_tsc = clock_cycles ();
+    }
+}
+
+/* Orders pointers to lock profiles from most to least waiting,
+   then from most to least contended. */
+static int
+lockstat_compare (const void *a_, const void *b_)
+{
+  const struct lockstat *a = *(struct lockstat *const *) a_;
+  const struct lockstat *b = *(struct lockstat *const *) b_;
+
+  if (a->wait_cycles != b->wait_cycles)
+    return a->wait_cycles < b->wait_cycles ? 1 : -1;
+  if (a->contended != b->contended)
+    return a->contended < b->contended ? 1 : -1;
+  return 0;
+}
+
+/* Prints the profiles of the locks that were acquired, those
+   waited for the most first. */
+void
+lockstat_print_stats (void)
+{
+  static struct lockstat *sorted[LOCKSTAT_CNT];
+  enum intr_level old_level;
+  size_t i, cnt;
+
+  if (!lockstat_enabled)
+    return;
+
+  old_level = intr_disable ();
+  for (i = cnt = 0; i < lockstat_cnt; i++)
+    if (lockstats[i].acquires > 0)
+      sorted[cnt++] = &lockstats[i];
+  qsort (sorted, cnt, sizeof *sorted, lockstat_compare);
+  intr_set_level (old_level);
 
-  while (!list_empty (&cond->waiters))
-    cond_signal (cond, lock);
+  for (i = 0; i < cnt; i++)
+    printf ("Lock %s: %llu acquires, %llu contended, %llu ns waiting, "
+            "%llu ns max hold\n", sorted[i]->name, sorted[i]->acquires,
+            sorted[i]->contended,
+            (unsigned long long) clock_cycles_to_ns (sorted[i]->wait_cycles),
+            (unsigned long long) clock_cycles_to_ns (sorted[i]->max_hold));
 }
@@ -1,46 +1,145 @@
 #ifndef THREADS_SYNCH_H
 #define THREADS_SYNCH_H
 
+#include <heap.h>
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
+
+/* A queue of threads waiting for an event.  Each waits either
+   exclusively, so that one wakeup wakes only one of them, or
+   shared, so that any wakeup wakes all of them.  Exclusive
+   waiters are kept in a heap by priority, so that waking the
+   highest-priority one takes O(log n) time however many wait. */
+struct waitqueue
+  {
+    struct heap exclusive;      /* Exclusive waiters' struct waiters. */
+    struct list shared;         /* Shared waiters' struct waiters. */
+    unsigned next_seq;          /* Orders exclusive waiters of equal
+                                   priority first come, first
+                                   served. */
+  };
+
+struct thread;
+
+/* Timeout for waiting forever. */
+#define WAIT_FOREVER ((int64_t) -1)
+
+void waitqueue_init (struct waitqueue *);
+bool waitqueue_empty (struct waitqueue *);
+bool waitqueue_wait (struct waitqueue *, bool exclusive, int64_t timeout);
+size_t waitqueue_wake (struct waitqueue *, size_t cnt);
+size_t waitqueue_wake_all (struct waitqueue *);
+size_t waitqueue_wake_io (struct waitqueue *, size_t cnt);
+bool waitqueue_io_wakeup (void);
+int waitqueue_max_priority (struct waitqueue *);
+bool waitqueue_interrupt (struct thread *);
+void waitqueue_requeue (struct thread *);
 
 /* A counting semaphore. */
 struct semaphore 
   {
     unsigned value;             /* Current value. */
-    struct list waiters;        /* List of waiting threads. */
+    struct waitqueue waiters;   /* Waiting threads. */
   };
 
 void sema_init (struct semaphore *, unsigned value);
 void sema_down (struct semaphore *);
+bool sema_down_interruptible (struct semaphore *);
+bool sema_down_timeout (struct semaphore *, int64_t timeout);
 bool sema_try_down (struct semaphore *);
 void sema_up (struct semaphore *);
+void sema_up_io (struct semaphore *);
 void sema_self_test (void);
 
 /* Lock. */
 struct lock 
   {
-    struct thread *holder;      /* Thread holding lock (for debugging). */
+    struct thread *holder;      /* Thread holding lock. */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
+    struct list_elem elem;      /* Element in holder's held_locks. */
+    struct lockstat *stat;      /* Statistics for the lock's name, or
+                                   null if not profiling. */
+    uint64_t acquired_tsc;      /* TSC when the holder acquired it. */
   };
 
-void lock_init (struct lock *);
+void lock_init_named (struct lock *, const char *name);
+
+/* Initializes LOCK, naming it for lock profiling after the source
+   line that initialized it. */
+#define lock_init(LOCK) \
+        lock_init_named (LOCK, __FILE__ ":" LOCK_STRINGIFY (__LINE__))
+#define LOCK_STRINGIFY(X) LOCK_STRINGIFY_ (X)
+#define LOCK_STRINGIFY_(X) #X
 void lock_acquire (struct lock *);
+void lock_acquire_adaptive (struct lock *);
 bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
 
+/* Lock profiling. */
+extern bool lockstat_enabled;
+void lockstat_print_stats (void);
+
 /* Condition variable. */
 struct condition 
   {
-    struct list waiters;        /* List of waiting threads. */
+    struct waitqueue waiters;   /* Waiting threads. */
   };
 
 void cond_init (struct condition *);
 void cond_wait (struct condition *, struct lock *);
+bool cond_wait_timeout (struct condition *, struct lock *, int64_t timeout);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Readers-writer lock. */
+struct rwlock
+  {
+    struct lock write_lock;     /* Held by the writer, or the writer
+                                   waiting for readers to leave. */
+    struct lock lock;           /* Protects reader_cnt. */
+    struct condition no_readers; /* Signaled when reader_cnt drops to 0. */
+    unsigned reader_cnt;        /* Number of readers holding it. */
+  };
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+bool rwlock_try_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+bool rwlock_try_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+void rwlock_downgrade (struct rwlock *);
+bool rwlock_held_for_write (const struct rwlock *);
+
+/* Barrier: each of a fixed number of threads waits until all of
+   them have arrived, then all go on together.  Reusable: the
+   next round starts as soon as the last thread arrives. */
+struct barrier
+  {
+    unsigned cnt;               /* Threads per round. */
+    unsigned arrived;           /* Threads waiting in this round. */
+    unsigned round;             /* Rounds completed. */
+    struct waitqueue waiters;   /* Waiting threads. */
+  };
+
+void barrier_init (struct barrier *, unsigned cnt);
+bool barrier_wait (struct barrier *);
+
+/* Countdown latch: threads wait until it has been counted down
+   a given number of times, after which it stays open. */
+struct latch
+  {
+    unsigned count;             /* Count-downs still to come. */
+    struct waitqueue waiters;   /* Waiting threads. */
+  };
+
+void latch_init (struct latch *, unsigned count);
+void latch_count_down (struct latch *);
+void latch_wait (struct latch *);
+bool latch_wait_timeout (struct latch *, int64_t timeout);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
@@ -1,13 +1,22 @@
 #include "threads/thread.h"
 #include <debug.h>
+#include <inttypes.h>
 #include <stddef.h>
 #include <random.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/clock.h"
+#include "devices/timer.h"
 #include "threads/flags.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
+#include "threads/kstack.h"
 #include "threads/palloc.h"
+#include "threads/percpu.h"
+#include "threads/rcu.h"
+#include "threads/sched-trace.h"
+#include "threads/seqlock.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -37,6 +46,16 @@ static struct thread *initial_thread;
 /* Lock used by allocate_tid(). */
 static struct lock tid_lock;
 
+/* Pages of dead threads, kept for thread_create() to reuse, so
+   that short-lived threads need not go back to palloc or have
+   their pages zeroed each time.  Linked through their `elem'
+   members, most recently freed first.  Emptied when the kernel
+   pool runs short.  Protected by turning interrupts off. */
+#define THREAD_CACHE_MAX 16
+static struct list thread_cache;
+static size_t thread_cache_cnt;
+static struct palloc_notifier thread_cache_notifier;
+
 /* Stack frame for kernel_thread(). */
 struct kernel_thread_frame 
   {
@@ -45,10 +64,13 @@ struct kernel_thread_frame
     void *aux;                  /* Auxiliary data for function. */
   };
 
-/* Statistics. */
-static long long idle_ticks;    /* # of timer ticks spent idle. */
-static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
-static long long user_ticks;    /* # of timer ticks in user programs. */
+/* Statistics.  Written only by the timer interrupt handler,
+   under stats_seq, so readers need not turn interrupts off.  The
+   tick counts are per CPU, summed by thread_print_stats(). */
+static struct seqlock stats_seq;
+static struct pcpu_counter idle_ticks;   /* # of ticks spent idle. */
+static struct pcpu_counter kernel_ticks; /* # of ticks in kernel threads. */
+static struct pcpu_counter user_ticks;   /* # of ticks in user programs. */
 
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
@@ -59,6 +81,10 @@ static unsigned thread_ticks;   /* # of timer ticks since last yield. */
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* If true, print CPU accounting for each thread.
+   Controlled by kernel command-line option "-acct". */
+bool thread_acct_print;
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
@@ -66,10 +92,18 @@ static struct thread *running_thread (void);
 static struct thread *next_thread_to_run (void);
 static void init_thread (struct thread *, const char *name, int priority);
 static bool is_thread (struct thread *) UNUSED;
+static struct thread *alloc_thread_page (void);
+static void free_thread_page (struct thread *);
+static palloc_notify_func drain_thread_cache;
 static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
+static void acct_switch (struct thread *cur, struct thread *next);
+static void print_acct (struct thread *, void *aux);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
+static bool priority_more (const struct list_elem *,
+                           const struct list_elem *, void *aux);
+static void thread_requeue (struct thread *);
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
@@ -88,14 +122,19 @@ void
 thread_init (void) 
 {
   ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (offsetof (struct thread, acct) == THREAD_LINE_SIZE);
+  ASSERT (sizeof (struct thread_acct) <= THREAD_LINE_SIZE);
 
-  lock_init (&tid_lock);
+  lock_init_named (&tid_lock, "tid_lock");
+  seqlock_init (&stats_seq);
   list_init (&ready_list);
   list_init (&all_list);
+  list_init (&thread_cache);
 
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
   init_thread (initial_thread, "main", PRI_DEFAULT);
+  prng_init (&initial_thread->prng, random_ulong ());
   initial_thread->status = THREAD_RUNNING;
   initial_thread->tid = allocate_tid ();
 }
@@ -115,36 +154,79 @@ thread_start (void)
 
   /* Wait for the idle thread to initialize idle_thread. */
   sema_down (&idle_started);
+
+  /* palloc_init() has run by now, so the notifier can be
+     registered. */
+  palloc_register_notifier (&thread_cache_notifier, drain_thread_cache,
+                            NULL);
 }
 
-/* Called by the timer interrupt handler at each timer tick.
-   Thus, this function runs in an external interrupt context. */
+/* Called by the timer interrupt handler at each timer tick,
+   with USER true if the tick interrupted user code.  Thus, this
+   function runs in an external interrupt context. */
 void
-thread_tick (void) 
+thread_tick (bool user)
 {
   struct thread *t = thread_current ();
 
   /* Update statistics. */
+  seqlock_write_begin (&stats_seq);
   if (t == idle_thread)
-    idle_ticks++;
+    pcpu_inc (&idle_ticks);
 #ifdef USERPROG
   else if (t->pagedir != NULL)
-    user_ticks++;
+    pcpu_inc (&user_ticks);
 #endif
   else
-    kernel_ticks++;
+    pcpu_inc (&kernel_ticks);
+  seqlock_write_end (&stats_seq);
+  if (t != idle_thread)
+    {
+      if (user)
+        t->acct.user_ticks++;
+      else
+        t->acct.kernel_ticks++;
+    }
 
   /* Enforce preemption. */
   if (++thread_ticks >= TIME_SLICE)
     intr_yield_on_return ();
 }
 
+/* Called by the timer interrupt handler for each tick that
+   passed while the idle thread waited with the timer stopped
+   (see timer_idle_enter()), other than the one being handled. */
+void
+thread_idle_tick (void)
+{
+  seqlock_write_begin (&stats_seq);
+  pcpu_inc (&idle_ticks);
+  seqlock_write_end (&stats_seq);
+}
+
 /* Prints thread statistics. */
 void
 thread_print_stats (void) 
 {
+  long long idle, kernel, user;
+  unsigned seq;
+
+  do
+    {
+      seq = seqlock_read_begin (&stats_seq);
+      idle = pcpu_read (&idle_ticks);
+      kernel = pcpu_read (&kernel_ticks);
+      user = pcpu_read (&user_ticks);
+    }
+  while (seqlock_read_retry (&stats_seq, seq));
   printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
-          idle_ticks, kernel_ticks, user_ticks);
+          idle, kernel, user);
+  if (thread_acct_print)
+    {
+      enum intr_level old_level = intr_disable ();
+      thread_foreach (print_acct, NULL);
+      intr_set_level (old_level);
+    }
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -159,9 +241,9 @@ thread_print_stats (void)
    scheduled.  Use a semaphore or some other form of
    synchronization if you need to ensure ordering.
 
-   The code provided sets the new thread's `priority' member to
-   PRIORITY, but no actual priority scheduling is implemented.
-   Priority scheduling is the goal of Problem 1-3. */
+   The ready list is kept in priority order, so the new thread
+   runs first if its PRIORITY is higher than that of the running
+   thread. */
 tid_t
 thread_create (const char *name, int priority,
                thread_func *function, void *aux) 
@@ -176,14 +258,17 @@ thread_create (const char *name, int priority,
   ASSERT (function != NULL);
 
   /* Allocate thread. */
-  t = palloc_get_page (PAL_ZERO);
+  t = alloc_thread_page ();
   if (t == NULL)
     return TID_ERROR;
 
   /* Initialize thread. */
   init_thread (t, name, priority);
+  prng_init (&t->prng, prng_next (&thread_current ()->prng));
   tid = t->tid = allocate_tid ();
 
+  sched_trace (SCHED_CREATE, t, -1, -1);
+
   /* Prepare thread for first run by initializing its stack.
      Do this atomically so intermediate values for the 'stack' 
      member cannot be observed. */
@@ -206,8 +291,10 @@ thread_create (const char *name, int priority,
 
   intr_set_level (old_level);
 
-  /* Add to run queue. */
+  /* Add to run queue, and run it now if it has a higher
+     priority. */
   thread_unblock (t);
+  thread_check_preempt ();
 
   return tid;
 }
@@ -245,8 +332,11 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  list_push_back (&ready_list, &t->elem);
+  list_insert_ordered (&ready_list, &t->elem, priority_more, NULL);
+  t->acct.blocked_cycles += clock_cycles () - t->acct.since;
+  t->acct.since = clock_cycles ();
   t->status = THREAD_READY;
+  sched_trace (SCHED_WAKE, t, -1, -1);
   intr_set_level (old_level);
 }
 
@@ -257,6 +347,20 @@ thread_name (void)
   return thread_current ()->name;
 }
 
+/* Returns the running thread's own pseudo-random number
+   generator, for uses that need speed rather than RC4's
+   reproducible stream.  Each thread's generator is seeded from
+   its creator's, and the initial thread's from random_ulong(),
+   so a run with a fixed "-rs" seed is repeatable.  Must not be
+   called from an interrupt handler, which would share the
+   generator with the thread it interrupted. */
+struct prng *
+thread_prng (void) 
+{
+  ASSERT (!intr_context ());
+  return &thread_current ()->prng;
+}
+
 /* Returns the running thread.
    This is running_thread() plus a couple of sanity checks.
    See the big comment at the top of thread.h for details. */
@@ -293,6 +397,9 @@ thread_exit (void)
 #ifdef USERPROG
   process_exit ();
 #endif
+  fpu_exit ();
+  if (thread_acct_print)
+    print_acct (thread_current (), NULL);
 
   /* Remove thread from all threads list, set our status to dying,
      and schedule another process.  That process will destroy us
@@ -316,20 +423,24 @@ thread_yield (void)
 
   old_level = intr_disable ();
   if (cur != idle_thread) 
-    list_push_back (&ready_list, &cur->elem);
+    list_insert_ordered (&ready_list, &cur->elem, priority_more, NULL);
   cur->status = THREAD_READY;
   schedule ();
   intr_set_level (old_level);
 }
 
 /* Invoke function 'func' on all threads, passing along 'aux'.
-   This function must be called with interrupts off. */
+   This function must be called with interrupts off or in an RCU
+   read-side section, and 'func' must not sleep.  Threads are
+   added to all_list and removed from it with interrupts off,
+   and a dying thread's page is freed only after the switch away
+   from it, which ends any read-side section that found it. */
 void
 thread_foreach (thread_action_func *func, void *aux)
 {
   struct list_elem *e;
 
-  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (intr_get_level () == INTR_OFF || rcu_read_locked ());
 
   for (e = list_begin (&all_list); e != list_end (&all_list);
        e = list_next (e))
@@ -339,11 +450,124 @@ thread_foreach (thread_action_func *func, void *aux)
     }
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Sets the current thread's priority to NEW_PRIORITY.  If it
+   has been donated a higher priority, that stays in effect until
+   the donation ends.  Yields if the thread no longer has the
+   highest priority. */
 void
 thread_set_priority (int new_priority) 
 {
-  thread_current ()->priority = new_priority;
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  cur->base_priority = new_priority;
+  thread_update_priority (cur);
+  intr_set_level (old_level);
+  thread_check_preempt ();
+}
+
+/* Raises thread T's priority to PRIORITY, if that is higher, on
+   behalf of a thread waiting for a lock that T holds. */
+void
+thread_donate_priority (struct thread *t, int priority)
+{
+  enum intr_level old_level = intr_disable ();
+  if (priority > t->priority)
+    {
+      t->priority = priority;
+      thread_requeue (t);
+    }
+  intr_set_level (old_level);
+}
+
+/* Recomputes thread T's priority as the highest of its own and
+   those of the threads waiting for locks that T holds. */
+void
+thread_update_priority (struct thread *t)
+{
+  enum intr_level old_level = intr_disable ();
+  int priority = t->base_priority;
+  struct list_elem *e;
+
+  for (e = list_begin (&t->held_locks); e != list_end (&t->held_locks);
+       e = list_next (e))
+    {
+      struct lock *lock = list_entry (e, struct lock, elem);
+      int waiter_priority = waitqueue_max_priority (&lock->semaphore.waiters);
+      if (waiter_priority > priority)
+        priority = waiter_priority;
+    }
+  if (priority != t->priority)
+    {
+      t->priority = priority;
+      thread_requeue (t);
+    }
+  intr_set_level (old_level);
+}
+
+/* Yields the CPU if a ready thread has a higher priority than
+   the running thread.  In an interrupt handler, yields on return
+   from the interrupt instead.  Does not yield if the caller has
+   turned interrupts off, since it may be in the middle of an
+   update that must be atomic; such callers should call this
+   again once interrupts are back on. */
+void
+thread_check_preempt (void)
+{
+  enum intr_level old_level = intr_disable ();
+  bool preempt = (!list_empty (&ready_list)
+                  && (list_entry (list_front (&ready_list),
+                                  struct thread, elem)->priority
+                      > thread_current ()->priority));
+  intr_set_level (old_level);
+
+  if (preempt)
+    {
+      if (intr_context ())
+        intr_yield_on_return ();
+      else if (old_level == INTR_ON)
+        thread_yield ();
+    }
+}
+
+/* Returns true if thread A, given by its `elem', has lower
+   priority than thread B. */
+bool
+thread_priority_less (const struct list_elem *a_,
+                      const struct list_elem *b_, void *aux UNUSED)
+{
+  const struct thread *a = list_entry (a_, struct thread, elem);
+  const struct thread *b = list_entry (b_, struct thread, elem);
+
+  return a->priority < b->priority;
+}
+
+/* Returns true if thread A, given by its `elem', has higher
+   priority than thread B.  Keeps the ready list in descending
+   order of priority, first come first served within one. */
+static bool
+priority_more (const struct list_elem *a, const struct list_elem *b,
+               void *aux UNUSED)
+{
+  return thread_priority_less (b, a, NULL);
+}
+
+/* Puts thread T back in the ready list, if it is ready, or in
+   the waitqueue it is waiting in, if any, at the place for its
+   current priority.  Interrupts must be off. */
+static void
+thread_requeue (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (t->status == THREAD_READY)
+    {
+      list_remove (&t->elem);
+      list_insert_ordered (&ready_list, &t->elem, priority_more, NULL);
+    }
+  else
+    waitqueue_requeue (t);
 }
 
 /* Returns the current thread's priority. */
@@ -406,6 +630,15 @@ idle (void *idle_started_ UNUSED)
       intr_disable ();
       thread_block ();
 
+      /* Zero free pages while nothing else wants the CPU.  If a
+         thread became ready meanwhile, go back and run it. */
+      intr_enable ();
+      while (list_empty (&ready_list) && palloc_zero_idle ())
+        continue;
+      intr_disable ();
+      if (!list_empty (&ready_list))
+        continue;
+
       /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -418,6 +651,7 @@ idle (void *idle_started_ UNUSED)
 
          See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
          7.11.1 "HLT Instruction". */
+      timer_idle_enter ();
       asm volatile ("sti; hlt" : : : "memory");
     }
 }
@@ -440,11 +674,12 @@ running_thread (void)
   uint32_t *esp;
 
   /* Copy the CPU's stack pointer into `esp', and then round that
-     down to the start of a page.  Because `struct thread' is
-     always at the beginning of a page and the stack pointer is
+     down to the start of its stack.  Because `struct thread' is
+     always at the beginning of the page or, for a large stack,
+     the slot that holds the stack, and the stack pointer is
      somewhere in the middle, this locates the curent thread. */
   asm ("mov %%esp, %0" : "=g" (esp));
-  return pg_round_down (esp);
+  return kstack_thread (esp);
 }
 
 /* Returns true if T appears to point to a valid thread. */
@@ -459,17 +694,30 @@ is_thread (struct thread *t)
 static void
 init_thread (struct thread *t, const char *name, int priority)
 {
+  enum intr_level old_level;
+
   ASSERT (t != NULL);
   ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
   ASSERT (name != NULL);
 
   memset (t, 0, sizeof *t);
+  t->acct.since = clock_cycles ();
   t->status = THREAD_BLOCKED;
   strlcpy (t->name, name, sizeof t->name);
-  t->stack = (uint8_t *) t + PGSIZE;
-  t->priority = priority;
+  t->stack = kstack_top (t);
+  t->priority = t->base_priority = priority;
+  list_init (&t->held_locks);
+  t->wait_lock = NULL;
+#ifdef USERPROG
+  t->exit_status = -1;
+  list_init (&t->running_children);
+  list_init (&t->exited_children);
+#endif
   t->magic = THREAD_MAGIC;
+
+  old_level = intr_disable ();
   list_push_back (&all_list, &t->allelem);
+  intr_set_level (old_level);
 }
 
 /* Allocates a SIZE-byte frame at the top of thread T's stack and
@@ -532,6 +780,7 @@ thread_schedule_tail (struct thread *prev)
   /* Activate the new address space. */
   process_activate ();
 #endif
+  fpu_switch (cur);
 
   /* If the thread we switched from is dying, destroy its struct
      thread.  This must happen late so that thread_exit() doesn't
@@ -541,10 +790,86 @@ thread_schedule_tail (struct thread *prev)
   if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread) 
     {
       ASSERT (prev != cur);
-      palloc_free_page (prev);
+      free_thread_page (prev);
     }
 }
 
+/* Returns a page for a new thread, from thread_cache if it has
+   one and otherwise from palloc, or a null pointer if memory is
+   short.  With large kernel stacks, returns a stack slot from
+   kstack_alloc() instead.  The page is not zeroed: init_thread()
+   clears struct thread, and the stack needs no clearing. */
+static struct thread *
+alloc_thread_page (void)
+{
+  struct thread *t = NULL;
+  enum intr_level old_level;
+
+  if (kstack_size > PGSIZE)
+    return kstack_alloc ();
+
+  old_level = intr_disable ();
+  if (!list_empty (&thread_cache))
+    {
+      t = list_entry (list_pop_front (&thread_cache), struct thread, elem);
+      thread_cache_cnt--;
+    }
+  intr_set_level (old_level);
+
+  return t != NULL ? t : palloc_get_page (0);
+}
+
+/* Frees T's page, keeping it in thread_cache if there is room,
+   or T's stack slot.  Clears T's magic number, so that is_thread() rejects stale
+   pointers to it. */
+static void
+free_thread_page (struct thread *t)
+{
+  enum intr_level old_level;
+
+  if (kstack_owns (t))
+    {
+      t->magic = 0;
+      kstack_free (t);
+      return;
+    }
+
+  old_level = intr_disable ();
+  t->magic = 0;
+  if (thread_cache_cnt < THREAD_CACHE_MAX)
+    {
+      list_push_front (&thread_cache, &t->elem);
+      thread_cache_cnt++;
+      t = NULL;
+    }
+  intr_set_level (old_level);
+
+  if (t != NULL)
+    palloc_free_page (t);
+}
+
+/* Gives thread_cache's pages back when the kernel pool comes
+   under pressure. */
+static void
+drain_thread_cache (enum palloc_flags pool, size_t free_cnt UNUSED,
+                    void *aux UNUSED)
+{
+  enum intr_level old_level;
+
+  if (pool & PAL_USER)
+    return;
+
+  old_level = intr_disable ();
+  while (!list_empty (&thread_cache))
+    {
+      struct thread *t = list_entry (list_pop_front (&thread_cache),
+                                     struct thread, elem);
+      thread_cache_cnt--;
+      palloc_free_page (t);
+    }
+  intr_set_level (old_level);
+}
+
 /* Schedules a new process.  At entry, interrupts must be off and
    the running process's state must have been changed from
    running to some other state.  This function finds another
@@ -561,13 +886,59 @@ schedule (void)
 
   ASSERT (intr_get_level () == INTR_OFF);
   ASSERT (cur->status != THREAD_RUNNING);
+  ASSERT (cur->rcu_nesting == 0);
   ASSERT (is_thread (next));
 
+  rcu_quiescent ();
+
+  if (cur == idle_thread && next != cur)
+    timer_idle_exit ();
   if (cur != next)
-    prev = switch_threads (cur, next);
+    {
+      sched_trace_switch (cur, -1, next, -1);
+      acct_switch (cur, next);
+      prev = switch_threads (cur, next);
+    }
   thread_schedule_tail (prev);
 }
 
+/* Charges the time since CUR and NEXT last changed state when the
+   scheduler switches from CUR to NEXT: NEXT was ready that long,
+   and CUR, which is now ready, blocked, or dying, starts its next
+   interval. */
+static void
+acct_switch (struct thread *cur, struct thread *next)
+{
+  uint64_t now = clock_cycles ();
+
+  if (cur->status == THREAD_READY)
+    cur->acct.involuntary++;
+  else if (cur->status == THREAD_BLOCKED)
+    cur->acct.voluntary++;
+  cur->acct.since = now;
+
+  next->acct.ready_cycles += now - next->acct.since;
+  next->acct.since = now;
+}
+
+/* Prints thread T's CPU accounting.  Suitable for
+   thread_foreach(). */
+static void
+print_acct (struct thread *t, void *aux UNUSED)
+{
+  struct thread_acct a = t->acct;
+
+  if (t == idle_thread)
+    return;
+  printf ("Thread %s (tid %d): %lld user ticks, %lld kernel ticks, "
+          "%"PRIu64" ns in interrupts; %u voluntary, %u involuntary "
+          "switches; %"PRIu64" ns ready, %"PRIu64" ns blocked\n",
+          t->name, t->tid, a.user_ticks, a.kernel_ticks,
+          clock_cycles_to_ns (a.intr_cycles), a.voluntary, a.involuntary,
+          clock_cycles_to_ns (a.ready_cycles),
+          clock_cycles_to_ns (a.blocked_cycles));
+}
+
 /* Returns a tid to use for a new thread. */
 static tid_t
 allocate_tid (void) 
@@ -575,7 +946,7 @@ allocate_tid (void)
   static tid_t next_tid = 1;
   tid_t tid;
 
-  lock_acquire (&tid_lock);
+  lock_acquire_adaptive (&tid_lock);
   tid = next_tid++;
   lock_release (&tid_lock);
 
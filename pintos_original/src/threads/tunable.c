@@ -0,0 +1,161 @@
+#include "threads/tunable.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Boot-time tunables.
+
+   A subsystem that wants a knob set from the kernel command line
+   declares it next to the variable it controls, e.g.
+
+        static unsigned read_ahead_depth = READ_AHEAD_MAX;
+        TUNABLE_UINT ("cache.read_ahead", read_ahead_depth,
+                      0, READ_AHEAD_MAX, "Most sectors queued ahead.");
+
+   and "-o cache.read_ahead=4" then sets it while the command line
+   is parsed, before any subsystem is initialized.  A value that
+   does not parse, or that is out of range, or a name that no
+   subsystem declared, panics the kernel, just like an unknown
+   option.  "-o list" prints every tunable with its type, range,
+   and value once the command line has been parsed, so the values
+   shown are the ones the kernel runs with.
+
+   The declarations are gathered by the linker into one array, so
+   adding a tunable takes no change here or in threads/init.c.  A
+   tunable in code that is not built into this kernel, such as
+   vm/ without VM, simply does not exist. */
+
+/* The tunables, from the linker script. */
+extern const struct tunable _start_tunables[], _end_tunables[];
+
+static const struct tunable *find (const char *name, size_t length);
+static bool parse_value (const struct tunable *, const char *);
+static bool parse_number (const char *, long long *);
+
+/* Sets a tunable according to OPTION, of the form NAME=VALUE.
+   Panics if OPTION is malformed, names no tunable, or gives a
+   value that is invalid for it. */
+void
+tunable_set (const char *option)
+{
+  const char *value;
+  const struct tunable *t;
+
+  if (option == NULL)
+    PANIC ("-o requires NAME=VALUE or `list' (use -h for help)");
+  value = strchr (option, '=');
+  if (value == NULL)
+    PANIC ("-o %s: missing `=VALUE' (use -o list for tunables)", option);
+
+  t = find (option, value - option);
+  if (t == NULL)
+    PANIC ("-o %s: unknown tunable (use -o list for tunables)", option);
+  if (!parse_value (t, value + 1))
+    {
+      if (t->type == TUNABLE_TYPE_BOOL)
+        PANIC ("-o %s: value must be 0 or 1", option);
+      else
+        PANIC ("-o %s: value must be between %lld and %lld",
+               option, t->min, t->max);
+    }
+}
+
+/* Prints every tunable with its current value. */
+void
+tunable_print (void)
+{
+  static const char *type_names[] = {"int", "uint", "bool", "string"};
+  const struct tunable *t;
+
+  printf ("Tunables (set with -o NAME=VALUE):\n");
+  for (t = _start_tunables; t < _end_tunables; t++)
+    {
+      printf ("  %-22s %-6s ", t->name, type_names[t->type]);
+      switch (t->type)
+        {
+        case TUNABLE_TYPE_INT:
+          printf ("%d [%lld..%lld]", *t->var.i, t->min, t->max);
+          break;
+        case TUNABLE_TYPE_UINT:
+          printf ("%u [%lld..%lld]", *t->var.u, t->min, t->max);
+          break;
+        case TUNABLE_TYPE_BOOL:
+          printf ("%d", *t->var.b);
+          break;
+        case TUNABLE_TYPE_STRING:
+          printf ("\"%s\"", *t->var.s != NULL ? *t->var.s : "");
+          break;
+        }
+      printf ("\n    %s\n", t->desc);
+    }
+}
+
+/* Returns the tunable whose name is the LENGTH bytes at NAME, or
+   a null pointer if there is none. */
+static const struct tunable *
+find (const char *name, size_t length)
+{
+  const struct tunable *t;
+
+  for (t = _start_tunables; t < _end_tunables; t++)
+    if (strlen (t->name) == length && !memcmp (t->name, name, length))
+      return t;
+  return NULL;
+}
+
+/* Parses VALUE for tunable T and, if it is valid, stores it in
+   T's variable.  Returns true if successful, false if VALUE is
+   invalid. */
+static bool
+parse_value (const struct tunable *t, const char *value)
+{
+  long long n;
+
+  if (t->type == TUNABLE_TYPE_STRING)
+    {
+      /* The command line stays in memory, so VALUE may be kept. */
+      *t->var.s = value;
+      return true;
+    }
+
+  if (!parse_number (value, &n) || n < t->min || n > t->max)
+    return false;
+  switch (t->type)
+    {
+    case TUNABLE_TYPE_INT:
+      *t->var.i = n;
+      break;
+    case TUNABLE_TYPE_UINT:
+      *t->var.u = n;
+      break;
+    case TUNABLE_TYPE_BOOL:
+      *t->var.b = n;
+      break;
+    default:
+      NOT_REACHED ();
+    }
+  return true;
+}
+
+/* Parses S as an optionally signed decimal integer and stores it
+   in *N.  Returns true if successful, false if S is not a number
+   or is too long to be a sensible one. */
+static bool
+parse_number (const char *s, long long *n)
+{
+  bool negative = *s == '-';
+  int digits = 0;
+
+  if (negative)
+    s++;
+  for (*n = 0; *s >= '0' && *s <= '9'; s++)
+    if (++digits > 18)
+      return false;
+    else
+      *n = *n * 10 + (*s - '0');
+  if (digits == 0 || *s != '\0')
+    return false;
+  if (negative)
+    *n = -*n;
+  return true;
+}
@@ -0,0 +1,59 @@
+#ifndef THREADS_TUNABLE_H
+#define THREADS_TUNABLE_H
+
+#include <stdbool.h>
+
+/* Boot-time tunables.  See tunable.c. */
+
+/* Type of a tunable's variable. */
+enum tunable_type
+  {
+    TUNABLE_TYPE_INT,                   /* int, within a range. */
+    TUNABLE_TYPE_UINT,                  /* unsigned or size_t, within a range. */
+    TUNABLE_TYPE_BOOL,                  /* bool. */
+    TUNABLE_TYPE_STRING                 /* const char *. */
+  };
+
+/* A tunable, as declared by one of the TUNABLE_* macros below. */
+struct tunable
+  {
+    const char *name;                   /* Name for "-o NAME=VALUE". */
+    const char *desc;                   /* One-line description. */
+    enum tunable_type type;             /* Type of the variable. */
+    union
+      {
+        int *i;
+        unsigned *u;
+        bool *b;
+        const char **s;
+      }
+    var;                                /* Variable set by "-o". */
+    long long min, max;                 /* Range, for numeric types. */
+  };
+
+/* Declares variable VAR as tunable NAME, conventionally
+   "file.knob", described by DESC.  Use at file scope, next to
+   VAR's definition.  Numeric values must lie between MIN and MAX,
+   inclusive.  The variable's type must match the macro, which
+   the compiler checks. */
+#define TUNABLE_INT(NAME, VAR, MIN, MAX, DESC) \
+        TUNABLE_ (VAR, NAME, DESC, TUNABLE_TYPE_INT, .i = &(VAR), MIN, MAX)
+#define TUNABLE_UINT(NAME, VAR, MIN, MAX, DESC) \
+        TUNABLE_ (VAR, NAME, DESC, TUNABLE_TYPE_UINT, .u = &(VAR), MIN, MAX)
+#define TUNABLE_BOOL(NAME, VAR, DESC) \
+        TUNABLE_ (VAR, NAME, DESC, TUNABLE_TYPE_BOOL, .b = &(VAR), 0, 1)
+#define TUNABLE_STRING(NAME, VAR, DESC) \
+        TUNABLE_ (VAR, NAME, DESC, TUNABLE_TYPE_STRING, .s = &(VAR), 0, 0)
+
+/* The tunables are gathered into one array by the linker script,
+   threads/kernel.lds.S, between _start_tunables and
+   _end_tunables. */
+#define TUNABLE_(VAR, NAME, DESC, TYPE, INIT, MIN, MAX)                 \
+        static const struct tunable tunable_##VAR                       \
+          __attribute__ ((section (".tunables"), used, aligned (4))) =  \
+          {NAME, DESC, TYPE, {INIT}, MIN, MAX}
+
+void tunable_set (const char *option);
+void tunable_print (void);
+
+#endif /* threads/tunable.h */
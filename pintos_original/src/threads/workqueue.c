@@ -0,0 +1,114 @@
+#include "threads/workqueue.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Kernel worker threads.
+
+   work_schedule() appends a piece of work to a single list,
+   which WORKER_CNT threads serve in order.  Each worker waits
+   exclusively, so that scheduling one piece of work wakes one
+   worker.  There is more than one worker so that work that
+   sleeps for a long time, such as disk I/O, does not hold up
+   the rest. */
+#define WORKER_CNT 2
+
+/* Work waiting for a worker, protected by disabling interrupts,
+   so that interrupt handlers can schedule work. */
+static struct list work_list;
+static struct waitqueue work_waiters;
+
+static thread_func worker NO_RETURN;
+
+/* Starts the worker threads.  Must be called after
+   thread_start(). */
+void
+workqueue_init (void)
+{
+  int i;
+
+  list_init (&work_list);
+  waitqueue_init (&work_waiters);
+  for (i = 0; i < WORKER_CNT; i++)
+    {
+      char name[16];
+
+      snprintf (name, sizeof name, "kworker/%d", i);
+      if (thread_create (name, PRI_DEFAULT, worker, NULL) == TID_ERROR)
+        PANIC ("Failed to start worker thread");
+    }
+}
+
+/* Initializes W to call FUNC (AUX) when it runs. */
+void
+work_init (struct work *w, work_func *func, void *aux)
+{
+  ASSERT (w != NULL);
+  ASSERT (func != NULL);
+
+  w->func = func;
+  w->aux = aux;
+  w->pending = false;
+}
+
+/* Arranges for a worker thread to run W.  Does nothing if W is
+   already waiting to run, though W may be scheduled again once
+   it has started running.  Returns true if W was queued, false
+   if it was already pending.  May be called from an interrupt
+   handler. */
+bool
+work_schedule (struct work *w)
+{
+  enum intr_level old_level = intr_disable ();
+  bool queued = !w->pending;
+
+  if (queued)
+    {
+      w->pending = true;
+      list_push_back (&work_list, &w->elem);
+      waitqueue_wake (&work_waiters, 1);
+    }
+  intr_set_level (old_level);
+  return queued;
+}
+
+/* Takes W off the work list if it has not started running yet.
+   Returns true if W was pending, false otherwise.  Does not wait
+   for W to finish if it is running.  May be called from an
+   interrupt handler. */
+bool
+work_cancel (struct work *w)
+{
+  enum intr_level old_level = intr_disable ();
+  bool pending = w->pending;
+
+  if (pending)
+    {
+      list_remove (&w->elem);
+      w->pending = false;
+    }
+  intr_set_level (old_level);
+  return pending;
+}
+
+/* Worker thread.  Runs work from work_list, one piece at a
+   time. */
+static void
+worker (void *aux UNUSED)
+{
+  for (;;)
+    {
+      struct work *w;
+
+      intr_disable ();
+      while (list_empty (&work_list))
+        waitqueue_wait (&work_waiters, true, WAIT_FOREVER);
+      w = list_entry (list_pop_front (&work_list), struct work, elem);
+      w->pending = false;
+      intr_enable ();
+
+      w->func (w->aux);
+    }
+}
@@ -0,0 +1,24 @@
+#ifndef THREADS_WORKQUEUE_H
+#define THREADS_WORKQUEUE_H
+
+#include <list.h>
+#include <stdbool.h>
+
+/* Work to be done by a kernel worker thread.  Unlike work
+   deferred with intr_defer(), it may sleep, allocate memory, and
+   acquire locks. */
+typedef void work_func (void *aux);
+struct work
+  {
+    struct list_elem elem;      /* Element in the work list. */
+    work_func *func;            /* Function to call. */
+    void *aux;                  /* Auxiliary data for FUNC. */
+    bool pending;               /* In the work list? */
+  };
+
+void workqueue_init (void);
+void work_init (struct work *, work_func *, void *aux);
+bool work_schedule (struct work *);
+bool work_cancel (struct work *);
+
+#endif /* threads/workqueue.h */
@@ -3,11 +3,21 @@
 #include <stdio.h>
 #include "userprog/gdt.h"
 #include "threads/interrupt.h"
+#include "threads/kstack.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
 
+/* Number of page faults on pages that were already mapped as the
+   access required by the time the handler looked. */
+static long long soft_fault_cnt;
+
 static void kill (struct intr_frame *);
 static void page_fault (struct intr_frame *);
 
@@ -45,8 +55,6 @@ exception_init (void)
   intr_register_int (0, 0, INTR_ON, kill, "#DE Divide Error");
   intr_register_int (1, 0, INTR_ON, kill, "#DB Debug Exception");
   intr_register_int (6, 0, INTR_ON, kill, "#UD Invalid Opcode Exception");
-  intr_register_int (7, 0, INTR_ON, kill,
-                     "#NM Device Not Available Exception");
   intr_register_int (11, 0, INTR_ON, kill, "#NP Segment Not Present");
   intr_register_int (12, 0, INTR_ON, kill, "#SS Stack Fault Exception");
   intr_register_int (13, 0, INTR_ON, kill, "#GP General Protection Exception");
@@ -54,17 +62,25 @@ exception_init (void)
   intr_register_int (19, 0, INTR_ON, kill,
                      "#XF SIMD Floating-Point Exception");
 
-  /* Most exceptions can be handled with interrupts turned on.
+  /* #NM belongs to threads/fpu.c, which uses it to switch FPU
+     state lazily.
+
+     Most exceptions can be handled with interrupts turned on.
      We need to disable interrupts for page faults because the
      fault address is stored in CR2 and needs to be preserved. */
   intr_register_int (14, 0, INTR_OFF, page_fault, "#PF Page-Fault Exception");
+
+  /* #DF usually means that the kernel ran out of stack, so it is
+     handled by a task with a stack of its own.  See tss.c. */
+  intr_register_task (8, SEL_DF_TSS, "#DF Double Fault Exception");
 }
 
 /* Prints exception statistics. */
 void
 exception_print_stats (void) 
 {
-  printf ("Exception: %lld page faults\n", page_fault_cnt);
+  printf ("Exception: %lld page faults, %lld soft\n",
+          page_fault_cnt, soft_fault_cnt);
 }
 
 /* Handler for an exception (probably) caused by a user process. */
@@ -148,6 +164,55 @@ page_fault (struct intr_frame *f)
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
 
+  /* Fast path: a "soft" fault is on a page that is already
+     mapped as the access needs by the time we look, for example
+     through a TLB entry that was stale when the access was made
+     (the fault itself flushes it).  Retrying the access is all it
+     takes, with no VM lock and no kernel stack to commit. */
+  if (is_user_vaddr (fault_addr) && thread_current ()->pagedir != NULL)
+    {
+      uint32_t *pd = thread_current ()->pagedir;
+      if (write
+          ? pagedir_is_writable (pd, fault_addr)
+          : pagedir_get_page (pd, fault_addr) != NULL)
+        {
+          soft_fault_cnt++;
+          return;
+        }
+    }
+
+#ifdef VM
+  /* Bring in a page that is not loaded yet, grow the stack, or
+     copy a page shared copy-on-write.
+     A fault in the kernel, while it is accessing user memory for
+     a system call, is matched against the user's stack pointer
+     from the system call's entry.
+     Each may read the file system or swap, so the whole kernel
+     stack is committed first, if it is a large one; if memory is
+     too short for that, the fault is treated as fatal. */
+  if (kstack_reserve (kstack_size))
+    {
+      if (not_present)
+        {
+          void *esp = user ? f->esp : thread_current ()->user_esp;
+          if (page_load (fault_addr, write) || page_grow_stack (fault_addr, esp))
+            return;
+        }
+      else if (write && page_copy_on_write (fault_addr))
+        return;
+    }
+#endif
+
+  /* A fault in the kernel at a user address comes from get_user()
+     or put_user() in syscall.c, which leave the address to resume
+     at in EAX.  Resume there with -1 in EAX to report it. */
+  if (!user && is_user_vaddr (fault_addr))
+    {
+      f->eip = (void (*) (void)) f->eax;
+      f->eax = 0xffffffff;
+      return;
+    }
+
   /* To implement virtual memory, delete the rest of the function
      body, and replace it with code that brings in the page to
      which fault_addr refers. */
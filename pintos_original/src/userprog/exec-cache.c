@@ -0,0 +1,147 @@
+#include "userprog/exec-cache.h"
+#include <stdio.h>
+#include <string.h>
+#include "filesys/inode.h"
+#include "threads/synch.h"
+
+/* Cache of parsed executables.
+
+   Each exec of a program reads and checks its ELF header and
+   program headers before loading anything, although the result
+   is the same every time until the file changes.  load() keeps
+   the result here, keyed by the executable's inode, and the next
+   exec of the same file takes it from here instead.
+
+   Each entry holds its inode open, so that the in-memory inode,
+   whose version inode_write_at() bumps on every write, lives as
+   long as the entry.  An entry whose version no longer matches
+   is out of date and is dropped on lookup.  An entry for a
+   removed file would keep its blocks from being freed, so the
+   remove system call drops those with exec_cache_sweep(). */
+
+#define EXEC_CACHE_CNT 8        /* Number of entries. */
+
+struct exec_cache_entry
+  {
+    struct inode *inode;        /* Executable, or null if unused. */
+    unsigned version;           /* INODE's version when parsed. */
+    unsigned long long used;    /* When last looked up, for LRU. */
+    struct exec_image image;    /* Parsed headers. */
+  };
+
+static struct exec_cache_entry entries[EXEC_CACHE_CNT];
+static struct lock exec_cache_lock;
+static unsigned long long use_clock;    /* Lookups and insertions. */
+
+/* Statistics. */
+static unsigned long long hits, misses, stale;
+
+static void drop (struct exec_cache_entry *);
+
+/* Initializes the executable cache. */
+void
+exec_cache_init (void)
+{
+  lock_init (&exec_cache_lock);
+}
+
+/* Looks up INODE.  If it has an up-to-date entry, copies its
+   parsed image into *IMAGE and returns true; otherwise, returns
+   false. */
+bool
+exec_cache_lookup (struct inode *inode, struct exec_image *image)
+{
+  bool found = false;
+  size_t i;
+
+  lock_acquire (&exec_cache_lock);
+  for (i = 0; i < EXEC_CACHE_CNT; i++)
+    {
+      struct exec_cache_entry *e = &entries[i];
+      if (e->inode != inode)
+        continue;
+
+      if (e->version == inode_get_version (inode))
+        {
+          e->used = ++use_clock;
+          *image = e->image;
+          found = true;
+        }
+      else
+        {
+          drop (e);
+          stale++;
+        }
+      break;
+    }
+  if (found)
+    hits++;
+  else
+    misses++;
+  lock_release (&exec_cache_lock);
+  return found;
+}
+
+/* Adds IMAGE, just parsed from INODE's headers, to the cache,
+   replacing the least recently used entry if it is full. */
+void
+exec_cache_insert (struct inode *inode, const struct exec_image *image)
+{
+  struct exec_cache_entry *victim = &entries[0];
+  size_t i;
+
+  lock_acquire (&exec_cache_lock);
+  for (i = 0; i < EXEC_CACHE_CNT; i++)
+    {
+      struct exec_cache_entry *e = &entries[i];
+      if (e->inode == inode)
+        {
+          /* Parsed again by another exec at the same time. */
+          victim = e;
+          break;
+        }
+      if (e->inode == NULL
+          || (victim->inode != NULL && e->used < victim->used))
+        victim = e;
+    }
+  drop (victim);
+  victim->inode = inode_reopen (inode);
+  victim->version = inode_get_version (inode);
+  victim->used = ++use_clock;
+  victim->image = *image;
+  lock_release (&exec_cache_lock);
+}
+
+/* Drops the entries for removed files, so that their inodes can
+   be freed. */
+void
+exec_cache_sweep (void)
+{
+  size_t i;
+
+  lock_acquire (&exec_cache_lock);
+  for (i = 0; i < EXEC_CACHE_CNT; i++)
+    if (entries[i].inode != NULL && inode_is_removed (entries[i].inode))
+      drop (&entries[i]);
+  lock_release (&exec_cache_lock);
+}
+
+/* Prints executable cache statistics. */
+void
+exec_cache_print_stats (void)
+{
+  if (hits + misses > 0)
+    printf ("Exec cache: %llu hits, %llu misses, %llu out of date\n",
+            hits, misses, stale);
+}
+
+/* Empties E, closing its inode. */
+static void
+drop (struct exec_cache_entry *e)
+{
+  if (e->inode != NULL)
+    {
+      inode_close (e->inode);
+      e->inode = NULL;
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef USERPROG_EXEC_CACHE_H
+#define USERPROG_EXEC_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct inode;
+
+/* Most loadable segments in an executable.  load() rejects an
+   executable with more. */
+#define EXEC_SEGMENT_MAX 8
+
+/* A loadable segment, as load_segment() takes it. */
+struct exec_segment
+  {
+    uint32_t file_page;         /* Page-aligned file offset. */
+    uint32_t mem_page;          /* Page-aligned user address. */
+    uint32_t read_bytes;        /* Bytes to read from the file. */
+    uint32_t zero_bytes;        /* Bytes to zero after them. */
+    bool writable;              /* Writable by the process? */
+  };
+
+/* What load() learns from an executable's headers, once they
+   have been checked. */
+struct exec_image
+  {
+    void (*entry) (void);       /* Entry point. */
+    size_t segment_cnt;         /* Number of segments. */
+    struct exec_segment segments[EXEC_SEGMENT_MAX];
+  };
+
+void exec_cache_init (void);
+bool exec_cache_lookup (struct inode *, struct exec_image *);
+void exec_cache_insert (struct inode *, const struct exec_image *);
+void exec_cache_sweep (void);
+void exec_cache_print_stats (void);
+
+#endif /* userprog/exec-cache.h */
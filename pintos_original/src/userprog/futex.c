@@ -0,0 +1,155 @@
+#include "userprog/futex.h"
+#include <debug.h>
+#include <futex.h>
+#include <hash.h>
+#include <list.h>
+#include <stdint.h>
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Futexes.
+
+   A futex is any aligned int in a process's memory on which
+   threads wait, in futex_wait(), for another to change it and
+   call futex_wake() on it.  A user-space lock built on one, as
+   in lib/user/mutex.c, changes the int with atomic instructions
+   and makes a system call only when it finds the lock contended,
+   so that taking and releasing a free lock never enters the
+   kernel.
+
+   The kernel keeps nothing for an int that no one waits on.
+   Waiters are hashed on their address space and the address
+   into a fixed table of buckets, each a list of waiters under a
+   lock.  futex_wait() checks the int and queues itself while
+   holding the bucket's lock, and futex_wake() takes the same
+   lock, so a wakeup that follows a change to the int can't slip
+   in between a waiter's check and its sleep. */
+
+/* Number of buckets.  Must be a power of 2. */
+#define FUTEX_BUCKET_CNT 64
+
+struct futex_bucket
+  {
+    struct lock lock;           /* Protects the list and its waiters. */
+    struct list waiters;        /* struct futex_waiters. */
+  };
+
+static struct futex_bucket buckets[FUTEX_BUCKET_CNT];
+
+/* A thread waiting on a futex.  Lives on its stack. */
+struct futex_waiter
+  {
+    struct list_elem elem;      /* Element in a bucket's list. */
+    uint32_t *pagedir;          /* Address space... */
+    const int *uaddr;           /* ...and address waited on. */
+    struct semaphore wakeup;    /* Upped by futex_wake(). */
+    bool woken;                 /* Removed by futex_wake()? */
+  };
+
+/* Initializes the futex table. */
+void
+futex_init (void)
+{
+  size_t i;
+
+  for (i = 0; i < FUTEX_BUCKET_CNT; i++)
+    {
+      lock_init (&buckets[i].lock);
+      list_init (&buckets[i].waiters);
+    }
+}
+
+/* Returns the bucket for UADDR in the current process. */
+static struct futex_bucket *
+bucket_for (const int *uaddr)
+{
+  uintptr_t key = (uintptr_t) thread_current ()->pagedir ^ (uintptr_t) uaddr;
+
+  return &buckets[hash_int (key) & (FUTEX_BUCKET_CNT - 1)];
+}
+
+/* If the int at UADDR in the current process holds VAL, waits
+   until futex_wake() is called on it or, unless TIMEOUT is
+   WAIT_FOREVER, until TIMEOUT ticks have passed.  Returns
+   FUTEX_WOKEN, FUTEX_TIMEOUT, or FUTEX_CHANGED if the int did not
+   hold VAL.  As with any wait, the caller should recheck the int
+   on return.
+
+   UADDR must be aligned and mapped in the current process, and
+   with VM its page must be pinned, since it is read while a lock
+   is held. */
+int
+futex_wait (const int *uaddr, int val, int64_t timeout)
+{
+  struct futex_bucket *b = bucket_for (uaddr);
+  struct futex_waiter w;
+  int result;
+
+  ASSERT ((uintptr_t) uaddr % sizeof *uaddr == 0);
+
+  lock_acquire (&b->lock);
+  if (*(const volatile int *) uaddr != val)
+    {
+      lock_release (&b->lock);
+      return FUTEX_CHANGED;
+    }
+  if (timeout == 0)
+    {
+      lock_release (&b->lock);
+      return FUTEX_TIMEOUT;
+    }
+  w.pagedir = thread_current ()->pagedir;
+  w.uaddr = uaddr;
+  sema_init (&w.wakeup, 0);
+  w.woken = false;
+  list_push_back (&b->waiters, &w.elem);
+  lock_release (&b->lock);
+
+  if (timeout == WAIT_FOREVER)
+    sema_down (&w.wakeup);
+  else
+    sema_down_timeout (&w.wakeup, timeout);
+
+  /* A wakeup may race with the timeout, so W's fate is decided
+     under the lock. */
+  lock_acquire (&b->lock);
+  if (w.woken)
+    result = FUTEX_WOKEN;
+  else
+    {
+      list_remove (&w.elem);
+      result = FUTEX_TIMEOUT;
+    }
+  lock_release (&b->lock);
+  return result;
+}
+
+/* Wakes up to CNT of the current process's threads waiting on
+   the int at UADDR, in the order they began waiting.  Returns the
+   number woken. */
+int
+futex_wake (const int *uaddr, int cnt)
+{
+  struct futex_bucket *b = bucket_for (uaddr);
+  uint32_t *pd = thread_current ()->pagedir;
+  struct list_elem *e, *next;
+  int woken = 0;
+
+  lock_acquire (&b->lock);
+  for (e = list_begin (&b->waiters);
+       e != list_end (&b->waiters) && woken < cnt; e = next)
+    {
+      struct futex_waiter *w = list_entry (e, struct futex_waiter, elem);
+
+      next = list_next (e);
+      if (w->pagedir == pd && w->uaddr == uaddr)
+        {
+          list_remove (&w->elem);
+          w->woken = true;
+          sema_up (&w->wakeup);
+          woken++;
+        }
+    }
+  lock_release (&b->lock);
+  return woken;
+}
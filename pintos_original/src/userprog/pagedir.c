@@ -6,8 +6,17 @@
 #include "threads/pte.h"
 #include "threads/palloc.h"
 
+/* A range of at most this many pages is flushed from the TLB one
+   page at a time with `invlpg'; a larger one reloads CR3. */
+#define INVLPG_MAX 32
+
+/* Pages freed per call to palloc_free_batch() by
+   pagedir_destroy(). */
+#define FREE_BATCH 64
+
 static uint32_t *active_pd (void);
 static void invalidate_pagedir (uint32_t *);
+static void invalidate_page (uint32_t *, const void *vaddr);
 
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
@@ -23,10 +32,13 @@ pagedir_create (void)
 }
 
 /* Destroys page directory PD, freeing all the pages it
-   references. */
+   references.  The pages are freed FREE_BATCH at a time, with
+   palloc_free_batch(). */
 void
 pagedir_destroy (uint32_t *pd) 
 {
+  void *batch[FREE_BATCH];
+  size_t batch_cnt = 0;
   uint32_t *pde;
 
   if (pd == NULL)
@@ -41,9 +53,22 @@ pagedir_destroy (uint32_t *pd)
         
         for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++)
           if (*pte & PTE_P) 
-            palloc_free_page (pte_get_page (*pte));
-        palloc_free_page (pt);
+            {
+              batch[batch_cnt++] = pte_get_page (*pte);
+              if (batch_cnt == FREE_BATCH)
+                {
+                  palloc_free_batch (batch, batch_cnt);
+                  batch_cnt = 0;
+                }
+            }
+        batch[batch_cnt++] = pt;
+        if (batch_cnt == FREE_BATCH)
+          {
+            palloc_free_batch (batch, batch_cnt);
+            batch_cnt = 0;
+          }
       }
+  palloc_free_batch (batch, batch_cnt);
   palloc_free_page (pd);
 }
 
@@ -52,7 +77,10 @@ pagedir_destroy (uint32_t *pd)
    If PD does not have a page table for VADDR, behavior depends
    on CREATE.  If CREATE is true, then a new page table is
    created and a pointer into it is returned.  Otherwise, a null
-   pointer is returned. */
+   pointer is returned.
+   If VADDR is mapped by a 4 MB page directory entry, returns the
+   address of that entry, whose present, writable, accessed and
+   dirty bits are in the same places as a PTE's. */
 static uint32_t *
 lookup_page (uint32_t *pd, const void *vaddr, bool create)
 {
@@ -66,6 +94,11 @@ lookup_page (uint32_t *pd, const void *vaddr, bool create)
   /* Check for a page table for VADDR.
      If one is missing, create one if requested. */
   pde = pd + pd_no (vaddr);
+  if (pde_is_large (*pde))
+    {
+      ASSERT (!create);
+      return pde;
+    }
   if (*pde == 0) 
     {
       if (create)
@@ -130,10 +163,12 @@ pagedir_get_page (uint32_t *pd, const void *uaddr)
   ASSERT (is_user_vaddr (uaddr));
   
   pte = lookup_page (pd, uaddr, false);
-  if (pte != NULL && (*pte & PTE_P) != 0)
-    return pte_get_page (*pte) + pg_ofs (uaddr);
-  else
+  if (pte == NULL || (*pte & PTE_P) == 0)
     return NULL;
+  else if (pte == pd + pd_no (uaddr))
+    return pde_get_large_page (*pte, uaddr);
+  else
+    return pte_get_page (*pte) + pg_ofs (uaddr);
 }
 
 /* Marks user virtual page UPAGE "not present" in page
@@ -149,11 +184,57 @@ pagedir_clear_page (uint32_t *pd, void *upage)
   ASSERT (is_user_vaddr (upage));
 
   pte = lookup_page (pd, upage, false);
+  ASSERT (pte == NULL || !pde_is_large (pd[pd_no (upage)]));
   if (pte != NULL && (*pte & PTE_P) != 0)
     {
       *pte &= ~PTE_P;
-      invalidate_pagedir (pd);
+      invalidate_page (pd, upage);
+    }
+}
+
+/* Marks the PAGE_CNT user virtual pages starting at UPAGE "not
+   present" in page directory PD, like pagedir_clear_page(), but
+   with a single TLB flush for the whole range. */
+void
+pagedir_clear_range (uint32_t *pd, void *upage, size_t page_cnt)
+{
+  uint8_t *page = upage;
+  uint8_t *flush[INVLPG_MAX];   /* First pages cleared. */
+  size_t cleared = 0;
+  size_t i;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (is_user_vaddr (upage));
+  ASSERT (page_cnt <= (size_t) ((uint8_t *) PHYS_BASE - page) / PGSIZE);
+
+  for (i = 0; i < page_cnt; i++)
+    {
+      uint32_t *pte = lookup_page (pd, page + i * PGSIZE, false);
+      if (pte != NULL && (*pte & PTE_P) != 0)
+        {
+          *pte &= ~PTE_P;
+          if (cleared < INVLPG_MAX)
+            flush[cleared] = page + i * PGSIZE;
+          cleared++;
+        }
     }
+
+  /* Flush only the pages that were present, if there are few
+     enough of them, otherwise the whole TLB. */
+  if (cleared > INVLPG_MAX)
+    invalidate_pagedir (pd);
+  else
+    for (i = 0; i < cleared; i++)
+      invalidate_page (pd, flush[i]);
+}
+
+/* Returns true if virtual page VPAGE is present and writable in
+   PD. */
+bool
+pagedir_is_writable (uint32_t *pd, const void *vpage) 
+{
+  uint32_t *pte = lookup_page (pd, vpage, false);
+  return pte != NULL && (*pte & (PTE_P | PTE_W)) == (PTE_P | PTE_W);
 }
 
 /* Returns true if the PTE for virtual page VPAGE in PD is dirty,
@@ -180,7 +261,7 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
       else 
         {
           *pte &= ~(uint32_t) PTE_D;
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
@@ -209,7 +290,7 @@ pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
       else 
         {
           *pte &= ~(uint32_t) PTE_A; 
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
@@ -261,3 +342,14 @@ invalidate_pagedir (uint32_t *pd)
       pagedir_activate (pd);
     } 
 }
+
+/* Flushes the TLB entry for VADDR if PD is the active page
+   directory, which unlike reloading CR3 leaves every other entry
+   in place.  `invlpg' also flushes global entries, so this works
+   for kernel addresses too.  See [IA32-v2a] "INVLPG". */
+static void
+invalidate_page (uint32_t *pd, const void *vaddr)
+{
+  if (active_pd () == pd)
+    asm volatile ("invlpg (%0)" : : "r" (vaddr) : "memory");
+}
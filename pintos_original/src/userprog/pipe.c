@@ -0,0 +1,316 @@
+#include "userprog/pipe.h"
+#include <debug.h>
+#include <stdint.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/tunable.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+
+/* Pipes.
+
+   A pipe's data is kept in a ring of whole pages.  The writer
+   fills the page at the tail of the ring and starts a new one
+   when it is full; the reader drains the page at the head and
+   gives it back once it is empty.  Every page in the ring is
+   full except perhaps the last, so the bytes in the pipe are the
+   ring's pages end to end, less what has already been read from
+   the first one.
+
+   Waking the other side is batched.  A writer wakes readers
+   only when it fills a page and when its write ends, not for
+   every byte or chunk it adds, and a reader wakes writers only
+   when it frees a page, that is, when a writer blocked on a full
+   ring can actually make progress.  A reader that wakes takes as
+   much as is there, up to the size of its buffer.
+
+   Without VM, a read of a whole, page-aligned page of the
+   reader's buffer from a full page at the head of the ring
+   doesn't copy at all: the ring's page is mapped into the
+   reader's address space in place of the buffer's page, and the
+   buffer's old page goes into the ring, or is freed.  That is
+   why ring pages come from the user pool.  With VM, a user page
+   belongs to the supplemental page table and its frame to the
+   frame table, so pipes there always copy.  The writer always
+   copies once, into the ring: handing over its page would need
+   it to stop writing that page, which without copy-on-write
+   there is no way to enforce. */
+
+/* Pages in each pipe's ring.  Set by "-o pipe.pages=N". */
+static unsigned pipe_pages = 16;
+TUNABLE_UINT ("pipe.pages", pipe_pages, 1, 256,
+              "Pages of buffer in each pipe.");
+
+struct pipe
+  {
+    struct lock lock;           /* Protects everything below. */
+    struct condition readable;  /* Data arrived or the last writer
+                                   left. */
+    struct condition writable;  /* A page was freed or the last
+                                   reader left. */
+    int readers;                /* Open read ends. */
+    int writers;                /* Open write ends. */
+    void *spare;                /* A free page, or null. */
+    size_t head;                /* Slot of the first page. */
+    size_t used;                /* Pages in the ring. */
+    size_t head_ofs;            /* Bytes already read from the first
+                                   page. */
+    size_t tail_len;            /* Bytes written to the last page. */
+    size_t page_cnt;            /* Slots in pages[]. */
+    void *pages[];              /* Ring of pages. */
+  };
+
+static size_t pipe_bytes (const struct pipe *);
+static void *get_page (struct pipe *);
+static void put_page (struct pipe *, void *);
+#ifndef VM
+static bool swap_user_page (void *upage, void **kpage);
+#endif
+
+/* Creates and returns a new, empty pipe, with one read end and
+   one write end open, or a null pointer if memory allocation
+   fails. */
+struct pipe *
+pipe_create (void)
+{
+  struct pipe *p;
+
+  p = malloc (sizeof *p + pipe_pages * sizeof *p->pages);
+  if (p == NULL)
+    return NULL;
+  lock_init (&p->lock);
+  cond_init (&p->readable);
+  cond_init (&p->writable);
+  p->readers = p->writers = 1;
+  p->spare = NULL;
+  p->head = p->used = 0;
+  p->head_ofs = p->tail_len = 0;
+  p->page_cnt = pipe_pages;
+  return p;
+}
+
+/* Opens another read end of P, or a write end if WRITE is
+   true. */
+void
+pipe_open (struct pipe *p, bool write)
+{
+  lock_acquire (&p->lock);
+  if (write)
+    p->writers++;
+  else
+    p->readers++;
+  lock_release (&p->lock);
+}
+
+/* Closes a read end of P, or a write end if WRITE is true.
+   Closing the last write end lets readers see end of file, and
+   closing the last read end makes writes fail.  Once both kinds
+   are gone, frees P. */
+void
+pipe_close (struct pipe *p, bool write)
+{
+  bool dead;
+
+  lock_acquire (&p->lock);
+  if (write)
+    {
+      ASSERT (p->writers > 0);
+      if (--p->writers == 0)
+        cond_broadcast (&p->readable, &p->lock);
+    }
+  else
+    {
+      ASSERT (p->readers > 0);
+      if (--p->readers == 0)
+        cond_broadcast (&p->writable, &p->lock);
+    }
+  dead = p->readers == 0 && p->writers == 0;
+  lock_release (&p->lock);
+
+  if (dead)
+    {
+      for (; p->used > 0; p->used--)
+        {
+          palloc_free_page (p->pages[p->head]);
+          p->head = (p->head + 1) % p->page_cnt;
+        }
+      palloc_free_page (p->spare);
+      free (p);
+    }
+}
+
+/* Reads up to SIZE bytes from P into BUFFER.  If P is empty and
+   BLOCK is true, first waits until it is not, or until its last
+   write end is closed.  Returns the number of bytes read, which
+   is 0 if P is empty and either BLOCK is false or there are no
+   writers left.  BUFFER may be a user address that is mapped
+   writable, in which case whole pages of it may be replaced by
+   remapping, as described at the top of the file. */
+int
+pipe_read (struct pipe *p, void *buffer, size_t size, bool block)
+{
+  uint8_t *buf = buffer;
+  size_t bytes_read = 0;
+  bool freed = false;
+
+  lock_acquire (&p->lock);
+  while (block && pipe_bytes (p) == 0 && p->writers > 0)
+    cond_wait (&p->readable, &p->lock);
+  while (bytes_read < size && p->used > 0)
+    {
+      void **slot = &p->pages[p->head];
+      size_t len = p->used > 1 ? PGSIZE : p->tail_len;
+      size_t chunk = len - p->head_ofs;
+
+      if (chunk > size - bytes_read)
+        chunk = size - bytes_read;
+      if (chunk == 0)
+        break;
+#ifndef VM
+      if (chunk == PGSIZE && pg_ofs (buf) == 0 && is_user_vaddr (buf)
+          && swap_user_page (buf, slot))
+        ;
+      else
+#endif
+        memcpy (buf, (uint8_t *) *slot + p->head_ofs, chunk);
+      buf += chunk;
+      bytes_read += chunk;
+      p->head_ofs += chunk;
+
+      if (p->head_ofs == PGSIZE)
+        {
+          /* The first page is drained. */
+          put_page (p, *slot);
+          p->head = (p->head + 1) % p->page_cnt;
+          p->head_ofs = 0;
+          if (--p->used == 0)
+            p->tail_len = 0;
+          freed = true;
+        }
+      else if (p->used == 1 && p->head_ofs == p->tail_len)
+        {
+          /* Caught up with the writer in the last page, so that
+             it can start over at the beginning of the page. */
+          p->head_ofs = p->tail_len = 0;
+        }
+    }
+  if (freed)
+    cond_broadcast (&p->writable, &p->lock);
+  lock_release (&p->lock);
+
+  return bytes_read;
+}
+
+/* Writes SIZE bytes from BUFFER into P, waiting whenever P is
+   full for a reader to make room.  Returns the number of bytes
+   written, which is less than SIZE only if the last read end is
+   closed or memory runs out partway through, or -1 if nothing
+   could be written for either reason. */
+int
+pipe_write (struct pipe *p, const void *buffer, size_t size)
+{
+  const uint8_t *buf = buffer;
+  size_t bytes_written = 0;
+
+  lock_acquire (&p->lock);
+  while (bytes_written < size && p->readers > 0)
+    {
+      size_t chunk;
+
+      if (p->used == 0 || p->tail_len == PGSIZE)
+        {
+          /* Start a new page, if there is room for one. */
+          void *page;
+
+          if (p->used == p->page_cnt)
+            {
+              cond_wait (&p->writable, &p->lock);
+              continue;
+            }
+          page = get_page (p);
+          if (page == NULL)
+            break;
+          p->pages[(p->head + p->used++) % p->page_cnt] = page;
+          p->tail_len = 0;
+        }
+
+      chunk = PGSIZE - p->tail_len;
+      if (chunk > size - bytes_written)
+        chunk = size - bytes_written;
+      memcpy ((uint8_t *) p->pages[(p->head + p->used - 1) % p->page_cnt]
+              + p->tail_len, buf, chunk);
+      buf += chunk;
+      bytes_written += chunk;
+      p->tail_len += chunk;
+
+      if (p->tail_len == PGSIZE && bytes_written < size)
+        cond_broadcast (&p->readable, &p->lock);
+    }
+  if (bytes_written > 0)
+    cond_broadcast (&p->readable, &p->lock);
+  lock_release (&p->lock);
+
+  return bytes_written > 0 || size == 0 ? (int) bytes_written : -1;
+}
+
+/* Returns the number of bytes in P that have not been read. */
+static size_t
+pipe_bytes (const struct pipe *p)
+{
+  return p->used > 0 ? (p->used - 1) * PGSIZE + p->tail_len - p->head_ofs : 0;
+}
+
+/* Returns a page for P's ring, or a null pointer if memory is
+   exhausted. */
+static void *
+get_page (struct pipe *p)
+{
+  void *page = p->spare;
+
+  if (page != NULL)
+    p->spare = NULL;
+  else
+    page = palloc_get_page (PAL_USER);
+  return page;
+}
+
+/* Gives PAGE, which is no longer in P's ring, back to P, keeping
+   it as the spare if P has none. */
+static void
+put_page (struct pipe *p, void *page)
+{
+  if (p->spare == NULL)
+    p->spare = page;
+  else
+    palloc_free_page (page);
+}
+
+#ifndef VM
+/* Maps *KPAGE at UPAGE in the current process in place of the
+   page there, which must be mapped writable, and stores that
+   page in *KPAGE.  Returns true if successful, false without
+   changing anything if UPAGE is not mapped writable. */
+static bool
+swap_user_page (void *upage, void **kpage)
+{
+  uint32_t *pd = thread_current ()->pagedir;
+  void *old;
+
+  if (pd == NULL)
+    return false;
+  old = pagedir_get_page (pd, upage);
+  if (old == NULL || !pagedir_is_writable (pd, upage))
+    return false;
+  pagedir_clear_page (pd, upage);
+  if (!pagedir_set_page (pd, upage, *kpage, true))
+    {
+      pagedir_set_page (pd, upage, old, true);
+      return false;
+    }
+  *kpage = old;
+  return true;
+}
+#endif
@@ -0,0 +1,16 @@
+#ifndef USERPROG_PIPE_H
+#define USERPROG_PIPE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* A pipe.  See pipe.c. */
+struct pipe;
+
+struct pipe *pipe_create (void);
+void pipe_open (struct pipe *, bool write);
+void pipe_close (struct pipe *, bool write);
+int pipe_read (struct pipe *, void *, size_t, bool block);
+int pipe_write (struct pipe *, const void *, size_t);
+
+#endif /* userprog/pipe.h */
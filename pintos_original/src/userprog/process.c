@@ -1,68 +1,224 @@
 #include "userprog/process.h"
 #include <debug.h>
+#include <hash.h>
 #include <inttypes.h>
 #include <round.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "userprog/exec-cache.h"
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
+#include "userprog/pipe.h"
+#include "userprog/syscall.h"
 #include "userprog/tss.h"
+#include "userprog/vdso.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "threads/flags.h"
+#include "threads/fpu.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#ifdef VM
+#include "vm/mmap.h"
+#include "vm/page.h"
+#endif
+
+/* Most arguments on a command line. */
+#define ARGS_MAX 128
+
+/* A command line, split into arguments by process_execute() and
+   passed to start_process(), in a page of its own.  The arguments
+   are packed one after another, each with its null terminator,
+   in the same form setup_stack() gives them to the new process,
+   so that it can copy them in one piece without parsing again. */
+struct exec_args
+  {
+    struct exit_record *record; /* The new process's exit record. */
+    struct pipe *stdio[2];      /* Its console pipes, already opened
+                                   for it, or nulls. */
+    int argc;                   /* Number of arguments. */
+    size_t size;                /* Bytes used in strings[]. */
+    uint16_t ofs[ARGS_MAX];     /* Offset of each argument in strings[]. */
+    char strings[];             /* Arguments. */
+  };
+
+/* A child process's exit status, shared between the child and
+   its parent.  The parent finds it by tid in exit_records for
+   process_wait(), or takes the first of its exited children for
+   process_wait_any(), and frees it once it has the status.  A
+   child whose parent has exited frees its own.  Allocated with
+   malloc(), whose arenas already pack these small fixed-size
+   blocks a page at a time, slab fashion. */
+struct exit_record
+  {
+    tid_t tid;                  /* Child's thread id. */
+    int status;                 /* Exit status, once exited. */
+    struct thread *parent;      /* Parent, or null once it exits. */
+    struct hash_elem hash_elem; /* Element in exit_records. */
+    struct list_elem elem;      /* Element in the parent's
+                                   running_children or
+                                   exited_children. */
+    struct semaphore loaded;    /* Upped once the child has loaded. */
+    bool load_ok;               /* Did it load successfully? */
+    struct semaphore dead;      /* Upped when the child exits. */
+  };
+
+/* Exit records that the parent has not waited for yet, by tid.
+   records_lock protects this table, every exit record, and every
+   thread's lists of them. */
+static struct hash exit_records;
+static struct lock records_lock;
+
+static hash_hash_func record_hash;
+static hash_less_func record_less;
+static struct exit_record *new_record (void);
+static tid_t publish_record (struct exit_record *, tid_t);
+static void release_records (void);
 
 static thread_func start_process NO_RETURN;
-static bool load (const char *cmdline, void (**eip) (void), void **esp);
+#ifdef VM
+static thread_func start_fork NO_RETURN;
+#endif
+static bool load (const struct exec_args *, void (**eip) (void),
+                  void **esp);
+
+/* Initializes process bookkeeping. */
+void
+process_init (void)
+{
+  lock_init (&records_lock);
+  if (!hash_init (&exit_records, record_hash, record_less, NULL))
+    PANIC ("out of memory for exit records");
+}
 
-/* Starts a new thread running a user program loaded from
-   FILENAME.  The new thread may be scheduled (and may even exit)
-   before process_execute() returns.  Returns the new process's
-   thread id, or TID_ERROR if the thread cannot be created. */
+/* Starts a new thread running a user program loaded from the
+   first word of CMD_LINE, with the words as its arguments.  The
+   new process's console input and output go to wherever the
+   current process's do.  The new thread may be scheduled (and
+   may even exit) before process_execute() returns, but it does
+   not return until the program has loaded.  Returns the new
+   process's thread id, or TID_ERROR if the thread cannot be
+   created or the program cannot be loaded. */
 tid_t
-process_execute (const char *file_name) 
+process_execute (const char *cmd_line) 
 {
-  char *fn_copy;
+  struct thread *t = thread_current ();
+
+  return process_execute_redirect (cmd_line, t->stdio[STDIN_FILENO],
+                                   t->stdio[STDOUT_FILENO]);
+}
+
+/* Like process_execute(), but the new process reads its console
+   input from the read end of pipe IN and writes its console
+   output to the write end of pipe OUT, or uses the console itself
+   for either one that is a null pointer. */
+tid_t
+process_execute_redirect (const char *cmd_line, struct pipe *in,
+                          struct pipe *out)
+{
+  struct exec_args *args;
+  struct exit_record *record;
+  char *token, *save_ptr;
+  size_t room;
   tid_t tid;
 
-  /* Make a copy of FILE_NAME.
+  /* Make a copy of CMD_LINE.
      Otherwise there's a race between the caller and load(). */
-  fn_copy = palloc_get_page (0);
-  if (fn_copy == NULL)
+  args = palloc_get_page (0);
+  if (args == NULL)
     return TID_ERROR;
-  strlcpy (fn_copy, file_name, PGSIZE);
+  room = PGSIZE - offsetof (struct exec_args, strings);
+  strlcpy (args->strings, cmd_line, room);
+
+  /* Split it into words in place, packing each one down against
+     the one before. */
+  args->argc = 0;
+  args->size = 0;
+  for (token = strtok_r (args->strings, " ", &save_ptr); token != NULL;
+       token = strtok_r (NULL, " ", &save_ptr))
+    {
+      size_t length = strlen (token) + 1;
+
+      if (args->argc >= ARGS_MAX)
+        goto error;
+      args->ofs[args->argc++] = args->size;
+      memmove (args->strings + args->size, token, length);
+      args->size += length;
+    }
+  if (args->argc == 0)
+    goto error;
 
-  /* Create a new thread to execute FILE_NAME. */
-  tid = thread_create (file_name, PRI_DEFAULT, start_process, fn_copy);
+  /* Create a new thread to execute the program, named after it,
+     and wait for it to load. */
+  args->record = new_record ();
+  if (args->record == NULL)
+    goto error;
+  record = args->record;
+  args->stdio[STDIN_FILENO] = in;
+  args->stdio[STDOUT_FILENO] = out;
+  if (in != NULL)
+    pipe_open (in, false);
+  if (out != NULL)
+    pipe_open (out, true);
+  tid = thread_create (args->strings, PRI_DEFAULT, start_process, args);
   if (tid == TID_ERROR)
-    palloc_free_page (fn_copy); 
+    {
+      if (in != NULL)
+        pipe_close (in, false);
+      if (out != NULL)
+        pipe_close (out, true);
+      palloc_free_page (args); 
+    }
+  tid = publish_record (record, tid);
+  if (tid != TID_ERROR)
+    {
+      sema_down (&record->loaded);
+      if (!record->load_ok)
+        {
+          process_wait (tid);
+          tid = TID_ERROR;
+        }
+    }
   return tid;
+
+ error:
+  palloc_free_page (args);
+  return TID_ERROR;
 }
 
 /* A thread function that loads a user process and starts it
    running. */
 static void
-start_process (void *file_name_)
+start_process (void *args_)
 {
-  char *file_name = file_name_;
+  struct exec_args *args = args_;
+  struct exit_record *record = args->record;
+  struct thread *t = thread_current ();
   struct intr_frame if_;
   bool success;
 
+  t->exit_record = record;
+  t->stdio[STDIN_FILENO] = args->stdio[STDIN_FILENO];
+  t->stdio[STDOUT_FILENO] = args->stdio[STDOUT_FILENO];
+
   /* Initialize interrupt frame and load executable. */
   memset (&if_, 0, sizeof if_);
   if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
   if_.cs = SEL_UCSEG;
   if_.eflags = FLAG_IF | FLAG_MBS;
-  success = load (file_name, &if_.eip, &if_.esp);
+  success = load (args, &if_.eip, &if_.esp);
 
-  /* If load failed, quit. */
-  palloc_free_page (file_name);
+  /* Tell the parent how it went.  If load failed, quit. */
+  palloc_free_page (args);
+  record->load_ok = success;
+  sema_up (&record->loaded);
   if (!success) 
     thread_exit ();
 
@@ -76,6 +232,106 @@ start_process (void *file_name_)
   NOT_REACHED ();
 }
 
+#ifdef VM
+/* Passed from process_fork() to the child it creates. */
+struct fork_info
+  {
+    struct thread *parent;      /* Forking process. */
+    struct exit_record *record; /* Child's exit record. */
+    struct intr_frame if_;      /* Where the child returns to. */
+    struct semaphore done;      /* Upped once the child is set up. */
+    bool success;               /* Was it set up successfully? */
+  };
+#endif
+
+/* Starts a child of the current process running the same
+   program, in a copy of its address space.  The child returns to
+   user mode at the same point as the parent will from its
+   interrupt frame IF_, but with 0 as the system call's return
+   value.  The child has the parent's open files, pipe ends, and
+   console pipes, under the same handles.  Returns the new
+   process's thread id, or TID_ERROR if it cannot be created.
+
+   Nothing in memory is copied up front: the child shares the
+   parent's frames, and a page is copied only when either process
+   first writes it.  This needs the supplemental page table, so
+   without VM this always fails. */
+tid_t
+process_fork (const struct intr_frame *if_ UNUSED)
+{
+#ifdef VM
+  struct fork_info info;
+  tid_t tid;
+
+  info.parent = thread_current ();
+  if (info.parent->pages == NULL)
+    return TID_ERROR;
+  info.if_ = *if_;
+  sema_init (&info.done, 0);
+  info.success = false;
+  info.record = new_record ();
+  if (info.record == NULL)
+    return TID_ERROR;
+
+  tid = thread_create (thread_name (), thread_get_priority (),
+                       start_fork, &info);
+  tid = publish_record (info.record, tid);
+  if (tid == TID_ERROR)
+    return TID_ERROR;
+  sema_down (&info.done);
+  if (!info.success)
+    {
+      process_wait (tid);
+      return TID_ERROR;
+    }
+  return tid;
+#else
+  return TID_ERROR;
+#endif
+}
+
+#ifdef VM
+/* A thread function that sets up a child process for
+   process_fork() and starts it running. */
+static void
+start_fork (void *info_)
+{
+  struct fork_info *info = info_;
+  struct thread *t = thread_current ();
+  struct intr_frame if_ = info->if_;
+  bool success = false;
+
+  t->exit_record = info->record;
+  t->pagedir = pagedir_create ();
+  if (t->pagedir != NULL)
+    {
+      process_activate ();
+      list_init (&t->mappings);
+      t->next_mapid = 0;
+      t->pages = page_table_create ();
+      t->exec_file = file_reopen (info->parent->exec_file);
+      t->heap_start = info->parent->heap_start;
+      t->heap_break = info->parent->heap_break;
+      success = (t->pages != NULL && t->exec_file != NULL
+                 && vdso_map ()
+                 && page_table_copy (info->parent)
+                 && fpu_copy (info->parent)
+                 && syscall_fork (info->parent));
+    }
+
+  /* INFO is gone once the parent wakes up. */
+  info->success = success;
+  sema_up (&info->done);
+  if (!success)
+    thread_exit ();
+
+  /* Return to user mode as the parent, as in start_process(). */
+  if_.eax = 0;
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+#endif
+
 /* Waits for thread TID to die and returns its exit status.  If
    it was terminated by the kernel (i.e. killed due to an
    exception), returns -1.  If TID is invalid or if it was not a
@@ -83,12 +339,81 @@ start_process (void *file_name_)
    been successfully called for the given TID, returns -1
    immediately, without waiting.
 
-   This function will be implemented in problem 2-2.  For now, it
-   does nothing. */
+   The child's exit record is removed from the table of records
+   first, which is what makes a second wait for it fail, then
+   waited on until the child has died and filled in its status,
+   and finally freed. */
 int
-process_wait (tid_t child_tid UNUSED) 
+process_wait (tid_t child_tid) 
 {
-  return -1;
+  struct thread *cur = thread_current ();
+  struct exit_record key, *r;
+  struct hash_elem *e;
+  int status;
+
+  /* Claim the record, so that no one else waits for it. */
+  key.tid = child_tid;
+  lock_acquire (&records_lock);
+  e = hash_find (&exit_records, &key.hash_elem);
+  r = e != NULL ? hash_entry (e, struct exit_record, hash_elem) : NULL;
+  if (r == NULL || r->parent != cur)
+    {
+      lock_release (&records_lock);
+      return -1;
+    }
+  hash_delete (&exit_records, &r->hash_elem);
+  lock_release (&records_lock);
+
+  /* Once the child is dead, it does not touch R again. */
+  sema_down (&r->dead);
+  lock_acquire (&records_lock);
+  list_remove (&r->elem);
+  lock_release (&records_lock);
+
+  status = r->status;
+  free (r);
+  return status;
+}
+
+/* Waits for any child process of the current thread to die, if
+   none already has, and reaps it.  Stores its exit status in
+   *STATUS and returns its thread id.  Returns TID_ERROR
+   immediately if the current thread has no children left to wait
+   for. */
+tid_t
+process_wait_any (int *status)
+{
+  struct thread *cur = thread_current ();
+  struct exit_record *r;
+  tid_t tid;
+
+  lock_acquire (&records_lock);
+  while (list_empty (&cur->exited_children))
+    {
+      struct semaphore reaped;
+
+      if (list_empty (&cur->running_children))
+        {
+          lock_release (&records_lock);
+          return TID_ERROR;
+        }
+
+      /* The next child to exit ups REAPED. */
+      sema_init (&reaped, 0);
+      cur->reaper = &reaped;
+      lock_release (&records_lock);
+      sema_down (&reaped);
+      lock_acquire (&records_lock);
+    }
+  r = list_entry (list_pop_front (&cur->exited_children),
+                  struct exit_record, elem);
+  hash_delete (&exit_records, &r->hash_elem);
+  lock_release (&records_lock);
+
+  *status = r->status;
+  tid = r->tid;
+  free (r);
+  return tid;
 }
 
 /* Free the current process's resources. */
@@ -98,6 +423,26 @@ process_exit (void)
   struct thread *cur = thread_current ();
   uint32_t *pd;
 
+  if (cur->pagedir != NULL)
+    {
+      printf ("%s: exit(%d)\n", cur->name, cur->exit_status);
+#ifdef VM
+      page_print_faults ();
+#endif
+    }
+  syscall_exit ();
+
+#ifdef VM
+  /* Write back mapped files and free the process's frames and
+     swap slots while its page directory still exists.  The
+     executable stayed open for demand paging. */
+  mmap_unmap_all ();
+  page_table_destroy (cur->pages);
+  cur->pages = NULL;
+  file_close (cur->exec_file);
+  cur->exec_file = NULL;
+#endif
+
   /* Destroy the current process's page directory and switch back
      to the kernel-only page directory. */
   pd = cur->pagedir;
@@ -110,10 +455,129 @@ process_exit (void)
          directory before destroying the process's page
          directory, or our active page directory will be one
          that's been freed (and cleared). */
+      vdso_unmap ();
       cur->pagedir = NULL;
       pagedir_activate (NULL);
       pagedir_destroy (pd);
     }
+
+  /* Only now, with everything freed, let the parent know. */
+  release_records ();
+}
+
+/* Reports the current thread's exit status to its parent, if
+   any, and lets go of its children's exit records. */
+static void
+release_records (void)
+{
+  struct thread *cur = thread_current ();
+  struct exit_record *r = cur->exit_record;
+
+  lock_acquire (&records_lock);
+  if (r != NULL)
+    {
+      struct thread *parent = r->parent;
+
+      r->status = cur->exit_status;
+      if (parent == NULL)
+        free (r);
+      else
+        {
+          list_remove (&r->elem);
+          list_push_back (&parent->exited_children, &r->elem);
+          sema_up (&r->dead);
+          if (parent->reaper != NULL)
+            {
+              sema_up (parent->reaper);
+              parent->reaper = NULL;
+            }
+        }
+      cur->exit_record = NULL;
+    }
+
+  /* Running children free their own records when they exit. */
+  while (!list_empty (&cur->running_children))
+    {
+      r = list_entry (list_pop_front (&cur->running_children),
+                      struct exit_record, elem);
+      r->parent = NULL;
+      hash_delete (&exit_records, &r->hash_elem);
+    }
+  while (!list_empty (&cur->exited_children))
+    {
+      r = list_entry (list_pop_front (&cur->exited_children),
+                      struct exit_record, elem);
+      hash_delete (&exit_records, &r->hash_elem);
+      free (r);
+    }
+  lock_release (&records_lock);
+}
+
+/* Allocates an exit record for a child that the current thread
+   is about to create and adds it to the thread's running
+   children.  Returns the new record, or a null pointer if memory
+   is exhausted. */
+static struct exit_record *
+new_record (void)
+{
+  struct thread *cur = thread_current ();
+  struct exit_record *r = malloc (sizeof *r);
+
+  if (r == NULL)
+    return NULL;
+  r->tid = TID_ERROR;
+  r->status = -1;
+  r->parent = cur;
+  sema_init (&r->loaded, 0);
+  r->load_ok = false;
+  sema_init (&r->dead, 0);
+
+  lock_acquire (&records_lock);
+  list_push_back (&cur->running_children, &r->elem);
+  lock_release (&records_lock);
+  return r;
+}
+
+/* Makes R, from new_record(), findable by TID, the thread id that
+   thread_create() returned for its child, or frees it if TID is
+   TID_ERROR.  Returns TID. */
+static tid_t
+publish_record (struct exit_record *r, tid_t tid)
+{
+  lock_acquire (&records_lock);
+  if (tid != TID_ERROR)
+    {
+      r->tid = tid;
+      hash_insert (&exit_records, &r->hash_elem);
+    }
+  else
+    {
+      list_remove (&r->elem);
+      free (r);
+    }
+  lock_release (&records_lock);
+  return tid;
+}
+
+/* Hashes exit records by tid. */
+static unsigned
+record_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct exit_record *r = hash_entry (e, struct exit_record,
+                                            hash_elem);
+  return hash_int (r->tid);
+}
+
+/* Orders exit records by tid. */
+static bool
+record_less (const struct hash_elem *a_, const struct hash_elem *b_,
+             void *aux UNUSED)
+{
+  const struct exit_record *a = hash_entry (a_, struct exit_record,
+                                            hash_elem);
+  const struct exit_record *b = hash_entry (b_, struct exit_record,
+                                            hash_elem);
+  return a->tid < b->tid;
 }
 
 /* Sets up the CPU for running user code in the current
@@ -130,6 +594,10 @@ process_activate (void)
   /* Set thread's kernel stack for use in processing
      interrupts. */
   tss_update ();
+
+  /* Catch up the time page on what happened while we were
+     switched out. */
+  vdso_update ();
 }
 
 /* We load ELF binaries.  The following definitions are taken
@@ -195,25 +663,28 @@ struct Elf32_Phdr
 #define PF_W 2          /* Writable. */
 #define PF_R 4          /* Readable. */
 
-static bool setup_stack (void **esp);
+static bool setup_stack (const struct exec_args *, void **esp);
+static bool parse_image (struct file *, const char *file_name,
+                         struct exec_image *);
 static bool validate_segment (const struct Elf32_Phdr *, struct file *);
 static bool load_segment (struct file *file, off_t ofs, uint8_t *upage,
                           uint32_t read_bytes, uint32_t zero_bytes,
                           bool writable);
 
-/* Loads an ELF executable from FILE_NAME into the current thread.
+/* Loads an ELF executable named by the first of ARGS into the
+   current thread, with ARGS as its arguments.
    Stores the executable's entry point into *EIP
    and its initial stack pointer into *ESP.
    Returns true if successful, false otherwise. */
 bool
-load (const char *file_name, void (**eip) (void), void **esp) 
+load (const struct exec_args *args, void (**eip) (void), void **esp) 
 {
+  const char *file_name = args->strings;
   struct thread *t = thread_current ();
-  struct Elf32_Ehdr ehdr;
+  struct exec_image image;
   struct file *file = NULL;
-  off_t file_ofs;
   bool success = false;
-  int i;
+  size_t i;
 
   /* Allocate and activate page directory. */
   t->pagedir = pagedir_create ();
@@ -221,6 +692,20 @@ load (const char *file_name, void (**eip) (void), void **esp)
     goto done;
   process_activate ();
 
+#ifdef VM
+  /* Allocate supplemental page table. */
+  list_init (&t->mappings);
+  t->next_mapid = 0;
+  t->pages = page_table_create ();
+  if (t->pages == NULL)
+    goto done;
+#endif
+
+  /* Map the time page first, so that segments that would overlap
+     it fail to load. */
+  if (!vdso_map ())
+    goto done;
+
   /* Open executable file. */
   file = filesys_open (file_name);
   if (file == NULL) 
@@ -229,8 +714,71 @@ load (const char *file_name, void (**eip) (void), void **esp)
       goto done; 
     }
 
+  /* Read and check its headers, unless the executable cache
+     already has them. */
+  if (!exec_cache_lookup (file_get_inode (file), &image))
+    {
+      if (!parse_image (file, file_name, &image))
+        goto done;
+      exec_cache_insert (file_get_inode (file), &image);
+    }
+
+  /* Load segments.  The heap starts empty, just past the
+     highest of them. */
+  t->heap_start = NULL;
+  for (i = 0; i < image.segment_cnt; i++)
+    {
+      const struct exec_segment *seg = &image.segments[i];
+      uint8_t *end = ((uint8_t *) seg->mem_page
+                      + seg->read_bytes + seg->zero_bytes);
+      if (!load_segment (file, seg->file_page, (void *) seg->mem_page,
+                         seg->read_bytes, seg->zero_bytes, seg->writable))
+        goto done;
+      if (end > t->heap_start)
+        t->heap_start = end;
+    }
+  t->heap_break = t->heap_start;
+
+  /* Set up stack. */
+  if (!setup_stack (args, esp))
+    goto done;
+
+  /* Start address. */
+  *eip = image.entry;
+
+  success = true;
+
+ done:
+  /* We arrive here whether the load is successful or not. */
+#ifdef VM
+  /* Segments are read from the executable on demand, so keep it
+     open until the process exits. */
+  if (success)
+    t->exec_file = file;
+  else
+    file_close (file);
+#else
+  file_close (file);
+#endif
+  return success;
+}
+
+/* load() helpers. */
+
+/* Reads and checks the ELF header and program headers of FILE,
+   named FILE_NAME, and stores the entry point and the segments to
+   load into *IMAGE.  Returns true if successful, false if FILE is
+   not an executable that Pintos can run. */
+static bool
+parse_image (struct file *file, const char *file_name,
+             struct exec_image *image)
+{
+  struct Elf32_Ehdr ehdr;
+  off_t file_ofs;
+  int i;
+
   /* Read and verify executable header. */
-  if (file_read (file, &ehdr, sizeof ehdr) != sizeof ehdr
+  if (file_read_at (file, &ehdr, sizeof ehdr, 0) != sizeof ehdr
       || memcmp (ehdr.e_ident, "\177ELF\1\1\1", 7)
       || ehdr.e_type != 2
       || ehdr.e_machine != 3
@@ -239,8 +787,10 @@ load (const char *file_name, void (**eip) (void), void **esp)
       || ehdr.e_phnum > 1024) 
     {
       printf ("load: %s: error loading executable\n", file_name);
-      goto done; 
+      return false;
     }
+  image->entry = (void (*) (void)) ehdr.e_entry;
+  image->segment_cnt = 0;
 
   /* Read program headers. */
   file_ofs = ehdr.e_phoff;
@@ -249,11 +799,9 @@ load (const char *file_name, void (**eip) (void), void **esp)
       struct Elf32_Phdr phdr;
 
       if (file_ofs < 0 || file_ofs > file_length (file))
-        goto done;
-      file_seek (file, file_ofs);
-
-      if (file_read (file, &phdr, sizeof phdr) != sizeof phdr)
-        goto done;
+        return false;
+      if (file_read_at (file, &phdr, sizeof phdr, file_ofs) != sizeof phdr)
+        return false;
       file_ofs += sizeof phdr;
       switch (phdr.p_type) 
         {
@@ -267,58 +815,49 @@ load (const char *file_name, void (**eip) (void), void **esp)
         case PT_DYNAMIC:
         case PT_INTERP:
         case PT_SHLIB:
-          goto done;
+          return false;
         case PT_LOAD:
-          if (validate_segment (&phdr, file)) 
+          if (validate_segment (&phdr, file)
+              && image->segment_cnt < EXEC_SEGMENT_MAX) 
             {
-              bool writable = (phdr.p_flags & PF_W) != 0;
-              uint32_t file_page = phdr.p_offset & ~PGMASK;
-              uint32_t mem_page = phdr.p_vaddr & ~PGMASK;
+              struct exec_segment *seg
+                = &image->segments[image->segment_cnt++];
               uint32_t page_offset = phdr.p_vaddr & PGMASK;
-              uint32_t read_bytes, zero_bytes;
+              seg->writable = (phdr.p_flags & PF_W) != 0;
+              seg->file_page = phdr.p_offset & ~PGMASK;
+              seg->mem_page = phdr.p_vaddr & ~PGMASK;
               if (phdr.p_filesz > 0)
                 {
                   /* Normal segment.
                      Read initial part from disk and zero the rest. */
-                  read_bytes = page_offset + phdr.p_filesz;
-                  zero_bytes = (ROUND_UP (page_offset + phdr.p_memsz, PGSIZE)
-                                - read_bytes);
+                  seg->read_bytes = page_offset + phdr.p_filesz;
+                  seg->zero_bytes = (ROUND_UP (page_offset + phdr.p_memsz,
+                                               PGSIZE)
+                                     - seg->read_bytes);
                 }
               else 
                 {
                   /* Entirely zero.
                      Don't read anything from disk. */
-                  read_bytes = 0;
-                  zero_bytes = ROUND_UP (page_offset + phdr.p_memsz, PGSIZE);
+                  seg->read_bytes = 0;
+                  seg->zero_bytes = ROUND_UP (page_offset + phdr.p_memsz,
+                                              PGSIZE);
                 }
-              if (!load_segment (file, file_page, (void *) mem_page,
-                                 read_bytes, zero_bytes, writable))
-                goto done;
             }
           else
-            goto done;
+            return false;
           break;
         }
     }
-
-  /* Set up stack. */
-  if (!setup_stack (esp))
-    goto done;
-
-  /* Start address. */
-  *eip = (void (*) (void)) ehdr.e_entry;
-
-  success = true;
-
- done:
-  /* We arrive here whether the load is successful or not. */
-  file_close (file);
-  return success;
+  return true;
 }
-
-/* load() helpers. */
 
+#ifndef VM
+static bool load_bulk (struct file *, off_t ofs, uint8_t **upage,
+                       uint32_t *read_bytes, uint32_t *zero_bytes,
+                       bool writable);
 static bool install_page (void *upage, void *kpage, bool writable);
+#endif
 
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
@@ -377,6 +916,15 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
    The pages initialized by this function must be writable by the
    user process if WRITABLE is true, read-only otherwise.
 
+   With VM, the pages are only recorded in the supplemental page
+   table here, and are read in by the page fault handler when
+   first touched, pages with nothing to read as anonymous zeroed
+   memory.  FILE must then stay open.
+
+   Without VM, the pages with file data are read in one request,
+   straight into frames, if enough contiguous frames are free, and
+   pages of only zeros come pre-zeroed from palloc if it has them.
+
    Return true if successful, false if a memory allocation error
    or disk read error occurs. */
 static bool
@@ -387,7 +935,12 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
-  file_seek (file, ofs);
+#ifndef VM
+  if (read_bytes > PGSIZE && !load_bulk (file, ofs, &upage, &read_bytes,
+                                         &zero_bytes, writable))
+    return false;
+#endif
+
   while (read_bytes > 0 || zero_bytes > 0) 
     {
       /* Calculate how to fill this page.
@@ -396,18 +949,29 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
       size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
+#ifdef VM
+      /* Record the page for loading on demand. */
+      if (!page_add (upage, page_read_bytes > 0 ? file : NULL, ofs,
+                     page_read_bytes, writable))
+        return false;
+#else
       /* Get a page of memory. */
-      uint8_t *kpage = palloc_get_page (PAL_USER);
+      uint8_t *kpage = palloc_get_page (page_read_bytes > 0
+                                        ? PAL_USER : PAL_USER | PAL_ZERO);
       if (kpage == NULL)
         return false;
 
       /* Load this page. */
-      if (file_read (file, kpage, page_read_bytes) != (int) page_read_bytes)
+      if (page_read_bytes > 0)
         {
-          palloc_free_page (kpage);
-          return false; 
+          if (file_read_at_direct (file, kpage, page_read_bytes, ofs)
+              != (int) page_read_bytes)
+            {
+              palloc_free_page (kpage);
+              return false; 
+            }
+          memset (kpage + page_read_bytes, 0, page_zero_bytes);
         }
-      memset (kpage + page_read_bytes, 0, page_zero_bytes);
 
       /* Add the page to the process's address space. */
       if (!install_page (upage, kpage, writable)) 
@@ -415,35 +979,110 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
           palloc_free_page (kpage);
           return false; 
         }
+#endif
 
       /* Advance. */
       read_bytes -= page_read_bytes;
       zero_bytes -= page_zero_bytes;
+      ofs += page_read_bytes;
       upage += PGSIZE;
     }
   return true;
 }
 
-/* Create a minimal stack by mapping a zeroed page at the top of
-   user virtual memory. */
+#ifndef VM
+/* Loads the pages of a segment that have file data, as
+   load_segment() describes, with a single read into contiguous
+   frames.  Advances *UPAGE, *READ_BYTES, and *ZERO_BYTES past the
+   pages it loads.  Returns false if a disk read error occurs or
+   the pages cannot be mapped.  If there are not enough contiguous
+   frames, loads nothing and returns true, leaving load_segment()
+   to load page by page. */
 static bool
-setup_stack (void **esp) 
+load_bulk (struct file *file, off_t ofs, uint8_t **upage,
+           uint32_t *read_bytes, uint32_t *zero_bytes, bool writable)
 {
-  uint8_t *kpage;
-  bool success = false;
+  size_t page_cnt = DIV_ROUND_UP (*read_bytes, PGSIZE);
+  size_t tail = page_cnt * PGSIZE - *read_bytes;
+  uint8_t *kpages;
+  size_t i;
 
-  kpage = palloc_get_page (PAL_USER | PAL_ZERO);
-  if (kpage != NULL) 
+  kpages = palloc_get_multiple (PAL_USER, page_cnt);
+  if (kpages == NULL)
+    return true;
+  if (file_read_at_direct (file, kpages, *read_bytes, ofs)
+      != (int) *read_bytes)
     {
-      success = install_page (((uint8_t *) PHYS_BASE) - PGSIZE, kpage, true);
-      if (success)
-        *esp = PHYS_BASE;
-      else
-        palloc_free_page (kpage);
+      palloc_free_multiple (kpages, page_cnt);
+      return false;
     }
-  return success;
+  memset (kpages + *read_bytes, 0, tail);
+
+  for (i = 0; i < page_cnt; i++)
+    if (!install_page (*upage + i * PGSIZE, kpages + i * PGSIZE, writable))
+      {
+        /* The pages already mapped are freed with the page
+           directory. */
+        palloc_free_multiple (kpages + i * PGSIZE, page_cnt - i);
+        return false;
+      }
+
+  *upage += page_cnt * PGSIZE;
+  *read_bytes = 0;
+  *zero_bytes -= tail;
+  return true;
 }
+#endif
 
+/* Creates a minimal stack by mapping a zeroed page at the top of
+   user virtual memory, and pushes ARGS onto it for main(). */
+static bool
+setup_stack (const struct exec_args *args, void **esp) 
+{
+  uint8_t *upage = (uint8_t *) PHYS_BASE - PGSIZE;
+  uint8_t *strings = (uint8_t *) PHYS_BASE - args->size;
+  char **argv = (char **) ROUND_DOWN ((uintptr_t) strings, sizeof (char *))
+                - (args->argc + 1);
+  uint32_t *frame = (uint32_t *) argv - 3;
+  int i;
+
+  /* Everything must fit in the one page. */
+  if ((uint8_t *) frame < upage)
+    return false;
+
+#ifdef VM
+  /* Make the stack page pageable like any other. */
+  if (!page_add (upage, NULL, 0, 0, true) || !page_load (upage, true))
+    return false;
+#else
+  {
+    uint8_t *kpage = palloc_get_page (PAL_USER | PAL_ZERO);
+    if (kpage == NULL)
+      return false;
+    if (!install_page (upage, kpage, true))
+      {
+        palloc_free_page (kpage);
+        return false;
+      }
+  }
+#endif
+
+  /* The page is mapped in the current page directory, so write
+     through its user address: the strings in one copy, already
+     packed by process_execute(), then argv[], then main()'s
+     arguments under a null return address. */
+  memcpy (strings, args->strings, args->size);
+  for (i = 0; i < args->argc; i++)
+    argv[i] = (char *) strings + args->ofs[i];
+  argv[args->argc] = NULL;
+  frame[0] = 0;
+  frame[1] = args->argc;
+  frame[2] = (uint32_t) argv;
+  *esp = frame;
+  return true;
+}
+
+#ifndef VM
 /* Adds a mapping from user virtual address UPAGE to kernel
    virtual address KPAGE to the page table.
    If WRITABLE is true, the user process may modify the page;
@@ -463,3 +1102,103 @@ install_page (void *upage, void *kpage, bool writable)
   return (pagedir_get_page (t->pagedir, upage) == NULL
           && pagedir_set_page (t->pagedir, upage, kpage, writable));
 }
+#endif
+
+/* The heap.
+
+   A process's heap is the run of pages from the end of its
+   highest segment up to its "break", which sbrk() moves.  Pages
+   are added and removed whole, so the page that holds the break
+   stays mapped.  With VM, new pages are zero pages that the page
+   fault handler allocates on first touch, like the stack's; the
+   heap may grow until it would run into the stack's largest
+   extent.  Without VM, each page is allocated and zeroed
+   immediately, and the heap may grow up to the stack's one
+   page. */
+
+static bool heap_page_add (uint8_t *upage);
+static void heap_page_remove (uint8_t *upage);
+
+/* Moves the current process's break by INCREMENT bytes, which
+   may be negative, and returns the old break.  Returns
+   SBRK_FAILED without moving it if the break would leave the
+   heap's bounds, or if a page is already in use or memory
+   allocation fails. */
+void *
+process_sbrk (intptr_t increment)
+{
+  struct thread *t = thread_current ();
+  uint8_t *old = t->heap_break;
+  uint8_t *limit, *page;
+  size_t size;
+
+  if (old == NULL)
+    return SBRK_FAILED;
+#ifdef VM
+  limit = (uint8_t *) PHYS_BASE - page_stack_limit * PGSIZE;
+#else
+  limit = (uint8_t *) PHYS_BASE - PGSIZE;
+#endif
+
+  if (increment >= 0)
+    {
+      size = increment;
+      if (old > limit || size > (size_t) (limit - old))
+        return SBRK_FAILED;
+      for (page = pg_round_up (old); page < old + size; page += PGSIZE)
+        if (!heap_page_add (page))
+          {
+            while (page > (uint8_t *) pg_round_up (old))
+              heap_page_remove (page -= PGSIZE);
+            return SBRK_FAILED;
+          }
+    }
+  else
+    {
+      size = -(size_t) increment;
+      if (size > (size_t) (old - t->heap_start))
+        return SBRK_FAILED;
+      for (page = pg_round_up (old - size);
+           page < (uint8_t *) pg_round_up (old); page += PGSIZE)
+        heap_page_remove (page);
+    }
+  t->heap_break = old + increment;
+  return old;
+}
+
+/* Adds UPAGE to the current process's heap.  Returns true if
+   successful, false if UPAGE is already in use or memory
+   allocation fails. */
+static bool
+heap_page_add (uint8_t *upage)
+{
+#ifdef VM
+  return page_add (upage, NULL, 0, 0, true);
+#else
+  uint8_t *kpage = palloc_get_page (PAL_USER | PAL_ZERO);
+  if (kpage == NULL)
+    return false;
+  if (!install_page (upage, kpage, true))
+    {
+      palloc_free_page (kpage);
+      return false;
+    }
+  return true;
+#endif
+}
+
+/* Removes UPAGE from the current process's heap and frees its
+   memory. */
+static void
+heap_page_remove (uint8_t *upage)
+{
+#ifdef VM
+  page_remove (upage);
+#else
+  uint32_t *pd = thread_current ()->pagedir;
+  void *kpage = pagedir_get_page (pd, upage);
+
+  pagedir_clear_page (pd, upage);
+  palloc_free_page (kpage);
+#endif
+}
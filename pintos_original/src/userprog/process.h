@@ -3,8 +3,20 @@
 
 #include "threads/thread.h"
 
-tid_t process_execute (const char *file_name);
+struct intr_frame;
+struct pipe;
+
+/* Returned by process_sbrk() on failure. */
+#define SBRK_FAILED ((void *) -1)
+
+void process_init (void);
+tid_t process_execute (const char *cmd_line);
+tid_t process_execute_redirect (const char *cmd_line, struct pipe *in,
+                                struct pipe *out);
+tid_t process_fork (const struct intr_frame *);
 int process_wait (tid_t);
+tid_t process_wait_any (int *status);
+void *process_sbrk (intptr_t increment);
 void process_exit (void);
 void process_activate (void);
 
@@ -1,20 +1,1030 @@
 #include "userprog/syscall.h"
+#include <bitmap.h>
+#include <limits.h>
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
+#include "devices/block.h"
+#include "devices/clock.h"
+#include "devices/input.h"
+#include "devices/shutdown.h"
+#include "devices/timer.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
 #include "threads/interrupt.h"
+#include "threads/kstack.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/exec-cache.h"
+#include "userprog/futex.h"
+#include "userprog/pipe.h"
+#include "userprog/process.h"
+#ifdef VM
+#include "vm/mmap.h"
+#include "vm/page.h"
+#endif
+
+/* System calls.
+
+   User memory is never checked by walking the page directory.
+   Instead, the kernel just tries the access, with get_user() and
+   put_user(), and lets page_fault() tell it if the access failed.
+   In the common case, where the process passes good pointers,
+   that costs nothing beyond the access itself.
+
+   Buffers for read() and write() are not copied through the
+   kernel: the file system reads and writes the user's pages
+   directly, one page at a time.  Each page is checked first and,
+   with VM, pinned in memory so that the access can't fault while
+   the file system holds an inode or buffer cache lock. */
+
+/* Each process's open files and pipe ends are in an array
+   indexed by handle, less FD_MIN, with a bitmap of the handles in
+   use.  Lookup is a bounds check and an array access, and handing
+   out the lowest free handle is a bitmap scan.  The array starts
+   at FD_INIT_CNT entries and doubles whenever it fills. */
+#define FD_MIN 2                /* Lowest file handle; 0 and 1 are
+                                   the console. */
+#define FD_INIT_CNT 16          /* Initial handle capacity. */
+
+/* An open file handle.  Exactly one of FILE and PIPE is
+   nonnull. */
+struct fd
+  {
+    struct file *file;          /* Open file. */
+    struct pipe *pipe;          /* Pipe end. */
+    bool write;                 /* For a pipe, is this the write end? */
+  };
+
+/* A buffer for readv() and writev(), as in lib/user/syscall.h. */
+struct iovec
+  {
+    void *iov_base;             /* Start of the buffer. */
+    unsigned iov_len;           /* Length in bytes. */
+  };
+
+/* A system call for syscall_batch(), as in lib/user/syscall.h. */
+struct syscall_req
+  {
+    int number;                 /* SYS_* number. */
+    int args[3];                /* Arguments. */
+    int result;                 /* Return value. */
+  };
 
 static void syscall_handler (struct intr_frame *);
 
+static int sys_halt (void) NO_RETURN;
+static int sys_exit (int status) NO_RETURN;
+static int sys_exec (const char *ufile);
+static int sys_wait (tid_t);
+static int sys_create (const char *ufile, unsigned initial_size);
+static int sys_remove (const char *ufile);
+static int sys_open (const char *ufile);
+static int sys_filesize (int handle);
+static int sys_read (int handle, void *ubuf, unsigned size);
+static int sys_write (int handle, const void *ubuf, unsigned size);
+static int sys_seek (int handle, unsigned position);
+static int sys_tell (int handle);
+static int sys_close (int handle);
+#ifdef VM
+static int sys_mmap (int handle, void *addr);
+static int sys_munmap (int mapping);
+#endif
+static int sys_readv (int handle, const struct iovec *uiov, int iovcnt);
+static int sys_writev (int handle, const struct iovec *uiov, int iovcnt);
+static int sys_batch (struct syscall_req *ureqs, int cnt);
+static int sys_blockstats (const char *udevice, struct block_stats *ustats,
+                           bool reset);
+static int sys_uptime (uint64_t *uns);
+static int sys_wait_any (int *ustatus);
+static int sys_sbrk (intptr_t increment);
+static int sys_pipe (int *uhandles);
+static int sys_exec_redirect (const char *ufile, int in, int out);
+static int sys_futex_wait (int *uaddr, int val, int timeout_ms);
+static int sys_futex_wake (int *uaddr, int cnt);
+static int sys_fork (void);
+
+/* A system call, taking up to 3 word-size arguments.  Each
+   function is called as if it took all 3, which is harmless with
+   the cdecl calling convention. */
+typedef int syscall_function (int, int, int);
+
+struct syscall
+  {
+    const char *name;           /* Name, for statistics. */
+    size_t arg_cnt;             /* Number of arguments. */
+    syscall_function *func;     /* Implementation, or null. */
+  };
+
+/* Table entry for sys_NAME(), taking ARG_CNT arguments.  The
+   cast through void (*) (void) tells GCC that the differing
+   function type is intended. */
+#define SYSCALL(NAME, ARG_CNT) \
+  {#NAME, ARG_CNT, (syscall_function *) (void (*) (void)) sys_##NAME}
+
+/* System calls, indexed by SYS_* number. */
+static const struct syscall syscall_table[] =
+  {
+    [SYS_HALT] = SYSCALL (halt, 0),
+    [SYS_EXIT] = SYSCALL (exit, 1),
+    [SYS_EXEC] = SYSCALL (exec, 1),
+    [SYS_WAIT] = SYSCALL (wait, 1),
+    [SYS_CREATE] = SYSCALL (create, 2),
+    [SYS_REMOVE] = SYSCALL (remove, 1),
+    [SYS_OPEN] = SYSCALL (open, 1),
+    [SYS_FILESIZE] = SYSCALL (filesize, 1),
+    [SYS_READ] = SYSCALL (read, 3),
+    [SYS_WRITE] = SYSCALL (write, 3),
+    [SYS_SEEK] = SYSCALL (seek, 2),
+    [SYS_TELL] = SYSCALL (tell, 1),
+    [SYS_CLOSE] = SYSCALL (close, 1),
+#ifdef VM
+    [SYS_MMAP] = SYSCALL (mmap, 2),
+    [SYS_MUNMAP] = SYSCALL (munmap, 1),
+#endif
+    [SYS_READV] = SYSCALL (readv, 3),
+    [SYS_WRITEV] = SYSCALL (writev, 3),
+    [SYS_BATCH] = SYSCALL (batch, 2),
+    [SYS_BLOCKSTATS] = SYSCALL (blockstats, 3),
+    [SYS_UPTIME] = SYSCALL (uptime, 1),
+    [SYS_WAIT_ANY] = SYSCALL (wait_any, 1),
+    [SYS_SBRK] = SYSCALL (sbrk, 1),
+    [SYS_PIPE] = SYSCALL (pipe, 1),
+    [SYS_EXEC_REDIRECT] = SYSCALL (exec_redirect, 3),
+    [SYS_FUTEX_WAIT] = SYSCALL (futex_wait, 3),
+    [SYS_FUTEX_WAKE] = SYSCALL (futex_wake, 2),
+    [SYS_FORK] = SYSCALL (fork, 0),
+  };
+
+/* Number of entries in syscall_table. */
+#define SYSCALL_CNT (sizeof syscall_table / sizeof *syscall_table)
+
+/* Per-system call statistics. */
+struct syscall_stats
+  {
+    unsigned long long calls;   /* Number of calls. */
+    unsigned long long cycles;  /* CPU cycles spent in calls that
+                                   returned. */
+  };
+static struct syscall_stats syscall_stats[SYSCALL_CNT];
+
+static int invoke (unsigned call_nr, const int args[3]);
+static void copy_in (void *, const void *, size_t);
+static void copy_out (void *, const void *, size_t);
+static char *copy_in_string (const char *);
+static void pin_page (const void *, bool write);
+static void unpin_page (const void *);
+static struct file *lookup_fd (int handle);
+static struct pipe *lookup_pipe (int handle, bool write);
+static int alloc_fd (struct file *, struct pipe *, bool write);
+static void free_fd (int handle);
+
 void
-syscall_init (void) 
+syscall_init (void)
 {
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
 }
 
+/* System call handler. */
 static void
-syscall_handler (struct intr_frame *f UNUSED) 
+syscall_handler (struct intr_frame *f)
 {
-  printf ("system call!\n");
+  unsigned call_nr;
+  int args[3];
+
+#ifdef VM
+  /* For stack growth on faults while accessing user memory. */
+  thread_current ()->user_esp = f->esp;
+#endif
+
+  /* System calls lead into the file system and virtual memory,
+     so commit the whole kernel stack, if it is a large one. */
+  if (!kstack_reserve (kstack_size))
+    sys_exit (-1);
+
+  /* Look up the system call. */
+  copy_in (&call_nr, f->esp, sizeof call_nr);
+  if (call_nr >= SYSCALL_CNT || syscall_table[call_nr].func == NULL)
+    sys_exit (-1);
+
+  /* Fetch its arguments and call it. */
+  memset (args, 0, sizeof args);
+  copy_in (args, (uint32_t *) f->esp + 1,
+           sizeof *args * syscall_table[call_nr].arg_cnt);
+  f->eax = invoke (call_nr, args);
+}
+
+/* Calls system call CALL_NR, which must be valid, with ARGS, and
+   returns its return value, recording statistics. */
+static int
+invoke (unsigned call_nr, const int args[3])
+{
+  const struct syscall *sc = &syscall_table[call_nr];
+  struct syscall_stats *stats = &syscall_stats[call_nr];
+  enum intr_level old_level;
+  uint64_t start;
+  int retval;
+
+  old_level = intr_disable ();
+  stats->calls++;
+  intr_set_level (old_level);
+
+  start = clock_cycles ();
+  retval = sc->func (args[0], args[1], args[2]);
+
+  old_level = intr_disable ();
+  stats->cycles += clock_cycles () - start;
+  intr_set_level (old_level);
+  return retval;
+}
+
+/* Prints system call statistics. */
+void
+syscall_print_stats (void)
+{
+  size_t i;
+
+  for (i = 0; i < SYSCALL_CNT; i++)
+    if (syscall_stats[i].calls > 0)
+      printf ("Syscall %s: %llu calls, %llu cycles (%llu ns)\n",
+              syscall_table[i].name, syscall_stats[i].calls,
+              syscall_stats[i].cycles,
+              (unsigned long long) clock_cycles_to_ns (syscall_stats[i].cycles));
+}
+
+/* Gives the current process, a child that process_fork() is
+   setting up, its own references to PARENT's console pipes and
+   to each of PARENT's open files and pipe ends, under the same
+   handles.  A file is reopened at the same position, since open
+   files have no position to share.  Returns false if memory
+   runs out, leaving whatever was copied for syscall_exit(). */
+bool
+syscall_fork (struct thread *parent)
+{
+  struct thread *t = thread_current ();
+  size_t cnt, idx;
+
+  t->stdio[STDIN_FILENO] = parent->stdio[STDIN_FILENO];
+  t->stdio[STDOUT_FILENO] = parent->stdio[STDOUT_FILENO];
+  if (t->stdio[STDIN_FILENO] != NULL)
+    pipe_open (t->stdio[STDIN_FILENO], false);
+  if (t->stdio[STDOUT_FILENO] != NULL)
+    pipe_open (t->stdio[STDOUT_FILENO], true);
+
+  if (parent->fd_map == NULL)
+    return true;
+  cnt = bitmap_size (parent->fd_map);
+  t->fd_map = bitmap_create (cnt);
+  if (t->fd_map == NULL)
+    return false;
+  t->fds = calloc (cnt, sizeof *t->fds);
+  if (t->fds == NULL)
+    return false;
+  for (idx = bitmap_scan (parent->fd_map, 0, 1, true); idx != BITMAP_ERROR;
+       idx = bitmap_scan (parent->fd_map, idx + 1, 1, true))
+    {
+      const struct fd *fd = &parent->fds[idx];
+
+      if (fd->file != NULL)
+        {
+          struct file *file = file_reopen (fd->file);
+          if (file == NULL)
+            return false;
+          file_seek (file, file_tell (fd->file));
+          t->fds[idx].file = file;
+        }
+      else
+        {
+          pipe_open (fd->pipe, fd->write);
+          t->fds[idx].pipe = fd->pipe;
+          t->fds[idx].write = fd->write;
+        }
+      bitmap_mark (t->fd_map, idx);
+    }
+  return true;
+}
+
+/* Closes all of the current process's open files and pipes.
+   Called at process exit. */
+void
+syscall_exit (void)
+{
+  struct thread *t = thread_current ();
+  size_t idx;
+
+  if (t->stdio[STDIN_FILENO] != NULL)
+    pipe_close (t->stdio[STDIN_FILENO], false);
+  if (t->stdio[STDOUT_FILENO] != NULL)
+    pipe_close (t->stdio[STDOUT_FILENO], true);
+  t->stdio[STDIN_FILENO] = t->stdio[STDOUT_FILENO] = NULL;
+
+  if (t->fd_map == NULL)
+    return;
+  for (idx = bitmap_scan (t->fd_map, 0, 1, true); idx != BITMAP_ERROR;
+       idx = bitmap_scan (t->fd_map, idx + 1, 1, true))
+    if (t->fds[idx].file != NULL)
+      file_close (t->fds[idx].file);
+    else
+      pipe_close (t->fds[idx].pipe, t->fds[idx].write);
+  bitmap_destroy (t->fd_map);
+  free (t->fds);
+  t->fd_map = NULL;
+  t->fds = NULL;
+}
+
+/* Halt system call. */
+static int
+sys_halt (void)
+{
+  shutdown_power_off ();
+}
+
+/* Exit system call. */
+static int
+sys_exit (int status)
+{
+  thread_current ()->exit_status = status;
   thread_exit ();
+  NOT_REACHED ();
+}
+
+/* Exec system call. */
+static int
+sys_exec (const char *ufile)
+{
+  char *kfile = copy_in_string (ufile);
+  tid_t tid;
+
+  tid = process_execute (kfile);
+  palloc_free_page (kfile);
+  return tid;
+}
+
+/* Wait system call. */
+static int
+sys_wait (tid_t child)
+{
+  return process_wait (child);
+}
+
+/* Create system call. */
+static int
+sys_create (const char *ufile, unsigned initial_size)
+{
+  char *kfile = copy_in_string (ufile);
+  bool ok;
+
+  ok = filesys_create (kfile, initial_size);
+  palloc_free_page (kfile);
+  return ok;
+}
+
+/* Remove system call. */
+static int
+sys_remove (const char *ufile)
+{
+  char *kfile = copy_in_string (ufile);
+  bool ok;
+
+  ok = filesys_remove (kfile);
+  palloc_free_page (kfile);
+  if (ok)
+    exec_cache_sweep ();
+  return ok;
+}
+
+/* Open system call. */
+static int
+sys_open (const char *ufile)
+{
+  char *kfile = copy_in_string (ufile);
+  struct file *file;
+  int handle = -1;
+
+  file = filesys_open (kfile);
+  if (file != NULL)
+    {
+      handle = alloc_fd (file, NULL, false);
+      if (handle < 0)
+        file_close (file);
+    }
+  palloc_free_page (kfile);
+  return handle;
+}
+
+/* Filesize system call. */
+static int
+sys_filesize (int handle)
+{
+  struct file *file = lookup_fd (handle);
+  int size;
+
+  if (file == NULL)
+    return -1;
+  size = file_length (file);
+  return size;
+}
+
+/* Read system call.  A read from a pipe waits until there is
+   something to read and then reads what is there, up to SIZE
+   bytes. */
+static int
+sys_read (int handle, void *ubuf, unsigned size)
+{
+  uint8_t *buf = ubuf;
+  struct file *file = NULL;
+  struct pipe *pipe = NULL;
+  int bytes_read = 0;
+
+  if (handle == STDIN_FILENO)
+    pipe = thread_current ()->stdio[STDIN_FILENO];
+  else
+    {
+      file = lookup_fd (handle);
+      if (file == NULL)
+        {
+          pipe = lookup_pipe (handle, false);
+          if (pipe == NULL)
+            return -1;
+        }
+    }
+
+  /* Read into one page of BUF at a time. */
+  while (size > 0)
+    {
+      size_t page_left = PGSIZE - pg_ofs (buf);
+      size_t chunk = size < page_left ? size : page_left;
+      off_t n;
+
+      pin_page (buf, true);
+      if (file != NULL)
+        n = file_read (file, buf, chunk);
+      else if (pipe != NULL)
+        n = pipe_read (pipe, buf, chunk, bytes_read == 0);
+      else
+        n = input_read (buf, chunk);
+      unpin_page (buf);
+
+      bytes_read += n;
+      if ((size_t) n != chunk)
+        break;
+      buf += chunk;
+      size -= chunk;
+    }
+  return bytes_read;
+}
+
+/* Write system call.  A write to a pipe that no process may
+   read any more returns -1, or a short count if some of it was
+   written first. */
+static int
+sys_write (int handle, const void *ubuf, unsigned size)
+{
+  const uint8_t *buf = ubuf;
+  struct file *file = NULL;
+  struct pipe *pipe = NULL;
+  int bytes_written = 0;
+
+  if (handle == STDOUT_FILENO)
+    pipe = thread_current ()->stdio[STDOUT_FILENO];
+  else
+    {
+      file = lookup_fd (handle);
+      if (file == NULL)
+        {
+          pipe = lookup_pipe (handle, true);
+          if (pipe == NULL)
+            return -1;
+        }
+    }
+
+  /* Write from one page of BUF at a time. */
+  while (size > 0)
+    {
+      size_t page_left = PGSIZE - pg_ofs (buf);
+      size_t chunk = size < page_left ? size : page_left;
+      off_t n;
+
+      pin_page (buf, false);
+      if (file != NULL)
+        n = file_write (file, buf, chunk);
+      else if (pipe != NULL)
+        n = pipe_write (pipe, buf, chunk);
+      else
+        {
+          putbuf ((const char *) buf, chunk);
+          n = chunk;
+        }
+      unpin_page (buf);
+
+      if (n < 0)
+        return bytes_written > 0 ? bytes_written : -1;
+      bytes_written += n;
+      if ((size_t) n != chunk)
+        break;
+      buf += chunk;
+      size -= chunk;
+    }
+  return bytes_written;
+}
+
+/* Seek system call. */
+static int
+sys_seek (int handle, unsigned position)
+{
+  struct file *file = lookup_fd (handle);
+
+  if (file != NULL)
+    file_seek (file, position);
+  return 0;
+}
+
+/* Tell system call. */
+static int
+sys_tell (int handle)
+{
+  struct file *file = lookup_fd (handle);
+  int position;
+
+  if (file == NULL)
+    return -1;
+  position = file_tell (file);
+  return position;
+}
+
+/* Close system call. */
+static int
+sys_close (int handle)
+{
+  struct file *file = lookup_fd (handle);
+  struct pipe *pipe;
+
+  if (file != NULL)
+    {
+      file_close (file);
+      free_fd (handle);
+    }
+  else if ((pipe = lookup_pipe (handle, false)) != NULL)
+    {
+      pipe_close (pipe, false);
+      free_fd (handle);
+    }
+  else if ((pipe = lookup_pipe (handle, true)) != NULL)
+    {
+      pipe_close (pipe, true);
+      free_fd (handle);
+    }
+  return 0;
+}
+
+#ifdef VM
+/* Mmap system call. */
+static int
+sys_mmap (int handle, void *addr)
+{
+  struct file *file = lookup_fd (handle);
+  mapid_t mapping;
+
+  if (file == NULL)
+    return MAP_FAILED;
+  mapping = mmap_map (file, addr);
+  return mapping;
+}
+
+/* Munmap system call. */
+static int
+sys_munmap (int mapping)
+{
+  mmap_unmap (mapping);
+  return 0;
+}
+#endif
+
+/* Readv system call.  Reads into each of the IOVCNT buffers in
+   UIOV in turn, stopping early at end of file.  Returns the total
+   bytes read, or -1 if the first read fails. */
+static int
+sys_readv (int handle, const struct iovec *uiov, int iovcnt)
+{
+  int total = 0;
+  int i;
+
+  for (i = 0; i < iovcnt; i++)
+    {
+      struct iovec iov;
+      int n;
+
+      copy_in (&iov, &uiov[i], sizeof iov);
+      n = sys_read (handle, iov.iov_base, iov.iov_len);
+      if (n < 0)
+        return i == 0 ? -1 : total;
+      total += n;
+      if ((unsigned) n != iov.iov_len)
+        break;
+    }
+  return total;
+}
+
+/* Writev system call.  Writes each of the IOVCNT buffers in UIOV
+   in turn, stopping early at a short write.  Returns the total
+   bytes written, or -1 if the first write fails. */
+static int
+sys_writev (int handle, const struct iovec *uiov, int iovcnt)
+{
+  int total = 0;
+  int i;
+
+  for (i = 0; i < iovcnt; i++)
+    {
+      struct iovec iov;
+      int n;
+
+      copy_in (&iov, &uiov[i], sizeof iov);
+      n = sys_write (handle, iov.iov_base, iov.iov_len);
+      if (n < 0)
+        return i == 0 ? -1 : total;
+      total += n;
+      if ((unsigned) n != iov.iov_len)
+        break;
+    }
+  return total;
+}
+
+/* Batch system call.  Runs each of the CNT system calls in UREQS
+   in order, storing each one's return value in its request, or
+   -1 if it is not a valid system call.  A batch may not contain
+   another batch, or a fork, whose child would return from the
+   whole batch.  Returns CNT. */
+static int
+sys_batch (struct syscall_req *ureqs, int cnt)
+{
+  int i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      struct syscall_req req;
+      int result = -1;
+
+      copy_in (&req, &ureqs[i], sizeof req);
+      if ((unsigned) req.number < SYSCALL_CNT
+          && syscall_table[req.number].func != NULL
+          && req.number != SYS_BATCH && req.number != SYS_FORK)
+        result = invoke (req.number, req.args);
+      copy_out (&ureqs[i].result, &result, sizeof result);
+    }
+  return cnt;
+}
+
+/* Blockstats system call.  Copies the statistics for the block
+   device named UDEVICE to USTATS, then resets them if RESET is
+   true.  Returns false if there is no such device. */
+static int
+sys_blockstats (const char *udevice, struct block_stats *ustats, bool reset)
+{
+  char *device = copy_in_string (udevice);
+  struct block *block = block_get_by_name (device);
+  struct block_stats stats;
+
+  palloc_free_page (device);
+  if (block == NULL)
+    return false;
+  block_get_stats (block, &stats, reset);
+  copy_out (ustats, &stats, sizeof stats);
+  return true;
+}
+
+/* Uptime system call.  Stores the time since the machine started,
+   in nanoseconds, in *UNS. */
+static int
+sys_uptime (uint64_t *uns)
+{
+  uint64_t ns = clock_ns ();
+
+  copy_out (uns, &ns, sizeof ns);
+  return 0;
+}
+
+/* Wait-any system call.  Reaps any child that has exited, waiting
+   for one if necessary, and stores its exit status in *USTATUS. */
+static int
+sys_wait_any (int *ustatus)
+{
+  int status;
+  tid_t tid;
+
+  tid = process_wait_any (&status);
+  if (tid != TID_ERROR)
+    copy_out (ustatus, &status, sizeof status);
+  return tid;
+}
+
+/* Sbrk system call.  Moves the end of the heap by INCREMENT
+   bytes and returns its old address, or SBRK_FAILED. */
+static int
+sys_sbrk (intptr_t increment)
+{
+  return (int) process_sbrk (increment);
+}
+
+/* Pipe system call.  Creates a pipe and stores handles for its
+   read end and write end in UHANDLES[0] and UHANDLES[1].
+   Returns true if successful, false on failure. */
+static int
+sys_pipe (int *uhandles)
+{
+  struct pipe *pipe = pipe_create ();
+  int handles[2];
+
+  if (pipe == NULL)
+    return false;
+  handles[0] = alloc_fd (NULL, pipe, false);
+  if (handles[0] < 0)
+    {
+      pipe_close (pipe, false);
+      pipe_close (pipe, true);
+      return false;
+    }
+  handles[1] = alloc_fd (NULL, pipe, true);
+  if (handles[1] < 0)
+    {
+      sys_close (handles[0]);
+      pipe_close (pipe, true);
+      return false;
+    }
+  copy_out (uhandles, handles, sizeof handles);
+  return true;
+}
+
+/* Exec_redirect system call.  Like exec, but the new process's
+   console input comes from IN, which is STDIN_FILENO or the read
+   end of a pipe, and its console output goes to OUT, which is
+   STDOUT_FILENO or the write end of a pipe.  STDIN_FILENO and
+   STDOUT_FILENO mean the current process's own, as for exec. */
+static int
+sys_exec_redirect (const char *ufile, int in, int out)
+{
+  struct thread *t = thread_current ();
+  struct pipe *in_pipe = t->stdio[STDIN_FILENO];
+  struct pipe *out_pipe = t->stdio[STDOUT_FILENO];
+  char *kfile;
+  tid_t tid;
+
+  if (in != STDIN_FILENO && (in_pipe = lookup_pipe (in, false)) == NULL)
+    return TID_ERROR;
+  if (out != STDOUT_FILENO && (out_pipe = lookup_pipe (out, true)) == NULL)
+    return TID_ERROR;
+
+  kfile = copy_in_string (ufile);
+  tid = process_execute_redirect (kfile, in_pipe, out_pipe);
+  palloc_free_page (kfile);
+  return tid;
+}
+
+/* Futex_wait system call.  If the int at UADDR holds VAL, waits
+   for a futex_wake() on it, or for TIMEOUT_MS milliseconds unless
+   that is negative.  Returns FUTEX_WOKEN, FUTEX_CHANGED, or
+   FUTEX_TIMEOUT, or -1 if UADDR is not aligned. */
+static int
+sys_futex_wait (int *uaddr, int val, int timeout_ms)
+{
+  int64_t timeout = WAIT_FOREVER;
+  int result;
+
+  if ((uintptr_t) uaddr % sizeof *uaddr != 0)
+    return -1;
+  if (timeout_ms >= 0)
+    timeout = DIV_ROUND_UP ((int64_t) timeout_ms * TIMER_FREQ, 1000);
+
+  /* An aligned int lies within one page. */
+  pin_page (uaddr, false);
+  result = futex_wait (uaddr, val, timeout);
+  unpin_page (uaddr);
+  return result;
+}
+
+/* Futex_wake system call.  Wakes up to CNT threads waiting on
+   the int at UADDR.  Returns the number woken, or -1 if UADDR is
+   not aligned. */
+static int
+sys_futex_wake (int *uaddr, int cnt)
+{
+  if ((uintptr_t) uaddr % sizeof *uaddr != 0)
+    return -1;
+  return futex_wake (uaddr, cnt);
+}
+
+/* Fork system call.  The child returns to user mode through the
+   same interrupt frame as the parent, the one at the top of the
+   kernel stack, which the processor pushed on entry from user
+   mode. */
+static int
+sys_fork (void)
+{
+  struct thread *t = thread_current ();
+
+  return process_fork ((struct intr_frame *) kstack_top (t) - 1);
+}
+
+/* Reads a byte at user virtual address UADDR, which must be
+   below PHYS_BASE.  Returns the byte value if successful, -1 if
+   a page fault occurred.  page_fault() resumes a faulting access
+   at the address that this leaves in EAX, with -1 in EAX. */
+static inline int
+get_user (const uint8_t *uaddr)
+{
+  int result;
+  asm ("movl $1f, %0; movzbl %1, %0; 1:"
+       : "=&a" (result) : "m" (*uaddr));
+  return result;
+}
+
+/* Writes BYTE to user address UDST, which must be below
+   PHYS_BASE.  Returns true if successful, false if a page fault
+   occurred. */
+static inline bool
+put_user (uint8_t *udst, uint8_t byte)
+{
+  int error_code;
+  asm ("movl $1f, %0; movb %b2, %1; 1:"
+       : "=&a" (error_code), "=m" (*udst) : "q" (byte));
+  return error_code != -1;
+}
+
+/* Copies SIZE bytes from user address USRC to kernel address
+   DST.  Kills the process if any of USRC is not valid user
+   memory. */
+static void
+copy_in (void *dst_, const void *usrc_, size_t size)
+{
+  uint8_t *dst = dst_;
+  const uint8_t *usrc = usrc_;
+
+  for (; size > 0; size--, dst++, usrc++)
+    {
+      int byte;
+      if (!is_user_vaddr (usrc) || (byte = get_user (usrc)) < 0)
+        sys_exit (-1);
+      *dst = byte;
+    }
+}
+
+/* Copies SIZE bytes from kernel address SRC to user address
+   UDST.  Kills the process if any of UDST is not valid, writable
+   user memory. */
+static void
+copy_out (void *udst_, const void *src_, size_t size)
+{
+  uint8_t *udst = udst_;
+  const uint8_t *src = src_;
+
+  for (; size > 0; size--, udst++, src++)
+    if (!is_user_vaddr (udst) || !put_user (udst, *src))
+      sys_exit (-1);
+}
+
+/* Returns a copy of the null-terminated string at user address
+   US, in a page allocated with palloc_get_page().  Kills the
+   process if US is not valid user memory or its string does not
+   fit in a page. */
+static char *
+copy_in_string (const char *us)
+{
+  char *ks = palloc_get_page (0);
+  size_t length;
+
+  if (ks == NULL)
+    thread_exit ();
+  for (length = 0; length < PGSIZE; length++)
+    {
+      const uint8_t *p = (const uint8_t *) us + length;
+      int byte;
+
+      if (!is_user_vaddr (p) || (byte = get_user (p)) < 0)
+        {
+          palloc_free_page (ks);
+          sys_exit (-1);
+        }
+      ks[length] = byte;
+      if (byte == '\0')
+        return ks;
+    }
+  palloc_free_page (ks);
+  sys_exit (-1);
+}
+
+/* Makes the user page containing UADDR safe for the kernel to
+   access directly: checks that it is mapped, and writable if
+   WRITE is true, and with VM pins it.  Kills the process if the
+   page is not valid.  The first access pulls the page in or
+   grows the stack, as needed, through page_fault(). */
+static void
+pin_page (const void *uaddr, bool write)
+{
+  uint8_t *p = (uint8_t *) uaddr;
+  int byte;
+
+  if (!is_user_vaddr (p) || (byte = get_user (p)) < 0
+      || (write && !put_user (p, byte)))
+    sys_exit (-1);
+#ifdef VM
+  if (!page_pin (p, write))
+    sys_exit (-1);
+#endif
+}
+
+/* Releases a page made safe by pin_page(). */
+static void
+unpin_page (const void *uaddr UNUSED)
+{
+#ifdef VM
+  page_unpin (uaddr);
+#endif
+}
+
+/* Returns the current process's open file HANDLE, or a null
+   pointer if it has none or HANDLE is a pipe end. */
+static struct file *
+lookup_fd (int handle)
+{
+  struct thread *t = thread_current ();
+  size_t idx = (unsigned) handle - FD_MIN;
+
+  if (t->fd_map == NULL || idx >= bitmap_size (t->fd_map))
+    return NULL;
+  return t->fds[idx].file;
+}
+
+/* Returns the pipe whose read end, or write end if WRITE is
+   true, is the current process's handle HANDLE, or a null
+   pointer if HANDLE is not such a pipe end. */
+static struct pipe *
+lookup_pipe (int handle, bool write)
+{
+  struct thread *t = thread_current ();
+  size_t idx = (unsigned) handle - FD_MIN;
+
+  if (t->fd_map == NULL || idx >= bitmap_size (t->fd_map)
+      || t->fds[idx].write != write)
+    return NULL;
+  return t->fds[idx].pipe;
+}
+
+/* Gives FILE, or else end WRITE of PIPE, the current process's
+   lowest free file handle, growing its file table if it is full.
+   Returns the handle, or -1 if memory allocation fails. */
+static int
+alloc_fd (struct file *file, struct pipe *pipe, bool write)
+{
+  struct thread *t = thread_current ();
+  size_t idx = BITMAP_ERROR;
+
+  if (t->fd_map != NULL)
+    idx = bitmap_scan_and_flip (t->fd_map, 0, 1, false);
+  if (idx == BITMAP_ERROR)
+    {
+      /* Every handle is in use, so the new map starts with the
+         old one's handles all set. */
+      size_t old_cnt = t->fd_map != NULL ? bitmap_size (t->fd_map) : 0;
+      size_t new_cnt = old_cnt > 0 ? old_cnt * 2 : FD_INIT_CNT;
+      struct fd *fds;
+      struct bitmap *fd_map;
+
+      if (new_cnt > INT_MAX - FD_MIN)
+        return -1;
+      fd_map = bitmap_create (new_cnt);
+      if (fd_map == NULL)
+        return -1;
+      fds = realloc (t->fds, new_cnt * sizeof *fds);
+      if (fds == NULL)
+        {
+          bitmap_destroy (fd_map);
+          return -1;
+        }
+      memset (fds + old_cnt, 0, (new_cnt - old_cnt) * sizeof *fds);
+      bitmap_set_multiple (fd_map, 0, old_cnt + 1, true);
+      bitmap_destroy (t->fd_map);
+      t->fds = fds;
+      t->fd_map = fd_map;
+      idx = old_cnt;
+    }
+  t->fds[idx].file = file;
+  t->fds[idx].pipe = pipe;
+  t->fds[idx].write = write;
+  return idx + FD_MIN;
+}
+
+/* Frees the current process's file handle HANDLE, which must be
+   in use. */
+static void
+free_fd (int handle)
+{
+  struct thread *t = thread_current ();
+  size_t idx = handle - FD_MIN;
+
+  t->fds[idx].file = NULL;
+  t->fds[idx].pipe = NULL;
+  bitmap_reset (t->fd_map, idx);
 }
@@ -2,6 +2,9 @@
 #include <debug.h>
 #include <stddef.h>
 #include "userprog/gdt.h"
+#include "threads/flags.h"
+#include "threads/init.h"
+#include "threads/kstack.h"
 #include "threads/thread.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
@@ -47,7 +50,15 @@
    See [IA32-v3a] 6.2.1 "Task-State Segment (TSS)" for a
    description of the TSS.  See [IA32-v3a] 5.12.1 "Exception- or
    Interrupt-Handler Procedures" for a description of when and
-   how stack switching occurs during an interrupt. */
+   how stack switching occurs during an interrupt.
+
+   There is one more thing, which needs a second TSS: handling a
+   double fault caused by running out of kernel stack.  A fault
+   on the stack cannot push its own frame, which faults again,
+   and the double fault handler would need the same stack.  So
+   #DF goes through a task gate to a task of its own, described
+   by df_tss, with its own stack.  The switch saves the faulting
+   state in the kernel TSS, where double_fault() finds it. */
 struct tss
   {
     uint16_t back_link, :16;
@@ -75,6 +86,11 @@ struct tss
 /* Kernel TSS. */
 static struct tss *tss;
 
+/* Double fault task's TSS. */
+static struct tss *df_tss;
+
+static void double_fault (void) NO_RETURN;
+
 /* Initializes the kernel TSS. */
 void
 tss_init (void) 
@@ -86,6 +102,18 @@ tss_init (void)
   tss->ss0 = SEL_KDSEG;
   tss->bitmap = 0xdfff;
   tss_update ();
+
+  /* The double fault task starts afresh in double_fault() each
+     time, with interrupts off, on a stack page of its own. */
+  df_tss = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+  df_tss->cr3 = vtop (init_page_dir);
+  df_tss->eip = double_fault;
+  df_tss->eflags = FLAG_MBS;
+  df_tss->esp = (uint32_t) palloc_get_page (PAL_ASSERT) + PGSIZE;
+  df_tss->cs = SEL_KCSEG;
+  df_tss->ss = df_tss->ds = df_tss->es = SEL_KDSEG;
+  df_tss->fs = df_tss->gs = SEL_KDSEG;
+  df_tss->bitmap = 0xdfff;
 }
 
 /* Returns the kernel TSS. */
@@ -96,11 +124,37 @@ tss_get (void)
   return tss;
 }
 
+/* Returns the double fault task's TSS. */
+struct tss *
+tss_get_double_fault (void)
+{
+  ASSERT (df_tss != NULL);
+  return df_tss;
+}
+
 /* Sets the ring 0 stack pointer in the TSS to point to the end
    of the thread stack. */
 void
 tss_update (void) 
 {
   ASSERT (tss != NULL);
-  tss->esp0 = (uint8_t *) thread_current () + PGSIZE;
+  tss->esp0 = kstack_top (thread_current ());
+}
+
+/* Double fault task.  The x86 cannot resume after a double
+   fault, so this reports the faulting state, saved in the kernel
+   TSS by the task switch, and panics.  A fault whose address,
+   from CR2, is unmapped in the faulting thread's kernel stack
+   slot came from the stack overflowing into its guard pages. */
+static void
+double_fault (void)
+{
+  void *cr2;
+  void *esp = (void *) tss->esp;
+
+  asm ("movl %%cr2, %0" : "=r" (cr2));
+  if (kstack_is_guard (cr2) && kstack_thread (cr2) == kstack_thread (esp))
+    PANIC ("kernel stack overflow in thread at %p: eip=%p esp=%p",
+           kstack_thread (esp), (void *) tss->eip, esp);
+  PANIC ("double fault: eip=%p esp=%p cr2=%p", (void *) tss->eip, esp, cr2);
 }
@@ -0,0 +1,94 @@
+#include "userprog/vdso.h"
+#include <debug.h>
+#include <vdso.h>
+#include "userprog/pagedir.h"
+#include "devices/clock.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Time pages.  See lib/vdso.h for the layout, which user
+   programs share.
+
+   Each process has a page of its own, so that it can show the
+   process's own CPU usage.  Only the running process's page
+   needs to be current, so vdso_update() writes just that one, on
+   each timer tick and from process_activate(). */
+
+/* Maps a new time page into the current process at VDSO_ADDR.
+   Returns true if successful, false if memory is short or
+   something is already mapped there.  load() maps it before
+   anything else, so that later mappings that would overlap it
+   fail. */
+bool
+vdso_map (void)
+{
+  struct thread *t = thread_current ();
+  struct vdso *v;
+
+  ASSERT (t->pagedir != NULL);
+  ASSERT (t->vdso == NULL);
+
+  if (pagedir_get_page (t->pagedir, (void *) VDSO_ADDR) != NULL)
+    return false;
+  v = palloc_get_page (PAL_ZERO);
+  if (v == NULL)
+    return false;
+  if (!pagedir_set_page (t->pagedir, (void *) VDSO_ADDR, v, false))
+    {
+      palloc_free_page (v);
+      return false;
+    }
+  v->tick_freq = TIMER_FREQ;
+  v->cycles_per_sec = clock_hz ();
+
+  t->vdso = v;
+  vdso_update ();
+  return true;
+}
+
+/* Unmaps and frees the current process's time page, if it has
+   one.  Must be called before its page directory is destroyed. */
+void
+vdso_unmap (void)
+{
+  struct thread *t = thread_current ();
+  enum intr_level old_level;
+  struct vdso *v;
+
+  old_level = intr_disable ();
+  v = t->vdso;
+  t->vdso = NULL;
+  intr_set_level (old_level);
+
+  if (v != NULL)
+    {
+      pagedir_clear_page (t->pagedir, (void *) VDSO_ADDR);
+      palloc_free_page (v);
+    }
+}
+
+/* Brings the running process's time page, if any, up to date.
+   Called by the timer interrupt handler on every tick and by
+   process_activate() on every switch. */
+void
+vdso_update (void)
+{
+  struct thread *t = thread_current ();
+  enum intr_level old_level = intr_disable ();
+  struct vdso *v = t->vdso;
+
+  if (v != NULL)
+    {
+      v->seq++;
+      barrier ();
+      v->ticks = timer_ticks ();
+      v->user_ticks = t->acct.user_ticks;
+      v->kernel_ticks = t->acct.kernel_ticks;
+      barrier ();
+      v->seq++;
+    }
+  intr_set_level (old_level);
+}
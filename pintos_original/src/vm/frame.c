@@ -0,0 +1,483 @@
+#include "vm/frame.h"
+#include <debug.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/page.h"
+
+/* Frame table.
+
+   Every frame of the user pool that holds a process's page is on
+   a circular list, which a clock hand sweeps to pick a page to
+   evict when the user pool runs out.
+
+   Each frame has an age byte.  Every page.age_interval
+   milliseconds, frame_age() shifts each age right and sets its
+   top bit if any page in the frame was accessed since the last
+   pass, clearing the accessed bits, so that a smaller age means
+   a page used less, and less recently.  The same pass counts,
+   for each process, its pages in frames and how many of those
+   have a nonzero age: its working set, the pages it has used in
+   the last 8 passes.
+
+   Eviction takes the first frame the hand finds whose page is
+   outside the working set of an idle process, one with no pages
+   in its working set at all.  Failing that, after a full sweep,
+   it takes the youngest frame, and among frames of equal age
+   the one whose process has the most pages outside its working
+   set, so that processes that keep using their memory keep it.
+   A page accessed since the last pass counts as in use, as in a
+   plain clock.
+
+   A frame shared by more than one page, or pinned, is passed
+   over: evicting it would mean unmapping it from every process
+   that shares it.
+
+   One frame of zeros, the zero frame, is not on the clock at all.
+   frame_zero() maps it read-only for pages that would otherwise
+   get a frame of their own just to hold zeros; a page gets its
+   own frame only when it is first written.  The zero frame
+   counts as always shared, and it is never freed.
+
+   So that eviction seldom has to write a page to swap while a
+   process waits for it, each eviction wakes the page cleaner in
+   page.c, which looks at the cold frames just ahead of the hand,
+   the ones eviction will reach next.  frame_pick_dirty() picks
+   those whose pages would need writing, for the cleaner to write
+   to swap in a batch, and frame_reclaim() evicts those that need
+   no writing and frees them, to keep some of the user pool
+   free.
+
+   Frames holding read-only pages of executables are also in a
+   hash table keyed by inode and offset, so that processes
+   running the same program can find and share them instead of
+   reading their own copies.
+
+   The frame table does no locking of its own.  Its callers in
+   page.c serialize all paging with a lock. */
+
+/* Frames in use, in clock order. */
+static struct list frames;
+static size_t frame_cnt;
+
+/* Next frame for the clock hand to examine, or list_end(). */
+static struct list_elem *hand;
+
+/* Frames holding executable text, by text_elem. */
+static struct hash text_frames;
+
+/* The zero frame. */
+static struct frame zero_frame;
+
+/* Number of frame_age() passes so far. */
+static unsigned age_pass;
+
+static struct frame *new_frame (struct page *, void *kpage);
+static struct frame *frame_evict (void);
+static struct frame *pick_victim (void);
+static size_t outside_cnt (const struct thread *);
+static void clear_text (struct frame *);
+static hash_hash_func text_hash;
+static hash_less_func text_less;
+
+/* Initializes the frame table. */
+void
+frame_init (void)
+{
+  list_init (&frames);
+  frame_cnt = 0;
+  hand = list_end (&frames);
+  if (!hash_init (&text_frames, text_hash, text_less, NULL))
+    PANIC ("frame table creation failed");
+
+  zero_frame.kpage = palloc_get_page (PAL_USER | PAL_ZERO | PAL_ASSERT);
+  list_init (&zero_frame.pages);
+  zero_frame.pin_cnt = 0;
+  zero_frame.age = 0;
+  zero_frame.inode = NULL;
+}
+
+/* Obtains a frame of user memory for PAGE, evicting another
+   page if the user pool is exhausted, and zeroes it if ZERO is
+   true.  Returns the frame, or a null pointer if no frame could
+   be had. */
+struct frame *
+frame_alloc (struct page *page, bool zero)
+{
+  struct frame *f;
+  void *kpage;
+
+  kpage = palloc_get_page (PAL_USER | (zero ? PAL_ZERO : 0));
+  if (kpage == NULL)
+    {
+      /* Take over a victim's frame, in place on the clock. */
+      f = frame_evict ();
+      if (f != NULL)
+        {
+          clear_text (f);
+          if (zero)
+            memset (f->kpage, 0, PGSIZE);
+          list_init (&f->pages);
+          list_push_back (&f->pages, &page->frame_elem);
+          f->age = 0x80;
+        }
+      return f;
+    }
+  return new_frame (page, kpage);
+}
+
+/* Obtains a free frame of user memory for PAGE, without evicting
+   anything, for a page read ahead of need.  Its age is 0, so the
+   clock takes it early unless PAGE is accessed.  Returns the
+   frame, or a null pointer if the user pool is exhausted. */
+struct frame *
+frame_try_alloc (struct page *page)
+{
+  void *kpage = palloc_get_page (PAL_USER);
+  struct frame *f;
+
+  if (kpage == NULL)
+    return NULL;
+  f = new_frame (page, kpage);
+  if (f != NULL)
+    f->age = 0;
+  return f;
+}
+
+/* Frees frame F and its memory.  F's pages must already have
+   been released or unmapped. */
+void
+frame_free (struct frame *f)
+{
+  if (hand == &f->elem)
+    hand = list_next (hand);
+  list_remove (&f->elem);
+  frame_cnt--;
+  clear_text (f);
+  palloc_free_page (f->kpage);
+  free (f);
+}
+
+/* Adds PAGE to the pages sharing the zero frame and returns the
+   zero frame.  PAGE must map it read-only. */
+struct frame *
+frame_zero (struct page *page)
+{
+  frame_share (&zero_frame, page);
+  return &zero_frame;
+}
+
+/* Returns true if F is the zero frame. */
+bool
+frame_is_zero (const struct frame *f)
+{
+  return f == &zero_frame;
+}
+
+/* Adds PAGE to the pages sharing frame F. */
+void
+frame_share (struct frame *f, struct page *page)
+{
+  list_push_back (&f->pages, &page->frame_elem);
+}
+
+/* Removes PAGE from the pages sharing frame F, and frees F if
+   that was the last, unless F is the zero frame. */
+void
+frame_release (struct frame *f, struct page *page)
+{
+  list_remove (&page->frame_elem);
+  if (list_empty (&f->pages) && f != &zero_frame)
+    frame_free (f);
+}
+
+/* Returns true if more than one page shares frame F, or if F is
+   the zero frame. */
+bool
+frame_is_shared (const struct frame *f)
+{
+  return (f == &zero_frame
+          || (list_begin ((struct list *) &f->pages)
+              != list_rbegin ((struct list *) &f->pages)));
+}
+
+/* Returns the frame holding the READ_BYTES bytes at offset OFS
+   in INODE, followed by zeroes, as executable text, or a null
+   pointer if there is none. */
+struct frame *
+frame_find_text (struct inode *inode, off_t ofs, size_t read_bytes)
+{
+  struct frame key;
+  struct hash_elem *e;
+
+  key.inode = inode;
+  key.ofs = ofs;
+  key.read_bytes = read_bytes;
+  e = hash_find (&text_frames, &key.text_elem);
+  return e != NULL ? hash_entry (e, struct frame, text_elem) : NULL;
+}
+
+/* Records that frame F holds the READ_BYTES bytes at offset OFS
+   in INODE, followed by zeroes, as read-only executable text,
+   for frame_find_text().  F stays recorded until it is freed or
+   reused. */
+void
+frame_set_text (struct frame *f, struct inode *inode, off_t ofs,
+                size_t read_bytes)
+{
+  ASSERT (f->inode == NULL);
+
+  f->inode = inode;
+  f->ofs = ofs;
+  f->read_bytes = read_bytes;
+  if (hash_insert (&text_frames, &f->text_elem) != NULL)
+    f->inode = NULL;
+}
+
+/* Makes a frame for PAGE out of free user page KPAGE and puts it
+   on the clock.  Returns the frame, or a null pointer, freeing
+   KPAGE, if memory is short. */
+static struct frame *
+new_frame (struct page *page, void *kpage)
+{
+  struct frame *f = malloc (sizeof *f);
+  if (f == NULL)
+    {
+      palloc_free_page (kpage);
+      return NULL;
+    }
+  f->kpage = kpage;
+  list_init (&f->pages);
+  list_push_back (&f->pages, &page->frame_elem);
+  f->pin_cnt = 0;
+  f->age = 0x80;
+  f->inode = NULL;
+
+  /* Put it just behind the hand, so that it is examined last. */
+  list_insert (hand, &f->elem);
+  frame_cnt++;
+  return f;
+}
+
+/* Ages every frame by one pass and recounts each process's
+   pages in frames and its working set, as described at the top
+   of this file. */
+void
+frame_age (void)
+{
+  struct list_elem *e;
+
+  age_pass++;
+  for (e = list_begin (&frames); e != list_end (&frames); e = list_next (e))
+    {
+      struct frame *f = list_entry (e, struct frame, elem);
+      struct list_elem *pe;
+      bool accessed = false;
+
+      for (pe = list_begin (&f->pages); pe != list_end (&f->pages);
+           pe = list_next (pe))
+        if (page_accessed (list_entry (pe, struct page, frame_elem)))
+          accessed = true;
+      f->age = (f->age >> 1) | (accessed ? 0x80 : 0);
+
+      for (pe = list_begin (&f->pages); pe != list_end (&f->pages);
+           pe = list_next (pe))
+        {
+          struct thread *t = list_entry (pe, struct page, frame_elem)->thread;
+          if (t->age_pass != age_pass)
+            {
+              t->age_pass = age_pass;
+              t->resident_cnt = t->ws_cnt = 0;
+            }
+          t->resident_cnt++;
+          if (f->age != 0)
+            t->ws_cnt++;
+        }
+    }
+}
+
+/* Picks a victim with pick_victim() and evicts it, trying
+   another if its page can't be evicted for want of swap.
+   Returns the frame, or a null pointer if none can be
+   evicted. */
+static struct frame *
+frame_evict (void)
+{
+  size_t i;
+
+  for (i = 0; i < frame_cnt; i++)
+    {
+      struct frame *f = pick_victim ();
+      if (f == NULL)
+        break;
+      if (page_evict (list_entry (list_front (&f->pages),
+                                  struct page, frame_elem)))
+        {
+          page_wake_cleaner ();
+          return f;
+        }
+
+      /* Try every other frame before this one again. */
+      f->age = UINT8_MAX;
+    }
+  return NULL;
+}
+
+/* Runs the clock hand over the frames that may be evicted and
+   returns the one to evict, as described at the top of this
+   file, leaving the hand just past it.  Returns a null pointer
+   if every frame is pinned or shared. */
+static struct frame *
+pick_victim (void)
+{
+  struct frame *best = NULL;
+  size_t best_outside = 0;
+  size_t i;
+
+  for (i = 0; i < frame_cnt; i++)
+    {
+      struct frame *f;
+      struct page *page;
+      size_t outside;
+
+      if (hand == list_end (&frames))
+        hand = list_begin (&frames);
+      f = list_entry (hand, struct frame, elem);
+      hand = list_next (hand);
+      if (f->pin_cnt > 0 || frame_is_shared (f))
+        continue;
+
+      page = list_entry (list_front (&f->pages), struct page, frame_elem);
+      if (page_accessed (page))
+        f->age |= 0x80;
+      outside = outside_cnt (page->thread);
+      if (f->age == 0 && outside > 0 && page->thread->ws_cnt == 0)
+        return f;
+      if (best == NULL || f->age < best->age
+          || (f->age == best->age && outside > best_outside))
+        {
+          best = f;
+          best_outside = outside;
+        }
+    }
+
+  if (best != NULL)
+    hand = list_next (&best->elem);
+  return best;
+}
+
+/* Fills FRAMES with up to CNT cold frames ahead of the clock
+   hand whose pages would have to be written to swap to be
+   evicted, pinning each one.  Stops early once TARGET frames
+   ahead of the hand, counting those picked, could be evicted
+   without writing.  Returns the number of frames picked. */
+size_t
+frame_pick_dirty (struct frame **picked, size_t cnt, size_t target)
+{
+  struct list_elem *e = hand;
+  size_t clean_cnt = 0;
+  size_t n = 0;
+  size_t i;
+
+  for (i = 0; i < frame_cnt && n < cnt && clean_cnt + n < target; i++)
+    {
+      struct frame *f;
+      struct page *page;
+
+      if (e == list_end (&frames))
+        e = list_begin (&frames);
+      f = list_entry (e, struct frame, elem);
+      e = list_next (e);
+      if (f->pin_cnt > 0 || frame_is_shared (f))
+        continue;
+
+      page = list_entry (list_front (&f->pages), struct page, frame_elem);
+      if (page_accessed (page))
+        f->age |= 0x80;
+      if (f->age != 0)
+        continue;
+      if (page_is_clean (page))
+        clean_cnt++;
+      else if (!page->mapped)
+        {
+          f->pin_cnt++;
+          picked[n++] = f;
+        }
+    }
+  return n;
+}
+
+/* Evicts cold frames ahead of the clock hand whose pages need no
+   writing to be evicted, and frees them, until the user pool has
+   TARGET free pages or the hand has gone all the way around. */
+void
+frame_reclaim (size_t target)
+{
+  size_t i, cnt;
+
+  for (i = 0, cnt = frame_cnt;
+       i < cnt && palloc_free_count (PAL_USER) < target; i++)
+    {
+      struct frame *f;
+      struct page *page;
+
+      if (hand == list_end (&frames))
+        hand = list_begin (&frames);
+      f = list_entry (hand, struct frame, elem);
+      hand = list_next (hand);
+      if (f->pin_cnt > 0 || frame_is_shared (f))
+        continue;
+
+      page = list_entry (list_front (&f->pages), struct page, frame_elem);
+      if (page_accessed (page))
+        f->age |= 0x80;
+      if (f->age == 0 && page_is_clean (page) && page_evict (page))
+        frame_free (f);
+    }
+}
+
+/* Returns the number of T's pages in frames that are outside its
+   working set, as of the last frame_age() pass. */
+static size_t
+outside_cnt (const struct thread *t)
+{
+  return t->age_pass == age_pass ? t->resident_cnt - t->ws_cnt : 0;
+}
+
+/* Removes frame F from the text index, if it is there. */
+static void
+clear_text (struct frame *f)
+{
+  if (f->inode != NULL)
+    {
+      hash_delete (&text_frames, &f->text_elem);
+      f->inode = NULL;
+    }
+}
+
+/* Returns a hash value for the text frame that E is embedded
+   in. */
+static unsigned
+text_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct frame *f = hash_entry (e, struct frame, text_elem);
+  return hash_bytes (&f->inode, sizeof f->inode) ^ hash_int (f->ofs);
+}
+
+/* Returns true if text frame A precedes text frame B. */
+static bool
+text_less (const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED)
+{
+  const struct frame *a = hash_entry (a_, struct frame, text_elem);
+  const struct frame *b = hash_entry (b_, struct frame, text_elem);
+
+  if (a->inode != b->inode)
+    return a->inode < b->inode;
+  else if (a->ofs != b->ofs)
+    return a->ofs < b->ofs;
+  else
+    return a->read_bytes < b->read_bytes;
+}
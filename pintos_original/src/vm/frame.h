@@ -0,0 +1,49 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "filesys/off_t.h"
+
+struct inode;
+struct page;
+
+/* A frame of user memory holding a page.  Processes that share
+   a page copy-on-write, after fork, share its frame. */
+struct frame
+  {
+    void *kpage;                /* Kernel virtual address. */
+    struct list pages;          /* Pages held, by frame_elem. */
+    unsigned pin_cnt;           /* Pins; evicted only if 0. */
+    uint8_t age;                /* Use in recent aging passes, newest
+                                   in the top bit. */
+
+    /* Executable text, shared by (INODE, OFS). */
+    struct inode *inode;        /* Inode read from, or null. */
+    off_t ofs;                  /* Offset of the page in INODE. */
+    size_t read_bytes;          /* Bytes read; the rest are zero. */
+    struct hash_elem text_elem; /* Element in the text index. */
+
+    struct list_elem elem;      /* Element in the clock list. */
+  };
+
+void frame_init (void);
+struct frame *frame_alloc (struct page *, bool zero);
+struct frame *frame_try_alloc (struct page *);
+struct frame *frame_zero (struct page *);
+bool frame_is_zero (const struct frame *);
+void frame_free (struct frame *);
+void frame_age (void);
+size_t frame_pick_dirty (struct frame **, size_t cnt, size_t target);
+void frame_reclaim (size_t target);
+void frame_share (struct frame *, struct page *);
+void frame_release (struct frame *, struct page *);
+bool frame_is_shared (const struct frame *);
+struct frame *frame_find_text (struct inode *, off_t ofs, size_t read_bytes);
+void frame_set_text (struct frame *, struct inode *, off_t ofs,
+                     size_t read_bytes);
+
+#endif /* vm/frame.h */
@@ -0,0 +1,157 @@
+#include "vm/mmap.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/page.h"
+
+/* Memory-mapped files.
+
+   A mapping makes a file's contents appear in consecutive pages
+   of a process's address space.  Nothing is read when the
+   mapping is made: each page goes into the supplemental page
+   table as a "mapped" page, which the page fault handler reads
+   from the file on first touch.  Pages the process changes are
+   written back to the file when they are evicted or when the
+   mapping goes away, by munmap or at process exit, so reading a
+   large file this way takes no copy through a user buffer and
+   writing back costs only the pages actually changed.
+
+   Each mapping has its own file_reopen()'d file, so that it
+   survives the process closing the file descriptor it was made
+   from. */
+
+/* A memory-mapped file. */
+struct mapping
+  {
+    mapid_t id;                 /* Mapping identifier. */
+    struct file *file;          /* File mapped. */
+    uint8_t *addr;              /* First page of the mapping. */
+    size_t page_cnt;            /* Number of pages mapped. */
+    struct list_elem elem;      /* Element in thread's mappings. */
+  };
+
+static struct mapping *find_mapping (mapid_t);
+static void unmap (struct mapping *, size_t page_cnt);
+
+/* Maps FILE into the current process's address space at ADDR,
+   which must be page-aligned, with as many consecutive pages as
+   it takes to hold the whole file.  The final page's bytes past
+   the end of the file are zero and never written back.
+   Returns the new mapping's identifier, or MAP_FAILED if ADDR is
+   not page-aligned or is null, if FILE is empty, if any of the
+   pages is already in use, or if memory allocation fails. */
+mapid_t
+mmap_map (struct file *file, void *addr)
+{
+  struct thread *t = thread_current ();
+  struct mapping *m;
+  off_t length;
+  size_t i;
+
+  if (addr == NULL || pg_ofs (addr) != 0 || t->pages == NULL)
+    return MAP_FAILED;
+  length = file_length (file);
+  if (length <= 0
+      || (size_t) length > (size_t) ((uint8_t *) PHYS_BASE
+                                     - (uint8_t *) addr))
+    return MAP_FAILED;
+
+  m = malloc (sizeof *m);
+  if (m == NULL)
+    return MAP_FAILED;
+  m->file = file_reopen (file);
+  if (m->file == NULL)
+    {
+      free (m);
+      return MAP_FAILED;
+    }
+  m->addr = addr;
+  m->page_cnt = DIV_ROUND_UP (length, PGSIZE);
+
+  for (i = 0; i < m->page_cnt; i++)
+    {
+      off_t ofs = i * PGSIZE;
+      size_t read_bytes = length - ofs < PGSIZE ? length - ofs : PGSIZE;
+
+      if (!page_add_mapped (m->addr + ofs, m->file, ofs, read_bytes))
+        {
+          unmap (m, i);
+          return MAP_FAILED;
+        }
+    }
+
+  m->id = t->next_mapid++;
+  list_push_back (&t->mappings, &m->elem);
+  return m->id;
+}
+
+/* Removes the current process's mapping MAPID, writing its
+   changed pages back to the file.  Returns true if successful,
+   false if the process has no mapping MAPID. */
+bool
+mmap_unmap (mapid_t mapid)
+{
+  struct mapping *m = find_mapping (mapid);
+
+  if (m == NULL)
+    return false;
+  list_remove (&m->elem);
+  unmap (m, m->page_cnt);
+  return true;
+}
+
+/* Removes all of the current process's mappings, writing their
+   changed pages back.  Must be called before its page table is
+   destroyed. */
+void
+mmap_unmap_all (void)
+{
+  struct thread *t = thread_current ();
+
+  if (t->pages == NULL)
+    return;
+  while (!list_empty (&t->mappings))
+    {
+      struct list_elem *e = list_pop_front (&t->mappings);
+      struct mapping *m = list_entry (e, struct mapping, elem);
+      unmap (m, m->page_cnt);
+    }
+}
+
+/* Returns the current process's mapping MAPID, or a null pointer
+   if it has none. */
+static struct mapping *
+find_mapping (mapid_t mapid)
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+
+  if (t->pages == NULL)
+    return NULL;
+  for (e = list_begin (&t->mappings); e != list_end (&t->mappings);
+       e = list_next (e))
+    {
+      struct mapping *m = list_entry (e, struct mapping, elem);
+      if (m->id == mapid)
+        return m;
+    }
+  return NULL;
+}
+
+/* Removes the first PAGE_CNT pages of mapping M from the page
+   table, writing back those changed, then closes its file and
+   frees M.  M must not be on the mappings list. */
+static void
+unmap (struct mapping *m, size_t page_cnt)
+{
+  size_t i;
+
+  for (i = 0; i < page_cnt; i++)
+    page_remove (m->addr + i * PGSIZE);
+  file_close (m->file);
+  free (m);
+}
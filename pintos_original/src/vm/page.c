@@ -0,0 +1,1045 @@
+#include "vm/page.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/file.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/tunable.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/frame.h"
+#include "vm/swap.h"
+
+/* Supplemental page table.
+
+   Each process has a hash table, keyed by user virtual page, of
+   the pages it may use but that need not be in memory yet.
+   load() records each page of the executable's segments here
+   instead of reading it in.  The first time the process touches
+   such a page, the page fault handler calls page_load(), which
+   reads the page's bytes from the executable, zeroes the rest,
+   and maps it in a frame from the frame table.
+
+   When the user pool runs out, the frame table's clock picks a
+   victim, guided by the ages that a kernel thread updates
+   periodically with frame_age(), and page_evict() unmaps it.  If
+   the process has written to it, in the page's lifetime, its
+   contents go to swap and come back from there on the next
+   fault; otherwise they are read from the file or zeroed again.
+   A page goes to the slot at its offset in the swap cluster
+   already holding another page from its aligned run of
+   SWAP_CLUSTER virtual pages, if it is free, and a fault on a
+   page in swap reads in, in the same request, the neighbors that
+   are in the slots around it, for as many as free frames allow.
+
+   Each eviction also wakes the page cleaner, a kernel thread
+   that writes dirty pages the clock will reach soon to swap,
+   CLEAN_BATCH pages to a request, while they stay mapped.  Such
+   a page keeps its copy's slot in swap_slot, and if the process
+   does not write it again, evicting it later needs no I/O.  The
+   cleaner copies the pages into a buffer of its own and clears
+   their dirty bits under vm_lock, then writes them without the
+   lock, so faults proceed meanwhile; their frames stay pinned,
+   and a page freed meanwhile is left for the cleaner to free.
+   The cleaner then frees frames it need not write, until
+   page.clean_target user pages are free.
+
+   Pages of memory-mapped files (see mmap.c) are "mapped": they
+   are always written back to their file, never to swap, and only
+   if the process has written them since they were loaded.
+
+   A process made by process_fork() starts with a copy of its
+   parent's page table.  Pages already in memory are not copied:
+   parent and child share the frame, mapped read-only in both.
+   Writing to such a "cow" page faults, and page_copy_on_write()
+   then gives the writer a private copy, or, if no other process
+   still shares the frame, just maps it writable again.  A shared
+   frame is never evicted.  Read-only pages stay shared until
+   their processes exit.
+
+   A page that would be all zeros when loaded, and that is loaded
+   for reading, maps the frame table's zero frame, as a cow page
+   if it is writable, so that it takes a frame of its own only
+   once it is written.
+
+   Read-only pages of executables are shared more widely: the
+   frame table indexes frames holding them by inode and offset,
+   so every process running the same program maps the same
+   frame for each text page, whether or not one forked another.
+
+   vm_lock serializes all of this, which also keeps a page from
+   being evicted while it is loaded or freed.
+
+   Each process counts its faults by the work they took: "minor"
+   ones mapped a zero page or a shared text frame, "major" ones
+   read the page from its file or from swap, and "cow" ones made
+   a copy-on-write page private.  With "-o page.fault_stats=1"
+   the counts are printed when the process exits. */
+
+/* Serializes paging. */
+static struct lock vm_lock;
+
+/* Most pages a user stack may grow to.  Set by the kernel
+   command line option "-sl". */
+size_t page_stack_limit = 2048;
+TUNABLE_UINT ("page.stack_limit", page_stack_limit,
+              1, (uintptr_t) PHYS_BASE / PGSIZE / 2,
+              "Most pages a user stack may grow to.");
+
+/* Milliseconds between frame_age() passes. */
+static unsigned page_age_interval = 100;
+TUNABLE_UINT ("page.age_interval", page_age_interval, 1, 60000,
+              "Milliseconds between passes aging user frames.");
+
+/* Pages the page cleaner writes to swap in one request. */
+#define CLEAN_BATCH 8
+
+/* User pages the page cleaner keeps free or ready to evict with
+   no I/O.  0 turns the cleaner off. */
+static unsigned page_clean_target = 16;
+TUNABLE_UINT ("page.clean_target", page_clean_target, 0, 1024,
+              "User pages the page cleaner keeps ready to reuse.");
+
+/* Page cleaner's wakeups and work. */
+static struct semaphore clean_sema; /* Upped to wake the cleaner. */
+static bool clean_pending;          /* CLEAN_SEMA upped, not yet downed. */
+static struct palloc_notifier clean_notifier;
+static unsigned clean_cnt;          /* Pages written. */
+static unsigned clean_write_cnt;    /* Requests written. */
+static unsigned reclaim_cnt;        /* Frames freed. */
+static unsigned read_ahead_cnt;     /* Pages read from swap ahead of
+                                       need. */
+static unsigned zero_map_cnt;       /* Pages mapped to the zero frame. */
+
+/* Map the zero frame for pages of zeros that are only read? */
+static bool page_zero_frame = true;
+TUNABLE_BOOL ("page.zero_frame", page_zero_frame,
+              "Share one frame of zeros among pages not yet written.");
+
+/* Print each process's fault counts when it exits? */
+static bool page_fault_stats = false;
+TUNABLE_BOOL ("page.fault_stats", page_fault_stats,
+              "Print each process's page faults at exit.");
+
+static hash_hash_func page_hash;
+static hash_less_func page_less;
+static hash_action_func page_free;
+static struct page *page_lookup (struct hash *, const void *upage);
+static bool insert_page (void *upage, struct file *, off_t ofs,
+                         size_t read_bytes, bool writable, bool mapped);
+static void write_back (struct page *);
+static bool load_page (struct page *, bool write);
+static bool copy_page (struct page *);
+static void save_dirty (struct page *);
+static bool clean_batch (uint8_t *);
+static void sort_pages (struct page **, size_t cnt);
+static size_t cluster_slot (struct page *);
+static void swap_in_cluster (struct page *, void *kpage);
+static struct frame *read_ahead_frame (struct page *, uint8_t *base,
+                                       size_t first, size_t k);
+static palloc_notify_func user_pool_low;
+static thread_func age_thread;
+static thread_func clean_thread;
+
+/* Initializes the paging lock and starts the threads that age
+   frames and clean pages. */
+void
+page_init (void)
+{
+  lock_init (&vm_lock);
+  sema_init (&clean_sema, 0);
+  thread_create ("page_age", PRI_MIN, age_thread, NULL);
+  if (page_clean_target > 0)
+    {
+      thread_create ("page_clean", PRI_DEFAULT, clean_thread, NULL);
+      palloc_register_notifier (&clean_notifier, user_pool_low, NULL);
+    }
+}
+
+/* Creates and returns an empty page table, or a null pointer if
+   memory allocation fails. */
+struct hash *
+page_table_create (void)
+{
+  struct hash *pages = malloc (sizeof *pages);
+  if (pages != NULL && !hash_init (pages, page_hash, page_less, NULL))
+    {
+      free (pages);
+      pages = NULL;
+    }
+  return pages;
+}
+
+/* Destroys page table PAGES, which may be a null pointer,
+   freeing the frames and swap slots of its pages.  Must be called
+   before the pages' page directory is destroyed. */
+void
+page_table_destroy (struct hash *pages)
+{
+  if (pages != NULL)
+    {
+      lock_acquire (&vm_lock);
+      hash_destroy (pages, page_free);
+      lock_release (&vm_lock);
+      free (pages);
+    }
+}
+
+/* Prints the current process's page fault counts, if
+   "-o page.fault_stats=1" asked for them. */
+void
+page_print_faults (void)
+{
+  struct thread *t = thread_current ();
+
+  if (page_fault_stats)
+    printf ("%s: page faults: %u minor, %u major, %u cow\n",
+            t->name, t->minor_faults, t->major_faults, t->cow_faults);
+}
+
+/* Adds user virtual page UPAGE to the current process's page
+   table, to be loaded on first use by reading READ_BYTES bytes
+   from FILE starting at offset OFS and zeroing the rest of the
+   page.  FILE is null if READ_BYTES is 0.  The page must be
+   writable by the process if WRITABLE is true, read-only
+   otherwise.
+   Returns true if successful, false if UPAGE is already in use
+   or if memory allocation fails. */
+bool
+page_add (void *upage, struct file *file, off_t ofs, size_t read_bytes,
+          bool writable)
+{
+  return insert_page (upage, file, ofs, read_bytes, writable, false);
+}
+
+/* Adds user virtual page UPAGE to the current process's page
+   table as a writable page of a memory-mapped FILE, like
+   page_add(), except that the page's READ_BYTES bytes at offset
+   OFS are written back to FILE, if changed, when the page is
+   evicted or removed.
+   Returns true if successful, false if UPAGE is already in use
+   or if memory allocation fails. */
+bool
+page_add_mapped (void *upage, struct file *file, off_t ofs,
+                 size_t read_bytes)
+{
+  ASSERT (file != NULL);
+
+  return insert_page (upage, file, ofs, read_bytes, true, true);
+}
+
+/* Removes user virtual page UPAGE from the current process's
+   page table, writing it back to its file first if it is mapped
+   and has been changed.  Does nothing if UPAGE is not in the
+   page table. */
+void
+page_remove (void *upage)
+{
+  struct thread *t = thread_current ();
+  struct page *p;
+
+  lock_acquire (&vm_lock);
+  p = page_lookup (t->pages, upage);
+  if (p != NULL)
+    {
+      hash_delete (t->pages, &p->elem);
+      page_free (&p->elem, NULL);
+    }
+  lock_release (&vm_lock);
+}
+
+/* Brings in the page of the current process that contains
+   FAULT_ADDR, if it is in the page table and not yet loaded, for
+   writing if WRITE is true, otherwise for reading.
+   Returns true if successful, false if FAULT_ADDR is not in such
+   a page or if memory allocation or the file read fails. */
+bool
+page_load (const void *fault_addr, bool write)
+{
+  struct thread *t = thread_current ();
+  struct page *p;
+  bool success = false;
+
+  if (t->pages == NULL || !is_user_vaddr (fault_addr))
+    return false;
+
+  lock_acquire (&vm_lock);
+  p = page_lookup (t->pages, pg_round_down (fault_addr));
+  if (p != NULL && p->frame == NULL)
+    success = load_page (p, write);
+  lock_release (&vm_lock);
+  return success;
+}
+
+/* Grows the current process's stack down to the page containing
+   FAULT_ADDR, if the fault looks like a stack access given user
+   stack pointer ESP, and the stack would stay within
+   page_stack_limit pages.  Only that one page is added; pages
+   between it and the rest of the stack come in when touched.
+   Returns true if successful, false if FAULT_ADDR is not a stack
+   access or memory is short. */
+bool
+page_grow_stack (const void *fault_addr, const void *esp)
+{
+  const uint8_t *addr = fault_addr;
+  void *upage = pg_round_down (fault_addr);
+
+  /* PUSH and PUSHA check access rights, and so fault, before
+     they move the stack pointer, by up to 32 bytes below it. */
+  if (esp == NULL || addr + 32 < (const uint8_t *) esp)
+    return false;
+  if (!is_user_vaddr (addr)
+      || (size_t) ((uint8_t *) PHYS_BASE - (uint8_t *) upage)
+         > page_stack_limit * PGSIZE)
+    return false;
+
+  return page_add (upage, NULL, 0, 0, true) && page_load (upage, true);
+}
+
+/* Gives the current process a writable page of its own for the
+   copy-on-write page containing FAULT_ADDR, copying the frame
+   it shares.  Returns true if successful, false if FAULT_ADDR is
+   not in such a page or if no frame is available. */
+bool
+page_copy_on_write (const void *fault_addr)
+{
+  struct thread *t = thread_current ();
+  struct page *p;
+  bool success = false;
+
+  if (t->pages == NULL || !is_user_vaddr (fault_addr))
+    return false;
+
+  lock_acquire (&vm_lock);
+  p = page_lookup (t->pages, pg_round_down (fault_addr));
+  if (p != NULL && p->cow && p->frame != NULL)
+    success = copy_page (p);
+  lock_release (&vm_lock);
+  return success;
+}
+
+/* Pins the current process's page containing UADDR in memory,
+   loading it if necessary, so that the kernel can access it
+   directly without faulting, for example while holding locks
+   that the page fault handler would need.  If WRITE is true, the
+   page must be writable, and it is first made private if it is
+   copy-on-write.  Returns true if successful, false if UADDR is
+   not in such a page or memory is short.  Each successful call
+   must be balanced by page_unpin(). */
+bool
+page_pin (const void *uaddr, bool write)
+{
+  struct thread *t = thread_current ();
+  struct page *p;
+  bool success = false;
+
+  if (t->pages == NULL || !is_user_vaddr (uaddr))
+    return false;
+
+  lock_acquire (&vm_lock);
+  p = page_lookup (t->pages, pg_round_down (uaddr));
+  if (p == NULL || (write && !p->writable))
+    goto done;
+  if (p->frame == NULL && !load_page (p, write))
+    goto done;
+  if (write && p->cow && !copy_page (p))
+    goto done;
+  p->frame->pin_cnt++;
+  success = true;
+
+ done:
+  lock_release (&vm_lock);
+  return success;
+}
+
+/* Unpins the current process's page containing UADDR, pinned by
+   page_pin(). */
+void
+page_unpin (const void *uaddr)
+{
+  struct thread *t = thread_current ();
+  struct page *p;
+
+  lock_acquire (&vm_lock);
+  p = page_lookup (t->pages, pg_round_down (uaddr));
+  ASSERT (p != NULL && p->frame != NULL && p->frame->pin_cnt > 0);
+  p->frame->pin_cnt--;
+  lock_release (&vm_lock);
+}
+
+/* Fills the current process's page table with a copy of
+   PARENT's, for process_fork().  The current process's page
+   directory, page table, and exec_file must already exist, and
+   PARENT must not run meanwhile.  Loaded pages are shared with
+   PARENT: read-only ones as they are, writable ones
+   copy-on-write.  Pages in swap are brought in first, so that
+   each slot has a single owner.  Memory-mapped pages are not
+   copied.
+   Returns true if successful, false if memory allocation fails,
+   in which case the caller must destroy the partial copy. */
+bool
+page_table_copy (struct thread *parent)
+{
+  struct thread *t = thread_current ();
+  struct hash_iterator i;
+  bool success = true;
+
+  lock_acquire (&vm_lock);
+  hash_first (&i, parent->pages);
+  while (success && hash_next (&i))
+    {
+      struct page *p = hash_entry (hash_cur (&i), struct page, elem);
+      struct page *c;
+
+      if (p->mapped)
+        continue;
+      ASSERT (p->file == NULL || p->file == parent->exec_file);
+
+      /* Bring it back from swap. */
+      if (p->frame == NULL && p->swap_slot != SWAP_NONE)
+        {
+          struct frame *f = frame_alloc (p, false);
+          if (f == NULL)
+            {
+              success = false;
+              break;
+            }
+          swap_in (p->swap_slot, f->kpage);
+          p->swap_slot = SWAP_NONE;
+          pagedir_set_page (p->pagedir, p->upage, f->kpage, p->writable);
+          p->frame = f;
+          p->cow = false;
+        }
+
+      c = malloc (sizeof *c);
+      if (c == NULL)
+        {
+          success = false;
+          break;
+        }
+      *c = *p;
+      c->file = p->file != NULL ? t->exec_file : NULL;
+      c->thread = t;
+      c->pagedir = t->pagedir;
+      c->frame = NULL;
+      c->swap_slot = SWAP_NONE;
+      c->cow = false;
+      c->cleaning = false;
+
+      if (p->frame != NULL)
+        {
+          /* Write-protect the parent's mapping, noting first
+             whether it was written. */
+          if (p->writable && !p->cow)
+            {
+              save_dirty (p);
+              pagedir_clear_page (p->pagedir, p->upage);
+              pagedir_set_page (p->pagedir, p->upage, p->frame->kpage,
+                                false);
+              p->cow = true;
+            }
+          c->dirty = p->dirty;
+          if (!pagedir_set_page (c->pagedir, c->upage, p->frame->kpage,
+                                 false))
+            {
+              free (c);
+              success = false;
+              break;
+            }
+          c->frame = p->frame;
+          c->cow = p->cow;
+          frame_share (p->frame, c);
+        }
+      hash_insert (t->pages, &c->elem);
+    }
+  lock_release (&vm_lock);
+  return success;
+}
+
+/* Returns true if page P, which must be loaded, has been
+   accessed since the last call, clearing its accessed bit.
+   Called by the frame table's clock, with vm_lock held. */
+bool
+page_accessed (struct page *p)
+{
+  ASSERT (p->frame != NULL);
+
+  if (!pagedir_is_accessed (p->pagedir, p->upage))
+    return false;
+  pagedir_set_accessed (p->pagedir, p->upage, false);
+  return true;
+}
+
+/* Returns true if page P, which must be loaded, could be evicted
+   without writing it anywhere.  Called by the frame table, with
+   vm_lock held. */
+bool
+page_is_clean (struct page *p)
+{
+  ASSERT (p->frame != NULL);
+
+  return (!pagedir_is_dirty (p->pagedir, p->upage)
+          && (p->mapped || !p->dirty || p->swap_slot != SWAP_NONE));
+}
+
+/* Evicts page P from its frame, writing it to swap first if it
+   has been written and the page cleaner has no good copy of it,
+   or back to its file if it is mapped.  Returns false, leaving P
+   loaded, if it needs swap and none is available.  Called by the frame table, with
+   vm_lock held; the caller reuses or frees the frame. */
+bool
+page_evict (struct page *p)
+{
+  ASSERT (p->frame != NULL);
+
+  /* Unmap it first, so the process can't change it meanwhile. */
+  pagedir_clear_page (p->pagedir, p->upage);
+  if (p->mapped)
+    {
+      write_back (p);
+      p->frame = NULL;
+      return true;
+    }
+  save_dirty (p);
+  if (p->dirty && p->swap_slot == SWAP_NONE)
+    {
+      p->swap_slot = swap_alloc_near (cluster_slot (p),
+                                      pg_no (p->upage) % SWAP_CLUSTER);
+      if (p->swap_slot == SWAP_NONE)
+        {
+          /* The page table already exists, so this can't fail. */
+          pagedir_set_page (p->pagedir, p->upage, p->frame->kpage,
+                            p->writable);
+          return false;
+        }
+      swap_write (p->swap_slot, 1, p->frame->kpage);
+    }
+  p->frame = NULL;
+  return true;
+}
+
+/* Returns the page in PAGES whose user virtual address is
+   UPAGE, or a null pointer if there is none. */
+static struct page *
+page_lookup (struct hash *pages, const void *upage)
+{
+  struct page p;
+  struct hash_elem *e;
+
+  p.upage = (void *) upage;
+  e = hash_find (pages, &p.elem);
+  return e != NULL ? hash_entry (e, struct page, elem) : NULL;
+}
+
+/* Returns a hash value for the page that E is embedded in. */
+static unsigned
+page_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct page *p = hash_entry (e, struct page, elem);
+  return hash_bytes (&p->upage, sizeof p->upage);
+}
+
+/* Returns true if page A precedes page B. */
+static bool
+page_less (const struct hash_elem *a, const struct hash_elem *b,
+           void *aux UNUSED)
+{
+  const struct page *pa = hash_entry (a, struct page, elem);
+  const struct page *pb = hash_entry (b, struct page, elem);
+  return pa->upage < pb->upage;
+}
+
+/* Frees the page that E is embedded in, with its frame or swap
+   slot, writing it back to its file first if it is mapped. */
+static void
+page_free (struct hash_elem *e, void *aux UNUSED)
+{
+  struct page *p = hash_entry (e, struct page, elem);
+
+  if (p->frame != NULL)
+    {
+      pagedir_clear_page (p->pagedir, p->upage);
+      if (p->mapped)
+        write_back (p);
+      frame_release (p->frame, p);
+      p->frame = NULL;
+    }
+  if (p->swap_slot != SWAP_NONE)
+    swap_free (p->swap_slot);
+  if (p->cleaning)
+    {
+      /* The page cleaner holds it and frees it when done. */
+      p->thread = NULL;
+      return;
+    }
+  free (p);
+}
+
+/* Adds a page to the current process's page table, as described
+   for page_add() and page_add_mapped(). */
+static bool
+insert_page (void *upage, struct file *file, off_t ofs, size_t read_bytes,
+             bool writable, bool mapped)
+{
+  struct thread *t = thread_current ();
+  struct page *p;
+  bool success;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (is_user_vaddr (upage));
+  ASSERT (read_bytes <= PGSIZE);
+  ASSERT (file != NULL || read_bytes == 0);
+
+  p = malloc (sizeof *p);
+  if (p == NULL)
+    return false;
+  p->upage = upage;
+  p->file = file;
+  p->ofs = ofs;
+  p->read_bytes = read_bytes;
+  p->writable = writable;
+  p->mapped = mapped;
+  p->cow = false;
+  p->cleaning = false;
+  p->dirty = false;
+  p->thread = t;
+  p->pagedir = t->pagedir;
+  p->frame = NULL;
+  p->swap_slot = SWAP_NONE;
+
+  lock_acquire (&vm_lock);
+  success = (pagedir_get_page (t->pagedir, upage) == NULL
+             && hash_insert (t->pages, &p->elem) == NULL);
+  lock_release (&vm_lock);
+  if (!success)
+    free (p);
+  return success;
+}
+
+/* Loads page P, which is not loaded, into a frame and maps it,
+   for writing if WRITE is true, otherwise for reading.  Returns
+   true if successful, false if memory allocation or the file
+   read fails.  Called with vm_lock held. */
+static bool
+load_page (struct page *p, bool write)
+{
+  struct frame *f;
+  uint8_t *kpage;
+  bool text;
+  bool major = false;
+
+  ASSERT (p->frame == NULL);
+
+  /* A page of zeros that is only read maps the zero frame. */
+  if (!write && page_zero_frame && p->read_bytes == 0
+      && p->swap_slot == SWAP_NONE && !p->mapped)
+    {
+      f = frame_zero (p);
+      if (!pagedir_set_page (p->pagedir, p->upage, f->kpage, false))
+        {
+          frame_release (f, p);
+          return false;
+        }
+      p->frame = f;
+      p->cow = p->writable;
+      thread_current ()->minor_faults++;
+      zero_map_cnt++;
+      return true;
+    }
+
+  /* A read-only page of an executable comes from the frame that
+     every process running it shares, if one is in memory. */
+  text = p->file != NULL && !p->writable && !p->mapped;
+  if (text)
+    {
+      f = frame_find_text (file_get_inode (p->file), p->ofs,
+                           p->read_bytes);
+      if (f != NULL)
+        {
+          frame_share (f, p);
+          goto map;
+        }
+    }
+
+  /* Get a frame and fill it. */
+  f = frame_alloc (p, p->swap_slot == SWAP_NONE && p->read_bytes == 0);
+  if (f == NULL)
+    return false;
+  kpage = f->kpage;
+  if (p->swap_slot != SWAP_NONE)
+    {
+      swap_in_cluster (p, kpage);
+      major = true;
+    }
+  else if (p->read_bytes > 0)
+    {
+      if (file_read_at_direct (p->file, kpage, p->read_bytes, p->ofs)
+          != (off_t) p->read_bytes)
+        {
+          frame_free (f);
+          return false;
+        }
+      memset (kpage + p->read_bytes, 0, PGSIZE - p->read_bytes);
+      major = true;
+    }
+  if (text)
+    frame_set_text (f, file_get_inode (p->file), p->ofs, p->read_bytes);
+
+ map:
+  if (!pagedir_set_page (p->pagedir, p->upage, f->kpage, p->writable))
+    {
+      frame_release (f, p);
+      return false;
+    }
+  p->frame = f;
+  p->cow = false;
+  if (major)
+    thread_current ()->major_faults++;
+  else
+    thread_current ()->minor_faults++;
+  return true;
+}
+
+/* Makes copy-on-write page P, which must be loaded, private and
+   writable: copies its frame if another page still shares it,
+   otherwise just maps it writable.  Returns true if successful,
+   false if no frame is available.  Called with vm_lock held. */
+static bool
+copy_page (struct page *p)
+{
+  struct frame *old = p->frame;
+
+  ASSERT (p->cow && old != NULL);
+
+  pagedir_clear_page (p->pagedir, p->upage);
+  if (frame_is_shared (old))
+    {
+      /* Copy into a new frame.  OLD must stay put until it is
+         copied. */
+      struct frame *f;
+
+      list_remove (&p->frame_elem);
+      old->pin_cnt++;
+      f = frame_alloc (p, frame_is_zero (old));
+      old->pin_cnt--;
+      if (f == NULL)
+        {
+          frame_share (old, p);
+          pagedir_set_page (p->pagedir, p->upage, old->kpage, false);
+          return false;
+        }
+      if (!frame_is_zero (old))
+        memcpy (f->kpage, old->kpage, PGSIZE);
+      p->frame = f;
+    }
+  pagedir_set_page (p->pagedir, p->upage, p->frame->kpage, true);
+  p->cow = false;
+  thread_current ()->cow_faults++;
+  return true;
+}
+
+/* Writes mapped page P, which must be loaded but already
+   unmapped, back to its file if the process changed it. */
+static void
+write_back (struct page *p)
+{
+  ASSERT (p->mapped && p->frame != NULL);
+
+  if (pagedir_is_dirty (p->pagedir, p->upage))
+    file_write_at (p->file, p->frame->kpage, p->read_bytes, p->ofs);
+}
+
+/* Ages the frame table every page_age_interval milliseconds. */
+static void
+age_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_msleep (page_age_interval);
+      lock_acquire (&vm_lock);
+      frame_age ();
+      lock_release (&vm_lock);
+    }
+}
+
+/* Wakes the page cleaner, unless it is awake already.  May be
+   called with interrupts off. */
+void
+page_wake_cleaner (void)
+{
+  enum intr_level old_level;
+
+  if (page_clean_target == 0)
+    return;
+  old_level = intr_disable ();
+  if (!clean_pending)
+    {
+      clean_pending = true;
+      sema_up (&clean_sema);
+    }
+  intr_set_level (old_level);
+}
+
+/* Prints page cleaner statistics. */
+void
+page_print_stats (void)
+{
+  printf ("Paging: %u zero-frame maps, %u pages cleaned in %u writes, "
+          "%u frames reclaimed, %u pages read ahead\n",
+          zero_map_cnt, clean_cnt, clean_write_cnt, reclaim_cnt,
+          read_ahead_cnt);
+}
+
+/* Notes in P, which must be loaded, whether its process has
+   written it since it was mapped or since the page cleaner
+   copied it.  If it has, the cleaner's copy is out of date, so
+   its slot is freed.  Must be called before P's PTE is replaced,
+   which would lose its dirty bit.  Called with vm_lock held. */
+static void
+save_dirty (struct page *p)
+{
+  if (pagedir_is_dirty (p->pagedir, p->upage))
+    {
+      p->dirty = true;
+      p->rewritten = true;
+      if (p->swap_slot != SWAP_NONE)
+        {
+          swap_free (p->swap_slot);
+          p->swap_slot = SWAP_NONE;
+        }
+    }
+}
+
+/* Wakes the page cleaner when the user pool runs low. */
+static void
+user_pool_low (enum palloc_flags pool, size_t free_cnt UNUSED,
+               void *aux UNUSED)
+{
+  if (pool & PAL_USER)
+    page_wake_cleaner ();
+}
+
+/* Page cleaner.  Each time it is woken, writes dirty pages to
+   swap a batch at a time until enough are clean, then frees
+   frames that need no writing. */
+static void
+clean_thread (void *aux UNUSED)
+{
+  uint8_t *buffer = palloc_get_multiple (PAL_ASSERT, CLEAN_BATCH);
+
+  for (;;)
+    {
+      enum intr_level old_level;
+      size_t before;
+
+      sema_down (&clean_sema);
+      old_level = intr_disable ();
+      clean_pending = false;
+      intr_set_level (old_level);
+
+      while (clean_batch (buffer))
+        continue;
+
+      lock_acquire (&vm_lock);
+      before = palloc_free_count (PAL_USER);
+      frame_reclaim (page_clean_target);
+      if (palloc_free_count (PAL_USER) > before)
+        reclaim_cnt += palloc_free_count (PAL_USER) - before;
+      lock_release (&vm_lock);
+    }
+}
+
+/* Writes up to CLEAN_BATCH dirty pages that the clock will reach
+   soon to swap, copying them into BUFFER first.  Each page gets a
+   slot next to its neighbors', by cluster_slot(), and each run of
+   consecutive slots is written in one request.  Returns true if
+   it wrote a full batch, so that there may be more to do, false
+   otherwise. */
+static bool
+clean_batch (uint8_t *buffer)
+{
+  struct frame *frames[CLEAN_BATCH];
+  struct page *pages[CLEAN_BATCH];
+  size_t slots[CLEAN_BATCH];
+  size_t picked, cnt, i, j;
+
+  /* Pick pages, give each a slot, and copy them.  In order by
+     process and address, neighbors get consecutive slots. */
+  lock_acquire (&vm_lock);
+  picked = frame_pick_dirty (frames, CLEAN_BATCH, page_clean_target);
+  for (i = 0; i < picked; i++)
+    pages[i] = list_entry (list_front (&frames[i]->pages),
+                           struct page, frame_elem);
+  sort_pages (pages, picked);
+  for (i = cnt = 0; i < picked; i++)
+    {
+      struct page *p = pages[i];
+      size_t want;
+
+      if (cnt > 0 && pages[cnt - 1]->thread == p->thread
+          && (uint8_t *) pages[cnt - 1]->upage + PGSIZE == p->upage)
+        want = slots[cnt - 1] + 1;
+      else
+        want = cluster_slot (p);
+      slots[cnt] = swap_alloc_near (want, pg_no (p->upage) % SWAP_CLUSTER);
+      if (slots[cnt] == SWAP_NONE)
+        {
+          p->frame->pin_cnt--;
+          continue;
+        }
+
+      save_dirty (p);
+      pagedir_set_dirty (p->pagedir, p->upage, false);
+      p->cleaning = true;
+      p->rewritten = false;
+      memcpy (buffer + cnt * PGSIZE, p->frame->kpage, PGSIZE);
+      pages[cnt++] = p;
+    }
+  lock_release (&vm_lock);
+  if (cnt == 0)
+    return false;
+
+  for (i = 0; i < cnt; i = j)
+    {
+      for (j = i + 1; j < cnt && slots[j] == slots[j - 1] + 1; j++)
+        continue;
+      swap_write (slots[i], j - i, buffer + i * PGSIZE);
+      clean_write_cnt++;
+    }
+
+  /* Keep each copy that is still good. */
+  lock_acquire (&vm_lock);
+  for (i = 0; i < cnt; i++)
+    {
+      struct page *p = pages[i];
+
+      p->cleaning = false;
+      if (p->thread == NULL)
+        {
+          swap_free (slots[i]);
+          free (p);
+          continue;
+        }
+      p->frame->pin_cnt--;
+      if (!p->rewritten && !pagedir_is_dirty (p->pagedir, p->upage)
+          && p->swap_slot == SWAP_NONE)
+        p->swap_slot = slots[i];
+      else
+        swap_free (slots[i]);
+    }
+  clean_cnt += cnt;
+  lock_release (&vm_lock);
+  return cnt == CLEAN_BATCH;
+}
+
+/* Sorts the CNT pages in PAGES by process, then by address. */
+static void
+sort_pages (struct page **pages, size_t cnt)
+{
+  size_t i, j;
+
+  for (i = 1; i < cnt; i++)
+    {
+      struct page *p = pages[i];
+      for (j = i; j > 0 && (pages[j - 1]->thread > p->thread
+                            || (pages[j - 1]->thread == p->thread
+                                && pages[j - 1]->upage > p->upage)); j--)
+        pages[j] = pages[j - 1];
+      pages[j] = p;
+    }
+}
+
+/* Returns the swap slot that would put page P, which is in a
+   frame, at its offset in the swap cluster of another page in its
+   run of SWAP_CLUSTER virtual pages that is at its own offset in
+   that cluster, or SWAP_NONE if no page in the run is.  Called
+   with vm_lock held. */
+static size_t
+cluster_slot (struct page *p)
+{
+  size_t idx = pg_no (p->upage) % SWAP_CLUSTER;
+  uint8_t *base = (uint8_t *) p->upage - idx * PGSIZE;
+  size_t k;
+
+  for (k = 0; k < SWAP_CLUSTER; k++)
+    {
+      struct page *q = page_lookup (p->thread->pages, base + k * PGSIZE);
+      if (q != NULL && q != p && q->swap_slot != SWAP_NONE
+          && q->swap_slot % SWAP_CLUSTER == k)
+        return q->swap_slot - k + idx;
+    }
+  return SWAP_NONE;
+}
+
+/* Reads page P, which is in swap, into KPAGE.  In the same
+   request, reads the pages around P in its run of SWAP_CLUSTER
+   virtual pages that are in the slots around P's, as far as free
+   frames are at hand for them, and maps them too, so that a
+   process reading its memory back in order faults about once
+   per run.  Called with vm_lock held. */
+static void
+swap_in_cluster (struct page *p, void *kpage)
+{
+  size_t idx = pg_no (p->upage) % SWAP_CLUSTER;
+  uint8_t *base = (uint8_t *) p->upage - idx * PGSIZE;
+  size_t first = p->swap_slot - idx;
+  struct frame *frames[SWAP_CLUSTER];
+  void *kpages[SWAP_CLUSTER];
+  size_t lo, hi, k;
+
+  kpages[idx] = kpage;
+  lo = hi = idx;
+  if (p->swap_slot % SWAP_CLUSTER == idx)
+    {
+      while (lo > 0
+             && (frames[lo - 1] = read_ahead_frame (p, base, first,
+                                                    lo - 1)) != NULL)
+        {
+          lo--;
+          kpages[lo] = frames[lo]->kpage;
+        }
+      while (hi + 1 < SWAP_CLUSTER
+             && (frames[hi + 1] = read_ahead_frame (p, base, first,
+                                                    hi + 1)) != NULL)
+        {
+          hi++;
+          kpages[hi] = frames[hi]->kpage;
+        }
+    }
+  swap_in_multi (first + lo, hi - lo + 1, kpages + lo);
+  p->swap_slot = SWAP_NONE;
+
+  for (k = lo; k <= hi; k++)
+    if (k != idx)
+      {
+        struct page *q = list_entry (list_front (&frames[k]->pages),
+                                     struct page, frame_elem);
+
+        /* Its page table already exists, so this can't fail. */
+        pagedir_set_page (q->pagedir, q->upage, frames[k]->kpage,
+                          q->writable);
+        q->frame = frames[k];
+        q->swap_slot = SWAP_NONE;
+        q->cow = false;
+        read_ahead_cnt++;
+      }
+}
+
+/* Returns a free frame for the page at offset K in the run of
+   SWAP_CLUSTER virtual pages at BASE in page P's process, if that
+   page is in swap slot FIRST + K and a free frame is at hand, or
+   a null pointer otherwise. */
+static struct frame *
+read_ahead_frame (struct page *p, uint8_t *base, size_t first, size_t k)
+{
+  struct page *q = page_lookup (p->thread->pages, base + k * PGSIZE);
+
+  if (q == NULL || q->frame != NULL || q->swap_slot != first + k)
+    return NULL;
+  return frame_try_alloc (q);
+}
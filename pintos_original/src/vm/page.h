@@ -0,0 +1,65 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "filesys/off_t.h"
+
+struct file;
+struct frame;
+struct thread;
+
+/* A page of a process's address space. */
+struct page
+  {
+    void *upage;                /* User virtual page. */
+    struct file *file;          /* File to read from, or null. */
+    off_t ofs;                  /* Offset of the page's data in FILE. */
+    size_t read_bytes;          /* Bytes to read; the rest are zeroed. */
+    bool writable;              /* Map read/write or read-only? */
+    bool mapped;                /* Write back to FILE, not swap? */
+    bool dirty;                 /* Written since created?  If so,
+                                   FILE no longer has its contents. */
+    struct thread *thread;      /* Owning process. */
+    uint32_t *pagedir;          /* Owning process's page directory. */
+    struct frame *frame;        /* Frame holding the page, or null. */
+    size_t swap_slot;           /* Swap slot holding it, or SWAP_NONE.
+                                   If FRAME is not null, a copy the
+                                   page cleaner made, good if the
+                                   page is not dirty in PAGEDIR. */
+    bool cow;                   /* Sharing FRAME copy-on-write? */
+    bool cleaning;              /* Being written by the page cleaner? */
+    bool rewritten;             /* Written since the cleaner copied it? */
+    struct list_elem frame_elem; /* Element in FRAME's pages. */
+    struct hash_elem elem;      /* Element in the page table. */
+  };
+
+/* Most pages a user stack may grow to. */
+extern size_t page_stack_limit;
+
+void page_init (void);
+struct hash *page_table_create (void);
+void page_table_destroy (struct hash *);
+void page_print_faults (void);
+
+bool page_add (void *upage, struct file *, off_t ofs, size_t read_bytes,
+               bool writable);
+bool page_add_mapped (void *upage, struct file *, off_t ofs,
+                      size_t read_bytes);
+void page_remove (void *upage);
+bool page_table_copy (struct thread *parent);
+bool page_load (const void *fault_addr, bool write);
+bool page_grow_stack (const void *fault_addr, const void *esp);
+bool page_copy_on_write (const void *fault_addr);
+bool page_pin (const void *uaddr, bool write);
+void page_unpin (const void *uaddr);
+bool page_accessed (struct page *);
+bool page_is_clean (struct page *);
+bool page_evict (struct page *);
+void page_wake_cleaner (void);
+void page_print_stats (void);
+
+#endif /* vm/page.h */
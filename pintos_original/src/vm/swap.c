@@ -0,0 +1,149 @@
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Swap.
+
+   The BLOCK_SWAP device is divided into page-size slots, and a
+   bitmap, one bit per slot, tracks which are in use.
+
+   Slots are grouped into aligned clusters of SWAP_CLUSTER.  page.c
+   asks to put each page of an aligned run of SWAP_CLUSTER virtual
+   pages at the same offset in one cluster, next to the slots of
+   its neighbors, so that reading the neighbors back is one
+   request; swap_alloc_near() gives it that slot if it is free,
+   or else takes a whole free cluster, next-fit, or failing that
+   any free slot.  Callers in page.c serialize all paging with a
+   lock, so there is none here. */
+
+/* Sectors per swap slot. */
+#define SECTORS_PER_SLOT (PGSIZE / BLOCK_SECTOR_SIZE)
+
+static struct block *swap_device;   /* Swap device, or null. */
+static struct bitmap *swap_map;     /* Slots in use. */
+static size_t cluster_hint;         /* Next cluster to try. */
+static void *read_buffer;           /* For swap_in_multi(). */
+
+/* Finds the swap device and sets up its slot bitmap.  Without a
+   swap device, only clean pages can be evicted. */
+void
+swap_init (void)
+{
+  swap_device = block_get_role (BLOCK_SWAP);
+  if (swap_device == NULL)
+    {
+      printf ("swap: no swap device, dirty pages cannot be evicted\n");
+      return;
+    }
+  swap_map = bitmap_create (block_size (swap_device) / SECTORS_PER_SLOT);
+  if (swap_map == NULL)
+    PANIC ("bitmap creation failed--swap device is too large");
+  read_buffer = palloc_get_multiple (PAL_ASSERT, SWAP_CLUSTER);
+}
+
+/* Allocates CNT consecutive free swap slots and returns the
+   first, or SWAP_NONE if there are no such slots or no swap. */
+size_t
+swap_alloc (size_t cnt)
+{
+  size_t slot;
+
+  if (swap_map == NULL)
+    return SWAP_NONE;
+  slot = bitmap_scan_and_flip_next (swap_map, cnt, false);
+  return slot != BITMAP_ERROR ? slot : SWAP_NONE;
+}
+
+/* Allocates a swap slot for a page at offset CLUSTER_OFS in its
+   run of virtual pages: slot WANT, if it is not SWAP_NONE and is
+   free, otherwise the slot at CLUSTER_OFS in a free cluster, or
+   failing that any free slot.  Returns the slot, or SWAP_NONE if
+   swap is full or absent. */
+size_t
+swap_alloc_near (size_t want, size_t cluster_ofs)
+{
+  size_t cluster_cnt, i;
+
+  ASSERT (cluster_ofs < SWAP_CLUSTER);
+
+  if (swap_map == NULL)
+    return SWAP_NONE;
+  if (want < bitmap_size (swap_map) && !bitmap_test (swap_map, want))
+    {
+      bitmap_mark (swap_map, want);
+      return want;
+    }
+
+  cluster_cnt = bitmap_size (swap_map) / SWAP_CLUSTER;
+  for (i = 0; i < cluster_cnt; i++)
+    {
+      size_t c = (cluster_hint + i) % cluster_cnt;
+      if (bitmap_none (swap_map, c * SWAP_CLUSTER, SWAP_CLUSTER))
+        {
+          cluster_hint = c + 1;
+          bitmap_mark (swap_map, c * SWAP_CLUSTER + cluster_ofs);
+          return c * SWAP_CLUSTER + cluster_ofs;
+        }
+    }
+  return swap_alloc (1);
+}
+
+/* Writes the CNT pages at PAGES to the CNT allocated swap slots
+   starting at SLOT, in one request to the swap device.  Needs no
+   serialization, so the page cleaner calls it without the
+   paging lock. */
+void
+swap_write (size_t slot, size_t cnt, const void *pages)
+{
+  ASSERT (swap_map != NULL);
+  ASSERT (bitmap_all (swap_map, slot, cnt));
+
+  block_write_multi (swap_device, slot * SECTORS_PER_SLOT,
+                     cnt * SECTORS_PER_SLOT, pages);
+}
+
+/* Reads swap slot SLOT into the page at KPAGE and frees the
+   slot. */
+void
+swap_in (size_t slot, void *kpage)
+{
+  ASSERT (swap_map != NULL);
+  ASSERT (bitmap_test (swap_map, slot));
+
+  block_read_multi (swap_device, slot * SECTORS_PER_SLOT,
+                    SECTORS_PER_SLOT, kpage);
+  bitmap_reset (swap_map, slot);
+}
+
+/* Reads the CNT swap slots starting at SLOT, in one request, into
+   the pages at KPAGES[0] through KPAGES[CNT - 1], and frees the
+   slots.  CNT must not exceed SWAP_CLUSTER. */
+void
+swap_in_multi (size_t slot, size_t cnt, void **kpages)
+{
+  size_t i;
+
+  ASSERT (swap_map != NULL);
+  ASSERT (cnt <= SWAP_CLUSTER);
+  ASSERT (bitmap_all (swap_map, slot, cnt));
+
+  block_read_multi (swap_device, slot * SECTORS_PER_SLOT,
+                    cnt * SECTORS_PER_SLOT, read_buffer);
+  for (i = 0; i < cnt; i++)
+    memcpy (kpages[i], (uint8_t *) read_buffer + i * PGSIZE, PGSIZE);
+  bitmap_set_multiple (swap_map, slot, cnt, false);
+}
+
+/* Frees swap slot SLOT without reading it. */
+void
+swap_free (size_t slot)
+{
+  ASSERT (swap_map != NULL);
+  ASSERT (bitmap_test (swap_map, slot));
+  bitmap_reset (swap_map, slot);
+}
@@ -0,0 +1,22 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* No swap slot. */
+#define SWAP_NONE SIZE_MAX
+
+/* Slots per cluster, and so virtual pages per aligned run that
+   swap_alloc_near() keeps together. */
+#define SWAP_CLUSTER 8
+
+void swap_init (void);
+size_t swap_alloc (size_t cnt);
+size_t swap_alloc_near (size_t want, size_t cluster_ofs);
+void swap_write (size_t slot, size_t cnt, const void *pages);
+void swap_in (size_t slot, void *kpage);
+void swap_in_multi (size_t slot, size_t cnt, void **kpages);
+void swap_free (size_t slot);
+
+#endif /* vm/swap.h */
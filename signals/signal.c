@@ -4,9 +4,11 @@
 #include <random.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/klog.h"
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
@@ -15,6 +17,242 @@
 #include "userprog/process.h"
 #endif
 
+/* Default action of each signal that can be pending. */
+static void (*const default_action[SIG_COUNT])(int by) = {
+	[SIG_CHLD] = SIG_CHLD_DFL,
+	[SIG_USER] = SIG_USER_DFL,
+	[SIG_CPU] = SIG_CPU_DFL,
+	[SIG_KILL] = SIG_KILL_DFL,
+};
+
+/* An instance of SIG_RT or SIG_IO queued for a thread. */
+struct sigqueue_entry {
+	int sig;                        /* SIG_RT or SIG_IO. */
+	int by;                         /* Sender's tid. */
+	int value;                      /* Value passed to sigqueue(), or
+	                                   request id for SIG_IO. */
+	int64_t sent_at;                /* Tick it was sent. */
+	struct list_elem elem;          /* Element in queued_signals. */
+};
+
+/* Signal statistics, per signal.  Bucket I of LATENCY counts
+   signals taken less than 2**I ticks after they were raised (and
+   at least 2**(I-1) ticks, for I > 0); the last bucket also
+   counts all slower ones.  Protected by turning interrupts off. */
+#define LATENCY_BUCKETS 8
+struct signal_stats {
+	long long sent;                 /* Sent, including the rest. */
+	long long coalesced;            /* Merged into a pending one. */
+	long long ignored;              /* Discarded by the mask. */
+	long long dropped;              /* Queue full or receiver exited. */
+	long long delivered;            /* Handled or taken by sigwait. */
+	long long latency[LATENCY_BUCKETS];
+};
+static struct signal_stats stats[SIG_COUNT];
+
+static void count_delivery(int sig, int64_t sent_at);
+
+/* Entries for queued signals come from a fixed pool, so that
+   sending one never allocates.  Protected by turning interrupts
+   off. */
+static struct sigqueue_entry sigqueue_pool[SIGQUEUE_POOL];
+static struct list sigqueue_free;
+
+/* A thread's installed signal handlers.  Most threads never call
+   sigaction(), so this is allocated by the first call rather than
+   taking room in struct thread. */
+struct sighandlers {
+	signal_handler *handler[SIG_COUNT]; /* Handler, or NULL for the
+	                                       default action. */
+};
+
+/* A thread waiting in sigtimedwait().  Lives on its stack. */
+struct sigwaiter {
+	sigset_t set;                   /* Signals waited for. */
+	struct semaphore sema;          /* Upped when one is raised. */
+	struct timeout timeout;         /* Ends a timed wait. */
+};
+
+static int signal_take(struct thread *t, sigset_t set, int *by, int *value);
+static void signal_wake(struct thread *t, int sig);
+static void hasten_kill(struct thread *x, int priority);
+static bool is_queued(int sig);
+static block_done_func sigio_done;
+static timeout_func sigwait_timeout;
+
+/* Initializes the pool of queued signals. */
+void signal_init(void) {
+	int i;
+	list_init(&sigqueue_free);
+	for (i = 0; i < SIGQUEUE_POOL; i++)
+		list_push_back(&sigqueue_free, &sigqueue_pool[i].elem);
+}
+
+/* Makes signal SIG pending for thread T, sent by thread BY.
+   A signal that is already pending is not queued again: only its
+   latest sender is kept.  Interrupts must be off. */
+void signal_raise(struct thread *t, int sig, int by) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (sig >= 0 && sig < SIG_COUNT && sig != SIG_UBLOCK && !is_queued(sig));
+	stats[sig].sent++;
+	if ((t->pending >> sig) & 1)
+		stats[sig].coalesced++;
+	else
+		t->pending_since[sig] = timer_ticks();
+	t->sent_by[sig] = by;
+	t->pending |= ((sigset_t)1) << sig;
+	signal_wake(t, sig);
+}
+
+/* Counts signal SIG, raised at tick SENT_AT, as delivered. */
+static void count_delivery(int sig, int64_t sent_at) {
+	int64_t latency = timer_ticks() - sent_at;
+	int bucket = 0;
+	while (bucket < LATENCY_BUCKETS - 1 && latency >= ((int64_t)1 << bucket))
+		bucket++;
+	stats[sig].delivered++;
+	stats[sig].latency[bucket]++;
+}
+
+/* Prints signal statistics. */
+void signal_print_stats(void) {
+	static const char *names[SIG_COUNT] = {
+		[SIG_CHLD] = "SIG_CHLD", [SIG_USER] = "SIG_USER", [SIG_CPU] = "SIG_CPU",
+		[SIG_UBLOCK] = "SIG_UBLOCK", [SIG_RT] = "SIG_RT", [SIG_IO] = "SIG_IO",
+		[SIG_KILL] = "SIG_KILL",
+	};
+	int sig, i;
+	for (sig = 0; sig < SIG_COUNT; sig++) {
+		if (stats[sig].sent == 0)
+			continue;
+		printf("%s: %lld sent, %lld coalesced, %lld ignored, %lld dropped, %lld delivered\n",
+		       names[sig], stats[sig].sent, stats[sig].coalesced, stats[sig].ignored,
+		       stats[sig].dropped, stats[sig].delivered);
+		if (sig == SIG_UBLOCK)
+			continue;
+		printf("  latency in ticks:");
+		for (i = 0; i < LATENCY_BUCKETS; i++) {
+			if (i <= 1)
+				printf("%s %d: %lld", i ? "," : "", i, stats[sig].latency[i]);
+			else if (i == LATENCY_BUCKETS - 1)
+				printf(", %d+: %lld", 1 << (i - 1), stats[sig].latency[i]);
+			else
+				printf(", %d-%d: %lld", 1 << (i - 1), (1 << i) - 1, stats[sig].latency[i]);
+		}
+		printf("\n");
+	}
+}
+
+/* Wakes thread T if it is waiting for signal SIG in
+   sigtimedwait().  Interrupts must be off. */
+static void signal_wake(struct thread *t, int sig) {
+	if (t->sigwaiter != NULL && ((t->sigwaiter->set >> sig) & 1))
+		sema_up(&t->sigwaiter->sema);
+}
+
+/* Removes the lowest-numbered signal in SET pending for thread
+   T, storing its sender in *BY and its value in *VALUE.  Returns
+   the signal, or -1 if none in SET is pending.  Interrupts must
+   be off. */
+static int signal_take(struct thread *t, sigset_t set, int *by, int *value) {
+	sigset_t bits = t->pending & set;
+	int sig;
+	if (bits == 0)
+		return -1;
+	sig = __builtin_ctz(bits);
+	if (is_queued(sig)) {
+		/* Take the oldest instance of SIG, and clear its pending
+		   bit if no other is queued. */
+		struct sigqueue_entry * q = NULL;
+		bool more = false;
+		struct list_elem *e;
+		for (e = list_begin(&t->queued_signals); e != list_end(&t->queued_signals); e = list_next(e)) {
+			struct sigqueue_entry * x = list_entry(e, struct sigqueue_entry, elem);
+			if (x->sig != sig)
+				continue;
+			if (q == NULL)
+				q = x;
+			else {
+				more = true;
+				break;
+			}
+		}
+		ASSERT (q != NULL);
+		list_remove(&q->elem);
+		*by = q->by;
+		*value = q->value;
+		count_delivery(sig, q->sent_at);
+		list_push_back(&sigqueue_free, &q->elem);
+		t->queued_cnt--;
+		if (!more)
+			t->pending &= ~(((sigset_t)1) << sig);
+	}
+	else {
+		*by = t->sent_by[sig];
+		*value = 0;
+		count_delivery(sig, t->pending_since[sig]);
+		t->pending &= ~(((sigset_t)1) << sig);
+	}
+	return sig;
+}
+
+/* Delivers the running thread's pending signals, lowest-numbered
+   first, so that notifications come before the signals whose
+   default action is to exit.  Signals the thread is waiting for
+   in sigtimedwait() are left for it to take.  Called by the
+   scheduler with interrupts off. */
+void signal_deliver(void) {
+	struct thread * cur = running_thread();
+	int sig, by, value;
+	ASSERT (intr_get_level () == INTR_OFF);
+	while ((sig = signal_take(cur, ~(cur->sigwaiter != NULL ? cur->sigwaiter->set : 0), &by, &value)) >= 0) {
+		if (cur->sighandlers != NULL && cur->sighandlers->handler[sig] != NULL)
+			cur->sighandlers->handler[sig](sig, by, value);
+		else if (sig == SIG_RT)
+			SIG_RT_DFL(by, value);
+		else if (sig == SIG_IO)
+			SIG_IO_DFL(by, value);
+		else
+			default_action[sig](by);
+	}
+}
+
+/* Discards thread T's pending signals, returning its queued ones
+   to the pool, and cancels any timed signal wait.  Called when T
+   exits, with interrupts off, so that nothing is delivered to it
+   while it finishes exiting. */
+void signal_release(struct thread *t) {
+	int sig;
+	ASSERT (intr_get_level () == INTR_OFF);
+	for (sig = 0; sig < SIG_COUNT; sig++)
+		if (!is_queued(sig) && ((t->pending >> sig) & 1))
+			stats[sig].dropped++;
+	while (!list_empty(&t->queued_signals)) {
+		struct sigqueue_entry * q = list_entry(list_pop_front(&t->queued_signals), struct sigqueue_entry, elem);
+		stats[q->sig].dropped++;
+		list_push_back(&sigqueue_free, &q->elem);
+	}
+	t->queued_cnt = 0;
+	t->pending = 0;
+	if (t->sigwaiter != NULL) {
+		timeout_cancel(&t->sigwaiter->timeout);
+		t->sigwaiter = NULL;
+	}
+}
+
+/* Frees the running thread's signal handlers.  Called by
+   thread_exit() before it turns interrupts off for good, since
+   free() may sleep; no handler runs after this. */
+void signal_exit(void) {
+	struct thread * cur = thread_current();
+	enum intr_level old_level;
+	old_level = intr_disable ();
+	struct sighandlers * h = cur->sighandlers;
+	cur->sighandlers = NULL;
+	intr_set_level (old_level);
+	free(h);
+}
+
 enum sighandler_t Signal(int signum, enum sighandler_t handler) {
 	if (signum == SIG_KILL) return 0;
 	ASSERT (intr_get_level () == INTR_ON);
@@ -27,43 +265,230 @@ enum sighandler_t Signal(int signum, enum sighandler_t handler) {
 	if (old_handler != handler) {
 		cur->mask ^= (1 << signum);
 	}
+	if (handler == SIG_DFL && cur->sighandlers != NULL)
+		cur->sighandlers->handler[signum] = NULL;
+	thread_check_lifetime (cur);
 
 	intr_set_level (old_level);
 	return old_handler;
 }
 
-int kill(int tid, int sig) {
-	if (sig == SIG_CHLD || sig == SIG_CPU || tid <= 2) return -1;
+/* Installs HANDLER for signal SIGNUM in the running thread, or
+   the default action if HANDLER is null, and stores the handler
+   it replaces in *OLDHANDLER if OLDHANDLER is nonnull.  Does not
+   change whether SIGNUM is ignored.  SIG_KILL cannot be caught.
+   Returns 0 if successful, -1 if SIGNUM is invalid or memory for
+   the thread's handlers is short. */
+int sigaction(int signum, signal_handler *handler, signal_handler **oldhandler) {
+	if (signum < 0 || signum >= SIG_COUNT || signum == SIG_UBLOCK || signum == SIG_KILL) return -1;
 	ASSERT (intr_get_level () == INTR_ON);
+	struct thread * cur = thread_current();
+	if (cur->sighandlers == NULL && handler != NULL) {
+		/* Allocate with interrupts on, because malloc() may sleep. */
+		cur->sighandlers = calloc(1, sizeof *cur->sighandlers);
+		if (cur->sighandlers == NULL) return -1;
+	}
 	enum intr_level old_level;
 	old_level = intr_disable ();
 
-	struct thread * x = thread_lookup(tid);
+	if (oldhandler)
+		*oldhandler = cur->sighandlers != NULL ? cur->sighandlers->handler[signum] : NULL;
+	if (cur->sighandlers != NULL)
+		cur->sighandlers->handler[signum] = handler;
 
-	if (x == NULL) {intr_set_level (old_level); return -1;}
-	if (sig != SIG_KILL && ((x->mask >> sig) & 1)) {intr_set_level (old_level);return 0;}
+	intr_set_level (old_level);
+	return 0;
+}
+
+/* Wakes thread X at once, for SIG_UBLOCK, if it is blocked.  If
+   X is on a wait list, as in sema_down(), it is taken off first;
+   it will find that it has nothing to wait for yet and wait
+   again, after taking any pending signals.  A thread that has
+   not started yet, whose list element has never been linked, is
+   left for thread_create() to unblock.  Interrupts must be off;
+   the caller should check for preemption once they are back on. */
+static void unblock(struct thread *x) {
+	struct list_elem * e = &x->elem;
+	if (x->status != THREAD_BLOCKED || e->prev == NULL) return;
+	if (e->prev->next == e && e->next->prev == e)
+		list_remove(e);
+	thread_unblock(x);
+	stats[SIG_UBLOCK].delivered++;
+}
+
+/* Sends signal SIG, with VALUE if it is SIG_RT or SIG_IO, to
+   thread X from thread BY.  Returns 0 if successful or X ignores
+   SIG, -1 if SIG is queued and X's queue or the pool is full.
+   Interrupts must be off. */
+int signal_send(struct thread *x, int sig, int value, int by) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	if (sig != SIG_KILL && ((x->mask >> sig) & 1)) {
+		stats[sig].sent++;
+		stats[sig].ignored++;
+		return 0;
+	}
 
 	if (sig == SIG_UBLOCK) {
-		if (x->status == THREAD_BLOCKED) {
-			list_push_back(&to_unblock_list, &x->blkelem);
+		stats[sig].sent++;
+		unblock(x);
+		return 0;
+	}
+
+	if (is_queued(sig)) {
+		stats[sig].sent++;
+		if (x->queued_cnt >= SIGQUEUE_MAX || list_empty(&sigqueue_free)) {
+			stats[sig].dropped++;
+			return -1;
 		}
-		intr_set_level (old_level);
+		struct sigqueue_entry * q = list_entry(list_pop_front(&sigqueue_free), struct sigqueue_entry, elem);
+		q->sig = sig;
+		q->by = by;
+		q->value = value;
+		q->sent_at = timer_ticks();
+		list_push_back(&x->queued_signals, &q->elem);
+		x->queued_cnt++;
+		x->pending |= ((sigset_t)1) << sig;
+		signal_wake(x, sig);
 		return 0;
 	}
 
+	signal_raise(x, sig, by);
+	if (sig == SIG_KILL)
+		hasten_kill(x, running_thread()->priority);
+	return 0;
+}
+
+/* Makes SIG_KILL, just raised for thread X, take effect soon.
+   SIG_KILL_DFL runs only once X is scheduled, which a blocked or
+   low-priority thread may not be for a long time, holding its
+   memory meanwhile.  So X's priority is raised to at least
+   PRIORITY, the sender's, for good, since X will not need its
+   own again, and X's wait is ended if it is waiting
+   interruptibly.  X then runs, and exits, no later than a thread
+   of the sender's priority would.  Interrupts must be off; the
+   caller should check for preemption once they are back on. */
+static void hasten_kill(struct thread *x, int priority) {
+	if (x->base_priority < priority) {
+		x->base_priority = priority;
+		thread_update_priority(x);
+	}
+	waitqueue_interrupt(x);
+}
+
+int kill(int tid, int sig) {
+	if (sig < 0 || sig >= SIG_COUNT || sig == SIG_CHLD || sig == SIG_CPU || sig == SIG_IO || tid <= 2) return -1;
+	ASSERT (intr_get_level () == INTR_ON);
+	enum intr_level old_level;
+	old_level = intr_disable ();
+
+	struct thread * x = thread_lookup(tid);
+
+	if (x == NULL) {intr_set_level (old_level); return -1;}
 	if (sig == SIG_KILL) {
 		if (x->ptid != running_thread()->tid) {intr_set_level(old_level);return -1;}
 	}
-	if (x->signals[sig].type != -1) {
-		x->signals[sig].sent_by = running_thread()->tid;
-		intr_set_level (old_level);
-		return 0;
+	int ret = signal_send(x, sig, 0, running_thread()->tid);
+	intr_set_level (old_level);
+	thread_check_preempt();
+	return ret;
+}
+
+/* Sends signal SIG to thread TID and to all of its descendants,
+   as kill() would to each, in one pass over the thread tree with
+   interrupts off.  SIG_KILL may only be sent by TID's parent,
+   which thereby tears down TID's whole subtree.  Returns 0 if
+   successful, -1 if SIG or TID is invalid, or if SIG is SIG_RT
+   and it could not be queued for some thread. */
+int killtree(int tid, int sig) {
+	if (sig < 0 || sig >= SIG_COUNT || sig == SIG_CHLD || sig == SIG_CPU || sig == SIG_IO || tid <= 2) return -1;
+	ASSERT (intr_get_level () == INTR_ON);
+	enum intr_level old_level;
+	old_level = intr_disable ();
+
+	struct thread * root = thread_lookup(tid);
+	int by = running_thread()->tid;
+	int ret = 0;
+
+	if (root == NULL) {intr_set_level (old_level); return -1;}
+	if (sig == SIG_KILL && root->ptid != by) {intr_set_level(old_level);return -1;}
+
+	/* Walk the subtree in preorder, without recursion. */
+	struct thread * x = root;
+	for (;;) {
+		if (signal_send(x, sig, 0, by) < 0) ret = -1;
+		if (!list_empty(&x->children)) {
+			x = list_entry(list_front(&x->children), struct thread, child_elem);
+			continue;
+		}
+		while (x != root && list_next(&x->child_elem) == list_end(&x->parent->children))
+			x = x->parent;
+		if (x == root) break;
+		x = list_entry(list_next(&x->child_elem), struct thread, child_elem);
+	}
+	intr_set_level (old_level);
+	thread_check_preempt();
+	return ret;
+}
+
+/* Queues signal SIG, which must be SIG_RT, for thread TID, with
+   VALUE to pass to its handler.  Unlike kill(), repeated signals
+   are not merged.  Returns 0 if the signal was queued or TID
+   ignores it, -1 if SIG or TID is invalid or TID's queue or the
+   pool is full. */
+int sigqueue(int tid, int sig, int value) {
+	if (sig != SIG_RT || tid <= 2) return -1;
+	ASSERT (intr_get_level () == INTR_ON);
+	enum intr_level old_level;
+	old_level = intr_disable ();
+
+	struct thread * x = thread_lookup(tid);
+
+	if (x == NULL) {intr_set_level (old_level); return -1;}
+	int ret = signal_send(x, sig, value, running_thread()->tid);
+	intr_set_level (old_level);
+	thread_check_preempt();
+	return ret;
+}
+
+/* Returns true if signal SIG is queued, rather than coalesced,
+   when sent. */
+static bool is_queued(int sig) {
+	return sig == SIG_RT || sig == SIG_IO;
+}
+
+/* Submits R to BLOCK, as an asynchronous request to read or
+   write, as WRITE says, the CNT sectors starting at SECTOR,
+   the Ith of them to or from BUFFERS[I].  When it completes,
+   SIG_IO is queued for the running thread, with ID as its value
+   and the thread itself as sender, so that the thread can go on
+   computing meanwhile and take the completion in a handler or
+   in sigtimedwait().  R and BUFFERS must stay valid until then.
+   A completion that cannot be queued, because the thread ignores
+   SIG_IO, has exited, or has a full queue, is counted as
+   dropped and lost; a thread with many requests outstanding
+   should keep them under SIGQUEUE_MAX. */
+void sigio_submit(struct block *block, struct sigio_request *r, bool write,
+                  block_sector_t sector, void *const buffers[], size_t cnt, int id) {
+	r->tid = thread_current()->tid;
+	r->id = id;
+	block_request_init(&r->request, write, sector, buffers, cnt, sigio_done, r);
+	block_submit(block, &r->request);
+}
+
+/* Completes a request submitted with sigio_submit(), in the
+   block layer's deferred completion work. */
+static void sigio_done(struct block_request *request) {
+	struct sigio_request * r = request->aux;
+	enum intr_level old_level;
+	old_level = intr_disable ();
+	struct thread * x = thread_lookup(r->tid);
+	if (x != NULL)
+		signal_send(x, SIG_IO, r->id, r->tid);
+	else {
+		stats[SIG_IO].sent++;
+		stats[SIG_IO].dropped++;
 	}
-	x->signals[sig].type = sig;
-	x->signals[sig].sent_by = running_thread()->tid;
-	list_push_back(&x->signals_queue, &x->signals[sig].threadelem);
 	intr_set_level (old_level);
-	return 0;
 }
 
 // 0 - SIGBLOCK 1 - SIG_UNBLOCK 2 - SIG_SETMASK
@@ -92,10 +517,70 @@ int sigprocmask(int how, const sigset_t *set, sigset_t *oldset){
 		intr_set_level (old_level);
 		return -1;
 	}
+	thread_check_lifetime (cur);
 	intr_set_level (old_level);
 	return 0;
 }
 
+/* Waits until one of the signals in SET is pending, then takes
+   it without running its handler and stores its number in *SIG.
+   Returns 0 if successful, -1 if SET is invalid. */
+int sigwait(const sigset_t *set, int *sig) {
+	struct siginfo info;
+	if (sigtimedwait(set, &info, -1) < 0)
+		return -1;
+	if (sig) *sig = info.sig;
+	return 0;
+}
+
+/* Waits up to TICKS timer ticks, or forever if TICKS is negative,
+   until one of the signals in SET is pending.  Then takes it
+   without running its handler, and stores its number, sender and
+   value in *INFO if INFO is nonnull.  Signals outside SET are
+   delivered as usual meanwhile, and SIG_KILL ends the wait at
+   once, since it is interruptible.  SET may not contain SIG_KILL or
+   SIG_UBLOCK, and since ignored signals are discarded when sent,
+   waiting for one only times out.  Returns the signal taken, or -1 if SET is invalid
+   or the wait timed out. */
+int sigtimedwait(const sigset_t *set, struct siginfo *info, int64_t ticks) {
+	if (!set || *set == 0 || *set >= (1 << SIG_COUNT)
+	    || ((*set >> SIG_KILL) & 1) || ((*set >> SIG_UBLOCK) & 1)) return -1;
+	ASSERT (intr_get_level () == INTR_ON);
+	enum intr_level old_level;
+	old_level = intr_disable ();
+
+	struct thread * cur = thread_current();
+	struct sigwaiter w;
+	int sig, by, value;
+	w.set = *set;
+	sema_init(&w.sema, 0);
+	timeout_init(&w.timeout, sigwait_timeout, &w);
+	cur->sigwaiter = &w;
+	if (ticks > 0)
+		timeout_add(&w.timeout, ticks);
+	while ((sig = signal_take(cur, w.set, &by, &value)) < 0) {
+		if (ticks >= 0 && !w.timeout.pending)
+			break;
+		sema_down_interruptible(&w.sema);
+	}
+	timeout_cancel(&w.timeout);
+	cur->sigwaiter = NULL;
+	intr_set_level (old_level);
+
+	if (sig >= 0 && info) {
+		info->sig = sig;
+		info->by = by;
+		info->value = value;
+	}
+	return sig;
+}
+
+/* Ends the timed signal wait AUX. */
+static void sigwait_timeout(struct timeout *t UNUSED, void *aux) {
+	struct sigwaiter * w = aux;
+	sema_up(&w->sema);
+}
+
 int sigemptyset(sigset_t *set){
 	if (!set) {
 		return -1;
@@ -145,20 +630,28 @@ int sigdelset(sigset_t *set, int signum){
 }
 	
 void SIG_KILL_DFL(int by) {
-	printf("%d Killed by %d\n", running_thread()->tid, by);
+	klog_printf("%d Killed by %d\n", running_thread()->tid, by);
 	thread_exit();
 }
 
 void SIG_USER_DFL(int by) {
-	printf("%d sent SIG_USER to %d\n", by, running_thread()->tid);
+	klog_printf("%d sent SIG_USER to %d\n", by, running_thread()->tid);
+}
+
+void SIG_RT_DFL(int by, int value) {
+	klog_printf("%d sent SIG_RT %d to %d\n", by, value, running_thread()->tid);
+}
+
+void SIG_IO_DFL(int by, int value) {
+	klog_printf("I/O request %d of %d complete\n", value, by);
 }
 
 void SIG_CPU_DFL(int by UNUSED) {
-	printf("Lifetime of %d = %lld\n", running_thread()->tid, running_thread()->lifetime);
+	klog_printf("Lifetime of %d = %lld\n", running_thread()->tid, running_thread()->lifetime);
 	thread_exit();
 }
 
 void SIG_CHLD_DFL(int by UNUSED) {
 	running_thread()->alive--;
-	printf("Thread %d: %d Children, %d alive\n", running_thread()->tid, running_thread()->total, running_thread()->alive);
+	klog_printf("Thread %d: %d Children, %d alive\n", running_thread()->tid, running_thread()->total, running_thread()->alive);
 }
\ No newline at end of file
@@ -4,37 +4,82 @@
 #include <debug.h>
 #include <list.h>
 #include <stdint.h>
+#include "devices/block.h"
 
 struct thread;
+struct sigwaiter;
 
 #define SIG_CHLD  0
 #define SIG_USER  1
 #define SIG_CPU  2
 #define SIG_UBLOCK  3
-#define SIG_KILL  4
-#define SIG_COUNT  5
+#define SIG_RT  4
+#define SIG_IO  5
+#define SIG_KILL  6
+#define SIG_COUNT  7
 #define SIG_BLOCK  0
 #define SIG_UNBLOCK  1
 #define SIG_SETMASK  2
-#define NUM_SIGNAL  4
+#define NUM_SIGNAL  6
+
+/* SIG_RT and SIG_IO are queued rather than coalesced: each
+   sigqueue(), or each completion of a request submitted with
+   sigio_submit(), is delivered once, with its value, in the
+   order sent.  Up to SIGQUEUE_MAX of them may be queued for a
+   thread, and SIGQUEUE_POOL for all threads together. */
+#define SIGQUEUE_MAX  16
+#define SIGQUEUE_POOL  256
 
 
 enum sighandler_t {
     SIG_DFL,
     SIG_IGN
 };
-struct signal_t {
-	int type;
-	int sent_by;
-	struct list_elem threadelem;
-};
 typedef unsigned short sigset_t;
 
+/* A signal handler, called with the signal number, the tid of
+   the thread that sent it, and the value passed to sigqueue(), or
+   0 for a signal sent by kill().  Runs in the receiving thread
+   with interrupts off, so it must not sleep. */
+typedef void signal_handler (int sig, int by, int value);
+
+/* An asynchronous block request whose completion is reported
+   to the thread that submitted it by SIG_IO, with the request's
+   id as the value.  Owned by the block layer from sigio_submit()
+   until then. */
+struct sigio_request {
+	struct block_request request;   /* The request itself. */
+	int tid;                        /* Thread to notify. */
+	int id;                         /* Value passed with SIG_IO. */
+};
+
+/* A signal taken by sigtimedwait(). */
+struct siginfo {
+	int sig;                        /* Signal number. */
+	int by;                         /* Sender's tid. */
+	int value;                      /* sigqueue() value, or 0. */
+};
+
 
 enum sighandler_t Signal(int signum, enum sighandler_t handler);
 int kill(int pid, int sig);
+int sigqueue(int tid, int sig, int value);
+int killtree(int tid, int sig);
+void sigio_submit(struct block *block, struct sigio_request *r, bool write,
+                  block_sector_t sector, void *const buffers[], size_t cnt, int id);
+int sigaction(int signum, signal_handler *handler, signal_handler **oldhandler);
+
+void signal_init(void);
+void signal_raise(struct thread *t, int sig, int by);
+int signal_send(struct thread *x, int sig, int value, int by);
+void signal_deliver(void);
+void signal_release(struct thread *t);
+void signal_exit(void);
+void signal_print_stats(void);
 
 int sigprocmask(int how, const sigset_t *set, sigset_t *oldset);
+int sigwait(const sigset_t *set, int *sig);
+int sigtimedwait(const sigset_t *set, struct siginfo *info, int64_t ticks);
 
 int sigemptyset(sigset_t *set);
 int sigfillset(sigset_t *set);
@@ -44,6 +89,8 @@ int sigdelset(sigset_t *set, int signum);
 void SIG_KILL_DFL(int by);
 void SIG_USER_DFL(int by);
 void SIG_CPU_DFL(int by);
+void SIG_RT_DFL(int by, int value);
+void SIG_IO_DFL(int by, int value);
 void SIG_CHLD_DFL(int by);
 
 #endif
\ No newline at end of file
@@ -1,13 +1,23 @@
 #include "threads/thread.h"
 #include <debug.h>
+#include <inttypes.h>
 #include <stddef.h>
 #include <random.h>
+#include <round.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/clock.h"
+#include "devices/timer.h"
 #include "threads/flags.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
+#include "threads/kstack.h"
 #include "threads/palloc.h"
+#include "threads/percpu.h"
+#include "threads/rcu.h"
+#include "threads/sched-trace.h"
+#include "threads/seqlock.h"
 #include "threads/malloc.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
@@ -27,13 +37,36 @@
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
-static struct hash tids;
 static struct list all_list;
 
+/* Tids index a table of threads, for thread_lookup().  The low
+   TID_SLOT_BITS bits of a tid are its slot in the table, and the
+   rest count how many times the slot has been reused, so that a
+   stale tid does not find the slot's next thread.  Freed slots
+   are reused first, which keeps the table dense.  Slot 0 is
+   never used, so no tid is 0.  The table starts out in static
+   storage and doubles in size from the page allocator when it
+   fills.  Protected by turning interrupts off; resizing is also
+   serialized by tid_lock. */
+#define TID_SLOT_BITS 16
+#define TID_SLOTS_MAX (1 << TID_SLOT_BITS)
+#define TID_SLOTS_INIT 64
+#define TID_GEN_MASK ((1u << (31 - TID_SLOT_BITS)) - 1)
+struct tid_slot
+  {
+    struct thread *thread;      /* Thread with this slot, or NULL. */
+    unsigned gen;               /* Times the slot has been freed. */
+    int next_free;              /* Next free slot, if free. */
+  };
+static struct tid_slot tid_slots_init[TID_SLOTS_INIT];
+static struct tid_slot *tid_slots = tid_slots_init;
+static int tid_slot_cnt = TID_SLOTS_INIT;   /* Size of tid_slots. */
+static int tid_slots_used = 1;  /* Slots ever handed out. */
+static int tid_free = -1;       /* First free slot, or -1. */
+
 /* Idle thread. */
 static struct list ready_list;
 static struct thread *idle_thread;
-struct list to_unblock_list;
 
 /* Initial thread, the thread running init.c:main(). */
 static struct thread *initial_thread;
@@ -41,6 +74,16 @@ static struct thread *initial_thread;
 /* Lock used by allocate_tid(). */
 static struct lock tid_lock;
 
+/* Pages of dead threads, kept for thread_create() to reuse, so
+   that short-lived threads need not go back to palloc or have
+   their pages zeroed each time.  Linked through their `elem'
+   members, most recently freed first.  Emptied when the kernel
+   pool runs short.  Protected by turning interrupts off. */
+#define THREAD_CACHE_MAX 16
+static struct list thread_cache;
+static size_t thread_cache_cnt;
+static struct palloc_notifier thread_cache_notifier;
+
 /* Stack frame for kernel_thread(). */
 struct kernel_thread_frame 
   {
@@ -49,10 +92,13 @@ struct kernel_thread_frame
     void *aux;                  /* Auxiliary data for function. */
   };
 
-/* Statistics. */
-static long long idle_ticks;    /* # of timer ticks spent idle. */
-static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
-static long long user_ticks;    /* # of timer ticks in user programs. */
+/* Statistics.  Written only by the timer interrupt handler,
+   under stats_seq, so readers need not turn interrupts off.  The
+   tick counts are per CPU, summed by thread_print_stats(). */
+static struct seqlock stats_seq;
+static struct pcpu_counter idle_ticks;   /* # of ticks spent idle. */
+static struct pcpu_counter kernel_ticks; /* # of ticks in kernel threads. */
+static struct pcpu_counter user_ticks;   /* # of ticks in user programs. */
 
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
@@ -63,41 +109,58 @@ static unsigned thread_ticks;   /* # of timer ticks since last yield. */
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* If true, print CPU accounting for each thread.
+   Controlled by kernel command-line option "-acct". */
+bool thread_acct_print;
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
 static struct thread *next_thread_to_run (void);
 static void init_thread (struct thread *, const char *name, int priority);
 static bool is_thread (struct thread *) UNUSED;
+static struct thread *alloc_thread_page (void);
+static void free_thread_page (struct thread *);
+static palloc_notify_func drain_thread_cache;
 static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
+static void acct_switch (struct thread *cur, struct thread *next);
+static void print_acct (struct thread *, void *aux);
+static void thread_resume (void);
 void thread_schedule_tail (struct thread *prev);
-static tid_t allocate_tid (void);
-static unsigned tid_hash (const struct hash_elem *p_, void *aux UNUSED);
-static bool tid_less (const struct hash_elem *a_, const struct hash_elem *b_, void *aux UNUSED);
-
-
-unsigned
-tid_hash (const struct hash_elem *p_, void *aux UNUSED) {
-  const struct thread *p = hash_entry (p_, struct thread, hash_elem);
-  return hash_bytes (&p->tid, sizeof p->tid);
-}
-
+static tid_t allocate_tid (struct thread *);
+static bool grow_tids (void);
+static void release_tid (tid_t);
+static bool priority_more (const struct list_elem *,
+                           const struct list_elem *, void *aux);
+static void thread_requeue (struct thread *);
+static long long lifetime_ticks (struct thread *);
+static void lifetime_arm (struct thread *);
+static timeout_func lifetime_expired;
+static void cpu_group_charge (struct thread *);
+static bool cpu_group_exhausted (struct cpu_group *);
+static void cpu_group_park (struct thread *);
+static timeout_func cpu_group_refill;
+
+
+/* Returns the live thread with the given TID, or a null pointer
+   if there is none.  Must be called with interrupts off or in an
+   RCU read-side section, and the thread returned stays valid
+   only until interrupts go back on or the section ends.  The
+   table is only changed with interrupts off, and grow_tids()
+   frees an old table only after a grace period. */
 struct thread *
 thread_lookup (const int tid) {
-  if (tid == 1) return initial_thread;
-  if (tid == 2) return idle_thread;
-	struct thread p;
-	struct hash_elem *e;
-	p.tid = tid;
-	e = hash_find (&tids, &p.hash_elem);
-	return e != NULL ? hash_entry (e, struct thread, hash_elem) : NULL;
-}
-bool
-tid_less (const struct hash_elem *a_, const struct hash_elem *b_, void *aux UNUSED) {
-  const struct thread *a = hash_entry (a_, struct thread, hash_elem);
-  const struct thread *b = hash_entry (b_, struct thread, hash_elem);
-  return a->tid < b->tid;
+  struct tid_slot *slots = tid_slots;
+  struct thread *t;
+  int slot = tid & (TID_SLOTS_MAX - 1);
+
+  ASSERT (intr_get_level () == INTR_OFF || rcu_read_locked ());
+
+  if (tid <= 0 || slot >= tid_slot_cnt)
+    return NULL;
+  t = slots[slot].thread;
+  return t != NULL && t->tid == tid ? t : NULL;
 }
 
 /* Initializes the threading system by transforming the code
@@ -117,17 +180,22 @@ void
 thread_init (void) 
 {
   ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (offsetof (struct thread, acct) == THREAD_LINE_SIZE);
+  ASSERT (sizeof (struct thread_acct) <= THREAD_LINE_SIZE);
 
-  lock_init (&tid_lock);
+  lock_init_named (&tid_lock, "tid_lock");
+  seqlock_init (&stats_seq);
   list_init (&ready_list);
-  list_init (&to_unblock_list);
+  signal_init ();
   list_init (&all_list);
+  list_init (&thread_cache);
 
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
   init_thread (initial_thread, "main", PRI_DEFAULT);
+  prng_init (&initial_thread->prng, random_ulong ());
   initial_thread->status = THREAD_RUNNING;
-  initial_thread->tid = allocate_tid ();
+  initial_thread->tid = allocate_tid (initial_thread);
 }
 
 /* Starts preemptive thread scheduling by enabling interrupts.
@@ -142,58 +210,85 @@ thread_start (void)
 
   /* Start preemptive thread scheduling. */
   intr_enable ();
-  hash_init (&tids, tid_hash, tid_less, NULL);
+
   /* Wait for the idle thread to initialize idle_thread. */
   sema_down (&idle_started);
+
+  /* palloc_init() has run by now, so the notifier can be
+     registered. */
+  palloc_register_notifier (&thread_cache_notifier, drain_thread_cache,
+                            NULL);
 }
 
-/* Called by the timer interrupt handler at each timer tick.
-   Thus, this function runs in an external interrupt context. */
+/* Called by the timer interrupt handler at each timer tick,
+   with USER true if the tick interrupted user code.  Thus, this
+   function runs in an external interrupt context. */
 void
-thread_tick (void) 
+thread_tick (bool user)
 {
   struct thread *t = thread_current ();
 
   /* Update statistics. */
+  seqlock_write_begin (&stats_seq);
   if (t == idle_thread)
-    idle_ticks++;
+    pcpu_inc (&idle_ticks);
 #ifdef USERPROG
   else if (t->pagedir != NULL)
-    user_ticks++;
+    pcpu_inc (&user_ticks);
 #endif
   else
-    kernel_ticks++;
-  running_thread()->ticks ++;
-  if (running_thread()->ticks > running_thread()->lifetime) {
-
-    if (running_thread()->signals[SIG_CPU].type == -1 && !((running_thread()->mask >> SIG_CPU) & 1)) {
-      running_thread()->signals[SIG_CPU].type = SIG_CPU;
-      list_push_back(&(running_thread()->signals_queue), &running_thread()->signals[SIG_CPU].threadelem);
+    pcpu_inc (&kernel_ticks);
+  seqlock_write_end (&stats_seq);
+  if (t != idle_thread)
+    {
+      if (user)
+        t->acct.user_ticks++;
+      else
+        t->acct.kernel_ticks++;
+      if (t->cpu_group != NULL)
+        cpu_group_charge (t);
     }
-  }
-  struct list_elem * e;
-  for (e = list_begin(&ready_list); e != list_end(&ready_list); e = list_next(e)) {
-    struct thread * T = list_entry(e, struct thread, elem);
-    T->ticks ++;
-    if (T->ticks > T->lifetime) {
-      if (T->signals[SIG_CPU].type == -1 && !((T->mask >> SIG_CPU) & 1)) {
-        T->signals[SIG_CPU].type = SIG_CPU;
-        list_push_back(&(T->signals_queue), &T->signals[SIG_CPU].threadelem);
-      }
-    } 
-  }
 
   /* Enforce preemption. */
   if (++thread_ticks >= TIME_SLICE)
     intr_yield_on_return ();
 }
 
+/* Called by the timer interrupt handler for each tick that
+   passed while the idle thread waited with the timer stopped
+   (see timer_idle_enter()), other than the one being handled. */
+void
+thread_idle_tick (void)
+{
+  seqlock_write_begin (&stats_seq);
+  pcpu_inc (&idle_ticks);
+  seqlock_write_end (&stats_seq);
+}
+
 /* Prints thread statistics. */
 void
 thread_print_stats (void) 
 {
+  long long idle, kernel, user;
+  unsigned seq;
+
+  do
+    {
+      seq = seqlock_read_begin (&stats_seq);
+      idle = pcpu_read (&idle_ticks);
+      kernel = pcpu_read (&kernel_ticks);
+      user = pcpu_read (&user_ticks);
+    }
+  while (seqlock_read_retry (&stats_seq, seq));
   printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
-          idle_ticks, kernel_ticks, user_ticks);
+          idle, kernel, user);
+  signal_print_stats ();
+  if (thread_acct_print)
+    {
+      enum intr_level old_level = intr_disable ();
+      thread_foreach (print_acct, NULL);
+      intr_set_level (old_level);
+    }
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -208,9 +303,9 @@ thread_print_stats (void)
    scheduled.  Use a semaphore or some other form of
    synchronization if you need to ensure ordering.
 
-   The code provided sets the new thread's `priority' member to
-   PRIORITY, but no actual priority scheduling is implemented.
-   Priority scheduling is the goal of Problem 1-3. */
+   The ready list is kept in priority order, so the new thread
+   runs first if its PRIORITY is higher than that of the running
+   thread. */
 tid_t
 thread_create (const char *name, int priority,
                thread_func *function, void *aux) 
@@ -225,19 +320,34 @@ thread_create (const char *name, int priority,
   ASSERT (function != NULL);
 
   /* Allocate thread. */
-  t = palloc_get_page (PAL_ZERO);
+  t = alloc_thread_page ();
   if (t == NULL)
     return TID_ERROR;
 
+  tid = allocate_tid (t);
+  if (tid == TID_ERROR)
+    {
+      free_thread_page (t);
+      return TID_ERROR;
+    }
+
   /* Initialize thread. */
   init_thread (t, name, priority);
-  tid = t->tid = allocate_tid ();
-  if(t->tid > 2)hash_insert(&tids, &t->hash_elem);
+  prng_init (&t->prng, prng_next (&thread_current ()->prng));
+  t->tid = tid;
+
+  sched_trace (SCHED_CREATE, t, -1, -1);
+
   /* Prepare thread for first run by initializing its stack.
      Do this atomically so intermediate values for the 'stack' 
      member cannot be observed. */
   old_level = intr_disable ();
 
+  /* Charge the new thread to its creator's CPU budget. */
+  t->cpu_group = thread_current ()->cpu_group;
+  if (t->cpu_group != NULL)
+    t->cpu_group->members++;
+
   /* Stack frame for kernel_thread(). */
   kf = alloc_frame (t, sizeof *kf);
   kf->eip = NULL;
@@ -255,8 +365,10 @@ thread_create (const char *name, int priority,
 
   intr_set_level (old_level);
 
-  /* Add to run queue. */
+  /* Add to run queue, and run it now if it has a higher
+     priority. */
   thread_unblock (t);
+  thread_check_preempt ();
 
   return tid;
 }
@@ -270,11 +382,16 @@ thread_create (const char *name, int priority,
 void
 thread_block (void) 
 {
+  struct thread *cur = thread_current ();
+
   ASSERT (!intr_context ());
   ASSERT (intr_get_level () == INTR_OFF);
 
-  thread_current ()->status = THREAD_BLOCKED;
+  cur->ticks += timer_ticks () - cur->active_since;
+  timeout_cancel (&cur->lifetime_timeout);
+  cur->status = THREAD_BLOCKED;
   schedule ();
+  thread_resume ();
 }
 
 /* Transitions a blocked thread T to the ready-to-run state.
@@ -294,9 +411,14 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  list_push_back (&ready_list, &t->elem);
+  list_insert_ordered (&ready_list, &t->elem, priority_more, NULL);
   
+  t->acct.blocked_cycles += clock_cycles () - t->acct.since;
+  t->acct.since = clock_cycles ();
   t->status = THREAD_READY;
+  sched_trace (SCHED_WAKE, t, -1, -1);
+  t->active_since = timer_ticks ();
+  lifetime_arm (t);
   intr_set_level (old_level);
 }
 
@@ -307,6 +429,20 @@ thread_name (void)
   return thread_current ()->name;
 }
 
+/* Returns the running thread's own pseudo-random number
+   generator, for uses that need speed rather than RC4's
+   reproducible stream.  Each thread's generator is seeded from
+   its creator's, and the initial thread's from random_ulong(),
+   so a run with a fixed "-rs" seed is repeatable.  Must not be
+   called from an interrupt handler, which would share the
+   generator with the thread it interrupted. */
+struct prng *
+thread_prng (void) 
+{
+  ASSERT (!intr_context ());
+  return &thread_current ()->prng;
+}
+
 /* Returns the running thread.
    This is running_thread() plus a couple of sanity checks.
    See the big comment at the top of thread.h for details. */
@@ -343,26 +479,38 @@ thread_exit (void)
 #ifdef USERPROG
   process_exit ();
 #endif
+  fpu_exit ();
+  signal_exit ();
+  if (thread_acct_print)
+    print_acct (thread_current (), NULL);
 
   /* Remove thread from all threads list, set our status to dying,
      and schedule another process.  That process will destroy us
      when it calls thread_schedule_tail(). */
+  cpu_group_join (NULL);
   intr_disable ();
+  timeout_cancel (&thread_current ()->lifetime_timeout);
+  signal_release (thread_current ());
   list_remove (&thread_current()->allelem);
-  struct thread * par = thread_lookup (thread_current()->ptid);
+  struct thread * par = thread_current ()->parent;
+
+  /* Hand our children to our parent, so that they stay in its
+     subtree for killtree(). */
+  while (!list_empty (&thread_current ()->children)) {
+    struct thread *c = list_entry (list_pop_front (&thread_current ()->children),
+                                   struct thread, child_elem);
+    c->parent = par;
+    c->ptid = par != NULL ? par->tid : 0;
+    if (par != NULL) {
+      list_push_back (&par->children, &c->child_elem);
+      par->alive++;
+    }
+  }
   if (par != NULL) {
-  	if (!((par->mask >> SIG_CHLD) & 1)) {
-      if (par->signals[SIG_CHLD].type != -1) {
-        par->signals[SIG_CHLD].sent_by = running_thread()->tid;
-      }
-      else {
-        par->signals[SIG_CHLD].type = SIG_CHLD;
-        par->signals[SIG_CHLD].sent_by = running_thread()->tid;
-  		  list_push_back(&par->signals_queue, &par->signals[SIG_CHLD].threadelem);
-      }
-  	}
+    list_remove (&thread_current ()->child_elem);
+    signal_send (par, SIG_CHLD, 0, running_thread()->tid);
   }
-  hash_delete(&tids, &running_thread()->hash_elem);
+  release_tid (running_thread()->tid);
   thread_current ()->status = THREAD_DYING;
   schedule ();
   NOT_REACHED ();
@@ -380,20 +528,25 @@ thread_yield (void)
 
   old_level = intr_disable ();
   if (cur != idle_thread) 
-    list_push_back (&ready_list, &cur->elem);
+    list_insert_ordered (&ready_list, &cur->elem, priority_more, NULL);
   cur->status = THREAD_READY;
   schedule ();
+  thread_resume ();
   intr_set_level (old_level);
 }
 
 /* Invoke function 'func' on all threads, passing along 'aux'.
-   This function must be called with interrupts off. */
+   This function must be called with interrupts off or in an RCU
+   read-side section, and 'func' must not sleep.  Threads are
+   added to all_list and removed from it with interrupts off,
+   and a dying thread's page is freed only after the switch away
+   from it, which ends any read-side section that found it. */
 void
 thread_foreach (thread_action_func *func, void *aux)
 {
   struct list_elem *e;
 
-  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (intr_get_level () == INTR_OFF || rcu_read_locked ());
 
   for (e = list_begin (&all_list); e != list_end (&all_list);
        e = list_next (e))
@@ -403,11 +556,124 @@ thread_foreach (thread_action_func *func, void *aux)
     }
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Sets the current thread's priority to NEW_PRIORITY.  If it
+   has been donated a higher priority, that stays in effect until
+   the donation ends.  Yields if the thread no longer has the
+   highest priority. */
 void
 thread_set_priority (int new_priority) 
 {
-  thread_current ()->priority = new_priority;
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  cur->base_priority = new_priority;
+  thread_update_priority (cur);
+  intr_set_level (old_level);
+  thread_check_preempt ();
+}
+
+/* Raises thread T's priority to PRIORITY, if that is higher, on
+   behalf of a thread waiting for a lock that T holds. */
+void
+thread_donate_priority (struct thread *t, int priority)
+{
+  enum intr_level old_level = intr_disable ();
+  if (priority > t->priority)
+    {
+      t->priority = priority;
+      thread_requeue (t);
+    }
+  intr_set_level (old_level);
+}
+
+/* Recomputes thread T's priority as the highest of its own and
+   those of the threads waiting for locks that T holds. */
+void
+thread_update_priority (struct thread *t)
+{
+  enum intr_level old_level = intr_disable ();
+  int priority = t->base_priority;
+  struct list_elem *e;
+
+  for (e = list_begin (&t->held_locks); e != list_end (&t->held_locks);
+       e = list_next (e))
+    {
+      struct lock *lock = list_entry (e, struct lock, elem);
+      int waiter_priority = waitqueue_max_priority (&lock->semaphore.waiters);
+      if (waiter_priority > priority)
+        priority = waiter_priority;
+    }
+  if (priority != t->priority)
+    {
+      t->priority = priority;
+      thread_requeue (t);
+    }
+  intr_set_level (old_level);
+}
+
+/* Yields the CPU if a ready thread has a higher priority than
+   the running thread.  In an interrupt handler, yields on return
+   from the interrupt instead.  Does not yield if the caller has
+   turned interrupts off, since it may be in the middle of an
+   update that must be atomic; such callers should call this
+   again once interrupts are back on. */
+void
+thread_check_preempt (void)
+{
+  enum intr_level old_level = intr_disable ();
+  bool preempt = (!list_empty (&ready_list)
+                  && (list_entry (list_front (&ready_list),
+                                  struct thread, elem)->priority
+                      > thread_current ()->priority));
+  intr_set_level (old_level);
+
+  if (preempt)
+    {
+      if (intr_context ())
+        intr_yield_on_return ();
+      else if (old_level == INTR_ON)
+        thread_yield ();
+    }
+}
+
+/* Returns true if thread A, given by its `elem', has lower
+   priority than thread B. */
+bool
+thread_priority_less (const struct list_elem *a_,
+                      const struct list_elem *b_, void *aux UNUSED)
+{
+  const struct thread *a = list_entry (a_, struct thread, elem);
+  const struct thread *b = list_entry (b_, struct thread, elem);
+
+  return a->priority < b->priority;
+}
+
+/* Returns true if thread A, given by its `elem', has higher
+   priority than thread B.  Keeps the ready list in descending
+   order of priority, first come first served within one. */
+static bool
+priority_more (const struct list_elem *a, const struct list_elem *b,
+               void *aux UNUSED)
+{
+  return thread_priority_less (b, a, NULL);
+}
+
+/* Puts thread T back in the ready list, if it is ready, or in
+   the waitqueue it is waiting in, if any, at the place for its
+   current priority.  Interrupts must be off. */
+static void
+thread_requeue (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (t->status == THREAD_READY)
+    {
+      list_remove (&t->elem);
+      list_insert_ordered (&ready_list, &t->elem, priority_more, NULL);
+    }
+  else
+    waitqueue_requeue (t);
 }
 
 /* Returns the current thread's priority. */
@@ -470,6 +736,15 @@ idle (void *idle_started_ UNUSED)
       intr_disable ();
       thread_block ();
 
+      /* Zero free pages while nothing else wants the CPU.  If a
+         thread became ready meanwhile, go back and run it. */
+      intr_enable ();
+      while (list_empty (&ready_list) && palloc_zero_idle ())
+        continue;
+      intr_disable ();
+      if (!list_empty (&ready_list))
+        continue;
+
       /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -482,6 +757,7 @@ idle (void *idle_started_ UNUSED)
 
          See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
          7.11.1 "HLT Instruction". */
+      timer_idle_enter ();
       asm volatile ("sti; hlt" : : : "memory");
     }
 }
@@ -492,6 +768,7 @@ kernel_thread (thread_func *function, void *aux)
 {
   ASSERT (function != NULL);
 
+  thread_resume ();
   intr_enable ();       /* The scheduler runs with interrupts off. */
   function (aux);       /* Execute the thread function. */
   thread_exit ();       /* If function() returns, kill the thread. */
@@ -504,11 +781,12 @@ running_thread (void)
   uint32_t *esp;
 
   /* Copy the CPU's stack pointer into `esp', and then round that
-     down to the start of a page.  Because `struct thread' is
-     always at the beginning of a page and the stack pointer is
+     down to the start of its stack.  Because `struct thread' is
+     always at the beginning of the page or, for a large stack,
+     the slot that holds the stack, and the stack pointer is
      somewhere in the middle, this locates the curent thread. */
   asm ("mov %%esp, %0" : "=g" (esp));
-  return pg_round_down (esp);
+  return kstack_thread (esp);
 }
 
 /* Returns true if T appears to point to a valid thread. */
@@ -528,23 +806,39 @@ init_thread (struct thread *t, const char *name, int priority)
   ASSERT (name != NULL);
 
   memset (t, 0, sizeof *t);
+  t->acct.since = clock_cycles ();
   t->status = THREAD_BLOCKED;
   strlcpy (t->name, name, sizeof t->name);
-  t->stack = (uint8_t *) t + PGSIZE;
-  t->priority = priority;
+  t->stack = kstack_top (t);
+  t->priority = t->base_priority = priority;
+  list_init (&t->held_locks);
+  t->wait_lock = NULL;
+#ifdef USERPROG
+  t->exit_status = -1;
+  list_init (&t->running_children);
+  list_init (&t->exited_children);
+#endif
   t->magic = THREAD_MAGIC;
   t->ptid = running_thread()->tid;
   t->lifetime = LLONG_MAX;
   t->ticks = 0;
+  timeout_init (&t->lifetime_timeout, lifetime_expired, t);
   running_thread()->total++;
   running_thread()->alive++;
   t->mask = 0;
+  list_init (&t->queued_signals);
+  t->sigwaiter = NULL;
   t->total = t->alive = 0;
-  int i;
-  for (i = 0; i < SIG_COUNT; ++i)
-    t->signals[i].type = -1;
-  list_init(&t->signals_queue);
+  list_init (&t->children);
+  if (t != running_thread ()) {
+    enum intr_level old_level = intr_disable ();
+    t->parent = running_thread ();
+    list_push_back (&t->parent->children, &t->child_elem);
+    intr_set_level (old_level);
+  }
+  enum intr_level old_level = intr_disable ();
   list_push_back (&all_list, &t->allelem);
+  intr_set_level (old_level);
 }
 
 /* Allocates a SIZE-byte frame at the top of thread T's stack and
@@ -564,14 +858,21 @@ alloc_frame (struct thread *t, size_t size)
    return a thread from the run queue, unless the run queue is
    empty.  (If the running thread can continue running, then it
    will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
+   idle_thread.  Threads whose throttled CPU budget is used up
+   are parked along the way, until their group's next period. */
 static struct thread *
 next_thread_to_run (void) 
 {
-  if (list_empty (&ready_list))
-    return idle_thread;
-  else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+  while (!list_empty (&ready_list))
+    {
+      struct thread *t = list_entry (list_pop_front (&ready_list),
+                                     struct thread, elem);
+      if (t->cpu_group == NULL || !t->cpu_group->throttle
+          || !cpu_group_exhausted (t->cpu_group))
+        return t;
+      cpu_group_park (t);
+    }
+  return idle_thread;
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -607,6 +908,7 @@ thread_schedule_tail (struct thread *prev)
   /* Activate the new address space. */
   process_activate ();
 #endif
+  fpu_switch (cur);
 
   /* If the thread we switched from is dying, destroy its struct
      thread.  This must happen late so that thread_exit() doesn't
@@ -616,8 +918,84 @@ thread_schedule_tail (struct thread *prev)
   if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread) 
     {
       ASSERT (prev != cur);
-      palloc_free_page (prev);
+      free_thread_page (prev);
+    }
+}
+
+/* Returns a page for a new thread, from thread_cache if it has
+   one and otherwise from palloc, or a null pointer if memory is
+   short.  With large kernel stacks, returns a stack slot from
+   kstack_alloc() instead.  The page is not zeroed: init_thread()
+   clears struct thread, and the stack needs no clearing. */
+static struct thread *
+alloc_thread_page (void)
+{
+  struct thread *t = NULL;
+  enum intr_level old_level;
+
+  if (kstack_size > PGSIZE)
+    return kstack_alloc ();
+
+  old_level = intr_disable ();
+  if (!list_empty (&thread_cache))
+    {
+      t = list_entry (list_pop_front (&thread_cache), struct thread, elem);
+      thread_cache_cnt--;
     }
+  intr_set_level (old_level);
+
+  return t != NULL ? t : palloc_get_page (0);
+}
+
+/* Frees T's page, keeping it in thread_cache if there is room,
+   or T's stack slot.  Clears T's magic number, so that is_thread() rejects stale
+   pointers to it. */
+static void
+free_thread_page (struct thread *t)
+{
+  enum intr_level old_level;
+
+  if (kstack_owns (t))
+    {
+      t->magic = 0;
+      kstack_free (t);
+      return;
+    }
+
+  old_level = intr_disable ();
+  t->magic = 0;
+  if (thread_cache_cnt < THREAD_CACHE_MAX)
+    {
+      list_push_front (&thread_cache, &t->elem);
+      thread_cache_cnt++;
+      t = NULL;
+    }
+  intr_set_level (old_level);
+
+  if (t != NULL)
+    palloc_free_page (t);
+}
+
+/* Gives thread_cache's pages back when the kernel pool comes
+   under pressure. */
+static void
+drain_thread_cache (enum palloc_flags pool, size_t free_cnt UNUSED,
+                    void *aux UNUSED)
+{
+  enum intr_level old_level;
+
+  if (pool & PAL_USER)
+    return;
+
+  old_level = intr_disable ();
+  while (!list_empty (&thread_cache))
+    {
+      struct thread *t = list_entry (list_pop_front (&thread_cache),
+                                     struct thread, elem);
+      thread_cache_cnt--;
+      palloc_free_page (t);
+    }
+  intr_set_level (old_level);
 }
 
 /* Schedules a new process.  At entry, interrupts must be off and
@@ -639,60 +1017,316 @@ schedule (void)
 
   ASSERT (intr_get_level () == INTR_OFF);
   ASSERT (cur->status != THREAD_RUNNING);
+  ASSERT (cur->rcu_nesting == 0);
   ASSERT (is_thread (next));
 
+  rcu_quiescent ();
+
+  if (cur == idle_thread && next != cur)
+    timer_idle_exit ();
   if (cur != next)
-    prev = switch_threads (cur, next);
-  thread_schedule_tail (prev);
-  struct list_elem * e;
-  // if (running_thread()->tid > 2)printf("%d %lld %lld\n", running_thread()->tid, running_thread()->ticks, running_thread()->lifetime);
-  for (e = list_begin(&to_unblock_list); e != list_end(&to_unblock_list);) {
-    struct list_elem * ee = list_next(e);
-    struct thread * s = list_entry(e, struct thread, blkelem);
-    list_remove(e);
-    if (s->status == THREAD_BLOCKED)
-      thread_unblock(s);
-    e = ee;
-  }
-  for (e = list_begin(&running_thread()->signals_queue); e != list_end(&running_thread()->signals_queue);) {
-    struct list_elem * ee = list_next(e);
-    struct signal_t * s = list_entry(e, struct signal_t, threadelem);
-    if (s->type == SIG_CHLD) {
-      SIG_CHLD_DFL(s->sent_by);
-    }
-    else if (s->type == SIG_KILL) {
-      SIG_KILL_DFL(s->sent_by);
-    }
-    else if (s->type == SIG_CPU) {
-      SIG_CPU_DFL(s->sent_by);
-    }
-    else if (s->type == SIG_USER) {
-      SIG_USER_DFL(s->sent_by);
+    {
+      sched_trace_switch (cur, -1, next, -1);
+      acct_switch (cur, next);
+      prev = switch_threads (cur, next);
     }
-    list_remove(e);
-    s->type = -1;
-    e = ee;
-  }
+  thread_schedule_tail (prev);
 }
 
-/* Returns a tid to use for a new thread. */
+/* Called on the way back into a thread that has been scheduled
+   again, after schedule() returns, with interrupts off: unblocks
+   delivers the running thread's pending signals.  This is gated
+   by a single test, so a switch with nothing to do stays cheap,
+   and schedule() itself never runs signal handlers. */
+static void
+thread_resume (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (running_thread()->pending != 0)
+    signal_deliver ();
+}
+
+/* Charges the time since CUR and NEXT last changed state when the
+   scheduler switches from CUR to NEXT: NEXT was ready that long,
+   and CUR, which is now ready, blocked, or dying, starts its next
+   interval. */
+static void
+acct_switch (struct thread *cur, struct thread *next)
+{
+  uint64_t now = clock_cycles ();
+
+  if (cur->status == THREAD_READY)
+    cur->acct.involuntary++;
+  else if (cur->status == THREAD_BLOCKED)
+    cur->acct.voluntary++;
+  cur->acct.since = now;
+
+  next->acct.ready_cycles += now - next->acct.since;
+  next->acct.since = now;
+}
+
+/* Prints thread T's CPU accounting.  Suitable for
+   thread_foreach(). */
+static void
+print_acct (struct thread *t, void *aux UNUSED)
+{
+  struct thread_acct a = t->acct;
+
+  if (t == idle_thread)
+    return;
+  printf ("Thread %s (tid %d): %lld user ticks, %lld kernel ticks, "
+          "%"PRIu64" ns in interrupts; %u voluntary, %u involuntary "
+          "switches; %"PRIu64" ns ready, %"PRIu64" ns blocked\n",
+          t->name, t->tid, a.user_ticks, a.kernel_ticks,
+          clock_cycles_to_ns (a.intr_cycles), a.voluntary, a.involuntary,
+          clock_cycles_to_ns (a.ready_cycles),
+          clock_cycles_to_ns (a.blocked_cycles));
+}
+
+/* Returns a tid to use for new thread T, recording T in the tid
+   table, or TID_ERROR if the table is full. */
 static tid_t
-allocate_tid (void) 
+allocate_tid (struct thread *t) 
 {
-  static tid_t next_tid = 1;
-  tid_t tid;
+  enum intr_level old_level;
+  tid_t tid = TID_ERROR;
+  int slot;
 
-  lock_acquire (&tid_lock);
-  tid = next_tid++;
+  lock_acquire_adaptive (&tid_lock);
+  if (tid_free >= 0 || tid_slots_used < tid_slot_cnt || grow_tids ())
+    {
+      old_level = intr_disable ();
+      if (tid_free >= 0)
+        {
+          slot = tid_free;
+          tid_free = tid_slots[slot].next_free;
+        }
+      else
+        slot = tid_slots_used++;
+      tid_slots[slot].thread = t;
+      tid = ((tid_slots[slot].gen & TID_GEN_MASK) << TID_SLOT_BITS) | slot;
+      intr_set_level (old_level);
+    }
   lock_release (&tid_lock);
 
   return tid;
 }
+
+/* Doubles the size of the tid table.  Returns false if it is
+   already as large as it can be or memory is short.  Must be
+   called with tid_lock held. */
+static bool
+grow_tids (void)
+{
+  size_t old_pages = DIV_ROUND_UP (tid_slot_cnt * sizeof *tid_slots, PGSIZE);
+  int new_cnt = tid_slot_cnt * 2;
+  struct tid_slot *old = tid_slots, *new;
+  enum intr_level old_level;
+
+  ASSERT (lock_held_by_current_thread (&tid_lock));
+  if (new_cnt > TID_SLOTS_MAX)
+    return false;
+  new = palloc_get_multiple (PAL_ZERO, DIV_ROUND_UP (new_cnt * sizeof *new,
+                                                     PGSIZE));
+  if (new == NULL)
+    return false;
+
+  old_level = intr_disable ();
+  memcpy (new, old, tid_slot_cnt * sizeof *new);
+  tid_slots = new;
+  tid_slot_cnt = new_cnt;
+  intr_set_level (old_level);
+
+  synchronize_rcu ();
+  if (old != tid_slots_init)
+    palloc_free_multiple (old, old_pages);
+  return true;
+}
+
+/* Frees TID's slot in the tid table for reuse.  Interrupts must
+   be off. */
+static void
+release_tid (tid_t tid)
+{
+  int slot = tid & (TID_SLOTS_MAX - 1);
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (tid_slots[slot].thread != NULL && tid_slots[slot].thread->tid == tid);
+
+  tid_slots[slot].thread = NULL;
+  tid_slots[slot].gen++;
+  tid_slots[slot].next_free = tid_free;
+  tid_free = slot;
+}
 
 /* Offset of `stack' member within `struct thread'.
    Used by switch.S, which can't figure it out on its own. */
 uint32_t thread_stack_ofs = offsetof (struct thread, stack);
 
 void setlifetime(long long X) {
-  running_thread()->lifetime = X;
-}
\ No newline at end of file
+  enum intr_level old_level = intr_disable ();
+  struct thread *cur = running_thread ();
+
+  cur->lifetime = X;
+  timeout_cancel (&cur->lifetime_timeout);
+  lifetime_arm (cur);
+  intr_set_level (old_level);
+}
+
+/* Returns the number of ticks T has spent running or ready to
+   run. */
+static long long
+lifetime_ticks (struct thread *t)
+{
+  if (t->status == THREAD_BLOCKED)
+    return t->ticks;
+  return t->ticks + timer_ticks () - t->active_since;
+}
+
+/* Adds T's lifetime timeout, to fire at the tick at which T
+   outlives its lifetime, if it has one.  T must be running or
+   ready to run and its timeout not pending.  Lifetimes are
+   enforced this way, rather than by charging every ready thread
+   at every tick, so that a tick costs the same however many
+   threads are ready. */
+static void
+lifetime_arm (struct thread *t)
+{
+  if (t->lifetime != LLONG_MAX)
+    timeout_add (&t->lifetime_timeout,
+                 t->lifetime - lifetime_ticks (t) + 1);
+}
+
+/* Lifetime timeout function: AUX is the thread. */
+static void
+lifetime_expired (struct timeout *timeout UNUSED, void *aux)
+{
+  thread_check_lifetime (aux);
+}
+
+/* Queues SIG_CPU for T if T has outlived its lifetime and does
+   not ignore SIG_CPU.  Called when T's lifetime timeout fires
+   and when T stops ignoring signals. */
+void
+thread_check_lifetime (struct thread *t)
+{
+  enum intr_level old_level = intr_disable ();
+
+  if (lifetime_ticks (t) > t->lifetime
+      && !((t->pending >> SIG_CPU) & 1) && !((t->mask >> SIG_CPU) & 1))
+    signal_raise (t, SIG_CPU, t->tid);
+  intr_set_level (old_level);
+}
+
+/* Initializes G as a CPU budget of QUOTA ticks every PERIOD
+   ticks, with no members.  If THROTTLE is true, members that
+   use up the budget are parked until the next period;
+   otherwise, each tick a member runs over budget queues
+   SIG_CPU for it, whose default action is thread_exit(). */
+void
+cpu_group_init (struct cpu_group *g, long long quota, long long period,
+                bool throttle)
+{
+  ASSERT (quota > 0 && period > 0);
+
+  g->quota = quota;
+  g->period = period;
+  g->used = 0;
+  g->period_start = timer_ticks ();
+  g->throttle = throttle;
+  g->members = 0;
+  list_init (&g->throttled);
+  timeout_init (&g->refill, cpu_group_refill, g);
+}
+
+/* Moves the running thread into CPU budget G, or out of its
+   budget if G is null.  Threads it creates later start in the
+   same budget. */
+void
+cpu_group_join (struct cpu_group *g)
+{
+  enum intr_level old_level = intr_disable ();
+  struct thread *cur = running_thread ();
+
+  if (cur->cpu_group != NULL && --cur->cpu_group->members == 0)
+    timeout_cancel (&cur->cpu_group->refill);
+  cur->cpu_group = g;
+  if (g != NULL)
+    g->members++;
+  intr_set_level (old_level);
+}
+
+/* Returns true if G has used up its quota for the current
+   period, first starting a new period if the last one is
+   over. */
+static bool
+cpu_group_exhausted (struct cpu_group *g)
+{
+  int64_t now = timer_ticks ();
+
+  if (now - g->period_start >= g->period)
+    {
+      g->period_start = now - (now - g->period_start) % g->period;
+      g->used = 0;
+    }
+  return g->used >= g->quota;
+}
+
+/* Charges a tick that running thread T used to its CPU budget,
+   and if that exhausts the budget, yields so that
+   next_thread_to_run() parks T, or queues SIG_CPU for T, as the
+   group asks.  Runs in the timer interrupt. */
+static void
+cpu_group_charge (struct thread *t)
+{
+  struct cpu_group *g = t->cpu_group;
+
+  cpu_group_exhausted (g);
+  if (++g->used < g->quota)
+    return;
+  if (g->throttle)
+    intr_yield_on_return ();
+  else if (!((t->pending >> SIG_CPU) & 1) && !((t->mask >> SIG_CPU) & 1))
+    signal_raise (t, SIG_CPU, t->tid);
+}
+
+/* Parks T, just taken off the run queue or just made ready by the
+   running thread's yield, on its exhausted group's throttled
+   list, and arranges for the group's refill at the end of the
+   period.  From here T is blocked, as if by thread_block(). */
+static void
+cpu_group_park (struct thread *t)
+{
+  struct cpu_group *g = t->cpu_group;
+
+  if (t != running_thread ())
+    {
+      /* The running thread's ready time ends in acct_switch(). */
+      uint64_t now = clock_cycles ();
+      t->acct.ready_cycles += now - t->acct.since;
+      t->acct.since = now;
+    }
+  t->ticks += timer_ticks () - t->active_since;
+  timeout_cancel (&t->lifetime_timeout);
+  t->status = THREAD_BLOCKED;
+  list_push_back (&g->throttled, &t->elem);
+  if (!g->refill.pending)
+    timeout_add (&g->refill, g->period_start + g->period - timer_ticks ());
+}
+
+/* Refill timeout function: AUX is a throttled cpu_group, whose
+   period is over.  Starts the next one and makes the parked
+   members ready again. */
+static void
+cpu_group_refill (struct timeout *timeout UNUSED, void *aux)
+{
+  struct cpu_group *g = aux;
+
+  g->period_start = timer_ticks ();
+  g->used = 0;
+  while (!list_empty (&g->throttled))
+    thread_unblock (list_entry (list_pop_front (&g->throttled),
+                                struct thread, elem));
+  thread_check_preempt ();
+}
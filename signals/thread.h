@@ -3,8 +3,9 @@
 
 #include <debug.h>
 #include <list.h>
+#include <random.h>
 #include <stdint.h>
-#include <hash.h>
+#include "devices/timer.h"
 #include "threads/signal.h"
 
 /* States in a thread's life cycle. */
@@ -26,6 +27,33 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Per-thread CPU accounting.  Updated with interrupts off by the
+   scheduler and by the timer and interrupt handlers, so read it
+   with interrupts off too. */
+struct thread_acct
+  {
+    /* Updated on every switch. */
+    uint64_t since;             /* Cycle count when it last became
+                                   ready, blocked, or running. */
+    uint64_t ready_cycles;      /* Waiting on the ready queue. */
+    unsigned voluntary;         /* Switches away because it blocked. */
+    unsigned involuntary;       /* Switches away while still ready. */
+
+    /* Updated on every tick, wakeup, or interrupt. */
+    int64_t user_ticks;         /* Ticks that interrupted user code. */
+    int64_t kernel_ticks;       /* Ticks that interrupted the kernel. */
+    uint64_t blocked_cycles;    /* Blocked. */
+    uint64_t intr_cycles;       /* In external interrupt handlers. */
+  };
+
+/* Size of a CPU cache line.  The members of struct thread that
+   the scheduler and the timer interrupt use on every switch and
+   tick come first, within one line, and the accounting that the
+   same paths update fills the next, so that a switch touches two
+   lines of each thread instead of fields scattered across the
+   structure.  thread_init() checks that they still fit. */
+#define THREAD_LINE_SIZE 64
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -52,8 +80,9 @@ typedef int tid_t;
              |              magic              |
              |                :                |
              |                :                |
-             |               name              |
+             |               acct              |
              |              status             |
+             |              stack              |
         0 kB +---------------------------------+
 
    The upshot of this is twofold:
@@ -83,36 +112,131 @@ typedef int tid_t;
    ready state is on the run queue, whereas only a thread in the
    blocked state is on a semaphore wait list. */
 
+/* A CPU-time budget shared by a group of threads, such as the
+   threads of one job.  Each tick that a member runs is charged
+   to the group, and once a period's QUOTA ticks are used up,
+   members either receive SIG_CPU or, if THROTTLE is set, are not
+   scheduled again until the next period begins.  Owned by
+   thread.c, and accessed only with interrupts off.  A group must
+   outlive its members. */
+struct cpu_group
+  {
+    long long quota;                    /* Ticks per period. */
+    long long period;                   /* Length of a period, in ticks. */
+    long long used;                     /* Ticks charged this period. */
+    int64_t period_start;               /* Tick the period began. */
+    bool throttle;                      /* Park members when exhausted? */
+    int members;                        /* Threads in the group. */
+    struct list throttled;              /* Members parked until refill. */
+    struct timeout refill;              /* Ends the period of a
+                                           throttled group. */
+  };
+
 struct thread * thread_lookup (const int tid);
-extern struct list to_unblock_list;
 struct thread
   {
-    /* Owned by thread.c. */
-    long long lifetime;
-    long long ticks;
-    struct hash_elem hash_elem;
-    tid_t tid;                          /* Thread identifier. */
+    /* Used on every switch or tick.  Owned by thread.c.  Must fit
+       in THREAD_LINE_SIZE bytes. */
+    uint8_t *stack;                     /* Saved stack pointer. */
     enum thread_status status;          /* Thread state. */
+    int priority;                       /* Priority, with donations. */
+    tid_t tid;                          /* Thread identifier. */
+    long long lifetime;                 /* Ticks until SIG_CPU. */
+    long long ticks;                    /* Ticks run or ready, up to
+                                           active_since. */
+    int64_t active_since;               /* Tick it was last unblocked. */
+
+    /* Shared between thread.c and synch.c. */
+    struct list_elem elem;              /* List element. */
+    sigset_t pending;                   /* Signals awaiting delivery. */
+    sigset_t mask;                      /* Signals ignored. */
+
+    /* CPU accounting, owned by thread.c, in a line of its own. */
+    struct thread_acct acct __attribute__ ((aligned (THREAD_LINE_SIZE)));
+
+    /* The rest is used less often. */
     char name[16];                      /* Name (for debugging purposes). */
-    uint8_t *stack;                     /* Saved stack pointer. */
-    int priority;                       /* Priority. */
+    int base_priority;                  /* Priority without donations. */
+    struct list held_locks;             /* Locks held. */
+    struct lock *wait_lock;             /* Lock being waited for. */
+    struct waiter *waiter;              /* Wait in a waitqueue, or null.
+                                           Owned by synch.c. */
+    int rcu_nesting;                    /* Read-side section depth. */
+    bool rcu_yield;                     /* Yield when it reaches 0?
+                                           Owned by rcu.c. */
+    struct timeout lifetime_timeout;    /* Queues SIG_CPU. */
+    struct cpu_group *cpu_group;        /* CPU budget, or null. */
     int ptid;
     int total, alive;
+    struct thread *parent;              /* Parent, or NULL if none. */
+    struct list children;               /* Child threads. */
+    struct list_elem child_elem;        /* Element in parent's children. */
     struct list_elem allelem;           /* List element for all threads list. */
+    struct prng prng;                   /* Random numbers, for thread_prng(). */
 
-    /* Shared between thread.c and synch.c. */
-    struct list_elem elem;              /* List element. */
-    struct list_elem blkelem;              /* List element. */
-    struct list signals_queue;
-    struct signal_t signals[5];
-    sigset_t mask;
+    /* Owned by threads/signal.c. */
+    int sent_by[SIG_COUNT];             /* Sender of each pending signal. */
+    int64_t pending_since[SIG_COUNT];   /* Tick each was raised. */
+    struct list queued_signals;         /* Queued SIG_RT and SIG_IO
+                                           instances. */
+    int queued_cnt;                     /* Length of queued_signals. */
+    struct sigwaiter *sigwaiter;        /* Set while in sigtimedwait(). */
+    struct sighandlers *sighandlers;    /* Installed handlers, or null
+                                           until the first sigaction(). */
 
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */
+    struct vdso *vdso;                  /* Time page, or null. */
+    int exit_status;                    /* Status passed to exit(). */
+    struct exit_record *exit_record;    /* Shared with the parent, or
+                                           null if none. */
+    struct list running_children;       /* Exit records of live children. */
+    struct list exited_children;        /* Exit records not yet reaped. */
+    struct semaphore *reaper;           /* Upped when a child exits, in
+                                           process_wait_any(). */
+    uint8_t *heap_start;                /* Start of the heap. */
+    uint8_t *heap_break;                /* End of the heap, moved by
+                                           process_sbrk(). */
+
+    /* Owned by userprog/syscall.c. */
+    struct fd *fds;                     /* Open files and pipes, by
+                                           handle. */
+    struct bitmap *fd_map;              /* File handles in use. */
+    struct pipe *stdio[2];              /* Pipes standing in for the
+                                           console's input and output,
+                                           or nulls. */
+#endif
+#ifdef VM
+    /* Owned by vm/page.c. */
+    struct hash *pages;                 /* Supplemental page table. */
+    struct file *exec_file;             /* Executable, read on demand. */
+    void *user_esp;                     /* User stack pointer at the
+                                           last system call. */
+    struct list mappings;               /* Memory-mapped files. */
+    int next_mapid;                     /* Next mapping identifier. */
+    unsigned minor_faults;              /* Pages mapped without I/O. */
+    unsigned major_faults;              /* Pages read from file or swap. */
+    unsigned cow_faults;                /* Copy-on-write pages made private. */
+
+    /* Owned by vm/frame.c. */
+    unsigned age_pass;                  /* Aging pass that counted these. */
+    size_t resident_cnt;                /* Pages in frames. */
+    size_t ws_cnt;                      /* Of those, pages in the working
+                                           set. */
 #endif
+#ifdef FILESYS
+    /* Owned by filesys/journal.c. */
+    int journal_depth;                  /* Nesting of journal_begin(). */
+#endif
+
+    /* Owned by threads/fpu.c. */
+    void *fpu;                          /* Saved FPU state, or null if
+                                           the thread has not used the
+                                           FPU. */
 
-    /* Owned by thread.c. */
+    /* Owned by thread.c.  Last, nearest the stack, to catch it
+       overflowing. */
     unsigned magic;                     /* Detects stack overflow. */
   };
 
@@ -120,11 +244,21 @@ struct thread
    If true, use multi-level feedback queue scheduler.
    Controlled by kernel command-line option "-o mlfqs". */
 extern bool thread_mlfqs;
+
+/* If true, print each thread's CPU accounting when it exits and,
+   for the threads still alive, at shutdown.  Controlled by kernel
+   command-line option "-acct". */
+extern bool thread_acct_print;
 void setlifetime(long long X);
+void thread_check_lifetime (struct thread *);
+void cpu_group_init (struct cpu_group *, long long quota,
+                     long long period, bool throttle);
+void cpu_group_join (struct cpu_group *);
 void thread_init (void);
 void thread_start (void);
 
-void thread_tick (void);
+void thread_tick (bool user);
+void thread_idle_tick (void);
 void thread_print_stats (void);
 
 typedef void thread_func (void *aux);
@@ -136,6 +270,7 @@ void thread_unblock (struct thread *);
 struct thread *thread_current (void);
 tid_t thread_tid (void);
 const char *thread_name (void);
+struct prng *thread_prng (void);
 
 void thread_exit (void) NO_RETURN;
 void thread_yield (void);
@@ -146,6 +281,11 @@ void thread_foreach (thread_action_func *, void *);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
+void thread_donate_priority (struct thread *, int priority);
+void thread_update_priority (struct thread *);
+void thread_check_preempt (void);
+bool thread_priority_less (const struct list_elem *,
+                           const struct list_elem *, void *aux);
 
 int thread_get_nice (void);
 void thread_set_nice (int);